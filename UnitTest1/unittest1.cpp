@@ -830,6 +830,13 @@ namespace UnitTest1
             Assert::AreEqual(ret, 0);
         }
 
+        TEST_METHOD(retry_flood)
+        {
+            int ret = tls_api_retry_flood_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
         TEST_METHOD(retry_token)
         {
             int ret = tls_retry_token_test();
@@ -950,6 +957,13 @@ namespace UnitTest1
             Assert::AreEqual(ret, 0);
         }
 
+        TEST_METHOD(token_store_expiry)
+        {
+            int ret = token_store_expiry_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
         TEST_METHOD(token_reuse_api)
         {
             int ret = token_reuse_api_test();
@@ -957,6 +971,13 @@ namespace UnitTest1
             Assert::AreEqual(ret, 0);
         }
 
+        TEST_METHOD(shared_registry)
+        {
+            int ret = shared_registry_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
         TEST_METHOD(test_session_resume)
         {
             int ret = session_resume_test();
@@ -1216,6 +1237,13 @@ namespace UnitTest1
             Assert::AreEqual(ret, 0);
         }
 
+        TEST_METHOD(initial_key_bench)
+        {
+            int ret = initial_key_bench_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
         TEST_METHOD(dtn_basic)
         {
             int ret = dtn_basic_test();
@@ -1306,6 +1334,13 @@ namespace UnitTest1
 
             Assert::AreEqual(ret, 0);
         }
+
+        TEST_METHOD(tls_master_shared)
+        {
+            int ret = tls_master_shared_test();
+
+            Assert::AreEqual(ret, 0);
+        }
     
         TEST_METHOD(nat_rebinding)
         {
@@ -1669,6 +1704,83 @@ namespace UnitTest1
             Assert::AreEqual(ret, 0);
         }
 
+        TEST_METHOD(qlog_trace_background)
+        {
+            int ret = qlog_trace_background_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(qlog_trace_ring)
+        {
+            int ret = qlog_trace_ring_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(binlog_ring_bench)
+        {
+            int ret = binlog_ring_bench_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(qlog_trace_segment)
+        {
+            int ret = qlog_trace_segment_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(binlog_segment)
+        {
+            int ret = binlog_segment_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(binlog_sampling)
+        {
+            int ret = binlog_sampling_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(binlog_flight_recorder)
+        {
+            int ret = binlog_flight_recorder_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(qlog_trace_compact)
+        {
+            int ret = qlog_trace_compact_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(qlog_trace_compact_segment)
+        {
+            int ret = qlog_trace_compact_segment_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(qlog_trace_threshold)
+        {
+            int ret = qlog_trace_threshold_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(qlog_trace_batch)
+        {
+            int ret = qlog_trace_batch_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
         TEST_METHOD(path_packet_queue)
         {
             int ret = path_packet_queue_test();
@@ -1682,6 +1794,27 @@ namespace UnitTest1
 
             Assert::AreEqual(ret, 0);
         }
+
+        TEST_METHOD(perflog_stream)
+        {
+            int ret = perflog_stream_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(metrics)
+        {
+            int ret = metrics_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(phase_profile)
+        {
+            int ret = phase_profile_test();
+
+            Assert::AreEqual(ret, 0);
+        }
         TEST_METHOD(nat_rebinding_stress)
         {
             int ret = rebinding_stress_test();
@@ -2746,6 +2879,12 @@ namespace UnitTest1
             Assert::AreEqual(ret, 0);
         }
 
+        TEST_METHOD(qpack_huffman_encode) {
+            int ret = qpack_huffman_encode_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
         TEST_METHOD(h3zero_parse_qpack) {
             int ret = h3zero_parse_qpack_test();
 
@@ -2854,6 +2993,78 @@ namespace UnitTest1
             Assert::AreEqual(ret, 0);
         }
 
+        TEST_METHOD(h3zero_file_cache) {
+            int ret = h3zero_file_cache_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(h3zero_file_cache_bench) {
+            int ret = h3zero_file_cache_bench_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(h3zero_response_cache) {
+            int ret = h3zero_response_cache_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(h3zero_response_cache_bench) {
+            int ret = h3zero_response_cache_bench_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(h3zero_priority) {
+            int ret = h3zero_priority_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(h3zero_priority_page_load) {
+            int ret = h3zero_priority_page_load_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(h3zero_frame_pool) {
+            int ret = h3zero_frame_pool_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(h3zero_stream_index) {
+            int ret = h3zero_stream_index_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(h3zero_loadgen_histogram) {
+            int ret = h3zero_loadgen_histogram_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(h3zero_loadgen) {
+            int ret = h3zero_loadgen_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(h3zero_router) {
+            int ret = h3zero_router_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(h3zero_router_bench) {
+            int ret = h3zero_router_bench_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
         TEST_METHOD(h3zero_satellite) {
             int ret = h3zero_satellite_test();
 
@@ -2932,6 +3143,24 @@ namespace UnitTest1
             Assert::AreEqual(ret, 0);
         }
 
+        TEST_METHOD(h3zero_qpack_dynamic) {
+            int ret = h3zero_qpack_dynamic_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(h3zero_qpack_bench) {
+            int ret = h3zero_qpack_bench_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(h3zero_qpack_huffman_bench) {
+            int ret = h3zero_qpack_huffman_bench_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
         TEST_METHOD(http_drop) {
             int ret = http_drop_test();
 
@@ -2986,6 +3215,12 @@ namespace UnitTest1
             Assert::AreEqual(ret, 0);
         }
 
+        TEST_METHOD(picowt_baton_datagram) {
+            int ret = picowt_baton_datagram_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
         TEST_METHOD(grease_quic_bit_one_way) {
             int ret = grease_quic_bit_one_way_test();
 
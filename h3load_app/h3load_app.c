@@ -0,0 +1,372 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* HTTP/3 load generator, in the style of h2load.
+ *
+ * The load is spread over several threads. Each thread runs its own QUIC
+ * context and packet loop, with a share of the connections, requests and
+ * request rate. The statistics of all threads are merged at the end of the
+ * test.
+ *
+ * Session tickets received by a thread are kept in its QUIC context, so that
+ * connections replaced after the requests per connection limit can resume
+ * with 0-RTT. If a ticket store is specified, the first thread loads it at
+ * start and saves it at the end, so that the next test can also use 0-RTT.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WINDOWS
+#include "getopt.h"
+#endif
+#include <picosocks.h>
+#include <picoquic.h>
+#include <picoquic_utils.h>
+#include <picoquic_packet_loop.h>
+#include <h3zero.h>
+#include <h3zero_common.h>
+#include "h3zero_loadgen.h"
+
+#define H3LOAD_MAX_THREADS 64
+#define H3LOAD_MAX_PATHS 1024
+
+typedef struct st_h3load_thread_ctx_t {
+    h3zero_loadgen_config_t config;
+    char const* ticket_store_filename;
+    picoquic_quic_t* quic;
+    h3zero_loadgen_ctx_t* lg_ctx;
+    picoquic_thread_t thread;
+    int ret;
+} h3load_thread_ctx_t;
+
+static void usage(char const* sample_name)
+{
+    fprintf(stderr, "Usage:\n");
+    fprintf(stderr, "    %s [options] server_name port [path ...]\n", sample_name);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -c number    number of connections (default 1)\n");
+    fprintf(stderr, "  -m number    concurrent streams per connection (default 1)\n");
+    fprintf(stderr, "  -t number    number of threads (default 1)\n");
+    fprintf(stderr, "  -n number    total number of requests (default 1, 0 if -D is set)\n");
+    fprintf(stderr, "  -D seconds   test duration\n");
+    fprintf(stderr, "  -r number    total request rate per second, open loop (default closed loop)\n");
+    fprintf(stderr, "  -R number    requests per connection before opening a new one\n");
+    fprintf(stderr, "  -i file      read the paths from a file, one per line\n");
+    fprintf(stderr, "  -T template  path template, with \"{n}\" replaced by the request number\n");
+    fprintf(stderr, "  -N number    range of the template request numbers\n");
+    fprintf(stderr, "  -S sni       server name indication\n");
+    fprintf(stderr, "  -s file      session ticket store, for 0-RTT across runs\n");
+    fprintf(stderr, "  -h           this help message\n");
+    exit(1);
+}
+
+static uint64_t get_number(char const* sample_name, char const* arg)
+{
+    char* end = NULL;
+    uint64_t x = (uint64_t)strtoull(arg, &end, 10);
+
+    if (end == arg || *end != 0) {
+        fprintf(stderr, "Invalid number: %s\n", arg);
+        usage(sample_name);
+    }
+
+    return x;
+}
+
+/* Read the list of paths, one per line. Empty lines are ignored. */
+static int load_paths(char const* file_name, char** paths, size_t* nb_paths)
+{
+    int ret = 0;
+    FILE* F = picoquic_file_open(file_name, "r");
+
+    if (F == NULL) {
+        fprintf(stderr, "Cannot open <%s>\n", file_name);
+        ret = -1;
+    }
+    else {
+        char line[H3ZERO_LOADGEN_PATH_MAX];
+
+        while (ret == 0 && *nb_paths < H3LOAD_MAX_PATHS && fgets(line, sizeof(line), F) != NULL) {
+            size_t length = strlen(line);
+
+            while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+                length--;
+            }
+            if (length > 0) {
+                if ((paths[*nb_paths] = (char*)malloc(length + 1)) == NULL) {
+                    ret = -1;
+                }
+                else {
+                    memcpy(paths[*nb_paths], line, length);
+                    paths[*nb_paths][length] = 0;
+                    *nb_paths += 1;
+                }
+            }
+        }
+        F = picoquic_file_close(F);
+    }
+
+    return ret;
+}
+
+static picoquic_thread_return_t h3load_thread(void* arg)
+{
+    h3load_thread_ctx_t* thread_ctx = (h3load_thread_ctx_t*)arg;
+
+    thread_ctx->ret = picoquic_packet_loop(thread_ctx->quic, 0, thread_ctx->config.server_address.ss_family,
+        0, 0, 0, h3zero_loadgen_loop_cb, thread_ctx->lg_ctx);
+    if (thread_ctx->ret == PICOQUIC_NO_ERROR_TERMINATE_PACKET_LOOP) {
+        thread_ctx->ret = 0;
+    }
+
+    picoquic_thread_do_return;
+}
+
+/* Divide a total between the threads, the first threads get the remainder */
+static uint64_t h3load_share(uint64_t total, size_t nb_threads, size_t i)
+{
+    return total / nb_threads + ((i < total % nb_threads) ? 1 : 0);
+}
+
+/* Each thread must get at least one connection, one request and one request
+ * per second, otherwise its share of the load would be lost. */
+static size_t h3load_max_threads(h3zero_loadgen_config_t const* config, size_t nb_threads)
+{
+    size_t max_threads = nb_threads;
+
+    if (max_threads > config->nb_connections) {
+        max_threads = config->nb_connections;
+    }
+    if (config->nb_requests > 0 && max_threads > config->nb_requests) {
+        max_threads = (size_t)config->nb_requests;
+    }
+    if (config->request_rate > 0 && max_threads > config->request_rate) {
+        max_threads = (size_t)config->request_rate;
+    }
+    if (max_threads == 0) {
+        max_threads = 1;
+    }
+    if (max_threads < nb_threads) {
+        fprintf(stderr, "Using %zu threads instead of %zu.\n", max_threads, nb_threads);
+    }
+
+    return max_threads;
+}
+
+static int h3load_run(h3zero_loadgen_config_t const* config, size_t nb_threads, char const* ticket_store_filename)
+{
+    int ret = 0;
+    h3load_thread_ctx_t* thread_ctx = NULL;
+    size_t nb_started = 0;
+    uint64_t current_time = picoquic_current_time();
+    h3zero_loadgen_stats_t stats;
+
+    nb_threads = h3load_max_threads(config, nb_threads);
+    thread_ctx = (h3load_thread_ctx_t*)malloc(nb_threads * sizeof(h3load_thread_ctx_t));
+    memset(&stats, 0, sizeof(stats));
+    h3zero_loadgen_histogram_init(&stats.ttfb);
+    h3zero_loadgen_histogram_init(&stats.completion);
+
+    if (thread_ctx == NULL) {
+        ret = -1;
+    }
+    else {
+        memset(thread_ctx, 0, nb_threads * sizeof(h3load_thread_ctx_t));
+    }
+
+    /* Create one QUIC context and one load generator per thread */
+    for (size_t i = 0; ret == 0 && i < nb_threads; i++) {
+        h3load_thread_ctx_t* t_ctx = &thread_ctx[i];
+
+        t_ctx->config = *config;
+        t_ctx->config.nb_connections = (size_t)h3load_share(config->nb_connections, nb_threads, i);
+        t_ctx->config.nb_requests = h3load_share(config->nb_requests, nb_threads, i);
+        t_ctx->config.request_rate = h3load_share(config->request_rate, nb_threads, i);
+        t_ctx->ticket_store_filename = (i == 0) ? ticket_store_filename : NULL;
+
+        t_ctx->quic = picoquic_create((uint32_t)t_ctx->config.nb_connections + 1, NULL, NULL, NULL, "h3", NULL, NULL,
+            NULL, NULL, NULL, current_time, NULL, t_ctx->ticket_store_filename, NULL, 0);
+        if (t_ctx->quic == NULL) {
+            fprintf(stderr, "Could not create the QUIC context of thread %zu\n", i);
+            ret = -1;
+        }
+        else {
+            picoquic_set_default_congestion_algorithm(t_ctx->quic, picoquic_bbr_algorithm);
+            picoquic_set_key_log_file_from_env(t_ctx->quic);
+            if ((t_ctx->lg_ctx = h3zero_loadgen_create(&t_ctx->config, t_ctx->quic)) == NULL) {
+                fprintf(stderr, "Could not create the load generator of thread %zu\n", i);
+                ret = -1;
+            }
+        }
+    }
+
+    for (size_t i = 0; ret == 0 && i < nb_threads; i++) {
+        if (picoquic_create_thread(&thread_ctx[i].thread, h3load_thread, &thread_ctx[i]) != 0) {
+            fprintf(stderr, "Could not start thread %zu\n", i);
+            ret = -1;
+        }
+        else {
+            nb_started++;
+        }
+    }
+
+    for (size_t i = 0; i < nb_started; i++) {
+        (void)picoquic_wait_thread(thread_ctx[i].thread);
+#ifdef _WINDOWS
+        CloseHandle(thread_ctx[i].thread);
+#endif
+        if (thread_ctx[i].ret != 0) {
+            fprintf(stderr, "Thread %zu returns %d (0x%x)\n", i, thread_ctx[i].ret, thread_ctx[i].ret);
+            ret = thread_ctx[i].ret;
+        }
+        h3zero_loadgen_stats_merge(&stats, &thread_ctx[i].lg_ctx->stats);
+    }
+
+    if (nb_started > 0) {
+        h3zero_loadgen_print_stats(stdout, &stats);
+    }
+
+    if (thread_ctx != NULL) {
+        for (size_t i = 0; i < nb_threads; i++) {
+            if (thread_ctx[i].lg_ctx != NULL) {
+                h3zero_loadgen_delete(thread_ctx[i].lg_ctx);
+            }
+            if (thread_ctx[i].quic != NULL) {
+                if (thread_ctx[i].ticket_store_filename != NULL &&
+                    picoquic_save_session_tickets(thread_ctx[i].quic, thread_ctx[i].ticket_store_filename) != 0) {
+                    fprintf(stderr, "Could not store the saved session tickets.\n");
+                }
+                picoquic_free(thread_ctx[i].quic);
+            }
+        }
+        free(thread_ctx);
+    }
+
+    return ret;
+}
+
+int main(int argc, char** argv)
+{
+    int ret = 0;
+    int opt;
+    h3zero_loadgen_config_t config;
+    size_t nb_threads = 1;
+    char const* path_file = NULL;
+    char const* ticket_store_filename = NULL;
+    char const* sni = NULL;
+    char* paths[H3LOAD_MAX_PATHS];
+    size_t nb_paths = 0;
+    size_t nb_file_paths = 0;
+    int is_nb_requests_set = 0;
+
+#ifdef _WINDOWS
+    WSADATA wsaData = { 0 };
+    (void)WSA_START(MAKEWORD(2, 2), &wsaData);
+#endif
+
+    memset(&config, 0, sizeof(config));
+    config.nb_connections = 1;
+    config.nb_streams = 1;
+
+    while ((opt = getopt(argc, argv, "c:m:t:n:D:r:R:i:T:N:S:s:h")) != -1) {
+        switch (opt) {
+        case 'c':
+            config.nb_connections = (size_t)get_number(argv[0], optarg);
+            break;
+        case 'm':
+            config.nb_streams = (size_t)get_number(argv[0], optarg);
+            break;
+        case 't':
+            nb_threads = (size_t)get_number(argv[0], optarg);
+            break;
+        case 'n':
+            config.nb_requests = get_number(argv[0], optarg);
+            is_nb_requests_set = 1;
+            break;
+        case 'D':
+            config.duration_us = get_number(argv[0], optarg) * 1000000;
+            break;
+        case 'r':
+            config.request_rate = get_number(argv[0], optarg);
+            break;
+        case 'R':
+            config.requests_per_connection = get_number(argv[0], optarg);
+            break;
+        case 'i':
+            path_file = optarg;
+            break;
+        case 'T':
+            config.path_template = optarg;
+            break;
+        case 'N':
+            config.template_range = get_number(argv[0], optarg);
+            break;
+        case 'S':
+            sni = optarg;
+            break;
+        case 's':
+            ticket_store_filename = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            break;
+        }
+    }
+
+    if (argc - optind < 2 || config.nb_connections == 0 || config.nb_streams == 0 ||
+        nb_threads == 0 || nb_threads > H3LOAD_MAX_THREADS) {
+        usage(argv[0]);
+    }
+    if (!is_nb_requests_set && config.duration_us == 0) {
+        config.nb_requests = 1;
+    }
+    if (path_file != NULL) {
+        ret = load_paths(path_file, paths, &nb_paths);
+        nb_file_paths = nb_paths;
+    }
+    for (int i = optind + 2; ret == 0 && i < argc && nb_paths < H3LOAD_MAX_PATHS; i++) {
+        paths[nb_paths++] = argv[i];
+    }
+    config.paths = (char const**)paths;
+    config.nb_paths = nb_paths;
+
+    if (ret == 0) {
+        char const* server_name = argv[optind];
+        int server_port = (int)get_number(argv[0], argv[optind + 1]);
+        int is_name = 0;
+
+        ret = picoquic_get_server_address(server_name, server_port, &config.server_address, &is_name);
+        if (ret != 0) {
+            fprintf(stderr, "Cannot get the IP address for <%s> port <%d>\n", server_name, server_port);
+        }
+        else {
+            config.sni = (sni != NULL) ? sni : ((is_name) ? server_name : "test");
+            ret = h3load_run(&config, nb_threads, ticket_store_filename);
+        }
+    }
+
+    for (size_t i = 0; i < nb_file_paths; i++) {
+        free(paths[i]);
+    }
+
+    exit(ret);
+}
@@ -24,97 +24,403 @@
 */
 
 #include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
 #include "logreader.h"
 #include "bytestream.h"
 #include "qlog.h"
 #include "picoquic_internal.h"
 #include "picoquic_binlog.h"
+#include "picoquic_utils.h"
 #include "picoquic.h"
+#include "autoqlog.h"
 
-int autoqlog(picoquic_cnx_t* cnx)
+static void autoqlog_write_error(char const* binlog_file_name, int error_code)
+{
+    FILE* F_err = NULL;
+    char err_file_name[512];
+    size_t name_len = strlen(binlog_file_name);
+    if (name_len > 500) {
+        name_len = 500;
+    }
+    memcpy(err_file_name, binlog_file_name, name_len);
+    memcpy(err_file_name + name_len, ".errlog", 7);
+    err_file_name[name_len + 7] = 0;
+    F_err = picoquic_file_open(err_file_name, "wt");
+    if (F_err != NULL) {
+        fprintf(F_err, "Cannot create qlog file for %s, error: %d\n", binlog_file_name, error_code);
+    }
+    (void)picoquic_file_close(F_err);
+}
+
+/* Compose the name of the qlog file for the connection. This only depends
+ * on the connection state, and is done before the conversion is queued.
+ */
+static int autoqlog_file_name(picoquic_cnx_t* cnx, char* filename, size_t filename_max, int* error_code)
+{
+    int ret = 0;
+    char cid_name[2 * PICOQUIC_CONNECTION_ID_MAX_SIZE + 1];
+
+    if (picoquic_print_connection_id_hexa(cid_name, sizeof(cid_name), &cnx->initial_cnxid) != 0) {
+        DBG_PRINTF("Cannot convert connection id for %s", cnx->binlog_file_name);
+        *error_code = 2;
+        ret = -1;
+    }
+    else
+    {
+        if (cnx->quic->use_unique_log_names) {
+            ret = picoquic_sprintf(filename, filename_max, NULL, "%s%s%s.%x.%s.%s",
+                cnx->quic->qlog_dir, PICOQUIC_FILE_SEPARATOR, cid_name, cnx->log_unique,
+                (cnx->client_mode) ? "client" : "server", "qlog");
+        }
+        else {
+            ret = picoquic_sprintf(filename, filename_max, NULL, "%s%s%s.%s.%s",
+                cnx->quic->qlog_dir, PICOQUIC_FILE_SEPARATOR, cid_name,
+                (cnx->client_mode) ? "client" : "server", "qlog");
+        }
+
+        if (ret != 0) {
+            DBG_PRINTF("Cannot format file name for connection %s in file %s", cid_name, cnx->binlog_file_name);
+            *error_code = 3;
+        }
+    }
+
+    return ret;
+}
+
+/* Convert a closed binary log to qlog. This does not refer to the connection
+ * or QUIC context, so it can run either in the packet loop or in the
+ * background worker.
+ */
+static int autoqlog_convert(picoquic_connection_id_t* initial_cnxid, char const* binlog_file_name,
+    char const* qlog_file_name, char const* qlog_dir, int delete_binlog)
 {
     int ret = 0;
-    uint64_t log_time = cnx->start_time;
+    uint64_t log_time = 0;
     uint16_t flags = 0;
     int error_code = 0;
-    FILE* f_binlog = picoquic_open_cc_log_file_for_read(cnx->binlog_file_name, &flags, &log_time);
+    FILE* f_binlog = picoquic_open_cc_log_file_for_read(binlog_file_name, &flags, &log_time);
     if (f_binlog == NULL) {
-        DBG_PRINTF("Cannot open file %s for reading.\n", cnx->binlog_file_name);
+        DBG_PRINTF("Cannot open file %s for reading.\n", binlog_file_name);
         error_code = 1;
         ret = -1;
     }
     else {
-        char filename[512];
-        char cid_name[2 * PICOQUIC_CONNECTION_ID_MAX_SIZE + 1];
-
-        if (picoquic_print_connection_id_hexa(cid_name, sizeof(cid_name), &cnx->initial_cnxid) != 0) {
-            DBG_PRINTF("Cannot convert connection id for %s", cnx->binlog_file_name);
-            error_code = 2;
-            ret = -1;
+        ret = qlog_convert(initial_cnxid, f_binlog, binlog_file_name, qlog_file_name, qlog_dir, flags);
+        picoquic_file_close(f_binlog);
+        if (ret != 0) {
+            DBG_PRINTF("Cannot convert file %s to qlog, err = %d.\n", binlog_file_name, ret);
+            error_code = 4;
         }
-        else
-        {
-            int sprintf_ret = -1;
-            if (cnx->quic->use_unique_log_names) {
-                sprintf_ret = picoquic_sprintf(filename, sizeof(filename), NULL, "%s%s%s.%x.%s.%s",
-                    cnx->quic->qlog_dir, PICOQUIC_FILE_SEPARATOR, cid_name, cnx->log_unique,
-                    (cnx->client_mode) ? "client" : "server", "qlog");
-            }
-            else {
-                sprintf_ret = picoquic_sprintf(filename, sizeof(filename), NULL, "%s%s%s.%s.%s",
-                    cnx->quic->qlog_dir, PICOQUIC_FILE_SEPARATOR, cid_name,
-                    (cnx->client_mode) ? "client" : "server", "qlog");
+        else if (delete_binlog) {
+            int last_err = 0;
+            if ((ret = picoquic_file_delete(binlog_file_name, &last_err)) != 0) {
+                DBG_PRINTF("Cannot delete file %s to qlog, err = %d.\n", binlog_file_name, last_err);
+                error_code = 5;
             }
+        }
+    }
+    if (ret != 0) {
+        autoqlog_write_error(binlog_file_name, error_code);
+    }
 
-            if (sprintf_ret != 0) {
-                DBG_PRINTF("Cannot format file name for connection %s in file %s", cid_name, cnx->binlog_file_name);
-                ret = -1;
-                error_code = 3;
-            }
-            else {
-                ret = qlog_convert(&cnx->initial_cnxid, f_binlog, cnx->binlog_file_name, filename, cnx->quic->qlog_dir, flags);
-                picoquic_file_close(f_binlog);
-                if (ret != 0) {
-                    DBG_PRINTF("Cannot convert file %s to qlog, err = %d.\n", cnx->binlog_file_name, ret);
-                    error_code = 4;
-                }
-                else {
-                    if (cnx->quic->binlog_dir == NULL) {
-                        int last_err = 0;
-                        if ((ret = picoquic_file_delete(cnx->binlog_file_name, &last_err)) != 0) {
-                            DBG_PRINTF("Cannot delete file %s to qlog, err = %d.\n", cnx->binlog_file_name, last_err);
-                            error_code = 5;
-                        }
-                    }
-                }
+    return ret;
+}
+
+/* Background conversion.
+ * Converting a binary log to qlog requires reading the whole file and
+ * rendering it as JSON, which may take several milliseconds. When the
+ * background worker is enabled, the packet loop only queues the file names
+ * and the initial CID, and a worker thread performs the conversions in
+ * order. The queue depth is bounded; when it is full, the conversion is
+ * either dropped, keeping the binary log for offline conversion, or
+ * performed inline as in the synchronous mode.
+ */
+typedef struct st_autoqlog_job_t {
+    struct st_autoqlog_job_t* next;
+    picoquic_connection_id_t initial_cnxid;
+    char* binlog_file_name;
+    char* qlog_file_name;
+    char* qlog_dir;
+    int delete_binlog;
+    struct st_autoqlog_worker_t* worker;
+} autoqlog_job_t;
+
+typedef struct st_autoqlog_worker_t {
+    picoquic_mutex_t mutex;
+    picoquic_event_t event;
+    picoquic_thread_t thread;
+    autoqlog_job_t* first;
+    autoqlog_job_t* last;
+    size_t queue_depth;
+    size_t max_queue_depth;
+    picoquic_qlog_queue_policy_enum policy;
+    int should_stop;
+    uint64_t nb_converted;
+    uint64_t nb_dropped;
+    uint64_t nb_inline;
+} autoqlog_worker_t;
+
+static void autoqlog_job_free(autoqlog_job_t* job)
+{
+    (void)picoquic_string_free(job->binlog_file_name);
+    (void)picoquic_string_free(job->qlog_file_name);
+    (void)picoquic_string_free(job->qlog_dir);
+    free(job);
+}
+
+static autoqlog_job_t* autoqlog_job_create(picoquic_cnx_t* cnx, char const* qlog_file_name)
+{
+    autoqlog_job_t* job = (autoqlog_job_t*)malloc(sizeof(autoqlog_job_t));
+
+    if (job != NULL) {
+        memset(job, 0, sizeof(autoqlog_job_t));
+        job->initial_cnxid = cnx->initial_cnxid;
+        job->delete_binlog = (cnx->quic->binlog_dir == NULL);
+        job->worker = (struct st_autoqlog_worker_t*)cnx->quic->v_autoqlog_ctx;
+        if ((job->binlog_file_name = picoquic_string_duplicate(cnx->binlog_file_name)) == NULL ||
+            (job->qlog_file_name = picoquic_string_duplicate(qlog_file_name)) == NULL ||
+            (job->qlog_dir = picoquic_string_duplicate(cnx->quic->qlog_dir)) == NULL) {
+            autoqlog_job_free(job);
+            job = NULL;
+        }
+    }
+
+    return job;
+}
+
+static picoquic_thread_return_t autoqlog_worker_fn(void* v_worker)
+{
+    autoqlog_worker_t* worker = (autoqlog_worker_t*)v_worker;
+
+    (void)picoquic_lock_mutex(&worker->mutex);
+    while (worker->first != NULL || !worker->should_stop) {
+        autoqlog_job_t* job = worker->first;
+
+        if (job != NULL) {
+            worker->first = job->next;
+            if (worker->first == NULL) {
+                worker->last = NULL;
             }
+            worker->queue_depth--;
+        }
+        (void)picoquic_unlock_mutex(&worker->mutex);
+
+        if (job != NULL) {
+            (void)autoqlog_convert(&job->initial_cnxid, job->binlog_file_name, job->qlog_file_name,
+                job->qlog_dir, job->delete_binlog);
+            autoqlog_job_free(job);
+        }
+        else {
+            /* The event carries no state, so wake up periodically in case a signal was missed */
+            (void)picoquic_wait_for_event(&worker->event, 100000);
+        }
+
+        (void)picoquic_lock_mutex(&worker->mutex);
+        if (job != NULL) {
+            worker->nb_converted++;
         }
     }
-    if (ret != 0) {
-        FILE* F_err = NULL;
-        char err_file_name[512];
-        size_t name_len = strlen(cnx->binlog_file_name);
-        if (name_len > 500) {
-            name_len = 500;
+    (void)picoquic_unlock_mutex(&worker->mutex);
+
+    picoquic_thread_do_return;
+}
+
+/* Stop the worker after all queued conversions are complete. */
+static void autoqlog_worker_close(picoquic_quic_t* quic)
+{
+    autoqlog_worker_t* worker = (autoqlog_worker_t*)quic->v_autoqlog_ctx;
+
+    if (worker != NULL) {
+        (void)picoquic_lock_mutex(&worker->mutex);
+        worker->should_stop = 1;
+        (void)picoquic_unlock_mutex(&worker->mutex);
+        (void)picoquic_signal_event(&worker->event);
+        (void)picoquic_wait_thread(worker->thread);
+#ifdef _WINDOWS
+        CloseHandle(worker->thread);
+#endif
+        picoquic_delete_event(&worker->event);
+        (void)picoquic_delete_mutex(&worker->mutex);
+        free(worker);
+        quic->v_autoqlog_ctx = NULL;
+    }
+    quic->autoqlog_close_fn = NULL;
+}
+
+static autoqlog_worker_t* autoqlog_worker_create(size_t max_queue_depth, picoquic_qlog_queue_policy_enum policy)
+{
+    autoqlog_worker_t* worker = (autoqlog_worker_t*)malloc(sizeof(autoqlog_worker_t));
+
+    if (worker != NULL) {
+        memset(worker, 0, sizeof(autoqlog_worker_t));
+        worker->max_queue_depth = max_queue_depth;
+        worker->policy = policy;
+        if (picoquic_create_mutex(&worker->mutex) != 0) {
+            free(worker);
+            worker = NULL;
+        }
+        else if (picoquic_create_event(&worker->event) != 0) {
+            (void)picoquic_delete_mutex(&worker->mutex);
+            free(worker);
+            worker = NULL;
+        }
+        else if (picoquic_create_thread(&worker->thread, autoqlog_worker_fn, worker) != 0) {
+            picoquic_delete_event(&worker->event);
+            (void)picoquic_delete_mutex(&worker->mutex);
+            free(worker);
+            worker = NULL;
+        }
+    }
+
+    return worker;
+}
+
+/* Queue the conversion. Returns 0 if the job was queued, or dropped and
+ * freed, -1 if the caller should perform the conversion inline.
+ */
+static int autoqlog_worker_submit(autoqlog_worker_t* worker, autoqlog_job_t* job)
+{
+    int ret = 0;
+    int is_queued = 0;
+
+    (void)picoquic_lock_mutex(&worker->mutex);
+    if (worker->queue_depth < worker->max_queue_depth) {
+        if (worker->last == NULL) {
+            worker->first = job;
         }
-        memcpy(err_file_name, cnx->binlog_file_name, name_len);
-        memcpy(err_file_name + name_len, ".errlog", 7);
-        err_file_name[name_len + 0] = 0;
-        F_err = picoquic_file_open(err_file_name, "wt");
-        if (F_err != NULL) {
-            fprintf(F_err, "Cannot create qlog file for %s, error: %d\n", cnx->binlog_file_name, error_code);
+        else {
+            worker->last->next = job;
         }
-        (void)picoquic_file_close(F_err);
+        worker->last = job;
+        worker->queue_depth++;
+        is_queued = 1;
+    }
+    else if (worker->policy == picoquic_qlog_queue_full_drop) {
+        worker->nb_dropped++;
+        DBG_PRINTF("Qlog queue full, binary log %s not converted.\n", job->binlog_file_name);
+        autoqlog_job_free(job);
+    }
+    else {
+        worker->nb_inline++;
+        ret = -1;
+    }
+    (void)picoquic_unlock_mutex(&worker->mutex);
+
+    if (is_queued) {
+        (void)picoquic_signal_event(&worker->event);
+    }
+
+    return ret;
+}
+
+/* Run a prepared conversion: queue it if the worker is available,
+ * or convert it in the calling thread. */
+static int autoqlog_job_run(autoqlog_job_t* job)
+{
+    int ret = 0;
+
+    if (job->worker == NULL || autoqlog_worker_submit(job->worker, job) != 0) {
+        ret = autoqlog_convert(&job->initial_cnxid, job->binlog_file_name, job->qlog_file_name,
+            job->qlog_dir, job->delete_binlog);
+        autoqlog_job_free(job);
+    }
+
+    return ret;
+}
+
+int autoqlog(picoquic_cnx_t* cnx)
+{
+    int ret = 0;
+    int error_code = 0;
+    char filename[512];
+    autoqlog_job_t* job = NULL;
+
+    if ((ret = autoqlog_file_name(cnx, filename, sizeof(filename), &error_code)) != 0) {
+        autoqlog_write_error(cnx->binlog_file_name, error_code);
+    }
+    else if (cnx->quic->v_autoqlog_ctx != NULL && (job = autoqlog_job_create(cnx, filename)) != NULL) {
+        ret = autoqlog_job_run(job);
+    }
+    else {
+        ret = autoqlog_convert(&cnx->initial_cnxid, cnx->binlog_file_name, filename, cnx->quic->qlog_dir,
+            cnx->quic->binlog_dir == NULL);
     }
 
     return ret;
 }
 
+/* When the binary log is written through the log ring, the conversion is
+ * prepared when the connection closes, and started by the ring writer
+ * thread once the binary log file is complete. */
+static void* autoqlog_defer(picoquic_cnx_t* cnx)
+{
+    int error_code = 0;
+    char filename[512];
+    autoqlog_job_t* job = NULL;
+
+    if (autoqlog_file_name(cnx, filename, sizeof(filename), &error_code) != 0) {
+        autoqlog_write_error(cnx->binlog_file_name, error_code);
+    }
+    else {
+        job = autoqlog_job_create(cnx, filename);
+    }
+
+    return job;
+}
+
+static void autoqlog_run_deferred(void* v_job)
+{
+    (void)autoqlog_job_run((autoqlog_job_t*)v_job);
+}
+
 int picoquic_set_qlog(picoquic_quic_t* quic, char const* qlog_dir)
 {
     quic->autoqlog_fn = autoqlog; 
+    quic->autoqlog_defer_fn = autoqlog_defer;
+    quic->autoqlog_run_fn = autoqlog_run_deferred;
     picoquic_enable_binlog(quic);
     quic->qlog_dir = picoquic_string_free(quic->qlog_dir);
     quic->qlog_dir = picoquic_string_duplicate(qlog_dir);
     return 0;
-}
\ No newline at end of file
+}
+
+int picoquic_set_qlog_background(picoquic_quic_t* quic, size_t max_queue_depth, picoquic_qlog_queue_policy_enum policy)
+{
+    int ret = 0;
+
+    if (max_queue_depth == 0) {
+        autoqlog_worker_close(quic);
+    }
+    else if (quic->v_autoqlog_ctx != NULL) {
+        autoqlog_worker_t* worker = (autoqlog_worker_t*)quic->v_autoqlog_ctx;
+        (void)picoquic_lock_mutex(&worker->mutex);
+        worker->max_queue_depth = max_queue_depth;
+        worker->policy = policy;
+        (void)picoquic_unlock_mutex(&worker->mutex);
+    }
+    else if ((quic->v_autoqlog_ctx = autoqlog_worker_create(max_queue_depth, policy)) == NULL) {
+        ret = PICOQUIC_ERROR_MEMORY;
+    }
+    else {
+        quic->autoqlog_close_fn = autoqlog_worker_close;
+    }
+
+    return ret;
+}
+
+void picoquic_get_qlog_background_stats(picoquic_quic_t* quic, uint64_t* nb_converted, uint64_t* nb_dropped, uint64_t* nb_inline)
+{
+    autoqlog_worker_t* worker = (autoqlog_worker_t*)quic->v_autoqlog_ctx;
+
+    *nb_converted = 0;
+    *nb_dropped = 0;
+    *nb_inline = 0;
+    if (worker != NULL) {
+        (void)picoquic_lock_mutex(&worker->mutex);
+        *nb_converted = worker->nb_converted;
+        *nb_dropped = worker->nb_dropped;
+        *nb_inline = worker->nb_inline;
+        (void)picoquic_unlock_mutex(&worker->mutex);
+    }
+}
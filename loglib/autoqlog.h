@@ -38,6 +38,24 @@ extern "C" {
     */
 int picoquic_set_qlog(picoquic_quic_t* quic, char const* qlog_dir);
 
+/* Convert binary logs to qlog in a background thread instead of the packet loop.
+ * When a connection closes, the names of the binary log and qlog files are
+ * queued, and a worker thread performs the conversion. At most
+ * max_queue_depth conversions can be pending. If the queue is full, the
+ * policy decides whether the conversion is dropped, leaving the binary log
+ * in place for offline conversion with picolog_t, or performed inline.
+ * Pending conversions complete before the QUIC context is freed.
+ * Setting max_queue_depth to 0 stops the worker and restores synchronous
+ * conversion.
+ */
+typedef enum {
+    picoquic_qlog_queue_full_drop = 0,
+    picoquic_qlog_queue_full_inline
+} picoquic_qlog_queue_policy_enum;
+
+int picoquic_set_qlog_background(picoquic_quic_t* quic, size_t max_queue_depth, picoquic_qlog_queue_policy_enum policy);
+void picoquic_get_qlog_background_stats(picoquic_quic_t* quic, uint64_t* nb_converted, uint64_t* nb_dropped, uint64_t* nb_inline);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,362 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WINDOWS
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "picoquic_internal.h"
+#include "picoquic_utils.h"
+#include "cidset.h"
+#include "logreader.h"
+#include "csv.h"
+#include "qlog.h"
+#include "logbatch.h"
+
+#define BINLOG_BATCH_MAX_THREADS 64
+
+typedef struct st_binlog_batch_file_t {
+    char const* binlog_name;
+    uint8_t* data;
+    size_t size;
+} binlog_batch_file_t;
+
+typedef struct st_binlog_batch_job_t {
+    binlog_batch_file_t* file;
+    picoquic_connection_id_t cid;
+    int occurrence;
+} binlog_batch_job_t;
+
+/* Number of times each connection id was found, used to name the outputs */
+typedef struct st_binlog_batch_cid_count_t {
+    picoquic_connection_id_t cid;
+    int nb_found;
+} binlog_batch_cid_count_t;
+
+typedef struct st_binlog_batch_ctx_t {
+    picoquic_mutex_t mutex;
+    char const* out_dir;
+    binlog_batch_format_enum format;
+    binlog_batch_file_t* files;
+    binlog_batch_file_t* current_file;
+    picohash_table* cid_counts;
+    binlog_batch_job_t* jobs;
+    size_t nb_jobs;
+    size_t nb_jobs_max;
+    size_t next_job;
+    size_t nb_errors;
+} binlog_batch_ctx_t;
+
+static uint64_t binlog_batch_cid_hash(const void* key)
+{
+    return picoquic_connection_id_hash(&((const binlog_batch_cid_count_t*)key)->cid);
+}
+
+static int binlog_batch_cid_compare(const void* key0, const void* key1)
+{
+    return picoquic_compare_connection_id(&((const binlog_batch_cid_count_t*)key0)->cid,
+        &((const binlog_batch_cid_count_t*)key1)->cid);
+}
+
+/* Returns the number of times the connection id was found before, or -1 on error */
+static int binlog_batch_cid_found(picohash_table* cid_counts, const picoquic_connection_id_t* cid)
+{
+    int occurrence = -1;
+    binlog_batch_cid_count_t key;
+    picohash_item* item;
+
+    key.cid = *cid;
+    if ((item = picohash_retrieve(cid_counts, &key)) != NULL) {
+        occurrence = ((binlog_batch_cid_count_t*)item->key)->nb_found++;
+    }
+    else {
+        binlog_batch_cid_count_t* count = (binlog_batch_cid_count_t*)malloc(sizeof(binlog_batch_cid_count_t));
+
+        if (count != NULL) {
+            count->cid = *cid;
+            count->nb_found = 1;
+            if (picohash_insert(cid_counts, count) == 0) {
+                occurrence = 0;
+            }
+            else {
+                free(count);
+            }
+        }
+    }
+
+    return occurrence;
+}
+
+/* Map the file in memory. On Windows, the workers open the file instead. */
+static int binlog_batch_map(binlog_batch_file_t* file)
+{
+    int ret = 0;
+#ifndef _WINDOWS
+    int fd = open(file->binlog_name, O_RDONLY);
+
+    ret = -1;
+    if (fd >= 0) {
+        struct stat st;
+
+        if (fstat(fd, &st) == 0 && st.st_size >= 16) {
+            void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (data != MAP_FAILED) {
+                file->data = (uint8_t*)data;
+                file->size = (size_t)st.st_size;
+                ret = 0;
+            }
+        }
+        (void)close(fd);
+    }
+#endif
+    return ret;
+}
+
+static void binlog_batch_unmap(binlog_batch_file_t* file)
+{
+#ifndef _WINDOWS
+    if (file->data != NULL) {
+        (void)munmap(file->data, file->size);
+        file->data = NULL;
+    }
+#endif
+}
+
+/* Open a private read stream on the file, positioned after the header */
+static FILE* binlog_batch_open(binlog_batch_file_t* file, uint16_t* flags)
+{
+    uint64_t log_time = 0;
+    FILE* F = NULL;
+#ifdef _WINDOWS
+    F = picoquic_open_cc_log_file_for_read(file->binlog_name, flags, &log_time);
+#else
+    F = fmemopen(file->data, file->size, "rb");
+    if (F != NULL && picoquic_read_cc_log_file_header(F, file->binlog_name, flags, &log_time) != 0) {
+        F = picoquic_file_close(F);
+    }
+#endif
+    return F;
+}
+
+static int binlog_batch_add_job(const picoquic_connection_id_t* cid, void* ptr)
+{
+    int ret = 0;
+    binlog_batch_ctx_t* ctx = (binlog_batch_ctx_t*)ptr;
+
+    if (ctx->nb_jobs >= ctx->nb_jobs_max) {
+        size_t new_max = (ctx->nb_jobs_max == 0) ? 256 : 2 * ctx->nb_jobs_max;
+        binlog_batch_job_t* new_jobs = (binlog_batch_job_t*)realloc(ctx->jobs, new_max * sizeof(binlog_batch_job_t));
+
+        if (new_jobs == NULL) {
+            ret = -1;
+        }
+        else {
+            ctx->jobs = new_jobs;
+            ctx->nb_jobs_max = new_max;
+        }
+    }
+
+    if (ret == 0) {
+        binlog_batch_job_t* job = &ctx->jobs[ctx->nb_jobs++];
+
+        job->file = ctx->current_file;
+        job->cid = *cid;
+        if ((job->occurrence = binlog_batch_cid_found(ctx->cid_counts, cid)) < 0) {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+static int binlog_batch_convert_job(binlog_batch_ctx_t* ctx, binlog_batch_job_t* job)
+{
+    int ret = 0;
+    uint16_t flags = 0;
+    char cid_name[2 * PICOQUIC_CONNECTION_ID_MAX_SIZE + 1];
+    char out_name[512];
+    char const* out_ext = (ctx->format == binlog_batch_format_csv) ? "csv" : "qlog";
+    FILE* f_binlog = NULL;
+
+    if (picoquic_print_connection_id_hexa(cid_name, sizeof(cid_name), &job->cid) != 0) {
+        ret = -1;
+    }
+    else if (job->occurrence > 0) {
+        ret = picoquic_sprintf(out_name, sizeof(out_name), NULL, "%s%s%s.%d.%s",
+            ctx->out_dir, PICOQUIC_FILE_SEPARATOR, cid_name, job->occurrence, out_ext);
+    }
+    else {
+        ret = picoquic_sprintf(out_name, sizeof(out_name), NULL, "%s%s%s.%s",
+            ctx->out_dir, PICOQUIC_FILE_SEPARATOR, cid_name, out_ext);
+    }
+
+    if (ret == 0 && (f_binlog = binlog_batch_open(job->file, &flags)) == NULL) {
+        ret = -1;
+    }
+
+    if (ret == 0) {
+        if (ctx->format == binlog_batch_format_csv) {
+            FILE* f_csvlog = picoquic_file_open(out_name, "w");
+
+            if (f_csvlog == NULL) {
+                ret = -1;
+            }
+            else {
+                ret = picoquic_cc_bin_to_csv(f_binlog, f_csvlog);
+                (void)picoquic_file_close(f_csvlog);
+            }
+        }
+        else {
+            ret = qlog_convert(&job->cid, f_binlog, job->file->binlog_name, out_name, NULL, flags);
+        }
+    }
+
+    if (ret != 0) {
+        DBG_PRINTF("Cannot convert connection %s of %s\n", cid_name, job->file->binlog_name);
+    }
+    (void)picoquic_file_close(f_binlog);
+
+    return ret;
+}
+
+static picoquic_thread_return_t binlog_batch_worker(void* v_ctx)
+{
+    binlog_batch_ctx_t* ctx = (binlog_batch_ctx_t*)v_ctx;
+    binlog_batch_job_t* job;
+
+    do {
+        job = NULL;
+        (void)picoquic_lock_mutex(&ctx->mutex);
+        if (ctx->next_job < ctx->nb_jobs) {
+            job = &ctx->jobs[ctx->next_job++];
+        }
+        (void)picoquic_unlock_mutex(&ctx->mutex);
+
+        if (job != NULL && binlog_batch_convert_job(ctx, job) != 0) {
+            (void)picoquic_lock_mutex(&ctx->mutex);
+            ctx->nb_errors++;
+            (void)picoquic_unlock_mutex(&ctx->mutex);
+        }
+    } while (job != NULL);
+
+    picoquic_thread_do_return;
+}
+
+/* Find the connections in all the files, then run the conversions */
+int binlog_batch_convert(char const** binlog_names, size_t nb_binlogs, char const* out_dir,
+    binlog_batch_format_enum format, int nb_threads, binlog_batch_stats_t* stats)
+{
+    int ret = 0;
+    int is_mutex_created = 0;
+    uint64_t start_time = picoquic_current_time();
+    binlog_batch_ctx_t ctx;
+    picoquic_thread_t threads[BINLOG_BATCH_MAX_THREADS];
+    int nb_started = 0;
+
+    memset(&ctx, 0, sizeof(binlog_batch_ctx_t));
+    memset(stats, 0, sizeof(binlog_batch_stats_t));
+    ctx.out_dir = (out_dir == NULL) ? "." : out_dir;
+    ctx.format = format;
+    if (nb_threads < 1) {
+        nb_threads = 1;
+    }
+    else if (nb_threads > BINLOG_BATCH_MAX_THREADS) {
+        nb_threads = BINLOG_BATCH_MAX_THREADS;
+    }
+
+    if ((ctx.files = (binlog_batch_file_t*)calloc((nb_binlogs > 0) ? nb_binlogs : 1, sizeof(binlog_batch_file_t))) == NULL ||
+        (ctx.cid_counts = picohash_create(256, binlog_batch_cid_hash, binlog_batch_cid_compare)) == NULL) {
+        ret = -1;
+    }
+    else if ((ret = picoquic_create_mutex(&ctx.mutex)) == 0) {
+        is_mutex_created = 1;
+    }
+
+    for (size_t i = 0; ret == 0 && i < nb_binlogs; i++) {
+        binlog_batch_file_t* file = &ctx.files[i];
+        picohash_table* cids = NULL;
+        FILE* F = NULL;
+        uint16_t flags = 0;
+
+        file->binlog_name = binlog_names[i];
+
+        if (binlog_batch_map(file) != 0 || (F = binlog_batch_open(file, &flags)) == NULL ||
+            (cids = cidset_create()) == NULL || binlog_list_cids(F, cids) != 0) {
+            DBG_PRINTF("Cannot read the connections of %s\n", file->binlog_name);
+            ctx.nb_errors++;
+        }
+        else {
+            stats->nb_files++;
+            ctx.current_file = file;
+            ret = cidset_iterate(cids, binlog_batch_add_job, &ctx);
+        }
+        (void)picoquic_file_close(F);
+        if (cids != NULL) {
+            (void)cidset_delete(cids);
+        }
+    }
+
+    if (ret == 0) {
+        while (nb_started < nb_threads && (size_t)nb_started < ctx.nb_jobs &&
+            picoquic_create_thread(&threads[nb_started], binlog_batch_worker, &ctx) == 0) {
+            nb_started++;
+        }
+        /* If no thread could be started, convert in the calling thread */
+        if (nb_started == 0) {
+            (void)binlog_batch_worker(&ctx);
+        }
+        for (int i = 0; i < nb_started; i++) {
+            (void)picoquic_wait_thread(threads[i]);
+#ifdef _WINDOWS
+            CloseHandle(threads[i]);
+#endif
+        }
+    }
+
+    stats->nb_connections = ctx.nb_jobs;
+    stats->nb_errors = ctx.nb_errors;
+    stats->duration_us = picoquic_current_time() - start_time;
+
+    if (ctx.files != NULL) {
+        for (size_t i = 0; i < nb_binlogs; i++) {
+            binlog_batch_unmap(&ctx.files[i]);
+        }
+        free(ctx.files);
+    }
+    if (ctx.jobs != NULL) {
+        free(ctx.jobs);
+    }
+    if (ctx.cid_counts != NULL) {
+        picohash_delete(ctx.cid_counts, 1);
+    }
+    if (is_mutex_created) {
+        (void)picoquic_delete_mutex(&ctx.mutex);
+    }
+
+    return (ret == 0 && ctx.nb_errors == 0) ? 0 : -1;
+}
@@ -0,0 +1,67 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef LOGBATCH_H
+#define LOGBATCH_H
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Batch conversion of binary logs.
+ *
+ * All the connections found in a list of binary log files are converted
+ * in parallel by a pool of worker threads. Each file is mapped in memory
+ * once, and each worker reads it through its own memory stream, so the
+ * conversions do not share file positions. On Windows, the workers open
+ * the files directly.
+ *
+ * The output files are named after the initial connection id, e.g.
+ * "<out_dir>/<cid>.qlog". If the same connection id appears in several
+ * files, for example in client and server logs, the later ones are
+ * numbered in the order of the input files, "<out_dir>/<cid>.1.qlog",
+ * "<out_dir>/<cid>.2.qlog", etc., so they do not overwrite each other.
+ */
+typedef enum {
+    binlog_batch_format_qlog = 0,
+    binlog_batch_format_csv
+} binlog_batch_format_enum;
+
+typedef struct st_binlog_batch_stats_t {
+    size_t nb_files;
+    size_t nb_connections;
+    size_t nb_errors;
+    uint64_t duration_us;
+} binlog_batch_stats_t;
+
+/* Returns 0 if all the files were read and all the connections converted.
+ * Errors do not stop the batch, they are counted in the stats. */
+int binlog_batch_convert(char const** binlog_names, size_t nb_binlogs, char const* out_dir,
+    binlog_batch_format_enum format, int nb_threads, binlog_batch_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOGBATCH_H */
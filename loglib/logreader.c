@@ -20,6 +20,7 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
 #include <errno.h>
@@ -32,15 +33,290 @@
 
 static int byteread_packet_header(bytestream * s, picoquic_packet_header * ph);
 
-int fileread_binlog(FILE* bin_log, int(*cb)(bytestream*, void*), void* cbptr)
+static int fileread_binlog_record(FILE* bin_log, bytestream_buf* stream_msg, bytestream** s, uint64_t* record_length)
 {
     int ret = 0;
     uint8_t head[4];
+
+    if (fread(head, sizeof(head), 1, bin_log) <= 0) {
+        ret = -1;
+    }
+    else {
+        uint32_t len = (head[0] << 24) | (head[1] << 16) | (head[2] << 8) | head[3];
+        if (len > sizeof(stream_msg->buf) || fread(stream_msg->buf, len, 1, bin_log) <= 0) {
+            ret = -1;
+        }
+        else {
+            *s = bytestream_buf_init(stream_msg, len);
+            *record_length = sizeof(head) + (uint64_t)len;
+        }
+    }
+
+    return ret;
+}
+
+/* Seek with 64 bit offsets, so that segments larger than 2GB can be read
+ * on platforms where long is 32 bits. */
+static int fileread_binlog_seek(FILE* bin_log, uint64_t offset, int whence)
+{
+#ifdef _WINDOWS
+    return _fseeki64(bin_log, (__int64)offset, whence);
+#else
+    return fseeko(bin_log, (off_t)offset, whence);
+#endif
+}
+
+static int64_t fileread_binlog_tell(FILE* bin_log)
+{
+#ifdef _WINDOWS
+    return (int64_t)_ftelli64(bin_log);
+#else
+    return (int64_t)ftello(bin_log);
+#endif
+}
+
+/* Log segments end with an index and a trailer. The trailer is only
+ * accepted if it points to an index that ends just before it. */
+static int fileread_binlog_trailer(FILE* bin_log, uint64_t* index_offset, size_t* index_length)
+{
+    int ret = -1;
+    uint8_t trailer[PICOQUIC_BINLOG_TRAILER_SIZE];
+
+    if (fileread_binlog_seek(bin_log, 0, SEEK_END) == 0) {
+        int64_t file_size = fileread_binlog_tell(bin_log);
+
+        if (file_size >= 16 + PICOQUIC_BINLOG_TRAILER_SIZE &&
+            fileread_binlog_seek(bin_log, (uint64_t)file_size - PICOQUIC_BINLOG_TRAILER_SIZE, SEEK_SET) == 0 &&
+            fread(trailer, sizeof(trailer), 1, bin_log) > 0) {
+            bytestream stream;
+            bytestream* ps = bytestream_ref_init(&stream, trailer, sizeof(trailer));
+            uint64_t offset = 0;
+            uint32_t length = 0;
+            uint32_t fcc = 0;
+
+            if (byteread_int64(ps, &offset) == 0 &&
+                byteread_int32(ps, &length) == 0 &&
+                byteread_int32(ps, &fcc) == 0 &&
+                fcc == FOURCC('c', 'i', 'd', 'x') &&
+                offset >= 16 &&
+                offset + length + PICOQUIC_BINLOG_TRAILER_SIZE == (uint64_t)file_size) {
+                *index_offset = offset;
+                *index_length = length;
+                ret = 0;
+            }
+        }
+    }
+
+    return ret;
+}
+
+/* Load the index of a log segment. Returns NULL if the file has no index. */
+static uint8_t* fileread_binlog_index(FILE* bin_log, size_t* index_length)
+{
+    uint64_t index_offset = 0;
+    uint8_t* index = NULL;
+
+    if (fileread_binlog_trailer(bin_log, &index_offset, index_length) == 0 &&
+        (index = (uint8_t*)malloc(*index_length + 1)) != NULL) {
+        if (fileread_binlog_seek(bin_log, index_offset, SEEK_SET) != 0 ||
+            (*index_length > 0 && fread(index, *index_length, 1, bin_log) <= 0)) {
+            free(index);
+            index = NULL;
+        }
+    }
+
+    return index;
+}
+
+/* Compact logs are decoded back to the regular record format before being
+ * passed to the callbacks, see binlog_compact.c for the format. The decoder
+ * keeps the CID, the time of the last event and the address dictionary
+ * of each connection. */
+#define BINLOG_COMPACT_MAX_CONNECTIONS 0x100000
+
+typedef struct st_binlog_compact_cnx_t {
+    picoquic_connection_id_t cid;
+    int is_cid_known;
+    uint64_t last_time;
+    size_t nb_addr;
+    size_t addr_length[PICOQUIC_BINLOG_COMPACT_ADDR_MAX];
+    uint8_t addr[PICOQUIC_BINLOG_COMPACT_ADDR_MAX][PICOQUIC_BINLOG_COMPACT_ADDR_SIZE];
+} binlog_compact_cnx_t;
+
+typedef struct st_binlog_compact_reader_t {
+    binlog_compact_cnx_t* cnx;
+    size_t nb_cnx;
+    int (*cb)(bytestream*, void*);
+    void* cbptr;
+} binlog_compact_reader_t;
+
+static binlog_compact_cnx_t* binlog_compact_get_cnx(binlog_compact_reader_t* reader, uint64_t number)
+{
+    binlog_compact_cnx_t* c = NULL;
+
+    if (number < reader->nb_cnx) {
+        c = &reader->cnx[number];
+    }
+    else if (number < BINLOG_COMPACT_MAX_CONNECTIONS) {
+        size_t new_nb = (size_t)number + 1;
+        binlog_compact_cnx_t* new_cnx = (binlog_compact_cnx_t*)realloc(reader->cnx, new_nb * sizeof(binlog_compact_cnx_t));
+
+        if (new_cnx != NULL) {
+            memset(&new_cnx[reader->nb_cnx], 0, (new_nb - reader->nb_cnx) * sizeof(binlog_compact_cnx_t));
+            reader->cnx = new_cnx;
+            reader->nb_cnx = new_nb;
+            c = &reader->cnx[number];
+        }
+    }
+
+    return c;
+}
+
+static int binlog_compact_decode_addr(binlog_compact_cnx_t* c, bytestream* s, bytestream* out)
+{
+    uint64_t ref = 0;
+    int ret = byteread_vint(s, &ref);
+
+    if (ret == 0) {
+        uint64_t index = ref >> 1;
+
+        if ((ref & 1) != 0) {
+            const uint8_t* addr = bytestream_ptr(s);
+            size_t addr_length;
+
+            if ((ret = byteskip_addr(s)) == 0) {
+                addr_length = bytestream_ptr(s) - addr;
+                ret = bytewrite_buffer(out, addr, addr_length);
+                if (ret == 0 && index < PICOQUIC_BINLOG_COMPACT_ADDR_MAX && addr_length <= PICOQUIC_BINLOG_COMPACT_ADDR_SIZE) {
+                    memcpy(c->addr[index], addr, addr_length);
+                    c->addr_length[index] = addr_length;
+                    if (c->nb_addr <= index) {
+                        c->nb_addr = (size_t)index + 1;
+                    }
+                }
+            }
+        }
+        else if (index < c->nb_addr) {
+            ret = bytewrite_buffer(out, c->addr[index], c->addr_length[index]);
+        }
+        else {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+static int fileread_binlog_compact_cb(bytestream* s, void* ptr)
+{
+    binlog_compact_reader_t* reader = (binlog_compact_reader_t*)ptr;
+    binlog_compact_cnx_t* c = NULL;
+    uint8_t buffer[BYTESTREAM_MAX_BUFFER_SIZE + 128];
+    bytestream out_stream;
+    bytestream* out = bytestream_ref_init(&out_stream, buffer, sizeof(buffer));
+    uint64_t ref = 0;
+    uint64_t zigzag = 0;
+    uint64_t path_id = 0;
+    uint64_t id = 0;
+    int ret = byteread_vint(s, &ref);
+
+    if (ret == 0) {
+        if ((c = binlog_compact_get_cnx(reader, ref >> 1)) == NULL) {
+            ret = -1;
+        }
+        else if ((ref & 1) != 0) {
+            /* First record of the connection in this file */
+            memset(c, 0, sizeof(binlog_compact_cnx_t));
+            if ((ret = byteread_cid(s, &c->cid)) == 0) {
+                c->is_cid_known = 1;
+            }
+        }
+        else if (!c->is_cid_known) {
+            ret = -1;
+        }
+    }
+
+    if (ret == 0 &&
+        (ret = byteread_vint(s, &zigzag)) == 0 &&
+        (ret = byteread_vint(s, &path_id)) == 0 &&
+        (ret = byteread_vint(s, &id)) == 0) {
+        uint64_t delta = (zigzag >> 1) ^ (uint64_t)(-(int64_t)(zigzag & 1));
+
+        c->last_time += delta;
+        ret |= bytewrite_cid(out, &c->cid);
+        ret |= bytewrite_vint(out, c->last_time);
+        ret |= bytewrite_vint(out, path_id);
+        ret |= bytewrite_vint(out, id);
+
+        if (ret == 0 && (id == picoquic_log_event_pdu_sent || id == picoquic_log_event_pdu_recv)) {
+            uint64_t packet_length = 0;
+
+            if ((ret = binlog_compact_decode_addr(c, s, out)) == 0 &&
+                (ret = byteread_vint(s, &packet_length)) == 0 &&
+                (ret = bytewrite_vint(out, packet_length)) == 0) {
+                ret = binlog_compact_decode_addr(c, s, out);
+            }
+        }
+
+        if (ret == 0) {
+            ret = bytewrite_buffer(out, bytestream_ptr(s), bytestream_remain(s));
+        }
+
+        if (ret == 0) {
+            bytestream record_stream;
+            bytestream* record = bytestream_ref_init(&record_stream, buffer, bytestream_length(out));
+
+            ret = reader->cb(record, reader->cbptr);
+        }
+    }
+
+    return ret;
+}
+
+/* If the file uses compact records, insert the decoder before the callback */
+static void binlog_compact_reader_wrap(binlog_compact_reader_t* reader, FILE* bin_log,
+    int(**cb)(bytestream*, void*), void** cbptr)
+{
+    uint8_t header[16];
+
+    memset(reader, 0, sizeof(binlog_compact_reader_t));
+
+    if (fseek(bin_log, 0, SEEK_SET) == 0 && fread(header, sizeof(header), 1, bin_log) > 0) {
+        uint16_t version = (uint16_t)((header[6] << 8) | header[7]);
+
+        if (PICOQUIC_BINLOG_IS_COMPACT(version)) {
+            reader->cb = *cb;
+            reader->cbptr = *cbptr;
+            *cb = fileread_binlog_compact_cb;
+            *cbptr = reader;
+        }
+    }
+}
+
+static void binlog_compact_reader_release(binlog_compact_reader_t* reader)
+{
+    if (reader->cnx != NULL) {
+        free(reader->cnx);
+        reader->cnx = NULL;
+    }
+    reader->nb_cnx = 0;
+}
+
+static int fileread_binlog_sequential(FILE* bin_log, int(*cb)(bytestream*, void*), void* cbptr)
+{
+    int ret = 0;
+    uint8_t head[4];
+    uint64_t position = 16;
+    uint64_t end_of_records = UINT64_MAX;
+    size_t index_length = 0;
     bytestream_buf stream_msg;
 
+    /* Do not read the index of log segments as if it was a record */
+    (void)fileread_binlog_trailer(bin_log, &end_of_records, &index_length);
+
     fseek(bin_log, 16, SEEK_SET);
 
-    while (ret == 0 && fread(head, sizeof(head), 1, bin_log) > 0) {
+    while (ret == 0 && position < end_of_records && fread(head, sizeof(head), 1, bin_log) > 0) {
 
         uint32_t len = (head[0] << 24) | (head[1] << 16) | (head[2] << 8) | head[3];
         if (len > sizeof(stream_msg.buf)) {
@@ -54,6 +330,69 @@ int fileread_binlog(FILE* bin_log, int(*cb)(bytestream*, void*), void* cbptr)
         if (ret == 0) {
             bytestream* s = bytestream_buf_init(&stream_msg, len);
             ret |= cb(s, cbptr);
+            position += sizeof(head) + (uint64_t)len;
+        }
+    }
+
+    return ret;
+}
+
+int fileread_binlog(FILE* bin_log, int(*cb)(bytestream*, void*), void* cbptr)
+{
+    int ret;
+    binlog_compact_reader_t compact;
+
+    binlog_compact_reader_wrap(&compact, bin_log, &cb, &cbptr);
+    ret = fileread_binlog_sequential(bin_log, cb, cbptr);
+    binlog_compact_reader_release(&compact);
+
+    return ret;
+}
+
+/* Call back the records listed for one connection in the index of a log segment */
+static int fileread_binlog_indexed(FILE* bin_log, const uint8_t* index, size_t index_length,
+    const picoquic_connection_id_t* cid, int(*cb)(bytestream*, void*), void* cbptr)
+{
+    int ret = 0;
+    bytestream stream;
+    bytestream* ps = bytestream_ref_init(&stream, index, index_length);
+    uint64_t nb_cid = 0;
+
+    ret = byteread_vint(ps, &nb_cid);
+
+    for (uint64_t i = 0; ret == 0 && i < nb_cid; i++) {
+        picoquic_connection_id_t entry_cid;
+        uint64_t nb_records = 0;
+
+        if ((ret = byteread_cid(ps, &entry_cid)) == 0 &&
+            (ret = byteread_vint(ps, &nb_records)) == 0) {
+            if (picoquic_compare_connection_id(&entry_cid, cid) != 0) {
+                for (uint64_t j = 0; ret == 0 && j < nb_records; j++) {
+                    ret = byteread_skip_vint(ps);
+                }
+            }
+            else {
+                uint64_t offset = 0;
+                bytestream_buf stream_msg;
+
+                for (uint64_t j = 0; ret == 0 && j < nb_records; j++) {
+                    uint64_t delta = 0;
+                    uint64_t record_length = 0;
+                    bytestream* s = NULL;
+
+                    if ((ret = byteread_vint(ps, &delta)) == 0) {
+                        offset += delta;
+                        if (fileread_binlog_seek(bin_log, offset, SEEK_SET) != 0 ||
+                            fileread_binlog_record(bin_log, &stream_msg, &s, &record_length) != 0) {
+                            ret = -1;
+                        }
+                        else {
+                            ret = cb(s, cbptr);
+                        }
+                    }
+                }
+                break;
+            }
         }
     }
 
@@ -202,11 +541,28 @@ static int binlog_convert_event(bytestream * s, void * ptr)
 
 int binlog_convert(FILE * f_binlog, const picoquic_connection_id_t * cid, binlog_convert_cb_t * callbacks)
 {
+    int ret;
     convert_log_file_event_t ctx;
+    size_t index_length = 0;
+    uint8_t* index = fileread_binlog_index(f_binlog, &index_length);
+    binlog_compact_reader_t compact;
+    int(*cb)(bytestream*, void*) = binlog_convert_event;
+    void* cbptr = &ctx;
+
     ctx.cid = cid;
     ctx.callbacks = callbacks;
 
-    return fileread_binlog(f_binlog, binlog_convert_event, &ctx);
+    binlog_compact_reader_wrap(&compact, f_binlog, &cb, &cbptr);
+    if (index != NULL) {
+        ret = fileread_binlog_indexed(f_binlog, index, index_length, cid, cb, cbptr);
+        free(index);
+    }
+    else {
+        ret = fileread_binlog_sequential(f_binlog, cb, cbptr);
+    }
+    binlog_compact_reader_release(&compact);
+
+    return ret;
 }
 
 static int binlog_list_cids_cb(bytestream * s, void * cbptr)
@@ -223,7 +579,36 @@ static int binlog_list_cids_cb(bytestream * s, void * cbptr)
 
 int binlog_list_cids(FILE * binlog, picohash_table * cids)
 {
-    return fileread_binlog(binlog, binlog_list_cids_cb, cids);
+    int ret = 0;
+    size_t index_length = 0;
+    uint8_t* index = fileread_binlog_index(binlog, &index_length);
+
+    if (index == NULL) {
+        ret = fileread_binlog(binlog, binlog_list_cids_cb, cids);
+    }
+    else {
+        /* Log segments list the connection ids in the index */
+        bytestream stream;
+        bytestream* ps = bytestream_ref_init(&stream, index, index_length);
+        uint64_t nb_cid = 0;
+
+        ret = byteread_vint(ps, &nb_cid);
+        for (uint64_t i = 0; ret == 0 && i < nb_cid; i++) {
+            picoquic_connection_id_t cid;
+            uint64_t nb_records = 0;
+
+            if ((ret = byteread_cid(ps, &cid)) == 0 &&
+                (ret = byteread_vint(ps, &nb_records)) == 0 &&
+                (ret = cidset_insert(cids, &cid)) == 0) {
+                for (uint64_t j = 0; ret == 0 && j < nb_records; j++) {
+                    ret = byteread_skip_vint(ps);
+                }
+            }
+        }
+        free(index);
+    }
+
+    return ret;
 }
 
 static int byteread_packet_header(bytestream * s, picoquic_packet_header * ph)
@@ -292,6 +677,41 @@ FILE * open_outfile(const char * cid_name, const char * binlog_name, const char
     return f;
 }
 
+/* Check the header of a binary log file, and leave the file positioned
+ * after the header */
+int picoquic_read_cc_log_file_header(FILE* bin_log, char const* bin_cc_log_name, uint16_t* flags, uint64_t* log_time)
+{
+    int ret = 0;
+    bytestream_buf stream;
+    bytestream * ps = bytestream_buf_init(&stream, 16);
+
+    uint32_t fcc = 0;
+    uint16_t version = 0;
+
+    if (fread(stream.buf, bytestream_size(ps), 1, bin_log) <= 0) {
+        ret = -1;
+        DBG_PRINTF("Cannot read header for file %s.\n", bin_cc_log_name);
+    }
+    else if (byteread_int32(ps, &fcc) != 0 || fcc != FOURCC('q', 'l', 'o', 'g')) {
+        ret = -1;
+        DBG_PRINTF("Header for file %s does not start with magic number.\n", bin_cc_log_name);
+    }
+    else if (byteread_int16(ps, flags) != 0) {
+        ret = -1;
+        DBG_PRINTF("Header for file %s does include flags.\n", bin_cc_log_name);
+    }
+    else if (byteread_int16(ps, &version) != 0 ||
+        version < PICOQUIC_BINLOG_VERSION || version > PICOQUIC_BINLOG_VERSION_COMPACT_SEGMENT) {
+        ret = -1;
+        DBG_PRINTF("Header for file %s requires unsupported version.\n", bin_cc_log_name);
+    }
+    else {
+        ret = byteread_int64(ps, log_time);
+    }
+
+    return ret;
+}
+
 /* Open the bin file for reading */
 FILE * picoquic_open_cc_log_file_for_read(char const * bin_cc_log_name, uint16_t * flags, uint64_t * log_time)
 {
@@ -303,31 +723,7 @@ FILE * picoquic_open_cc_log_file_for_read(char const * bin_cc_log_name, uint16_t
     }
 
     if (ret == 0) {
-        bytestream_buf stream;
-        bytestream * ps = bytestream_buf_init(&stream, 16);
-
-        uint32_t fcc = 0;
-        uint16_t version = 0;
-
-        if (fread(stream.buf, bytestream_size(ps), 1, bin_log) <= 0) {
-            ret = -1;
-            DBG_PRINTF("Cannot read header for file %s.\n", bin_cc_log_name);
-        }
-        else if (byteread_int32(ps, &fcc) != 0 || fcc != FOURCC('q', 'l', 'o', 'g')) {
-            ret = -1;
-            DBG_PRINTF("Header for file %s does not start with magic number.\n", bin_cc_log_name);
-        }
-        else if (byteread_int16(ps, flags) != 0) {
-            ret = -1;
-            DBG_PRINTF("Header for file %s does include flags.\n", bin_cc_log_name);
-        }
-        else if (byteread_int16(ps, &version) != 0 || version != 0x01) {
-            ret = -1;
-            DBG_PRINTF("Header for file %s requires unsupported version.\n", bin_cc_log_name);
-        }
-        else {
-            ret = byteread_int64(ps, log_time);
-        }
+        ret = picoquic_read_cc_log_file_header(bin_log, bin_cc_log_name, flags, log_time);
     }
 
     if (ret != 0) {
@@ -33,7 +33,8 @@ extern "C" {
 #endif
 
 /*! \brief Read the contents of a binary log file and call the callback
- *         function for each event found in the file.
+ *         function for each event found in the file. Events of compact
+ *         log files are passed to the callback in the regular format.
  *
  *  \param f_binlog The file handle of the opened binary log file.
  *  \param cb       The callback function which receives a bytestream of
@@ -71,6 +72,9 @@ typedef struct binlog_convert_cb_st {
 /*! \brief Convert the content of a binary log file into a sequence of log
  *         event calls for a specific connection.
  *
+ *  If the file is a log segment closed with an index, only the records of
+ *  the connection are read; otherwise, all records are read in sequence.
+ *
  *  \param f_binlog  The file handle of the opened binary log file.
  *  \param cid       Initial connection id for the events to be called back.
  *  \param callbacks Callback functions for the events.
@@ -78,7 +82,8 @@ typedef struct binlog_convert_cb_st {
 int binlog_convert(FILE * f_binlog, const picoquic_connection_id_t * cid, binlog_convert_cb_t * callbacks);
 
 /*! \brief Write all connection ids contained in a binary log file into a
- *         picohash_table.
+ *         picohash_table. For indexed log segments, the ids are read from
+ *         the index.
  *
  *  \param f_binlog The file handle of the opened binary log file.
  *  \param cids     picohash_table that will collect the connection ids
@@ -104,6 +109,11 @@ FILE * open_outfile(const char * cid_name, const char * binlog_name, const char
 
 FILE * picoquic_open_cc_log_file_for_read(char const * bin_cc_log_name, uint16_t * flags, uint64_t * log_time);
 
+/*! \brief Check the header of a binary log file opened by the caller, for
+ *         example as a memory stream. Returns 0 if the header is valid.
+ */
+int picoquic_read_cc_log_file_header(FILE* bin_log, char const* bin_cc_log_name, uint16_t* flags, uint64_t* log_time);
+
 int picoquic_cc_log_file_to_csv(char const * bin_cc_log_name, char const * csv_cc_log_name);
 
 #ifdef __cplusplus
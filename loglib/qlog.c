@@ -63,22 +63,45 @@ typedef struct qlog_context_st {
     int state;
 } qlog_context_t;
 
-int qlog_string(FILE* f, bytestream* s, uint64_t l)
+/* The qlog text is written to a fully buffered stream. Byte strings are
+ * formatted in a local buffer and written in chunks, instead of calling
+ * fprintf for each byte. */
+#define QLOG_OUTPUT_BUFFER_SIZE 0x10000
+#define QLOG_TEXT_CHUNK 256
+
+static const char qlog_hex_digits[] = "0123456789abcdef";
+
+static void qlog_hex_bytes(FILE* f, const uint8_t* bytes, size_t length)
 {
-    uint64_t x;
-    int error_found = (s->ptr + (size_t)l > s->size);
+    char text[2 * QLOG_TEXT_CHUNK];
 
-    fprintf(f, "\"");
+    while (length > 0) {
+        size_t chunk = (length > QLOG_TEXT_CHUNK) ? QLOG_TEXT_CHUNK : length;
 
-    for (x = 0; x < l && s->ptr < s->size; x++) {
-        fprintf(f, "%02x", s->data[s->ptr++]);
+        for (size_t i = 0; i < chunk; i++) {
+            text[2 * i] = qlog_hex_digits[bytes[i] >> 4];
+            text[2 * i + 1] = qlog_hex_digits[bytes[i] & 0xf];
+        }
+        (void)fwrite(text, 1, 2 * chunk, f);
+        bytes += chunk;
+        length -= chunk;
     }
+}
+
+int qlog_string(FILE* f, bytestream* s, uint64_t l)
+{
+    int error_found = (s->ptr + (size_t)l > s->size);
+    size_t length = (error_found) ? s->size - s->ptr : (size_t)l;
+
+    fputc('"', f);
+    qlog_hex_bytes(f, s->data + s->ptr, length);
+    s->ptr += length;
 
     if (error_found) {
-        fprintf(f, "... coding error!");
+        fputs("... coding error!", f);
     }
 
-    fprintf(f, "\"");
+    fputc('"', f);
     return (error_found) ? -1 : 0;
 }
 
@@ -86,27 +109,38 @@ int qlog_chars(FILE* f, bytestream* s, uint64_t l)
 {
     uint64_t x;
     int error_found = (s->ptr + (size_t)l > s->size);
+    char text[3 * QLOG_TEXT_CHUNK];
+    size_t text_length = 0;
 
-    fprintf(f, "\"");
+    fputc('"', f);
 
     for (x = 0; x < l && s->ptr < s->size; x++) {
         int c = s->data[s->ptr++];
+
+        if (text_length + 3 > sizeof(text)) {
+            (void)fwrite(text, 1, text_length, f);
+            text_length = 0;
+        }
         if (c == '"' || c == '\\') {
-            fprintf(f, "\\%c", c);
+            text[text_length++] = '\\';
+            text[text_length++] = (char)c;
         }
         else if (c >= ' ' && c < 127) {
-            fprintf(f, "%c", c);
+            text[text_length++] = (char)c;
         }
         else {
-            fprintf(f, "\\%02x", c);
+            text[text_length++] = '\\';
+            text[text_length++] = qlog_hex_digits[c >> 4];
+            text[text_length++] = qlog_hex_digits[c & 0xf];
         }
     }
+    (void)fwrite(text, 1, text_length, f);
 
     if (error_found) {
-        fprintf(f, "... coding error!");
+        fputs("... coding error!", f);
     }
 
-    fprintf(f, "\"");
+    fputc('"', f);
     return (error_found) ? -1 : 0;
 }
 
@@ -221,10 +255,11 @@ void qlog_tp_version_negotiation(FILE* f, bytestream* s, uint64_t len)
     if ((len & 3) != 0 || len == 0) {
         fprintf(f, "\"bad_length\": \"%" PRIu64, len);
     } else {
+        size_t chunk = (s->size - s->ptr > 4) ? 4 : s->size - s->ptr;
+
         fprintf(f, "\"chosen\": \"");
-        for (int i = 0; i < 4 && s->ptr < s->size; i++, s->ptr++) {
-            fprintf(f, "%02x", s->data[s->ptr]);
-        }
+        qlog_hex_bytes(f, s->data + s->ptr, chunk);
+        s->ptr += chunk;
         fprintf(f, "\"");
         if (s->ptr < s->size) {
             int is_first = 1;
@@ -232,9 +267,9 @@ void qlog_tp_version_negotiation(FILE* f, bytestream* s, uint64_t len)
             do {
                 fprintf(f, "%s", (is_first)?"\"":", \"");
                 is_first = 0;
-                for (int i = 0; i < 4 && s->ptr < s->size; i++, s->ptr++) {
-                    fprintf(f, "%02x", s->data[s->ptr]);
-                }
+                chunk = (s->size - s->ptr > 4) ? 4 : s->size - s->ptr;
+                qlog_hex_bytes(f, s->data + s->ptr, chunk);
+                s->ptr += chunk;
                 fprintf(f, "\"");
             } while (s->ptr < s->size);
             fprintf(f, "]");
@@ -790,7 +825,7 @@ void qlog_path_abandon_frame(FILE* f, bytestream* s)
             if (c < 0x20 || c > 0x7E) {
                 c = '.';
             }
-            fprintf(f, "%c", c);
+            fputc(c, f);
         }
         fprintf(f, "\"");
     }
@@ -883,7 +918,7 @@ void qlog_closing_frame(uint64_t ftype, FILE* f, bytestream* s)
             if (c < 0x20 || c > 0x7E) {
                 c = '.';
             }
-            fprintf(f, "%c", c);
+            fputc(c, f);
         }
         fprintf(f, "\"");
     }
@@ -1557,6 +1592,11 @@ int qlog_convert(const picoquic_connection_id_t* cid, FILE* f_binlog, const char
     else  if (ret == 0) {
 
         qlog_context_t qlog;
+        char* out_buffer = NULL;
+
+        if (f_txtlog != stdout && (out_buffer = (char*)malloc(QLOG_OUTPUT_BUFFER_SIZE)) != NULL) {
+            (void)setvbuf(f_txtlog, out_buffer, _IOFBF, QLOG_OUTPUT_BUFFER_SIZE);
+        }
 
         memset(&qlog, 0, sizeof(qlog_context_t));
 
@@ -1590,6 +1630,9 @@ int qlog_convert(const picoquic_connection_id_t* cid, FILE* f_binlog, const char
         }
 
         picoquic_file_close(f_txtlog);
+        if (out_buffer != NULL) {
+            free(out_buffer);
+        }
     }
 
     return ret;
@@ -69,6 +69,7 @@ static picoquic_h09_server_callback_ctx_t* first_server_callback_create_context(
             ctx->path_table = param->path_table;
             ctx->path_table_nb = param->path_table_nb;
             ctx->web_folder = param->web_folder;
+            ctx->router = param->router;
         }
     }
 
@@ -79,6 +80,8 @@ static void picoquic_h09_server_callback_delete_context(picoquic_h09_server_call
 {
 
     picosplay_empty_tree(&ctx->h3_stream_tree);
+    h3zero_delete_stream_index(ctx);
+    h3zero_frame_pool_release(&ctx->frame_pool);
 
     free(ctx);
 }
@@ -212,18 +215,11 @@ static int picohttp_server_parse_commandline(uint8_t* command, size_t command_le
             ret = -1;
         }
         else {
-            size_t path_length = command_length - consumed;
-            uint8_t* path = (uint8_t*)malloc(path_length + 1);
-
-            if (path != NULL) {
-                memcpy(path, command + consumed, path_length);
-                path[path_length] = 0;
-                stream_ctx->ps.hq.path = path;
-                stream_ctx->ps.hq.path_length = path_length;
-            }
-            else {
-                ret = -1;
-            }
+            /* The path is used in place. The command buffer is not
+             * written after the command line is parsed. */
+            command[command_length] = 0;
+            stream_ctx->ps.hq.path = command + consumed;
+            stream_ctx->ps.hq.path_length = command_length - consumed;
         }
     }
 
@@ -258,6 +254,15 @@ int picoquic_h09_server_process_data_header(
     int ret = 0;
     size_t processed = 0;
 
+    if (stream_ctx->frame == NULL) {
+        /* The command buffer is only attached to HTTP 0.9 streams */
+        int is_pooled = 0;
+        if ((stream_ctx->frame = h3zero_frame_buffer_get(stream_ctx->frame_pool, PICOHTTP_SERVER_FRAME_MAX, &is_pooled)) == NULL) {
+            ret = -1;
+        }
+        stream_ctx->is_frame_pooled = is_pooled;
+    }
+
     while (ret == 0 && processed < length) {
         if (stream_ctx->ps.hq.status == picohttp_server_stream_status_none) {
             /* If the command has not been received yet, try to process it */
@@ -270,7 +275,7 @@ int picoquic_h09_server_process_data_header(
                 else if (bytes[processed] == '\n') {
                     crlf_present = 1;
                 }
-                else if (stream_ctx->ps.hq.command_length < sizeof(stream_ctx->frame) - 1) {
+                else if (stream_ctx->ps.hq.command_length < PICOHTTP_SERVER_FRAME_MAX - 1) {
                     stream_ctx->frame[stream_ctx->ps.hq.command_length++] = bytes[processed];
                 }
                 else {
@@ -334,10 +339,10 @@ int picoquic_h09_server_process_data(picoquic_cnx_t* cnx,
             size_t available = length - processed;
 
             if (stream_ctx->post_received == 0 && available > 0) {
-                int path_item = picohttp_find_path_item(stream_ctx->ps.hq.path, stream_ctx->ps.hq.path_length, app_ctx->path_table, app_ctx->path_table_nb);
+                int path_item = h3zero_route_path(app_ctx, stream_ctx->ps.hq.path, stream_ctx->ps.hq.path_length, &stream_ctx->route);
                 if (path_item >= 0) {
                     stream_ctx->path_callback = app_ctx->path_table[path_item].path_callback;
-                    stream_ctx->path_callback(cnx, (uint8_t*)stream_ctx->ps.stream_state.header.path, stream_ctx->ps.stream_state.header.path_length, picohttp_callback_post, stream_ctx, 
+                    stream_ctx->path_callback(cnx, stream_ctx->ps.hq.path, stream_ctx->ps.hq.path_length, picohttp_callback_post, stream_ctx, 
                         app_ctx->path_table[path_item].path_app_ctx);
                 }
                 stream_ctx->post_received += available;
@@ -370,7 +375,7 @@ int picoquic_h09_server_process_data(picoquic_cnx_t* cnx,
             stream_ctx->ps.hq.status = picohttp_server_stream_status_finished;
 
             picoquic_log_app_message(cnx, "Server CB, Stream: %" PRIu64 ", Processing command: %s\n",
-                stream_id, strip_endofline(buf, sizeof(buf), (char*)&stream_ctx->frame));
+                stream_id, strip_endofline(buf, sizeof(buf), (char*)stream_ctx->frame));
 
             if (stream_ctx->ps.hq.method == 0) {
                 int file_error = 0;
@@ -385,11 +390,11 @@ int picoquic_h09_server_process_data(picoquic_cnx_t* cnx,
             }
             else if (stream_ctx->ps.hq.method == 1) {
                 if (stream_ctx->post_received == 0) {
-                    int path_item = picohttp_find_path_item(stream_ctx->ps.hq.path, stream_ctx->ps.hq.path_length, app_ctx->path_table, app_ctx->path_table_nb);
+                    int path_item = h3zero_route_path(app_ctx, stream_ctx->ps.hq.path, stream_ctx->ps.hq.path_length, &stream_ctx->route);
                     if (path_item >= 0) {
                         /* TODO-POST: move this code to post-fin callback.*/
                         stream_ctx->path_callback = app_ctx->path_table[path_item].path_callback;
-                        stream_ctx->path_callback(cnx, (uint8_t*)stream_ctx->ps.stream_state.header.path, stream_ctx->ps.stream_state.header.path_length, picohttp_callback_post, 
+                        stream_ctx->path_callback(cnx, stream_ctx->ps.hq.path, stream_ctx->ps.hq.path_length, picohttp_callback_post, 
                             stream_ctx, app_ctx->path_table[path_item].path_app_ctx);
                     }
                 }
@@ -424,7 +429,7 @@ int picoquic_h09_server_process_data(picoquic_cnx_t* cnx,
                 }
 
                 picoquic_log_app_message(cnx, "Server CB, Stream: %" PRIu64 ", Reply with bad request message after command: %s\n",
-                    stream_id, strip_endofline(buf, sizeof(buf), (char*)&stream_ctx->frame));
+                    stream_id, strip_endofline(buf, sizeof(buf), (char*)stream_ctx->frame));
 
                 stream_ctx->response_length = strlen(bad_request_message);
                 (void)picoquic_add_to_stream_with_ctx(cnx, stream_ctx->stream_id, (const uint8_t*)bad_request_message,
@@ -460,11 +465,11 @@ int picoquic_h09_server_process_data(picoquic_cnx_t* cnx,
         }
         else if (stream_ctx->response_length == 0 && stream_ctx->echo_length == 0 && stream_ctx->ps.hq.method == 0) {
             char buf[256];
-            if (stream_ctx->ps.hq.command_length < sizeof(stream_ctx->frame)){
+            if (stream_ctx->ps.hq.command_length < PICOHTTP_SERVER_FRAME_MAX){
                 stream_ctx->frame[stream_ctx->ps.hq.command_length] = 0;
 
                 picoquic_log_app_message(cnx, "Server CB, Stream: %" PRIu64 ", Partial command: %s\n",
-                    stream_id, strip_endofline(buf, sizeof(buf), (char*)&stream_ctx->frame));
+                    stream_id, strip_endofline(buf, sizeof(buf), (char*)stream_ctx->frame));
             }
             else {
 
@@ -43,10 +43,6 @@ extern "C" {
 #define PICOHTTP_ALPN_H3_LATEST "h3-32"
 #define PICOHTTP_ALPN_HQ_LATEST "hq-32"
 
-/* Identify the path item based on the incoming path in GET or POST */
-
-int picohttp_find_path_item(const uint8_t* path, size_t path_length, const picohttp_server_path_item_t* path_table, size_t path_table_nb);
-
 /* Define value for default pages */
 
 extern char const* h3zero_server_default_page;
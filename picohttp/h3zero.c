@@ -273,6 +273,70 @@ h3zero_qpack_static_t qpack_static[] = {
 
 size_t h3zero_qpack_nb_static = sizeof(qpack_static) / sizeof(h3zero_qpack_static_t);
 
+/* Names of the headers, in the order of http_header_enum_t. */
+static char const * h3zero_header_names[] = {
+    "", /* http_header_unknown */
+    ":authority", /* http_pseudo_header_authority */
+    ":path", /* http_pseudo_header_path */
+    "age", /* http_header_age */
+    "content-disposition", /* http_header_content_disposition */
+    "content-length", /* http_header_content_length */
+    "cookie", /* http_header_cookie */
+    "date", /* http_header_date */
+    "etag", /* http_header_etag */
+    "if-modified-since", /* http_header_if_modified_since */
+    "if-none-match", /* http_header_if_none_match */
+    "last-modified", /* http_header_last_modified */
+    "link", /* http_header_link */
+    "location", /* http_header_location */
+    "referer", /* http_header_referer */
+    "set-cookie", /* http_header_set_cookie */
+    ":method", /* http_pseudo_header_method */
+    ":scheme", /* http_pseudo_header_scheme */
+    ":status", /* http_pseudo_header_status */
+    ":protocol", /* http_pseudo_header_protocol */
+    "accept", /* http_header_accept */
+    "accept-encoding", /* http_header_accept_encoding */
+    "accept-ranges", /* http_header_accept_ranges */
+    "access-control-allow-headers", /* http_header_access_control_allow_headers */
+    "access-control-allow-origin", /* http_header_access_control_allow_origin */
+    "cache-control", /* http_header_cache_control */
+    "content-encoding", /* http_header_content_encoding */
+    "content-type", /* http_header_content_type */
+    "range", /* http_header_range */
+    "strict-transport-security", /* http_header_strict_transport_security */
+    "vary", /* http_header_vary */
+    "x-content-type-options", /* http_header_x_content_type_options */
+    "x-xss-protection", /* http_header_x_xss_protection */
+    "accept-language", /* http_header_accept_language */
+    "access-control-allow-credentials", /* http_header_access_control_allow_credentials */
+    "access-control-allow-methods", /* http_header_access_control_allow_methods */
+    "access-control-expose-headers", /* http_header_access_control_expose_headers */
+    "access-control-request-headers", /* http_header_access_control_request_headers */
+    "access-control-request-method", /* http_header_access_control_request_method */
+    "alt-svc", /* http_header_alt_svc */
+    "authorization", /* http_header_authorization */
+    "content-security-policy", /* http_header_content_security_policy */
+    "early-data", /* http_header_early_data */
+    "expect-ct", /* http_header_expect_ct */
+    "forwarded", /* http_header_forwarded */
+    "if-range", /* http_header_if_range */
+    "origin", /* http_header_origin */
+    "purpose", /* http_header_purpose */
+    "server", /* http_header_server */
+    "timing-allow-origin", /* http_header_timing_allow_origin */
+    "upgrade-insecure-requests", /* http_header_upgrade_insecure_requests */
+    "user-agent", /* http_header_user_agent */
+    "x-forwarded-for", /* http_header_x_forwarded_for */
+    "x-frame-options", /* http_header_x_frame_options */
+    "priority", /* http_header_priority */
+};
+
+char const * h3zero_get_header_name(http_header_enum_t header)
+{
+    return (header < http_header_max) ? h3zero_header_names[header] : h3zero_header_names[http_header_unknown];
+}
+
 /* 
  * Minimal QPACK parsing.
  *
@@ -403,6 +467,95 @@ uint8_t* h3zero_parse_qpack_header_value_string(uint8_t * bytes, uint8_t* decode
     return bytes;
 }
 
+/* Copy of the path, from the frame pool if the header parts have one */
+static int h3zero_parse_qpack_header_path(h3zero_header_parts_t* parts, const uint8_t* path, size_t path_length)
+{
+    int ret = 0;
+    int is_pooled = 0;
+    uint8_t* copy = h3zero_frame_buffer_get(parts->frame_pool, path_length + 1, &is_pooled);
+
+    if (copy == NULL) {
+        ret = -1;
+    }
+    else {
+        memcpy(copy, path, path_length);
+        copy[path_length] = 0;
+        parts->path = copy;
+        parts->path_length = path_length;
+        parts->path_is_pooled = is_pooled;
+    }
+    return ret;
+}
+
+static int h3zero_parse_qpack_header_decoded(http_header_enum_t header, uint8_t* decoded,
+    size_t decoded_length, h3zero_header_parts_t * parts)
+{
+    int ret = 0;
+
+    switch (header) {
+    case http_pseudo_header_method:
+        if (parts->method != h3zero_method_none) {
+            /* Duplicate method! */
+            ret = -1;
+        }
+        else {
+            parts->method = h3zero_get_method_by_name(decoded, decoded_length);
+        }
+        break;
+    case http_header_content_type:
+        if (parts->content_type != h3zero_content_type_none) {
+            /* Duplicate content type! */
+            ret = -1;
+        }
+        else {
+            parts->content_type = h3zero_get_content_type_by_name(decoded, decoded_length);
+        }
+        break;
+    case http_pseudo_header_status:
+        if (parts->status != 0) {
+            /* Duplicate content type! */
+            ret = -1;
+        }
+        else {
+            /* TODO: decimal to binary */
+            parts->status = h3zero_parse_status(decoded, decoded_length);
+        }
+        break;
+    case http_pseudo_header_path:
+        if (parts->path != NULL) {
+            /* Duplicate content type! */
+            ret = -1;
+        }
+        else {
+            ret = h3zero_parse_qpack_header_path(parts, decoded, decoded_length);
+        }
+        break;
+    case http_pseudo_header_protocol:
+        if (parts->protocol != NULL) {
+            /* Duplicate content type! */
+            ret = -1;
+        }
+        else if (h3zero_parse_qpack_header_value_string(decoded, decoded,
+            decoded_length, &parts->protocol, &parts->protocol_length) == NULL) {
+            ret = -1;
+        }
+        break;
+    case http_header_priority: {
+        /* Invalid priority fields are ignored, not treated as errors */
+        int incremental = 0;
+        if (h3zero_parse_priority_field(decoded, decoded_length, &parts->urgency, &incremental) == 0) {
+            parts->incremental = incremental;
+            parts->priority_found = 1;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+
+    return ret;
+}
+
 uint8_t * h3zero_parse_qpack_header_value(uint8_t * bytes, uint8_t * bytes_max,
     http_header_enum_t header, h3zero_header_parts_t * parts)
 {
@@ -412,6 +565,10 @@ uint8_t * h3zero_parse_qpack_header_value(uint8_t * bytes, uint8_t * bytes_max,
     size_t decoded_length;
     uint8_t deHuff[256];
 
+    if (bytes == NULL || bytes >= bytes_max) {
+        return NULL;
+    }
+
     is_huffman = (bytes[0] >> 7) & 1;
     bytes = h3zero_qpack_int_decode(bytes, bytes_max, 0x7F, &v_length);
     if (bytes != NULL) {
@@ -428,60 +585,10 @@ uint8_t * h3zero_parse_qpack_header_value(uint8_t * bytes, uint8_t * bytes_max,
                 decoded_length = (size_t) v_length;
             }
 
-            switch (header) {
-            case http_pseudo_header_method:
-                if (parts->method != h3zero_method_none) {
-                    /* Duplicate method! */
-                    bytes = 0;
-                }
-                else {
-                    parts->method = h3zero_get_method_by_name(decoded, decoded_length);
-                }
-                break;
-            case http_header_content_type:
-                if (parts->content_type != h3zero_content_type_none) {
-                    /* Duplicate content type! */
-                    bytes = 0;
-                }
-                else {
-                    parts->content_type = h3zero_get_content_type_by_name(decoded, decoded_length);
-                }
-                break;
-            case http_pseudo_header_status:
-                if (parts->status != 0) {
-                    /* Duplicate content type! */
-                    bytes = 0;
-                }
-                else {
-                    /* TODO: decimal to binary */
-                    parts->status = h3zero_parse_status(decoded, decoded_length);
-                }
-                break;
-            case http_pseudo_header_path:
-                if (parts->path != NULL) {
-                    /* Duplicate content type! */
-                    bytes = 0;
-                }
-                else {
-                    bytes = h3zero_parse_qpack_header_value_string(bytes, decoded,
-                        decoded_length, &parts->path, &parts->path_length);
-                }
-                break;
-            case http_pseudo_header_protocol:
-                if (parts->protocol != NULL) {
-                    /* Duplicate content type! */
-                    bytes = 0;
-                }
-                else {
-                    bytes = h3zero_parse_qpack_header_value_string(bytes, decoded,
-                        decoded_length, &parts->protocol, &parts->protocol_length);
-                }
-                break;
-            default:
-                break;
+            if (h3zero_parse_qpack_header_decoded(header, decoded, decoded_length, parts) != 0) {
+                bytes = NULL;
             }
-
-            if (bytes != NULL) {
+            else {
                 bytes += v_length;
             }
         }
@@ -493,11 +600,11 @@ uint8_t * h3zero_parse_qpack_header_value(uint8_t * bytes, uint8_t * bytes_max,
 int h3zero_get_interesting_header_type(uint8_t * name, size_t name_length, int is_huffman)
 {
     char const  * interesting_header_name[] = {
-     ":method", ":path", ":status", "content-type", ":protocol", "origin", NULL};
+     ":method", ":path", ":status", "content-type", ":protocol", "origin", "priority", NULL};
     const http_header_enum_t interesting_header[] = {
         http_pseudo_header_method, http_pseudo_header_path,
         http_pseudo_header_status, http_header_content_type,
-        http_pseudo_header_protocol, http_header_origin
+        http_pseudo_header_protocol, http_header_origin, http_header_priority
     };
     http_header_enum_t val = http_header_unknown;
     uint8_t deHuff[256];
@@ -521,24 +628,155 @@ int h3zero_get_interesting_header_type(uint8_t * name, size_t name_length, int i
     return val;
 }
 
-uint8_t * h3zero_parse_qpack_header_frame(uint8_t * bytes, uint8_t * bytes_max, 
-    h3zero_header_parts_t * parts)
+/* Decoding of the header section prefix, see section 4.5.1 of RFC 9204.
+ * The required insert count is encoded modulo twice the maximum number of
+ * entries in the decoder table. Without a dynamic table, the only
+ * acceptable value is zero.
+ */
+static uint8_t* h3zero_qpack_section_prefix_decode(uint8_t* bytes, uint8_t* bytes_max,
+    h3zero_qpack_decoder_t* decoder, uint64_t* required_insert_count, uint64_t* base)
+{
+    uint64_t encoded_insert_count = 0;
+    uint64_t delta_base = 0;
+
+    *required_insert_count = 0;
+    *base = 0;
+
+    bytes = h3zero_qpack_int_decode(bytes, bytes_max, 0xFF, &encoded_insert_count);
+    if (bytes != NULL && encoded_insert_count != 0) {
+        uint64_t max_entries = (decoder == NULL) ? 0 : decoder->table.max_capacity / H3ZERO_QPACK_ENTRY_OVERHEAD;
+        uint64_t full_range = 2 * max_entries;
+
+        if (encoded_insert_count > full_range) {
+            bytes = NULL;
+        }
+        else {
+            uint64_t max_value = decoder->table.insert_count + max_entries;
+            uint64_t max_wrapped = (max_value / full_range) * full_range;
+
+            *required_insert_count = max_wrapped + encoded_insert_count - 1;
+            if (*required_insert_count > max_value) {
+                if (*required_insert_count <= full_range) {
+                    bytes = NULL;
+                }
+                else {
+                    *required_insert_count -= full_range;
+                }
+            }
+            if (*required_insert_count == 0) {
+                bytes = NULL;
+            }
+        }
+    }
+    if (bytes != NULL && bytes < bytes_max) {
+        int is_negative = (bytes[0] & 0x80) != 0;
+
+        bytes = h3zero_qpack_int_decode(bytes, bytes_max, 0x7F, &delta_base);
+        if (bytes != NULL) {
+            if (!is_negative) {
+                *base = *required_insert_count + delta_base;
+            }
+            else if (delta_base < *required_insert_count) {
+                *base = *required_insert_count - delta_base - 1;
+            }
+            else {
+                bytes = NULL;
+            }
+        }
+    }
+    else {
+        bytes = NULL;
+    }
+
+    return bytes;
+}
+
+int h3zero_qpack_section_is_blocked(h3zero_qpack_decoder_t* decoder, uint8_t* bytes, uint8_t* bytes_max)
+{
+    int ret = 0;
+    uint64_t required_insert_count;
+    uint64_t base;
+
+    if (h3zero_qpack_section_prefix_decode(bytes, bytes_max, decoder, &required_insert_count, &base) == NULL) {
+        ret = -1;
+    }
+    else if (required_insert_count > 0 && required_insert_count > decoder->table.insert_count) {
+        ret = 1;
+    }
+    return ret;
+}
+
+/* Find the dynamic entry referenced in a field line. Relative indices count
+ * down from the base, post-base indices count up from it. The entry must be
+ * below the required insert count of the section.
+ */
+static h3zero_qpack_entry_t* h3zero_qpack_section_entry(h3zero_qpack_decoder_t* decoder,
+    uint64_t required_insert_count, uint64_t base, uint64_t index, int is_post_base)
+{
+    h3zero_qpack_entry_t* entry = NULL;
+
+    if (decoder != NULL) {
+        uint64_t absolute_index = UINT64_MAX;
+
+        if (is_post_base) {
+            absolute_index = base + index;
+        }
+        else if (index < base) {
+            absolute_index = base - 1 - index;
+        }
+        if (absolute_index < required_insert_count) {
+            entry = h3zero_qpack_table_get(&decoder->table, absolute_index);
+        }
+    }
+    return entry;
+}
+
+static uint8_t* h3zero_parse_qpack_dynamic_entry(uint8_t* bytes, h3zero_qpack_entry_t* entry, h3zero_header_parts_t* parts)
+{
+    if (bytes != NULL) {
+        if (entry == NULL ||
+            h3zero_parse_qpack_header_decoded(entry->header, entry->value, entry->value_length, parts) != 0) {
+            bytes = NULL;
+        }
+    }
+    return bytes;
+}
+
+static uint8_t* h3zero_parse_qpack_dynamic_name(uint8_t* bytes, uint8_t* bytes_max, h3zero_qpack_entry_t* entry, h3zero_header_parts_t* parts)
+{
+    if (bytes != NULL) {
+        if (entry == NULL) {
+            bytes = NULL;
+        }
+        else {
+            bytes = h3zero_parse_qpack_header_value(bytes, bytes_max, entry->header, parts);
+        }
+    }
+    return bytes;
+}
+
+static int h3zero_qpack_instruction_int_encode(h3zero_qpack_buffer_t* buffer, uint8_t prefix, uint8_t mask, uint64_t val);
+
+uint8_t * h3zero_parse_qpack_header_frame_pooled(uint8_t * bytes, uint8_t * bytes_max,
+    h3zero_header_parts_t * parts, h3zero_qpack_decoder_t* decoder, uint64_t stream_id,
+    h3zero_frame_pool_t* frame_pool)
 {
+    uint64_t required_insert_count = 0;
+    uint64_t base = 0;
+
     memset(parts, 0, sizeof(h3zero_header_parts_t));
+    parts->frame_pool = frame_pool;
 
     if (bytes == NULL || bytes >= bytes_max) {
         return NULL;
     }
 
-    /* parse base, expect 0 insert */
-    if (bytes[0] != 0) {
-        /* unexpected value */
+    /* parse required insert count and base. Blocked sections must be
+     * held by the caller until the encoder instructions arrive. */
+    bytes = h3zero_qpack_section_prefix_decode(bytes, bytes_max, decoder, &required_insert_count, &base);
+    if (bytes != NULL && required_insert_count > 0 && required_insert_count > decoder->table.insert_count) {
         bytes = NULL;
     }
-    else {
-        uint64_t delta_base;
-        bytes = h3zero_qpack_int_decode(bytes + 1, bytes_max, 0x7F, &delta_base);
-    }
 
     while (bytes != NULL && bytes < bytes_max) {
         if ((bytes[0] & 0xC0) == 0xC0) {
@@ -547,7 +785,7 @@ uint8_t * h3zero_parse_qpack_header_frame(uint8_t * bytes, uint8_t * bytes_max,
 
             bytes = h3zero_qpack_int_decode(bytes, bytes_max, 0x3F, &s_index);
 
-            if (s_index > h3zero_qpack_nb_static) {
+            if (s_index >= h3zero_qpack_nb_static) {
                 /* Index out of range */
                 bytes = NULL;
             }
@@ -585,18 +823,10 @@ uint8_t * h3zero_parse_qpack_header_frame(uint8_t * bytes, uint8_t * bytes_max,
                         /* Duplicate path! */
                         bytes = NULL;
                     }
-                    else {
-                        parts->path_length = strlen(qpack_static[s_index].content);
-                        parts->path = malloc(parts->path_length + 1);
-                        if (parts->path == NULL) {
-                            /* internal error */
-                            bytes = NULL;
-                            parts->path_length = 0;
-                        }
-                        else {
-                            memcpy((uint8_t *)parts->path, qpack_static[s_index].content, parts->path_length);
-                            ((uint8_t*)parts->path)[parts->path_length] = 0;
-                        }
+                    else if (h3zero_parse_qpack_header_path(parts, (const uint8_t*)qpack_static[s_index].content,
+                        strlen(qpack_static[s_index].content)) != 0) {
+                        /* internal error */
+                        bytes = NULL;
                     }
                     break;
                 case http_header_origin:
@@ -608,13 +838,33 @@ uint8_t * h3zero_parse_qpack_header_frame(uint8_t * bytes, uint8_t * bytes_max,
                 }
             }
         }
+        else if ((bytes[0] & 0xC0) == 0x80) {
+            /* Index reference with dynamic encoding */
+            uint64_t r_index;
+
+            bytes = h3zero_qpack_int_decode(bytes, bytes_max, 0x3F, &r_index);
+            if (bytes != NULL) {
+                bytes = h3zero_parse_qpack_dynamic_entry(bytes,
+                    h3zero_qpack_section_entry(decoder, required_insert_count, base, r_index, 0), parts);
+            }
+        }
+        else if ((bytes[0] & 0xF0) == 0x10) {
+            /* Index reference with post-base index */
+            uint64_t p_index;
+
+            bytes = h3zero_qpack_int_decode(bytes, bytes_max, 0x0F, &p_index);
+            if (bytes != NULL) {
+                bytes = h3zero_parse_qpack_dynamic_entry(bytes,
+                    h3zero_qpack_section_entry(decoder, required_insert_count, base, p_index, 1), parts);
+            }
+        }
         else if ((bytes[0] & 0xD0) == 0x50) {
             /* Literal header field with name reference, static encoding */
             uint64_t s_index;
 
             bytes = h3zero_qpack_int_decode(bytes, bytes_max, 0x0F, &s_index);
             if (bytes != NULL) {
-                if (s_index > h3zero_qpack_nb_static) {
+                if (s_index >= h3zero_qpack_nb_static) {
                     /* Index out of range */
                     bytes = NULL;
                 } else {
@@ -623,6 +873,16 @@ uint8_t * h3zero_parse_qpack_header_frame(uint8_t * bytes, uint8_t * bytes_max,
                 }
             }
         }
+        else if ((bytes[0] & 0xD0) == 0x40) {
+            /* Literal header field with name reference, dynamic encoding */
+            uint64_t r_index;
+
+            bytes = h3zero_qpack_int_decode(bytes, bytes_max, 0x0F, &r_index);
+            if (bytes != NULL) {
+                bytes = h3zero_parse_qpack_dynamic_name(bytes, bytes_max,
+                    h3zero_qpack_section_entry(decoder, required_insert_count, base, r_index, 0), parts);
+            }
+        }
         else if ((bytes[0] & 0xE0) == 0x20) {
             /* Literal Header Field Without Name Reference */
             uint64_t n_length;
@@ -641,15 +901,47 @@ uint8_t * h3zero_parse_qpack_header_frame(uint8_t * bytes, uint8_t * bytes_max,
                 }
             }
         }
+        else if ((bytes[0] & 0xF0) == 0x00) {
+            /* Literal header field with post-base name reference */
+            uint64_t p_index;
+
+            bytes = h3zero_qpack_int_decode(bytes, bytes_max, 0x07, &p_index);
+            if (bytes != NULL) {
+                bytes = h3zero_parse_qpack_dynamic_name(bytes, bytes_max,
+                    h3zero_qpack_section_entry(decoder, required_insert_count, base, p_index, 1), parts);
+            }
+        }
         else {
             /* unexpected encoding */
             bytes = NULL;
         }
     }
 
+    if (bytes != NULL && required_insert_count > 0) {
+        /* Section acknowledgement, on the decoder stream */
+        if (h3zero_qpack_instruction_int_encode(&decoder->instructions, 0x80, 0x7F, stream_id) != 0) {
+            bytes = NULL;
+        }
+        else if (required_insert_count > decoder->reported_insert_count) {
+            decoder->reported_insert_count = required_insert_count;
+        }
+    }
+
     return bytes;
 }
 
+uint8_t * h3zero_parse_qpack_header_frame_ex(uint8_t * bytes, uint8_t * bytes_max,
+    h3zero_header_parts_t * parts, h3zero_qpack_decoder_t* decoder, uint64_t stream_id)
+{
+    return h3zero_parse_qpack_header_frame_pooled(bytes, bytes_max, parts, decoder, stream_id, NULL);
+}
+
+uint8_t * h3zero_parse_qpack_header_frame(uint8_t * bytes, uint8_t * bytes_max, 
+    h3zero_header_parts_t * parts)
+{
+    return h3zero_parse_qpack_header_frame_ex(bytes, bytes_max, parts, NULL, 0);
+}
+
 /*
  * Header frame.
  * The HEADERS frame (type=0x1) is used to carry a header block,
@@ -701,20 +993,40 @@ static uint8_t * h3zero_qpack_code_encode(uint8_t * bytes, uint8_t * bytes_max,
     return bytes;
 }
 
+/* Encode a string literal, with a length prefix of the specified mask and
+ * the Huffman flag in the bit just above the mask. The Huffman encoding is
+ * only used if it makes the string shorter.
+ */
+static uint8_t * h3zero_qpack_string_encode(uint8_t * bytes, uint8_t * bytes_max,
+    uint8_t prefix, uint8_t mask, uint8_t const * s, size_t s_length)
+{
+    size_t huffman_length = h3zero_qpack_huffman_length(s, s_length);
+
+    if (huffman_length < s_length) {
+        bytes = h3zero_qpack_code_encode(bytes, bytes_max, prefix | (mask + 1), mask, huffman_length);
+        bytes = h3zero_qpack_huffman_encode(bytes, bytes_max, s, s_length);
+    }
+    else {
+        bytes = h3zero_qpack_code_encode(bytes, bytes_max, prefix, mask, s_length);
+        if (bytes != NULL && s_length > 0) {
+            if (bytes + s_length > bytes_max) {
+                bytes = NULL;
+            }
+            else {
+                memcpy(bytes, s, s_length);
+                bytes += s_length;
+            }
+        }
+    }
+
+    return bytes;
+}
+
 static uint8_t * h3zero_qpack_literal_plus_ref_encode(uint8_t * bytes, uint8_t * bytes_max,
     uint64_t code, uint8_t const * val, size_t val_length)
 {
     bytes = h3zero_qpack_code_encode(bytes, bytes_max, 0x50, 0x0F, code);
-    bytes = h3zero_qpack_code_encode(bytes, bytes_max, 0x00, 0x7F, val_length);
-    if (bytes != NULL && val_length > 0) {
-        if (bytes + val_length > bytes_max) {
-            bytes = NULL;
-        }
-        else {
-            memcpy(bytes, val, val_length);
-            bytes += val_length;
-        }
-    }
+    bytes = h3zero_qpack_string_encode(bytes, bytes_max, 0x00, 0x7F, val, val_length);
 
     return bytes;
 }
@@ -736,62 +1048,33 @@ This supposes that the literal is less than 127 bytes.
 * +-------------------------------+
 */
 
-static uint8_t * h3zero_qpack_name_encode(uint8_t * bytes, uint8_t * bytes_max,
-    uint8_t prefix, uint8_t mask, uint8_t const * name, size_t name_length) 
+static uint8_t * h3zero_qpack_literal_plus_name_encode(uint8_t * bytes, uint8_t * bytes_max,
+    uint8_t const * name, size_t name_length, uint8_t const * val, size_t val_length)
 {
-    if (bytes != NULL) {
-        if (bytes + 1 > bytes_max) {
-            bytes = NULL;
-        }
-        else {
-            *bytes = prefix;
-            bytes = h3zero_qpack_int_encode(bytes, bytes_max, mask, name_length);
-            if (bytes != NULL && name_length > 0) {
-                if (bytes + name_length > bytes_max) {
-                    bytes = NULL;
-                }
-                else {
-                    memcpy(bytes, name, name_length);
-                    bytes += name_length;
-                }
-            }
-        }
-    }
+    bytes = h3zero_qpack_string_encode(bytes, bytes_max, 0x20, 0x07, name, name_length);
+    bytes = h3zero_qpack_string_encode(bytes, bytes_max, 0x00, 0x7F, val, val_length);
 
     return bytes;
 }
 
-static uint8_t * h3zero_qpack_literal_plus_name_encode(uint8_t * bytes, uint8_t * bytes_max,
-    uint8_t const * name, size_t name_length, uint8_t const * val, size_t val_length)
+static int h3zero_get_content_type_code(h3zero_content_type_enum content_type)
 {
-
-    bytes = h3zero_qpack_name_encode(bytes, bytes_max, 0x20, 0x07, name, name_length);
-    bytes = h3zero_qpack_code_encode(bytes, bytes_max, 0x00, 0x7F, val_length);
-    if (bytes != NULL && val_length > 0) {
-        if (bytes + val_length > bytes_max) {
-            bytes = NULL;
-        }
-        else {
-            memcpy(bytes, val, val_length);
-            bytes += val_length;
+    int code = -1;
+    for (size_t i = 0; i < h3zero_qpack_nb_static; i++) {
+        if (qpack_static[i].header == http_header_content_type &&
+            qpack_static[i].enum_as_int == content_type) {
+            code = qpack_static[i].index;
+            break;
         }
     }
-
-    return bytes;
+    return code;
 }
 
 uint8_t * h3zero_encode_content_type(uint8_t * bytes, uint8_t * bytes_max, h3zero_content_type_enum content_type)
 {
     /* Content type header */
     if (bytes != NULL) {
-        int code = -1;
-        for (size_t i = 0; i < h3zero_qpack_nb_static; i++) {
-            if (qpack_static[i].header == http_header_content_type &&
-                qpack_static[i].enum_as_int == content_type) {
-                code = qpack_static[i].index;
-                break;
-            }
-        }
+        int code = h3zero_get_content_type_code(content_type);
 
         if (code < 0) {
             /* Error, no such content */
@@ -906,43 +1189,253 @@ uint8_t* h3zero_create_request_header_frame(uint8_t* bytes, uint8_t* bytes_max,
         host, H3ZERO_USER_AGENT_STRING);
 }
 
-uint8_t * h3zero_create_response_header_frame_ex(uint8_t * bytes, uint8_t * bytes_max,
-    h3zero_content_type_enum doc_type, char const* server_string)
-{
-
-    if (bytes == NULL || bytes + 2 > bytes_max) {
-        return NULL;
-    }
-    /* Push 2 NULL bytes for request header: base, and delta */
-    *bytes++ = 0;
-    *bytes++ = 0;
-
-    /* Status = 200 */
-    bytes = h3zero_qpack_code_encode(bytes, bytes_max, 0xC0, 0x3F, H3ZERO_QPACK_CODE_200);
-
-    /* Server string */
-    if (server_string != NULL) {
-        bytes = h3zero_qpack_literal_plus_ref_encode(bytes, bytes_max, H3ZERO_QPACK_SERVER, (uint8_t const*)server_string, strlen(server_string));
-    }
-
-    if (doc_type != h3zero_content_type_none) {
-        /* Content type header */
-        bytes = h3zero_encode_content_type(bytes, bytes_max, doc_type);
-    }
-
-    return bytes;
-}
+/* Extensible priorities, RFC 9218.
+ * The priority field is a structured field dictionary (RFC 8941), such
+ * as "u=1, i". Each member has a key, an optional value, and optional
+ * parameters. A key without value is a boolean set to true.
+ */
+#define H3ZERO_SF_ITEM_OTHER 0
+#define H3ZERO_SF_ITEM_INTEGER 1
+#define H3ZERO_SF_ITEM_BOOLEAN 2
 
-uint8_t* h3zero_create_response_header_frame(uint8_t* bytes, uint8_t* bytes_max,
-    h3zero_content_type_enum doc_type)
+static int h3zero_sf_is_key_char(uint8_t c)
 {
-    return h3zero_create_response_header_frame_ex(bytes, bytes_max, doc_type, H3ZERO_USER_AGENT_STRING);
+    return ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_' || c == '-' || c == '.' || c == '*');
 }
 
-uint8_t* h3zero_create_error_frame(uint8_t* bytes, uint8_t* bytes_max, char const* error_code, char const* server_string)
+/* Parse the key of a dictionary member or parameter, and the value that
+ * follows if any. Return the index after the last byte, or 0 if the
+ * syntax is not valid.
+ */
+static size_t h3zero_sf_parse_key_value(const uint8_t* v, size_t v_length, size_t i,
+    size_t* key_start, size_t* key_length, int* item_type, int64_t* item_value)
 {
-    if (bytes == NULL || bytes + 2 > bytes_max) {
-        return NULL;
+    *key_start = i;
+    if (i >= v_length || !((v[i] >= 'a' && v[i] <= 'z') || v[i] == '*')) {
+        return 0;
+    }
+    while (i < v_length && h3zero_sf_is_key_char(v[i])) {
+        i++;
+    }
+    *key_length = i - *key_start;
+    *item_type = H3ZERO_SF_ITEM_BOOLEAN;
+    *item_value = 1;
+
+    if (i < v_length && v[i] == '=') {
+        i++;
+        if (i >= v_length) {
+            i = 0;
+        }
+        else if (v[i] == '?') {
+            /* Boolean */
+            if (i + 1 < v_length && (v[i + 1] == '0' || v[i + 1] == '1')) {
+                *item_value = v[i + 1] - '0';
+                i += 2;
+            }
+            else {
+                i = 0;
+            }
+        }
+        else if (v[i] == '-' || (v[i] >= '0' && v[i] <= '9')) {
+            /* Integer or decimal. Only small integers are of interest. */
+            int is_negative = (v[i] == '-');
+            size_t nb_digits = 0;
+
+            *item_type = H3ZERO_SF_ITEM_INTEGER;
+            *item_value = 0;
+            if (is_negative) {
+                i++;
+            }
+            while (i < v_length && ((v[i] >= '0' && v[i] <= '9') || v[i] == '.')) {
+                if (v[i] == '.') {
+                    *item_type = H3ZERO_SF_ITEM_OTHER;
+                }
+                else if (nb_digits < 15) {
+                    *item_value = 10 * (*item_value) + (v[i] - '0');
+                }
+                nb_digits++;
+                i++;
+            }
+            if (is_negative) {
+                *item_value = -*item_value;
+            }
+            if (nb_digits == 0) {
+                i = 0;
+            }
+        }
+        else if (v[i] == '"') {
+            /* String */
+            *item_type = H3ZERO_SF_ITEM_OTHER;
+            i++;
+            while (i < v_length && v[i] != '"') {
+                i += (v[i] == '\\') ? 2 : 1;
+            }
+            i = (i < v_length) ? i + 1 : 0;
+        }
+        else {
+            /* Token, byte sequence or other item that priorities do not use */
+            *item_type = H3ZERO_SF_ITEM_OTHER;
+            while (i < v_length && v[i] != ',' && v[i] != ';' && v[i] != ' ' && v[i] != '\t') {
+                i++;
+            }
+        }
+    }
+
+    return i;
+}
+
+int h3zero_parse_priority_field(const uint8_t* value, size_t value_length, uint8_t* urgency, int* incremental)
+{
+    int ret = 0;
+    size_t i = 0;
+    uint8_t u = H3ZERO_PRIORITY_URGENCY_DEFAULT;
+    int inc = 0;
+
+    while (ret == 0 && i < value_length) {
+        size_t key_start = 0;
+        size_t key_length = 0;
+        int item_type = H3ZERO_SF_ITEM_OTHER;
+        int64_t item_value = 0;
+
+        while (i < value_length && (value[i] == ' ' || value[i] == '\t')) {
+            i++;
+        }
+        if ((i = h3zero_sf_parse_key_value(value, value_length, i, &key_start, &key_length, &item_type, &item_value)) == 0) {
+            ret = -1;
+            break;
+        }
+        if (key_length == 1 && value[key_start] == 'u') {
+            /* Urgencies outside of the range are ignored */
+            if (item_type == H3ZERO_SF_ITEM_INTEGER && item_value >= 0 && item_value <= H3ZERO_PRIORITY_URGENCY_MAX) {
+                u = (uint8_t)item_value;
+            }
+        }
+        else if (key_length == 1 && value[key_start] == 'i') {
+            if (item_type == H3ZERO_SF_ITEM_BOOLEAN) {
+                inc = (int)item_value;
+            }
+        }
+        /* Skip the parameters of the member */
+        while (ret == 0 && i < value_length && value[i] == ';') {
+            size_t p_start = 0;
+            size_t p_length = 0;
+            int p_type = 0;
+            int64_t p_value = 0;
+
+            i++;
+            while (i < value_length && value[i] == ' ') {
+                i++;
+            }
+            if ((i = h3zero_sf_parse_key_value(value, value_length, i, &p_start, &p_length, &p_type, &p_value)) == 0) {
+                ret = -1;
+            }
+        }
+        while (i < value_length && (value[i] == ' ' || value[i] == '\t')) {
+            i++;
+        }
+        if (ret == 0 && i < value_length) {
+            /* Members are separated by commas, and there is no trailing comma */
+            if (value[i] != ',' || i + 1 >= value_length) {
+                ret = -1;
+            }
+            else {
+                i++;
+            }
+        }
+    }
+
+    if (ret == 0) {
+        *urgency = u;
+        *incremental = inc;
+    }
+    else {
+        *urgency = H3ZERO_PRIORITY_URGENCY_DEFAULT;
+        *incremental = 0;
+    }
+
+    return ret;
+}
+
+size_t h3zero_format_priority_field(char* buf, size_t buf_size, uint8_t urgency, int incremental)
+{
+    size_t length = 0;
+
+    if (urgency > H3ZERO_PRIORITY_URGENCY_MAX) {
+        urgency = H3ZERO_PRIORITY_URGENCY_MAX;
+    }
+    if (buf_size >= 7) {
+        buf[length++] = 'u';
+        buf[length++] = '=';
+        buf[length++] = (char)('0' + urgency);
+        if (incremental) {
+            buf[length++] = ',';
+            buf[length++] = ' ';
+            buf[length++] = 'i';
+        }
+        buf[length] = 0;
+    }
+
+    return length;
+}
+
+uint8_t h3zero_priority_to_stream_priority(uint8_t urgency, int incremental)
+{
+    if (urgency > H3ZERO_PRIORITY_URGENCY_MAX) {
+        urgency = H3ZERO_PRIORITY_URGENCY_MAX;
+    }
+    return (uint8_t)(2 * urgency + ((incremental) ? 2 : 3));
+}
+
+/* Append a priority field to a header block, for example after
+ * h3zero_create_request_header_frame. The name is not in the static
+ * table, so the field is encoded as a literal name and value.
+ */
+uint8_t* h3zero_create_priority_header_field(uint8_t* bytes, uint8_t* bytes_max, uint8_t urgency, int incremental)
+{
+    char field[8];
+    size_t field_length = h3zero_format_priority_field(field, sizeof(field), urgency, incremental);
+
+    return h3zero_qpack_literal_plus_name_encode(bytes, bytes_max, (uint8_t const*)"priority", 8,
+        (uint8_t const*)field, field_length);
+}
+
+uint8_t * h3zero_create_response_header_frame_ex(uint8_t * bytes, uint8_t * bytes_max,
+    h3zero_content_type_enum doc_type, char const* server_string)
+{
+
+    if (bytes == NULL || bytes + 2 > bytes_max) {
+        return NULL;
+    }
+    /* Push 2 NULL bytes for request header: base, and delta */
+    *bytes++ = 0;
+    *bytes++ = 0;
+
+    /* Status = 200 */
+    bytes = h3zero_qpack_code_encode(bytes, bytes_max, 0xC0, 0x3F, H3ZERO_QPACK_CODE_200);
+
+    /* Server string */
+    if (server_string != NULL) {
+        bytes = h3zero_qpack_literal_plus_ref_encode(bytes, bytes_max, H3ZERO_QPACK_SERVER, (uint8_t const*)server_string, strlen(server_string));
+    }
+
+    if (doc_type != h3zero_content_type_none) {
+        /* Content type header */
+        bytes = h3zero_encode_content_type(bytes, bytes_max, doc_type);
+    }
+
+    return bytes;
+}
+
+uint8_t* h3zero_create_response_header_frame(uint8_t* bytes, uint8_t* bytes_max,
+    h3zero_content_type_enum doc_type)
+{
+    return h3zero_create_response_header_frame_ex(bytes, bytes_max, doc_type, H3ZERO_USER_AGENT_STRING);
+}
+
+uint8_t* h3zero_create_error_frame(uint8_t* bytes, uint8_t* bytes_max, char const* error_code, char const* server_string)
+{
+    if (bytes == NULL || bytes + 2 > bytes_max) {
+        return NULL;
     }
     /* Push 2 NULL bytes for request header: base, and delta */
     *bytes++ = 0;
@@ -952,45 +1445,886 @@ uint8_t* h3zero_create_error_frame(uint8_t* bytes, uint8_t* bytes_max, char cons
         bytes = h3zero_qpack_code_encode(bytes, bytes_max, 0xC0, 0x3F, H3ZERO_QPACK_CODE_404);
     }
     else {
-        bytes = h3zero_qpack_code_encode(bytes, bytes_max, 0x50, 0x0F, H3ZERO_QPACK_CODE_404);
-        if (bytes != NULL && bytes + 4 <= bytes_max) {
-            *bytes++ = 3;
-            *bytes++ = error_code[0];
-            *bytes++ = error_code[1];
-            *bytes++ = error_code[2];
+        bytes = h3zero_qpack_literal_plus_ref_encode(bytes, bytes_max, H3ZERO_QPACK_CODE_404, (uint8_t const*)error_code, strlen(error_code));
+    }
+
+    /* Server string */
+    if (server_string != NULL) {
+        bytes = h3zero_qpack_literal_plus_ref_encode(bytes, bytes_max, H3ZERO_QPACK_SERVER, (uint8_t const*)server_string, strlen(server_string));
+    }
+    /* Allowed methods */
+    if (strcmp(error_code, "405") == 0 && bytes != NULL) {
+        char const* allowed = "GET, POST, CONNECT";
+        bytes = h3zero_qpack_literal_plus_ref_encode(bytes, bytes_max, H3ZERO_QPACK_ALLOW_GET, (uint8_t*)allowed, strlen(allowed));
+    }
+    return bytes;
+}
+
+uint8_t * h3zero_create_not_found_header_frame_ex(uint8_t * bytes, uint8_t * bytes_max, char const* server_string)
+{
+    return h3zero_create_error_frame(bytes, bytes_max, "404", server_string);
+}
+
+uint8_t* h3zero_create_not_found_header_frame(uint8_t* bytes, uint8_t* bytes_max)
+{
+    return h3zero_create_not_found_header_frame_ex(bytes, bytes_max, H3ZERO_USER_AGENT_STRING);
+}
+
+uint8_t * h3zero_create_bad_method_header_frame_ex(uint8_t * bytes, uint8_t * bytes_max, char const* server_string)
+{
+    return h3zero_create_error_frame(bytes, bytes_max, "405", server_string);
+}
+
+uint8_t* h3zero_create_bad_method_header_frame(uint8_t* bytes, uint8_t* bytes_max)
+{
+    return h3zero_create_bad_method_header_frame_ex(bytes, bytes_max, H3ZERO_USER_AGENT_STRING);
+}
+
+/*
+ * QPACK dynamic table.
+ * The table is a ring of entries. Inserting an entry evicts the oldest
+ * entries until the new one fits. The name and the value of an entry
+ * are stored in a single allocation, name first.
+ */
+
+int h3zero_qpack_table_init(h3zero_qpack_table_t* table, uint64_t max_capacity)
+{
+    int ret = 0;
+
+    memset(table, 0, sizeof(h3zero_qpack_table_t));
+    table->max_capacity = max_capacity;
+    table->nb_entries_max = (size_t)(max_capacity / H3ZERO_QPACK_ENTRY_OVERHEAD);
+    if (table->nb_entries_max > 0) {
+        table->entries = (h3zero_qpack_entry_t*)malloc(table->nb_entries_max * sizeof(h3zero_qpack_entry_t));
+        if (table->entries == NULL) {
+            table->nb_entries_max = 0;
+            table->max_capacity = 0;
+            ret = -1;
+        }
+        else {
+            memset(table->entries, 0, table->nb_entries_max * sizeof(h3zero_qpack_entry_t));
+        }
+    }
+    return ret;
+}
+
+static void h3zero_qpack_table_evict(h3zero_qpack_table_t* table)
+{
+    h3zero_qpack_entry_t* entry = &table->entries[table->drop_count % table->nb_entries_max];
+
+    table->size -= entry->name_length + entry->value_length + H3ZERO_QPACK_ENTRY_OVERHEAD;
+    free(entry->name);
+    memset(entry, 0, sizeof(h3zero_qpack_entry_t));
+    table->drop_count++;
+}
+
+void h3zero_qpack_table_release(h3zero_qpack_table_t* table)
+{
+    while (table->drop_count < table->insert_count) {
+        h3zero_qpack_table_evict(table);
+    }
+    if (table->entries != NULL) {
+        free(table->entries);
+    }
+    memset(table, 0, sizeof(h3zero_qpack_table_t));
+}
+
+int h3zero_qpack_table_set_capacity(h3zero_qpack_table_t* table, uint64_t capacity)
+{
+    int ret = 0;
+
+    if (capacity > table->max_capacity) {
+        ret = -1;
+    }
+    else {
+        while (table->size > capacity) {
+            h3zero_qpack_table_evict(table);
+        }
+        table->capacity = capacity;
+    }
+    return ret;
+}
+
+/* The name and value are copied before evicting entries, because they
+ * may point to an entry that is about to be evicted. */
+int h3zero_qpack_table_insert(h3zero_qpack_table_t* table, http_header_enum_t header,
+    const uint8_t* name, size_t name_length, const uint8_t* value, size_t value_length)
+{
+    int ret = 0;
+    uint64_t entry_size = (uint64_t)name_length + value_length + H3ZERO_QPACK_ENTRY_OVERHEAD;
+
+    if (table->nb_entries_max == 0 || entry_size > table->capacity) {
+        ret = -1;
+    }
+    else {
+        uint8_t* data = (uint8_t*)malloc(name_length + value_length + 1);
+
+        if (data == NULL) {
+            ret = -1;
+        }
+        else {
+            h3zero_qpack_entry_t* entry;
+
+            if (name_length > 0) {
+                memcpy(data, name, name_length);
+            }
+            if (value_length > 0) {
+                memcpy(data + name_length, value, value_length);
+            }
+            while (table->size + entry_size > table->capacity) {
+                h3zero_qpack_table_evict(table);
+            }
+            entry = &table->entries[table->insert_count % table->nb_entries_max];
+            entry->header = header;
+            entry->name = data;
+            entry->name_length = name_length;
+            entry->value = data + name_length;
+            entry->value_length = value_length;
+            table->size += entry_size;
+            table->insert_count++;
+        }
+    }
+    return ret;
+}
+
+h3zero_qpack_entry_t* h3zero_qpack_table_get(h3zero_qpack_table_t* table, uint64_t absolute_index)
+{
+    h3zero_qpack_entry_t* entry = NULL;
+
+    if (absolute_index >= table->drop_count && absolute_index < table->insert_count) {
+        entry = &table->entries[absolute_index % table->nb_entries_max];
+    }
+    return entry;
+}
+
+/* Instruction buffers */
+static uint8_t* h3zero_qpack_buffer_reserve(h3zero_qpack_buffer_t* buffer, size_t needed)
+{
+    if (buffer->length + needed > buffer->size) {
+        size_t new_size = (buffer->size == 0) ? 256 : buffer->size;
+        uint8_t* new_bytes;
+
+        while (new_size < buffer->length + needed) {
+            new_size *= 2;
+        }
+        new_bytes = (uint8_t*)realloc(buffer->bytes, new_size);
+        if (new_bytes == NULL) {
+            return NULL;
+        }
+        buffer->bytes = new_bytes;
+        buffer->size = new_size;
+    }
+    return buffer->bytes + buffer->length;
+}
+
+static int h3zero_qpack_buffer_append(h3zero_qpack_buffer_t* buffer, const uint8_t* bytes, size_t length)
+{
+    int ret = 0;
+
+    if (length > 0) {
+        uint8_t* target = h3zero_qpack_buffer_reserve(buffer, length);
+        if (target == NULL) {
+            ret = -1;
+        }
+        else {
+            memcpy(target, bytes, length);
+            buffer->length += length;
+        }
+    }
+    return ret;
+}
+
+static void h3zero_qpack_buffer_consume(h3zero_qpack_buffer_t* buffer, size_t consumed)
+{
+    if (consumed >= buffer->length) {
+        buffer->length = 0;
+    }
+    else if (consumed > 0) {
+        memmove(buffer->bytes, buffer->bytes + consumed, buffer->length - consumed);
+        buffer->length -= consumed;
+    }
+}
+
+static void h3zero_qpack_buffer_release(h3zero_qpack_buffer_t* buffer)
+{
+    if (buffer->bytes != NULL) {
+        free(buffer->bytes);
+    }
+    memset(buffer, 0, sizeof(h3zero_qpack_buffer_t));
+}
+
+static int h3zero_qpack_instruction_int_encode(h3zero_qpack_buffer_t* buffer, uint8_t prefix, uint8_t mask, uint64_t val)
+{
+    int ret = 0;
+    uint8_t* bytes = h3zero_qpack_buffer_reserve(buffer, 16);
+
+    if (bytes == NULL) {
+        ret = -1;
+    }
+    else {
+        uint8_t* bytes_end;
+
+        *bytes = prefix;
+        if ((bytes_end = h3zero_qpack_int_encode(bytes, bytes + 16, mask, val)) == NULL) {
+            ret = -1;
+        }
+        else {
+            buffer->length += bytes_end - bytes;
+        }
+    }
+    return ret;
+}
+
+/* Instructions arrive on the encoder and decoder streams, and may be split
+ * between stream frames. The parsers check that an integer or a string is
+ * complete before decoding it, and set "is_incomplete" if it is not.
+ */
+static int h3zero_qpack_int_is_complete(uint8_t* bytes, uint8_t* bytes_max, uint8_t mask)
+{
+    int is_complete = 0;
+
+    if (bytes < bytes_max) {
+        if ((bytes[0] & mask) != mask) {
+            is_complete = 1;
+        }
+        else {
+            bytes++;
+            while (bytes < bytes_max) {
+                if (((*bytes++) & 0x80) == 0) {
+                    is_complete = 1;
+                    break;
+                }
+            }
+        }
+    }
+    return is_complete;
+}
+
+static uint8_t* h3zero_qpack_instruction_int_decode(uint8_t* bytes, uint8_t* bytes_max, uint8_t mask,
+    uint64_t* val, int* is_incomplete)
+{
+    if (bytes != NULL) {
+        if (!h3zero_qpack_int_is_complete(bytes, bytes_max, mask)) {
+            *is_incomplete = 1;
+            bytes = NULL;
+        }
+        else {
+            bytes = h3zero_qpack_int_decode(bytes, bytes_max, mask, val);
+        }
+    }
+    return bytes;
+}
+
+static uint8_t* h3zero_qpack_instruction_string_decode(uint8_t* bytes, uint8_t* bytes_max, uint8_t h_bit, uint8_t mask,
+    uint8_t** s, size_t* s_length, int* is_huffman, int* is_incomplete)
+{
+    uint64_t length = 0;
+
+    if (bytes != NULL && bytes < bytes_max) {
+        *is_huffman = (bytes[0] & h_bit) != 0;
+    }
+    bytes = h3zero_qpack_instruction_int_decode(bytes, bytes_max, mask, &length, is_incomplete);
+    if (bytes != NULL) {
+        if (length > (uint64_t)(bytes_max - bytes)) {
+            *is_incomplete = 1;
+            bytes = NULL;
+        }
+        else {
+            *s = bytes;
+            *s_length = (size_t)length;
+            bytes += length;
+        }
+    }
+    return bytes;
+}
+
+/* Huffman codes are at least 5 bits long, so the decoded string is less
+ * than twice as long as the encoded one. */
+static uint8_t* h3zero_qpack_huffman_copy(uint8_t* bytes, size_t length, size_t* decoded_length)
+{
+    size_t decoded_max = 2 * length + 1;
+    uint8_t* decoded = (uint8_t*)malloc(decoded_max);
+
+    if (decoded != NULL &&
+        hzero_qpack_huffman_decode(bytes, bytes + length, decoded, decoded_max, decoded_length) != 0) {
+        free(decoded);
+        decoded = NULL;
+    }
+    return decoded;
+}
+
+/*
+ * QPACK decoder.
+ * The decoder table mirrors the encoder table of the peer. It is updated
+ * by the instructions received on the peer's encoder stream. The decoder
+ * queues Insert Count Increment instructions after processing encoder
+ * instructions, Section Acknowledgement instructions after decoding a
+ * section that references the table, and Stream Cancellation if a
+ * blocked stream is abandoned.
+ */
+
+int h3zero_qpack_decoder_init(h3zero_qpack_decoder_t* decoder, uint64_t max_capacity, uint64_t max_blocked_streams)
+{
+    memset(decoder, 0, sizeof(h3zero_qpack_decoder_t));
+    decoder->max_blocked_streams = max_blocked_streams;
+    return h3zero_qpack_table_init(&decoder->table, max_capacity);
+}
+
+void h3zero_qpack_decoder_release(h3zero_qpack_decoder_t* decoder)
+{
+    h3zero_qpack_table_release(&decoder->table);
+    h3zero_qpack_buffer_release(&decoder->encoder_stream);
+    h3zero_qpack_buffer_release(&decoder->instructions);
+}
+
+int h3zero_qpack_decoder_cancel_stream(h3zero_qpack_decoder_t* decoder, uint64_t stream_id)
+{
+    int ret = 0;
+
+    if (decoder->table.max_capacity > 0) {
+        ret = h3zero_qpack_instruction_int_encode(&decoder->instructions, 0x40, 0x3F, stream_id);
+    }
+    return ret;
+}
+
+static int h3zero_qpack_decoder_insert(h3zero_qpack_decoder_t* decoder, http_header_enum_t header,
+    uint8_t* name, size_t name_length, int name_is_huffman,
+    uint8_t* value, size_t value_length, int value_is_huffman)
+{
+    int ret = 0;
+    uint8_t* name_decoded = NULL;
+    uint8_t* value_decoded = NULL;
+
+    if (name_is_huffman) {
+        if ((name_decoded = h3zero_qpack_huffman_copy(name, name_length, &name_length)) == NULL) {
+            ret = H3ZERO_QPACK_ENCODER_STREAM_ERROR;
+        }
+        else {
+            name = name_decoded;
+        }
+    }
+    if (ret == 0 && value_is_huffman) {
+        if ((value_decoded = h3zero_qpack_huffman_copy(value, value_length, &value_length)) == NULL) {
+            ret = H3ZERO_QPACK_ENCODER_STREAM_ERROR;
+        }
+        else {
+            value = value_decoded;
+        }
+    }
+    if (ret == 0) {
+        if (header == http_header_unknown) {
+            header = (http_header_enum_t)h3zero_get_interesting_header_type(name, name_length, 0);
+        }
+        if (h3zero_qpack_table_insert(&decoder->table, header, name, name_length, value, value_length) != 0) {
+            ret = H3ZERO_QPACK_ENCODER_STREAM_ERROR;
+        }
+    }
+    if (name_decoded != NULL) {
+        free(name_decoded);
+    }
+    if (value_decoded != NULL) {
+        free(value_decoded);
+    }
+    return ret;
+}
+
+/* Parse one encoder instruction. Sets "consumed" to zero if the
+ * instruction is not complete yet. */
+static int h3zero_qpack_decoder_parse_instruction(h3zero_qpack_decoder_t* decoder,
+    uint8_t* bytes, uint8_t* bytes_max, size_t* consumed)
+{
+    int ret = 0;
+    int is_incomplete = 0;
+    uint8_t* bytes_first = bytes;
+    uint8_t* name = NULL;
+    size_t name_length = 0;
+    int name_is_huffman = 0;
+    uint8_t* value = NULL;
+    size_t value_length = 0;
+    int value_is_huffman = 0;
+    uint64_t index = 0;
+
+    *consumed = 0;
+
+    if ((bytes[0] & 0x80) == 0x80) {
+        /* Insert with name reference, static if T bit (0x40) is set */
+        int is_static = (bytes[0] & 0x40) != 0;
+
+        bytes = h3zero_qpack_instruction_int_decode(bytes, bytes_max, 0x3F, &index, &is_incomplete);
+        bytes = h3zero_qpack_instruction_string_decode(bytes, bytes_max, 0x80, 0x7F, &value, &value_length,
+            &value_is_huffman, &is_incomplete);
+        if (bytes != NULL) {
+            if (is_static) {
+                if (index >= h3zero_qpack_nb_static) {
+                    ret = H3ZERO_QPACK_ENCODER_STREAM_ERROR;
+                }
+                else {
+                    char const* static_name = h3zero_get_header_name(qpack_static[index].header);
+                    ret = h3zero_qpack_decoder_insert(decoder, qpack_static[index].header,
+                        (uint8_t*)static_name, strlen(static_name), 0, value, value_length, value_is_huffman);
+                }
+            }
+            else {
+                h3zero_qpack_entry_t* entry = (index < decoder->table.insert_count) ?
+                    h3zero_qpack_table_get(&decoder->table, decoder->table.insert_count - 1 - index) : NULL;
+                if (entry == NULL) {
+                    ret = H3ZERO_QPACK_ENCODER_STREAM_ERROR;
+                }
+                else {
+                    ret = h3zero_qpack_decoder_insert(decoder, entry->header, entry->name, entry->name_length, 0,
+                        value, value_length, value_is_huffman);
+                }
+            }
+        }
+    }
+    else if ((bytes[0] & 0xC0) == 0x40) {
+        /* Insert with literal name */
+        bytes = h3zero_qpack_instruction_string_decode(bytes, bytes_max, 0x20, 0x1F, &name, &name_length,
+            &name_is_huffman, &is_incomplete);
+        bytes = h3zero_qpack_instruction_string_decode(bytes, bytes_max, 0x80, 0x7F, &value, &value_length,
+            &value_is_huffman, &is_incomplete);
+        if (bytes != NULL) {
+            ret = h3zero_qpack_decoder_insert(decoder, http_header_unknown, name, name_length, name_is_huffman,
+                value, value_length, value_is_huffman);
+        }
+    }
+    else if ((bytes[0] & 0xE0) == 0x20) {
+        /* Set dynamic table capacity */
+        bytes = h3zero_qpack_instruction_int_decode(bytes, bytes_max, 0x1F, &index, &is_incomplete);
+        if (bytes != NULL && h3zero_qpack_table_set_capacity(&decoder->table, index) != 0) {
+            ret = H3ZERO_QPACK_ENCODER_STREAM_ERROR;
+        }
+    }
+    else {
+        /* Duplicate */
+        bytes = h3zero_qpack_instruction_int_decode(bytes, bytes_max, 0x1F, &index, &is_incomplete);
+        if (bytes != NULL) {
+            h3zero_qpack_entry_t* entry = (index < decoder->table.insert_count) ?
+                h3zero_qpack_table_get(&decoder->table, decoder->table.insert_count - 1 - index) : NULL;
+            if (entry == NULL) {
+                ret = H3ZERO_QPACK_ENCODER_STREAM_ERROR;
+            }
+            else {
+                ret = h3zero_qpack_decoder_insert(decoder, entry->header, entry->name, entry->name_length, 0,
+                    entry->value, entry->value_length, 0);
+            }
         }
     }
 
-    /* Server string */
-    if (server_string != NULL) {
-        bytes = h3zero_qpack_literal_plus_ref_encode(bytes, bytes_max, H3ZERO_QPACK_SERVER, (uint8_t const*)server_string, strlen(server_string));
+    if (ret == 0) {
+        if (bytes != NULL) {
+            *consumed = bytes - bytes_first;
+        }
+        else if (!is_incomplete) {
+            ret = H3ZERO_QPACK_ENCODER_STREAM_ERROR;
+        }
     }
-    /* Allowed methods */
-    if (strcmp(error_code, "405") == 0 && bytes != NULL) {
-        char const* allowed = "GET, POST, CONNECT";
-        bytes = h3zero_qpack_literal_plus_ref_encode(bytes, bytes_max, H3ZERO_QPACK_ALLOW_GET, (uint8_t*)allowed, strlen(allowed));
+    return ret;
+}
+
+int h3zero_qpack_decoder_receive(h3zero_qpack_decoder_t* decoder, const uint8_t* bytes, size_t length)
+{
+    int ret = 0;
+
+    if (h3zero_qpack_buffer_append(&decoder->encoder_stream, bytes, length) != 0) {
+        ret = H3ZERO_INTERNAL_ERROR;
+    }
+    else {
+        size_t parsed = 0;
+
+        while (ret == 0 && parsed < decoder->encoder_stream.length) {
+            size_t consumed = 0;
+            ret = h3zero_qpack_decoder_parse_instruction(decoder, decoder->encoder_stream.bytes + parsed,
+                decoder->encoder_stream.bytes + decoder->encoder_stream.length, &consumed);
+            if (consumed == 0) {
+                break;
+            }
+            parsed += consumed;
+        }
+        h3zero_qpack_buffer_consume(&decoder->encoder_stream, parsed);
+        /* A pending instruction cannot be much larger than the table */
+        if (ret == 0 && decoder->encoder_stream.length > 2 * decoder->table.max_capacity + 64) {
+            ret = H3ZERO_QPACK_ENCODER_STREAM_ERROR;
+        }
+        if (ret == 0 && decoder->table.insert_count > decoder->reported_insert_count) {
+            if (h3zero_qpack_instruction_int_encode(&decoder->instructions, 0x00, 0x3F,
+                decoder->table.insert_count - decoder->reported_insert_count) != 0) {
+                ret = H3ZERO_INTERNAL_ERROR;
+            }
+            else {
+                decoder->reported_insert_count = decoder->table.insert_count;
+            }
+        }
+    }
+    return ret;
+}
+
+/*
+ * QPACK encoder.
+ * The encoder table is created once the peer settings are known, with
+ * the smaller of the local and peer maximum capacities. The capacity is
+ * set on the encoder stream before the first insertion.
+ */
+
+int h3zero_qpack_encoder_init(h3zero_qpack_encoder_t* encoder, uint64_t max_capacity)
+{
+    memset(encoder, 0, sizeof(h3zero_qpack_encoder_t));
+    encoder->local_max_capacity = max_capacity;
+    return 0;
+}
+
+void h3zero_qpack_encoder_release(h3zero_qpack_encoder_t* encoder)
+{
+    h3zero_qpack_table_release(&encoder->table);
+    if (encoder->sections != NULL) {
+        free(encoder->sections);
+    }
+    h3zero_qpack_buffer_release(&encoder->decoder_stream);
+    h3zero_qpack_buffer_release(&encoder->instructions);
+    encoder->sections = NULL;
+    encoder->nb_sections = 0;
+    encoder->nb_sections_max = 0;
+}
+
+int h3zero_qpack_encoder_set_peer_settings(h3zero_qpack_encoder_t* encoder,
+    uint64_t peer_max_capacity, uint64_t peer_blocked_streams)
+{
+    int ret = 0;
+
+    if (!encoder->is_peer_settings_known) {
+        encoder->is_peer_settings_known = 1;
+        encoder->peer_max_capacity = peer_max_capacity;
+        encoder->peer_blocked_streams = peer_blocked_streams;
+        ret = h3zero_qpack_table_init(&encoder->table,
+            (peer_max_capacity < encoder->local_max_capacity) ? peer_max_capacity : encoder->local_max_capacity);
+    }
+    return ret;
+}
+
+static int h3zero_qpack_encoder_section_ack(h3zero_qpack_encoder_t* encoder, uint64_t stream_id)
+{
+    int ret = H3ZERO_QPACK_DECODER_STREAM_ERROR;
+
+    for (size_t i = 0; i < encoder->nb_sections; i++) {
+        if (encoder->sections[i].stream_id == stream_id) {
+            if (encoder->sections[i].required_insert_count > encoder->known_received_count) {
+                encoder->known_received_count = encoder->sections[i].required_insert_count;
+            }
+            encoder->nb_sections--;
+            memmove(&encoder->sections[i], &encoder->sections[i + 1], (encoder->nb_sections - i) * sizeof(h3zero_qpack_section_t));
+            ret = 0;
+            break;
+        }
+    }
+    return ret;
+}
+
+static void h3zero_qpack_encoder_stream_cancel(h3zero_qpack_encoder_t* encoder, uint64_t stream_id)
+{
+    size_t j = 0;
+
+    for (size_t i = 0; i < encoder->nb_sections; i++) {
+        if (encoder->sections[i].stream_id != stream_id) {
+            encoder->sections[j++] = encoder->sections[i];
+        }
+    }
+    encoder->nb_sections = j;
+}
+
+int h3zero_qpack_encoder_receive(h3zero_qpack_encoder_t* encoder, const uint8_t* bytes, size_t length)
+{
+    int ret = 0;
+
+    if (h3zero_qpack_buffer_append(&encoder->decoder_stream, bytes, length) != 0) {
+        ret = H3ZERO_INTERNAL_ERROR;
+    }
+    else {
+        uint8_t* next = encoder->decoder_stream.bytes;
+        uint8_t* next_max = next + encoder->decoder_stream.length;
+
+        while (ret == 0 && next < next_max) {
+            int is_incomplete = 0;
+            uint64_t val = 0;
+            uint8_t* after;
+
+            if ((next[0] & 0x80) == 0x80) {
+                /* Section Acknowledgement */
+                if ((after = h3zero_qpack_instruction_int_decode(next, next_max, 0x7F, &val, &is_incomplete)) != NULL) {
+                    ret = h3zero_qpack_encoder_section_ack(encoder, val);
+                }
+            }
+            else if ((next[0] & 0xC0) == 0x40) {
+                /* Stream Cancellation */
+                if ((after = h3zero_qpack_instruction_int_decode(next, next_max, 0x3F, &val, &is_incomplete)) != NULL) {
+                    h3zero_qpack_encoder_stream_cancel(encoder, val);
+                }
+            }
+            else {
+                /* Insert Count Increment */
+                if ((after = h3zero_qpack_instruction_int_decode(next, next_max, 0x3F, &val, &is_incomplete)) != NULL) {
+                    if (val == 0 || val > encoder->table.insert_count - encoder->known_received_count) {
+                        ret = H3ZERO_QPACK_DECODER_STREAM_ERROR;
+                    }
+                    else {
+                        encoder->known_received_count += val;
+                    }
+                }
+            }
+            if (after == NULL) {
+                if (!is_incomplete) {
+                    ret = H3ZERO_QPACK_DECODER_STREAM_ERROR;
+                }
+                break;
+            }
+            next = after;
+        }
+        h3zero_qpack_buffer_consume(&encoder->decoder_stream, next - encoder->decoder_stream.bytes);
+        if (ret == 0 && encoder->decoder_stream.length > 16) {
+            ret = H3ZERO_QPACK_DECODER_STREAM_ERROR;
+        }
+    }
+    return ret;
+}
+
+static uint64_t h3zero_qpack_encoder_find(h3zero_qpack_encoder_t* encoder, uint8_t const* name, size_t name_length,
+    const h3zero_qpack_field_t* field)
+{
+    for (uint64_t i = encoder->table.drop_count; i < encoder->table.insert_count; i++) {
+        h3zero_qpack_entry_t* entry = &encoder->table.entries[i % encoder->table.nb_entries_max];
+        if (entry->value_length == field->value_length && entry->name_length == name_length &&
+            (field->value_length == 0 || memcmp(entry->value, field->value, field->value_length) == 0) &&
+            (name_length == 0 || memcmp(entry->name, name, name_length) == 0)) {
+            return i;
+        }
+    }
+    return UINT64_MAX;
+}
+
+/* Insert a field in the table if it fits without evicting anything, and
+ * queue the matching encoder instruction. Returns the absolute index of
+ * the new entry, or UINT64_MAX if it was not inserted. */
+static uint64_t h3zero_qpack_encoder_insert(h3zero_qpack_encoder_t* encoder, uint8_t const* name, size_t name_length,
+    const h3zero_qpack_field_t* field)
+{
+    uint64_t absolute_index = UINT64_MAX;
+    uint64_t entry_size = (uint64_t)name_length + field->value_length + H3ZERO_QPACK_ENTRY_OVERHEAD;
+
+    if (encoder->table.size + entry_size <= encoder->table.max_capacity) {
+        size_t needed = 48 + name_length + field->value_length;
+        uint8_t* bytes = h3zero_qpack_buffer_reserve(&encoder->instructions, needed);
+        uint8_t* bytes_max = bytes + needed;
+        uint8_t* bytes_first = bytes;
+
+        if (bytes != NULL && !encoder->is_capacity_sent) {
+            /* Set dynamic table capacity */
+            bytes = h3zero_qpack_code_encode(bytes, bytes_max, 0x20, 0x1F, encoder->table.max_capacity);
+        }
+        if (field->static_index != UINT64_MAX) {
+            /* Insert with static name reference */
+            bytes = h3zero_qpack_code_encode(bytes, bytes_max, 0xC0, 0x3F, field->static_index);
+        }
+        else {
+            /* Insert with literal name */
+            bytes = h3zero_qpack_string_encode(bytes, bytes_max, 0x40, 0x1F, name, name_length);
+        }
+        bytes = h3zero_qpack_string_encode(bytes, bytes_max, 0x00, 0x7F, field->value, field->value_length);
+        if (bytes != NULL &&
+            (encoder->is_capacity_sent || h3zero_qpack_table_set_capacity(&encoder->table, encoder->table.max_capacity) == 0) &&
+            h3zero_qpack_table_insert(&encoder->table,
+                (http_header_enum_t)h3zero_get_interesting_header_type((uint8_t*)name, name_length, 0),
+                name, name_length, field->value, field->value_length) == 0) {
+            encoder->is_capacity_sent = 1;
+            encoder->instructions.length += bytes - bytes_first;
+            absolute_index = encoder->table.insert_count - 1;
+        }
+    }
+    return absolute_index;
+}
+
+static int h3zero_qpack_encoder_add_section(h3zero_qpack_encoder_t* encoder, uint64_t stream_id, uint64_t required_insert_count)
+{
+    int ret = 0;
+
+    if (encoder->nb_sections >= encoder->nb_sections_max) {
+        size_t new_max = (encoder->nb_sections_max == 0) ? 16 : 2 * encoder->nb_sections_max;
+        h3zero_qpack_section_t* new_sections = (h3zero_qpack_section_t*)realloc(encoder->sections,
+            new_max * sizeof(h3zero_qpack_section_t));
+        if (new_sections == NULL) {
+            ret = -1;
+        }
+        else {
+            encoder->sections = new_sections;
+            encoder->nb_sections_max = new_max;
+        }
+    }
+    if (ret == 0) {
+        encoder->sections[encoder->nb_sections].stream_id = stream_id;
+        encoder->sections[encoder->nb_sections].required_insert_count = required_insert_count;
+        encoder->nb_sections++;
+    }
+    return ret;
+}
+
+/* Encode a header section. Insertions are done first, so that the base
+ * can be set to the required insert count and all references to the
+ * dynamic table use relative indices. Entries that the peer has not
+ * acknowledged yet are only referenced if the number of sections that
+ * could be blocked stays below the peer's limit.
+ */
+uint8_t* h3zero_qpack_encode_header_section(uint8_t* bytes, uint8_t* bytes_max,
+    h3zero_qpack_encoder_t* encoder, uint64_t stream_id,
+    const h3zero_qpack_field_t* fields, size_t nb_fields)
+{
+    uint64_t reference[H3ZERO_QPACK_SECTION_FIELDS_MAX];
+    uint64_t required_insert_count = 0;
+    int use_dynamic = (encoder != NULL && encoder->table.nb_entries_max > 0);
+    int can_block = 0;
+
+    if (bytes == NULL || nb_fields > H3ZERO_QPACK_SECTION_FIELDS_MAX) {
+        return NULL;
+    }
+
+    if (use_dynamic) {
+        uint64_t nb_blocking = 0;
+        for (size_t i = 0; i < encoder->nb_sections; i++) {
+            if (encoder->sections[i].required_insert_count > encoder->known_received_count) {
+                nb_blocking++;
+            }
+        }
+        can_block = nb_blocking < encoder->peer_blocked_streams;
+    }
+
+    for (size_t i = 0; bytes != NULL && i < nb_fields; i++) {
+        reference[i] = UINT64_MAX;
+        if (fields[i].static_index != UINT64_MAX && fields[i].static_index >= h3zero_qpack_nb_static) {
+            bytes = NULL;
+        }
+        else if (use_dynamic && !fields[i].is_static_match) {
+            uint8_t const* name = fields[i].name;
+            size_t name_length = fields[i].name_length;
+            uint64_t absolute_index;
+
+            if (fields[i].static_index != UINT64_MAX) {
+                name = (uint8_t const*)h3zero_get_header_name(qpack_static[fields[i].static_index].header);
+                name_length = strlen((char const*)name);
+            }
+            absolute_index = h3zero_qpack_encoder_find(encoder, name, name_length, &fields[i]);
+            if (absolute_index == UINT64_MAX && fields[i].is_indexable) {
+                absolute_index = h3zero_qpack_encoder_insert(encoder, name, name_length, &fields[i]);
+            }
+            if (absolute_index != UINT64_MAX && (absolute_index < encoder->known_received_count || can_block)) {
+                reference[i] = absolute_index;
+                if (absolute_index >= required_insert_count) {
+                    required_insert_count = absolute_index + 1;
+                }
+            }
+        }
+    }
+
+    /* Section prefix: required insert count, and base equal to it */
+    if (bytes == NULL || bytes + 2 > bytes_max) {
+        bytes = NULL;
+    }
+    else if (required_insert_count == 0) {
+        *bytes++ = 0;
+        *bytes++ = 0;
+    }
+    else {
+        uint64_t max_entries = encoder->peer_max_capacity / H3ZERO_QPACK_ENTRY_OVERHEAD;
+        bytes = h3zero_qpack_code_encode(bytes, bytes_max, 0x00, 0xFF, (required_insert_count % (2 * max_entries)) + 1);
+        bytes = h3zero_qpack_code_encode(bytes, bytes_max, 0x00, 0x7F, 0);
+    }
+
+    for (size_t i = 0; bytes != NULL && i < nb_fields; i++) {
+        if (fields[i].is_static_match) {
+            bytes = h3zero_qpack_code_encode(bytes, bytes_max, 0xC0, 0x3F, fields[i].static_index);
+        }
+        else if (reference[i] != UINT64_MAX) {
+            bytes = h3zero_qpack_code_encode(bytes, bytes_max, 0x80, 0x3F, required_insert_count - 1 - reference[i]);
+        }
+        else if (fields[i].static_index != UINT64_MAX) {
+            bytes = h3zero_qpack_literal_plus_ref_encode(bytes, bytes_max, fields[i].static_index,
+                fields[i].value, fields[i].value_length);
+        }
+        else {
+            bytes = h3zero_qpack_literal_plus_name_encode(bytes, bytes_max, fields[i].name, fields[i].name_length,
+                fields[i].value, fields[i].value_length);
+        }
+    }
+
+    if (bytes != NULL && required_insert_count > 0 &&
+        h3zero_qpack_encoder_add_section(encoder, stream_id, required_insert_count) != 0) {
+        bytes = NULL;
     }
+
     return bytes;
 }
 
-uint8_t * h3zero_create_not_found_header_frame_ex(uint8_t * bytes, uint8_t * bytes_max, char const* server_string)
+static void h3zero_qpack_static_field(h3zero_qpack_field_t* field, uint64_t static_index)
 {
-    return h3zero_create_error_frame(bytes, bytes_max, "404", server_string);
+    memset(field, 0, sizeof(h3zero_qpack_field_t));
+    field->static_index = static_index;
+    field->is_static_match = 1;
 }
 
-uint8_t* h3zero_create_not_found_header_frame(uint8_t* bytes, uint8_t* bytes_max)
+static void h3zero_qpack_static_name_field(h3zero_qpack_field_t* field, uint64_t static_index,
+    char const* value, int is_indexable)
 {
-    return h3zero_create_not_found_header_frame_ex(bytes, bytes_max, H3ZERO_USER_AGENT_STRING);
+    memset(field, 0, sizeof(h3zero_qpack_field_t));
+    field->static_index = static_index;
+    field->value = (uint8_t const*)value;
+    field->value_length = strlen(value);
+    field->is_indexable = is_indexable;
 }
 
-uint8_t * h3zero_create_bad_method_header_frame_ex(uint8_t * bytes, uint8_t * bytes_max, char const* server_string)
+uint8_t* h3zero_create_response_header_frame_qpack(uint8_t* bytes, uint8_t* bytes_max,
+    h3zero_content_type_enum doc_type, char const* server_string,
+    h3zero_qpack_encoder_t* encoder, uint64_t stream_id)
 {
-    return h3zero_create_error_frame(bytes, bytes_max, "405", server_string);
+    h3zero_qpack_field_t fields[3];
+    size_t nb_fields = 0;
+
+    /* Status = 200 */
+    h3zero_qpack_static_field(&fields[nb_fields++], H3ZERO_QPACK_CODE_200);
+    /* Server string */
+    if (server_string != NULL) {
+        h3zero_qpack_static_name_field(&fields[nb_fields++], H3ZERO_QPACK_SERVER, server_string, 1);
+    }
+    if (doc_type != h3zero_content_type_none) {
+        /* Content type header */
+        int code = h3zero_get_content_type_code(doc_type);
+        if (code < 0) {
+            return NULL;
+        }
+        h3zero_qpack_static_field(&fields[nb_fields++], code);
+    }
+
+    return h3zero_qpack_encode_header_section(bytes, bytes_max, encoder, stream_id, fields, nb_fields);
 }
 
-uint8_t* h3zero_create_bad_method_header_frame(uint8_t* bytes, uint8_t* bytes_max)
+uint8_t* h3zero_create_error_frame_qpack(uint8_t* bytes, uint8_t* bytes_max, char const* error_code,
+    char const* server_string, h3zero_qpack_encoder_t* encoder, uint64_t stream_id)
 {
-    return h3zero_create_bad_method_header_frame_ex(bytes, bytes_max, H3ZERO_USER_AGENT_STRING);
+    h3zero_qpack_field_t fields[3];
+    size_t nb_fields = 0;
+
+    /* Status = 404, or other code */
+    if (strcmp(error_code, "404") == 0) {
+        h3zero_qpack_static_field(&fields[nb_fields++], H3ZERO_QPACK_CODE_404);
+    }
+    else {
+        h3zero_qpack_static_name_field(&fields[nb_fields++], H3ZERO_QPACK_CODE_404, error_code, 0);
+    }
+    /* Server string */
+    if (server_string != NULL) {
+        h3zero_qpack_static_name_field(&fields[nb_fields++], H3ZERO_QPACK_SERVER, server_string, 1);
+    }
+    /* Allowed methods */
+    if (strcmp(error_code, "405") == 0) {
+        h3zero_qpack_static_name_field(&fields[nb_fields++], H3ZERO_QPACK_ALLOW_GET, "GET, POST, CONNECT", 1);
+    }
+
+    return h3zero_qpack_encode_header_section(bytes, bytes_max, encoder, stream_id, fields, nb_fields);
 }
 
 /* Read varint from stream.
@@ -1035,9 +2369,10 @@ uint8_t * h3zero_varint_from_stream(uint8_t* bytes, uint8_t* bytes_max, uint64_t
 void h3zero_release_header_parts(h3zero_header_parts_t* header)
 {
     if (header->path != NULL) {
-        free((uint8_t*)header->path);
+        h3zero_frame_buffer_release(header->frame_pool, (uint8_t*)header->path, header->path_is_pooled);
         *((uint8_t**)&header->path) = NULL;
         header->path_length = 0;
+        header->path_is_pooled = 0;
     }
     if (header->protocol != NULL) {
         free((uint8_t*)header->protocol);
@@ -1046,19 +2381,61 @@ void h3zero_release_header_parts(h3zero_header_parts_t* header)
     }
 }
 
+uint8_t* h3zero_frame_buffer_get(h3zero_frame_pool_t* pool, size_t length, int* is_pooled)
+{
+    uint8_t* buffer = NULL;
+
+    *is_pooled = 0;
+    if (pool != NULL && length <= H3ZERO_FRAME_BUFFER_SIZE) {
+        if (pool->nb_buffers > 0) {
+            buffer = pool->buffers[--pool->nb_buffers];
+        }
+        else if ((buffer = (uint8_t*)malloc(H3ZERO_FRAME_BUFFER_SIZE)) != NULL) {
+            pool->nb_allocated++;
+        }
+        *is_pooled = (buffer != NULL);
+    }
+    else {
+        buffer = (uint8_t*)malloc((length > 0) ? length : 1);
+    }
+
+    return buffer;
+}
+
+void h3zero_frame_buffer_release(h3zero_frame_pool_t* pool, uint8_t* buffer, int is_pooled)
+{
+    if (is_pooled && pool != NULL && pool->nb_buffers < H3ZERO_FRAME_POOL_MAX) {
+        pool->buffers[pool->nb_buffers++] = buffer;
+    }
+    else {
+        free(buffer);
+    }
+}
+
+void h3zero_frame_pool_release(h3zero_frame_pool_t* pool)
+{
+    while (pool->nb_buffers > 0) {
+        free(pool->buffers[--pool->nb_buffers]);
+    }
+}
+
 void h3zero_delete_data_stream_state(h3zero_data_stream_state_t * stream_state)
 {
     if (stream_state->header_found){
         h3zero_release_header_parts(&stream_state->header);
     }
 
-    if (stream_state->trailer_found){
-        h3zero_release_header_parts(&stream_state->trailer);
-    }
-
     if (stream_state->current_frame != NULL) {
-        free(stream_state->current_frame);
+        h3zero_frame_buffer_release(stream_state->frame_pool, stream_state->current_frame,
+            stream_state->is_current_frame_pooled);
         stream_state->current_frame = NULL;
+        stream_state->is_current_frame_pooled = 0;
+    }
+
+    if (stream_state->blocked_bytes != NULL) {
+        free(stream_state->blocked_bytes);
+        stream_state->blocked_bytes = NULL;
+        stream_state->blocked_length = 0;
     }
 }
 
@@ -1091,659 +2468,1475 @@ uint8_t const * h3zero_default_setting_frame = h3zero_default_setting_frame_val;
 
 const size_t h3zero_default_setting_frame_size = sizeof(h3zero_default_setting_frame_val);
 
-/* There is no way in QPACK to prevent sender from using Huffman 
- * encoding. We use a simple decoding function with two tables:
- * - h3zero_qpack_huffman_bit, 64 bytes, 512 bits
- * - h3zero_qpack_huffman_val, 512 bytes.
- * If the bit at position "i" is set in the "bit" table, the code decoded so
- * far is an index. Increase "i" by one if the input byte is zero, by the
- * value in the "val" table if 1.
- * If the bit at position "i" is set in the "bit" table, the code decoded so
- * far is a terminal. Add the value in "val" to the decoded octet list, and
- * reset the index "i" to zero.
+/* Huffman coding of QPACK strings, using the static code of RFC 7541,
+ * appendix B.
+ *
+ * The encoding table lists the code and its length in bits for each octet.
+ * Codes are shifted in a 64 bit accumulator, and whole octets are written
+ * out as soon as they are available. The last octet is padded with ones,
+ * i.e., the most significant bits of the EOS code.
+ *
+ * Decoding proceeds four bits at a time. The 256 states of the decoder are
+ * the internal nodes of the Huffman tree, with the root as state 0. For
+ * each state and each nibble of input, the table gives the next state, and
+ * flags indicating whether a symbol was decoded (at most one, since the
+ * shortest code has 5 bits), whether the EOS code was found, which is an
+ * error, and whether the bits since the last symbol are all ones, which
+ * means that the input can validly end at that point.
  */
 
-const uint8_t h3zero_qpack_huffman_bit[64] = {
-    249,
-    50,
-    115,
-    39,
-    38,
-    79,
-    147,
-    39,
-    38,
-    100,
-    249,
-    50,
-    114,
-    100,
-    242,
-    100,
-    228,
-    228,
-    206,
-    77,
-    52,
-    228,
-    204,
-    203,
-    202,
-    114,
-    102,
-    79,
-    147,
-    39,
-    76,
-    156,
-    153,
-    62,
-    76,
-    156,
-    156,
-    153,
-    62,
-    76,
-    156,
-    153,
-    60,
-    154,
-    100,
-    242,
-    102,
-    79,
-    147,
-    39,
-    38,
-    83,
-    228,
-    201,
-    201,
-    147,
-    211,
-    39,
-    38,
-    79,
-    38,
-    78,
-    76,
-    178
+typedef struct st_h3zero_qpack_huffman_code_t {
+    uint32_t code;
+    uint8_t nb_bits;
+} h3zero_qpack_huffman_code_t;
+
+static const h3zero_qpack_huffman_code_t h3zero_qpack_huffman_code[256] = {
+    { 0x1ff8, 13 }, { 0x7fffd8, 23 }, { 0xfffffe2, 28 }, { 0xfffffe3, 28 }, /* 0-3 */
+    { 0xfffffe4, 28 }, { 0xfffffe5, 28 }, { 0xfffffe6, 28 }, { 0xfffffe7, 28 }, /* 4-7 */
+    { 0xfffffe8, 28 }, { 0xffffea, 24 }, { 0x3ffffffc, 30 }, { 0xfffffe9, 28 }, /* 8-11 */
+    { 0xfffffea, 28 }, { 0x3ffffffd, 30 }, { 0xfffffeb, 28 }, { 0xfffffec, 28 }, /* 12-15 */
+    { 0xfffffed, 28 }, { 0xfffffee, 28 }, { 0xfffffef, 28 }, { 0xffffff0, 28 }, /* 16-19 */
+    { 0xffffff1, 28 }, { 0xffffff2, 28 }, { 0x3ffffffe, 30 }, { 0xffffff3, 28 }, /* 20-23 */
+    { 0xffffff4, 28 }, { 0xffffff5, 28 }, { 0xffffff6, 28 }, { 0xffffff7, 28 }, /* 24-27 */
+    { 0xffffff8, 28 }, { 0xffffff9, 28 }, { 0xffffffa, 28 }, { 0xffffffb, 28 }, /* 28-31 */
+    { 0x14, 6 }, { 0x3f8, 10 }, { 0x3f9, 10 }, { 0xffa, 12 }, /* 32-35 */
+    { 0x1ff9, 13 }, { 0x15, 6 }, { 0xf8, 8 }, { 0x7fa, 11 }, /* 36-39 */
+    { 0x3fa, 10 }, { 0x3fb, 10 }, { 0xf9, 8 }, { 0x7fb, 11 }, /* 40-43 */
+    { 0xfa, 8 }, { 0x16, 6 }, { 0x17, 6 }, { 0x18, 6 }, /* 44-47 */
+    { 0x0, 5 }, { 0x1, 5 }, { 0x2, 5 }, { 0x19, 6 }, /* 48-51 */
+    { 0x1a, 6 }, { 0x1b, 6 }, { 0x1c, 6 }, { 0x1d, 6 }, /* 52-55 */
+    { 0x1e, 6 }, { 0x1f, 6 }, { 0x5c, 7 }, { 0xfb, 8 }, /* 56-59 */
+    { 0x7ffc, 15 }, { 0x20, 6 }, { 0xffb, 12 }, { 0x3fc, 10 }, /* 60-63 */
+    { 0x1ffa, 13 }, { 0x21, 6 }, { 0x5d, 7 }, { 0x5e, 7 }, /* 64-67 */
+    { 0x5f, 7 }, { 0x60, 7 }, { 0x61, 7 }, { 0x62, 7 }, /* 68-71 */
+    { 0x63, 7 }, { 0x64, 7 }, { 0x65, 7 }, { 0x66, 7 }, /* 72-75 */
+    { 0x67, 7 }, { 0x68, 7 }, { 0x69, 7 }, { 0x6a, 7 }, /* 76-79 */
+    { 0x6b, 7 }, { 0x6c, 7 }, { 0x6d, 7 }, { 0x6e, 7 }, /* 80-83 */
+    { 0x6f, 7 }, { 0x70, 7 }, { 0x71, 7 }, { 0x72, 7 }, /* 84-87 */
+    { 0xfc, 8 }, { 0x73, 7 }, { 0xfd, 8 }, { 0x1ffb, 13 }, /* 88-91 */
+    { 0x7fff0, 19 }, { 0x1ffc, 13 }, { 0x3ffc, 14 }, { 0x22, 6 }, /* 92-95 */
+    { 0x7ffd, 15 }, { 0x3, 5 }, { 0x23, 6 }, { 0x4, 5 }, /* 96-99 */
+    { 0x24, 6 }, { 0x5, 5 }, { 0x25, 6 }, { 0x26, 6 }, /* 100-103 */
+    { 0x27, 6 }, { 0x6, 5 }, { 0x74, 7 }, { 0x75, 7 }, /* 104-107 */
+    { 0x28, 6 }, { 0x29, 6 }, { 0x2a, 6 }, { 0x7, 5 }, /* 108-111 */
+    { 0x2b, 6 }, { 0x76, 7 }, { 0x2c, 6 }, { 0x8, 5 }, /* 112-115 */
+    { 0x9, 5 }, { 0x2d, 6 }, { 0x77, 7 }, { 0x78, 7 }, /* 116-119 */
+    { 0x79, 7 }, { 0x7a, 7 }, { 0x7b, 7 }, { 0x7ffe, 15 }, /* 120-123 */
+    { 0x7fc, 11 }, { 0x3ffd, 14 }, { 0x1ffd, 13 }, { 0xffffffc, 28 }, /* 124-127 */
+    { 0xfffe6, 20 }, { 0x3fffd2, 22 }, { 0xfffe7, 20 }, { 0xfffe8, 20 }, /* 128-131 */
+    { 0x3fffd3, 22 }, { 0x3fffd4, 22 }, { 0x3fffd5, 22 }, { 0x7fffd9, 23 }, /* 132-135 */
+    { 0x3fffd6, 22 }, { 0x7fffda, 23 }, { 0x7fffdb, 23 }, { 0x7fffdc, 23 }, /* 136-139 */
+    { 0x7fffdd, 23 }, { 0x7fffde, 23 }, { 0xffffeb, 24 }, { 0x7fffdf, 23 }, /* 140-143 */
+    { 0xffffec, 24 }, { 0xffffed, 24 }, { 0x3fffd7, 22 }, { 0x7fffe0, 23 }, /* 144-147 */
+    { 0xffffee, 24 }, { 0x7fffe1, 23 }, { 0x7fffe2, 23 }, { 0x7fffe3, 23 }, /* 148-151 */
+    { 0x7fffe4, 23 }, { 0x1fffdc, 21 }, { 0x3fffd8, 22 }, { 0x7fffe5, 23 }, /* 152-155 */
+    { 0x3fffd9, 22 }, { 0x7fffe6, 23 }, { 0x7fffe7, 23 }, { 0xffffef, 24 }, /* 156-159 */
+    { 0x3fffda, 22 }, { 0x1fffdd, 21 }, { 0xfffe9, 20 }, { 0x3fffdb, 22 }, /* 160-163 */
+    { 0x3fffdc, 22 }, { 0x7fffe8, 23 }, { 0x7fffe9, 23 }, { 0x1fffde, 21 }, /* 164-167 */
+    { 0x7fffea, 23 }, { 0x3fffdd, 22 }, { 0x3fffde, 22 }, { 0xfffff0, 24 }, /* 168-171 */
+    { 0x1fffdf, 21 }, { 0x3fffdf, 22 }, { 0x7fffeb, 23 }, { 0x7fffec, 23 }, /* 172-175 */
+    { 0x1fffe0, 21 }, { 0x1fffe1, 21 }, { 0x3fffe0, 22 }, { 0x1fffe2, 21 }, /* 176-179 */
+    { 0x7fffed, 23 }, { 0x3fffe1, 22 }, { 0x7fffee, 23 }, { 0x7fffef, 23 }, /* 180-183 */
+    { 0xfffea, 20 }, { 0x3fffe2, 22 }, { 0x3fffe3, 22 }, { 0x3fffe4, 22 }, /* 184-187 */
+    { 0x7ffff0, 23 }, { 0x3fffe5, 22 }, { 0x3fffe6, 22 }, { 0x7ffff1, 23 }, /* 188-191 */
+    { 0x3ffffe0, 26 }, { 0x3ffffe1, 26 }, { 0xfffeb, 20 }, { 0x7fff1, 19 }, /* 192-195 */
+    { 0x3fffe7, 22 }, { 0x7ffff2, 23 }, { 0x3fffe8, 22 }, { 0x1ffffec, 25 }, /* 196-199 */
+    { 0x3ffffe2, 26 }, { 0x3ffffe3, 26 }, { 0x3ffffe4, 26 }, { 0x7ffffde, 27 }, /* 200-203 */
+    { 0x7ffffdf, 27 }, { 0x3ffffe5, 26 }, { 0xfffff1, 24 }, { 0x1ffffed, 25 }, /* 204-207 */
+    { 0x7fff2, 19 }, { 0x1fffe3, 21 }, { 0x3ffffe6, 26 }, { 0x7ffffe0, 27 }, /* 208-211 */
+    { 0x7ffffe1, 27 }, { 0x3ffffe7, 26 }, { 0x7ffffe2, 27 }, { 0xfffff2, 24 }, /* 212-215 */
+    { 0x1fffe4, 21 }, { 0x1fffe5, 21 }, { 0x3ffffe8, 26 }, { 0x3ffffe9, 26 }, /* 216-219 */
+    { 0xffffffd, 28 }, { 0x7ffffe3, 27 }, { 0x7ffffe4, 27 }, { 0x7ffffe5, 27 }, /* 220-223 */
+    { 0xfffec, 20 }, { 0xfffff3, 24 }, { 0xfffed, 20 }, { 0x1fffe6, 21 }, /* 224-227 */
+    { 0x3fffe9, 22 }, { 0x1fffe7, 21 }, { 0x1fffe8, 21 }, { 0x7ffff3, 23 }, /* 228-231 */
+    { 0x3fffea, 22 }, { 0x3fffeb, 22 }, { 0x1ffffee, 25 }, { 0x1ffffef, 25 }, /* 232-235 */
+    { 0xfffff4, 24 }, { 0xfffff5, 24 }, { 0x3ffffea, 26 }, { 0x7ffff4, 23 }, /* 236-239 */
+    { 0x3ffffeb, 26 }, { 0x7ffffe6, 27 }, { 0x3ffffec, 26 }, { 0x3ffffed, 26 }, /* 240-243 */
+    { 0x7ffffe7, 27 }, { 0x7ffffe8, 27 }, { 0x7ffffe9, 27 }, { 0x7ffffea, 27 }, /* 244-247 */
+    { 0x7ffffeb, 27 }, { 0xffffffe, 28 }, { 0x7ffffec, 27 }, { 0x7ffffed, 27 }, /* 248-251 */
+    { 0x7ffffee, 27 }, { 0x7ffffef, 27 }, { 0x7fffff0, 27 }, { 0x3ffffee, 26 } /* 252-255 */
 };
 
-const uint8_t h3zero_qpack_huffman_val[512] = {
-    /* 0: |  X: 44 */ 44,
-    /* 1: |0  X: 17 */ 16,
-    /* 2: |00  X: 10 */ 8,
-    /* 3: |000  X: 7 */ 4,
-    /* 4: |0000  X: 6 */ 2,
-    /* 5: |00000  V: 48 */ 48,
-    /* 6: |00001  V: 49 */ 49,
-    /* 7: |0001  X: 9 */ 2,
-    /* 8: |00010  V: 50 */ 50,
-    /* 9: |00011  V: 97 */ 97,
-    /* 10: |001  X: 14 */ 4,
-    /* 11: |0010  X: 13 */ 2,
-    /* 12: |00100  V: 99 */ 99,
-    /* 13: |00101  V: 101 */ 101,
-    /* 14: |0011  X: 16 */ 2,
-    /* 15: |00110  V: 105 */ 105,
-    /* 16: |00111  V: 111 */ 111,
-    /* 17: |01  X: 29 */ 12,
-    /* 18: |010  X: 22 */ 4,
-    /* 19: |0100  X: 21 */ 2,
-    /* 20: |01000  V: 115 */ 115,
-    /* 21: |01001  V: 116 */ 116,
-    /* 22: |0101  X: 26 */ 4,
-    /* 23: |01010  X: 25 */ 2,
-    /* 24: |010100  V: 32 */ 32,
-    /* 25: |010101  V: 37 */ 37,
-    /* 26: |01011  X: 28 */ 2,
-    /* 27: |010110  V: 45 */ 45,
-    /* 28: |010111  V: 46 */ 46,
-    /* 29: |011  X: 37 */ 8,
-    /* 30: |0110  X: 34 */ 4,
-    /* 31: |01100  X: 33 */ 2,
-    /* 32: |011000  V: 47 */ 47,
-    /* 33: |011001  V: 51 */ 51,
-    /* 34: |01101  X: 36 */ 2,
-    /* 35: |011010  V: 52 */ 52,
-    /* 36: |011011  V: 53 */ 53,
-    /* 37: |0111  X: 41 */ 4,
-    /* 38: |01110  X: 40 */ 2,
-    /* 39: |011100  V: 54 */ 54,
-    /* 40: |011101  V: 55 */ 55,
-    /* 41: |01111  X: 43 */ 2,
-    /* 42: |011110  V: 56 */ 56,
-    /* 43: |011111  V: 57 */ 57,
-    /* 44: |1  X: 80 */ 36,
-    /* 45: |10  X: 61 */ 16,
-    /* 46: |100  X: 54 */ 8,
-    /* 47: |1000  X: 51 */ 4,
-    /* 48: |10000  X: 50 */ 2,
-    /* 49: |100000  V: 61 */ 61,
-    /* 50: |100001  V: 65 */ 65,
-    /* 51: |10001  X: 53 */ 2,
-    /* 52: |100010  V: 95 */ 95,
-    /* 53: |100011  V: 98 */ 98,
-    /* 54: |1001  X: 58 */ 4,
-    /* 55: |10010  X: 57 */ 2,
-    /* 56: |100100  V: 100 */ 100,
-    /* 57: |100101  V: 102 */ 102,
-    /* 58: |10011  X: 60 */ 2,
-    /* 59: |100110  V: 103 */ 103,
-    /* 60: |100111  V: 104 */ 104,
-    /* 61: |101  X: 69 */ 8,
-    /* 62: |1010  X: 66 */ 4,
-    /* 63: |10100  X: 65 */ 2,
-    /* 64: |101000  V: 108 */ 108,
-    /* 65: |101001  V: 109 */ 109,
-    /* 66: |10101  X: 68 */ 2,
-    /* 67: |101010  V: 110 */ 110,
-    /* 68: |101011  V: 112 */ 112,
-    /* 69: |1011  X: 73 */ 4,
-    /* 70: |10110  X: 72 */ 2,
-    /* 71: |101100  V: 114 */ 114,
-    /* 72: |101101  V: 117 */ 117,
-    /* 73: |10111  X: 77 */ 4,
-    /* 74: |101110  X: 76 */ 2,
-    /* 75: |1011100  V: 58 */ 58,
-    /* 76: |1011101  V: 66 */ 66,
-    /* 77: |101111  X: 79 */ 2,
-    /* 78: |1011110  V: 67 */ 67,
-    /* 79: |1011111  V: 68 */ 68,
-    /* 80: |11  X: 112 */ 32,
-    /* 81: |110  X: 97 */ 16,
-    /* 82: |1100  X: 90 */ 8,
-    /* 83: |11000  X: 87 */ 4,
-    /* 84: |110000  X: 86 */ 2,
-    /* 85: |1100000  V: 69 */ 69,
-    /* 86: |1100001  V: 70 */ 70,
-    /* 87: |110001  X: 89 */ 2,
-    /* 88: |1100010  V: 71 */ 71,
-    /* 89: |1100011  V: 72 */ 72,
-    /* 90: |11001  X: 94 */ 4,
-    /* 91: |110010  X: 93 */ 2,
-    /* 92: |1100100  V: 73 */ 73,
-    /* 93: |1100101  V: 74 */ 74,
-    /* 94: |110011  X: 96 */ 2,
-    /* 95: |1100110  V: 75 */ 75,
-    /* 96: |1100111  V: 76 */ 76,
-    /* 97: |1101  X: 105 */ 8,
-    /* 98: |11010  X: 102 */ 4,
-    /* 99: |110100  X: 101 */ 2,
-    /* 100: |1101000  V: 77 */ 77,
-    /* 101: |1101001  V: 78 */ 78,
-    /* 102: |110101  X: 104 */ 2,
-    /* 103: |1101010  V: 79 */ 79,
-    /* 104: |1101011  V: 80 */ 80,
-    /* 105: |11011  X: 109 */ 4,
-    /* 106: |110110  X: 108 */ 2,
-    /* 107: |1101100  V: 81 */ 81,
-    /* 108: |1101101  V: 82 */ 82,
-    /* 109: |110111  X: 111 */ 2,
-    /* 110: |1101110  V: 83 */ 83,
-    /* 111: |1101111  V: 84 */ 84,
-    /* 112: |111  X: 128 */ 16,
-    /* 113: |1110  X: 121 */ 8,
-    /* 114: |11100  X: 118 */ 4,
-    /* 115: |111000  X: 117 */ 2,
-    /* 116: |1110000  V: 85 */ 85,
-    /* 117: |1110001  V: 86 */ 86,
-    /* 118: |111001  X: 120 */ 2,
-    /* 119: |1110010  V: 87 */ 87,
-    /* 120: |1110011  V: 89 */ 89,
-    /* 121: |11101  X: 125 */ 4,
-    /* 122: |111010  X: 124 */ 2,
-    /* 123: |1110100  V: 106 */ 106,
-    /* 124: |1110101  V: 107 */ 107,
-    /* 125: |111011  X: 127 */ 2,
-    /* 126: |1110110  V: 113 */ 113,
-    /* 127: |1110111  V: 118 */ 118,
-    /* 128: |1111  X: 136 */ 8,
-    /* 129: |11110  X: 133 */ 4,
-    /* 130: |111100  X: 132 */ 2,
-    /* 131: |1111000  V: 119 */ 119,
-    /* 132: |1111001  V: 120 */ 120,
-    /* 133: |111101  X: 135 */ 2,
-    /* 134: |1111010  V: 121 */ 121,
-    /* 135: |1111011  V: 122 */ 122,
-    /* 136: |11111  X: 144 */ 8,
-    /* 137: |111110  X: 141 */ 4,
-    /* 138: |1111100  X: 140 */ 2,
-    /* 139: |11111000  V: 38 */ 38,
-    /* 140: |11111001  V: 42 */ 42,
-    /* 141: |1111101  X: 143 */ 2,
-    /* 142: |11111010  V: 44 */ 44,
-    /* 143: |11111011  V: 59 */ 59,
-    /* 144: |111111  X: 148 */ 4,
-    /* 145: |1111110  X: 147 */ 2,
-    /* 146: |11111100  V: 88 */ 88,
-    /* 147: |11111101  V: 90 */ 90,
-    /* 148: |1111111  X: 156 */ 8,
-    /* 149: |11111110  X: 153 */ 4,
-    /* 150: |11111110|0  X: 152 */ 2,
-    /* 151: |11111110|00  V: 33 */ 33,
-    /* 152: |11111110|01  V: 34 */ 34,
-    /* 153: |11111110|1  X: 155 */ 2,
-    /* 154: |11111110|10  V: 40 */ 40,
-    /* 155: |11111110|11  V: 41 */ 41,
-    /* 156: |11111111|  X: 162 */ 6,
-    /* 157: |11111111|0  X: 159 */ 2,
-    /* 158: |11111111|00  V: 63 */ 63,
-    /* 159: |11111111|01  X: 161 */ 2,
-    /* 160: |11111111|010  V: 39 */ 39,
-    /* 161: |11111111|011  V: 43 */ 43,
-    /* 162: |11111111|1  X: 168 */ 6,
-    /* 163: |11111111|10  X: 165 */ 2,
-    /* 164: |11111111|100  V: 124 */ 124,
-    /* 165: |11111111|101  X: 167 */ 2,
-    /* 166: |11111111|1010  V: 35 */ 35,
-    /* 167: |11111111|1011  V: 62 */ 62,
-    /* 168: |11111111|11  X: 176 */ 8,
-    /* 169: |11111111|110  X: 173 */ 4,
-    /* 170: |11111111|1100  X: 172 */ 2,
-    /* 171: |11111111|11000  V: 0 */ 0,
-    /* 172: |11111111|11001  V: 36 */ 36,
-    /* 173: |11111111|1101  X: 175 */ 2,
-    /* 174: |11111111|11010  V: 64 */ 64,
-    /* 175: |11111111|11011  V: 91 */ 91,
-    /* 176: |11111111|111  X: 180 */ 4,
-    /* 177: |11111111|1110  X: 179 */ 2,
-    /* 178: |11111111|11100  V: 93 */ 93,
-    /* 179: |11111111|11101  V: 126 */ 126,
-    /* 180: |11111111|1111  X: 184 */ 4,
-    /* 181: |11111111|11110  X: 183 */ 2,
-    /* 182: |11111111|111100  V: 94 */ 94,
-    /* 183: |11111111|111101  V: 125 */ 125,
-    /* 184: |11111111|11111  X: 188 */ 4,
-    /* 185: |11111111|111110  X: 187 */ 2,
-    /* 186: |11111111|1111100  V: 60 */ 60,
-    /* 187: |11111111|1111101  V: 96 */ 96,
-    /* 188: |11111111|111111  X: 190 */ 2,
-    /* 189: |11111111|1111110  V: 123 */ 123,
-    /* 190: |11111111|1111111  X: 220 */ 30,
-    /* 191: |11111111|11111110|  X: 201 */ 10,
-    /* 192: |11111111|11111110|0  X: 196 */ 4,
-    /* 193: |11111111|11111110|00  X: 195 */ 2,
-    /* 194: |11111111|11111110|000  V: 92 */ 92,
-    /* 195: |11111111|11111110|001  V: 195 */ 195,
-    /* 196: |11111111|11111110|01  X: 198 */ 2,
-    /* 197: |11111111|11111110|010  V: 208 */ 208,
-    /* 198: |11111111|11111110|011  X: 200 */ 2,
-    /* 199: |11111111|11111110|0110  V: 128 */ 128,
-    /* 200: |11111111|11111110|0111  V: 130 */ 130,
-    /* 201: |11111111|11111110|1  X: 209 */ 8,
-    /* 202: |11111111|11111110|10  X: 206 */ 4,
-    /* 203: |11111111|11111110|100  X: 205 */ 2,
-    /* 204: |11111111|11111110|1000  V: 131 */ 131,
-    /* 205: |11111111|11111110|1001  V: 162 */ 162,
-    /* 206: |11111111|11111110|101  X: 208 */ 2,
-    /* 207: |11111111|11111110|1010  V: 184 */ 184,
-    /* 208: |11111111|11111110|1011  V: 194 */ 194,
-    /* 209: |11111111|11111110|11  X: 213 */ 4,
-    /* 210: |11111111|11111110|110  X: 212 */ 2,
-    /* 211: |11111111|11111110|1100  V: 224 */ 224,
-    /* 212: |11111111|11111110|1101  V: 226 */ 226,
-    /* 213: |11111111|11111110|111  X: 217 */ 4,
-    /* 214: |11111111|11111110|1110  X: 216 */ 2,
-    /* 215: |11111111|11111110|11100  V: 153 */ 153,
-    /* 216: |11111111|11111110|11101  V: 161 */ 161,
-    /* 217: |11111111|11111110|1111  X: 219 */ 2,
-    /* 218: |11111111|11111110|11110  V: 167 */ 167,
-    /* 219: |11111111|11111110|11111  V: 172 */ 172,
-    /* 220: |11111111|11111111|  X: 266 */ 46,
-    /* 221: |11111111|11111111|0  X: 237 */ 16,
-    /* 222: |11111111|11111111|00  X: 230 */ 8,
-    /* 223: |11111111|11111111|000  X: 227 */ 4,
-    /* 224: |11111111|11111111|0000  X: 226 */ 2,
-    /* 225: |11111111|11111111|00000  V: 176 */ 176,
-    /* 226: |11111111|11111111|00001  V: 177 */ 177,
-    /* 227: |11111111|11111111|0001  X: 229 */ 2,
-    /* 228: |11111111|11111111|00010  V: 179 */ 179,
-    /* 229: |11111111|11111111|00011  V: 209 */ 209,
-    /* 230: |11111111|11111111|001  X: 234 */ 4,
-    /* 231: |11111111|11111111|0010  X: 233 */ 2,
-    /* 232: |11111111|11111111|00100  V: 216 */ 216,
-    /* 233: |11111111|11111111|00101  V: 217 */ 217,
-    /* 234: |11111111|11111111|0011  X: 236 */ 2,
-    /* 235: |11111111|11111111|00110  V: 227 */ 227,
-    /* 236: |11111111|11111111|00111  V: 229 */ 229,
-    /* 237: |11111111|11111111|01  X: 251 */ 14,
-    /* 238: |11111111|11111111|010  X: 244 */ 6,
-    /* 239: |11111111|11111111|0100  X: 241 */ 2,
-    /* 240: |11111111|11111111|01000  V: 230 */ 230,
-    /* 241: |11111111|11111111|01001  X: 243 */ 2,
-    /* 242: |11111111|11111111|010010  V: 129 */ 129,
-    /* 243: |11111111|11111111|010011  V: 132 */ 132,
-    /* 244: |11111111|11111111|0101  X: 248 */ 4,
-    /* 245: |11111111|11111111|01010  X: 247 */ 2,
-    /* 246: |11111111|11111111|010100  V: 133 */ 133,
-    /* 247: |11111111|11111111|010101  V: 134 */ 134,
-    /* 248: |11111111|11111111|01011  X: 250 */ 2,
-    /* 249: |11111111|11111111|010110  V: 136 */ 136,
-    /* 250: |11111111|11111111|010111  V: 146 */ 146,
-    /* 251: |11111111|11111111|011  X: 259 */ 8,
-    /* 252: |11111111|11111111|0110  X: 256 */ 4,
-    /* 253: |11111111|11111111|01100  X: 255 */ 2,
-    /* 254: |11111111|11111111|011000  V: 154 */ 154,
-    /* 255: |11111111|11111111|011001  V: 156 */ 156,
-    /* 256: |11111111|11111111|01101  X: 257 */ 2,
-    /* 257: |11111111|11111111|011010  V: 160 */ 160,
-    /* 258: |11111111|11111111|011011  V: 163 */ 163,
-    /* 259: |11111111|11111111|0111  X: 263 */ 4,
-    /* 260: |11111111|11111111|01110  X: 262 */ 2,
-    /* 261: |11111111|11111111|011100  V: 164 */ 164,
-    /* 262: |11111111|11111111|011101  V: 169 */ 169,
-    /* 263: |11111111|11111111|01111  X: 265 */ 2,
-    /* 264: |11111111|11111111|011110  V: 170 */ 170,
-    /* 265: |11111111|11111111|011111  V: 173 */ 173,
-    /* 266: |11111111|11111111|1  X: 306 */ 40,
-    /* 267: |11111111|11111111|10  X: 283 */ 16,
-    /* 268: |11111111|11111111|100  X: 276 */ 8,
-    /* 269: |11111111|11111111|1000  X: 273 */ 4,
-    /* 270: |11111111|11111111|10000  X: 272 */ 2,
-    /* 271: |11111111|11111111|100000  V: 178 */ 178,
-    /* 272: |11111111|11111111|100001  V: 181 */ 181,
-    /* 273: |11111111|11111111|10001  X: 275 */ 2,
-    /* 274: |11111111|11111111|100010  V: 185 */ 185,
-    /* 275: |11111111|11111111|100011  V: 186 */ 186,
-    /* 276: |11111111|11111111|1001  X: 280 */ 4,
-    /* 277: |11111111|11111111|10010  X: 279 */ 2,
-    /* 278: |11111111|11111111|100100  V: 187 */ 187,
-    /* 279: |11111111|11111111|100101  V: 189 */ 189,
-    /* 280: |11111111|11111111|10011  X: 282 */ 2,
-    /* 281: |11111111|11111111|100110  V: 190 */ 190,
-    /* 282: |11111111|11111111|100111  V: 196 */ 196,
-    /* 283: |11111111|11111111|101  X: 291 */ 8,
-    /* 284: |11111111|11111111|1010  X: 288 */ 4,
-    /* 285: |11111111|11111111|10100  X: 287 */ 2,
-    /* 286: |11111111|11111111|101000  V: 198 */ 198,
-    /* 287: |11111111|11111111|101001  V: 228 */ 228,
-    /* 288: |11111111|11111111|10101  X: 290 */ 2,
-    /* 289: |11111111|11111111|101010  V: 232 */ 232,
-    /* 290: |11111111|11111111|101011  V: 233 */ 233,
-    /* 291: |11111111|11111111|1011  X: 299 */ 8,
-    /* 292: |11111111|11111111|10110  X: 296 */ 4,
-    /* 293: |11111111|11111111|101100  X: 295 */ 2,
-    /* 294: |11111111|11111111|1011000  V: 1 */ 1,
-    /* 295: |11111111|11111111|1011001  V: 135 */ 135,
-    /* 296: |11111111|11111111|101101  X: 298 */ 2,
-    /* 297: |11111111|11111111|1011010  V: 137 */ 137,
-    /* 298: |11111111|11111111|1011011  V: 138 */ 138,
-    /* 299: |11111111|11111111|10111  X: 303 */ 4,
-    /* 300: |11111111|11111111|101110  X: 302 */ 2,
-    /* 301: |11111111|11111111|1011100  V: 139 */ 139,
-    /* 302: |11111111|11111111|1011101  V: 140 */ 140,
-    /* 303: |11111111|11111111|101111  X: 305 */ 2,
-    /* 304: |11111111|11111111|1011110  V: 141 */ 141,
-    /* 305: |11111111|11111111|1011111  V: 143 */ 143,
-    /* 306: |11111111|11111111|11  X: 338 */ 32,
-    /* 307: |11111111|11111111|110  X: 323 */ 16,
-    /* 308: |11111111|11111111|1100  X: 316 */ 8,
-    /* 309: |11111111|11111111|11000  X: 313 */ 4,
-    /* 310: |11111111|11111111|110000  X: 312 */ 2,
-    /* 311: |11111111|11111111|1100000  V: 147 */ 147,
-    /* 312: |11111111|11111111|1100001  V: 149 */ 149,
-    /* 313: |11111111|11111111|110001  X: 315 */ 2,
-    /* 314: |11111111|11111111|1100010  V: 150 */ 150,
-    /* 315: |11111111|11111111|1100011  V: 151 */ 151,
-    /* 316: |11111111|11111111|11001  X: 320 */ 4,
-    /* 317: |11111111|11111111|110010  X: 319 */ 2,
-    /* 318: |11111111|11111111|1100100  V: 152 */ 152,
-    /* 319: |11111111|11111111|1100101  V: 155 */ 155,
-    /* 320: |11111111|11111111|110011  X: 322 */ 2,
-    /* 321: |11111111|11111111|1100110  V: 157 */ 157,
-    /* 322: |11111111|11111111|1100111  V: 158 */ 158,
-    /* 323: |11111111|11111111|1101  X: 331 */ 8,
-    /* 324: |11111111|11111111|11010  X: 328 */ 4,
-    /* 325: |11111111|11111111|110100  X: 327 */ 2,
-    /* 326: |11111111|11111111|1101000  V: 165 */ 165,
-    /* 327: |11111111|11111111|1101001  V: 166 */ 166,
-    /* 328: |11111111|11111111|110101  X: 330 */ 2,
-    /* 329: |11111111|11111111|1101010  V: 168 */ 168,
-    /* 330: |11111111|11111111|1101011  V: 174 */ 174,
-    /* 331: |11111111|11111111|11011  X: 335 */ 4,
-    /* 332: |11111111|11111111|110110  X: 334 */ 2,
-    /* 333: |11111111|11111111|1101100  V: 175 */ 175,
-    /* 334: |11111111|11111111|1101101  V: 180 */ 180,
-    /* 335: |11111111|11111111|110111  X: 337 */ 2,
-    /* 336: |11111111|11111111|1101110  V: 182 */ 182,
-    /* 337: |11111111|11111111|1101111  V: 183 */ 183,
-    /* 338: |11111111|11111111|111  X: 360 */ 22,
-    /* 339: |11111111|11111111|1110  X: 347 */ 8,
-    /* 340: |11111111|11111111|11100  X: 344 */ 4,
-    /* 341: |11111111|11111111|111000  X: 343 */ 2,
-    /* 342: |11111111|11111111|1110000  V: 188 */ 188,
-    /* 343: |11111111|11111111|1110001  V: 191 */ 191,
-    /* 344: |11111111|11111111|111001  X: 346 */ 2,
-    /* 345: |11111111|11111111|1110010  V: 197 */ 197,
-    /* 346: |11111111|11111111|1110011  V: 231 */ 231,
-    /* 347: |11111111|11111111|11101  X: 353 */ 6,
-    /* 348: |11111111|11111111|111010  X: 350 */ 2,
-    /* 349: |11111111|11111111|1110100  V: 239 */ 239,
-    /* 350: |11111111|11111111|1110101  X: 352 */ 2,
-    /* 351: |11111111|11111111|11101010  V: 9 */ 9,
-    /* 352: |11111111|11111111|11101011  V: 142 */ 142,
-    /* 353: |11111111|11111111|111011  X: 357 */ 4,
-    /* 354: |11111111|11111111|1110110  X: 356 */ 2,
-    /* 355: |11111111|11111111|11101100  V: 144 */ 144,
-    /* 356: |11111111|11111111|11101101  V: 145 */ 145,
-    /* 357: |11111111|11111111|1110111  X: 359 */ 2,
-    /* 358: |11111111|11111111|11101110  V: 148 */ 148,
-    /* 359: |11111111|11111111|11101111  V: 159 */ 159,
-    /* 360: |11111111|11111111|1111  X: 380 */ 20,
-    /* 361: |11111111|11111111|11110  X: 369 */ 8,
-    /* 362: |11111111|11111111|111100  X: 366 */ 4,
-    /* 363: |11111111|11111111|1111000  X: 365 */ 2,
-    /* 364: |11111111|11111111|11110000  V: 171 */ 171,
-    /* 365: |11111111|11111111|11110001  V: 206 */ 206,
-    /* 366: |11111111|11111111|1111001  X: 368 */ 2,
-    /* 367: |11111111|11111111|11110010  V: 215 */ 215,
-    /* 368: |11111111|11111111|11110011  V: 225 */ 225,
-    /* 369: |11111111|11111111|111101  X: 373 */ 4,
-    /* 370: |11111111|11111111|1111010  X: 372 */ 2,
-    /* 371: |11111111|11111111|11110100  V: 236 */ 236,
-    /* 372: |11111111|11111111|11110101  V: 237 */ 237,
-    /* 373: |11111111|11111111|1111011  X: 377 */ 4,
-    /* 374: |11111111|11111111|11110110|  X: 376 */ 2,
-    /* 375: |11111111|11111111|11110110|0  V: 199 */ 199,
-    /* 376: |11111111|11111111|11110110|1  V: 207 */ 207,
-    /* 377: |11111111|11111111|11110111|  X: 379 */ 2,
-    /* 378: |11111111|11111111|11110111|0  V: 234 */ 234,
-    /* 379: |11111111|11111111|11110111|1  V: 235 */ 235,
-    /* 380: |11111111|11111111|11111  X: 414 */ 34,
-    /* 381: |11111111|11111111|111110  X: 397 */ 16,
-    /* 382: |11111111|11111111|1111100  X: 390 */ 8,
-    /* 383: |11111111|11111111|11111000|  X: 387 */ 4,
-    /* 384: |11111111|11111111|11111000|0  X: 386 */ 2,
-    /* 385: |11111111|11111111|11111000|00  V: 192 */ 192,
-    /* 386: |11111111|11111111|11111000|01  V: 193 */ 193,
-    /* 387: |11111111|11111111|11111000|1  X: 389 */ 2,
-    /* 388: |11111111|11111111|11111000|10  V: 200 */ 200,
-    /* 389: |11111111|11111111|11111000|11  V: 201 */ 201,
-    /* 390: |11111111|11111111|11111001|  X: 394 */ 4,
-    /* 391: |11111111|11111111|11111001|0  X: 393 */ 2,
-    /* 392: |11111111|11111111|11111001|00  V: 202 */ 202,
-    /* 393: |11111111|11111111|11111001|01  V: 205 */ 205,
-    /* 394: |11111111|11111111|11111001|1  X: 396 */ 2,
-    /* 395: |11111111|11111111|11111001|10  V: 210 */ 210,
-    /* 396: |11111111|11111111|11111001|11  V: 213 */ 213,
-    /* 397: |11111111|11111111|1111101  X: 405 */ 8,
-    /* 398: |11111111|11111111|11111010|  X: 402 */ 4,
-    /* 399: |11111111|11111111|11111010|0  X: 401 */ 2,
-    /* 400: |11111111|11111111|11111010|00  V: 218 */ 218,
-    /* 401: |11111111|11111111|11111010|01  V: 219 */ 219,
-    /* 402: |11111111|11111111|11111010|1  X: 404 */ 2,
-    /* 403: |11111111|11111111|11111010|10  V: 238 */ 238,
-    /* 404: |11111111|11111111|11111010|11  V: 240 */ 240,
-    /* 405: |11111111|11111111|11111011|  X: 409 */ 4,
-    /* 406: |11111111|11111111|11111011|0  X: 408 */ 2,
-    /* 407: |11111111|11111111|11111011|00  V: 242 */ 242,
-    /* 408: |11111111|11111111|11111011|01  V: 243 */ 243,
-    /* 409: |11111111|11111111|11111011|1  X: 411 */ 2,
-    /* 410: |11111111|11111111|11111011|10  V: 255 */ 255,
-    /* 411: |11111111|11111111|11111011|11  X: 413 */ 2,
-    /* 412: |11111111|11111111|11111011|110  V: 203 */ 203,
-    /* 413: |11111111|11111111|11111011|111  V: 204 */ 204,
-    /* 414: |11111111|11111111|111111  X: 446 */ 32,
-    /* 415: |11111111|11111111|1111110  X: 431 */ 16,
-    /* 416: |11111111|11111111|11111100|  X: 424 */ 8,
-    /* 417: |11111111|11111111|11111100|0  X: 421 */ 4,
-    /* 418: |11111111|11111111|11111100|00  X: 420 */ 2,
-    /* 419: |11111111|11111111|11111100|000  V: 211 */ 211,
-    /* 420: |11111111|11111111|11111100|001  V: 212 */ 212,
-    /* 421: |11111111|11111111|11111100|01  X: 423 */ 2,
-    /* 422: |11111111|11111111|11111100|010  V: 214 */ 214,
-    /* 423: |11111111|11111111|11111100|011  V: 221 */ 221,
-    /* 424: |11111111|11111111|11111100|1  X: 428 */ 4,
-    /* 425: |11111111|11111111|11111100|10  X: 427 */ 2,
-    /* 426: |11111111|11111111|11111100|100  V: 222 */ 222,
-    /* 427: |11111111|11111111|11111100|101  V: 223 */ 223,
-    /* 428: |11111111|11111111|11111100|11  X: 430 */ 2,
-    /* 429: |11111111|11111111|11111100|110  V: 241 */ 241,
-    /* 430: |11111111|11111111|11111100|111  V: 244 */ 244,
-    /* 431: |11111111|11111111|11111101|  X: 439 */ 8,
-    /* 432: |11111111|11111111|11111101|0  X: 436 */ 4,
-    /* 433: |11111111|11111111|11111101|00  X: 435 */ 2,
-    /* 434: |11111111|11111111|11111101|000  V: 245 */ 245,
-    /* 435: |11111111|11111111|11111101|001  V: 246 */ 246,
-    /* 436: |11111111|11111111|11111101|01  X: 438 */ 2,
-    /* 437: |11111111|11111111|11111101|010  V: 247 */ 247,
-    /* 438: |11111111|11111111|11111101|011  V: 248 */ 248,
-    /* 439: |11111111|11111111|11111101|1  X: 443 */ 4,
-    /* 440: |11111111|11111111|11111101|10  X: 442 */ 2,
-    /* 441: |11111111|11111111|11111101|100  V: 250 */ 250,
-    /* 442: |11111111|11111111|11111101|101  V: 251 */ 251,
-    /* 443: |11111111|11111111|11111101|11  X: 445 */ 2,
-    /* 444: |11111111|11111111|11111101|110  V: 252 */ 252,
-    /* 445: |11111111|11111111|11111101|111  V: 253 */ 253,
-    /* 446: |11111111|11111111|1111111  X: 476 */ 30,
-    /* 447: |11111111|11111111|11111110|  X: 461 */ 14,
-    /* 448: |11111111|11111111|11111110|0  X: 454 */ 6,
-    /* 449: |11111111|11111111|11111110|00  X: 451 */ 2,
-    /* 450: |11111111|11111111|11111110|000  V: 254 */ 254,
-    /* 451: |11111111|11111111|11111110|001  X: 453 */ 2,
-    /* 452: |11111111|11111111|11111110|0010  V: 2 */ 2,
-    /* 453: |11111111|11111111|11111110|0011  V: 3 */ 3,
-    /* 454: |11111111|11111111|11111110|01  X: 458 */ 4,
-    /* 455: |11111111|11111111|11111110|010  X: 457 */ 2,
-    /* 456: |11111111|11111111|11111110|0100  V: 4 */ 4,
-    /* 457: |11111111|11111111|11111110|0101  V: 5 */ 5,
-    /* 458: |11111111|11111111|11111110|011  X: 460 */ 2,
-    /* 459: |11111111|11111111|11111110|0110  V: 6 */ 6,
-    /* 460: |11111111|11111111|11111110|0111  V: 7 */ 7,
-    /* 461: |11111111|11111111|11111110|1  X: 469 */ 8,
-    /* 462: |11111111|11111111|11111110|10  X: 466 */ 4,
-    /* 463: |11111111|11111111|11111110|100  X: 465 */ 2,
-    /* 464: |11111111|11111111|11111110|1000  V: 8 */ 8,
-    /* 465: |11111111|11111111|11111110|1001  V: 11 */ 11,
-    /* 466: |11111111|11111111|11111110|101  X: 468 */ 2,
-    /* 467: |11111111|11111111|11111110|1010  V: 12 */ 12,
-    /* 468: |11111111|11111111|11111110|1011  V: 14 */ 14,
-    /* 469: |11111111|11111111|11111110|11  X: 473 */ 4,
-    /* 470: |11111111|11111111|11111110|110  X: 472 */ 2,
-    /* 471: |11111111|11111111|11111110|1100  V: 15 */ 15,
-    /* 472: |11111111|11111111|11111110|1101  V: 16 */ 16,
-    /* 473: |11111111|11111111|11111110|111  X: 475 */ 2,
-    /* 474: |11111111|11111111|11111110|1110  V: 17 */ 17,
-    /* 475: |11111111|11111111|11111110|1111  V: 18 */ 18,
-    /* 476: |11111111|11111111|11111111|  X: 492 */ 16,
-    /* 477: |11111111|11111111|11111111|0  X: 485 */ 8,
-    /* 478: |11111111|11111111|11111111|00  X: 482 */ 4,
-    /* 479: |11111111|11111111|11111111|000  X: 481 */ 2,
-    /* 480: |11111111|11111111|11111111|0000  V: 19 */ 19,
-    /* 481: |11111111|11111111|11111111|0001  V: 20 */ 20,
-    /* 482: |11111111|11111111|11111111|001  X: 484 */ 2,
-    /* 483: |11111111|11111111|11111111|0010  V: 21 */ 21,
-    /* 484: |11111111|11111111|11111111|0011  V: 23 */ 23,
-    /* 485: |11111111|11111111|11111111|01  X: 489 */ 4,
-    /* 486: |11111111|11111111|11111111|010  X: 488 */ 2,
-    /* 487: |11111111|11111111|11111111|0100  V: 24 */ 24,
-    /* 488: |11111111|11111111|11111111|0101  V: 25 */ 25,
-    /* 489: |11111111|11111111|11111111|011  X: 491 */ 2,
-    /* 490: |11111111|11111111|11111111|0110  V: 26 */ 26,
-    /* 491: |11111111|11111111|11111111|0111  V: 27 */ 27,
-    /* 492: |11111111|11111111|11111111|1  X: 500 */ 8,
-    /* 493: |11111111|11111111|11111111|10  X: 497 */ 4,
-    /* 494: |11111111|11111111|11111111|100  X: 496 */ 2,
-    /* 495: |11111111|11111111|11111111|1000  V: 28 */ 28,
-    /* 496: |11111111|11111111|11111111|1001  V: 29 */ 29,
-    /* 497: |11111111|11111111|11111111|101  X: 499 */ 2,
-    /* 498: |11111111|11111111|11111111|1010  V: 30 */ 30,
-    /* 499: |11111111|11111111|11111111|1011  V: 31 */ 31,
-    /* 500: |11111111|11111111|11111111|11  X: 504 */ 4,
-    /* 501: |11111111|11111111|11111111|110  X: 503 */ 2,
-    /* 502: |11111111|11111111|11111111|1100  V: 127 */ 127,
-    /* 503: |11111111|11111111|11111111|1101  V: 220 */ 220,
-    /* 504: |11111111|11111111|11111111|111  X: 506 */ 2,
-    /* 505: |11111111|11111111|11111111|1110  V: 249 */ 249,
-    /* 506: |11111111|11111111|11111111|1111  X: 510 */ 4,
-    /* 507: |11111111|11111111|11111111|11110  X: 509 */ 2,
-    /* 508: |11111111|11111111|11111111|111100  V: 10 */ 10,
-    /* 509: |11111111|11111111|11111111|111101  V: 13 */ 13,
-    /* 510: |11111111|11111111|11111111|11111  X: 512 */ 2,
-    /* 511: |11111111|11111111|11111111|111110  V: 22 */ 22
+#define H3ZERO_QPACK_HUFFMAN_ACCEPTED 1
+#define H3ZERO_QPACK_HUFFMAN_SYMBOL 2
+#define H3ZERO_QPACK_HUFFMAN_FAIL 4
+
+typedef struct st_h3zero_qpack_huffman_step_t {
+    uint8_t state;
+    uint8_t flags;
+    uint8_t symbol;
+} h3zero_qpack_huffman_step_t;
+
+static const h3zero_qpack_huffman_step_t h3zero_qpack_huffman_step[256][16] = {
+    /* state 0 */
+    {
+        { 4, 0, 0 }, { 5, 0, 0 }, { 7, 0, 0 }, { 8, 0, 0 }, { 11, 0, 0 }, { 12, 0, 0 }, { 16, 0, 0 }, { 19, 0, 0 },
+        { 25, 0, 0 }, { 28, 0, 0 }, { 32, 0, 0 }, { 35, 0, 0 }, { 42, 0, 0 }, { 49, 0, 0 }, { 57, 0, 0 }, { 64, 1, 0 }
+    },
+    /* state 1 */
+    {
+        { 0, 3, 48 }, { 0, 3, 49 }, { 0, 3, 50 }, { 0, 3, 97 }, { 0, 3, 99 }, { 0, 3, 101 }, { 0, 3, 105 }, { 0, 3, 111 },
+        { 0, 3, 115 }, { 0, 3, 116 }, { 13, 0, 0 }, { 14, 0, 0 }, { 17, 0, 0 }, { 18, 0, 0 }, { 20, 0, 0 }, { 21, 0, 0 }
+    },
+    /* state 2 */
+    {
+        { 1, 2, 48 }, { 22, 3, 48 }, { 1, 2, 49 }, { 22, 3, 49 }, { 1, 2, 50 }, { 22, 3, 50 }, { 1, 2, 97 }, { 22, 3, 97 },
+        { 1, 2, 99 }, { 22, 3, 99 }, { 1, 2, 101 }, { 22, 3, 101 }, { 1, 2, 105 }, { 22, 3, 105 }, { 1, 2, 111 }, { 22, 3, 111 }
+    },
+    /* state 3 */
+    {
+        { 2, 2, 48 }, { 9, 2, 48 }, { 23, 2, 48 }, { 40, 3, 48 }, { 2, 2, 49 }, { 9, 2, 49 }, { 23, 2, 49 }, { 40, 3, 49 },
+        { 2, 2, 50 }, { 9, 2, 50 }, { 23, 2, 50 }, { 40, 3, 50 }, { 2, 2, 97 }, { 9, 2, 97 }, { 23, 2, 97 }, { 40, 3, 97 }
+    },
+    /* state 4 */
+    {
+        { 3, 2, 48 }, { 6, 2, 48 }, { 10, 2, 48 }, { 15, 2, 48 }, { 24, 2, 48 }, { 31, 2, 48 }, { 41, 2, 48 }, { 56, 3, 48 },
+        { 3, 2, 49 }, { 6, 2, 49 }, { 10, 2, 49 }, { 15, 2, 49 }, { 24, 2, 49 }, { 31, 2, 49 }, { 41, 2, 49 }, { 56, 3, 49 }
+    },
+    /* state 5 */
+    {
+        { 3, 2, 50 }, { 6, 2, 50 }, { 10, 2, 50 }, { 15, 2, 50 }, { 24, 2, 50 }, { 31, 2, 50 }, { 41, 2, 50 }, { 56, 3, 50 },
+        { 3, 2, 97 }, { 6, 2, 97 }, { 10, 2, 97 }, { 15, 2, 97 }, { 24, 2, 97 }, { 31, 2, 97 }, { 41, 2, 97 }, { 56, 3, 97 }
+    },
+    /* state 6 */
+    {
+        { 2, 2, 99 }, { 9, 2, 99 }, { 23, 2, 99 }, { 40, 3, 99 }, { 2, 2, 101 }, { 9, 2, 101 }, { 23, 2, 101 }, { 40, 3, 101 },
+        { 2, 2, 105 }, { 9, 2, 105 }, { 23, 2, 105 }, { 40, 3, 105 }, { 2, 2, 111 }, { 9, 2, 111 }, { 23, 2, 111 }, { 40, 3, 111 }
+    },
+    /* state 7 */
+    {
+        { 3, 2, 99 }, { 6, 2, 99 }, { 10, 2, 99 }, { 15, 2, 99 }, { 24, 2, 99 }, { 31, 2, 99 }, { 41, 2, 99 }, { 56, 3, 99 },
+        { 3, 2, 101 }, { 6, 2, 101 }, { 10, 2, 101 }, { 15, 2, 101 }, { 24, 2, 101 }, { 31, 2, 101 }, { 41, 2, 101 }, { 56, 3, 101 }
+    },
+    /* state 8 */
+    {
+        { 3, 2, 105 }, { 6, 2, 105 }, { 10, 2, 105 }, { 15, 2, 105 }, { 24, 2, 105 }, { 31, 2, 105 }, { 41, 2, 105 }, { 56, 3, 105 },
+        { 3, 2, 111 }, { 6, 2, 111 }, { 10, 2, 111 }, { 15, 2, 111 }, { 24, 2, 111 }, { 31, 2, 111 }, { 41, 2, 111 }, { 56, 3, 111 }
+    },
+    /* state 9 */
+    {
+        { 1, 2, 115 }, { 22, 3, 115 }, { 1, 2, 116 }, { 22, 3, 116 }, { 0, 3, 32 }, { 0, 3, 37 }, { 0, 3, 45 }, { 0, 3, 46 },
+        { 0, 3, 47 }, { 0, 3, 51 }, { 0, 3, 52 }, { 0, 3, 53 }, { 0, 3, 54 }, { 0, 3, 55 }, { 0, 3, 56 }, { 0, 3, 57 }
+    },
+    /* state 10 */
+    {
+        { 2, 2, 115 }, { 9, 2, 115 }, { 23, 2, 115 }, { 40, 3, 115 }, { 2, 2, 116 }, { 9, 2, 116 }, { 23, 2, 116 }, { 40, 3, 116 },
+        { 1, 2, 32 }, { 22, 3, 32 }, { 1, 2, 37 }, { 22, 3, 37 }, { 1, 2, 45 }, { 22, 3, 45 }, { 1, 2, 46 }, { 22, 3, 46 }
+    },
+    /* state 11 */
+    {
+        { 3, 2, 115 }, { 6, 2, 115 }, { 10, 2, 115 }, { 15, 2, 115 }, { 24, 2, 115 }, { 31, 2, 115 }, { 41, 2, 115 }, { 56, 3, 115 },
+        { 3, 2, 116 }, { 6, 2, 116 }, { 10, 2, 116 }, { 15, 2, 116 }, { 24, 2, 116 }, { 31, 2, 116 }, { 41, 2, 116 }, { 56, 3, 116 }
+    },
+    /* state 12 */
+    {
+        { 2, 2, 32 }, { 9, 2, 32 }, { 23, 2, 32 }, { 40, 3, 32 }, { 2, 2, 37 }, { 9, 2, 37 }, { 23, 2, 37 }, { 40, 3, 37 },
+        { 2, 2, 45 }, { 9, 2, 45 }, { 23, 2, 45 }, { 40, 3, 45 }, { 2, 2, 46 }, { 9, 2, 46 }, { 23, 2, 46 }, { 40, 3, 46 }
+    },
+    /* state 13 */
+    {
+        { 3, 2, 32 }, { 6, 2, 32 }, { 10, 2, 32 }, { 15, 2, 32 }, { 24, 2, 32 }, { 31, 2, 32 }, { 41, 2, 32 }, { 56, 3, 32 },
+        { 3, 2, 37 }, { 6, 2, 37 }, { 10, 2, 37 }, { 15, 2, 37 }, { 24, 2, 37 }, { 31, 2, 37 }, { 41, 2, 37 }, { 56, 3, 37 }
+    },
+    /* state 14 */
+    {
+        { 3, 2, 45 }, { 6, 2, 45 }, { 10, 2, 45 }, { 15, 2, 45 }, { 24, 2, 45 }, { 31, 2, 45 }, { 41, 2, 45 }, { 56, 3, 45 },
+        { 3, 2, 46 }, { 6, 2, 46 }, { 10, 2, 46 }, { 15, 2, 46 }, { 24, 2, 46 }, { 31, 2, 46 }, { 41, 2, 46 }, { 56, 3, 46 }
+    },
+    /* state 15 */
+    {
+        { 1, 2, 47 }, { 22, 3, 47 }, { 1, 2, 51 }, { 22, 3, 51 }, { 1, 2, 52 }, { 22, 3, 52 }, { 1, 2, 53 }, { 22, 3, 53 },
+        { 1, 2, 54 }, { 22, 3, 54 }, { 1, 2, 55 }, { 22, 3, 55 }, { 1, 2, 56 }, { 22, 3, 56 }, { 1, 2, 57 }, { 22, 3, 57 }
+    },
+    /* state 16 */
+    {
+        { 2, 2, 47 }, { 9, 2, 47 }, { 23, 2, 47 }, { 40, 3, 47 }, { 2, 2, 51 }, { 9, 2, 51 }, { 23, 2, 51 }, { 40, 3, 51 },
+        { 2, 2, 52 }, { 9, 2, 52 }, { 23, 2, 52 }, { 40, 3, 52 }, { 2, 2, 53 }, { 9, 2, 53 }, { 23, 2, 53 }, { 40, 3, 53 }
+    },
+    /* state 17 */
+    {
+        { 3, 2, 47 }, { 6, 2, 47 }, { 10, 2, 47 }, { 15, 2, 47 }, { 24, 2, 47 }, { 31, 2, 47 }, { 41, 2, 47 }, { 56, 3, 47 },
+        { 3, 2, 51 }, { 6, 2, 51 }, { 10, 2, 51 }, { 15, 2, 51 }, { 24, 2, 51 }, { 31, 2, 51 }, { 41, 2, 51 }, { 56, 3, 51 }
+    },
+    /* state 18 */
+    {
+        { 3, 2, 52 }, { 6, 2, 52 }, { 10, 2, 52 }, { 15, 2, 52 }, { 24, 2, 52 }, { 31, 2, 52 }, { 41, 2, 52 }, { 56, 3, 52 },
+        { 3, 2, 53 }, { 6, 2, 53 }, { 10, 2, 53 }, { 15, 2, 53 }, { 24, 2, 53 }, { 31, 2, 53 }, { 41, 2, 53 }, { 56, 3, 53 }
+    },
+    /* state 19 */
+    {
+        { 2, 2, 54 }, { 9, 2, 54 }, { 23, 2, 54 }, { 40, 3, 54 }, { 2, 2, 55 }, { 9, 2, 55 }, { 23, 2, 55 }, { 40, 3, 55 },
+        { 2, 2, 56 }, { 9, 2, 56 }, { 23, 2, 56 }, { 40, 3, 56 }, { 2, 2, 57 }, { 9, 2, 57 }, { 23, 2, 57 }, { 40, 3, 57 }
+    },
+    /* state 20 */
+    {
+        { 3, 2, 54 }, { 6, 2, 54 }, { 10, 2, 54 }, { 15, 2, 54 }, { 24, 2, 54 }, { 31, 2, 54 }, { 41, 2, 54 }, { 56, 3, 54 },
+        { 3, 2, 55 }, { 6, 2, 55 }, { 10, 2, 55 }, { 15, 2, 55 }, { 24, 2, 55 }, { 31, 2, 55 }, { 41, 2, 55 }, { 56, 3, 55 }
+    },
+    /* state 21 */
+    {
+        { 3, 2, 56 }, { 6, 2, 56 }, { 10, 2, 56 }, { 15, 2, 56 }, { 24, 2, 56 }, { 31, 2, 56 }, { 41, 2, 56 }, { 56, 3, 56 },
+        { 3, 2, 57 }, { 6, 2, 57 }, { 10, 2, 57 }, { 15, 2, 57 }, { 24, 2, 57 }, { 31, 2, 57 }, { 41, 2, 57 }, { 56, 3, 57 }
+    },
+    /* state 22 */
+    {
+        { 26, 0, 0 }, { 27, 0, 0 }, { 29, 0, 0 }, { 30, 0, 0 }, { 33, 0, 0 }, { 34, 0, 0 }, { 36, 0, 0 }, { 37, 0, 0 },
+        { 43, 0, 0 }, { 46, 0, 0 }, { 50, 0, 0 }, { 53, 0, 0 }, { 58, 0, 0 }, { 61, 0, 0 }, { 65, 0, 0 }, { 68, 1, 0 }
+    },
+    /* state 23 */
+    {
+        { 0, 3, 61 }, { 0, 3, 65 }, { 0, 3, 95 }, { 0, 3, 98 }, { 0, 3, 100 }, { 0, 3, 102 }, { 0, 3, 103 }, { 0, 3, 104 },
+        { 0, 3, 108 }, { 0, 3, 109 }, { 0, 3, 110 }, { 0, 3, 112 }, { 0, 3, 114 }, { 0, 3, 117 }, { 38, 0, 0 }, { 39, 0, 0 }
+    },
+    /* state 24 */
+    {
+        { 1, 2, 61 }, { 22, 3, 61 }, { 1, 2, 65 }, { 22, 3, 65 }, { 1, 2, 95 }, { 22, 3, 95 }, { 1, 2, 98 }, { 22, 3, 98 },
+        { 1, 2, 100 }, { 22, 3, 100 }, { 1, 2, 102 }, { 22, 3, 102 }, { 1, 2, 103 }, { 22, 3, 103 }, { 1, 2, 104 }, { 22, 3, 104 }
+    },
+    /* state 25 */
+    {
+        { 2, 2, 61 }, { 9, 2, 61 }, { 23, 2, 61 }, { 40, 3, 61 }, { 2, 2, 65 }, { 9, 2, 65 }, { 23, 2, 65 }, { 40, 3, 65 },
+        { 2, 2, 95 }, { 9, 2, 95 }, { 23, 2, 95 }, { 40, 3, 95 }, { 2, 2, 98 }, { 9, 2, 98 }, { 23, 2, 98 }, { 40, 3, 98 }
+    },
+    /* state 26 */
+    {
+        { 3, 2, 61 }, { 6, 2, 61 }, { 10, 2, 61 }, { 15, 2, 61 }, { 24, 2, 61 }, { 31, 2, 61 }, { 41, 2, 61 }, { 56, 3, 61 },
+        { 3, 2, 65 }, { 6, 2, 65 }, { 10, 2, 65 }, { 15, 2, 65 }, { 24, 2, 65 }, { 31, 2, 65 }, { 41, 2, 65 }, { 56, 3, 65 }
+    },
+    /* state 27 */
+    {
+        { 3, 2, 95 }, { 6, 2, 95 }, { 10, 2, 95 }, { 15, 2, 95 }, { 24, 2, 95 }, { 31, 2, 95 }, { 41, 2, 95 }, { 56, 3, 95 },
+        { 3, 2, 98 }, { 6, 2, 98 }, { 10, 2, 98 }, { 15, 2, 98 }, { 24, 2, 98 }, { 31, 2, 98 }, { 41, 2, 98 }, { 56, 3, 98 }
+    },
+    /* state 28 */
+    {
+        { 2, 2, 100 }, { 9, 2, 100 }, { 23, 2, 100 }, { 40, 3, 100 }, { 2, 2, 102 }, { 9, 2, 102 }, { 23, 2, 102 }, { 40, 3, 102 },
+        { 2, 2, 103 }, { 9, 2, 103 }, { 23, 2, 103 }, { 40, 3, 103 }, { 2, 2, 104 }, { 9, 2, 104 }, { 23, 2, 104 }, { 40, 3, 104 }
+    },
+    /* state 29 */
+    {
+        { 3, 2, 100 }, { 6, 2, 100 }, { 10, 2, 100 }, { 15, 2, 100 }, { 24, 2, 100 }, { 31, 2, 100 }, { 41, 2, 100 }, { 56, 3, 100 },
+        { 3, 2, 102 }, { 6, 2, 102 }, { 10, 2, 102 }, { 15, 2, 102 }, { 24, 2, 102 }, { 31, 2, 102 }, { 41, 2, 102 }, { 56, 3, 102 }
+    },
+    /* state 30 */
+    {
+        { 3, 2, 103 }, { 6, 2, 103 }, { 10, 2, 103 }, { 15, 2, 103 }, { 24, 2, 103 }, { 31, 2, 103 }, { 41, 2, 103 }, { 56, 3, 103 },
+        { 3, 2, 104 }, { 6, 2, 104 }, { 10, 2, 104 }, { 15, 2, 104 }, { 24, 2, 104 }, { 31, 2, 104 }, { 41, 2, 104 }, { 56, 3, 104 }
+    },
+    /* state 31 */
+    {
+        { 1, 2, 108 }, { 22, 3, 108 }, { 1, 2, 109 }, { 22, 3, 109 }, { 1, 2, 110 }, { 22, 3, 110 }, { 1, 2, 112 }, { 22, 3, 112 },
+        { 1, 2, 114 }, { 22, 3, 114 }, { 1, 2, 117 }, { 22, 3, 117 }, { 0, 3, 58 }, { 0, 3, 66 }, { 0, 3, 67 }, { 0, 3, 68 }
+    },
+    /* state 32 */
+    {
+        { 2, 2, 108 }, { 9, 2, 108 }, { 23, 2, 108 }, { 40, 3, 108 }, { 2, 2, 109 }, { 9, 2, 109 }, { 23, 2, 109 }, { 40, 3, 109 },
+        { 2, 2, 110 }, { 9, 2, 110 }, { 23, 2, 110 }, { 40, 3, 110 }, { 2, 2, 112 }, { 9, 2, 112 }, { 23, 2, 112 }, { 40, 3, 112 }
+    },
+    /* state 33 */
+    {
+        { 3, 2, 108 }, { 6, 2, 108 }, { 10, 2, 108 }, { 15, 2, 108 }, { 24, 2, 108 }, { 31, 2, 108 }, { 41, 2, 108 }, { 56, 3, 108 },
+        { 3, 2, 109 }, { 6, 2, 109 }, { 10, 2, 109 }, { 15, 2, 109 }, { 24, 2, 109 }, { 31, 2, 109 }, { 41, 2, 109 }, { 56, 3, 109 }
+    },
+    /* state 34 */
+    {
+        { 3, 2, 110 }, { 6, 2, 110 }, { 10, 2, 110 }, { 15, 2, 110 }, { 24, 2, 110 }, { 31, 2, 110 }, { 41, 2, 110 }, { 56, 3, 110 },
+        { 3, 2, 112 }, { 6, 2, 112 }, { 10, 2, 112 }, { 15, 2, 112 }, { 24, 2, 112 }, { 31, 2, 112 }, { 41, 2, 112 }, { 56, 3, 112 }
+    },
+    /* state 35 */
+    {
+        { 2, 2, 114 }, { 9, 2, 114 }, { 23, 2, 114 }, { 40, 3, 114 }, { 2, 2, 117 }, { 9, 2, 117 }, { 23, 2, 117 }, { 40, 3, 117 },
+        { 1, 2, 58 }, { 22, 3, 58 }, { 1, 2, 66 }, { 22, 3, 66 }, { 1, 2, 67 }, { 22, 3, 67 }, { 1, 2, 68 }, { 22, 3, 68 }
+    },
+    /* state 36 */
+    {
+        { 3, 2, 114 }, { 6, 2, 114 }, { 10, 2, 114 }, { 15, 2, 114 }, { 24, 2, 114 }, { 31, 2, 114 }, { 41, 2, 114 }, { 56, 3, 114 },
+        { 3, 2, 117 }, { 6, 2, 117 }, { 10, 2, 117 }, { 15, 2, 117 }, { 24, 2, 117 }, { 31, 2, 117 }, { 41, 2, 117 }, { 56, 3, 117 }
+    },
+    /* state 37 */
+    {
+        { 2, 2, 58 }, { 9, 2, 58 }, { 23, 2, 58 }, { 40, 3, 58 }, { 2, 2, 66 }, { 9, 2, 66 }, { 23, 2, 66 }, { 40, 3, 66 },
+        { 2, 2, 67 }, { 9, 2, 67 }, { 23, 2, 67 }, { 40, 3, 67 }, { 2, 2, 68 }, { 9, 2, 68 }, { 23, 2, 68 }, { 40, 3, 68 }
+    },
+    /* state 38 */
+    {
+        { 3, 2, 58 }, { 6, 2, 58 }, { 10, 2, 58 }, { 15, 2, 58 }, { 24, 2, 58 }, { 31, 2, 58 }, { 41, 2, 58 }, { 56, 3, 58 },
+        { 3, 2, 66 }, { 6, 2, 66 }, { 10, 2, 66 }, { 15, 2, 66 }, { 24, 2, 66 }, { 31, 2, 66 }, { 41, 2, 66 }, { 56, 3, 66 }
+    },
+    /* state 39 */
+    {
+        { 3, 2, 67 }, { 6, 2, 67 }, { 10, 2, 67 }, { 15, 2, 67 }, { 24, 2, 67 }, { 31, 2, 67 }, { 41, 2, 67 }, { 56, 3, 67 },
+        { 3, 2, 68 }, { 6, 2, 68 }, { 10, 2, 68 }, { 15, 2, 68 }, { 24, 2, 68 }, { 31, 2, 68 }, { 41, 2, 68 }, { 56, 3, 68 }
+    },
+    /* state 40 */
+    {
+        { 44, 0, 0 }, { 45, 0, 0 }, { 47, 0, 0 }, { 48, 0, 0 }, { 51, 0, 0 }, { 52, 0, 0 }, { 54, 0, 0 }, { 55, 0, 0 },
+        { 59, 0, 0 }, { 60, 0, 0 }, { 62, 0, 0 }, { 63, 0, 0 }, { 66, 0, 0 }, { 67, 0, 0 }, { 69, 0, 0 }, { 72, 1, 0 }
+    },
+    /* state 41 */
+    {
+        { 0, 3, 69 }, { 0, 3, 70 }, { 0, 3, 71 }, { 0, 3, 72 }, { 0, 3, 73 }, { 0, 3, 74 }, { 0, 3, 75 }, { 0, 3, 76 },
+        { 0, 3, 77 }, { 0, 3, 78 }, { 0, 3, 79 }, { 0, 3, 80 }, { 0, 3, 81 }, { 0, 3, 82 }, { 0, 3, 83 }, { 0, 3, 84 }
+    },
+    /* state 42 */
+    {
+        { 1, 2, 69 }, { 22, 3, 69 }, { 1, 2, 70 }, { 22, 3, 70 }, { 1, 2, 71 }, { 22, 3, 71 }, { 1, 2, 72 }, { 22, 3, 72 },
+        { 1, 2, 73 }, { 22, 3, 73 }, { 1, 2, 74 }, { 22, 3, 74 }, { 1, 2, 75 }, { 22, 3, 75 }, { 1, 2, 76 }, { 22, 3, 76 }
+    },
+    /* state 43 */
+    {
+        { 2, 2, 69 }, { 9, 2, 69 }, { 23, 2, 69 }, { 40, 3, 69 }, { 2, 2, 70 }, { 9, 2, 70 }, { 23, 2, 70 }, { 40, 3, 70 },
+        { 2, 2, 71 }, { 9, 2, 71 }, { 23, 2, 71 }, { 40, 3, 71 }, { 2, 2, 72 }, { 9, 2, 72 }, { 23, 2, 72 }, { 40, 3, 72 }
+    },
+    /* state 44 */
+    {
+        { 3, 2, 69 }, { 6, 2, 69 }, { 10, 2, 69 }, { 15, 2, 69 }, { 24, 2, 69 }, { 31, 2, 69 }, { 41, 2, 69 }, { 56, 3, 69 },
+        { 3, 2, 70 }, { 6, 2, 70 }, { 10, 2, 70 }, { 15, 2, 70 }, { 24, 2, 70 }, { 31, 2, 70 }, { 41, 2, 70 }, { 56, 3, 70 }
+    },
+    /* state 45 */
+    {
+        { 3, 2, 71 }, { 6, 2, 71 }, { 10, 2, 71 }, { 15, 2, 71 }, { 24, 2, 71 }, { 31, 2, 71 }, { 41, 2, 71 }, { 56, 3, 71 },
+        { 3, 2, 72 }, { 6, 2, 72 }, { 10, 2, 72 }, { 15, 2, 72 }, { 24, 2, 72 }, { 31, 2, 72 }, { 41, 2, 72 }, { 56, 3, 72 }
+    },
+    /* state 46 */
+    {
+        { 2, 2, 73 }, { 9, 2, 73 }, { 23, 2, 73 }, { 40, 3, 73 }, { 2, 2, 74 }, { 9, 2, 74 }, { 23, 2, 74 }, { 40, 3, 74 },
+        { 2, 2, 75 }, { 9, 2, 75 }, { 23, 2, 75 }, { 40, 3, 75 }, { 2, 2, 76 }, { 9, 2, 76 }, { 23, 2, 76 }, { 40, 3, 76 }
+    },
+    /* state 47 */
+    {
+        { 3, 2, 73 }, { 6, 2, 73 }, { 10, 2, 73 }, { 15, 2, 73 }, { 24, 2, 73 }, { 31, 2, 73 }, { 41, 2, 73 }, { 56, 3, 73 },
+        { 3, 2, 74 }, { 6, 2, 74 }, { 10, 2, 74 }, { 15, 2, 74 }, { 24, 2, 74 }, { 31, 2, 74 }, { 41, 2, 74 }, { 56, 3, 74 }
+    },
+    /* state 48 */
+    {
+        { 3, 2, 75 }, { 6, 2, 75 }, { 10, 2, 75 }, { 15, 2, 75 }, { 24, 2, 75 }, { 31, 2, 75 }, { 41, 2, 75 }, { 56, 3, 75 },
+        { 3, 2, 76 }, { 6, 2, 76 }, { 10, 2, 76 }, { 15, 2, 76 }, { 24, 2, 76 }, { 31, 2, 76 }, { 41, 2, 76 }, { 56, 3, 76 }
+    },
+    /* state 49 */
+    {
+        { 1, 2, 77 }, { 22, 3, 77 }, { 1, 2, 78 }, { 22, 3, 78 }, { 1, 2, 79 }, { 22, 3, 79 }, { 1, 2, 80 }, { 22, 3, 80 },
+        { 1, 2, 81 }, { 22, 3, 81 }, { 1, 2, 82 }, { 22, 3, 82 }, { 1, 2, 83 }, { 22, 3, 83 }, { 1, 2, 84 }, { 22, 3, 84 }
+    },
+    /* state 50 */
+    {
+        { 2, 2, 77 }, { 9, 2, 77 }, { 23, 2, 77 }, { 40, 3, 77 }, { 2, 2, 78 }, { 9, 2, 78 }, { 23, 2, 78 }, { 40, 3, 78 },
+        { 2, 2, 79 }, { 9, 2, 79 }, { 23, 2, 79 }, { 40, 3, 79 }, { 2, 2, 80 }, { 9, 2, 80 }, { 23, 2, 80 }, { 40, 3, 80 }
+    },
+    /* state 51 */
+    {
+        { 3, 2, 77 }, { 6, 2, 77 }, { 10, 2, 77 }, { 15, 2, 77 }, { 24, 2, 77 }, { 31, 2, 77 }, { 41, 2, 77 }, { 56, 3, 77 },
+        { 3, 2, 78 }, { 6, 2, 78 }, { 10, 2, 78 }, { 15, 2, 78 }, { 24, 2, 78 }, { 31, 2, 78 }, { 41, 2, 78 }, { 56, 3, 78 }
+    },
+    /* state 52 */
+    {
+        { 3, 2, 79 }, { 6, 2, 79 }, { 10, 2, 79 }, { 15, 2, 79 }, { 24, 2, 79 }, { 31, 2, 79 }, { 41, 2, 79 }, { 56, 3, 79 },
+        { 3, 2, 80 }, { 6, 2, 80 }, { 10, 2, 80 }, { 15, 2, 80 }, { 24, 2, 80 }, { 31, 2, 80 }, { 41, 2, 80 }, { 56, 3, 80 }
+    },
+    /* state 53 */
+    {
+        { 2, 2, 81 }, { 9, 2, 81 }, { 23, 2, 81 }, { 40, 3, 81 }, { 2, 2, 82 }, { 9, 2, 82 }, { 23, 2, 82 }, { 40, 3, 82 },
+        { 2, 2, 83 }, { 9, 2, 83 }, { 23, 2, 83 }, { 40, 3, 83 }, { 2, 2, 84 }, { 9, 2, 84 }, { 23, 2, 84 }, { 40, 3, 84 }
+    },
+    /* state 54 */
+    {
+        { 3, 2, 81 }, { 6, 2, 81 }, { 10, 2, 81 }, { 15, 2, 81 }, { 24, 2, 81 }, { 31, 2, 81 }, { 41, 2, 81 }, { 56, 3, 81 },
+        { 3, 2, 82 }, { 6, 2, 82 }, { 10, 2, 82 }, { 15, 2, 82 }, { 24, 2, 82 }, { 31, 2, 82 }, { 41, 2, 82 }, { 56, 3, 82 }
+    },
+    /* state 55 */
+    {
+        { 3, 2, 83 }, { 6, 2, 83 }, { 10, 2, 83 }, { 15, 2, 83 }, { 24, 2, 83 }, { 31, 2, 83 }, { 41, 2, 83 }, { 56, 3, 83 },
+        { 3, 2, 84 }, { 6, 2, 84 }, { 10, 2, 84 }, { 15, 2, 84 }, { 24, 2, 84 }, { 31, 2, 84 }, { 41, 2, 84 }, { 56, 3, 84 }
+    },
+    /* state 56 */
+    {
+        { 0, 3, 85 }, { 0, 3, 86 }, { 0, 3, 87 }, { 0, 3, 89 }, { 0, 3, 106 }, { 0, 3, 107 }, { 0, 3, 113 }, { 0, 3, 118 },
+        { 0, 3, 119 }, { 0, 3, 120 }, { 0, 3, 121 }, { 0, 3, 122 }, { 70, 0, 0 }, { 71, 0, 0 }, { 73, 0, 0 }, { 74, 1, 0 }
+    },
+    /* state 57 */
+    {
+        { 1, 2, 85 }, { 22, 3, 85 }, { 1, 2, 86 }, { 22, 3, 86 }, { 1, 2, 87 }, { 22, 3, 87 }, { 1, 2, 89 }, { 22, 3, 89 },
+        { 1, 2, 106 }, { 22, 3, 106 }, { 1, 2, 107 }, { 22, 3, 107 }, { 1, 2, 113 }, { 22, 3, 113 }, { 1, 2, 118 }, { 22, 3, 118 }
+    },
+    /* state 58 */
+    {
+        { 2, 2, 85 }, { 9, 2, 85 }, { 23, 2, 85 }, { 40, 3, 85 }, { 2, 2, 86 }, { 9, 2, 86 }, { 23, 2, 86 }, { 40, 3, 86 },
+        { 2, 2, 87 }, { 9, 2, 87 }, { 23, 2, 87 }, { 40, 3, 87 }, { 2, 2, 89 }, { 9, 2, 89 }, { 23, 2, 89 }, { 40, 3, 89 }
+    },
+    /* state 59 */
+    {
+        { 3, 2, 85 }, { 6, 2, 85 }, { 10, 2, 85 }, { 15, 2, 85 }, { 24, 2, 85 }, { 31, 2, 85 }, { 41, 2, 85 }, { 56, 3, 85 },
+        { 3, 2, 86 }, { 6, 2, 86 }, { 10, 2, 86 }, { 15, 2, 86 }, { 24, 2, 86 }, { 31, 2, 86 }, { 41, 2, 86 }, { 56, 3, 86 }
+    },
+    /* state 60 */
+    {
+        { 3, 2, 87 }, { 6, 2, 87 }, { 10, 2, 87 }, { 15, 2, 87 }, { 24, 2, 87 }, { 31, 2, 87 }, { 41, 2, 87 }, { 56, 3, 87 },
+        { 3, 2, 89 }, { 6, 2, 89 }, { 10, 2, 89 }, { 15, 2, 89 }, { 24, 2, 89 }, { 31, 2, 89 }, { 41, 2, 89 }, { 56, 3, 89 }
+    },
+    /* state 61 */
+    {
+        { 2, 2, 106 }, { 9, 2, 106 }, { 23, 2, 106 }, { 40, 3, 106 }, { 2, 2, 107 }, { 9, 2, 107 }, { 23, 2, 107 }, { 40, 3, 107 },
+        { 2, 2, 113 }, { 9, 2, 113 }, { 23, 2, 113 }, { 40, 3, 113 }, { 2, 2, 118 }, { 9, 2, 118 }, { 23, 2, 118 }, { 40, 3, 118 }
+    },
+    /* state 62 */
+    {
+        { 3, 2, 106 }, { 6, 2, 106 }, { 10, 2, 106 }, { 15, 2, 106 }, { 24, 2, 106 }, { 31, 2, 106 }, { 41, 2, 106 }, { 56, 3, 106 },
+        { 3, 2, 107 }, { 6, 2, 107 }, { 10, 2, 107 }, { 15, 2, 107 }, { 24, 2, 107 }, { 31, 2, 107 }, { 41, 2, 107 }, { 56, 3, 107 }
+    },
+    /* state 63 */
+    {
+        { 3, 2, 113 }, { 6, 2, 113 }, { 10, 2, 113 }, { 15, 2, 113 }, { 24, 2, 113 }, { 31, 2, 113 }, { 41, 2, 113 }, { 56, 3, 113 },
+        { 3, 2, 118 }, { 6, 2, 118 }, { 10, 2, 118 }, { 15, 2, 118 }, { 24, 2, 118 }, { 31, 2, 118 }, { 41, 2, 118 }, { 56, 3, 118 }
+    },
+    /* state 64 */
+    {
+        { 1, 2, 119 }, { 22, 3, 119 }, { 1, 2, 120 }, { 22, 3, 120 }, { 1, 2, 121 }, { 22, 3, 121 }, { 1, 2, 122 }, { 22, 3, 122 },
+        { 0, 3, 38 }, { 0, 3, 42 }, { 0, 3, 44 }, { 0, 3, 59 }, { 0, 3, 88 }, { 0, 3, 90 }, { 75, 0, 0 }, { 78, 1, 0 }
+    },
+    /* state 65 */
+    {
+        { 2, 2, 119 }, { 9, 2, 119 }, { 23, 2, 119 }, { 40, 3, 119 }, { 2, 2, 120 }, { 9, 2, 120 }, { 23, 2, 120 }, { 40, 3, 120 },
+        { 2, 2, 121 }, { 9, 2, 121 }, { 23, 2, 121 }, { 40, 3, 121 }, { 2, 2, 122 }, { 9, 2, 122 }, { 23, 2, 122 }, { 40, 3, 122 }
+    },
+    /* state 66 */
+    {
+        { 3, 2, 119 }, { 6, 2, 119 }, { 10, 2, 119 }, { 15, 2, 119 }, { 24, 2, 119 }, { 31, 2, 119 }, { 41, 2, 119 }, { 56, 3, 119 },
+        { 3, 2, 120 }, { 6, 2, 120 }, { 10, 2, 120 }, { 15, 2, 120 }, { 24, 2, 120 }, { 31, 2, 120 }, { 41, 2, 120 }, { 56, 3, 120 }
+    },
+    /* state 67 */
+    {
+        { 3, 2, 121 }, { 6, 2, 121 }, { 10, 2, 121 }, { 15, 2, 121 }, { 24, 2, 121 }, { 31, 2, 121 }, { 41, 2, 121 }, { 56, 3, 121 },
+        { 3, 2, 122 }, { 6, 2, 122 }, { 10, 2, 122 }, { 15, 2, 122 }, { 24, 2, 122 }, { 31, 2, 122 }, { 41, 2, 122 }, { 56, 3, 122 }
+    },
+    /* state 68 */
+    {
+        { 1, 2, 38 }, { 22, 3, 38 }, { 1, 2, 42 }, { 22, 3, 42 }, { 1, 2, 44 }, { 22, 3, 44 }, { 1, 2, 59 }, { 22, 3, 59 },
+        { 1, 2, 88 }, { 22, 3, 88 }, { 1, 2, 90 }, { 22, 3, 90 }, { 76, 0, 0 }, { 77, 0, 0 }, { 79, 0, 0 }, { 81, 1, 0 }
+    },
+    /* state 69 */
+    {
+        { 2, 2, 38 }, { 9, 2, 38 }, { 23, 2, 38 }, { 40, 3, 38 }, { 2, 2, 42 }, { 9, 2, 42 }, { 23, 2, 42 }, { 40, 3, 42 },
+        { 2, 2, 44 }, { 9, 2, 44 }, { 23, 2, 44 }, { 40, 3, 44 }, { 2, 2, 59 }, { 9, 2, 59 }, { 23, 2, 59 }, { 40, 3, 59 }
+    },
+    /* state 70 */
+    {
+        { 3, 2, 38 }, { 6, 2, 38 }, { 10, 2, 38 }, { 15, 2, 38 }, { 24, 2, 38 }, { 31, 2, 38 }, { 41, 2, 38 }, { 56, 3, 38 },
+        { 3, 2, 42 }, { 6, 2, 42 }, { 10, 2, 42 }, { 15, 2, 42 }, { 24, 2, 42 }, { 31, 2, 42 }, { 41, 2, 42 }, { 56, 3, 42 }
+    },
+    /* state 71 */
+    {
+        { 3, 2, 44 }, { 6, 2, 44 }, { 10, 2, 44 }, { 15, 2, 44 }, { 24, 2, 44 }, { 31, 2, 44 }, { 41, 2, 44 }, { 56, 3, 44 },
+        { 3, 2, 59 }, { 6, 2, 59 }, { 10, 2, 59 }, { 15, 2, 59 }, { 24, 2, 59 }, { 31, 2, 59 }, { 41, 2, 59 }, { 56, 3, 59 }
+    },
+    /* state 72 */
+    {
+        { 2, 2, 88 }, { 9, 2, 88 }, { 23, 2, 88 }, { 40, 3, 88 }, { 2, 2, 90 }, { 9, 2, 90 }, { 23, 2, 90 }, { 40, 3, 90 },
+        { 0, 3, 33 }, { 0, 3, 34 }, { 0, 3, 40 }, { 0, 3, 41 }, { 0, 3, 63 }, { 80, 0, 0 }, { 82, 0, 0 }, { 84, 1, 0 }
+    },
+    /* state 73 */
+    {
+        { 3, 2, 88 }, { 6, 2, 88 }, { 10, 2, 88 }, { 15, 2, 88 }, { 24, 2, 88 }, { 31, 2, 88 }, { 41, 2, 88 }, { 56, 3, 88 },
+        { 3, 2, 90 }, { 6, 2, 90 }, { 10, 2, 90 }, { 15, 2, 90 }, { 24, 2, 90 }, { 31, 2, 90 }, { 41, 2, 90 }, { 56, 3, 90 }
+    },
+    /* state 74 */
+    {
+        { 1, 2, 33 }, { 22, 3, 33 }, { 1, 2, 34 }, { 22, 3, 34 }, { 1, 2, 40 }, { 22, 3, 40 }, { 1, 2, 41 }, { 22, 3, 41 },
+        { 1, 2, 63 }, { 22, 3, 63 }, { 0, 3, 39 }, { 0, 3, 43 }, { 0, 3, 124 }, { 83, 0, 0 }, { 85, 0, 0 }, { 88, 1, 0 }
+    },
+    /* state 75 */
+    {
+        { 2, 2, 33 }, { 9, 2, 33 }, { 23, 2, 33 }, { 40, 3, 33 }, { 2, 2, 34 }, { 9, 2, 34 }, { 23, 2, 34 }, { 40, 3, 34 },
+        { 2, 2, 40 }, { 9, 2, 40 }, { 23, 2, 40 }, { 40, 3, 40 }, { 2, 2, 41 }, { 9, 2, 41 }, { 23, 2, 41 }, { 40, 3, 41 }
+    },
+    /* state 76 */
+    {
+        { 3, 2, 33 }, { 6, 2, 33 }, { 10, 2, 33 }, { 15, 2, 33 }, { 24, 2, 33 }, { 31, 2, 33 }, { 41, 2, 33 }, { 56, 3, 33 },
+        { 3, 2, 34 }, { 6, 2, 34 }, { 10, 2, 34 }, { 15, 2, 34 }, { 24, 2, 34 }, { 31, 2, 34 }, { 41, 2, 34 }, { 56, 3, 34 }
+    },
+    /* state 77 */
+    {
+        { 3, 2, 40 }, { 6, 2, 40 }, { 10, 2, 40 }, { 15, 2, 40 }, { 24, 2, 40 }, { 31, 2, 40 }, { 41, 2, 40 }, { 56, 3, 40 },
+        { 3, 2, 41 }, { 6, 2, 41 }, { 10, 2, 41 }, { 15, 2, 41 }, { 24, 2, 41 }, { 31, 2, 41 }, { 41, 2, 41 }, { 56, 3, 41 }
+    },
+    /* state 78 */
+    {
+        { 2, 2, 63 }, { 9, 2, 63 }, { 23, 2, 63 }, { 40, 3, 63 }, { 1, 2, 39 }, { 22, 3, 39 }, { 1, 2, 43 }, { 22, 3, 43 },
+        { 1, 2, 124 }, { 22, 3, 124 }, { 0, 3, 35 }, { 0, 3, 62 }, { 86, 0, 0 }, { 87, 0, 0 }, { 89, 0, 0 }, { 90, 1, 0 }
+    },
+    /* state 79 */
+    {
+        { 3, 2, 63 }, { 6, 2, 63 }, { 10, 2, 63 }, { 15, 2, 63 }, { 24, 2, 63 }, { 31, 2, 63 }, { 41, 2, 63 }, { 56, 3, 63 },
+        { 2, 2, 39 }, { 9, 2, 39 }, { 23, 2, 39 }, { 40, 3, 39 }, { 2, 2, 43 }, { 9, 2, 43 }, { 23, 2, 43 }, { 40, 3, 43 }
+    },
+    /* state 80 */
+    {
+        { 3, 2, 39 }, { 6, 2, 39 }, { 10, 2, 39 }, { 15, 2, 39 }, { 24, 2, 39 }, { 31, 2, 39 }, { 41, 2, 39 }, { 56, 3, 39 },
+        { 3, 2, 43 }, { 6, 2, 43 }, { 10, 2, 43 }, { 15, 2, 43 }, { 24, 2, 43 }, { 31, 2, 43 }, { 41, 2, 43 }, { 56, 3, 43 }
+    },
+    /* state 81 */
+    {
+        { 2, 2, 124 }, { 9, 2, 124 }, { 23, 2, 124 }, { 40, 3, 124 }, { 1, 2, 35 }, { 22, 3, 35 }, { 1, 2, 62 }, { 22, 3, 62 },
+        { 0, 3, 0 }, { 0, 3, 36 }, { 0, 3, 64 }, { 0, 3, 91 }, { 0, 3, 93 }, { 0, 3, 126 }, { 91, 0, 0 }, { 92, 1, 0 }
+    },
+    /* state 82 */
+    {
+        { 3, 2, 124 }, { 6, 2, 124 }, { 10, 2, 124 }, { 15, 2, 124 }, { 24, 2, 124 }, { 31, 2, 124 }, { 41, 2, 124 }, { 56, 3, 124 },
+        { 2, 2, 35 }, { 9, 2, 35 }, { 23, 2, 35 }, { 40, 3, 35 }, { 2, 2, 62 }, { 9, 2, 62 }, { 23, 2, 62 }, { 40, 3, 62 }
+    },
+    /* state 83 */
+    {
+        { 3, 2, 35 }, { 6, 2, 35 }, { 10, 2, 35 }, { 15, 2, 35 }, { 24, 2, 35 }, { 31, 2, 35 }, { 41, 2, 35 }, { 56, 3, 35 },
+        { 3, 2, 62 }, { 6, 2, 62 }, { 10, 2, 62 }, { 15, 2, 62 }, { 24, 2, 62 }, { 31, 2, 62 }, { 41, 2, 62 }, { 56, 3, 62 }
+    },
+    /* state 84 */
+    {
+        { 1, 2, 0 }, { 22, 3, 0 }, { 1, 2, 36 }, { 22, 3, 36 }, { 1, 2, 64 }, { 22, 3, 64 }, { 1, 2, 91 }, { 22, 3, 91 },
+        { 1, 2, 93 }, { 22, 3, 93 }, { 1, 2, 126 }, { 22, 3, 126 }, { 0, 3, 94 }, { 0, 3, 125 }, { 93, 0, 0 }, { 94, 1, 0 }
+    },
+    /* state 85 */
+    {
+        { 2, 2, 0 }, { 9, 2, 0 }, { 23, 2, 0 }, { 40, 3, 0 }, { 2, 2, 36 }, { 9, 2, 36 }, { 23, 2, 36 }, { 40, 3, 36 },
+        { 2, 2, 64 }, { 9, 2, 64 }, { 23, 2, 64 }, { 40, 3, 64 }, { 2, 2, 91 }, { 9, 2, 91 }, { 23, 2, 91 }, { 40, 3, 91 }
+    },
+    /* state 86 */
+    {
+        { 3, 2, 0 }, { 6, 2, 0 }, { 10, 2, 0 }, { 15, 2, 0 }, { 24, 2, 0 }, { 31, 2, 0 }, { 41, 2, 0 }, { 56, 3, 0 },
+        { 3, 2, 36 }, { 6, 2, 36 }, { 10, 2, 36 }, { 15, 2, 36 }, { 24, 2, 36 }, { 31, 2, 36 }, { 41, 2, 36 }, { 56, 3, 36 }
+    },
+    /* state 87 */
+    {
+        { 3, 2, 64 }, { 6, 2, 64 }, { 10, 2, 64 }, { 15, 2, 64 }, { 24, 2, 64 }, { 31, 2, 64 }, { 41, 2, 64 }, { 56, 3, 64 },
+        { 3, 2, 91 }, { 6, 2, 91 }, { 10, 2, 91 }, { 15, 2, 91 }, { 24, 2, 91 }, { 31, 2, 91 }, { 41, 2, 91 }, { 56, 3, 91 }
+    },
+    /* state 88 */
+    {
+        { 2, 2, 93 }, { 9, 2, 93 }, { 23, 2, 93 }, { 40, 3, 93 }, { 2, 2, 126 }, { 9, 2, 126 }, { 23, 2, 126 }, { 40, 3, 126 },
+        { 1, 2, 94 }, { 22, 3, 94 }, { 1, 2, 125 }, { 22, 3, 125 }, { 0, 3, 60 }, { 0, 3, 96 }, { 0, 3, 123 }, { 95, 1, 0 }
+    },
+    /* state 89 */
+    {
+        { 3, 2, 93 }, { 6, 2, 93 }, { 10, 2, 93 }, { 15, 2, 93 }, { 24, 2, 93 }, { 31, 2, 93 }, { 41, 2, 93 }, { 56, 3, 93 },
+        { 3, 2, 126 }, { 6, 2, 126 }, { 10, 2, 126 }, { 15, 2, 126 }, { 24, 2, 126 }, { 31, 2, 126 }, { 41, 2, 126 }, { 56, 3, 126 }
+    },
+    /* state 90 */
+    {
+        { 2, 2, 94 }, { 9, 2, 94 }, { 23, 2, 94 }, { 40, 3, 94 }, { 2, 2, 125 }, { 9, 2, 125 }, { 23, 2, 125 }, { 40, 3, 125 },
+        { 1, 2, 60 }, { 22, 3, 60 }, { 1, 2, 96 }, { 22, 3, 96 }, { 1, 2, 123 }, { 22, 3, 123 }, { 96, 0, 0 }, { 110, 1, 0 }
+    },
+    /* state 91 */
+    {
+        { 3, 2, 94 }, { 6, 2, 94 }, { 10, 2, 94 }, { 15, 2, 94 }, { 24, 2, 94 }, { 31, 2, 94 }, { 41, 2, 94 }, { 56, 3, 94 },
+        { 3, 2, 125 }, { 6, 2, 125 }, { 10, 2, 125 }, { 15, 2, 125 }, { 24, 2, 125 }, { 31, 2, 125 }, { 41, 2, 125 }, { 56, 3, 125 }
+    },
+    /* state 92 */
+    {
+        { 2, 2, 60 }, { 9, 2, 60 }, { 23, 2, 60 }, { 40, 3, 60 }, { 2, 2, 96 }, { 9, 2, 96 }, { 23, 2, 96 }, { 40, 3, 96 },
+        { 2, 2, 123 }, { 9, 2, 123 }, { 23, 2, 123 }, { 40, 3, 123 }, { 97, 0, 0 }, { 101, 0, 0 }, { 111, 0, 0 }, { 133, 1, 0 }
+    },
+    /* state 93 */
+    {
+        { 3, 2, 60 }, { 6, 2, 60 }, { 10, 2, 60 }, { 15, 2, 60 }, { 24, 2, 60 }, { 31, 2, 60 }, { 41, 2, 60 }, { 56, 3, 60 },
+        { 3, 2, 96 }, { 6, 2, 96 }, { 10, 2, 96 }, { 15, 2, 96 }, { 24, 2, 96 }, { 31, 2, 96 }, { 41, 2, 96 }, { 56, 3, 96 }
+    },
+    /* state 94 */
+    {
+        { 3, 2, 123 }, { 6, 2, 123 }, { 10, 2, 123 }, { 15, 2, 123 }, { 24, 2, 123 }, { 31, 2, 123 }, { 41, 2, 123 }, { 56, 3, 123 },
+        { 98, 0, 0 }, { 99, 0, 0 }, { 102, 0, 0 }, { 105, 0, 0 }, { 112, 0, 0 }, { 119, 0, 0 }, { 134, 0, 0 }, { 153, 1, 0 }
+    },
+    /* state 95 */
+    {
+        { 0, 3, 92 }, { 0, 3, 195 }, { 0, 3, 208 }, { 100, 0, 0 }, { 103, 0, 0 }, { 104, 0, 0 }, { 106, 0, 0 }, { 107, 0, 0 },
+        { 113, 0, 0 }, { 116, 0, 0 }, { 120, 0, 0 }, { 126, 0, 0 }, { 135, 0, 0 }, { 142, 0, 0 }, { 154, 0, 0 }, { 169, 1, 0 }
+    },
+    /* state 96 */
+    {
+        { 1, 2, 92 }, { 22, 3, 92 }, { 1, 2, 195 }, { 22, 3, 195 }, { 1, 2, 208 }, { 22, 3, 208 }, { 0, 3, 128 }, { 0, 3, 130 },
+        { 0, 3, 131 }, { 0, 3, 162 }, { 0, 3, 184 }, { 0, 3, 194 }, { 0, 3, 224 }, { 0, 3, 226 }, { 108, 0, 0 }, { 109, 0, 0 }
+    },
+    /* state 97 */
+    {
+        { 2, 2, 92 }, { 9, 2, 92 }, { 23, 2, 92 }, { 40, 3, 92 }, { 2, 2, 195 }, { 9, 2, 195 }, { 23, 2, 195 }, { 40, 3, 195 },
+        { 2, 2, 208 }, { 9, 2, 208 }, { 23, 2, 208 }, { 40, 3, 208 }, { 1, 2, 128 }, { 22, 3, 128 }, { 1, 2, 130 }, { 22, 3, 130 }
+    },
+    /* state 98 */
+    {
+        { 3, 2, 92 }, { 6, 2, 92 }, { 10, 2, 92 }, { 15, 2, 92 }, { 24, 2, 92 }, { 31, 2, 92 }, { 41, 2, 92 }, { 56, 3, 92 },
+        { 3, 2, 195 }, { 6, 2, 195 }, { 10, 2, 195 }, { 15, 2, 195 }, { 24, 2, 195 }, { 31, 2, 195 }, { 41, 2, 195 }, { 56, 3, 195 }
+    },
+    /* state 99 */
+    {
+        { 3, 2, 208 }, { 6, 2, 208 }, { 10, 2, 208 }, { 15, 2, 208 }, { 24, 2, 208 }, { 31, 2, 208 }, { 41, 2, 208 }, { 56, 3, 208 },
+        { 2, 2, 128 }, { 9, 2, 128 }, { 23, 2, 128 }, { 40, 3, 128 }, { 2, 2, 130 }, { 9, 2, 130 }, { 23, 2, 130 }, { 40, 3, 130 }
+    },
+    /* state 100 */
+    {
+        { 3, 2, 128 }, { 6, 2, 128 }, { 10, 2, 128 }, { 15, 2, 128 }, { 24, 2, 128 }, { 31, 2, 128 }, { 41, 2, 128 }, { 56, 3, 128 },
+        { 3, 2, 130 }, { 6, 2, 130 }, { 10, 2, 130 }, { 15, 2, 130 }, { 24, 2, 130 }, { 31, 2, 130 }, { 41, 2, 130 }, { 56, 3, 130 }
+    },
+    /* state 101 */
+    {
+        { 1, 2, 131 }, { 22, 3, 131 }, { 1, 2, 162 }, { 22, 3, 162 }, { 1, 2, 184 }, { 22, 3, 184 }, { 1, 2, 194 }, { 22, 3, 194 },
+        { 1, 2, 224 }, { 22, 3, 224 }, { 1, 2, 226 }, { 22, 3, 226 }, { 0, 3, 153 }, { 0, 3, 161 }, { 0, 3, 167 }, { 0, 3, 172 }
+    },
+    /* state 102 */
+    {
+        { 2, 2, 131 }, { 9, 2, 131 }, { 23, 2, 131 }, { 40, 3, 131 }, { 2, 2, 162 }, { 9, 2, 162 }, { 23, 2, 162 }, { 40, 3, 162 },
+        { 2, 2, 184 }, { 9, 2, 184 }, { 23, 2, 184 }, { 40, 3, 184 }, { 2, 2, 194 }, { 9, 2, 194 }, { 23, 2, 194 }, { 40, 3, 194 }
+    },
+    /* state 103 */
+    {
+        { 3, 2, 131 }, { 6, 2, 131 }, { 10, 2, 131 }, { 15, 2, 131 }, { 24, 2, 131 }, { 31, 2, 131 }, { 41, 2, 131 }, { 56, 3, 131 },
+        { 3, 2, 162 }, { 6, 2, 162 }, { 10, 2, 162 }, { 15, 2, 162 }, { 24, 2, 162 }, { 31, 2, 162 }, { 41, 2, 162 }, { 56, 3, 162 }
+    },
+    /* state 104 */
+    {
+        { 3, 2, 184 }, { 6, 2, 184 }, { 10, 2, 184 }, { 15, 2, 184 }, { 24, 2, 184 }, { 31, 2, 184 }, { 41, 2, 184 }, { 56, 3, 184 },
+        { 3, 2, 194 }, { 6, 2, 194 }, { 10, 2, 194 }, { 15, 2, 194 }, { 24, 2, 194 }, { 31, 2, 194 }, { 41, 2, 194 }, { 56, 3, 194 }
+    },
+    /* state 105 */
+    {
+        { 2, 2, 224 }, { 9, 2, 224 }, { 23, 2, 224 }, { 40, 3, 224 }, { 2, 2, 226 }, { 9, 2, 226 }, { 23, 2, 226 }, { 40, 3, 226 },
+        { 1, 2, 153 }, { 22, 3, 153 }, { 1, 2, 161 }, { 22, 3, 161 }, { 1, 2, 167 }, { 22, 3, 167 }, { 1, 2, 172 }, { 22, 3, 172 }
+    },
+    /* state 106 */
+    {
+        { 3, 2, 224 }, { 6, 2, 224 }, { 10, 2, 224 }, { 15, 2, 224 }, { 24, 2, 224 }, { 31, 2, 224 }, { 41, 2, 224 }, { 56, 3, 224 },
+        { 3, 2, 226 }, { 6, 2, 226 }, { 10, 2, 226 }, { 15, 2, 226 }, { 24, 2, 226 }, { 31, 2, 226 }, { 41, 2, 226 }, { 56, 3, 226 }
+    },
+    /* state 107 */
+    {
+        { 2, 2, 153 }, { 9, 2, 153 }, { 23, 2, 153 }, { 40, 3, 153 }, { 2, 2, 161 }, { 9, 2, 161 }, { 23, 2, 161 }, { 40, 3, 161 },
+        { 2, 2, 167 }, { 9, 2, 167 }, { 23, 2, 167 }, { 40, 3, 167 }, { 2, 2, 172 }, { 9, 2, 172 }, { 23, 2, 172 }, { 40, 3, 172 }
+    },
+    /* state 108 */
+    {
+        { 3, 2, 153 }, { 6, 2, 153 }, { 10, 2, 153 }, { 15, 2, 153 }, { 24, 2, 153 }, { 31, 2, 153 }, { 41, 2, 153 }, { 56, 3, 153 },
+        { 3, 2, 161 }, { 6, 2, 161 }, { 10, 2, 161 }, { 15, 2, 161 }, { 24, 2, 161 }, { 31, 2, 161 }, { 41, 2, 161 }, { 56, 3, 161 }
+    },
+    /* state 109 */
+    {
+        { 3, 2, 167 }, { 6, 2, 167 }, { 10, 2, 167 }, { 15, 2, 167 }, { 24, 2, 167 }, { 31, 2, 167 }, { 41, 2, 167 }, { 56, 3, 167 },
+        { 3, 2, 172 }, { 6, 2, 172 }, { 10, 2, 172 }, { 15, 2, 172 }, { 24, 2, 172 }, { 31, 2, 172 }, { 41, 2, 172 }, { 56, 3, 172 }
+    },
+    /* state 110 */
+    {
+        { 114, 0, 0 }, { 115, 0, 0 }, { 117, 0, 0 }, { 118, 0, 0 }, { 121, 0, 0 }, { 123, 0, 0 }, { 127, 0, 0 }, { 130, 0, 0 },
+        { 136, 0, 0 }, { 139, 0, 0 }, { 143, 0, 0 }, { 146, 0, 0 }, { 155, 0, 0 }, { 162, 0, 0 }, { 170, 0, 0 }, { 180, 1, 0 }
+    },
+    /* state 111 */
+    {
+        { 0, 3, 176 }, { 0, 3, 177 }, { 0, 3, 179 }, { 0, 3, 209 }, { 0, 3, 216 }, { 0, 3, 217 }, { 0, 3, 227 }, { 0, 3, 229 },
+        { 0, 3, 230 }, { 122, 0, 0 }, { 124, 0, 0 }, { 125, 0, 0 }, { 128, 0, 0 }, { 129, 0, 0 }, { 131, 0, 0 }, { 132, 0, 0 }
+    },
+    /* state 112 */
+    {
+        { 1, 2, 176 }, { 22, 3, 176 }, { 1, 2, 177 }, { 22, 3, 177 }, { 1, 2, 179 }, { 22, 3, 179 }, { 1, 2, 209 }, { 22, 3, 209 },
+        { 1, 2, 216 }, { 22, 3, 216 }, { 1, 2, 217 }, { 22, 3, 217 }, { 1, 2, 227 }, { 22, 3, 227 }, { 1, 2, 229 }, { 22, 3, 229 }
+    },
+    /* state 113 */
+    {
+        { 2, 2, 176 }, { 9, 2, 176 }, { 23, 2, 176 }, { 40, 3, 176 }, { 2, 2, 177 }, { 9, 2, 177 }, { 23, 2, 177 }, { 40, 3, 177 },
+        { 2, 2, 179 }, { 9, 2, 179 }, { 23, 2, 179 }, { 40, 3, 179 }, { 2, 2, 209 }, { 9, 2, 209 }, { 23, 2, 209 }, { 40, 3, 209 }
+    },
+    /* state 114 */
+    {
+        { 3, 2, 176 }, { 6, 2, 176 }, { 10, 2, 176 }, { 15, 2, 176 }, { 24, 2, 176 }, { 31, 2, 176 }, { 41, 2, 176 }, { 56, 3, 176 },
+        { 3, 2, 177 }, { 6, 2, 177 }, { 10, 2, 177 }, { 15, 2, 177 }, { 24, 2, 177 }, { 31, 2, 177 }, { 41, 2, 177 }, { 56, 3, 177 }
+    },
+    /* state 115 */
+    {
+        { 3, 2, 179 }, { 6, 2, 179 }, { 10, 2, 179 }, { 15, 2, 179 }, { 24, 2, 179 }, { 31, 2, 179 }, { 41, 2, 179 }, { 56, 3, 179 },
+        { 3, 2, 209 }, { 6, 2, 209 }, { 10, 2, 209 }, { 15, 2, 209 }, { 24, 2, 209 }, { 31, 2, 209 }, { 41, 2, 209 }, { 56, 3, 209 }
+    },
+    /* state 116 */
+    {
+        { 2, 2, 216 }, { 9, 2, 216 }, { 23, 2, 216 }, { 40, 3, 216 }, { 2, 2, 217 }, { 9, 2, 217 }, { 23, 2, 217 }, { 40, 3, 217 },
+        { 2, 2, 227 }, { 9, 2, 227 }, { 23, 2, 227 }, { 40, 3, 227 }, { 2, 2, 229 }, { 9, 2, 229 }, { 23, 2, 229 }, { 40, 3, 229 }
+    },
+    /* state 117 */
+    {
+        { 3, 2, 216 }, { 6, 2, 216 }, { 10, 2, 216 }, { 15, 2, 216 }, { 24, 2, 216 }, { 31, 2, 216 }, { 41, 2, 216 }, { 56, 3, 216 },
+        { 3, 2, 217 }, { 6, 2, 217 }, { 10, 2, 217 }, { 15, 2, 217 }, { 24, 2, 217 }, { 31, 2, 217 }, { 41, 2, 217 }, { 56, 3, 217 }
+    },
+    /* state 118 */
+    {
+        { 3, 2, 227 }, { 6, 2, 227 }, { 10, 2, 227 }, { 15, 2, 227 }, { 24, 2, 227 }, { 31, 2, 227 }, { 41, 2, 227 }, { 56, 3, 227 },
+        { 3, 2, 229 }, { 6, 2, 229 }, { 10, 2, 229 }, { 15, 2, 229 }, { 24, 2, 229 }, { 31, 2, 229 }, { 41, 2, 229 }, { 56, 3, 229 }
+    },
+    /* state 119 */
+    {
+        { 1, 2, 230 }, { 22, 3, 230 }, { 0, 3, 129 }, { 0, 3, 132 }, { 0, 3, 133 }, { 0, 3, 134 }, { 0, 3, 136 }, { 0, 3, 146 },
+        { 0, 3, 154 }, { 0, 3, 156 }, { 0, 3, 160 }, { 0, 3, 163 }, { 0, 3, 164 }, { 0, 3, 169 }, { 0, 3, 170 }, { 0, 3, 173 }
+    },
+    /* state 120 */
+    {
+        { 2, 2, 230 }, { 9, 2, 230 }, { 23, 2, 230 }, { 40, 3, 230 }, { 1, 2, 129 }, { 22, 3, 129 }, { 1, 2, 132 }, { 22, 3, 132 },
+        { 1, 2, 133 }, { 22, 3, 133 }, { 1, 2, 134 }, { 22, 3, 134 }, { 1, 2, 136 }, { 22, 3, 136 }, { 1, 2, 146 }, { 22, 3, 146 }
+    },
+    /* state 121 */
+    {
+        { 3, 2, 230 }, { 6, 2, 230 }, { 10, 2, 230 }, { 15, 2, 230 }, { 24, 2, 230 }, { 31, 2, 230 }, { 41, 2, 230 }, { 56, 3, 230 },
+        { 2, 2, 129 }, { 9, 2, 129 }, { 23, 2, 129 }, { 40, 3, 129 }, { 2, 2, 132 }, { 9, 2, 132 }, { 23, 2, 132 }, { 40, 3, 132 }
+    },
+    /* state 122 */
+    {
+        { 3, 2, 129 }, { 6, 2, 129 }, { 10, 2, 129 }, { 15, 2, 129 }, { 24, 2, 129 }, { 31, 2, 129 }, { 41, 2, 129 }, { 56, 3, 129 },
+        { 3, 2, 132 }, { 6, 2, 132 }, { 10, 2, 132 }, { 15, 2, 132 }, { 24, 2, 132 }, { 31, 2, 132 }, { 41, 2, 132 }, { 56, 3, 132 }
+    },
+    /* state 123 */
+    {
+        { 2, 2, 133 }, { 9, 2, 133 }, { 23, 2, 133 }, { 40, 3, 133 }, { 2, 2, 134 }, { 9, 2, 134 }, { 23, 2, 134 }, { 40, 3, 134 },
+        { 2, 2, 136 }, { 9, 2, 136 }, { 23, 2, 136 }, { 40, 3, 136 }, { 2, 2, 146 }, { 9, 2, 146 }, { 23, 2, 146 }, { 40, 3, 146 }
+    },
+    /* state 124 */
+    {
+        { 3, 2, 133 }, { 6, 2, 133 }, { 10, 2, 133 }, { 15, 2, 133 }, { 24, 2, 133 }, { 31, 2, 133 }, { 41, 2, 133 }, { 56, 3, 133 },
+        { 3, 2, 134 }, { 6, 2, 134 }, { 10, 2, 134 }, { 15, 2, 134 }, { 24, 2, 134 }, { 31, 2, 134 }, { 41, 2, 134 }, { 56, 3, 134 }
+    },
+    /* state 125 */
+    {
+        { 3, 2, 136 }, { 6, 2, 136 }, { 10, 2, 136 }, { 15, 2, 136 }, { 24, 2, 136 }, { 31, 2, 136 }, { 41, 2, 136 }, { 56, 3, 136 },
+        { 3, 2, 146 }, { 6, 2, 146 }, { 10, 2, 146 }, { 15, 2, 146 }, { 24, 2, 146 }, { 31, 2, 146 }, { 41, 2, 146 }, { 56, 3, 146 }
+    },
+    /* state 126 */
+    {
+        { 1, 2, 154 }, { 22, 3, 154 }, { 1, 2, 156 }, { 22, 3, 156 }, { 1, 2, 160 }, { 22, 3, 160 }, { 1, 2, 163 }, { 22, 3, 163 },
+        { 1, 2, 164 }, { 22, 3, 164 }, { 1, 2, 169 }, { 22, 3, 169 }, { 1, 2, 170 }, { 22, 3, 170 }, { 1, 2, 173 }, { 22, 3, 173 }
+    },
+    /* state 127 */
+    {
+        { 2, 2, 154 }, { 9, 2, 154 }, { 23, 2, 154 }, { 40, 3, 154 }, { 2, 2, 156 }, { 9, 2, 156 }, { 23, 2, 156 }, { 40, 3, 156 },
+        { 2, 2, 160 }, { 9, 2, 160 }, { 23, 2, 160 }, { 40, 3, 160 }, { 2, 2, 163 }, { 9, 2, 163 }, { 23, 2, 163 }, { 40, 3, 163 }
+    },
+    /* state 128 */
+    {
+        { 3, 2, 154 }, { 6, 2, 154 }, { 10, 2, 154 }, { 15, 2, 154 }, { 24, 2, 154 }, { 31, 2, 154 }, { 41, 2, 154 }, { 56, 3, 154 },
+        { 3, 2, 156 }, { 6, 2, 156 }, { 10, 2, 156 }, { 15, 2, 156 }, { 24, 2, 156 }, { 31, 2, 156 }, { 41, 2, 156 }, { 56, 3, 156 }
+    },
+    /* state 129 */
+    {
+        { 3, 2, 160 }, { 6, 2, 160 }, { 10, 2, 160 }, { 15, 2, 160 }, { 24, 2, 160 }, { 31, 2, 160 }, { 41, 2, 160 }, { 56, 3, 160 },
+        { 3, 2, 163 }, { 6, 2, 163 }, { 10, 2, 163 }, { 15, 2, 163 }, { 24, 2, 163 }, { 31, 2, 163 }, { 41, 2, 163 }, { 56, 3, 163 }
+    },
+    /* state 130 */
+    {
+        { 2, 2, 164 }, { 9, 2, 164 }, { 23, 2, 164 }, { 40, 3, 164 }, { 2, 2, 169 }, { 9, 2, 169 }, { 23, 2, 169 }, { 40, 3, 169 },
+        { 2, 2, 170 }, { 9, 2, 170 }, { 23, 2, 170 }, { 40, 3, 170 }, { 2, 2, 173 }, { 9, 2, 173 }, { 23, 2, 173 }, { 40, 3, 173 }
+    },
+    /* state 131 */
+    {
+        { 3, 2, 164 }, { 6, 2, 164 }, { 10, 2, 164 }, { 15, 2, 164 }, { 24, 2, 164 }, { 31, 2, 164 }, { 41, 2, 164 }, { 56, 3, 164 },
+        { 3, 2, 169 }, { 6, 2, 169 }, { 10, 2, 169 }, { 15, 2, 169 }, { 24, 2, 169 }, { 31, 2, 169 }, { 41, 2, 169 }, { 56, 3, 169 }
+    },
+    /* state 132 */
+    {
+        { 3, 2, 170 }, { 6, 2, 170 }, { 10, 2, 170 }, { 15, 2, 170 }, { 24, 2, 170 }, { 31, 2, 170 }, { 41, 2, 170 }, { 56, 3, 170 },
+        { 3, 2, 173 }, { 6, 2, 173 }, { 10, 2, 173 }, { 15, 2, 173 }, { 24, 2, 173 }, { 31, 2, 173 }, { 41, 2, 173 }, { 56, 3, 173 }
+    },
+    /* state 133 */
+    {
+        { 137, 0, 0 }, { 138, 0, 0 }, { 140, 0, 0 }, { 141, 0, 0 }, { 144, 0, 0 }, { 145, 0, 0 }, { 147, 0, 0 }, { 150, 0, 0 },
+        { 156, 0, 0 }, { 159, 0, 0 }, { 163, 0, 0 }, { 166, 0, 0 }, { 171, 0, 0 }, { 174, 0, 0 }, { 181, 0, 0 }, { 190, 1, 0 }
+    },
+    /* state 134 */
+    {
+        { 0, 3, 178 }, { 0, 3, 181 }, { 0, 3, 185 }, { 0, 3, 186 }, { 0, 3, 187 }, { 0, 3, 189 }, { 0, 3, 190 }, { 0, 3, 196 },
+        { 0, 3, 198 }, { 0, 3, 228 }, { 0, 3, 232 }, { 0, 3, 233 }, { 148, 0, 0 }, { 149, 0, 0 }, { 151, 0, 0 }, { 152, 0, 0 }
+    },
+    /* state 135 */
+    {
+        { 1, 2, 178 }, { 22, 3, 178 }, { 1, 2, 181 }, { 22, 3, 181 }, { 1, 2, 185 }, { 22, 3, 185 }, { 1, 2, 186 }, { 22, 3, 186 },
+        { 1, 2, 187 }, { 22, 3, 187 }, { 1, 2, 189 }, { 22, 3, 189 }, { 1, 2, 190 }, { 22, 3, 190 }, { 1, 2, 196 }, { 22, 3, 196 }
+    },
+    /* state 136 */
+    {
+        { 2, 2, 178 }, { 9, 2, 178 }, { 23, 2, 178 }, { 40, 3, 178 }, { 2, 2, 181 }, { 9, 2, 181 }, { 23, 2, 181 }, { 40, 3, 181 },
+        { 2, 2, 185 }, { 9, 2, 185 }, { 23, 2, 185 }, { 40, 3, 185 }, { 2, 2, 186 }, { 9, 2, 186 }, { 23, 2, 186 }, { 40, 3, 186 }
+    },
+    /* state 137 */
+    {
+        { 3, 2, 178 }, { 6, 2, 178 }, { 10, 2, 178 }, { 15, 2, 178 }, { 24, 2, 178 }, { 31, 2, 178 }, { 41, 2, 178 }, { 56, 3, 178 },
+        { 3, 2, 181 }, { 6, 2, 181 }, { 10, 2, 181 }, { 15, 2, 181 }, { 24, 2, 181 }, { 31, 2, 181 }, { 41, 2, 181 }, { 56, 3, 181 }
+    },
+    /* state 138 */
+    {
+        { 3, 2, 185 }, { 6, 2, 185 }, { 10, 2, 185 }, { 15, 2, 185 }, { 24, 2, 185 }, { 31, 2, 185 }, { 41, 2, 185 }, { 56, 3, 185 },
+        { 3, 2, 186 }, { 6, 2, 186 }, { 10, 2, 186 }, { 15, 2, 186 }, { 24, 2, 186 }, { 31, 2, 186 }, { 41, 2, 186 }, { 56, 3, 186 }
+    },
+    /* state 139 */
+    {
+        { 2, 2, 187 }, { 9, 2, 187 }, { 23, 2, 187 }, { 40, 3, 187 }, { 2, 2, 189 }, { 9, 2, 189 }, { 23, 2, 189 }, { 40, 3, 189 },
+        { 2, 2, 190 }, { 9, 2, 190 }, { 23, 2, 190 }, { 40, 3, 190 }, { 2, 2, 196 }, { 9, 2, 196 }, { 23, 2, 196 }, { 40, 3, 196 }
+    },
+    /* state 140 */
+    {
+        { 3, 2, 187 }, { 6, 2, 187 }, { 10, 2, 187 }, { 15, 2, 187 }, { 24, 2, 187 }, { 31, 2, 187 }, { 41, 2, 187 }, { 56, 3, 187 },
+        { 3, 2, 189 }, { 6, 2, 189 }, { 10, 2, 189 }, { 15, 2, 189 }, { 24, 2, 189 }, { 31, 2, 189 }, { 41, 2, 189 }, { 56, 3, 189 }
+    },
+    /* state 141 */
+    {
+        { 3, 2, 190 }, { 6, 2, 190 }, { 10, 2, 190 }, { 15, 2, 190 }, { 24, 2, 190 }, { 31, 2, 190 }, { 41, 2, 190 }, { 56, 3, 190 },
+        { 3, 2, 196 }, { 6, 2, 196 }, { 10, 2, 196 }, { 15, 2, 196 }, { 24, 2, 196 }, { 31, 2, 196 }, { 41, 2, 196 }, { 56, 3, 196 }
+    },
+    /* state 142 */
+    {
+        { 1, 2, 198 }, { 22, 3, 198 }, { 1, 2, 228 }, { 22, 3, 228 }, { 1, 2, 232 }, { 22, 3, 232 }, { 1, 2, 233 }, { 22, 3, 233 },
+        { 0, 3, 1 }, { 0, 3, 135 }, { 0, 3, 137 }, { 0, 3, 138 }, { 0, 3, 139 }, { 0, 3, 140 }, { 0, 3, 141 }, { 0, 3, 143 }
+    },
+    /* state 143 */
+    {
+        { 2, 2, 198 }, { 9, 2, 198 }, { 23, 2, 198 }, { 40, 3, 198 }, { 2, 2, 228 }, { 9, 2, 228 }, { 23, 2, 228 }, { 40, 3, 228 },
+        { 2, 2, 232 }, { 9, 2, 232 }, { 23, 2, 232 }, { 40, 3, 232 }, { 2, 2, 233 }, { 9, 2, 233 }, { 23, 2, 233 }, { 40, 3, 233 }
+    },
+    /* state 144 */
+    {
+        { 3, 2, 198 }, { 6, 2, 198 }, { 10, 2, 198 }, { 15, 2, 198 }, { 24, 2, 198 }, { 31, 2, 198 }, { 41, 2, 198 }, { 56, 3, 198 },
+        { 3, 2, 228 }, { 6, 2, 228 }, { 10, 2, 228 }, { 15, 2, 228 }, { 24, 2, 228 }, { 31, 2, 228 }, { 41, 2, 228 }, { 56, 3, 228 }
+    },
+    /* state 145 */
+    {
+        { 3, 2, 232 }, { 6, 2, 232 }, { 10, 2, 232 }, { 15, 2, 232 }, { 24, 2, 232 }, { 31, 2, 232 }, { 41, 2, 232 }, { 56, 3, 232 },
+        { 3, 2, 233 }, { 6, 2, 233 }, { 10, 2, 233 }, { 15, 2, 233 }, { 24, 2, 233 }, { 31, 2, 233 }, { 41, 2, 233 }, { 56, 3, 233 }
+    },
+    /* state 146 */
+    {
+        { 1, 2, 1 }, { 22, 3, 1 }, { 1, 2, 135 }, { 22, 3, 135 }, { 1, 2, 137 }, { 22, 3, 137 }, { 1, 2, 138 }, { 22, 3, 138 },
+        { 1, 2, 139 }, { 22, 3, 139 }, { 1, 2, 140 }, { 22, 3, 140 }, { 1, 2, 141 }, { 22, 3, 141 }, { 1, 2, 143 }, { 22, 3, 143 }
+    },
+    /* state 147 */
+    {
+        { 2, 2, 1 }, { 9, 2, 1 }, { 23, 2, 1 }, { 40, 3, 1 }, { 2, 2, 135 }, { 9, 2, 135 }, { 23, 2, 135 }, { 40, 3, 135 },
+        { 2, 2, 137 }, { 9, 2, 137 }, { 23, 2, 137 }, { 40, 3, 137 }, { 2, 2, 138 }, { 9, 2, 138 }, { 23, 2, 138 }, { 40, 3, 138 }
+    },
+    /* state 148 */
+    {
+        { 3, 2, 1 }, { 6, 2, 1 }, { 10, 2, 1 }, { 15, 2, 1 }, { 24, 2, 1 }, { 31, 2, 1 }, { 41, 2, 1 }, { 56, 3, 1 },
+        { 3, 2, 135 }, { 6, 2, 135 }, { 10, 2, 135 }, { 15, 2, 135 }, { 24, 2, 135 }, { 31, 2, 135 }, { 41, 2, 135 }, { 56, 3, 135 }
+    },
+    /* state 149 */
+    {
+        { 3, 2, 137 }, { 6, 2, 137 }, { 10, 2, 137 }, { 15, 2, 137 }, { 24, 2, 137 }, { 31, 2, 137 }, { 41, 2, 137 }, { 56, 3, 137 },
+        { 3, 2, 138 }, { 6, 2, 138 }, { 10, 2, 138 }, { 15, 2, 138 }, { 24, 2, 138 }, { 31, 2, 138 }, { 41, 2, 138 }, { 56, 3, 138 }
+    },
+    /* state 150 */
+    {
+        { 2, 2, 139 }, { 9, 2, 139 }, { 23, 2, 139 }, { 40, 3, 139 }, { 2, 2, 140 }, { 9, 2, 140 }, { 23, 2, 140 }, { 40, 3, 140 },
+        { 2, 2, 141 }, { 9, 2, 141 }, { 23, 2, 141 }, { 40, 3, 141 }, { 2, 2, 143 }, { 9, 2, 143 }, { 23, 2, 143 }, { 40, 3, 143 }
+    },
+    /* state 151 */
+    {
+        { 3, 2, 139 }, { 6, 2, 139 }, { 10, 2, 139 }, { 15, 2, 139 }, { 24, 2, 139 }, { 31, 2, 139 }, { 41, 2, 139 }, { 56, 3, 139 },
+        { 3, 2, 140 }, { 6, 2, 140 }, { 10, 2, 140 }, { 15, 2, 140 }, { 24, 2, 140 }, { 31, 2, 140 }, { 41, 2, 140 }, { 56, 3, 140 }
+    },
+    /* state 152 */
+    {
+        { 3, 2, 141 }, { 6, 2, 141 }, { 10, 2, 141 }, { 15, 2, 141 }, { 24, 2, 141 }, { 31, 2, 141 }, { 41, 2, 141 }, { 56, 3, 141 },
+        { 3, 2, 143 }, { 6, 2, 143 }, { 10, 2, 143 }, { 15, 2, 143 }, { 24, 2, 143 }, { 31, 2, 143 }, { 41, 2, 143 }, { 56, 3, 143 }
+    },
+    /* state 153 */
+    {
+        { 157, 0, 0 }, { 158, 0, 0 }, { 160, 0, 0 }, { 161, 0, 0 }, { 164, 0, 0 }, { 165, 0, 0 }, { 167, 0, 0 }, { 168, 0, 0 },
+        { 172, 0, 0 }, { 173, 0, 0 }, { 175, 0, 0 }, { 177, 0, 0 }, { 182, 0, 0 }, { 185, 0, 0 }, { 191, 0, 0 }, { 207, 1, 0 }
+    },
+    /* state 154 */
+    {
+        { 0, 3, 147 }, { 0, 3, 149 }, { 0, 3, 150 }, { 0, 3, 151 }, { 0, 3, 152 }, { 0, 3, 155 }, { 0, 3, 157 }, { 0, 3, 158 },
+        { 0, 3, 165 }, { 0, 3, 166 }, { 0, 3, 168 }, { 0, 3, 174 }, { 0, 3, 175 }, { 0, 3, 180 }, { 0, 3, 182 }, { 0, 3, 183 }
+    },
+    /* state 155 */
+    {
+        { 1, 2, 147 }, { 22, 3, 147 }, { 1, 2, 149 }, { 22, 3, 149 }, { 1, 2, 150 }, { 22, 3, 150 }, { 1, 2, 151 }, { 22, 3, 151 },
+        { 1, 2, 152 }, { 22, 3, 152 }, { 1, 2, 155 }, { 22, 3, 155 }, { 1, 2, 157 }, { 22, 3, 157 }, { 1, 2, 158 }, { 22, 3, 158 }
+    },
+    /* state 156 */
+    {
+        { 2, 2, 147 }, { 9, 2, 147 }, { 23, 2, 147 }, { 40, 3, 147 }, { 2, 2, 149 }, { 9, 2, 149 }, { 23, 2, 149 }, { 40, 3, 149 },
+        { 2, 2, 150 }, { 9, 2, 150 }, { 23, 2, 150 }, { 40, 3, 150 }, { 2, 2, 151 }, { 9, 2, 151 }, { 23, 2, 151 }, { 40, 3, 151 }
+    },
+    /* state 157 */
+    {
+        { 3, 2, 147 }, { 6, 2, 147 }, { 10, 2, 147 }, { 15, 2, 147 }, { 24, 2, 147 }, { 31, 2, 147 }, { 41, 2, 147 }, { 56, 3, 147 },
+        { 3, 2, 149 }, { 6, 2, 149 }, { 10, 2, 149 }, { 15, 2, 149 }, { 24, 2, 149 }, { 31, 2, 149 }, { 41, 2, 149 }, { 56, 3, 149 }
+    },
+    /* state 158 */
+    {
+        { 3, 2, 150 }, { 6, 2, 150 }, { 10, 2, 150 }, { 15, 2, 150 }, { 24, 2, 150 }, { 31, 2, 150 }, { 41, 2, 150 }, { 56, 3, 150 },
+        { 3, 2, 151 }, { 6, 2, 151 }, { 10, 2, 151 }, { 15, 2, 151 }, { 24, 2, 151 }, { 31, 2, 151 }, { 41, 2, 151 }, { 56, 3, 151 }
+    },
+    /* state 159 */
+    {
+        { 2, 2, 152 }, { 9, 2, 152 }, { 23, 2, 152 }, { 40, 3, 152 }, { 2, 2, 155 }, { 9, 2, 155 }, { 23, 2, 155 }, { 40, 3, 155 },
+        { 2, 2, 157 }, { 9, 2, 157 }, { 23, 2, 157 }, { 40, 3, 157 }, { 2, 2, 158 }, { 9, 2, 158 }, { 23, 2, 158 }, { 40, 3, 158 }
+    },
+    /* state 160 */
+    {
+        { 3, 2, 152 }, { 6, 2, 152 }, { 10, 2, 152 }, { 15, 2, 152 }, { 24, 2, 152 }, { 31, 2, 152 }, { 41, 2, 152 }, { 56, 3, 152 },
+        { 3, 2, 155 }, { 6, 2, 155 }, { 10, 2, 155 }, { 15, 2, 155 }, { 24, 2, 155 }, { 31, 2, 155 }, { 41, 2, 155 }, { 56, 3, 155 }
+    },
+    /* state 161 */
+    {
+        { 3, 2, 157 }, { 6, 2, 157 }, { 10, 2, 157 }, { 15, 2, 157 }, { 24, 2, 157 }, { 31, 2, 157 }, { 41, 2, 157 }, { 56, 3, 157 },
+        { 3, 2, 158 }, { 6, 2, 158 }, { 10, 2, 158 }, { 15, 2, 158 }, { 24, 2, 158 }, { 31, 2, 158 }, { 41, 2, 158 }, { 56, 3, 158 }
+    },
+    /* state 162 */
+    {
+        { 1, 2, 165 }, { 22, 3, 165 }, { 1, 2, 166 }, { 22, 3, 166 }, { 1, 2, 168 }, { 22, 3, 168 }, { 1, 2, 174 }, { 22, 3, 174 },
+        { 1, 2, 175 }, { 22, 3, 175 }, { 1, 2, 180 }, { 22, 3, 180 }, { 1, 2, 182 }, { 22, 3, 182 }, { 1, 2, 183 }, { 22, 3, 183 }
+    },
+    /* state 163 */
+    {
+        { 2, 2, 165 }, { 9, 2, 165 }, { 23, 2, 165 }, { 40, 3, 165 }, { 2, 2, 166 }, { 9, 2, 166 }, { 23, 2, 166 }, { 40, 3, 166 },
+        { 2, 2, 168 }, { 9, 2, 168 }, { 23, 2, 168 }, { 40, 3, 168 }, { 2, 2, 174 }, { 9, 2, 174 }, { 23, 2, 174 }, { 40, 3, 174 }
+    },
+    /* state 164 */
+    {
+        { 3, 2, 165 }, { 6, 2, 165 }, { 10, 2, 165 }, { 15, 2, 165 }, { 24, 2, 165 }, { 31, 2, 165 }, { 41, 2, 165 }, { 56, 3, 165 },
+        { 3, 2, 166 }, { 6, 2, 166 }, { 10, 2, 166 }, { 15, 2, 166 }, { 24, 2, 166 }, { 31, 2, 166 }, { 41, 2, 166 }, { 56, 3, 166 }
+    },
+    /* state 165 */
+    {
+        { 3, 2, 168 }, { 6, 2, 168 }, { 10, 2, 168 }, { 15, 2, 168 }, { 24, 2, 168 }, { 31, 2, 168 }, { 41, 2, 168 }, { 56, 3, 168 },
+        { 3, 2, 174 }, { 6, 2, 174 }, { 10, 2, 174 }, { 15, 2, 174 }, { 24, 2, 174 }, { 31, 2, 174 }, { 41, 2, 174 }, { 56, 3, 174 }
+    },
+    /* state 166 */
+    {
+        { 2, 2, 175 }, { 9, 2, 175 }, { 23, 2, 175 }, { 40, 3, 175 }, { 2, 2, 180 }, { 9, 2, 180 }, { 23, 2, 180 }, { 40, 3, 180 },
+        { 2, 2, 182 }, { 9, 2, 182 }, { 23, 2, 182 }, { 40, 3, 182 }, { 2, 2, 183 }, { 9, 2, 183 }, { 23, 2, 183 }, { 40, 3, 183 }
+    },
+    /* state 167 */
+    {
+        { 3, 2, 175 }, { 6, 2, 175 }, { 10, 2, 175 }, { 15, 2, 175 }, { 24, 2, 175 }, { 31, 2, 175 }, { 41, 2, 175 }, { 56, 3, 175 },
+        { 3, 2, 180 }, { 6, 2, 180 }, { 10, 2, 180 }, { 15, 2, 180 }, { 24, 2, 180 }, { 31, 2, 180 }, { 41, 2, 180 }, { 56, 3, 180 }
+    },
+    /* state 168 */
+    {
+        { 3, 2, 182 }, { 6, 2, 182 }, { 10, 2, 182 }, { 15, 2, 182 }, { 24, 2, 182 }, { 31, 2, 182 }, { 41, 2, 182 }, { 56, 3, 182 },
+        { 3, 2, 183 }, { 6, 2, 183 }, { 10, 2, 183 }, { 15, 2, 183 }, { 24, 2, 183 }, { 31, 2, 183 }, { 41, 2, 183 }, { 56, 3, 183 }
+    },
+    /* state 169 */
+    {
+        { 0, 3, 188 }, { 0, 3, 191 }, { 0, 3, 197 }, { 0, 3, 231 }, { 0, 3, 239 }, { 176, 0, 0 }, { 178, 0, 0 }, { 179, 0, 0 },
+        { 183, 0, 0 }, { 184, 0, 0 }, { 186, 0, 0 }, { 187, 0, 0 }, { 192, 0, 0 }, { 199, 0, 0 }, { 208, 0, 0 }, { 223, 1, 0 }
+    },
+    /* state 170 */
+    {
+        { 1, 2, 188 }, { 22, 3, 188 }, { 1, 2, 191 }, { 22, 3, 191 }, { 1, 2, 197 }, { 22, 3, 197 }, { 1, 2, 231 }, { 22, 3, 231 },
+        { 1, 2, 239 }, { 22, 3, 239 }, { 0, 3, 9 }, { 0, 3, 142 }, { 0, 3, 144 }, { 0, 3, 145 }, { 0, 3, 148 }, { 0, 3, 159 }
+    },
+    /* state 171 */
+    {
+        { 2, 2, 188 }, { 9, 2, 188 }, { 23, 2, 188 }, { 40, 3, 188 }, { 2, 2, 191 }, { 9, 2, 191 }, { 23, 2, 191 }, { 40, 3, 191 },
+        { 2, 2, 197 }, { 9, 2, 197 }, { 23, 2, 197 }, { 40, 3, 197 }, { 2, 2, 231 }, { 9, 2, 231 }, { 23, 2, 231 }, { 40, 3, 231 }
+    },
+    /* state 172 */
+    {
+        { 3, 2, 188 }, { 6, 2, 188 }, { 10, 2, 188 }, { 15, 2, 188 }, { 24, 2, 188 }, { 31, 2, 188 }, { 41, 2, 188 }, { 56, 3, 188 },
+        { 3, 2, 191 }, { 6, 2, 191 }, { 10, 2, 191 }, { 15, 2, 191 }, { 24, 2, 191 }, { 31, 2, 191 }, { 41, 2, 191 }, { 56, 3, 191 }
+    },
+    /* state 173 */
+    {
+        { 3, 2, 197 }, { 6, 2, 197 }, { 10, 2, 197 }, { 15, 2, 197 }, { 24, 2, 197 }, { 31, 2, 197 }, { 41, 2, 197 }, { 56, 3, 197 },
+        { 3, 2, 231 }, { 6, 2, 231 }, { 10, 2, 231 }, { 15, 2, 231 }, { 24, 2, 231 }, { 31, 2, 231 }, { 41, 2, 231 }, { 56, 3, 231 }
+    },
+    /* state 174 */
+    {
+        { 2, 2, 239 }, { 9, 2, 239 }, { 23, 2, 239 }, { 40, 3, 239 }, { 1, 2, 9 }, { 22, 3, 9 }, { 1, 2, 142 }, { 22, 3, 142 },
+        { 1, 2, 144 }, { 22, 3, 144 }, { 1, 2, 145 }, { 22, 3, 145 }, { 1, 2, 148 }, { 22, 3, 148 }, { 1, 2, 159 }, { 22, 3, 159 }
+    },
+    /* state 175 */
+    {
+        { 3, 2, 239 }, { 6, 2, 239 }, { 10, 2, 239 }, { 15, 2, 239 }, { 24, 2, 239 }, { 31, 2, 239 }, { 41, 2, 239 }, { 56, 3, 239 },
+        { 2, 2, 9 }, { 9, 2, 9 }, { 23, 2, 9 }, { 40, 3, 9 }, { 2, 2, 142 }, { 9, 2, 142 }, { 23, 2, 142 }, { 40, 3, 142 }
+    },
+    /* state 176 */
+    {
+        { 3, 2, 9 }, { 6, 2, 9 }, { 10, 2, 9 }, { 15, 2, 9 }, { 24, 2, 9 }, { 31, 2, 9 }, { 41, 2, 9 }, { 56, 3, 9 },
+        { 3, 2, 142 }, { 6, 2, 142 }, { 10, 2, 142 }, { 15, 2, 142 }, { 24, 2, 142 }, { 31, 2, 142 }, { 41, 2, 142 }, { 56, 3, 142 }
+    },
+    /* state 177 */
+    {
+        { 2, 2, 144 }, { 9, 2, 144 }, { 23, 2, 144 }, { 40, 3, 144 }, { 2, 2, 145 }, { 9, 2, 145 }, { 23, 2, 145 }, { 40, 3, 145 },
+        { 2, 2, 148 }, { 9, 2, 148 }, { 23, 2, 148 }, { 40, 3, 148 }, { 2, 2, 159 }, { 9, 2, 159 }, { 23, 2, 159 }, { 40, 3, 159 }
+    },
+    /* state 178 */
+    {
+        { 3, 2, 144 }, { 6, 2, 144 }, { 10, 2, 144 }, { 15, 2, 144 }, { 24, 2, 144 }, { 31, 2, 144 }, { 41, 2, 144 }, { 56, 3, 144 },
+        { 3, 2, 145 }, { 6, 2, 145 }, { 10, 2, 145 }, { 15, 2, 145 }, { 24, 2, 145 }, { 31, 2, 145 }, { 41, 2, 145 }, { 56, 3, 145 }
+    },
+    /* state 179 */
+    {
+        { 3, 2, 148 }, { 6, 2, 148 }, { 10, 2, 148 }, { 15, 2, 148 }, { 24, 2, 148 }, { 31, 2, 148 }, { 41, 2, 148 }, { 56, 3, 148 },
+        { 3, 2, 159 }, { 6, 2, 159 }, { 10, 2, 159 }, { 15, 2, 159 }, { 24, 2, 159 }, { 31, 2, 159 }, { 41, 2, 159 }, { 56, 3, 159 }
+    },
+    /* state 180 */
+    {
+        { 0, 3, 171 }, { 0, 3, 206 }, { 0, 3, 215 }, { 0, 3, 225 }, { 0, 3, 236 }, { 0, 3, 237 }, { 188, 0, 0 }, { 189, 0, 0 },
+        { 193, 0, 0 }, { 196, 0, 0 }, { 200, 0, 0 }, { 203, 0, 0 }, { 209, 0, 0 }, { 216, 0, 0 }, { 224, 0, 0 }, { 238, 1, 0 }
+    },
+    /* state 181 */
+    {
+        { 1, 2, 171 }, { 22, 3, 171 }, { 1, 2, 206 }, { 22, 3, 206 }, { 1, 2, 215 }, { 22, 3, 215 }, { 1, 2, 225 }, { 22, 3, 225 },
+        { 1, 2, 236 }, { 22, 3, 236 }, { 1, 2, 237 }, { 22, 3, 237 }, { 0, 3, 199 }, { 0, 3, 207 }, { 0, 3, 234 }, { 0, 3, 235 }
+    },
+    /* state 182 */
+    {
+        { 2, 2, 171 }, { 9, 2, 171 }, { 23, 2, 171 }, { 40, 3, 171 }, { 2, 2, 206 }, { 9, 2, 206 }, { 23, 2, 206 }, { 40, 3, 206 },
+        { 2, 2, 215 }, { 9, 2, 215 }, { 23, 2, 215 }, { 40, 3, 215 }, { 2, 2, 225 }, { 9, 2, 225 }, { 23, 2, 225 }, { 40, 3, 225 }
+    },
+    /* state 183 */
+    {
+        { 3, 2, 171 }, { 6, 2, 171 }, { 10, 2, 171 }, { 15, 2, 171 }, { 24, 2, 171 }, { 31, 2, 171 }, { 41, 2, 171 }, { 56, 3, 171 },
+        { 3, 2, 206 }, { 6, 2, 206 }, { 10, 2, 206 }, { 15, 2, 206 }, { 24, 2, 206 }, { 31, 2, 206 }, { 41, 2, 206 }, { 56, 3, 206 }
+    },
+    /* state 184 */
+    {
+        { 3, 2, 215 }, { 6, 2, 215 }, { 10, 2, 215 }, { 15, 2, 215 }, { 24, 2, 215 }, { 31, 2, 215 }, { 41, 2, 215 }, { 56, 3, 215 },
+        { 3, 2, 225 }, { 6, 2, 225 }, { 10, 2, 225 }, { 15, 2, 225 }, { 24, 2, 225 }, { 31, 2, 225 }, { 41, 2, 225 }, { 56, 3, 225 }
+    },
+    /* state 185 */
+    {
+        { 2, 2, 236 }, { 9, 2, 236 }, { 23, 2, 236 }, { 40, 3, 236 }, { 2, 2, 237 }, { 9, 2, 237 }, { 23, 2, 237 }, { 40, 3, 237 },
+        { 1, 2, 199 }, { 22, 3, 199 }, { 1, 2, 207 }, { 22, 3, 207 }, { 1, 2, 234 }, { 22, 3, 234 }, { 1, 2, 235 }, { 22, 3, 235 }
+    },
+    /* state 186 */
+    {
+        { 3, 2, 236 }, { 6, 2, 236 }, { 10, 2, 236 }, { 15, 2, 236 }, { 24, 2, 236 }, { 31, 2, 236 }, { 41, 2, 236 }, { 56, 3, 236 },
+        { 3, 2, 237 }, { 6, 2, 237 }, { 10, 2, 237 }, { 15, 2, 237 }, { 24, 2, 237 }, { 31, 2, 237 }, { 41, 2, 237 }, { 56, 3, 237 }
+    },
+    /* state 187 */
+    {
+        { 2, 2, 199 }, { 9, 2, 199 }, { 23, 2, 199 }, { 40, 3, 199 }, { 2, 2, 207 }, { 9, 2, 207 }, { 23, 2, 207 }, { 40, 3, 207 },
+        { 2, 2, 234 }, { 9, 2, 234 }, { 23, 2, 234 }, { 40, 3, 234 }, { 2, 2, 235 }, { 9, 2, 235 }, { 23, 2, 235 }, { 40, 3, 235 }
+    },
+    /* state 188 */
+    {
+        { 3, 2, 199 }, { 6, 2, 199 }, { 10, 2, 199 }, { 15, 2, 199 }, { 24, 2, 199 }, { 31, 2, 199 }, { 41, 2, 199 }, { 56, 3, 199 },
+        { 3, 2, 207 }, { 6, 2, 207 }, { 10, 2, 207 }, { 15, 2, 207 }, { 24, 2, 207 }, { 31, 2, 207 }, { 41, 2, 207 }, { 56, 3, 207 }
+    },
+    /* state 189 */
+    {
+        { 3, 2, 234 }, { 6, 2, 234 }, { 10, 2, 234 }, { 15, 2, 234 }, { 24, 2, 234 }, { 31, 2, 234 }, { 41, 2, 234 }, { 56, 3, 234 },
+        { 3, 2, 235 }, { 6, 2, 235 }, { 10, 2, 235 }, { 15, 2, 235 }, { 24, 2, 235 }, { 31, 2, 235 }, { 41, 2, 235 }, { 56, 3, 235 }
+    },
+    /* state 190 */
+    {
+        { 194, 0, 0 }, { 195, 0, 0 }, { 197, 0, 0 }, { 198, 0, 0 }, { 201, 0, 0 }, { 202, 0, 0 }, { 204, 0, 0 }, { 205, 0, 0 },
+        { 210, 0, 0 }, { 213, 0, 0 }, { 217, 0, 0 }, { 220, 0, 0 }, { 225, 0, 0 }, { 231, 0, 0 }, { 239, 0, 0 }, { 246, 1, 0 }
+    },
+    /* state 191 */
+    {
+        { 0, 3, 192 }, { 0, 3, 193 }, { 0, 3, 200 }, { 0, 3, 201 }, { 0, 3, 202 }, { 0, 3, 205 }, { 0, 3, 210 }, { 0, 3, 213 },
+        { 0, 3, 218 }, { 0, 3, 219 }, { 0, 3, 238 }, { 0, 3, 240 }, { 0, 3, 242 }, { 0, 3, 243 }, { 0, 3, 255 }, { 206, 0, 0 }
+    },
+    /* state 192 */
+    {
+        { 1, 2, 192 }, { 22, 3, 192 }, { 1, 2, 193 }, { 22, 3, 193 }, { 1, 2, 200 }, { 22, 3, 200 }, { 1, 2, 201 }, { 22, 3, 201 },
+        { 1, 2, 202 }, { 22, 3, 202 }, { 1, 2, 205 }, { 22, 3, 205 }, { 1, 2, 210 }, { 22, 3, 210 }, { 1, 2, 213 }, { 22, 3, 213 }
+    },
+    /* state 193 */
+    {
+        { 2, 2, 192 }, { 9, 2, 192 }, { 23, 2, 192 }, { 40, 3, 192 }, { 2, 2, 193 }, { 9, 2, 193 }, { 23, 2, 193 }, { 40, 3, 193 },
+        { 2, 2, 200 }, { 9, 2, 200 }, { 23, 2, 200 }, { 40, 3, 200 }, { 2, 2, 201 }, { 9, 2, 201 }, { 23, 2, 201 }, { 40, 3, 201 }
+    },
+    /* state 194 */
+    {
+        { 3, 2, 192 }, { 6, 2, 192 }, { 10, 2, 192 }, { 15, 2, 192 }, { 24, 2, 192 }, { 31, 2, 192 }, { 41, 2, 192 }, { 56, 3, 192 },
+        { 3, 2, 193 }, { 6, 2, 193 }, { 10, 2, 193 }, { 15, 2, 193 }, { 24, 2, 193 }, { 31, 2, 193 }, { 41, 2, 193 }, { 56, 3, 193 }
+    },
+    /* state 195 */
+    {
+        { 3, 2, 200 }, { 6, 2, 200 }, { 10, 2, 200 }, { 15, 2, 200 }, { 24, 2, 200 }, { 31, 2, 200 }, { 41, 2, 200 }, { 56, 3, 200 },
+        { 3, 2, 201 }, { 6, 2, 201 }, { 10, 2, 201 }, { 15, 2, 201 }, { 24, 2, 201 }, { 31, 2, 201 }, { 41, 2, 201 }, { 56, 3, 201 }
+    },
+    /* state 196 */
+    {
+        { 2, 2, 202 }, { 9, 2, 202 }, { 23, 2, 202 }, { 40, 3, 202 }, { 2, 2, 205 }, { 9, 2, 205 }, { 23, 2, 205 }, { 40, 3, 205 },
+        { 2, 2, 210 }, { 9, 2, 210 }, { 23, 2, 210 }, { 40, 3, 210 }, { 2, 2, 213 }, { 9, 2, 213 }, { 23, 2, 213 }, { 40, 3, 213 }
+    },
+    /* state 197 */
+    {
+        { 3, 2, 202 }, { 6, 2, 202 }, { 10, 2, 202 }, { 15, 2, 202 }, { 24, 2, 202 }, { 31, 2, 202 }, { 41, 2, 202 }, { 56, 3, 202 },
+        { 3, 2, 205 }, { 6, 2, 205 }, { 10, 2, 205 }, { 15, 2, 205 }, { 24, 2, 205 }, { 31, 2, 205 }, { 41, 2, 205 }, { 56, 3, 205 }
+    },
+    /* state 198 */
+    {
+        { 3, 2, 210 }, { 6, 2, 210 }, { 10, 2, 210 }, { 15, 2, 210 }, { 24, 2, 210 }, { 31, 2, 210 }, { 41, 2, 210 }, { 56, 3, 210 },
+        { 3, 2, 213 }, { 6, 2, 213 }, { 10, 2, 213 }, { 15, 2, 213 }, { 24, 2, 213 }, { 31, 2, 213 }, { 41, 2, 213 }, { 56, 3, 213 }
+    },
+    /* state 199 */
+    {
+        { 1, 2, 218 }, { 22, 3, 218 }, { 1, 2, 219 }, { 22, 3, 219 }, { 1, 2, 238 }, { 22, 3, 238 }, { 1, 2, 240 }, { 22, 3, 240 },
+        { 1, 2, 242 }, { 22, 3, 242 }, { 1, 2, 243 }, { 22, 3, 243 }, { 1, 2, 255 }, { 22, 3, 255 }, { 0, 3, 203 }, { 0, 3, 204 }
+    },
+    /* state 200 */
+    {
+        { 2, 2, 218 }, { 9, 2, 218 }, { 23, 2, 218 }, { 40, 3, 218 }, { 2, 2, 219 }, { 9, 2, 219 }, { 23, 2, 219 }, { 40, 3, 219 },
+        { 2, 2, 238 }, { 9, 2, 238 }, { 23, 2, 238 }, { 40, 3, 238 }, { 2, 2, 240 }, { 9, 2, 240 }, { 23, 2, 240 }, { 40, 3, 240 }
+    },
+    /* state 201 */
+    {
+        { 3, 2, 218 }, { 6, 2, 218 }, { 10, 2, 218 }, { 15, 2, 218 }, { 24, 2, 218 }, { 31, 2, 218 }, { 41, 2, 218 }, { 56, 3, 218 },
+        { 3, 2, 219 }, { 6, 2, 219 }, { 10, 2, 219 }, { 15, 2, 219 }, { 24, 2, 219 }, { 31, 2, 219 }, { 41, 2, 219 }, { 56, 3, 219 }
+    },
+    /* state 202 */
+    {
+        { 3, 2, 238 }, { 6, 2, 238 }, { 10, 2, 238 }, { 15, 2, 238 }, { 24, 2, 238 }, { 31, 2, 238 }, { 41, 2, 238 }, { 56, 3, 238 },
+        { 3, 2, 240 }, { 6, 2, 240 }, { 10, 2, 240 }, { 15, 2, 240 }, { 24, 2, 240 }, { 31, 2, 240 }, { 41, 2, 240 }, { 56, 3, 240 }
+    },
+    /* state 203 */
+    {
+        { 2, 2, 242 }, { 9, 2, 242 }, { 23, 2, 242 }, { 40, 3, 242 }, { 2, 2, 243 }, { 9, 2, 243 }, { 23, 2, 243 }, { 40, 3, 243 },
+        { 2, 2, 255 }, { 9, 2, 255 }, { 23, 2, 255 }, { 40, 3, 255 }, { 1, 2, 203 }, { 22, 3, 203 }, { 1, 2, 204 }, { 22, 3, 204 }
+    },
+    /* state 204 */
+    {
+        { 3, 2, 242 }, { 6, 2, 242 }, { 10, 2, 242 }, { 15, 2, 242 }, { 24, 2, 242 }, { 31, 2, 242 }, { 41, 2, 242 }, { 56, 3, 242 },
+        { 3, 2, 243 }, { 6, 2, 243 }, { 10, 2, 243 }, { 15, 2, 243 }, { 24, 2, 243 }, { 31, 2, 243 }, { 41, 2, 243 }, { 56, 3, 243 }
+    },
+    /* state 205 */
+    {
+        { 3, 2, 255 }, { 6, 2, 255 }, { 10, 2, 255 }, { 15, 2, 255 }, { 24, 2, 255 }, { 31, 2, 255 }, { 41, 2, 255 }, { 56, 3, 255 },
+        { 2, 2, 203 }, { 9, 2, 203 }, { 23, 2, 203 }, { 40, 3, 203 }, { 2, 2, 204 }, { 9, 2, 204 }, { 23, 2, 204 }, { 40, 3, 204 }
+    },
+    /* state 206 */
+    {
+        { 3, 2, 203 }, { 6, 2, 203 }, { 10, 2, 203 }, { 15, 2, 203 }, { 24, 2, 203 }, { 31, 2, 203 }, { 41, 2, 203 }, { 56, 3, 203 },
+        { 3, 2, 204 }, { 6, 2, 204 }, { 10, 2, 204 }, { 15, 2, 204 }, { 24, 2, 204 }, { 31, 2, 204 }, { 41, 2, 204 }, { 56, 3, 204 }
+    },
+    /* state 207 */
+    {
+        { 211, 0, 0 }, { 212, 0, 0 }, { 214, 0, 0 }, { 215, 0, 0 }, { 218, 0, 0 }, { 219, 0, 0 }, { 221, 0, 0 }, { 222, 0, 0 },
+        { 226, 0, 0 }, { 228, 0, 0 }, { 232, 0, 0 }, { 235, 0, 0 }, { 240, 0, 0 }, { 243, 0, 0 }, { 247, 0, 0 }, { 250, 1, 0 }
+    },
+    /* state 208 */
+    {
+        { 0, 3, 211 }, { 0, 3, 212 }, { 0, 3, 214 }, { 0, 3, 221 }, { 0, 3, 222 }, { 0, 3, 223 }, { 0, 3, 241 }, { 0, 3, 244 },
+        { 0, 3, 245 }, { 0, 3, 246 }, { 0, 3, 247 }, { 0, 3, 248 }, { 0, 3, 250 }, { 0, 3, 251 }, { 0, 3, 252 }, { 0, 3, 253 }
+    },
+    /* state 209 */
+    {
+        { 1, 2, 211 }, { 22, 3, 211 }, { 1, 2, 212 }, { 22, 3, 212 }, { 1, 2, 214 }, { 22, 3, 214 }, { 1, 2, 221 }, { 22, 3, 221 },
+        { 1, 2, 222 }, { 22, 3, 222 }, { 1, 2, 223 }, { 22, 3, 223 }, { 1, 2, 241 }, { 22, 3, 241 }, { 1, 2, 244 }, { 22, 3, 244 }
+    },
+    /* state 210 */
+    {
+        { 2, 2, 211 }, { 9, 2, 211 }, { 23, 2, 211 }, { 40, 3, 211 }, { 2, 2, 212 }, { 9, 2, 212 }, { 23, 2, 212 }, { 40, 3, 212 },
+        { 2, 2, 214 }, { 9, 2, 214 }, { 23, 2, 214 }, { 40, 3, 214 }, { 2, 2, 221 }, { 9, 2, 221 }, { 23, 2, 221 }, { 40, 3, 221 }
+    },
+    /* state 211 */
+    {
+        { 3, 2, 211 }, { 6, 2, 211 }, { 10, 2, 211 }, { 15, 2, 211 }, { 24, 2, 211 }, { 31, 2, 211 }, { 41, 2, 211 }, { 56, 3, 211 },
+        { 3, 2, 212 }, { 6, 2, 212 }, { 10, 2, 212 }, { 15, 2, 212 }, { 24, 2, 212 }, { 31, 2, 212 }, { 41, 2, 212 }, { 56, 3, 212 }
+    },
+    /* state 212 */
+    {
+        { 3, 2, 214 }, { 6, 2, 214 }, { 10, 2, 214 }, { 15, 2, 214 }, { 24, 2, 214 }, { 31, 2, 214 }, { 41, 2, 214 }, { 56, 3, 214 },
+        { 3, 2, 221 }, { 6, 2, 221 }, { 10, 2, 221 }, { 15, 2, 221 }, { 24, 2, 221 }, { 31, 2, 221 }, { 41, 2, 221 }, { 56, 3, 221 }
+    },
+    /* state 213 */
+    {
+        { 2, 2, 222 }, { 9, 2, 222 }, { 23, 2, 222 }, { 40, 3, 222 }, { 2, 2, 223 }, { 9, 2, 223 }, { 23, 2, 223 }, { 40, 3, 223 },
+        { 2, 2, 241 }, { 9, 2, 241 }, { 23, 2, 241 }, { 40, 3, 241 }, { 2, 2, 244 }, { 9, 2, 244 }, { 23, 2, 244 }, { 40, 3, 244 }
+    },
+    /* state 214 */
+    {
+        { 3, 2, 222 }, { 6, 2, 222 }, { 10, 2, 222 }, { 15, 2, 222 }, { 24, 2, 222 }, { 31, 2, 222 }, { 41, 2, 222 }, { 56, 3, 222 },
+        { 3, 2, 223 }, { 6, 2, 223 }, { 10, 2, 223 }, { 15, 2, 223 }, { 24, 2, 223 }, { 31, 2, 223 }, { 41, 2, 223 }, { 56, 3, 223 }
+    },
+    /* state 215 */
+    {
+        { 3, 2, 241 }, { 6, 2, 241 }, { 10, 2, 241 }, { 15, 2, 241 }, { 24, 2, 241 }, { 31, 2, 241 }, { 41, 2, 241 }, { 56, 3, 241 },
+        { 3, 2, 244 }, { 6, 2, 244 }, { 10, 2, 244 }, { 15, 2, 244 }, { 24, 2, 244 }, { 31, 2, 244 }, { 41, 2, 244 }, { 56, 3, 244 }
+    },
+    /* state 216 */
+    {
+        { 1, 2, 245 }, { 22, 3, 245 }, { 1, 2, 246 }, { 22, 3, 246 }, { 1, 2, 247 }, { 22, 3, 247 }, { 1, 2, 248 }, { 22, 3, 248 },
+        { 1, 2, 250 }, { 22, 3, 250 }, { 1, 2, 251 }, { 22, 3, 251 }, { 1, 2, 252 }, { 22, 3, 252 }, { 1, 2, 253 }, { 22, 3, 253 }
+    },
+    /* state 217 */
+    {
+        { 2, 2, 245 }, { 9, 2, 245 }, { 23, 2, 245 }, { 40, 3, 245 }, { 2, 2, 246 }, { 9, 2, 246 }, { 23, 2, 246 }, { 40, 3, 246 },
+        { 2, 2, 247 }, { 9, 2, 247 }, { 23, 2, 247 }, { 40, 3, 247 }, { 2, 2, 248 }, { 9, 2, 248 }, { 23, 2, 248 }, { 40, 3, 248 }
+    },
+    /* state 218 */
+    {
+        { 3, 2, 245 }, { 6, 2, 245 }, { 10, 2, 245 }, { 15, 2, 245 }, { 24, 2, 245 }, { 31, 2, 245 }, { 41, 2, 245 }, { 56, 3, 245 },
+        { 3, 2, 246 }, { 6, 2, 246 }, { 10, 2, 246 }, { 15, 2, 246 }, { 24, 2, 246 }, { 31, 2, 246 }, { 41, 2, 246 }, { 56, 3, 246 }
+    },
+    /* state 219 */
+    {
+        { 3, 2, 247 }, { 6, 2, 247 }, { 10, 2, 247 }, { 15, 2, 247 }, { 24, 2, 247 }, { 31, 2, 247 }, { 41, 2, 247 }, { 56, 3, 247 },
+        { 3, 2, 248 }, { 6, 2, 248 }, { 10, 2, 248 }, { 15, 2, 248 }, { 24, 2, 248 }, { 31, 2, 248 }, { 41, 2, 248 }, { 56, 3, 248 }
+    },
+    /* state 220 */
+    {
+        { 2, 2, 250 }, { 9, 2, 250 }, { 23, 2, 250 }, { 40, 3, 250 }, { 2, 2, 251 }, { 9, 2, 251 }, { 23, 2, 251 }, { 40, 3, 251 },
+        { 2, 2, 252 }, { 9, 2, 252 }, { 23, 2, 252 }, { 40, 3, 252 }, { 2, 2, 253 }, { 9, 2, 253 }, { 23, 2, 253 }, { 40, 3, 253 }
+    },
+    /* state 221 */
+    {
+        { 3, 2, 250 }, { 6, 2, 250 }, { 10, 2, 250 }, { 15, 2, 250 }, { 24, 2, 250 }, { 31, 2, 250 }, { 41, 2, 250 }, { 56, 3, 250 },
+        { 3, 2, 251 }, { 6, 2, 251 }, { 10, 2, 251 }, { 15, 2, 251 }, { 24, 2, 251 }, { 31, 2, 251 }, { 41, 2, 251 }, { 56, 3, 251 }
+    },
+    /* state 222 */
+    {
+        { 3, 2, 252 }, { 6, 2, 252 }, { 10, 2, 252 }, { 15, 2, 252 }, { 24, 2, 252 }, { 31, 2, 252 }, { 41, 2, 252 }, { 56, 3, 252 },
+        { 3, 2, 253 }, { 6, 2, 253 }, { 10, 2, 253 }, { 15, 2, 253 }, { 24, 2, 253 }, { 31, 2, 253 }, { 41, 2, 253 }, { 56, 3, 253 }
+    },
+    /* state 223 */
+    {
+        { 0, 3, 254 }, { 227, 0, 0 }, { 229, 0, 0 }, { 230, 0, 0 }, { 233, 0, 0 }, { 234, 0, 0 }, { 236, 0, 0 }, { 237, 0, 0 },
+        { 241, 0, 0 }, { 242, 0, 0 }, { 244, 0, 0 }, { 245, 0, 0 }, { 248, 0, 0 }, { 249, 0, 0 }, { 251, 0, 0 }, { 252, 1, 0 }
+    },
+    /* state 224 */
+    {
+        { 1, 2, 254 }, { 22, 3, 254 }, { 0, 3, 2 }, { 0, 3, 3 }, { 0, 3, 4 }, { 0, 3, 5 }, { 0, 3, 6 }, { 0, 3, 7 },
+        { 0, 3, 8 }, { 0, 3, 11 }, { 0, 3, 12 }, { 0, 3, 14 }, { 0, 3, 15 }, { 0, 3, 16 }, { 0, 3, 17 }, { 0, 3, 18 }
+    },
+    /* state 225 */
+    {
+        { 2, 2, 254 }, { 9, 2, 254 }, { 23, 2, 254 }, { 40, 3, 254 }, { 1, 2, 2 }, { 22, 3, 2 }, { 1, 2, 3 }, { 22, 3, 3 },
+        { 1, 2, 4 }, { 22, 3, 4 }, { 1, 2, 5 }, { 22, 3, 5 }, { 1, 2, 6 }, { 22, 3, 6 }, { 1, 2, 7 }, { 22, 3, 7 }
+    },
+    /* state 226 */
+    {
+        { 3, 2, 254 }, { 6, 2, 254 }, { 10, 2, 254 }, { 15, 2, 254 }, { 24, 2, 254 }, { 31, 2, 254 }, { 41, 2, 254 }, { 56, 3, 254 },
+        { 2, 2, 2 }, { 9, 2, 2 }, { 23, 2, 2 }, { 40, 3, 2 }, { 2, 2, 3 }, { 9, 2, 3 }, { 23, 2, 3 }, { 40, 3, 3 }
+    },
+    /* state 227 */
+    {
+        { 3, 2, 2 }, { 6, 2, 2 }, { 10, 2, 2 }, { 15, 2, 2 }, { 24, 2, 2 }, { 31, 2, 2 }, { 41, 2, 2 }, { 56, 3, 2 },
+        { 3, 2, 3 }, { 6, 2, 3 }, { 10, 2, 3 }, { 15, 2, 3 }, { 24, 2, 3 }, { 31, 2, 3 }, { 41, 2, 3 }, { 56, 3, 3 }
+    },
+    /* state 228 */
+    {
+        { 2, 2, 4 }, { 9, 2, 4 }, { 23, 2, 4 }, { 40, 3, 4 }, { 2, 2, 5 }, { 9, 2, 5 }, { 23, 2, 5 }, { 40, 3, 5 },
+        { 2, 2, 6 }, { 9, 2, 6 }, { 23, 2, 6 }, { 40, 3, 6 }, { 2, 2, 7 }, { 9, 2, 7 }, { 23, 2, 7 }, { 40, 3, 7 }
+    },
+    /* state 229 */
+    {
+        { 3, 2, 4 }, { 6, 2, 4 }, { 10, 2, 4 }, { 15, 2, 4 }, { 24, 2, 4 }, { 31, 2, 4 }, { 41, 2, 4 }, { 56, 3, 4 },
+        { 3, 2, 5 }, { 6, 2, 5 }, { 10, 2, 5 }, { 15, 2, 5 }, { 24, 2, 5 }, { 31, 2, 5 }, { 41, 2, 5 }, { 56, 3, 5 }
+    },
+    /* state 230 */
+    {
+        { 3, 2, 6 }, { 6, 2, 6 }, { 10, 2, 6 }, { 15, 2, 6 }, { 24, 2, 6 }, { 31, 2, 6 }, { 41, 2, 6 }, { 56, 3, 6 },
+        { 3, 2, 7 }, { 6, 2, 7 }, { 10, 2, 7 }, { 15, 2, 7 }, { 24, 2, 7 }, { 31, 2, 7 }, { 41, 2, 7 }, { 56, 3, 7 }
+    },
+    /* state 231 */
+    {
+        { 1, 2, 8 }, { 22, 3, 8 }, { 1, 2, 11 }, { 22, 3, 11 }, { 1, 2, 12 }, { 22, 3, 12 }, { 1, 2, 14 }, { 22, 3, 14 },
+        { 1, 2, 15 }, { 22, 3, 15 }, { 1, 2, 16 }, { 22, 3, 16 }, { 1, 2, 17 }, { 22, 3, 17 }, { 1, 2, 18 }, { 22, 3, 18 }
+    },
+    /* state 232 */
+    {
+        { 2, 2, 8 }, { 9, 2, 8 }, { 23, 2, 8 }, { 40, 3, 8 }, { 2, 2, 11 }, { 9, 2, 11 }, { 23, 2, 11 }, { 40, 3, 11 },
+        { 2, 2, 12 }, { 9, 2, 12 }, { 23, 2, 12 }, { 40, 3, 12 }, { 2, 2, 14 }, { 9, 2, 14 }, { 23, 2, 14 }, { 40, 3, 14 }
+    },
+    /* state 233 */
+    {
+        { 3, 2, 8 }, { 6, 2, 8 }, { 10, 2, 8 }, { 15, 2, 8 }, { 24, 2, 8 }, { 31, 2, 8 }, { 41, 2, 8 }, { 56, 3, 8 },
+        { 3, 2, 11 }, { 6, 2, 11 }, { 10, 2, 11 }, { 15, 2, 11 }, { 24, 2, 11 }, { 31, 2, 11 }, { 41, 2, 11 }, { 56, 3, 11 }
+    },
+    /* state 234 */
+    {
+        { 3, 2, 12 }, { 6, 2, 12 }, { 10, 2, 12 }, { 15, 2, 12 }, { 24, 2, 12 }, { 31, 2, 12 }, { 41, 2, 12 }, { 56, 3, 12 },
+        { 3, 2, 14 }, { 6, 2, 14 }, { 10, 2, 14 }, { 15, 2, 14 }, { 24, 2, 14 }, { 31, 2, 14 }, { 41, 2, 14 }, { 56, 3, 14 }
+    },
+    /* state 235 */
+    {
+        { 2, 2, 15 }, { 9, 2, 15 }, { 23, 2, 15 }, { 40, 3, 15 }, { 2, 2, 16 }, { 9, 2, 16 }, { 23, 2, 16 }, { 40, 3, 16 },
+        { 2, 2, 17 }, { 9, 2, 17 }, { 23, 2, 17 }, { 40, 3, 17 }, { 2, 2, 18 }, { 9, 2, 18 }, { 23, 2, 18 }, { 40, 3, 18 }
+    },
+    /* state 236 */
+    {
+        { 3, 2, 15 }, { 6, 2, 15 }, { 10, 2, 15 }, { 15, 2, 15 }, { 24, 2, 15 }, { 31, 2, 15 }, { 41, 2, 15 }, { 56, 3, 15 },
+        { 3, 2, 16 }, { 6, 2, 16 }, { 10, 2, 16 }, { 15, 2, 16 }, { 24, 2, 16 }, { 31, 2, 16 }, { 41, 2, 16 }, { 56, 3, 16 }
+    },
+    /* state 237 */
+    {
+        { 3, 2, 17 }, { 6, 2, 17 }, { 10, 2, 17 }, { 15, 2, 17 }, { 24, 2, 17 }, { 31, 2, 17 }, { 41, 2, 17 }, { 56, 3, 17 },
+        { 3, 2, 18 }, { 6, 2, 18 }, { 10, 2, 18 }, { 15, 2, 18 }, { 24, 2, 18 }, { 31, 2, 18 }, { 41, 2, 18 }, { 56, 3, 18 }
+    },
+    /* state 238 */
+    {
+        { 0, 3, 19 }, { 0, 3, 20 }, { 0, 3, 21 }, { 0, 3, 23 }, { 0, 3, 24 }, { 0, 3, 25 }, { 0, 3, 26 }, { 0, 3, 27 },
+        { 0, 3, 28 }, { 0, 3, 29 }, { 0, 3, 30 }, { 0, 3, 31 }, { 0, 3, 127 }, { 0, 3, 220 }, { 0, 3, 249 }, { 253, 1, 0 }
+    },
+    /* state 239 */
+    {
+        { 1, 2, 19 }, { 22, 3, 19 }, { 1, 2, 20 }, { 22, 3, 20 }, { 1, 2, 21 }, { 22, 3, 21 }, { 1, 2, 23 }, { 22, 3, 23 },
+        { 1, 2, 24 }, { 22, 3, 24 }, { 1, 2, 25 }, { 22, 3, 25 }, { 1, 2, 26 }, { 22, 3, 26 }, { 1, 2, 27 }, { 22, 3, 27 }
+    },
+    /* state 240 */
+    {
+        { 2, 2, 19 }, { 9, 2, 19 }, { 23, 2, 19 }, { 40, 3, 19 }, { 2, 2, 20 }, { 9, 2, 20 }, { 23, 2, 20 }, { 40, 3, 20 },
+        { 2, 2, 21 }, { 9, 2, 21 }, { 23, 2, 21 }, { 40, 3, 21 }, { 2, 2, 23 }, { 9, 2, 23 }, { 23, 2, 23 }, { 40, 3, 23 }
+    },
+    /* state 241 */
+    {
+        { 3, 2, 19 }, { 6, 2, 19 }, { 10, 2, 19 }, { 15, 2, 19 }, { 24, 2, 19 }, { 31, 2, 19 }, { 41, 2, 19 }, { 56, 3, 19 },
+        { 3, 2, 20 }, { 6, 2, 20 }, { 10, 2, 20 }, { 15, 2, 20 }, { 24, 2, 20 }, { 31, 2, 20 }, { 41, 2, 20 }, { 56, 3, 20 }
+    },
+    /* state 242 */
+    {
+        { 3, 2, 21 }, { 6, 2, 21 }, { 10, 2, 21 }, { 15, 2, 21 }, { 24, 2, 21 }, { 31, 2, 21 }, { 41, 2, 21 }, { 56, 3, 21 },
+        { 3, 2, 23 }, { 6, 2, 23 }, { 10, 2, 23 }, { 15, 2, 23 }, { 24, 2, 23 }, { 31, 2, 23 }, { 41, 2, 23 }, { 56, 3, 23 }
+    },
+    /* state 243 */
+    {
+        { 2, 2, 24 }, { 9, 2, 24 }, { 23, 2, 24 }, { 40, 3, 24 }, { 2, 2, 25 }, { 9, 2, 25 }, { 23, 2, 25 }, { 40, 3, 25 },
+        { 2, 2, 26 }, { 9, 2, 26 }, { 23, 2, 26 }, { 40, 3, 26 }, { 2, 2, 27 }, { 9, 2, 27 }, { 23, 2, 27 }, { 40, 3, 27 }
+    },
+    /* state 244 */
+    {
+        { 3, 2, 24 }, { 6, 2, 24 }, { 10, 2, 24 }, { 15, 2, 24 }, { 24, 2, 24 }, { 31, 2, 24 }, { 41, 2, 24 }, { 56, 3, 24 },
+        { 3, 2, 25 }, { 6, 2, 25 }, { 10, 2, 25 }, { 15, 2, 25 }, { 24, 2, 25 }, { 31, 2, 25 }, { 41, 2, 25 }, { 56, 3, 25 }
+    },
+    /* state 245 */
+    {
+        { 3, 2, 26 }, { 6, 2, 26 }, { 10, 2, 26 }, { 15, 2, 26 }, { 24, 2, 26 }, { 31, 2, 26 }, { 41, 2, 26 }, { 56, 3, 26 },
+        { 3, 2, 27 }, { 6, 2, 27 }, { 10, 2, 27 }, { 15, 2, 27 }, { 24, 2, 27 }, { 31, 2, 27 }, { 41, 2, 27 }, { 56, 3, 27 }
+    },
+    /* state 246 */
+    {
+        { 1, 2, 28 }, { 22, 3, 28 }, { 1, 2, 29 }, { 22, 3, 29 }, { 1, 2, 30 }, { 22, 3, 30 }, { 1, 2, 31 }, { 22, 3, 31 },
+        { 1, 2, 127 }, { 22, 3, 127 }, { 1, 2, 220 }, { 22, 3, 220 }, { 1, 2, 249 }, { 22, 3, 249 }, { 254, 0, 0 }, { 255, 1, 0 }
+    },
+    /* state 247 */
+    {
+        { 2, 2, 28 }, { 9, 2, 28 }, { 23, 2, 28 }, { 40, 3, 28 }, { 2, 2, 29 }, { 9, 2, 29 }, { 23, 2, 29 }, { 40, 3, 29 },
+        { 2, 2, 30 }, { 9, 2, 30 }, { 23, 2, 30 }, { 40, 3, 30 }, { 2, 2, 31 }, { 9, 2, 31 }, { 23, 2, 31 }, { 40, 3, 31 }
+    },
+    /* state 248 */
+    {
+        { 3, 2, 28 }, { 6, 2, 28 }, { 10, 2, 28 }, { 15, 2, 28 }, { 24, 2, 28 }, { 31, 2, 28 }, { 41, 2, 28 }, { 56, 3, 28 },
+        { 3, 2, 29 }, { 6, 2, 29 }, { 10, 2, 29 }, { 15, 2, 29 }, { 24, 2, 29 }, { 31, 2, 29 }, { 41, 2, 29 }, { 56, 3, 29 }
+    },
+    /* state 249 */
+    {
+        { 3, 2, 30 }, { 6, 2, 30 }, { 10, 2, 30 }, { 15, 2, 30 }, { 24, 2, 30 }, { 31, 2, 30 }, { 41, 2, 30 }, { 56, 3, 30 },
+        { 3, 2, 31 }, { 6, 2, 31 }, { 10, 2, 31 }, { 15, 2, 31 }, { 24, 2, 31 }, { 31, 2, 31 }, { 41, 2, 31 }, { 56, 3, 31 }
+    },
+    /* state 250 */
+    {
+        { 2, 2, 127 }, { 9, 2, 127 }, { 23, 2, 127 }, { 40, 3, 127 }, { 2, 2, 220 }, { 9, 2, 220 }, { 23, 2, 220 }, { 40, 3, 220 },
+        { 2, 2, 249 }, { 9, 2, 249 }, { 23, 2, 249 }, { 40, 3, 249 }, { 0, 3, 10 }, { 0, 3, 13 }, { 0, 3, 22 }, { 0, 4, 0 }
+    },
+    /* state 251 */
+    {
+        { 3, 2, 127 }, { 6, 2, 127 }, { 10, 2, 127 }, { 15, 2, 127 }, { 24, 2, 127 }, { 31, 2, 127 }, { 41, 2, 127 }, { 56, 3, 127 },
+        { 3, 2, 220 }, { 6, 2, 220 }, { 10, 2, 220 }, { 15, 2, 220 }, { 24, 2, 220 }, { 31, 2, 220 }, { 41, 2, 220 }, { 56, 3, 220 }
+    },
+    /* state 252 */
+    {
+        { 3, 2, 249 }, { 6, 2, 249 }, { 10, 2, 249 }, { 15, 2, 249 }, { 24, 2, 249 }, { 31, 2, 249 }, { 41, 2, 249 }, { 56, 3, 249 },
+        { 1, 2, 10 }, { 22, 3, 10 }, { 1, 2, 13 }, { 22, 3, 13 }, { 1, 2, 22 }, { 22, 3, 22 }, { 0, 4, 0 }, { 0, 4, 0 }
+    },
+    /* state 253 */
+    {
+        { 2, 2, 10 }, { 9, 2, 10 }, { 23, 2, 10 }, { 40, 3, 10 }, { 2, 2, 13 }, { 9, 2, 13 }, { 23, 2, 13 }, { 40, 3, 13 },
+        { 2, 2, 22 }, { 9, 2, 22 }, { 23, 2, 22 }, { 40, 3, 22 }, { 0, 4, 0 }, { 0, 4, 0 }, { 0, 4, 0 }, { 0, 4, 0 }
+    },
+    /* state 254 */
+    {
+        { 3, 2, 10 }, { 6, 2, 10 }, { 10, 2, 10 }, { 15, 2, 10 }, { 24, 2, 10 }, { 31, 2, 10 }, { 41, 2, 10 }, { 56, 3, 10 },
+        { 3, 2, 13 }, { 6, 2, 13 }, { 10, 2, 13 }, { 15, 2, 13 }, { 24, 2, 13 }, { 31, 2, 13 }, { 41, 2, 13 }, { 56, 3, 13 }
+    },
+    /* state 255 */
+    {
+        { 3, 2, 22 }, { 6, 2, 22 }, { 10, 2, 22 }, { 15, 2, 22 }, { 24, 2, 22 }, { 31, 2, 22 }, { 41, 2, 22 }, { 56, 3, 22 },
+        { 0, 4, 0 }, { 0, 4, 0 }, { 0, 4, 0 }, { 0, 4, 0 }, { 0, 4, 0 }, { 0, 4, 0 }, { 0, 4, 0 }, { 0, 4, 0 }
+    }
 };
 
+size_t h3zero_qpack_huffman_length(uint8_t const* bytes, size_t length)
+{
+    uint64_t nb_bits = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        nb_bits += h3zero_qpack_huffman_code[bytes[i]].nb_bits;
+    }
+
+    return (size_t)((nb_bits + 7) >> 3);
+}
+
+uint8_t* h3zero_qpack_huffman_encode(uint8_t* bytes, uint8_t* bytes_max, uint8_t const* s, size_t s_length)
+{
+    uint64_t acc = 0;
+    int nb_bits = 0;
+
+    if (bytes == NULL || bytes + h3zero_qpack_huffman_length(s, s_length) > bytes_max) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < s_length; i++) {
+        const h3zero_qpack_huffman_code_t* code = &h3zero_qpack_huffman_code[s[i]];
+
+        acc = (acc << code->nb_bits) | code->code;
+        nb_bits += code->nb_bits;
+        while (nb_bits >= 8) {
+            nb_bits -= 8;
+            *bytes++ = (uint8_t)(acc >> nb_bits);
+        }
+    }
+    if (nb_bits > 0) {
+        *bytes++ = (uint8_t)((acc << (8 - nb_bits)) | (0xFF >> nb_bits));
+    }
+
+    return bytes;
+}
+
+/* As required by RFC 7541 section 5.2, the padding must be a prefix of
+ * the EOS code, i.e., all ones, and shorter than 8 bits. Since all codes
+ * are at least 5 bits long, the padding is shorter than 8 bits if and only
+ * if the last byte completes a symbol. The EOS code is an error.
+ */
 int hzero_qpack_huffman_decode(uint8_t* bytes, uint8_t* bytes_max, uint8_t* decoded, size_t max_decoded, size_t* nb_decoded)
 {
     int ret = 0;
-    uint64_t val_in = 0;
-    int bits_in = 0;
     size_t decoded_index = 0;
-    int index = 0;
-    int was_all_ones = 1;
-
-    while (1) {
-        /* Refill the registry */
-        int bit;
-        int index_64 = index >> 3;
-        int b_index = 7 - (index & 7);
-
-        while (bits_in < 57 && bytes < bytes_max) {
-            uint64_t added = *bytes++;
-            int shift = 64 - bits_in - 8;
-            added <<= shift;
-            val_in |= added;
-            bits_in += 8;
-        }
-
-        if ((h3zero_qpack_huffman_bit[index_64] >> b_index) & 1) {
-            /* This is an index location */
-            if (bits_in <= 0) {
-                /* Reached the end of the input! */
-                break;
-            }
-            bit = (val_in >> 63) & 1;
-            val_in <<= 1;
-            bits_in--;
-            if (bit) {
-                index += h3zero_qpack_huffman_val[index];
-            }
-            else {
-                index++;
-                was_all_ones = 0;
-            }
-            if (index >= 512) {
-                /* End of string marked by all ones */
+    uint8_t state = 0;
+    uint8_t flags = H3ZERO_QPACK_HUFFMAN_ACCEPTED;
+    int is_symbol_in_byte = 1;
+
+    while (bytes < bytes_max) {
+        const h3zero_qpack_huffman_step_t* step = &h3zero_qpack_huffman_step[state][*bytes >> 4];
+
+        is_symbol_in_byte = 0;
+
+        if (step->flags & H3ZERO_QPACK_HUFFMAN_FAIL) {
+            ret = -1;
+            break;
+        }
+        if (step->flags & H3ZERO_QPACK_HUFFMAN_SYMBOL) {
+            if (decoded_index >= max_decoded) {
+                ret = -1;
                 break;
             }
+            decoded[decoded_index++] = step->symbol;
+            is_symbol_in_byte = 1;
         }
-        else if (decoded_index < max_decoded){
-            decoded[decoded_index++] = h3zero_qpack_huffman_val[index];
-            index = 0;
-            was_all_ones = 1;
-        }
-        else
-        {
-            /* input is too long */
-            was_all_ones = 1;
+        step = &h3zero_qpack_huffman_step[step->state][*bytes & 0x0F];
+        if (step->flags & H3ZERO_QPACK_HUFFMAN_FAIL) {
+            ret = -1;
             break;
         }
+        if (step->flags & H3ZERO_QPACK_HUFFMAN_SYMBOL) {
+            if (decoded_index >= max_decoded) {
+                ret = -1;
+                break;
+            }
+            decoded[decoded_index++] = step->symbol;
+            is_symbol_in_byte = 1;
+        }
+        state = step->state;
+        flags = step->flags;
+        bytes++;
     }
 
-    /* Error if break and not all ones before that */
-    if (!was_all_ones) {
+    if (ret == 0 && ((flags & H3ZERO_QPACK_HUFFMAN_ACCEPTED) == 0 || !is_symbol_in_byte)) {
+        /* The input ends in the middle of a code, or the padding is 8 bits or longer */
         ret = -1;
     }
 
@@ -62,14 +62,16 @@ typedef enum {
     h3zero_frame_max_push_id = 0xd,
     h3zero_frame_reserved_base = 0xb,
     h3zero_frame_reserved_delta = 0x1f,
-    h3zero_frame_webtransport_stream = 0x41
+    h3zero_frame_webtransport_stream = 0x41,
+    h3zero_frame_priority_update_request = 0xF0700,
+    h3zero_frame_priority_update_push = 0xF0701
 } h3zero_frame_type_enum_t;
 
 typedef enum {
     h3zero_stream_type_control = 0,
     h3zero_stream_type_push = 1, /* Push type not supported in h3zero settings */
-    h3zero_stream_type_qpack_encoder = 2, /* not required since not using dynamic table */
-    h3zero_stream_type_qpack_decoder = 3, /* not required since not using dynamic table */
+    h3zero_stream_type_qpack_encoder = 2, /* carries encoder instructions, see h3zero_qpack_encoder_t */
+    h3zero_stream_type_qpack_decoder = 3, /* carries decoder instructions, see h3zero_qpack_decoder_t */
     h3zero_stream_type_webtransport = 0x54 /* unidir stream is used as specified in web transport */
 } h3zero_stream_type_enum;
 
@@ -128,6 +130,7 @@ typedef enum {
     http_header_user_agent,
     http_header_x_forwarded_for,
     http_header_x_frame_options,
+    http_header_priority,
 	http_header_max
 } http_header_enum_t;
 
@@ -187,7 +190,12 @@ typedef struct st_h3zero_header_parts_t {
     h3zero_content_type_enum content_type;
     uint8_t const * protocol;
     size_t protocol_length;
+    uint8_t urgency;
+    struct st_h3zero_frame_pool_t* frame_pool; /* if set, the path is copied into a pool buffer */
     unsigned int path_is_huffman : 1;
+    unsigned int path_is_pooled : 1;
+    unsigned int incremental : 1;
+    unsigned int priority_found : 1;
 } h3zero_header_parts_t;
 
 /* Setting codes. */
@@ -222,6 +230,7 @@ uint8_t * h3zero_qpack_int_decode(uint8_t * bytes, uint8_t * bytes_max,
 
 uint8_t * h3zero_parse_qpack_header_frame(uint8_t * bytes, uint8_t * bytes_max,
     h3zero_header_parts_t * parts);
+char const * h3zero_get_header_name(http_header_enum_t header);
 uint8_t * h3zero_create_request_header_frame(uint8_t * bytes, uint8_t * bytes_max,
     uint8_t const * path, size_t path_length, char const * host);
 uint8_t* h3zero_create_request_header_frame_ex(uint8_t* bytes, uint8_t* bytes_max,
@@ -244,16 +253,200 @@ uint8_t* h3zero_create_not_found_header_frame_ex(uint8_t* bytes, uint8_t* bytes_
 uint8_t * h3zero_create_bad_method_header_frame(uint8_t * bytes, uint8_t * bytes_max);
 uint8_t* h3zero_create_bad_method_header_frame_ex(uint8_t* bytes, uint8_t* bytes_max, char const* server_string);
 
+/* Extensible priorities (RFC 9218).
+ * The priority header field and the PRIORITY_UPDATE frames carry a
+ * structured field dictionary with an urgency "u" from 0 (most urgent)
+ * to 7, and an incremental flag "i". Members that cannot be understood
+ * are ignored; if the field cannot be parsed, the defaults apply.
+ *
+ * The urgency is mapped onto the picoquic stream priorities, in which
+ * lower values are scheduled first, odd values are served in FIFO order
+ * and even values in round robin. Urgency u maps to 2u+3, or to 2u+2 if
+ * incremental. The default, urgency 3 not incremental, maps to 9, the
+ * default picoquic priority, and all values remain larger than those of
+ * the control and QPACK streams.
+ */
+#define H3ZERO_PRIORITY_URGENCY_DEFAULT 3
+#define H3ZERO_PRIORITY_URGENCY_MAX 7
+
+int h3zero_parse_priority_field(const uint8_t* value, size_t value_length, uint8_t* urgency, int* incremental);
+size_t h3zero_format_priority_field(char* buf, size_t buf_size, uint8_t urgency, int incremental);
+uint8_t h3zero_priority_to_stream_priority(uint8_t urgency, int incremental);
+uint8_t* h3zero_create_priority_header_field(uint8_t* bytes, uint8_t* bytes_max, uint8_t urgency, int incremental);
+
+/* QPACK dynamic table (RFC 9204).
+ * Each direction of the connection has its own table: the encoder
+ * inserts entries that the peer decoder mirrors after reading the encoder
+ * stream, and the decoder acknowledges them on the decoder stream.
+ * Entries are kept in a ring indexed by their absolute index modulo the
+ * largest number of entries that fits in the maximum capacity. The size
+ * of an entry is the length of name and value plus 32 bytes.
+ *
+ * Entries keep a copy of the name, even when inserted with a reference
+ * to the static table, so that both ends compute the same sizes. The
+ * header type is set if the name is one that h3zero parses.
+ */
+#define H3ZERO_QPACK_ENTRY_OVERHEAD 32
+#define H3ZERO_QPACK_SECTION_FIELDS_MAX 32
+
+typedef struct st_h3zero_qpack_entry_t {
+    http_header_enum_t header;
+    uint8_t* name;
+    size_t name_length;
+    uint8_t* value;
+    size_t value_length;
+} h3zero_qpack_entry_t;
+
+typedef struct st_h3zero_qpack_table_t {
+    h3zero_qpack_entry_t* entries;
+    size_t nb_entries_max;
+    uint64_t max_capacity;
+    uint64_t capacity;
+    uint64_t size;
+    uint64_t insert_count;
+    uint64_t drop_count; /* absolute index of the oldest entry */
+} h3zero_qpack_table_t;
+
+int h3zero_qpack_table_init(h3zero_qpack_table_t* table, uint64_t max_capacity);
+void h3zero_qpack_table_release(h3zero_qpack_table_t* table);
+int h3zero_qpack_table_set_capacity(h3zero_qpack_table_t* table, uint64_t capacity);
+int h3zero_qpack_table_insert(h3zero_qpack_table_t* table, http_header_enum_t header,
+    const uint8_t* name, size_t name_length, const uint8_t* value, size_t value_length);
+h3zero_qpack_entry_t* h3zero_qpack_table_get(h3zero_qpack_table_t* table, uint64_t absolute_index);
+
+/* Instructions are accumulated in buffers: incoming instructions may be
+ * split across stream frames, outgoing instructions are queued until
+ * they can be added to the encoder or decoder stream.
+ */
+typedef struct st_h3zero_qpack_buffer_t {
+    uint8_t* bytes;
+    size_t length;
+    size_t size;
+} h3zero_qpack_buffer_t;
+
+typedef struct st_h3zero_qpack_section_t {
+    uint64_t stream_id;
+    uint64_t required_insert_count;
+} h3zero_qpack_section_t;
+
+/* The encoder only inserts entries while they fit in the table without
+ * eviction, and falls back to literals once the table is full. This
+ * works well for the small set of header values that a server repeats
+ * in every response, and removes the need to track which entries are
+ * still referenced by unacknowledged sections. Entries are referenced
+ * before being acknowledged only if the peer accepts blocked streams.
+ */
+typedef struct st_h3zero_qpack_encoder_t {
+    h3zero_qpack_table_t table;
+    uint64_t local_max_capacity;
+    uint64_t peer_max_capacity;
+    uint64_t peer_blocked_streams;
+    uint64_t known_received_count;
+    h3zero_qpack_section_t* sections; /* sections waiting for acknowledgement */
+    size_t nb_sections;
+    size_t nb_sections_max;
+    h3zero_qpack_buffer_t decoder_stream;
+    h3zero_qpack_buffer_t instructions;
+    unsigned int is_peer_settings_known : 1;
+    unsigned int is_capacity_sent : 1;
+} h3zero_qpack_encoder_t;
+
+typedef struct st_h3zero_qpack_decoder_t {
+    h3zero_qpack_table_t table;
+    uint64_t max_blocked_streams;
+    uint64_t nb_blocked_streams;
+    uint64_t reported_insert_count;
+    h3zero_qpack_buffer_t encoder_stream;
+    h3zero_qpack_buffer_t instructions;
+} h3zero_qpack_decoder_t;
+
+/* Description of a field line for the encoder. If static_index is not
+ * UINT64_MAX, the name is that of the static entry, and if the value also
+ * matches the static entry is_static_match is set. Otherwise, the name is
+ * provided as a literal. Only indexable fields are added to the dynamic
+ * table: values that change with each request, such as paths or
+ * lengths, should not be.
+ */
+typedef struct st_h3zero_qpack_field_t {
+    uint64_t static_index;
+    uint8_t const* name;
+    size_t name_length;
+    uint8_t const* value;
+    size_t value_length;
+    unsigned int is_static_match : 1;
+    unsigned int is_indexable : 1;
+} h3zero_qpack_field_t;
+
+int h3zero_qpack_encoder_init(h3zero_qpack_encoder_t* encoder, uint64_t max_capacity);
+void h3zero_qpack_encoder_release(h3zero_qpack_encoder_t* encoder);
+int h3zero_qpack_encoder_set_peer_settings(h3zero_qpack_encoder_t* encoder,
+    uint64_t peer_max_capacity, uint64_t peer_blocked_streams);
+int h3zero_qpack_encoder_receive(h3zero_qpack_encoder_t* encoder, const uint8_t* bytes, size_t length);
+uint8_t* h3zero_qpack_encode_header_section(uint8_t* bytes, uint8_t* bytes_max,
+    h3zero_qpack_encoder_t* encoder, uint64_t stream_id,
+    const h3zero_qpack_field_t* fields, size_t nb_fields);
+
+int h3zero_qpack_decoder_init(h3zero_qpack_decoder_t* decoder, uint64_t max_capacity, uint64_t max_blocked_streams);
+void h3zero_qpack_decoder_release(h3zero_qpack_decoder_t* decoder);
+int h3zero_qpack_decoder_receive(h3zero_qpack_decoder_t* decoder, const uint8_t* bytes, size_t length);
+int h3zero_qpack_section_is_blocked(h3zero_qpack_decoder_t* decoder, uint8_t* bytes, uint8_t* bytes_max);
+int h3zero_qpack_decoder_cancel_stream(h3zero_qpack_decoder_t* decoder, uint64_t stream_id);
+uint8_t* h3zero_parse_qpack_header_frame_ex(uint8_t* bytes, uint8_t* bytes_max,
+    h3zero_header_parts_t* parts, h3zero_qpack_decoder_t* decoder, uint64_t stream_id);
+/* Same as h3zero_parse_qpack_header_frame_ex, but the path is copied into
+ * a buffer from the frame pool, so parsing a request does not allocate
+ * memory once the pool is primed. The buffer is returned to the pool by
+ * h3zero_release_header_parts. */
+uint8_t* h3zero_parse_qpack_header_frame_pooled(uint8_t* bytes, uint8_t* bytes_max,
+    h3zero_header_parts_t* parts, h3zero_qpack_decoder_t* decoder, uint64_t stream_id,
+    struct st_h3zero_frame_pool_t* frame_pool);
+
+/* Frame creation using the dynamic table. If the encoder is NULL or the
+ * peer did not allow a dynamic table, the result is identical to that of
+ * the static only functions. Encoder instructions are queued in the
+ * encoder, and must be sent before or with the header frame.
+ */
+uint8_t* h3zero_create_response_header_frame_qpack(uint8_t* bytes, uint8_t* bytes_max,
+    h3zero_content_type_enum doc_type, char const* server_string,
+    h3zero_qpack_encoder_t* encoder, uint64_t stream_id);
+uint8_t* h3zero_create_error_frame_qpack(uint8_t* bytes, uint8_t* bytes_max, char const* error_code,
+    char const* server_string, h3zero_qpack_encoder_t* encoder, uint64_t stream_id);
+
+/* Frame buffers.
+ * Frames are parsed directly from the stream data when they are received
+ * in a single delivery. A buffer is only needed if a frame spans several
+ * deliveries, or if a blocked header must be kept until the QPACK encoder
+ * instructions arrive. Buffers of H3ZERO_FRAME_BUFFER_SIZE bytes are then
+ * taken from a pool shared by the streams of the connection, and returned
+ * to it when the frame is processed. Larger frames use a dedicated
+ * allocation. Without a pool, all buffers are allocated and freed.
+ */
+#define H3ZERO_FRAME_BUFFER_SIZE 1024
+#define H3ZERO_FRAME_POOL_MAX 16
+
+typedef struct st_h3zero_frame_pool_t {
+    uint8_t* buffers[H3ZERO_FRAME_POOL_MAX];
+    size_t nb_buffers;
+    uint64_t nb_allocated; /* number of pool buffers allocated so far */
+} h3zero_frame_pool_t;
+
+uint8_t* h3zero_frame_buffer_get(h3zero_frame_pool_t* pool, size_t length, int* is_pooled);
+void h3zero_frame_buffer_release(h3zero_frame_pool_t* pool, uint8_t* buffer, int is_pooled);
+void h3zero_frame_pool_release(h3zero_frame_pool_t* pool);
+
 typedef struct st_h3zero_data_stream_state_t {
     struct st_h3zero_callback_ctx_t* h3_ctx;
+    h3zero_frame_pool_t* frame_pool;
     h3zero_header_parts_t header;
-    h3zero_header_parts_t trailer;
     uint64_t stream_type;
-    uint8_t * current_frame;
+    uint8_t * current_frame; /* only set if the frame is buffered */
     uint64_t current_frame_type;
     uint64_t current_frame_length;
     uint64_t current_frame_read;
     uint64_t control_stream_id;
+    uint64_t stream_id;
+    uint8_t * blocked_bytes; /* bytes received while the header is blocked */
+    size_t blocked_length;
     uint8_t frame_header[16];
     size_t frame_header_read;
     unsigned int is_upgrade_requested:1;
@@ -264,6 +457,9 @@ typedef struct st_h3zero_data_stream_state_t {
     unsigned int trailer_found : 1;
     unsigned int is_h3_control : 1;
     unsigned int is_current_frame_ignored : 1;
+    unsigned int is_header_blocked : 1; /* waiting for QPACK encoder instructions */
+    unsigned int is_blocked_fin : 1;
+    unsigned int is_current_frame_pooled : 1;
     /* Keeping track of FIN sent and FIN received, so applications can delete stream contexts that are not useful */
     unsigned int is_fin_received : 1; 
     unsigned int is_fin_sent : 1;
@@ -290,6 +486,10 @@ void h3zero_release_header_parts(h3zero_header_parts_t* header);
 
 int hzero_qpack_huffman_decode(uint8_t * bytes, uint8_t * bytes_max,
     uint8_t * decoded, size_t max_decoded, size_t * nb_decoded);
+/* Length of the Huffman encoding of a string, and encoding. The encoding
+ * returns NULL if the output does not fit between bytes and bytes_max. */
+size_t h3zero_qpack_huffman_length(uint8_t const * bytes, size_t length);
+uint8_t * h3zero_qpack_huffman_encode(uint8_t * bytes, uint8_t * bytes_max, uint8_t const * s, size_t s_length);
 
 /* TLV_Buffer_accumulator 
 */
@@ -33,6 +33,7 @@
 #include "tls_api.h"
 #include "h3zero.h"
 #include "h3zero_common.h"
+#include "h3zero_uri.h"
 
 
 
@@ -63,6 +64,10 @@ static void picohttp_clear_stream_ctx(h3zero_stream_ctx_t* stream_ctx)
 	if (stream_ctx->F != NULL) {
 		stream_ctx->F = picoquic_file_close(stream_ctx->F);
 	}
+	if (stream_ctx->file_entry != NULL) {
+		h3zero_file_cache_release(stream_ctx->file_entry);
+		stream_ctx->file_entry = NULL;
+	}
 
 	if (stream_ctx->path_callback != NULL) {
 		(void)stream_ctx->path_callback(stream_ctx->cnx, NULL, 0, picohttp_callback_free, stream_ctx, stream_ctx->path_callback_ctx);
@@ -72,37 +77,106 @@ static void picohttp_clear_stream_ctx(h3zero_stream_ctx_t* stream_ctx)
 		h3zero_delete_data_stream_state(&stream_ctx->ps.stream_state);
 	}
 	else {
-		if (stream_ctx->ps.hq.path != NULL) {
-			free(stream_ctx->ps.hq.path);
-		}
+		stream_ctx->ps.hq.path = NULL;
+	}
+	if (stream_ctx->frame != NULL) {
+		h3zero_frame_buffer_release(stream_ctx->frame_pool, stream_ctx->frame, stream_ctx->is_frame_pooled);
+		stream_ctx->frame = NULL;
 	}
 }
 
 static void picohttp_stream_node_delete(void * tree, picosplay_node_t * node)
 {
 	h3zero_stream_ctx_t * stream_ctx = picohttp_stream_node_value(node);
+	if (stream_ctx->stream_index != NULL) {
+		picohash_delete_item(stream_ctx->stream_index, &stream_ctx->stream_index_item, 0);
+	}
 	picohttp_clear_stream_ctx(stream_ctx);
 
-	free(stream_ctx);
+	h3zero_frame_buffer_release(stream_ctx->frame_pool, (uint8_t*)stream_ctx, stream_ctx->is_ctx_pooled);
 }
 
 void h3zero_delete_stream(picoquic_cnx_t * cnx, h3zero_callback_ctx_t* ctx, h3zero_stream_ctx_t* stream_ctx)
 {
+	if (stream_ctx->is_h3 && stream_ctx->ps.stream_state.is_header_blocked) {
+		/* The encoder must not wait for the acknowledgement of this section */
+		ctx->qpack_decoder.nb_blocked_streams--;
+		(void)h3zero_qpack_decoder_cancel_stream(&ctx->qpack_decoder, stream_ctx->stream_id);
+	}
 	if (cnx != NULL) {
 		picoquic_unlink_app_stream_ctx(cnx, stream_ctx->stream_id);
 	}
 	picosplay_delete(&ctx->h3_stream_tree, &stream_ctx->http_stream_node);
 }
 
+/* The stream contexts are owned by the splay tree, which keeps them ordered
+ * for scans. The stream contexts are also attached to the transport streams,
+ * so most callbacks receive them directly. The other lookups use a hash
+ * index keyed by stream ID. Stream IDs of a given type increase by 4, so an
+ * odd number of bins spreads them evenly. The number of bins doubles when
+ * the average chain exceeds 2 entries.
+ */
+#define H3ZERO_STREAM_INDEX_BINS 31
+
+static uint64_t h3zero_stream_index_hash(const void* key)
+{
+	return ((const h3zero_stream_ctx_t*)key)->stream_id;
+}
+
+static int h3zero_stream_index_compare(const void* key1, const void* key2)
+{
+	return (((const h3zero_stream_ctx_t*)key1)->stream_id == ((const h3zero_stream_ctx_t*)key2)->stream_id) ? 0 : -1;
+}
+
+static picohash_item* h3zero_stream_index_to_item(const void* key)
+{
+	return &((h3zero_stream_ctx_t*)key)->stream_index_item;
+}
+
+static int h3zero_stream_index_insert(h3zero_callback_ctx_t* ctx, h3zero_stream_ctx_t* stream_ctx)
+{
+	int ret = 0;
+
+	if (ctx->h3_stream_index == NULL &&
+		(ctx->h3_stream_index = picohash_create_ex(H3ZERO_STREAM_INDEX_BINS, h3zero_stream_index_hash,
+			h3zero_stream_index_compare, h3zero_stream_index_to_item)) == NULL) {
+		ret = -1;
+	}
+	else {
+		if (ctx->h3_stream_index->count >= 2 * ctx->h3_stream_index->nb_bin) {
+			/* If the allocation fails, the index keeps working with longer chains */
+			(void)picohash_resize(ctx->h3_stream_index, 2 * ctx->h3_stream_index->nb_bin + 1);
+		}
+		if ((ret = picohash_insert(ctx->h3_stream_index, stream_ctx)) == 0) {
+			stream_ctx->stream_index = ctx->h3_stream_index;
+		}
+	}
+
+	return ret;
+}
+
+void h3zero_delete_stream_index(h3zero_callback_ctx_t* ctx)
+{
+	if (ctx->h3_stream_index != NULL) {
+		/* The items are embedded in the stream contexts */
+		picohash_delete(ctx->h3_stream_index, 0);
+		ctx->h3_stream_index = NULL;
+	}
+}
+
 h3zero_stream_ctx_t* h3zero_find_stream(h3zero_callback_ctx_t* ctx, uint64_t stream_id)
 {
 	h3zero_stream_ctx_t * ret = NULL;
-	h3zero_stream_ctx_t target;
-	target.stream_id = stream_id;
-	picosplay_node_t * node = picosplay_find(&ctx->h3_stream_tree, (void*)&target);
 
-	if (node != NULL) {
-		ret = (h3zero_stream_ctx_t *)picohttp_stream_node_value(node);
+	if (ctx->h3_stream_index != NULL) {
+		h3zero_stream_ctx_t target;
+		picohash_item* item;
+
+		target.stream_id = stream_id;
+		item = picohash_retrieve(ctx->h3_stream_index, &target);
+		if (item != NULL) {
+			ret = (h3zero_stream_ctx_t*)item->key;
+		}
 	}
 
 	return ret;
@@ -120,21 +194,34 @@ h3zero_stream_ctx_t * h3zero_find_or_create_stream(
 	/* if stream is already present, check its state. New bytes? */
 
 	if (stream_ctx == NULL && should_create) {
+		/* Stream contexts are smaller than frame buffers, and are recycled
+		 * through the frame pool of the connection */
+		int is_pooled = 0;
 		stream_ctx = (h3zero_stream_ctx_t*)
-			malloc(sizeof(h3zero_stream_ctx_t));
+			h3zero_frame_buffer_get(&ctx->frame_pool, sizeof(h3zero_stream_ctx_t), &is_pooled);
+		if (stream_ctx != NULL) {
+			memset(stream_ctx, 0, sizeof(h3zero_stream_ctx_t));
+			stream_ctx->stream_id = stream_id;
+			stream_ctx->frame_pool = &ctx->frame_pool;
+			stream_ctx->is_ctx_pooled = is_pooled;
+			if (h3zero_stream_index_insert(ctx, stream_ctx) != 0) {
+				h3zero_frame_buffer_release(&ctx->frame_pool, (uint8_t*)stream_ctx, is_pooled);
+				stream_ctx = NULL;
+			}
+		}
 		if (stream_ctx == NULL) {
 			/* Could not handle this stream */
 			picoquic_reset_stream(cnx, stream_id, H3ZERO_INTERNAL_ERROR);
 		}
 		else {
-			memset(stream_ctx, 0, sizeof(h3zero_stream_ctx_t));
-			stream_ctx->stream_id = stream_id;
 			stream_ctx->is_h3 = is_h3;
 			stream_ctx->cnx = cnx;
 			if (is_h3) {
 				stream_ctx->ps.stream_state.h3_ctx = ctx;
+				stream_ctx->ps.stream_state.frame_pool = &ctx->frame_pool;
 				stream_ctx->ps.stream_state.stream_type = UINT64_MAX;
 				stream_ctx->ps.stream_state.control_stream_id = UINT64_MAX;
+				stream_ctx->ps.stream_state.stream_id = stream_id;
 				if (!IS_BIDIR_STREAM_ID(stream_id)) {
 					if (IS_LOCAL_STREAM_ID(stream_id, picoquic_is_client(cnx))) {
 						stream_ctx->ps.stream_state.is_fin_received = 1;
@@ -151,24 +238,120 @@ h3zero_stream_ctx_t * h3zero_find_or_create_stream(
 	return stream_ctx;
 }
 
+/* Priorities, RFC 9218.
+ * A PRIORITY_UPDATE frame overrides the priority header of the request.
+ * If the request stream is known, the update is applied immediately;
+ * otherwise, it is kept until the request is processed.
+ */
+int h3zero_set_priority_update(picoquic_cnx_t* cnx, h3zero_callback_ctx_t* ctx, uint64_t stream_id,
+	uint8_t urgency, int incremental)
+{
+	int ret = 0;
+	h3zero_stream_ctx_t* stream_ctx = h3zero_find_stream(ctx, stream_id);
+
+	if (stream_ctx != NULL) {
+		stream_ctx->is_priority_updated = 1;
+		ret = picoquic_set_stream_priority(cnx, stream_id, h3zero_priority_to_stream_priority(urgency, incremental));
+	}
+	else {
+		size_t i = 0;
+
+		while (i < ctx->nb_pending_priority && ctx->pending_priority[i].stream_id != stream_id) {
+			i++;
+		}
+		if (i >= H3ZERO_PENDING_PRIORITY_MAX) {
+			/* Drop the oldest update */
+			memmove(&ctx->pending_priority[0], &ctx->pending_priority[1],
+				(H3ZERO_PENDING_PRIORITY_MAX - 1) * sizeof(h3zero_pending_priority_t));
+			i = H3ZERO_PENDING_PRIORITY_MAX - 1;
+		}
+		else if (i >= ctx->nb_pending_priority) {
+			ctx->nb_pending_priority++;
+		}
+		ctx->pending_priority[i].stream_id = stream_id;
+		ctx->pending_priority[i].urgency = urgency;
+		ctx->pending_priority[i].incremental = incremental;
+	}
+
+	return ret;
+}
+
+/* Set the priority of the response stream when the request is processed,
+ * from a pending update if there is one, or else from the request header.
+ * Without either, the stream keeps the default priority.
+ */
+static int h3zero_set_request_priority(picoquic_cnx_t* cnx, h3zero_stream_ctx_t* stream_ctx, h3zero_callback_ctx_t* ctx)
+{
+	int ret = 0;
+
+	if (!stream_ctx->is_priority_updated) {
+		h3zero_header_parts_t* header = &stream_ctx->ps.stream_state.header;
+		uint8_t urgency = header->urgency;
+		int incremental = header->incremental;
+		int is_set = header->priority_found;
+
+		for (size_t i = 0; i < ctx->nb_pending_priority; i++) {
+			if (ctx->pending_priority[i].stream_id == stream_ctx->stream_id) {
+				urgency = ctx->pending_priority[i].urgency;
+				incremental = ctx->pending_priority[i].incremental;
+				is_set = 1;
+				ctx->nb_pending_priority--;
+				memmove(&ctx->pending_priority[i], &ctx->pending_priority[i + 1],
+					(ctx->nb_pending_priority - i) * sizeof(h3zero_pending_priority_t));
+				break;
+			}
+		}
+		if (is_set) {
+			ret = picoquic_set_stream_priority(cnx, stream_ctx->stream_id,
+				h3zero_priority_to_stream_priority(urgency, incremental));
+		}
+	}
+
+	return ret;
+}
+
 void h3zero_init_stream_tree(picosplay_tree_t * h3_stream_tree)
 {
 	picosplay_init_tree(h3_stream_tree, picohttp_stream_node_compare, picohttp_stream_node_create, picohttp_stream_node_delete, picohttp_stream_node_value);
 }
 
 
-/* Declare a stream prefix, such as used by webtransport or masque
+/* Declare a stream prefix, such as used by webtransport or masque.
+ *
+ * The prefixes are kept in a list, in order of declaration, and also in a
+ * hash index keyed by the prefix, i.e., the control stream ID, so that a
+ * connection can carry thousands of sessions without linear searches when
+ * receiving datagrams or streams. The index reuses the growth logic of the
+ * stream index.
  */
+static uint64_t h3zero_stream_prefix_hash(const void* key)
+{
+	return ((const h3zero_stream_prefix_t*)key)->prefix;
+}
+
+static int h3zero_stream_prefix_compare(const void* key1, const void* key2)
+{
+	return (((const h3zero_stream_prefix_t*)key1)->prefix == ((const h3zero_stream_prefix_t*)key2)->prefix) ? 0 : -1;
+}
+
+static picohash_item* h3zero_stream_prefix_to_item(const void* key)
+{
+	return &((h3zero_stream_prefix_t*)key)->hash_item;
+}
 
 h3zero_stream_prefix_t* h3zero_find_stream_prefix(h3zero_callback_ctx_t* ctx, uint64_t prefix)
 {
-	h3zero_stream_prefix_t* prefix_ctx = ctx->stream_prefixes.first;
+	h3zero_stream_prefix_t* prefix_ctx = NULL;
 
-	while (prefix_ctx != NULL) {
-		if (prefix_ctx->prefix == prefix) {
-			break;
+	if (ctx->stream_prefixes.index != NULL) {
+		h3zero_stream_prefix_t target;
+		picohash_item* item;
+
+		target.prefix = prefix;
+		item = picohash_retrieve(ctx->stream_prefixes.index, &target);
+		if (item != NULL) {
+			prefix_ctx = (h3zero_stream_prefix_t*)item->key;
 		}
-		prefix_ctx = prefix_ctx->next;
 	}
 
 	return prefix_ctx;
@@ -179,16 +362,30 @@ int h3zero_declare_stream_prefix(h3zero_callback_ctx_t* ctx, uint64_t prefix, pi
 	int ret = 0;
 	h3zero_stream_prefix_t* prefix_ctx = h3zero_find_stream_prefix(ctx, prefix);
 
-	if (prefix_ctx == NULL) {
-		prefix_ctx = (h3zero_stream_prefix_t*)malloc(sizeof(h3zero_stream_prefix_t));
-		if (prefix_ctx == NULL) {
+	if (prefix_ctx != NULL) {
+		ret = -1;
+	}
+	else if (ctx->stream_prefixes.index == NULL &&
+		(ctx->stream_prefixes.index = picohash_create_ex(H3ZERO_STREAM_INDEX_BINS, h3zero_stream_prefix_hash,
+			h3zero_stream_prefix_compare, h3zero_stream_prefix_to_item)) == NULL) {
+		ret = -1;
+	}
+	else if ((prefix_ctx = (h3zero_stream_prefix_t*)malloc(sizeof(h3zero_stream_prefix_t))) == NULL) {
+		ret = -1;
+	}
+	else {
+		memset(prefix_ctx, 0, sizeof(h3zero_stream_prefix_t));
+		prefix_ctx->prefix = prefix;
+		prefix_ctx->function_call = function_call;
+		prefix_ctx->function_ctx = function_ctx;
+		if (ctx->stream_prefixes.index->count >= 2 * ctx->stream_prefixes.index->nb_bin) {
+			(void)picohash_resize(ctx->stream_prefixes.index, 2 * ctx->stream_prefixes.index->nb_bin + 1);
+		}
+		if (picohash_insert(ctx->stream_prefixes.index, prefix_ctx) != 0) {
+			free(prefix_ctx);
 			ret = -1;
 		}
 		else {
-			memset(prefix_ctx, 0, sizeof(h3zero_stream_prefix_t));
-			prefix_ctx->prefix = prefix;
-			prefix_ctx->function_call = function_call;
-			prefix_ctx->function_ctx = function_ctx;
 			if (ctx->stream_prefixes.last == NULL) {
 				ctx->stream_prefixes.first = prefix_ctx;
 			}
@@ -199,16 +396,55 @@ int h3zero_declare_stream_prefix(h3zero_callback_ctx_t* ctx, uint64_t prefix, pi
 			ctx->stream_prefixes.last = prefix_ctx;
 		}
 	}
-	else {
-		ret = -1;
-	}
 	return ret;
 }
 
+/* Prefixes that are ready to send datagrams are queued in round robin order,
+ * so that each datagram sent costs the same whatever the number of sessions.
+ */
+static void h3zero_stream_prefix_enqueue_ready(h3zero_stream_prefixes_t* prefixes, h3zero_stream_prefix_t* prefix_ctx)
+{
+	if (!prefix_ctx->is_ready_queued) {
+		prefix_ctx->is_ready_queued = 1;
+		prefix_ctx->next_ready = NULL;
+		prefix_ctx->previous_ready = prefixes->last_ready;
+		if (prefixes->last_ready == NULL) {
+			prefixes->first_ready = prefix_ctx;
+		}
+		else {
+			prefixes->last_ready->next_ready = prefix_ctx;
+		}
+		prefixes->last_ready = prefix_ctx;
+	}
+}
+
+static void h3zero_stream_prefix_remove_ready(h3zero_stream_prefixes_t* prefixes, h3zero_stream_prefix_t* prefix_ctx)
+{
+	if (prefix_ctx->is_ready_queued) {
+		if (prefix_ctx->previous_ready == NULL) {
+			prefixes->first_ready = prefix_ctx->next_ready;
+		}
+		else {
+			prefix_ctx->previous_ready->next_ready = prefix_ctx->next_ready;
+		}
+		if (prefix_ctx->next_ready == NULL) {
+			prefixes->last_ready = prefix_ctx->previous_ready;
+		}
+		else {
+			prefix_ctx->next_ready->previous_ready = prefix_ctx->previous_ready;
+		}
+		prefix_ctx->next_ready = NULL;
+		prefix_ctx->previous_ready = NULL;
+		prefix_ctx->is_ready_queued = 0;
+	}
+}
+
 void h3zero_delete_stream_prefix(picoquic_cnx_t * cnx, h3zero_callback_ctx_t* ctx, uint64_t prefix)
 {
 	h3zero_stream_prefix_t* prefix_ctx = h3zero_find_stream_prefix(ctx, prefix);
 	if (prefix_ctx != NULL) {
+		picohash_delete_item(ctx->stream_prefixes.index, &prefix_ctx->hash_item, 0);
+		h3zero_stream_prefix_remove_ready(&ctx->stream_prefixes, prefix_ctx);
 		if (prefix_ctx->previous == NULL) {
 			ctx->stream_prefixes.first = prefix_ctx->next;
 		}
@@ -252,6 +488,10 @@ void h3zero_delete_all_stream_prefixes(picoquic_cnx_t * cnx, h3zero_callback_ctx
 			h3zero_delete_stream_prefix(cnx, ctx, next->prefix);
 		}
 	}
+	if (ctx->stream_prefixes.index != NULL) {
+		picohash_delete(ctx->stream_prefixes.index, 0);
+		ctx->stream_prefixes.index = NULL;
+	}
 }
 
 uint64_t h3zero_parse_stream_prefix(uint8_t* buffer_8, size_t* nb_in_buffer, uint8_t* data, size_t data_length, size_t * nb_read)
@@ -276,6 +516,11 @@ uint64_t h3zero_parse_stream_prefix(uint8_t* buffer_8, size_t* nb_in_buffer, uin
 }
 
 int h3zero_protocol_init(picoquic_cnx_t* cnx)
+{
+	return h3zero_protocol_init_ex(cnx, NULL);
+}
+
+int h3zero_protocol_init_ex(picoquic_cnx_t* cnx, h3zero_callback_ctx_t* ctx)
 {
 	uint8_t decoder_stream_head = (uint8_t)h3zero_stream_type_qpack_decoder;
 	uint8_t encoder_stream_head = (uint8_t)h3zero_stream_type_qpack_encoder;
@@ -291,6 +536,10 @@ int h3zero_protocol_init(picoquic_cnx_t* cnx)
 		settings.h3_datagram = 1;
 	}
 	settings.webtransport_max_sessions = 1;
+	if (ctx != NULL) {
+		settings.table_size = ctx->qpack_max_table_capacity;
+		settings.blocked_streams = ctx->qpack_blocked_streams;
+	}
 
 	settings_buffer[0] = (uint8_t)h3zero_stream_type_control;
 	if ((settings_last = h3zero_settings_encode(settings_buffer + 1, settings_buffer + sizeof(settings_buffer), &settings)) == NULL) {
@@ -307,24 +556,51 @@ int h3zero_protocol_init(picoquic_cnx_t* cnx)
 
 	if (ret == 0) {
 		uint64_t encoder_stream_id = picoquic_get_next_local_stream_id(cnx, 1);
-		/* set the encoder stream, although we do not actually create dynamic codes. */
+		/* set the encoder stream. Instructions are only sent if the peer enables the dynamic table. */
 		ret = picoquic_add_to_stream(cnx, encoder_stream_id, &encoder_stream_head, 1, 0);
 		if (ret == 0) {
 			ret = picoquic_set_stream_priority(cnx, encoder_stream_id, 1);
 		}
+		if (ret == 0 && ctx != NULL) {
+			ctx->qpack_encoder_stream_id = encoder_stream_id;
+		}
 	}
 
 	if (ret == 0) {
 		uint64_t decoder_stream_id = picoquic_get_next_local_stream_id(cnx, 1);
-		/* set the the decoder stream, although we do not actually create dynamic codes. */
+		/* set the the decoder stream. Instructions are only sent if the local dynamic table is enabled. */
 		ret = picoquic_add_to_stream(cnx, decoder_stream_id, &decoder_stream_head, 1, 0);
 		if (ret == 0) {
 			ret = picoquic_set_stream_priority(cnx, decoder_stream_id, 1);
 		}
+		if (ret == 0 && ctx != NULL) {
+			ctx->qpack_decoder_stream_id = decoder_stream_id;
+		}
 	}
 	return ret;
 }
 
+static void h3zero_release_current_frame(h3zero_data_stream_state_t* stream_state)
+{
+	if (stream_state->current_frame != NULL) {
+		h3zero_frame_buffer_release(stream_state->frame_pool, stream_state->current_frame,
+			stream_state->is_current_frame_pooled);
+		stream_state->current_frame = NULL;
+		stream_state->is_current_frame_pooled = 0;
+	}
+}
+
+static uint8_t* h3zero_attach_current_frame(h3zero_data_stream_state_t* stream_state)
+{
+	if (stream_state->current_frame == NULL) {
+		int is_pooled = 0;
+		stream_state->current_frame = h3zero_frame_buffer_get(stream_state->frame_pool,
+			(size_t)stream_state->current_frame_length, &is_pooled);
+		stream_state->is_current_frame_pooled = is_pooled;
+	}
+	return stream_state->current_frame;
+}
+
 uint8_t* h3zero_load_frame_content(uint8_t* bytes, uint8_t* bytes_max,
 	h3zero_data_stream_state_t* stream_state, uint64_t* error_found)
 {
@@ -335,8 +611,8 @@ uint8_t* h3zero_load_frame_content(uint8_t* bytes, uint8_t* bytes_max,
 		*error_found = H3ZERO_INTERNAL_ERROR;
 		return NULL;
 	}
-	else if (stream_state->current_frame == NULL) {
-		stream_state->current_frame = (uint8_t*)malloc((size_t)stream_state->current_frame_length);
+	else {
+		(void)h3zero_attach_current_frame(stream_state);
 	}
 
 	if (stream_state->current_frame == NULL) {
@@ -390,13 +666,10 @@ static void h3zero_reset_control_stream_state(h3zero_data_stream_state_t* stream
 	stream_state->current_frame_type = UINT64_MAX;
 	stream_state->current_frame_length = UINT64_MAX;
 	stream_state->current_frame_read = 0;
-	if (stream_state->current_frame != NULL) {
-		free(stream_state->current_frame);
-		stream_state->current_frame = NULL;
-	}
+	h3zero_release_current_frame(stream_state);
 }
 
-static uint8_t* h3zero_parse_control_stream(uint8_t* bytes, uint8_t* bytes_max,
+static uint8_t* h3zero_parse_control_stream(picoquic_cnx_t* cnx, uint8_t* bytes, uint8_t* bytes_max,
 	h3zero_data_stream_state_t* stream_state, h3zero_callback_ctx_t* ctx, uint64_t* error_found)
 {
 	while (bytes != NULL && bytes < bytes_max) {
@@ -427,7 +700,9 @@ static uint8_t* h3zero_parse_control_stream(uint8_t* bytes, uint8_t* bytes_max,
 					bytes = NULL;
 					continue;
 				}
-				else if (stream_state->current_frame_type != h3zero_frame_settings) {
+				else if (stream_state->current_frame_type != h3zero_frame_settings &&
+					(stream_state->current_frame_type != h3zero_frame_priority_update_request || cnx->client_mode)) {
+					/* Priority updates are only processed by servers */
 					stream_state->is_current_frame_ignored = 1;
 				}
 			}
@@ -463,6 +738,31 @@ static uint8_t* h3zero_parse_control_stream(uint8_t* bytes, uint8_t* bytes_max,
 					}
 					else {
 						ctx->settings.settings_received = 1;
+						if (h3zero_qpack_encoder_set_peer_settings(&ctx->qpack_encoder,
+							ctx->settings.table_size, ctx->settings.blocked_streams) != 0) {
+							*error_found = H3ZERO_INTERNAL_ERROR;
+							bytes = NULL;
+						}
+					}
+				}
+				else if (stream_state->current_frame_type == h3zero_frame_priority_update_request &&
+					!stream_state->is_current_frame_ignored) {
+					uint64_t prioritized_id = 0;
+					uint8_t urgency = H3ZERO_PRIORITY_URGENCY_DEFAULT;
+					int incremental = 0;
+
+					if (h3zero_priority_update_components_decode(stream_state->current_frame,
+						stream_state->current_frame + stream_state->current_frame_length,
+						&prioritized_id, &urgency, &incremental) == NULL) {
+						/* Field values that cannot be parsed are ignored */
+					}
+					else if ((prioritized_id & 3) != 0) {
+						/* Must be a client initiated bidirectional stream */
+						*error_found = H3ZERO_ID_ERROR;
+						bytes = NULL;
+					}
+					else {
+						(void)h3zero_set_priority_update(cnx, ctx, prioritized_id, urgency, incremental);
 					}
 				}
 				h3zero_reset_control_stream_state(stream_state);
@@ -552,16 +852,28 @@ uint8_t* h3zero_parse_remote_unidir_stream(
 	}
 	switch (stream_state->stream_type) {
 	case h3zero_stream_type_control: /* used to send/receive setting frame and other control frames. */
-		bytes = h3zero_parse_control_stream(bytes, bytes_max, stream_state, ctx, error_found);
+		bytes = h3zero_parse_control_stream(stream_ctx->cnx, bytes, bytes_max, stream_state, ctx, error_found);
 		break;
 	case h3zero_stream_type_push: /* Push type not supported in current implementation */
 		bytes = bytes_max;
 		break;
-	case h3zero_stream_type_qpack_encoder: /* not required since not using dynamic table */
-		bytes = bytes_max;
+	case h3zero_stream_type_qpack_encoder: /* instructions for the local decoder */
+		if (bytes < bytes_max &&
+			(*error_found = h3zero_qpack_decoder_receive(&ctx->qpack_decoder, bytes, bytes_max - bytes)) != 0) {
+			bytes = NULL;
+		}
+		else {
+			bytes = bytes_max;
+		}
 		break;
-	case h3zero_stream_type_qpack_decoder: /* not required since not using dynamic table */
-		bytes = bytes_max;
+	case h3zero_stream_type_qpack_decoder: /* instructions for the local encoder */
+		if (bytes < bytes_max &&
+			(*error_found = h3zero_qpack_encoder_receive(&ctx->qpack_encoder, bytes, bytes_max - bytes)) != 0) {
+			bytes = NULL;
+		}
+		else {
+			bytes = bytes_max;
+		}
 		break;
 	case h3zero_stream_type_webtransport: /* unidir stream is used as specified in web transport */
 		bytes = h3zero_parse_control_stream_id(bytes, bytes_max, stream_state, stream_ctx, ctx);
@@ -605,12 +917,51 @@ uint8_t* h3zero_parse_incoming_remote_stream(
 *   length N. Treat the following N bytes as data.
 */
 
+/* Parse a complete header frame, either directly from the stream data or
+ * from the frame buffer, and release the frame buffer. Trailers are
+ * checked but not kept.
+ */
+static int h3zero_parse_header_frame_content(h3zero_data_stream_state_t* stream_state, uint8_t* frame, uint64_t* error_found)
+{
+	int ret = 0;
+	uint8_t* parsed;
+	h3zero_header_parts_t trailer;
+	h3zero_header_parts_t* parts = (stream_state->header_found) ? &trailer : &stream_state->header;
+	h3zero_qpack_decoder_t* decoder = (stream_state->h3_ctx == NULL) ? NULL : &stream_state->h3_ctx->qpack_decoder;
+
+	stream_state->trailer_found = stream_state->header_found;
+	stream_state->header_found = 1;
+	/* parse */
+	parsed = h3zero_parse_qpack_header_frame_pooled(frame, frame + stream_state->current_frame_length, parts,
+		decoder, stream_state->stream_id, stream_state->frame_pool);
+	if (parsed == NULL || (size_t)(parsed - frame) != stream_state->current_frame_length) {
+		/* protocol error */
+		*error_found = (decoder != NULL && decoder->table.max_capacity > 0) ?
+			H3ZERO_QPACK_DECOMPRESSION_FAILED : H3ZERO_FRAME_ERROR;
+		ret = -1;
+	}
+	if (parts == &trailer) {
+		h3zero_release_header_parts(&trailer);
+	}
+	/* free resource */
+	stream_state->frame_header_parsed = 0;
+	stream_state->frame_header_read = 0;
+	h3zero_release_current_frame(stream_state);
+
+	return ret;
+}
+
 uint8_t * h3zero_parse_data_stream(uint8_t * bytes, uint8_t * bytes_max,
 	h3zero_data_stream_state_t * stream_state, size_t * available_data, uint64_t * error_found)
 {
 	*available_data = 0;
 	*error_found = 0;
 
+	if (stream_state->is_header_blocked) {
+		/* The caller must hold the bytes until the header is unblocked */
+		return bytes;
+	}
+
 	if (bytes == NULL || bytes >= bytes_max) {
 		*error_found = H3ZERO_INTERNAL_ERROR;
 		return NULL;
@@ -676,14 +1027,6 @@ uint8_t * h3zero_parse_data_stream(uint8_t * bytes, uint8_t * bytes_max,
 					*error_found = H3ZERO_INTERNAL_ERROR;
 					bytes = NULL;
 				}
-				else {
-					stream_state->current_frame = (uint8_t *)malloc((size_t)stream_state->current_frame_length);
-					if (stream_state->current_frame == NULL) {
-						/* error, internal error */
-						*error_found = H3ZERO_INTERNAL_ERROR;
-						bytes = NULL;
-					}
-				}
 			}
 			else if (stream_state->current_frame_type == h3zero_frame_webtransport_stream) {
 				if (stream_state->header_found) {
@@ -724,29 +1067,52 @@ uint8_t * h3zero_parse_data_stream(uint8_t * bytes, uint8_t * bytes_max,
 			}
 
 			if (stream_state->current_frame_type == h3zero_frame_header) {
-				memcpy(stream_state->current_frame + stream_state->current_frame_read, bytes, available);
+				uint8_t* frame = NULL;
+
+				if (stream_state->current_frame_read == 0 && available == stream_state->current_frame_length) {
+					/* The whole frame is available, parse it in place */
+					frame = bytes;
+				}
+				else if (h3zero_attach_current_frame(stream_state) == NULL) {
+					*error_found = H3ZERO_INTERNAL_ERROR;
+					return NULL;
+				}
+				else {
+					memcpy(stream_state->current_frame + stream_state->current_frame_read, bytes, available);
+					if (stream_state->current_frame_read + available >= stream_state->current_frame_length) {
+						frame = stream_state->current_frame;
+					}
+				}
 				stream_state->current_frame_read += available;
 				bytes += available;
 
-				if (stream_state->current_frame_read >= stream_state->current_frame_length) {
-					uint8_t* parsed;
-					h3zero_header_parts_t* parts = (stream_state->header_found) ?
-						&stream_state->trailer : &stream_state->header;
-					stream_state->trailer_found = stream_state->header_found;
-					stream_state->header_found = 1;
-					/* parse */
-					parsed = h3zero_parse_qpack_header_frame(stream_state->current_frame,
-						stream_state->current_frame + stream_state->current_frame_length, parts);
-					if (parsed == NULL || (size_t)(parsed - stream_state->current_frame) != stream_state->current_frame_length) {
-						/* protocol error */
-						*error_found = H3ZERO_FRAME_ERROR;
+				if (frame != NULL) {
+					h3zero_qpack_decoder_t* decoder = (stream_state->h3_ctx == NULL) ? NULL : &stream_state->h3_ctx->qpack_decoder;
+					int is_blocked = (decoder == NULL) ? 0 : h3zero_qpack_section_is_blocked(decoder,
+						frame, frame + stream_state->current_frame_length);
+
+					if (is_blocked > 0) {
+						/* Wait for the encoder instructions, if the peer is allowed that many blocked streams.
+						 * The frame must be kept in a buffer until then. */
+						if (decoder->nb_blocked_streams >= decoder->max_blocked_streams) {
+							*error_found = H3ZERO_QPACK_DECOMPRESSION_FAILED;
+							bytes = NULL;
+						}
+						else if (frame != stream_state->current_frame && h3zero_attach_current_frame(stream_state) == NULL) {
+							*error_found = H3ZERO_INTERNAL_ERROR;
+							bytes = NULL;
+						}
+						else {
+							if (frame != stream_state->current_frame) {
+								memcpy(stream_state->current_frame, frame, (size_t)stream_state->current_frame_length);
+							}
+							decoder->nb_blocked_streams++;
+							stream_state->is_header_blocked = 1;
+						}
+					}
+					else if (h3zero_parse_header_frame_content(stream_state, frame, error_found) != 0) {
 						bytes = NULL;
 					}
-					/* free resource */
-					stream_state->frame_header_parsed = 0;
-					stream_state->frame_header_read = 0;
-					free(stream_state->current_frame);
-					stream_state->current_frame = NULL;
 				}
 			}
 			else if (stream_state->current_frame_type == h3zero_frame_data) {
@@ -791,10 +1157,29 @@ h3zero_callback_ctx_t* h3zero_callback_create_context(picohttp_server_parameters
 
 		h3zero_init_stream_tree(&ctx->h3_stream_tree);
 
+		ctx->qpack_encoder_stream_id = UINT64_MAX;
+		ctx->qpack_decoder_stream_id = UINT64_MAX;
+
 		if (param != NULL) {
 			ctx->path_table = param->path_table;
 			ctx->path_table_nb = param->path_table_nb;
 			ctx->web_folder = param->web_folder;
+			ctx->file_cache = param->file_cache;
+			ctx->response_cache = param->response_cache;
+			ctx->router = param->router;
+		}
+
+		if (ctx->router == NULL && ctx->path_table_nb > 0) {
+			/* Compile the path table for this connection */
+			ctx->router = h3zero_router_create(ctx->path_table, ctx->path_table_nb);
+			ctx->is_router_owned = 1;
+		}
+
+		if ((ctx->path_table_nb > 0 && ctx->router == NULL) ||
+			h3zero_set_qpack_parameters(ctx, (param == NULL) ? 0 : param->qpack_max_table_capacity,
+			(param == NULL) ? 0 : param->qpack_blocked_streams) != 0) {
+			h3zero_callback_delete_context(NULL, ctx);
+			ctx = NULL;
 		}
 	}
 
@@ -805,9 +1190,50 @@ void h3zero_callback_delete_context(picoquic_cnx_t* cnx, h3zero_callback_ctx_t*
 {
 	h3zero_delete_all_stream_prefixes(cnx, ctx);
 	picosplay_empty_tree(&ctx->h3_stream_tree);
+	h3zero_delete_stream_index(ctx);
+	h3zero_frame_pool_release(&ctx->frame_pool);
+	h3zero_qpack_encoder_release(&ctx->qpack_encoder);
+	h3zero_qpack_decoder_release(&ctx->qpack_decoder);
+	if (ctx->is_router_owned && ctx->router != NULL) {
+		h3zero_router_delete(ctx->router);
+	}
 	free(ctx);
 }
 
+int h3zero_set_qpack_parameters(h3zero_callback_ctx_t* ctx, uint64_t max_table_capacity, uint64_t blocked_streams)
+{
+	int ret = 0;
+
+	h3zero_qpack_encoder_release(&ctx->qpack_encoder);
+	h3zero_qpack_decoder_release(&ctx->qpack_decoder);
+	ctx->qpack_max_table_capacity = max_table_capacity;
+	ctx->qpack_blocked_streams = blocked_streams;
+	if (h3zero_qpack_encoder_init(&ctx->qpack_encoder, max_table_capacity) != 0 ||
+		h3zero_qpack_decoder_init(&ctx->qpack_decoder, max_table_capacity, blocked_streams) != 0) {
+		ret = -1;
+	}
+	return ret;
+}
+
+/* Send the QPACK instructions queued by the encoder and the decoder.
+ */
+int h3zero_qpack_flush(picoquic_cnx_t* cnx, h3zero_callback_ctx_t* ctx)
+{
+	int ret = 0;
+
+	if (ctx->qpack_encoder.instructions.length > 0 && ctx->qpack_encoder_stream_id != UINT64_MAX) {
+		ret = picoquic_add_to_stream(cnx, ctx->qpack_encoder_stream_id,
+			ctx->qpack_encoder.instructions.bytes, ctx->qpack_encoder.instructions.length, 0);
+		ctx->qpack_encoder.instructions.length = 0;
+	}
+	if (ret == 0 && ctx->qpack_decoder.instructions.length > 0 && ctx->qpack_decoder_stream_id != UINT64_MAX) {
+		ret = picoquic_add_to_stream(cnx, ctx->qpack_decoder_stream_id,
+			ctx->qpack_decoder.instructions.bytes, ctx->qpack_decoder.instructions.length, 0);
+		ctx->qpack_decoder.instructions.length = 0;
+	}
+	return ret;
+}
+
 /* The picoquic callback bundles DATA and FIN. 
 * We maintain this bundling, so the application has complete control on
 * the stream context.
@@ -856,7 +1282,13 @@ int h3zero_process_remote_stream(picoquic_cnx_t* cnx,
 		if (bytes == NULL) {
 			picoquic_log_app_message(cnx, "Cannot parse incoming stream: %" PRIu64", error: %" PRIu64,
 				stream_id, error_found);
-			ret = picoquic_stop_sending(cnx, stream_id, error_found);
+			if (error_found == H3ZERO_QPACK_ENCODER_STREAM_ERROR || error_found == H3ZERO_QPACK_DECODER_STREAM_ERROR) {
+				/* Errors on the QPACK streams are connection errors */
+				ret = picoquic_close(cnx, error_found);
+			}
+			else {
+				ret = picoquic_stop_sending(cnx, stream_id, error_found);
+			}
 		}
 		else if (bytes < bytes_max || fin_or_event == picoquic_callback_stream_fin) {
 			ret = h3zero_post_data_or_fin(cnx, bytes, bytes_max - bytes, fin_or_event, stream_ctx);
@@ -900,18 +1332,66 @@ Picoquic POST Response\
 int h3zero_server_parse_path(const uint8_t* path, size_t path_length, uint64_t* echo_size,
 	char** file_path, char const* web_folder, int* file_error);
 
+/* Linear search of the path table, with the same precedence as
+ * h3zero_router_find: the longest exact route, or else the longest prefix
+ * that ends before the query. If the same path appears several times,
+ * the first entry is used. */
 int h3zero_find_path_item(const uint8_t * path, size_t path_length, const picohttp_server_path_item_t * path_table, size_t path_table_nb)
 {
-	size_t i = 0;
+	size_t path_end = h3zero_pathabempty_length(path, path_length);
+	int exact_item = -1;
+	int prefix_item = -1;
+
+	for (size_t i = 0; i < path_table_nb; i++) {
+		size_t item_length = path_table[i].path_length;
+
+		if (path_length >= item_length && memcmp(path, path_table[i].path, item_length) == 0) {
+			if (path_table[i].is_prefix) {
+				if (item_length <= path_end &&
+					(prefix_item < 0 || item_length > path_table[prefix_item].path_length)) {
+					prefix_item = (int)i;
+				}
+			}
+			else if ((path_length == item_length || path[item_length] == (uint8_t)'?') &&
+				(exact_item < 0 || item_length > path_table[exact_item].path_length)) {
+				exact_item = (int)i;
+			}
+		}
+	}
+	return (exact_item >= 0) ? exact_item : prefix_item;
+}
 
-	while (i < path_table_nb) {
-		if (path_length >= path_table[i].path_length && memcmp(path, path_table[i].path, path_table[i].path_length) == 0){
-			if (path_length == path_table[i].path_length || path[path_table[i].path_length] == (uint8_t)'?')
-				return (int)i;
+/* Find the path item with the compiled router if there is one, or else
+ * with a linear search of the path table. The match is documented in
+ * the same way in both cases. */
+int h3zero_route_path(h3zero_callback_ctx_t* ctx, const uint8_t* path, size_t path_length, h3zero_route_match_t* match)
+{
+	if (ctx->router != NULL) {
+		(void)h3zero_router_find(ctx->router, path, path_length, match);
+	}
+	else {
+		size_t path_end = h3zero_pathabempty_length(path, path_length);
+
+		match->path_item = h3zero_find_path_item(path, path_length, ctx->path_table, ctx->path_table_nb);
+		if (match->path_item >= 0 && ctx->path_table[match->path_item].is_prefix) {
+			match->suffix = path + ctx->path_table[match->path_item].path_length;
+			match->suffix_length = path_end - ctx->path_table[match->path_item].path_length;
+		}
+		else {
+			match->suffix = path + path_end;
+			match->suffix_length = 0;
+		}
+		if (path_end < path_length) {
+			match->query = path + path_end + 1;
+			match->query_length = path_length - path_end - 1;
+		}
+		else {
+			match->query = NULL;
+			match->query_length = 0;
 		}
-		i++;
 	}
-	return -1;
+
+	return match->path_item;
 }
 
 
@@ -919,6 +1399,35 @@ int h3zero_find_path_item(const uint8_t * path, size_t path_length, const picoht
 * This function is called after the client's stream is closed,
 * after verifying that a request was received */
 
+/* Send a response from the response cache. The cached bytes include the
+ * header frame, the data frame header and the body of small pages. Larger
+ * bodies are sent from the file entry, or generated, when the stream
+ * becomes active.
+ */
+static int h3zero_send_cached_response(picoquic_cnx_t* cnx, h3zero_stream_ctx_t* stream_ctx,
+	h3zero_response_entry_t* cached)
+{
+	int ret = 0;
+	int is_fin_stream = (cached->echo_length == 0);
+
+	stream_ctx->echo_length = cached->echo_length;
+	stream_ctx->echo_sent = 0;
+	if (cached->file_entry != NULL && stream_ctx->file_entry == NULL) {
+		stream_ctx->file_entry = h3zero_file_cache_reference(cached->file_entry);
+	}
+
+	ret = picoquic_add_to_stream_with_ctx(cnx, stream_ctx->stream_id,
+		cached->response, cached->response_length, is_fin_stream, stream_ctx);
+	if (ret != 0) {
+		ret = picoquic_reset_stream(cnx, stream_ctx->stream_id, H3ZERO_INTERNAL_ERROR);
+	}
+	else if (!is_fin_stream) {
+		ret = picoquic_mark_active_stream(cnx, stream_ctx->stream_id, 1, stream_ctx);
+	}
+
+	return ret;
+}
+
 int h3zero_process_request_frame(
 	picoquic_cnx_t* cnx,
 	h3zero_stream_ctx_t * stream_ctx,
@@ -932,34 +1441,51 @@ int h3zero_process_request_frame(
 	uint64_t response_length = 0;
 	int ret = 0;
 	int file_error = 0;
+	h3zero_response_entry_t* cached = NULL;
+
+	(void)h3zero_set_request_priority(cnx, stream_ctx, app_ctx);
 
 	*o_bytes++ = h3zero_frame_header;
 	o_bytes += 2; /* reserve two bytes for frame length */
 
 	if (stream_ctx->ps.stream_state.header.method == h3zero_method_get) {
 		/* Manage GET */
-		if (h3zero_server_parse_path(stream_ctx->ps.stream_state.header.path, stream_ctx->ps.stream_state.header.path_length,
+		if (app_ctx->response_cache != NULL && (cached = h3zero_response_cache_get(app_ctx->response_cache,
+			stream_ctx->ps.stream_state.header.path, stream_ctx->ps.stream_state.header.path_length,
+			picoquic_get_quic_time(cnx->quic))) != NULL) {
+			/* Cache hit, no need to resolve the path or encode the header */
+		}
+		else if (h3zero_server_parse_path(stream_ctx->ps.stream_state.header.path, stream_ctx->ps.stream_state.header.path_length,
 			&stream_ctx->echo_length, &stream_ctx->file_path, app_ctx->web_folder, &file_error) != 0) {
 			char log_text[256];
 			picoquic_log_app_message(cnx, "Cannot find file for path: <%s> in folder <%s>, error: 0x%x",
 				picoquic_uint8_to_str(log_text, 256, stream_ctx->ps.stream_state.header.path, stream_ctx->ps.stream_state.header.path_length),
 				(app_ctx->web_folder == NULL) ? "NULL" : app_ctx->web_folder, file_error);
 			/* If unknown, 404 */
-			o_bytes = h3zero_create_not_found_header_frame(o_bytes, o_bytes_max);
+			o_bytes = h3zero_create_error_frame_qpack(o_bytes, o_bytes_max, "404", H3ZERO_USER_AGENT_STRING,
+				&app_ctx->qpack_encoder, stream_ctx->stream_id);
 			/* TODO: consider known-url?data construct */
 		}
+		else if (app_ctx->response_cache != NULL && (cached = h3zero_response_cache_add(app_ctx->response_cache,
+			stream_ctx->ps.stream_state.header.path, stream_ctx->ps.stream_state.header.path_length,
+			stream_ctx->file_path, stream_ctx->echo_length, (const uint8_t*)h3zero_server_default_page,
+			strlen(h3zero_server_default_page), (stream_ctx->echo_length == 0) ? h3zero_content_type_text_html :
+			h3zero_content_type_text_plain, H3ZERO_USER_AGENT_STRING, picoquic_get_quic_time(cnx->quic))) != NULL) {
+			/* The response is now cached, it will be sent from the cache */
+		}
 		else {
 			response_length = (stream_ctx->echo_length == 0) ?
 				strlen(h3zero_server_default_page) : stream_ctx->echo_length;
-			o_bytes = h3zero_create_response_header_frame(o_bytes, o_bytes_max,
+			o_bytes = h3zero_create_response_header_frame_qpack(o_bytes, o_bytes_max,
 				(stream_ctx->echo_length == 0) ? h3zero_content_type_text_html :
-				h3zero_content_type_text_plain);
+				h3zero_content_type_text_plain, H3ZERO_USER_AGENT_STRING, &app_ctx->qpack_encoder, stream_ctx->stream_id);
 		}
 	}
 	else if (stream_ctx->ps.stream_state.header.method == h3zero_method_post) {
 		/* Manage Post. */
 		if (stream_ctx->path_callback == NULL && stream_ctx->post_received == 0) {
-			int path_item = h3zero_find_path_item(stream_ctx->ps.stream_state.header.path, stream_ctx->ps.stream_state.header.path_length, app_ctx->path_table, app_ctx->path_table_nb);
+			int path_item = h3zero_route_path(app_ctx, stream_ctx->ps.stream_state.header.path, stream_ctx->ps.stream_state.header.path_length,
+				&stream_ctx->route);
 			if (path_item >= 0) {
 				/* TODO-POST: move this code to post-fin callback.*/
 				stream_ctx->path_callback = app_ctx->path_table[path_item].path_callback;
@@ -980,27 +1506,30 @@ int h3zero_process_request_frame(
 
 		/* If known, create response header frame */
 		/* POST-TODO: provide content type of response as part of context */
-		o_bytes = h3zero_create_response_header_frame(o_bytes, o_bytes_max,
+		o_bytes = h3zero_create_response_header_frame_qpack(o_bytes, o_bytes_max,
 			(stream_ctx->echo_length == 0) ? h3zero_content_type_text_html :
-			h3zero_content_type_text_plain);
+			h3zero_content_type_text_plain, H3ZERO_USER_AGENT_STRING, &app_ctx->qpack_encoder, stream_ctx->stream_id);
 	}
 	else if (stream_ctx->ps.stream_state.header.method == h3zero_method_connect) {
 		/* The connect handling depends on the requested protocol */
 
 		if (stream_ctx->path_callback == NULL) {
-			int path_item = h3zero_find_path_item(stream_ctx->ps.stream_state.header.path, stream_ctx->ps.stream_state.header.path_length, app_ctx->path_table, app_ctx->path_table_nb);
+			int path_item = h3zero_route_path(app_ctx, stream_ctx->ps.stream_state.header.path, stream_ctx->ps.stream_state.header.path_length,
+				&stream_ctx->route);
 			if (path_item >= 0) {
 				stream_ctx->path_callback = app_ctx->path_table[path_item].path_callback;
 				if (stream_ctx->path_callback(cnx, (uint8_t*)stream_ctx->ps.stream_state.header.path, stream_ctx->ps.stream_state.header.path_length, picohttp_callback_connect,
 					stream_ctx, app_ctx->path_table[path_item].path_app_ctx) != 0) {
 					/* This callback is not supported */
 					picoquic_log_app_message(cnx, "Unsupported callback on stream: %"PRIu64 ", path:%s", stream_ctx->stream_id, app_ctx->path_table[path_item].path);
-					o_bytes = h3zero_create_error_frame(o_bytes, o_bytes_max, "501", H3ZERO_USER_AGENT_STRING);
+					o_bytes = h3zero_create_error_frame_qpack(o_bytes, o_bytes_max, "501", H3ZERO_USER_AGENT_STRING,
+						&app_ctx->qpack_encoder, stream_ctx->stream_id);
 				}
 				else {
 					/* Create a connect accept frame */
 					picoquic_log_app_message(cnx, "Connect accepted on stream: %"PRIu64 ", path:%s", stream_ctx->stream_id, app_ctx->path_table[path_item].path);
-					o_bytes = h3zero_create_response_header_frame(o_bytes, o_bytes_max, h3zero_content_type_none);
+					o_bytes = h3zero_create_response_header_frame_qpack(o_bytes, o_bytes_max, h3zero_content_type_none,
+						H3ZERO_USER_AGENT_STRING, &app_ctx->qpack_encoder, stream_ctx->stream_id);
 					stream_ctx->is_upgraded = 1;
 				}
 			}
@@ -1009,7 +1538,8 @@ int h3zero_process_request_frame(
 				char log_text[256];
 				picoquic_log_app_message(cnx, "cannot find path context on stream: %"PRIu64 ", path:%s", stream_ctx->stream_id,
 					picoquic_uint8_to_str(log_text, 256, stream_ctx->ps.stream_state.header.path, stream_ctx->ps.stream_state.header.path_length));
-				o_bytes = h3zero_create_not_found_header_frame(o_bytes, o_bytes_max);
+				o_bytes = h3zero_create_error_frame_qpack(o_bytes, o_bytes_max, "404", H3ZERO_USER_AGENT_STRING,
+					&app_ctx->qpack_encoder, stream_ctx->stream_id);
 			}
 		}
 		else {
@@ -1022,10 +1552,14 @@ int h3zero_process_request_frame(
 	{
 		/* unsupported method */
 		picoquic_log_app_message(cnx, "Unsupported method on stream: %"PRIu64, stream_ctx->stream_id);
-		o_bytes = h3zero_create_error_frame(o_bytes, o_bytes_max, "501", H3ZERO_USER_AGENT_STRING);
+		o_bytes = h3zero_create_error_frame_qpack(o_bytes, o_bytes_max, "501", H3ZERO_USER_AGENT_STRING,
+			&app_ctx->qpack_encoder, stream_ctx->stream_id);
 	}
 
-	if (o_bytes == NULL) {
+	if (cached != NULL) {
+		ret = h3zero_send_cached_response(cnx, stream_ctx, cached);
+	}
+	else if (o_bytes == NULL) {
 		picoquic_log_app_message(cnx, "Error, resetting stream: %"PRIu64, stream_ctx->stream_id);
 		ret = picoquic_reset_stream(cnx, stream_ctx->stream_id, H3ZERO_INTERNAL_ERROR);
 	}
@@ -1071,8 +1605,12 @@ int h3zero_process_request_frame(
 			if (is_fin_stream && stream_ctx->ps.stream_state.header.method == h3zero_method_connect) {
 				picoquic_log_app_message(cnx, "Setting FIN in connect response on stream: %"PRIu64, stream_ctx->stream_id);
 			}
-			ret = picoquic_add_to_stream_with_ctx(cnx, stream_ctx->stream_id,
-				buffer, o_bytes - buffer, is_fin_stream, stream_ctx);
+			/* Queue the encoder instructions before the header that references them */
+			ret = h3zero_qpack_flush(cnx, app_ctx);
+			if (ret == 0) {
+				ret = picoquic_add_to_stream_with_ctx(cnx, stream_ctx->stream_id,
+					buffer, o_bytes - buffer, is_fin_stream, stream_ctx);
+			}
 			if (ret != 0) {
 				o_bytes = NULL;
 			}
@@ -1134,6 +1672,30 @@ int h3zero_client_close_stream(picoquic_cnx_t * cnx,
 	return ret;
 }
 
+/* Hold the bytes received on a stream while its header is blocked.
+ */
+static int h3zero_hold_blocked_bytes(h3zero_data_stream_state_t* stream_state, uint8_t* bytes, size_t length,
+	picoquic_call_back_event_t fin_or_event)
+{
+	int ret = 0;
+
+	if (length > 0) {
+		uint8_t* new_bytes = (uint8_t*)realloc(stream_state->blocked_bytes, stream_state->blocked_length + length);
+		if (new_bytes == NULL) {
+			ret = -1;
+		}
+		else {
+			memcpy(new_bytes + stream_state->blocked_length, bytes, length);
+			stream_state->blocked_bytes = new_bytes;
+			stream_state->blocked_length += length;
+		}
+	}
+	if (fin_or_event == picoquic_callback_stream_fin) {
+		stream_state->is_blocked_fin = 1;
+	}
+	return ret;
+}
+
 int h3zero_process_h3_server_data(picoquic_cnx_t* cnx,
 	uint64_t stream_id, uint8_t* bytes, size_t length,
 	picoquic_call_back_event_t fin_or_event, h3zero_callback_ctx_t* ctx,
@@ -1151,6 +1713,12 @@ int h3zero_process_h3_server_data(picoquic_cnx_t* cnx,
 			ret = picoquic_close(cnx, error_found);
 			break;
 		}
+		else if (stream_ctx->ps.stream_state.is_header_blocked) {
+			/* Hold the remaining bytes until the encoder instructions arrive */
+			ret = h3zero_hold_blocked_bytes(&stream_ctx->ps.stream_state, bytes, bytes_max - bytes, fin_or_event);
+			process_complete = 1;
+			break;
+		}
 		else if (available_data > 0) {
 			if (stream_ctx->ps.stream_state.is_web_transport) {
 				if (stream_ctx->path_callback == NULL) {
@@ -1167,7 +1735,8 @@ int h3zero_process_h3_server_data(picoquic_cnx_t* cnx,
 				}
 			}
 			else if (stream_ctx->ps.stream_state.header_found && stream_ctx->post_received == 0) {
-				int path_item = h3zero_find_path_item(stream_ctx->ps.stream_state.header.path, stream_ctx->ps.stream_state.header.path_length, ctx->path_table, ctx->path_table_nb);
+				int path_item = h3zero_route_path(ctx, stream_ctx->ps.stream_state.header.path, stream_ctx->ps.stream_state.header.path_length,
+					&stream_ctx->route);
 				if (path_item >= 0) {
 					stream_ctx->path_callback = ctx->path_table[path_item].path_callback;
 					stream_ctx->path_callback(cnx, (uint8_t*)stream_ctx->ps.stream_state.header.path, stream_ctx->ps.stream_state.header.path_length, picohttp_callback_post,
@@ -1230,6 +1799,20 @@ int h3zero_process_h3_server_data(picoquic_cnx_t* cnx,
 	return ret;
 }
 
+static void h3zero_client_header_received(picoquic_cnx_t* cnx, h3zero_stream_ctx_t* stream_ctx)
+{
+	int is_success = (stream_ctx->ps.stream_state.header.status >= 200 &&
+		stream_ctx->ps.stream_state.header.status < 300);
+	if (stream_ctx->ps.stream_state.is_upgrade_requested) {
+		stream_ctx->is_upgraded = is_success;
+	}
+	if (stream_ctx->path_callback != NULL) {
+		stream_ctx->path_callback(cnx, NULL, 0, (is_success) ?
+			picohttp_callback_connect_accepted : picohttp_callback_connect_refused,
+			stream_ctx, stream_ctx->path_callback_ctx);
+	}
+}
+
 int h3zero_process_h3_client_data(picoquic_cnx_t* cnx,
 	uint64_t stream_id, uint8_t* bytes, size_t length,
 	picoquic_call_back_event_t fin_or_event, h3zero_callback_ctx_t* ctx,
@@ -1254,18 +1837,14 @@ int h3zero_process_h3_client_data(picoquic_cnx_t* cnx,
 				}
 				break;
 			}
+			else if (stream_ctx->ps.stream_state.is_header_blocked) {
+				/* Hold the remaining bytes until the encoder instructions arrive */
+				ret = h3zero_hold_blocked_bytes(&stream_ctx->ps.stream_state, bytes, bytes_max - bytes, fin_or_event);
+				break;
+			}
 			else {
 				if (header_required && stream_ctx->ps.stream_state.header_found && picoquic_is_client(cnx)) {
-					int is_success = (stream_ctx->ps.stream_state.header.status >= 200 &&
-						stream_ctx->ps.stream_state.header.status < 300);
-					if (stream_ctx->ps.stream_state.is_upgrade_requested) {
-						stream_ctx->is_upgraded = is_success;
-					}
-					if (stream_ctx->path_callback != NULL) {
-						stream_ctx->path_callback(cnx, NULL, 0, (is_success) ?
-							picohttp_callback_connect_accepted : picohttp_callback_connect_refused,
-							stream_ctx, stream_ctx->path_callback_ctx);
-					}
+					h3zero_client_header_received(cnx, stream_ctx);
 				}
 				if (available_data > 0) {
 					if (!stream_ctx->flow_opened) {
@@ -1291,7 +1870,7 @@ int h3zero_process_h3_client_data(picoquic_cnx_t* cnx,
 		}
 	}
 
-	if (fin_or_event == picoquic_callback_stream_fin) {
+	if (fin_or_event == picoquic_callback_stream_fin && !stream_ctx->ps.stream_state.is_header_blocked) {
 		if (stream_ctx->path_callback != NULL) {
 			stream_ctx->path_callback(cnx, NULL, 0, picohttp_callback_post_fin, stream_ctx, stream_ctx->path_callback_ctx);
 		}
@@ -1347,7 +1926,11 @@ int h3zero_callback_data(picoquic_cnx_t* cnx,
 		}
 	}
 	if (ret == 0) {
-		if (stream_ctx->is_upgraded) {
+		if (stream_ctx->is_h3 && stream_ctx->ps.stream_state.is_header_blocked) {
+			/* Nothing can be parsed until the header is decoded */
+			ret = h3zero_hold_blocked_bytes(&stream_ctx->ps.stream_state, bytes, length, fin_or_event);
+		}
+		else if (stream_ctx->is_upgraded) {
 			ret = h3zero_post_data_or_fin(cnx, bytes, length, fin_or_event, stream_ctx);
 		}
 		else if (IS_BIDIR_STREAM_ID(stream_id)) {
@@ -1391,6 +1974,59 @@ int h3zero_callback_data(picoquic_cnx_t* cnx,
 }
 
 
+/* Resume the streams whose header was blocked, once the encoder instructions
+ * that they reference have been received. Processing a stream may create or
+ * delete other streams, so the scan restarts after each resumed stream.
+ */
+static int h3zero_qpack_unblock_streams(picoquic_cnx_t* cnx, h3zero_callback_ctx_t* ctx)
+{
+	int ret = 0;
+	picosplay_node_t* node = (ctx->qpack_decoder.nb_blocked_streams > 0) ? picosplay_first(&ctx->h3_stream_tree) : NULL;
+
+	while (ret == 0 && node != NULL) {
+		h3zero_stream_ctx_t* stream_ctx = (h3zero_stream_ctx_t*)picohttp_stream_node_value(node);
+		h3zero_data_stream_state_t* stream_state = &stream_ctx->ps.stream_state;
+
+		if (stream_ctx->is_h3 && stream_state->is_header_blocked &&
+			h3zero_qpack_section_is_blocked(&ctx->qpack_decoder, stream_state->current_frame,
+				stream_state->current_frame + stream_state->current_frame_length) == 0) {
+			uint64_t error_found = 0;
+			uint64_t fin_stream_id = UINT64_MAX;
+			uint8_t* held = stream_state->blocked_bytes;
+			size_t held_length = stream_state->blocked_length;
+			picoquic_call_back_event_t fin_or_event = (stream_state->is_blocked_fin) ?
+				picoquic_callback_stream_fin : picoquic_callback_stream_data;
+
+			stream_state->is_header_blocked = 0;
+			stream_state->is_blocked_fin = 0;
+			stream_state->blocked_bytes = NULL;
+			stream_state->blocked_length = 0;
+			ctx->qpack_decoder.nb_blocked_streams--;
+
+			if (h3zero_parse_header_frame_content(stream_state, stream_state->current_frame, &error_found) != 0) {
+				ret = picoquic_close(cnx, error_found);
+			}
+			else {
+				if (cnx->client_mode && stream_ctx->is_open) {
+					h3zero_client_header_received(cnx, stream_ctx);
+				}
+				if (held_length > 0 || fin_or_event == picoquic_callback_stream_fin || !cnx->client_mode) {
+					ret = h3zero_callback_data(cnx, stream_ctx->stream_id, held, held_length, fin_or_event,
+						ctx, stream_ctx, &fin_stream_id);
+				}
+			}
+			if (held != NULL) {
+				free(held);
+			}
+			node = (ctx->qpack_decoder.nb_blocked_streams > 0) ? picosplay_first(&ctx->h3_stream_tree) : NULL;
+		}
+		else {
+			node = picosplay_next(node);
+		}
+	}
+	return ret;
+}
+
 /* Prepare to send. This is the same code as on the client side, except for the
 * delayed opening of the data file */
 int h3zero_prepare_to_send_buffer(void* context, size_t space,
@@ -1436,12 +2072,41 @@ int h3zero_prepare_to_send_buffer(void* context, size_t space,
 	return ret;
 }
 
+/* Send file content from the file cache, copying directly from the
+ * cached mapping or file into the stream buffer. */
+static int h3zero_prepare_to_send_file_entry(void* context, size_t space,
+	uint64_t echo_length, uint64_t* echo_sent, h3zero_file_entry_t* file_entry)
+{
+	int ret = 0;
+
+	if (*echo_sent < echo_length) {
+		uint8_t* buffer;
+		uint64_t available = echo_length - *echo_sent;
+		int is_fin = 1;
+
+		if (available > space) {
+			available = space;
+			is_fin = 0;
+		}
+
+		buffer = picoquic_provide_stream_data_buffer(context, (size_t)available, is_fin, !is_fin);
+		if (buffer == NULL || h3zero_file_entry_read(file_entry, *echo_sent, buffer, (size_t)available) != 0) {
+			ret = -1;
+		}
+		else {
+			*echo_sent += available;
+		}
+	}
+
+	return ret;
+}
+
 int h3zero_prepare_to_send(int client_mode, void* context, size_t space,
 	h3zero_stream_ctx_t* stream_ctx)
 {
 	int ret = 0;
 
-	if (!client_mode && stream_ctx->F == NULL && stream_ctx->file_path != NULL) {
+	if (!client_mode && stream_ctx->file_entry == NULL && stream_ctx->F == NULL && stream_ctx->file_path != NULL) {
 		stream_ctx->F = picoquic_file_open(stream_ctx->file_path, "rb");
 		if (stream_ctx->F == NULL) {
 			ret = -1;
@@ -1452,6 +2117,10 @@ int h3zero_prepare_to_send(int client_mode, void* context, size_t space,
 		if (client_mode) {
 			ret = h3zero_prepare_to_send_buffer(context, space, stream_ctx->post_size, &stream_ctx->post_sent, NULL);
 		}
+		else if (stream_ctx->file_entry != NULL) {
+			ret = h3zero_prepare_to_send_file_entry(context, space, stream_ctx->echo_length, &stream_ctx->echo_sent,
+				stream_ctx->file_entry);
+		}
 		else {
 			ret = h3zero_prepare_to_send_buffer(context, space, stream_ctx->echo_length, &stream_ctx->echo_sent,
 				stream_ctx->F);
@@ -1481,6 +2150,10 @@ int h3zero_callback_prepare_to_send(picoquic_cnx_t* cnx,
 		}
 		else {
 			/* default reply for known URL */
+			if (!cnx->client_mode && ctx->file_cache != NULL && stream_ctx->file_entry == NULL &&
+				stream_ctx->F == NULL && stream_ctx->file_path != NULL) {
+				stream_ctx->file_entry = h3zero_file_cache_open(ctx->file_cache, stream_ctx->file_path);
+			}
 			ret = h3zero_prepare_to_send(cnx->client_mode, context, space, stream_ctx);
 			/* if finished sending on server, delete stream */
 			if (!cnx->client_mode) {
@@ -1509,9 +2182,13 @@ int h3zero_callback_prepare_to_send(picoquic_cnx_t* cnx,
 *  the corresponding callback. If that callback fail, or if the prefix is not
 *  registered, it returns an error.
 * 
-*  Sending of callback is by polling the prefixes that are marked active for
-*  datagrams, in round robin fashion. If the datagram can be sent, the code
-*  automatically include the quarter stream ID corresponding to the context.
+*  Sending is driven by a queue of the prefixes that are marked active for
+*  datagrams, served in round robin fashion. Picoquic polls again as long as
+*  the connection is marked ready and there is space left in the packet, so
+*  datagrams of several sessions can share a packet. If the datagram can be
+*  sent, the code automatically includes the quarter stream ID corresponding
+*  to the context, and the application writes the payload directly in the
+*  packet buffer.
 */
 
 int h3zero_callback_datagram(picoquic_cnx_t* cnx, uint8_t* bytes, size_t length, h3zero_callback_ctx_t* h3_ctx)
@@ -1526,7 +2203,7 @@ int h3zero_callback_datagram(picoquic_cnx_t* cnx, uint8_t* bytes, size_t length,
 		/* find the control stream context, using the full stream ID */
 		h3zero_stream_prefix_t* prefix_ctx = h3zero_find_stream_prefix(h3_ctx, quarter_stream_id*4);
 
-		if (prefix_ctx->function_call == NULL) {
+		if (prefix_ctx == NULL || prefix_ctx->function_call == NULL) {
 			/* Should signal the error HTTP_DATAGRAM_ERROR */
 		} else {
 			h3zero_stream_ctx_t* stream_ctx = h3zero_find_stream(h3_ctx, prefix_ctx->prefix);
@@ -1594,10 +2271,13 @@ static int h3zero_callback_prepare_datagram_in_context(picoquic_cnx_t* cnx, void
 				/* the application might have called the mark active API, so we use an OR here */
 				prefix_ctx->ready_to_send_datagrams |= pdg_ctx.application_ready;
 				if (pdg_ctx.application_length > 0) {
-					h3_ctx->last_datagram_prefix = prefix_ctx->prefix;
 					data_sent = 1;
 				}
 			}
+			else {
+				/* Not enough space in this packet, try again in the next one */
+				prefix_ctx->ready_to_send_datagrams = 1;
+			}
 		}
 	}
 	return data_sent;
@@ -1605,49 +2285,26 @@ static int h3zero_callback_prepare_datagram_in_context(picoquic_cnx_t* cnx, void
 
 int h3zero_callback_prepare_datagram(picoquic_cnx_t* cnx, void* context, size_t space, h3zero_callback_ctx_t* h3_ctx)
 {
-	/* First pass will start just after the last datagram prefix polled, then next pass until that prefix  */
-	h3zero_stream_prefix_t * previous_prefix_ctx = h3zero_find_stream_prefix(h3_ctx, h3_ctx->last_datagram_prefix);
-	h3zero_stream_prefix_t * prefix_ctx = (previous_prefix_ctx == NULL) ? NULL : previous_prefix_ctx->next;
+	/* Poll the ready prefixes in queue order, until one of them sends a datagram.
+	 * The prefixes that remain ready go back to the end of the queue. At most one
+	 * turn of the queue is done per call, so prefixes whose datagrams do not fit
+	 * in the remaining space do not cause a loop. */
+	h3zero_stream_prefixes_t* prefixes = &h3_ctx->stream_prefixes;
+	h3zero_stream_prefix_t* last_in_turn = prefixes->last_ready;
+	h3zero_stream_prefix_t* prefix_ctx;
 	int data_sent = 0;
-	int still_active = 0;
-	int all_checked = 0;
-	/* checked the prefixes after the last sent one. */
-	while (prefix_ctx != NULL) {
+
+	while (!data_sent && (prefix_ctx = prefixes->first_ready) != NULL) {
+		h3zero_stream_prefix_remove_ready(prefixes, prefix_ctx);
 		data_sent = h3zero_callback_prepare_datagram_in_context(cnx, context, space, h3_ctx, prefix_ctx);
-		still_active |= prefix_ctx->ready_to_send_datagrams;
-		if (data_sent) {
-			break;
-		}
-		else {
-			prefix_ctx = prefix_ctx->next;
+		if (prefix_ctx->ready_to_send_datagrams) {
+			h3zero_stream_prefix_enqueue_ready(prefixes, prefix_ctx);
 		}
-	}
-	if (!data_sent) {
-		/* The previous loop only checked the prefixes after the last sent one. Now test the other ones. */
-		prefix_ctx = h3_ctx->stream_prefixes.first;
-		while (prefix_ctx != NULL) {
-			data_sent = h3zero_callback_prepare_datagram_in_context(cnx, context, space, h3_ctx, prefix_ctx);
-			still_active |= prefix_ctx->ready_to_send_datagrams;
-			if (data_sent) {
-				break;
-			}
-			else if (prefix_ctx == previous_prefix_ctx) {
-				all_checked = 1;
-				break;
-			} else {
-				prefix_ctx = prefix_ctx->next;
-			}
-		}
-	}
-	if (!all_checked) {
-		/* The previous loops concluded without checking all prefixes, so recheck */
-		prefix_ctx = h3_ctx->stream_prefixes.first;
-		while (prefix_ctx != NULL && !still_active) {
-			still_active |= prefix_ctx->ready_to_send_datagrams;
-			prefix_ctx = prefix_ctx->next;
+		if (prefix_ctx == last_in_turn) {
+			break;
 		}
 	}
-	picoquic_mark_datagram_ready(cnx, still_active);
+	picoquic_mark_datagram_ready(cnx, prefixes->first_ready != NULL);
 	return 0;
 }
 
@@ -1662,6 +2319,7 @@ int h3zero_set_datagram_ready(picoquic_cnx_t* cnx, uint64_t stream_id)
 		if (prefix_ctx != NULL) {
 			/* mark this control stream as ready for sending datagrams. */
 			prefix_ctx->ready_to_send_datagrams = 1;
+			h3zero_stream_prefix_enqueue_ready(&h3_ctx->stream_prefixes, prefix_ctx);
 			/* declare readiness to picoquic. */
 			ret = picoquic_mark_datagram_ready(cnx, 1);
 		}
@@ -1690,7 +2348,7 @@ int h3zero_callback(picoquic_cnx_t* cnx,
 		}
 		else {
 			picoquic_set_callback(cnx, h3zero_callback, ctx);
-			ret = h3zero_protocol_init(cnx);
+			ret = h3zero_protocol_init_ex(cnx, ctx);
 		}
 	} else{
 		ctx = (h3zero_callback_ctx_t*)callback_ctx;
@@ -1703,6 +2361,12 @@ int h3zero_callback(picoquic_cnx_t* cnx,
 			/* Data arrival on stream #x, maybe with fin mark */
 			ret = h3zero_callback_data(cnx, stream_id, bytes, length,
 				fin_or_event, ctx, stream_ctx, &fin_stream_id);
+			if (ret == 0) {
+				ret = h3zero_qpack_unblock_streams(cnx, ctx);
+			}
+			if (ret == 0) {
+				ret = h3zero_qpack_flush(cnx, ctx);
+			}
 			break;
 		case picoquic_callback_stream_reset: /* Peer reset stream #x */
 		case picoquic_callback_stop_sending: /* Peer asks server to reset stream #x */
@@ -1895,6 +2559,46 @@ const uint8_t* h3zero_settings_decode(const uint8_t* bytes, const uint8_t* bytes
 }
 
 
+/* PRIORITY_UPDATE frame, RFC 9218 section 7.
+ * The frame contains the ID of the prioritized request stream, followed by
+ * a priority field value in the same format as the priority header.
+ */
+uint8_t* h3zero_priority_update_encode(uint8_t* bytes, const uint8_t* bytes_max, uint64_t stream_id,
+	uint8_t urgency, int incremental)
+{
+	char field[8];
+	size_t field_length = h3zero_format_priority_field(field, sizeof(field), urgency, incremental);
+	size_t frame_length = picoquic_frames_varint_encode_length(stream_id) + field_length;
+
+	if ((bytes = picoquic_frames_varint_encode(bytes, bytes_max, h3zero_frame_priority_update_request)) != NULL &&
+		(bytes = picoquic_frames_varint_encode(bytes, bytes_max, frame_length)) != NULL &&
+		(bytes = picoquic_frames_varint_encode(bytes, bytes_max, stream_id)) != NULL) {
+		if (bytes + field_length > bytes_max) {
+			bytes = NULL;
+		}
+		else {
+			memcpy(bytes, field, field_length);
+			bytes += field_length;
+		}
+	}
+	return bytes;
+}
+
+const uint8_t* h3zero_priority_update_components_decode(const uint8_t* bytes, const uint8_t* bytes_max,
+	uint64_t* stream_id, uint8_t* urgency, int* incremental)
+{
+	if ((bytes = picoquic_frames_varint_decode(bytes, bytes_max, stream_id)) != NULL) {
+		if (h3zero_parse_priority_field(bytes, bytes_max - bytes, urgency, incremental) != 0) {
+			bytes = NULL;
+		}
+		else {
+			bytes = bytes_max;
+		}
+	}
+	return bytes;
+}
+
+
 /* TLV buffer accumulator.
 * This is commonly used when parsing data streams.
 */
@@ -1977,7 +2681,7 @@ const uint8_t* h3zero_accumulate_capsule(const uint8_t* bytes, const uint8_t* by
 			capsule->capsule = capsule_buffer;
 			capsule->capsule_buffer_size = capsule->capsule_length;
 		}
-		if (capsule->capsule == NULL) {
+		if (capsule->capsule == NULL && capsule->capsule_length > 0) {
 			capsule->value_read = 0;
 			capsule->capsule_buffer_size = 0;
 			bytes = NULL;
@@ -1986,7 +2690,9 @@ const uint8_t* h3zero_accumulate_capsule(const uint8_t* bytes, const uint8_t* by
 			if (capsule->value_read + available > capsule->capsule_length) {
 				available = capsule->capsule_length - capsule->value_read;
 			}
-			memcpy(capsule->capsule + capsule->value_read, bytes, available);
+			if (available > 0) {
+				memcpy(capsule->capsule + capsule->value_read, bytes, available);
+			}
 			bytes += available;
 			capsule->value_read += available;
 			if (capsule->value_read >= capsule->capsule_length) {
@@ -22,6 +22,7 @@
 #define H3ZERO_COMMON_H
 
 #include "picosplay.h"
+#include "picohash.h"
 #include "h3zero.h"
 
 #ifdef __cplusplus
@@ -63,12 +64,135 @@ extern "C" {
         size_t path_length;
         picohttp_post_data_cb_fn path_callback;
         void* path_app_ctx;
+        int is_prefix; /* Match all paths that start with the path, instead of only the path itself */
     } picohttp_server_path_item_t;
 
+    /* Path table compiled into a trie, built once and shared by all
+     * connections. Exact paths are preferred to prefixes, and longer
+     * prefixes to shorter ones.
+     * See h3zero_router.c for details.
+     */
+    typedef struct st_h3zero_router_node_t {
+        const uint8_t* segment; /* Bytes leading from the parent to this node, inside the path table */
+        uint32_t segment_length;
+        uint32_t first_child; /* Children are contiguous, sorted by label */
+        uint16_t nb_children;
+        uint8_t label; /* First byte of the segment */
+        int exact_item; /* Index in the path table, or -1 */
+        int prefix_item;
+    } h3zero_router_node_t;
+
+    typedef struct st_h3zero_router_t {
+        const picohttp_server_path_item_t* path_table;
+        size_t path_table_nb;
+        h3zero_router_node_t* nodes;
+        size_t nb_nodes;
+    } h3zero_router_t;
+
+    /* Result of a lookup. The suffix and the query point inside the path. */
+    typedef struct st_h3zero_route_match_t {
+        int path_item; /* Index in the path table, or -1 if no route matches */
+        const uint8_t* suffix; /* Part of the path after a prefix route, before the query */
+        size_t suffix_length;
+        const uint8_t* query; /* Part of the path after the '?', NULL if there is no query */
+        size_t query_length;
+    } h3zero_route_match_t;
+
+    h3zero_router_t* h3zero_router_create(const picohttp_server_path_item_t* path_table, size_t path_table_nb);
+    void h3zero_router_delete(h3zero_router_t* router);
+    int h3zero_router_find(const h3zero_router_t* router, const uint8_t* path, size_t path_length, h3zero_route_match_t* match);
+    /* Linear search of the path table, used when there is no router */
+    int h3zero_find_path_item(const uint8_t* path, size_t path_length, const picohttp_server_path_item_t* path_table, size_t path_table_nb);
+
     /* Define stream context common to http 3 and http 09 callbacks
     */
 #define PICOHTTP_SERVER_FRAME_MAX 1024
 
+    /* Cache of open files, shared by the streams that serve the same file.
+     * See h3zero_file_cache.c for details.
+     */
+    struct st_h3zero_file_cache_t;
+
+    typedef struct st_h3zero_file_entry_t {
+        picohash_item hash_item;
+        struct st_h3zero_file_cache_t* cache;
+        struct st_h3zero_file_entry_t* previous_idle;
+        struct st_h3zero_file_entry_t* next_idle;
+        char* file_path;
+        uint64_t file_size;
+        int nb_refs;
+#ifdef _WINDOWS
+        FILE* F;
+#else
+        int fd;
+        const uint8_t* map;
+#endif
+    } h3zero_file_entry_t;
+
+    typedef struct st_h3zero_file_cache_t {
+        picohash_table* table;
+        h3zero_file_entry_t* first_idle;
+        h3zero_file_entry_t* last_idle;
+        size_t nb_idle;
+        size_t max_idle;
+        uint64_t nb_opens;
+        uint64_t nb_hits;
+        uint64_t nb_invalidations;
+    } h3zero_file_cache_t;
+
+    h3zero_file_cache_t* h3zero_file_cache_create(size_t nb_bin, size_t max_idle);
+    void h3zero_file_cache_delete(h3zero_file_cache_t* cache);
+    h3zero_file_entry_t* h3zero_file_cache_open(h3zero_file_cache_t* cache, char const* file_path);
+    void h3zero_file_cache_release(h3zero_file_entry_t* entry);
+    h3zero_file_entry_t* h3zero_file_cache_reference(h3zero_file_entry_t* entry);
+    void h3zero_file_cache_forget(h3zero_file_entry_t* entry);
+    int h3zero_file_entry_read(h3zero_file_entry_t* entry, uint64_t offset, uint8_t* buffer, size_t length);
+
+    /* Cache of responses to GET requests, keyed by path. Each entry holds the
+     * response header frame and the data frame header, encoded with the
+     * static table only so they can be sent on any connection, plus either
+     * a small body or a reference to the file in the file cache.
+     * See h3zero_response_cache.c for details.
+     */
+    typedef struct st_h3zero_response_entry_t {
+        picohash_item hash_item;
+        struct st_h3zero_response_entry_t* previous_lru;
+        struct st_h3zero_response_entry_t* next_lru;
+        uint8_t* path;
+        size_t path_length;
+        uint8_t* response;
+        size_t response_length;
+        uint64_t echo_length;
+        h3zero_file_entry_t* file_entry;
+        int64_t file_mtime;
+        uint64_t last_check_time;
+        size_t size;
+    } h3zero_response_entry_t;
+
+    typedef struct st_h3zero_response_cache_t {
+        picohash_table* table;
+        h3zero_file_cache_t* file_cache;
+        h3zero_response_entry_t* first_lru;
+        h3zero_response_entry_t* last_lru;
+        size_t nb_entries;
+        size_t max_entries;
+        size_t total_size;
+        size_t max_size;
+        uint64_t check_interval;
+        uint64_t nb_hits;
+        uint64_t nb_misses;
+        uint64_t nb_invalidations;
+    } h3zero_response_cache_t;
+
+    h3zero_response_cache_t* h3zero_response_cache_create(h3zero_file_cache_t* file_cache, size_t max_entries,
+        size_t max_size, uint64_t check_interval);
+    void h3zero_response_cache_delete(h3zero_response_cache_t* cache);
+    h3zero_response_entry_t* h3zero_response_cache_get(h3zero_response_cache_t* cache, const uint8_t* path,
+        size_t path_length, uint64_t current_time);
+    h3zero_response_entry_t* h3zero_response_cache_add(h3zero_response_cache_t* cache, const uint8_t* path,
+        size_t path_length, char const* file_path, uint64_t echo_length, const uint8_t* body, size_t body_length,
+        h3zero_content_type_enum doc_type, char const* server_string, uint64_t current_time);
+
     typedef enum {
         picohttp_server_stream_status_none = 0,
         picohttp_server_stream_status_header,
@@ -81,15 +205,20 @@ extern "C" {
         /* TODO-POST: identification of URL to process POST or GET? */
         /* TODO-POST: provide content-type */
         picosplay_node_t http_stream_node;
+        picohash_item stream_index_item;
+        picohash_table* stream_index; /* Set while the stream is in the lookup index */
         picoquic_cnx_t* cnx;
+        h3zero_frame_pool_t* frame_pool; /* Pool of the connection, for the context and the HTTP 0.9 command */
         unsigned int is_h3:1;
         unsigned int is_upgraded:1;
+        unsigned int is_ctx_pooled:1;
+        unsigned int is_frame_pooled:1;
         union {
             h3zero_data_stream_state_t stream_state; /* h3 only */
             struct {
                 picohttp_server_stream_status_t status; 
                 int proto; 
-                uint8_t* path; 
+                uint8_t* path; /* points into the command buffer */
                 size_t path_length;
                 size_t command_length;
                 int method;
@@ -105,16 +234,22 @@ extern "C" {
         unsigned int is_open : 1;
         unsigned int is_file_open : 1;
         unsigned int flow_opened : 1;
+        unsigned int is_priority_updated : 1; /* PRIORITY_UPDATE received, overrides the priority header */
         uint64_t received_length;
         uint64_t post_size;
         uint64_t post_sent;
         char* f_name;
         /* Global state variables */
-        uint8_t frame[PICOHTTP_SERVER_FRAME_MAX];
+        uint8_t* frame; /* HTTP 0.9 command line, allocated when the first bytes are received */
         char* file_path;
         FILE* F;
+        h3zero_file_entry_t* file_entry; /* Used instead of F if the server has a file cache */
         picohttp_post_data_cb_fn path_callback;
         void* path_callback_ctx;
+        /* Route of the request. The suffix and the query point inside the
+         * request path, so path callbacks do not need to parse it again.
+         * The suffix is NULL until the request is routed. */
+        h3zero_route_match_t route;
     } h3zero_stream_ctx_t;
 
     /* Parsing of a data stream. This is implemented as a filter, with a set of states:
@@ -162,13 +297,23 @@ extern "C" {
     const uint8_t* h3zero_settings_components_decode(const uint8_t* bytes, const uint8_t* bytes_max, h3zero_settings_t* settings);
     const uint8_t* h3zero_settings_decode(const uint8_t* bytes, const uint8_t* bytes_max, h3zero_settings_t* settings);
 
+    /* handling of PRIORITY_UPDATE frames, see RFC 9218 */
+    uint8_t* h3zero_priority_update_encode(uint8_t* bytes, const uint8_t* bytes_max, uint64_t stream_id,
+        uint8_t urgency, int incremental);
+    const uint8_t* h3zero_priority_update_components_decode(const uint8_t* bytes, const uint8_t* bytes_max,
+        uint64_t* stream_id, uint8_t* urgency, int* incremental);
+
     /* Handling of stream prefixes, for applications that use it.
      */
     typedef struct st_h3zero_stream_prefix_t {
         struct st_h3zero_stream_prefix_t* next;
         struct st_h3zero_stream_prefix_t* previous;
+        struct st_h3zero_stream_prefix_t* next_ready;
+        struct st_h3zero_stream_prefix_t* previous_ready;
+        picohash_item hash_item;
         uint64_t prefix;
         unsigned int ready_to_send_datagrams : 1;
+        unsigned int is_ready_queued : 1;
         picohttp_post_data_cb_fn function_call;
         void* function_ctx;
     } h3zero_stream_prefix_t;
@@ -176,6 +321,9 @@ extern "C" {
     typedef struct st_h3zero_stream_prefixes_t {
         struct st_h3zero_stream_prefix_t* first;
         struct st_h3zero_stream_prefix_t* last;
+        picohash_table* index; /* Prefixes by value */
+        struct st_h3zero_stream_prefix_t* first_ready; /* Queue of prefixes ready to send datagrams */
+        struct st_h3zero_stream_prefix_t* last_ready;
     } h3zero_stream_prefixes_t;
 
     int h3zero_protocol_init(picoquic_cnx_t* cnx);
@@ -190,18 +338,57 @@ extern "C" {
         char const* web_folder;
         picohttp_server_path_item_t* path_table;
         size_t path_table_nb;
+        /* QPACK dynamic table. Zero means static table only. */
+        uint64_t qpack_max_table_capacity;
+        uint64_t qpack_blocked_streams;
+        /* Optional cache of open files, shared by all connections */
+        h3zero_file_cache_t* file_cache;
+        /* Optional cache of GET responses, shared by all connections */
+        h3zero_response_cache_t* response_cache;
+        /* Optional router compiled from the path table, shared by all connections.
+         * If not set, each connection compiles its own. */
+        h3zero_router_t* router;
     } picohttp_server_parameters_t;
 
+    /* PRIORITY_UPDATE frames may arrive on the control stream before the
+     * request stream is opened. A few of them are kept until the request
+     * is processed; if there are too many, the oldest are dropped.
+     */
+#define H3ZERO_PENDING_PRIORITY_MAX 16
+    typedef struct st_h3zero_pending_priority_t {
+        uint64_t stream_id;
+        uint8_t urgency;
+        int incremental;
+    } h3zero_pending_priority_t;
+
     typedef struct st_h3zero_callback_ctx_t {
         picosplay_tree_t h3_stream_tree;
+        /* Lookup of streams by ID, used when the transport does not provide the stream context */
+        picohash_table* h3_stream_index;
         picohttp_server_path_item_t * path_table;
         size_t path_table_nb;
+        h3zero_router_t* router;
+        int is_router_owned; /* Compiled for this connection, deleted with the context */
         char const* web_folder;
+        h3zero_file_cache_t* file_cache;
+        h3zero_response_cache_t* response_cache;
         /* Settings */
         h3zero_settings_t settings;
+        /* QPACK state. The local settings set the capacity of the decoder
+         * table, the peer settings that of the encoder table. */
+        uint64_t qpack_max_table_capacity;
+        uint64_t qpack_blocked_streams;
+        uint64_t qpack_encoder_stream_id;
+        uint64_t qpack_decoder_stream_id;
+        h3zero_qpack_encoder_t qpack_encoder;
+        h3zero_qpack_decoder_t qpack_decoder;
         /* connection wide tracking of stream prefixes */
         h3zero_stream_prefixes_t stream_prefixes;
-        uint64_t last_datagram_prefix;
+        /* Frame buffers shared by the streams of the connection */
+        h3zero_frame_pool_t frame_pool;
+        /* Priority updates received for streams not yet open */
+        h3zero_pending_priority_t pending_priority[H3ZERO_PENDING_PRIORITY_MAX];
+        size_t nb_pending_priority;
         /* Flag  and variables used by clients*/
         unsigned int no_disk : 1;
         unsigned int no_print : 1;
@@ -214,12 +401,31 @@ extern "C" {
     h3zero_callback_ctx_t* h3zero_callback_create_context(picohttp_server_parameters_t* param);
     void h3zero_callback_delete_context(picoquic_cnx_t* cnx, h3zero_callback_ctx_t* ctx);
 
+    /* Find the route of a request path, with the router of the context or
+     * with a linear search of its path table. Returns the path item, or -1. */
+    int h3zero_route_path(h3zero_callback_ctx_t* ctx, const uint8_t* path, size_t path_length, h3zero_route_match_t* match);
+
+    /* Set the QPACK parameters of a context, before calling h3zero_protocol_init_ex.
+     * The capacity and the number of blocked streams are announced in the settings.
+     */
+    int h3zero_set_qpack_parameters(h3zero_callback_ctx_t* ctx, uint64_t max_table_capacity, uint64_t blocked_streams);
+    int h3zero_protocol_init_ex(picoquic_cnx_t* cnx, h3zero_callback_ctx_t* ctx);
+    /* Send the pending QPACK encoder and decoder instructions */
+    int h3zero_qpack_flush(picoquic_cnx_t* cnx, h3zero_callback_ctx_t* ctx);
+
     int h3zero_post_data_or_fin(picoquic_cnx_t* cnx, uint8_t* bytes, size_t length, picoquic_call_back_event_t fin_or_event, h3zero_stream_ctx_t* stream_ctx);
 
     void h3zero_delete_stream(picoquic_cnx_t * cnx, h3zero_callback_ctx_t* ctx, h3zero_stream_ctx_t* stream_ctx);
     
+    /* Apply a priority update to a request stream, or keep it until the stream is open */
+    int h3zero_set_priority_update(picoquic_cnx_t* cnx, h3zero_callback_ctx_t* ctx, uint64_t stream_id,
+        uint8_t urgency, int incremental);
+
     h3zero_stream_ctx_t* h3zero_find_stream(h3zero_callback_ctx_t* ctx, 
         uint64_t stream_id);
+
+    /* Release the stream lookup index, after the stream tree is emptied */
+    void h3zero_delete_stream_index(h3zero_callback_ctx_t* ctx);
     
     h3zero_stream_ctx_t* h3zero_find_or_create_stream(
         picoquic_cnx_t* cnx,
@@ -236,6 +442,9 @@ extern "C" {
     void h3zero_forget_stream(picoquic_cnx_t* cnx, h3zero_stream_ctx_t* stream_ctx);
 
     int h3zero_set_datagram_ready(picoquic_cnx_t* cnx, uint64_t stream_id);
+    /* Datagram events, called from h3zero_callback */
+    int h3zero_callback_datagram(picoquic_cnx_t* cnx, uint8_t* bytes, size_t length, h3zero_callback_ctx_t* h3_ctx);
+    int h3zero_callback_prepare_datagram(picoquic_cnx_t* cnx, void* context, size_t space, h3zero_callback_ctx_t* h3_ctx);
     uint8_t* h3zero_provide_datagram_buffer(void* context, size_t length, int ready_to_send);
 
     int h3zero_callback(picoquic_cnx_t* cnx,
@@ -0,0 +1,391 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Cache of open files, used by the h3zero server to send file content.
+ *
+ * Files are opened once and shared by all the streams that serve them,
+ * across connections if the cache is attached to the server parameters.
+ * On POSIX systems, the file is mapped in memory and the content is copied
+ * directly from the mapping into the packet buffers. If the mapping fails,
+ * the content is read with pread on the cached file descriptor. On Windows,
+ * the content is read from a cached FILE handle.
+ *
+ * Entries that are not used by any stream remain open, so that the next
+ * request for the same file does not need to open it again. They are kept
+ * in a list ordered by time of last use, and the least recently used are
+ * closed when the number of idle entries exceeds the maximum. The cache is
+ * meant for static content. Reads do not make any system call when the file
+ * is mapped, so changes are only detected when the file is opened again from
+ * the cache, or when the response cache checks the file: the size of the file
+ * is compared with the size at the time it was mapped, and if it changed the
+ * entry is forgotten. Forgetting an entry drops its mapping, because accessing
+ * the mapping of a truncated file would raise SIGBUS; the streams still using
+ * the entry then read with pread, which fails cleanly if the requested bytes
+ * are no longer there. A file truncated between two checks while a stream is
+ * reading it can still cause SIGBUS, so files served through the cache shall
+ * be replaced, e.g., by renaming a new file, rather than truncated.
+ *
+ * The cache is not thread safe. It shall only be used from the thread
+ * running the server loop.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#ifndef _WINDOWS
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+#include "picohash.h"
+#include "picoquic_utils.h"
+#include "h3zero_common.h"
+
+static uint64_t h3zero_file_entry_hash(const void* key)
+{
+    const h3zero_file_entry_t* entry = (const h3zero_file_entry_t*)key;
+
+    return picohash_bytes((const uint8_t*)entry->file_path, (uint32_t)strlen(entry->file_path));
+}
+
+static int h3zero_file_entry_compare(const void* key1, const void* key2)
+{
+    const h3zero_file_entry_t* entry1 = (const h3zero_file_entry_t*)key1;
+    const h3zero_file_entry_t* entry2 = (const h3zero_file_entry_t*)key2;
+
+    return strcmp(entry1->file_path, entry2->file_path);
+}
+
+static picohash_item* h3zero_file_entry_to_item(const void* key)
+{
+    h3zero_file_entry_t* entry = (h3zero_file_entry_t*)key;
+
+    return &entry->hash_item;
+}
+
+h3zero_file_cache_t* h3zero_file_cache_create(size_t nb_bin, size_t max_idle)
+{
+    h3zero_file_cache_t* cache = (h3zero_file_cache_t*)malloc(sizeof(h3zero_file_cache_t));
+
+    if (cache != NULL) {
+        memset(cache, 0, sizeof(h3zero_file_cache_t));
+        cache->max_idle = max_idle;
+        cache->table = picohash_create_ex((nb_bin == 0) ? 1 : nb_bin, h3zero_file_entry_hash, h3zero_file_entry_compare,
+            h3zero_file_entry_to_item);
+        if (cache->table == NULL) {
+            free(cache);
+            cache = NULL;
+        }
+    }
+
+    return cache;
+}
+
+static void h3zero_file_entry_idle_remove(h3zero_file_cache_t* cache, h3zero_file_entry_t* entry)
+{
+    if (entry->previous_idle == NULL) {
+        cache->first_idle = entry->next_idle;
+    }
+    else {
+        entry->previous_idle->next_idle = entry->next_idle;
+    }
+    if (entry->next_idle == NULL) {
+        cache->last_idle = entry->previous_idle;
+    }
+    else {
+        entry->next_idle->previous_idle = entry->previous_idle;
+    }
+    entry->previous_idle = NULL;
+    entry->next_idle = NULL;
+    cache->nb_idle--;
+}
+
+static void h3zero_file_entry_close(h3zero_file_entry_t* entry)
+{
+#ifdef _WINDOWS
+    if (entry->F != NULL) {
+        entry->F = picoquic_file_close(entry->F);
+    }
+#else
+    if (entry->map != NULL) {
+        (void)munmap((void*)entry->map, (size_t)entry->file_size);
+        entry->map = NULL;
+    }
+    if (entry->fd >= 0) {
+        (void)close(entry->fd);
+        entry->fd = -1;
+    }
+#endif
+    free(entry->file_path);
+    free(entry);
+}
+
+static void h3zero_file_entry_delete(h3zero_file_cache_t* cache, h3zero_file_entry_t* entry)
+{
+    picohash_delete_item(cache->table, &entry->hash_item, 0);
+    h3zero_file_entry_close(entry);
+}
+
+void h3zero_file_cache_delete(h3zero_file_cache_t* cache)
+{
+    /* Entries still in use by streams are orphaned, and will be
+     * closed when the streams release them. */
+    for (size_t i = 0; i < cache->table->nb_bin; i++) {
+        picohash_item* item = cache->table->hash_bin[i];
+        while (item != NULL) {
+            h3zero_file_entry_t* entry = (h3zero_file_entry_t*)item->key;
+            item = item->next_in_bin;
+            if (entry->nb_refs == 0) {
+                h3zero_file_entry_close(entry);
+            }
+            else {
+                entry->cache = NULL;
+            }
+        }
+        /* The items are embedded in the entries */
+        cache->table->hash_bin[i] = NULL;
+    }
+    picohash_delete(cache->table, 0);
+    free(cache);
+}
+
+static h3zero_file_entry_t* h3zero_file_entry_open(char const* file_path)
+{
+    h3zero_file_entry_t* entry = (h3zero_file_entry_t*)malloc(sizeof(h3zero_file_entry_t));
+
+    if (entry != NULL) {
+        size_t path_length = strlen(file_path);
+        int ret = 0;
+
+        memset(entry, 0, sizeof(h3zero_file_entry_t));
+        if ((entry->file_path = (char*)malloc(path_length + 1)) == NULL) {
+            ret = -1;
+        }
+        else {
+            memcpy(entry->file_path, file_path, path_length + 1);
+        }
+#ifdef _WINDOWS
+        if (ret == 0 && (entry->F = picoquic_file_open(file_path, "rb")) == NULL) {
+            ret = -1;
+        }
+        if (ret == 0) {
+            if (_fseeki64(entry->F, 0, SEEK_END) != 0) {
+                ret = -1;
+            }
+            else {
+                entry->file_size = (uint64_t)_ftelli64(entry->F);
+            }
+        }
+#else
+        entry->fd = -1;
+        if (ret == 0 && (entry->fd = open(file_path, O_RDONLY)) < 0) {
+            ret = -1;
+        }
+        if (ret == 0) {
+            struct stat st;
+            if (fstat(entry->fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+                ret = -1;
+            }
+            else {
+                entry->file_size = (uint64_t)st.st_size;
+            }
+        }
+        if (ret == 0 && entry->file_size > 0 && (uint64_t)((size_t)entry->file_size) == entry->file_size) {
+            void* map = mmap(NULL, (size_t)entry->file_size, PROT_READ, MAP_SHARED, entry->fd, 0);
+            if (map != MAP_FAILED) {
+                entry->map = (const uint8_t*)map;
+#ifdef MADV_SEQUENTIAL
+                (void)madvise(map, (size_t)entry->file_size, MADV_SEQUENTIAL);
+#endif
+            }
+        }
+#ifdef POSIX_FADV_SEQUENTIAL
+        if (ret == 0 && entry->map == NULL) {
+            (void)posix_fadvise(entry->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        }
+#endif
+#endif
+        if (ret != 0) {
+            if (entry->file_path == NULL) {
+                free(entry);
+            }
+            else {
+                h3zero_file_entry_close(entry);
+            }
+            entry = NULL;
+        }
+    }
+
+    return entry;
+}
+
+/* Check that the size of the file did not change since it was opened */
+static int h3zero_file_entry_check(h3zero_file_entry_t* entry)
+{
+    int ret = 0;
+#ifndef _WINDOWS
+    struct stat st;
+
+    if (fstat(entry->fd, &st) != 0 || (uint64_t)st.st_size != entry->file_size) {
+        ret = -1;
+    }
+#endif
+    return ret;
+}
+
+h3zero_file_entry_t* h3zero_file_cache_open(h3zero_file_cache_t* cache, char const* file_path)
+{
+    h3zero_file_entry_t key;
+    h3zero_file_entry_t* entry = NULL;
+    picohash_item* item;
+
+    key.file_path = (char*)file_path;
+    item = picohash_retrieve(cache->table, &key);
+
+    if (item != NULL && h3zero_file_entry_check((h3zero_file_entry_t*)item->key) != 0) {
+        /* The file changed, open it again */
+        h3zero_file_cache_forget((h3zero_file_entry_t*)item->key);
+        cache->nb_invalidations++;
+        item = NULL;
+    }
+
+    if (item != NULL) {
+        entry = (h3zero_file_entry_t*)item->key;
+        if (entry->nb_refs == 0) {
+            h3zero_file_entry_idle_remove(cache, entry);
+        }
+        entry->nb_refs++;
+        cache->nb_hits++;
+    }
+    else if ((entry = h3zero_file_entry_open(file_path)) != NULL) {
+        if (picohash_insert(cache->table, entry) != 0) {
+            h3zero_file_entry_close(entry);
+            entry = NULL;
+        }
+        else {
+            entry->cache = cache;
+            entry->nb_refs = 1;
+            cache->nb_opens++;
+        }
+    }
+
+    return entry;
+}
+
+void h3zero_file_cache_release(h3zero_file_entry_t* entry)
+{
+    h3zero_file_cache_t* cache = entry->cache;
+
+    entry->nb_refs--;
+    if (entry->nb_refs <= 0) {
+        entry->nb_refs = 0;
+        if (cache == NULL) {
+            /* The cache was deleted while the entry was in use */
+            h3zero_file_entry_close(entry);
+        }
+        else {
+            /* Most recently used at the end of the idle list */
+            entry->previous_idle = cache->last_idle;
+            if (cache->last_idle == NULL) {
+                cache->first_idle = entry;
+            }
+            else {
+                cache->last_idle->next_idle = entry;
+            }
+            cache->last_idle = entry;
+            cache->nb_idle++;
+
+            while (cache->nb_idle > cache->max_idle) {
+                h3zero_file_entry_t* lru = cache->first_idle;
+                h3zero_file_entry_idle_remove(cache, lru);
+                h3zero_file_entry_delete(cache, lru);
+            }
+        }
+    }
+}
+
+/* Add a reference to an entry that is already in use */
+h3zero_file_entry_t* h3zero_file_cache_reference(h3zero_file_entry_t* entry)
+{
+    entry->nb_refs++;
+
+    return entry;
+}
+
+/* Remove an entry from the cache, for example if the file was modified.
+ * The next open will create a new entry, while the streams that use the
+ * old one can complete. The mapping may no longer be backed by the file,
+ * so it is dropped, and these streams read the file with pread. */
+void h3zero_file_cache_forget(h3zero_file_entry_t* entry)
+{
+    h3zero_file_cache_t* cache = entry->cache;
+
+#ifndef _WINDOWS
+    if (entry->map != NULL) {
+        (void)munmap((void*)entry->map, (size_t)entry->file_size);
+        entry->map = NULL;
+    }
+#endif
+    if (cache != NULL) {
+        picohash_delete_item(cache->table, &entry->hash_item, 0);
+        entry->cache = NULL;
+        if (entry->nb_refs == 0) {
+            h3zero_file_entry_idle_remove(cache, entry);
+            h3zero_file_entry_close(entry);
+        }
+    }
+}
+
+int h3zero_file_entry_read(h3zero_file_entry_t* entry, uint64_t offset, uint8_t* buffer, size_t length)
+{
+    int ret = 0;
+
+    if (offset > entry->file_size || length > entry->file_size - offset) {
+        ret = -1;
+    }
+#ifdef _WINDOWS
+    else if (_fseeki64(entry->F, (__int64)offset, SEEK_SET) != 0 ||
+        fread(buffer, 1, length, entry->F) != length) {
+        ret = -1;
+    }
+#else
+    else if (entry->map != NULL) {
+        memcpy(buffer, entry->map + offset, length);
+    }
+    else {
+        while (length > 0) {
+            ssize_t nb_read = pread(entry->fd, buffer, length, (off_t)offset);
+            if (nb_read <= 0) {
+                ret = -1;
+                break;
+            }
+            buffer += nb_read;
+            offset += (uint64_t)nb_read;
+            length -= (size_t)nb_read;
+        }
+    }
+#endif
+
+    return ret;
+}
@@ -0,0 +1,644 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "picoquic.h"
+#include "picoquic_utils.h"
+#include "picoquic_packet_loop.h"
+#include "h3zero.h"
+#include "h3zero_common.h"
+#include "h3zero_loadgen.h"
+
+/* Log-linear histogram. Values below 2*SUB_COUNT have their own bucket.
+ * Larger values are shifted right until they fall in [SUB_COUNT, 2*SUB_COUNT),
+ * and each shift count uses SUB_COUNT buckets.
+ */
+static size_t h3zero_loadgen_histogram_index(uint64_t value)
+{
+    size_t index;
+
+    if (value < 2 * H3ZERO_LOADGEN_HISTO_SUB_COUNT) {
+        index = (size_t)value;
+    }
+    else {
+        int shift = 0;
+
+        while ((value >> shift) >= 2 * H3ZERO_LOADGEN_HISTO_SUB_COUNT) {
+            shift++;
+        }
+        if (shift > H3ZERO_LOADGEN_HISTO_SHIFT_MAX) {
+            index = H3ZERO_LOADGEN_HISTO_BUCKETS - 1;
+        }
+        else {
+            index = (size_t)(shift + 1) * H3ZERO_LOADGEN_HISTO_SUB_COUNT +
+                (size_t)((value >> shift) - H3ZERO_LOADGEN_HISTO_SUB_COUNT);
+        }
+    }
+
+    return index;
+}
+
+static uint64_t h3zero_loadgen_histogram_upper(size_t index)
+{
+    uint64_t upper;
+
+    if (index < 2 * H3ZERO_LOADGEN_HISTO_SUB_COUNT) {
+        upper = index;
+    }
+    else {
+        int shift = (int)(index / H3ZERO_LOADGEN_HISTO_SUB_COUNT) - 1;
+        uint64_t sub = (uint64_t)(index % H3ZERO_LOADGEN_HISTO_SUB_COUNT) + H3ZERO_LOADGEN_HISTO_SUB_COUNT;
+
+        upper = ((sub + 1) << shift) - 1;
+    }
+
+    return upper;
+}
+
+void h3zero_loadgen_histogram_init(h3zero_loadgen_histogram_t* histo)
+{
+    memset(histo, 0, sizeof(h3zero_loadgen_histogram_t));
+    histo->min_value = UINT64_MAX;
+}
+
+void h3zero_loadgen_histogram_add(h3zero_loadgen_histogram_t* histo, uint64_t value)
+{
+    histo->counts[h3zero_loadgen_histogram_index(value)]++;
+    histo->nb_values++;
+    histo->sum += value;
+    if (value < histo->min_value) {
+        histo->min_value = value;
+    }
+    if (value > histo->max_value) {
+        histo->max_value = value;
+    }
+}
+
+void h3zero_loadgen_histogram_merge(h3zero_loadgen_histogram_t* histo, const h3zero_loadgen_histogram_t* other)
+{
+    for (size_t i = 0; i < H3ZERO_LOADGEN_HISTO_BUCKETS; i++) {
+        histo->counts[i] += other->counts[i];
+    }
+    histo->nb_values += other->nb_values;
+    histo->sum += other->sum;
+    if (other->min_value < histo->min_value) {
+        histo->min_value = other->min_value;
+    }
+    if (other->max_value > histo->max_value) {
+        histo->max_value = other->max_value;
+    }
+}
+
+uint64_t h3zero_loadgen_histogram_percentile(const h3zero_loadgen_histogram_t* histo, double percentile)
+{
+    uint64_t value = 0;
+
+    if (histo->nb_values > 0) {
+        uint64_t target = (uint64_t)((percentile * (double)histo->nb_values) / 100.0 + 0.999999);
+        uint64_t cumulative = 0;
+        size_t i = 0;
+
+        if (target < 1) {
+            target = 1;
+        }
+        else if (target > histo->nb_values) {
+            target = histo->nb_values;
+        }
+        while (i < H3ZERO_LOADGEN_HISTO_BUCKETS - 1 && cumulative + histo->counts[i] < target) {
+            cumulative += histo->counts[i];
+            i++;
+        }
+        /* The last bucket also holds all the values beyond the range */
+        value = (i == H3ZERO_LOADGEN_HISTO_BUCKETS - 1) ? histo->max_value : h3zero_loadgen_histogram_upper(i);
+        if (value > histo->max_value) {
+            value = histo->max_value;
+        }
+        if (value < histo->min_value) {
+            value = histo->min_value;
+        }
+    }
+
+    return value;
+}
+
+int h3zero_loadgen_format_path(h3zero_loadgen_config_t const* config, uint64_t n,
+    char* path, size_t path_max, size_t* path_length)
+{
+    int ret = 0;
+    char const* token = NULL;
+
+    *path_length = 0;
+    if (config->path_template != NULL) {
+        token = strstr(config->path_template, H3ZERO_LOADGEN_TEMPLATE_TOKEN);
+    }
+
+    if (token != NULL) {
+        size_t prefix_length = token - config->path_template;
+        char const* suffix = token + strlen(H3ZERO_LOADGEN_TEMPLATE_TOKEN);
+        uint64_t x = (config->template_range > 0) ? n % config->template_range : n;
+
+        if (prefix_length >= path_max) {
+            ret = -1;
+        }
+        else {
+            memcpy(path, config->path_template, prefix_length);
+            ret = picoquic_sprintf(path + prefix_length, path_max - prefix_length, NULL, "%" PRIu64 "%s", x, suffix);
+        }
+    }
+    else if (config->path_template != NULL) {
+        ret = picoquic_sprintf(path, path_max, NULL, "%s", config->path_template);
+    }
+    else if (config->nb_paths > 0) {
+        ret = picoquic_sprintf(path, path_max, NULL, "%s", config->paths[n % config->nb_paths]);
+    }
+    else {
+        ret = picoquic_sprintf(path, path_max, NULL, "/");
+    }
+
+    if (ret == 0) {
+        *path_length = strlen(path);
+    }
+
+    return ret;
+}
+
+static void h3zero_loadgen_release_request(h3zero_loadgen_request_t* request)
+{
+    request->in_use = 0;
+    request->lg_cnx->nb_active--;
+}
+
+/* Callback from the h3zero client for the request streams.
+ * The response header triggers "connect accepted" if the status is 2xx,
+ * "connect refused" otherwise.
+ */
+static int h3zero_loadgen_stream_cb(picoquic_cnx_t* cnx,
+    uint8_t* bytes, size_t length,
+    picohttp_call_back_event_t event,
+    h3zero_stream_ctx_t* stream_ctx,
+    void* path_app_ctx)
+{
+    int ret = 0;
+    h3zero_loadgen_request_t* request = (h3zero_loadgen_request_t*)path_app_ctx;
+    h3zero_loadgen_cnx_t* lg_cnx = request->lg_cnx;
+    h3zero_loadgen_ctx_t* lg_ctx = lg_cnx->lg_ctx;
+    uint64_t current_time = picoquic_get_quic_time(lg_ctx->quic);
+
+#ifdef _WINDOWS
+    UNREFERENCED_PARAMETER(bytes);
+    UNREFERENCED_PARAMETER(length);
+#endif
+
+    switch (event) {
+    case picohttp_callback_connect_accepted:
+    case picohttp_callback_connect_refused:
+        request->is_header_received = 1;
+        request->is_success = (event == picohttp_callback_connect_accepted);
+        request->header_time = current_time;
+        h3zero_loadgen_histogram_add(&lg_ctx->stats.ttfb, current_time - request->start_time);
+        break;
+    case picohttp_callback_post_fin:
+        if (request->is_success) {
+            lg_ctx->stats.nb_completed++;
+            lg_ctx->stats.nb_bytes += stream_ctx->received_length;
+            h3zero_loadgen_histogram_add(&lg_ctx->stats.completion, current_time - request->start_time);
+        }
+        else {
+            lg_ctx->stats.nb_failed++;
+        }
+        lg_ctx->stats.end_time = current_time;
+        h3zero_loadgen_release_request(request);
+        stream_ctx->is_open = 0;
+        lg_cnx->h3_ctx->nb_open_streams--;
+        h3zero_delete_stream(cnx, lg_cnx->h3_ctx, stream_ctx);
+        break;
+    case picohttp_callback_reset:
+        /* The stream context is released by h3zero after this call */
+        lg_ctx->stats.nb_failed++;
+        lg_ctx->stats.end_time = current_time;
+        h3zero_loadgen_release_request(request);
+        stream_ctx->path_callback = NULL;
+        stream_ctx->path_callback_ctx = NULL;
+        break;
+    case picohttp_callback_free:
+        /* The connection is deleted while the request is in flight */
+        if (request->in_use) {
+            lg_ctx->stats.nb_failed++;
+            h3zero_loadgen_release_request(request);
+        }
+        break;
+    default:
+        break;
+    }
+
+    return ret;
+}
+
+static int h3zero_loadgen_start_request(h3zero_loadgen_ctx_t* lg_ctx, h3zero_loadgen_cnx_t* lg_cnx,
+    uint64_t start_time)
+{
+    int ret = 0;
+    h3zero_loadgen_request_t* request = NULL;
+    h3zero_stream_ctx_t* stream_ctx = NULL;
+    uint64_t stream_id = picoquic_get_next_local_stream_id(lg_cnx->cnx, 0);
+    char path[H3ZERO_LOADGEN_PATH_MAX];
+    size_t path_length = 0;
+    uint8_t buffer[H3ZERO_LOADGEN_PATH_MAX + 256];
+    size_t request_length = 0;
+
+    for (size_t i = 0; i < lg_ctx->config->nb_streams; i++) {
+        if (!lg_cnx->requests[i].in_use) {
+            request = &lg_cnx->requests[i];
+            break;
+        }
+    }
+
+    if (request == NULL) {
+        ret = -1;
+    }
+    else if ((ret = h3zero_loadgen_format_path(lg_ctx->config, lg_ctx->stats.nb_started, path, sizeof(path),
+        &path_length)) == 0 &&
+        (ret = h3zero_client_create_stream_request(buffer, sizeof(buffer), (uint8_t const*)path, path_length, 0,
+            lg_ctx->config->sni, &request_length)) == 0) {
+        stream_ctx = h3zero_find_or_create_stream(lg_cnx->cnx, stream_id, lg_cnx->h3_ctx, 1, 1);
+        if (stream_ctx == NULL) {
+            ret = -1;
+        }
+        else {
+            memset(request, 0, sizeof(h3zero_loadgen_request_t));
+            request->lg_cnx = lg_cnx;
+            request->start_time = start_time;
+            request->in_use = 1;
+            lg_cnx->nb_active++;
+            lg_cnx->nb_started++;
+            lg_ctx->stats.nb_started++;
+            stream_ctx->is_open = 1;
+            stream_ctx->path_callback = h3zero_loadgen_stream_cb;
+            stream_ctx->path_callback_ctx = request;
+            lg_cnx->h3_ctx->nb_open_streams++;
+            ret = picoquic_add_to_stream_with_ctx(lg_cnx->cnx, stream_id, buffer, request_length, 1, stream_ctx);
+        }
+    }
+
+    return ret;
+}
+
+static int h3zero_loadgen_has_more_requests(h3zero_loadgen_ctx_t* lg_ctx, uint64_t current_time)
+{
+    h3zero_loadgen_config_t const* config = lg_ctx->config;
+
+    if (!lg_ctx->is_stopping &&
+        ((config->nb_requests > 0 && lg_ctx->stats.nb_started >= config->nb_requests) ||
+        (config->duration_us > 0 && current_time >= lg_ctx->stats.start_time + config->duration_us))) {
+        lg_ctx->is_stopping = 1;
+    }
+
+    return !lg_ctx->is_stopping;
+}
+
+/* In open loop, request number n is scheduled at start_time + n/rate */
+static uint64_t h3zero_loadgen_scheduled_time(h3zero_loadgen_ctx_t* lg_ctx, uint64_t n)
+{
+    uint64_t rate = lg_ctx->config->request_rate;
+
+    return lg_ctx->stats.start_time + (n / rate) * 1000000 + ((n % rate) * 1000000) / rate;
+}
+
+static h3zero_loadgen_cnx_t* h3zero_loadgen_find_cnx(h3zero_loadgen_ctx_t* lg_ctx, int should_advance)
+{
+    h3zero_loadgen_config_t const* config = lg_ctx->config;
+    h3zero_loadgen_cnx_t* found = NULL;
+
+    for (size_t k = 0; k < config->nb_connections; k++) {
+        size_t i = (lg_ctx->next_cnx + k) % config->nb_connections;
+        h3zero_loadgen_cnx_t* lg_cnx = &lg_ctx->cnx_ctx[i];
+
+        if (lg_cnx->cnx != NULL && picoquic_get_cnx_state(lg_cnx->cnx) < picoquic_state_disconnecting &&
+            lg_cnx->nb_active < config->nb_streams &&
+            (config->requests_per_connection == 0 || lg_cnx->nb_started < config->requests_per_connection)) {
+            found = lg_cnx;
+            if (should_advance) {
+                lg_ctx->next_cnx = (i + 1) % config->nb_connections;
+            }
+            break;
+        }
+    }
+
+    return found;
+}
+
+uint64_t h3zero_loadgen_next_time(h3zero_loadgen_ctx_t* lg_ctx)
+{
+    uint64_t next_time = UINT64_MAX;
+
+    if (!lg_ctx->is_stopping) {
+        if (lg_ctx->config->duration_us > 0) {
+            next_time = lg_ctx->stats.start_time + lg_ctx->config->duration_us;
+        }
+        if (lg_ctx->config->request_rate > 0 && h3zero_loadgen_find_cnx(lg_ctx, 0) != NULL) {
+            uint64_t request_time = h3zero_loadgen_scheduled_time(lg_ctx, lg_ctx->stats.nb_started);
+            if (request_time < next_time) {
+                next_time = request_time;
+            }
+        }
+    }
+
+    return next_time;
+}
+
+static void h3zero_loadgen_close_cnx(h3zero_loadgen_ctx_t* lg_ctx, h3zero_loadgen_cnx_t* lg_cnx)
+{
+    if (lg_cnx->cnx != NULL) {
+        if (picoquic_tls_is_psk_handshake(lg_cnx->cnx)) {
+            lg_ctx->stats.nb_resumed++;
+        }
+        picoquic_set_callback(lg_cnx->cnx, NULL, NULL);
+    }
+    if (lg_cnx->h3_ctx != NULL) {
+        /* Requests still in flight are counted as failed when their streams are freed */
+        h3zero_callback_delete_context(lg_cnx->cnx, lg_cnx->h3_ctx);
+        lg_cnx->h3_ctx = NULL;
+    }
+    if (lg_cnx->cnx != NULL && lg_cnx->is_owned) {
+        picoquic_delete_cnx(lg_cnx->cnx);
+    }
+    lg_cnx->cnx = NULL;
+}
+
+h3zero_loadgen_ctx_t* h3zero_loadgen_create(h3zero_loadgen_config_t const* config, picoquic_quic_t* quic)
+{
+    h3zero_loadgen_ctx_t* lg_ctx = NULL;
+
+    if (config->nb_connections > 0 && config->nb_streams > 0 &&
+        (lg_ctx = (h3zero_loadgen_ctx_t*)malloc(sizeof(h3zero_loadgen_ctx_t))) != NULL) {
+        memset(lg_ctx, 0, sizeof(h3zero_loadgen_ctx_t));
+        lg_ctx->config = config;
+        lg_ctx->quic = quic;
+        h3zero_loadgen_histogram_init(&lg_ctx->stats.ttfb);
+        h3zero_loadgen_histogram_init(&lg_ctx->stats.completion);
+        lg_ctx->cnx_ctx = (h3zero_loadgen_cnx_t*)malloc(config->nb_connections * sizeof(h3zero_loadgen_cnx_t));
+        if (lg_ctx->cnx_ctx == NULL) {
+            free(lg_ctx);
+            lg_ctx = NULL;
+        }
+        else {
+            int ret = 0;
+
+            memset(lg_ctx->cnx_ctx, 0, config->nb_connections * sizeof(h3zero_loadgen_cnx_t));
+            for (size_t i = 0; ret == 0 && i < config->nb_connections; i++) {
+                lg_ctx->cnx_ctx[i].lg_ctx = lg_ctx;
+                lg_ctx->cnx_ctx[i].requests = (h3zero_loadgen_request_t*)malloc(
+                    config->nb_streams * sizeof(h3zero_loadgen_request_t));
+                if (lg_ctx->cnx_ctx[i].requests == NULL) {
+                    ret = -1;
+                }
+                else {
+                    memset(lg_ctx->cnx_ctx[i].requests, 0, config->nb_streams * sizeof(h3zero_loadgen_request_t));
+                }
+            }
+            if (ret != 0) {
+                h3zero_loadgen_delete(lg_ctx);
+                lg_ctx = NULL;
+            }
+        }
+    }
+
+    return lg_ctx;
+}
+
+void h3zero_loadgen_delete(h3zero_loadgen_ctx_t* lg_ctx)
+{
+    for (size_t i = 0; i < lg_ctx->config->nb_connections; i++) {
+        h3zero_loadgen_close_cnx(lg_ctx, &lg_ctx->cnx_ctx[i]);
+        if (lg_ctx->cnx_ctx[i].requests != NULL) {
+            free(lg_ctx->cnx_ctx[i].requests);
+        }
+    }
+    free(lg_ctx->cnx_ctx);
+    free(lg_ctx);
+}
+
+int h3zero_loadgen_start_cnx(h3zero_loadgen_ctx_t* lg_ctx, size_t cnx_index, picoquic_cnx_t* cnx, uint64_t current_time)
+{
+    int ret = 0;
+    h3zero_loadgen_cnx_t* lg_cnx = &lg_ctx->cnx_ctx[cnx_index];
+
+    if (lg_ctx->stats.start_time == 0) {
+        lg_ctx->stats.start_time = current_time;
+        lg_ctx->stats.end_time = current_time;
+    }
+    lg_cnx->cnx = cnx;
+    lg_cnx->nb_active = 0;
+    lg_cnx->nb_started = 0;
+    if ((lg_cnx->h3_ctx = h3zero_callback_create_context(NULL)) == NULL) {
+        ret = -1;
+    }
+    else {
+        lg_cnx->h3_ctx->no_disk = 1;
+        lg_cnx->h3_ctx->no_print = 1;
+        picoquic_set_callback(cnx, h3zero_callback, lg_cnx->h3_ctx);
+        lg_ctx->stats.nb_connections++;
+        if ((ret = picoquic_start_client_cnx(cnx)) == 0) {
+            ret = h3zero_protocol_init_ex(cnx, lg_cnx->h3_ctx);
+        }
+        /* Requests queued before the handshake completes are sent as 0-RTT data */
+        if (ret == 0 && picoquic_is_0rtt_available(cnx)) {
+            lg_ctx->stats.nb_0rtt++;
+        }
+    }
+
+    return ret;
+}
+
+static int h3zero_loadgen_open_cnx(h3zero_loadgen_ctx_t* lg_ctx, size_t cnx_index, uint64_t current_time)
+{
+    int ret = 0;
+    picoquic_cnx_t* cnx = picoquic_create_cnx(lg_ctx->quic, picoquic_null_connection_id, picoquic_null_connection_id,
+        (struct sockaddr*)&lg_ctx->config->server_address, current_time, 0, lg_ctx->config->sni, "h3", 1);
+
+    if (cnx == NULL) {
+        ret = -1;
+    }
+    else {
+        lg_ctx->cnx_ctx[cnx_index].is_owned = 1;
+        ret = h3zero_loadgen_start_cnx(lg_ctx, cnx_index, cnx, current_time);
+    }
+
+    return ret;
+}
+
+int h3zero_loadgen_start(h3zero_loadgen_ctx_t* lg_ctx, uint64_t current_time)
+{
+    int ret = 0;
+
+    for (size_t i = 0; ret == 0 && i < lg_ctx->config->nb_connections; i++) {
+        ret = h3zero_loadgen_open_cnx(lg_ctx, i, current_time);
+    }
+    if (ret == 0) {
+        ret = h3zero_loadgen_update(lg_ctx, current_time);
+    }
+
+    return ret;
+}
+
+int h3zero_loadgen_update(h3zero_loadgen_ctx_t* lg_ctx, uint64_t current_time)
+{
+    int ret = 0;
+    int nb_running = 0;
+    int has_more = h3zero_loadgen_has_more_requests(lg_ctx, current_time);
+    h3zero_loadgen_config_t const* config = lg_ctx->config;
+
+    /* Replace the connections that are finished, close those that are no longer needed */
+    for (size_t i = 0; ret == 0 && i < config->nb_connections; i++) {
+        h3zero_loadgen_cnx_t* lg_cnx = &lg_ctx->cnx_ctx[i];
+
+        if (lg_cnx->cnx != NULL && picoquic_get_cnx_state(lg_cnx->cnx) == picoquic_state_disconnected) {
+            h3zero_loadgen_close_cnx(lg_ctx, lg_cnx);
+        }
+        if (lg_cnx->cnx == NULL && lg_cnx->is_owned && has_more) {
+            ret = h3zero_loadgen_open_cnx(lg_ctx, i, current_time);
+        }
+        if (lg_cnx->cnx != NULL) {
+            nb_running++;
+            if (lg_cnx->nb_active == 0 && picoquic_get_cnx_state(lg_cnx->cnx) < picoquic_state_disconnecting &&
+                (!has_more || (config->requests_per_connection > 0 && lg_cnx->nb_started >= config->requests_per_connection))) {
+                ret = picoquic_close(lg_cnx->cnx, 0);
+            }
+        }
+    }
+
+    /* Start the requests that are due */
+    while (ret == 0 && has_more &&
+        (config->request_rate == 0 || h3zero_loadgen_scheduled_time(lg_ctx, lg_ctx->stats.nb_started) <= current_time)) {
+        h3zero_loadgen_cnx_t* lg_cnx = h3zero_loadgen_find_cnx(lg_ctx, 1);
+
+        if (lg_cnx == NULL) {
+            break;
+        }
+        else {
+            uint64_t start_time = (config->request_rate == 0) ? current_time :
+                h3zero_loadgen_scheduled_time(lg_ctx, lg_ctx->stats.nb_started);
+            ret = h3zero_loadgen_start_request(lg_ctx, lg_cnx, start_time);
+            has_more = h3zero_loadgen_has_more_requests(lg_ctx, current_time);
+        }
+    }
+
+    if (ret == 0 && nb_running == 0 && !has_more) {
+        ret = PICOQUIC_NO_ERROR_TERMINATE_PACKET_LOOP;
+    }
+
+    return ret;
+}
+
+int h3zero_loadgen_loop_cb(picoquic_quic_t* quic, picoquic_packet_loop_cb_enum cb_mode,
+    void* callback_ctx, void* callback_arg)
+{
+    int ret = 0;
+    h3zero_loadgen_ctx_t* lg_ctx = (h3zero_loadgen_ctx_t*)callback_ctx;
+
+    if (lg_ctx == NULL) {
+        ret = PICOQUIC_ERROR_UNEXPECTED_ERROR;
+    }
+    else {
+        switch (cb_mode) {
+        case picoquic_packet_loop_ready:
+            if (callback_arg != NULL) {
+                ((picoquic_packet_loop_options_t*)callback_arg)->do_time_check = 1;
+            }
+            ret = h3zero_loadgen_start(lg_ctx, picoquic_get_quic_time(quic));
+            break;
+        case picoquic_packet_loop_after_receive:
+        case picoquic_packet_loop_after_send:
+            ret = h3zero_loadgen_update(lg_ctx, picoquic_get_quic_time(quic));
+            break;
+        case picoquic_packet_loop_time_check: {
+            packet_loop_time_check_arg_t* time_check_arg = (packet_loop_time_check_arg_t*)callback_arg;
+            uint64_t next_time = h3zero_loadgen_next_time(lg_ctx);
+
+            if (next_time <= time_check_arg->current_time) {
+                time_check_arg->delta_t = 0;
+            }
+            else if (next_time - time_check_arg->current_time < (uint64_t)time_check_arg->delta_t) {
+                time_check_arg->delta_t = (int64_t)(next_time - time_check_arg->current_time);
+            }
+            break;
+        }
+        case picoquic_packet_loop_port_update:
+        case picoquic_packet_loop_wake_up:
+            break;
+        default:
+            ret = PICOQUIC_ERROR_UNEXPECTED_ERROR;
+            break;
+        }
+    }
+
+    return ret;
+}
+
+void h3zero_loadgen_stats_merge(h3zero_loadgen_stats_t* stats, const h3zero_loadgen_stats_t* other)
+{
+    if (stats->nb_connections == 0 || (other->nb_connections > 0 && other->start_time < stats->start_time)) {
+        stats->start_time = other->start_time;
+    }
+    if (other->end_time > stats->end_time) {
+        stats->end_time = other->end_time;
+    }
+    stats->nb_started += other->nb_started;
+    stats->nb_completed += other->nb_completed;
+    stats->nb_failed += other->nb_failed;
+    stats->nb_bytes += other->nb_bytes;
+    stats->nb_connections += other->nb_connections;
+    stats->nb_resumed += other->nb_resumed;
+    stats->nb_0rtt += other->nb_0rtt;
+    h3zero_loadgen_histogram_merge(&stats->ttfb, &other->ttfb);
+    h3zero_loadgen_histogram_merge(&stats->completion, &other->completion);
+}
+
+static void h3zero_loadgen_print_histogram(FILE* F, char const* name, const h3zero_loadgen_histogram_t* histo)
+{
+    fprintf(F, "%-12s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+        name, (histo->nb_values == 0) ? 0 : histo->min_value,
+        (histo->nb_values == 0) ? 0 : histo->sum / histo->nb_values,
+        h3zero_loadgen_histogram_percentile(histo, 50.0),
+        h3zero_loadgen_histogram_percentile(histo, 90.0),
+        h3zero_loadgen_histogram_percentile(histo, 99.0),
+        h3zero_loadgen_histogram_percentile(histo, 99.9),
+        histo->max_value);
+}
+
+void h3zero_loadgen_print_stats(FILE* F, const h3zero_loadgen_stats_t* stats)
+{
+    double duration = (stats->end_time > stats->start_time) ? ((double)(stats->end_time - stats->start_time)) / 1000000.0 : 0.0;
+
+    fprintf(F, "Finished in %.3f s, %.1f req/s, %.3f MB/s\n", duration,
+        (duration > 0) ? ((double)stats->nb_completed) / duration : 0.0,
+        (duration > 0) ? ((double)stats->nb_bytes) / (duration * 1000000.0) : 0.0);
+    fprintf(F, "Requests: %" PRIu64 " started, %" PRIu64 " succeeded, %" PRIu64 " failed, %" PRIu64 " bytes received\n",
+        stats->nb_started, stats->nb_completed, stats->nb_failed, stats->nb_bytes);
+    fprintf(F, "Connections: %" PRIu64 " opened, %" PRIu64 " resumed, %" PRIu64 " with 0-RTT\n",
+        stats->nb_connections, stats->nb_resumed, stats->nb_0rtt);
+    fprintf(F, "%-12s %10s %10s %10s %10s %10s %10s %10s\n", "Latency (us)", "min", "mean", "p50", "p90", "p99", "p99.9", "max");
+    h3zero_loadgen_print_histogram(F, "TTFB", &stats->ttfb);
+    h3zero_loadgen_print_histogram(F, "Completion", &stats->completion);
+}
@@ -0,0 +1,160 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* HTTP/3 load generator, built on the h3zero client.
+ *
+ * A load generator context drives a set of connections from a single
+ * QUIC context, and is meant to run in the thread that runs the packet
+ * loop of that QUIC context. Applications that need more load run several
+ * contexts in parallel, one per thread, and merge the statistics.
+ *
+ * Each connection keeps up to nb_streams requests in flight. In closed loop
+ * mode, a new request is started as soon as a previous one completes. In
+ * open loop mode, requests are scheduled at a fixed rate, and the latency
+ * is measured from the scheduled time, so that delays caused by a busy
+ * server are not hidden by the generator waiting for free streams.
+ *
+ * Latencies are kept in log-linear histograms, with a precision of about
+ * 3% over the full range of values.
+ */
+
+#ifndef H3ZERO_LOADGEN_H
+#define H3ZERO_LOADGEN_H
+
+#include "picoquic.h"
+#include "picoquic_packet_loop.h"
+#include "h3zero.h"
+#include "h3zero_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define H3ZERO_LOADGEN_HISTO_SUB_BITS 5
+#define H3ZERO_LOADGEN_HISTO_SUB_COUNT (1 << H3ZERO_LOADGEN_HISTO_SUB_BITS)
+#define H3ZERO_LOADGEN_HISTO_SHIFT_MAX 36
+#define H3ZERO_LOADGEN_HISTO_BUCKETS ((H3ZERO_LOADGEN_HISTO_SHIFT_MAX + 2) * H3ZERO_LOADGEN_HISTO_SUB_COUNT)
+#define H3ZERO_LOADGEN_PATH_MAX 512
+#define H3ZERO_LOADGEN_TEMPLATE_TOKEN "{n}"
+
+    typedef struct st_h3zero_loadgen_histogram_t {
+        uint64_t counts[H3ZERO_LOADGEN_HISTO_BUCKETS];
+        uint64_t nb_values;
+        uint64_t min_value;
+        uint64_t max_value;
+        uint64_t sum;
+    } h3zero_loadgen_histogram_t;
+
+    void h3zero_loadgen_histogram_init(h3zero_loadgen_histogram_t* histo);
+    void h3zero_loadgen_histogram_add(h3zero_loadgen_histogram_t* histo, uint64_t value);
+    void h3zero_loadgen_histogram_merge(h3zero_loadgen_histogram_t* histo, const h3zero_loadgen_histogram_t* other);
+    /* Returns the highest value of the bucket that contains the percentile, or 0 if the histogram is empty */
+    uint64_t h3zero_loadgen_histogram_percentile(const h3zero_loadgen_histogram_t* histo, double percentile);
+
+    typedef struct st_h3zero_loadgen_config_t {
+        char const* sni;
+        struct sockaddr_storage server_address;
+        size_t nb_connections; /* Connections opened by each context */
+        size_t nb_streams; /* Requests in flight per connection */
+        uint64_t nb_requests; /* Requests per context, 0 if the test is only limited by duration */
+        uint64_t duration_us; /* Test duration, 0 if only limited by the number of requests */
+        uint64_t request_rate; /* Requests per second per context, 0 for closed loop */
+        uint64_t requests_per_connection; /* Connections are replaced after that many requests, 0 for never */
+        char const** paths; /* Paths requested in turn, if no template is set */
+        size_t nb_paths;
+        char const* path_template; /* "{n}" is replaced by the request number, modulo template_range */
+        uint64_t template_range;
+    } h3zero_loadgen_config_t;
+
+    typedef struct st_h3zero_loadgen_stats_t {
+        uint64_t start_time;
+        uint64_t end_time;
+        uint64_t nb_started;
+        uint64_t nb_completed; /* Completed with a 2xx status */
+        uint64_t nb_failed;
+        uint64_t nb_bytes; /* Response content received on completed requests */
+        uint64_t nb_connections;
+        uint64_t nb_resumed; /* Connections that used a session ticket */
+        uint64_t nb_0rtt; /* Connections that sent their first requests in 0-RTT */
+        h3zero_loadgen_histogram_t ttfb; /* Time to the response header, us */
+        h3zero_loadgen_histogram_t completion; /* Time to the end of the response, us */
+    } h3zero_loadgen_stats_t;
+
+    struct st_h3zero_loadgen_ctx_t;
+    struct st_h3zero_loadgen_cnx_t;
+
+    typedef struct st_h3zero_loadgen_request_t {
+        struct st_h3zero_loadgen_cnx_t* lg_cnx;
+        uint64_t start_time;
+        uint64_t header_time;
+        unsigned int in_use : 1;
+        unsigned int is_header_received : 1;
+        unsigned int is_success : 1;
+    } h3zero_loadgen_request_t;
+
+    typedef struct st_h3zero_loadgen_cnx_t {
+        struct st_h3zero_loadgen_ctx_t* lg_ctx;
+        picoquic_cnx_t* cnx;
+        h3zero_callback_ctx_t* h3_ctx;
+        h3zero_loadgen_request_t* requests; /* nb_streams entries */
+        size_t nb_active;
+        uint64_t nb_started;
+        unsigned int is_owned : 1; /* Created by the load generator, deleted when disconnected */
+    } h3zero_loadgen_cnx_t;
+
+    typedef struct st_h3zero_loadgen_ctx_t {
+        h3zero_loadgen_config_t const* config;
+        picoquic_quic_t* quic;
+        h3zero_loadgen_cnx_t* cnx_ctx; /* nb_connections entries */
+        size_t next_cnx;
+        unsigned int is_stopping : 1;
+        h3zero_loadgen_stats_t stats;
+    } h3zero_loadgen_ctx_t;
+
+    /* Format the path of the request number n */
+    int h3zero_loadgen_format_path(h3zero_loadgen_config_t const* config, uint64_t n,
+        char* path, size_t path_max, size_t* path_length);
+
+    h3zero_loadgen_ctx_t* h3zero_loadgen_create(h3zero_loadgen_config_t const* config, picoquic_quic_t* quic);
+    void h3zero_loadgen_delete(h3zero_loadgen_ctx_t* lg_ctx);
+    /* Open all the connections and start sending requests */
+    int h3zero_loadgen_start(h3zero_loadgen_ctx_t* lg_ctx, uint64_t current_time);
+    /* Run the load on a connection created by the application, instead of one
+     * created by the load generator. The connection must not be started yet. */
+    int h3zero_loadgen_start_cnx(h3zero_loadgen_ctx_t* lg_ctx, size_t cnx_index, picoquic_cnx_t* cnx, uint64_t current_time);
+    /* Start the requests that are due, replace the connections that are finished.
+     * Returns PICOQUIC_NO_ERROR_TERMINATE_PACKET_LOOP once the test is complete
+     * and all connections are closed. */
+    int h3zero_loadgen_update(h3zero_loadgen_ctx_t* lg_ctx, uint64_t current_time);
+    /* Time at which the next request is due, UINT64_MAX if none */
+    uint64_t h3zero_loadgen_next_time(h3zero_loadgen_ctx_t* lg_ctx);
+    /* Packet loop callback, with the load generator context as callback context */
+    int h3zero_loadgen_loop_cb(picoquic_quic_t* quic, picoquic_packet_loop_cb_enum cb_mode,
+        void* callback_ctx, void* callback_arg);
+
+    void h3zero_loadgen_stats_merge(h3zero_loadgen_stats_t* stats, const h3zero_loadgen_stats_t* other);
+    void h3zero_loadgen_print_stats(FILE* F, const h3zero_loadgen_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* H3ZERO_LOADGEN_H */
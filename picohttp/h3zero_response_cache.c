@@ -0,0 +1,358 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Cache of responses to GET requests, used by the h3zero server.
+ *
+ * The entries are keyed by the requested path. Each entry holds the bytes
+ * that start the response: the header frame, the header of the data frame,
+ * and, for small generated pages, the body itself. If the body is a file,
+ * the entry holds a reference to the file in the file cache, so the file
+ * remains open and mapped as long as the entry is present. On a cache hit,
+ * the server sends the response without resolving the path, opening the
+ * file or encoding the header.
+ *
+ * The header is encoded with the QPACK static table only, because the same
+ * bytes are sent on every connection, whatever the state of its dynamic
+ * table.
+ *
+ * The number of entries and their total size are limited. The size of an
+ * entry counts the mapped file. When a limit is exceeded, the least
+ * recently used entries are removed. If the check interval is not zero,
+ * the modification time and size of the file are verified when an entry
+ * is used and the last check is older than the interval. If the file has
+ * changed, the entry is removed, and the file is forgotten by the file
+ * cache so that the next request reads the new version.
+ *
+ * Like the file cache, the response cache is not thread safe.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "picohash.h"
+#include "picoquic_internal.h"
+#include "picoquic_utils.h"
+#include "h3zero.h"
+#include "h3zero_common.h"
+
+static uint64_t h3zero_response_entry_hash(const void* key)
+{
+    const h3zero_response_entry_t* entry = (const h3zero_response_entry_t*)key;
+
+    return picohash_bytes(entry->path, (uint32_t)entry->path_length);
+}
+
+static int h3zero_response_entry_compare(const void* key1, const void* key2)
+{
+    const h3zero_response_entry_t* entry1 = (const h3zero_response_entry_t*)key1;
+    const h3zero_response_entry_t* entry2 = (const h3zero_response_entry_t*)key2;
+    int ret = -1;
+
+    if (entry1->path_length == entry2->path_length && memcmp(entry1->path, entry2->path, entry1->path_length) == 0) {
+        ret = 0;
+    }
+
+    return ret;
+}
+
+static picohash_item* h3zero_response_entry_to_item(const void* key)
+{
+    h3zero_response_entry_t* entry = (h3zero_response_entry_t*)key;
+
+    return &entry->hash_item;
+}
+
+static int h3zero_response_cache_file_stat(char const* file_path, int64_t* mtime, uint64_t* size)
+{
+    int ret = 0;
+#ifdef _WINDOWS
+    struct _stat64 st;
+
+    if (_stat64(file_path, &st) != 0) {
+        ret = -1;
+    }
+#else
+    struct stat st;
+
+    if (stat(file_path, &st) != 0) {
+        ret = -1;
+    }
+#endif
+    else {
+        *mtime = (int64_t)st.st_mtime;
+        *size = (uint64_t)st.st_size;
+    }
+
+    return ret;
+}
+
+h3zero_response_cache_t* h3zero_response_cache_create(h3zero_file_cache_t* file_cache, size_t max_entries,
+    size_t max_size, uint64_t check_interval)
+{
+    h3zero_response_cache_t* cache = (h3zero_response_cache_t*)malloc(sizeof(h3zero_response_cache_t));
+
+    if (cache != NULL) {
+        memset(cache, 0, sizeof(h3zero_response_cache_t));
+        cache->file_cache = file_cache;
+        cache->max_entries = max_entries;
+        cache->max_size = max_size;
+        cache->check_interval = check_interval;
+        cache->table = picohash_create_ex((max_entries < 16) ? 16 : max_entries, h3zero_response_entry_hash,
+            h3zero_response_entry_compare, h3zero_response_entry_to_item);
+        if (cache->table == NULL) {
+            free(cache);
+            cache = NULL;
+        }
+    }
+
+    return cache;
+}
+
+static void h3zero_response_entry_free(h3zero_response_entry_t* entry)
+{
+    if (entry->file_entry != NULL) {
+        h3zero_file_cache_release(entry->file_entry);
+    }
+    if (entry->path != NULL) {
+        free(entry->path);
+    }
+    if (entry->response != NULL) {
+        free(entry->response);
+    }
+    free(entry);
+}
+
+static void h3zero_response_entry_remove(h3zero_response_cache_t* cache, h3zero_response_entry_t* entry)
+{
+    if (entry->previous_lru == NULL) {
+        cache->first_lru = entry->next_lru;
+    }
+    else {
+        entry->previous_lru->next_lru = entry->next_lru;
+    }
+    if (entry->next_lru == NULL) {
+        cache->last_lru = entry->previous_lru;
+    }
+    else {
+        entry->next_lru->previous_lru = entry->previous_lru;
+    }
+    picohash_delete_item(cache->table, &entry->hash_item, 0);
+    cache->nb_entries--;
+    cache->total_size -= entry->size;
+    h3zero_response_entry_free(entry);
+}
+
+static void h3zero_response_entry_append(h3zero_response_cache_t* cache, h3zero_response_entry_t* entry)
+{
+    entry->next_lru = NULL;
+    entry->previous_lru = cache->last_lru;
+    if (cache->last_lru == NULL) {
+        cache->first_lru = entry;
+    }
+    else {
+        cache->last_lru->next_lru = entry;
+    }
+    cache->last_lru = entry;
+}
+
+void h3zero_response_cache_delete(h3zero_response_cache_t* cache)
+{
+    while (cache->first_lru != NULL) {
+        h3zero_response_entry_remove(cache, cache->first_lru);
+    }
+    picohash_delete(cache->table, 0);
+    free(cache);
+}
+
+h3zero_response_entry_t* h3zero_response_cache_get(h3zero_response_cache_t* cache, const uint8_t* path,
+    size_t path_length, uint64_t current_time)
+{
+    h3zero_response_entry_t key;
+    h3zero_response_entry_t* entry = NULL;
+    picohash_item* item;
+
+    key.path = (uint8_t*)path;
+    key.path_length = path_length;
+    item = picohash_retrieve(cache->table, &key);
+
+    if (item != NULL) {
+        entry = (h3zero_response_entry_t*)item->key;
+
+        if (entry->file_entry != NULL && cache->check_interval > 0 &&
+            current_time >= entry->last_check_time + cache->check_interval) {
+            int64_t mtime = 0;
+            uint64_t size = 0;
+
+            entry->last_check_time = current_time;
+            if (h3zero_response_cache_file_stat(entry->file_entry->file_path, &mtime, &size) != 0 ||
+                mtime != entry->file_mtime || size != entry->file_entry->file_size) {
+                h3zero_file_cache_forget(entry->file_entry);
+                h3zero_response_entry_remove(cache, entry);
+                cache->nb_invalidations++;
+                entry = NULL;
+            }
+        }
+
+        if (entry != NULL && entry != cache->last_lru) {
+            /* Move to the most recently used position */
+            if (entry->previous_lru == NULL) {
+                cache->first_lru = entry->next_lru;
+            }
+            else {
+                entry->previous_lru->next_lru = entry->next_lru;
+            }
+            entry->next_lru->previous_lru = entry->previous_lru;
+            h3zero_response_entry_append(cache, entry);
+        }
+    }
+
+    if (entry == NULL) {
+        cache->nb_misses++;
+    }
+    else {
+        cache->nb_hits++;
+    }
+
+    return entry;
+}
+
+/* Create an entry for a successful GET response. If the file path is not
+ * NULL, the body is read from that file, through the file cache. Otherwise,
+ * if the echo length is zero, the body is copied in the entry, and if not
+ * the server generates echo_length bytes of data.
+ */
+h3zero_response_entry_t* h3zero_response_cache_add(h3zero_response_cache_t* cache, const uint8_t* path,
+    size_t path_length, char const* file_path, uint64_t echo_length, const uint8_t* body, size_t body_length,
+    h3zero_content_type_enum doc_type, char const* server_string, uint64_t current_time)
+{
+    int ret = 0;
+    h3zero_response_entry_t* entry = NULL;
+    uint8_t buffer[1024];
+    uint8_t* bytes = buffer;
+    uint8_t* bytes_max = buffer + sizeof(buffer);
+    uint64_t data_length = (echo_length == 0) ? body_length : echo_length;
+
+    if ((entry = (h3zero_response_entry_t*)malloc(sizeof(h3zero_response_entry_t))) == NULL) {
+        ret = -1;
+    }
+    else {
+        memset(entry, 0, sizeof(h3zero_response_entry_t));
+        entry->echo_length = echo_length;
+        entry->last_check_time = current_time;
+        if ((entry->path = (uint8_t*)malloc(path_length)) == NULL) {
+            ret = -1;
+        }
+        else {
+            memcpy(entry->path, path, path_length);
+            entry->path_length = path_length;
+        }
+    }
+
+    if (ret == 0 && file_path != NULL) {
+        uint64_t size = 0;
+
+        if (cache->file_cache == NULL ||
+            h3zero_response_cache_file_stat(file_path, &entry->file_mtime, &size) != 0 ||
+            (entry->file_entry = h3zero_file_cache_open(cache->file_cache, file_path)) == NULL ||
+            entry->file_entry->file_size != echo_length) {
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        /* Header frame, with two bytes reserved for the length */
+        *bytes++ = h3zero_frame_header;
+        bytes += 2;
+        bytes = h3zero_create_response_header_frame_ex(bytes, bytes_max, doc_type, server_string);
+        if (bytes == NULL) {
+            ret = -1;
+        }
+        else {
+            size_t header_length = bytes - &buffer[3];
+            buffer[1] = (uint8_t)((header_length >> 8) | 0x40);
+            buffer[2] = (uint8_t)(header_length & 0xFF);
+            if (data_length > 0) {
+                size_t ld = 0;
+
+                if (bytes + 2 < bytes_max) {
+                    *bytes++ = h3zero_frame_data;
+                    ld = picoquic_varint_encode(bytes, bytes_max - bytes, data_length);
+                }
+                if (ld == 0) {
+                    ret = -1;
+                }
+                else {
+                    bytes += ld;
+                }
+            }
+        }
+    }
+
+    if (ret == 0) {
+        size_t inline_length = (echo_length == 0) ? body_length : 0;
+
+        entry->response_length = (bytes - buffer) + inline_length;
+        entry->size = sizeof(h3zero_response_entry_t) + path_length + entry->response_length +
+            ((entry->file_entry == NULL) ? 0 : (size_t)entry->file_entry->file_size);
+        if (entry->size > cache->max_size || (entry->response = (uint8_t*)malloc(entry->response_length)) == NULL) {
+            ret = -1;
+        }
+        else {
+            memcpy(entry->response, buffer, bytes - buffer);
+            if (inline_length > 0) {
+                memcpy(entry->response + (bytes - buffer), body, inline_length);
+            }
+        }
+    }
+
+    if (ret == 0) {
+        h3zero_response_entry_t key;
+        picohash_item* item;
+
+        key.path = (uint8_t*)path;
+        key.path_length = path_length;
+        if ((item = picohash_retrieve(cache->table, &key)) != NULL) {
+            h3zero_response_entry_remove(cache, (h3zero_response_entry_t*)item->key);
+        }
+        if (picohash_insert(cache->table, entry) != 0) {
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        h3zero_response_entry_append(cache, entry);
+        cache->nb_entries++;
+        cache->total_size += entry->size;
+        while (cache->first_lru != entry &&
+            (cache->nb_entries > cache->max_entries || cache->total_size > cache->max_size)) {
+            h3zero_response_entry_remove(cache, cache->first_lru);
+        }
+    }
+    else if (entry != NULL) {
+        h3zero_response_entry_free(entry);
+        entry = NULL;
+    }
+
+    return entry;
+}
@@ -0,0 +1,296 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Compiled path table, used by the h3zero server to find the callback
+ * that handles a request path.
+ *
+ * The path table is compiled into a radix trie when the router is created.
+ * Chains of nodes that have a single child and end no route are merged, so
+ * each node is reached from its parent by a segment of one or more bytes.
+ * The segments point inside the paths of the table, and are not copied.
+ * The nodes are stored in a single array, in breadth first order, so that
+ * the children of a node are contiguous and sorted by the first byte of
+ * their segment. A lookup finds the child by binary search on the next
+ * byte of the path, then compares the rest of the segment, so its cost
+ * depends on the length of the path and not on the number of routes.
+ *
+ * Each node may end an exact route, a prefix route, or both. Exact routes
+ * match the path followed by nothing or by a query. Prefix routes match
+ * any path that starts with the prefix. If several routes match, exact
+ * routes are preferred, then the longest prefix. If the same path appears
+ * several times in the table, the first entry is used, as with the linear
+ * search in h3zero_find_path_item.
+ *
+ * The router only reads the path table, and does not change after it is
+ * created, so a single router can be shared by all the connections of a
+ * server, as long as the path table outlives it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "picoquic.h"
+#include "h3zero.h"
+#include "h3zero_common.h"
+#include "h3zero_uri.h"
+
+/* Nodes of the trie during construction, one per byte, with children in
+ * sorted lists. The label is the byte at position depth in the path of
+ * the item that created the node. */
+typedef struct st_h3zero_router_build_node_t {
+    int first_child;
+    int next_sibling;
+    int exact_item;
+    int prefix_item;
+    int item;
+    size_t depth;
+    uint8_t label;
+} h3zero_router_build_node_t;
+
+static int h3zero_router_build_child(h3zero_router_build_node_t* build, size_t* nb_build, int parent,
+    int item, size_t depth, uint8_t label)
+{
+    int* previous = &build[parent].first_child;
+    int child;
+
+    while (*previous >= 0 && build[*previous].label < label) {
+        previous = &build[*previous].next_sibling;
+    }
+    if (*previous >= 0 && build[*previous].label == label) {
+        child = *previous;
+    }
+    else {
+        child = (int)*nb_build;
+        *nb_build += 1;
+        build[child].first_child = -1;
+        build[child].next_sibling = *previous;
+        build[child].exact_item = -1;
+        build[child].prefix_item = -1;
+        build[child].item = item;
+        build[child].depth = depth;
+        build[child].label = label;
+        *previous = child;
+    }
+
+    return child;
+}
+
+static int h3zero_router_compile(h3zero_router_t* router)
+{
+    int ret = 0;
+    size_t max_nodes = 1;
+    size_t nb_build = 1;
+    h3zero_router_build_node_t* build = NULL;
+    int* order = NULL;
+
+    for (size_t i = 0; i < router->path_table_nb; i++) {
+        max_nodes += router->path_table[i].path_length;
+    }
+
+    if (max_nodes > INT32_MAX ||
+        (build = (h3zero_router_build_node_t*)malloc(max_nodes * sizeof(h3zero_router_build_node_t))) == NULL ||
+        (order = (int*)malloc(max_nodes * sizeof(int))) == NULL ||
+        (router->nodes = (h3zero_router_node_t*)malloc(max_nodes * sizeof(h3zero_router_node_t))) == NULL) {
+        ret = -1;
+    }
+    else {
+        size_t next_node = 1;
+
+        memset(&build[0], 0, sizeof(h3zero_router_build_node_t));
+        build[0].first_child = -1;
+        build[0].next_sibling = -1;
+        build[0].exact_item = -1;
+        build[0].prefix_item = -1;
+
+        for (size_t i = 0; i < router->path_table_nb; i++) {
+            const uint8_t* path = (const uint8_t*)router->path_table[i].path;
+            int node = 0;
+
+            for (size_t j = 0; j < router->path_table[i].path_length; j++) {
+                node = h3zero_router_build_child(build, &nb_build, node, (int)i, j, path[j]);
+            }
+            if (router->path_table[i].is_prefix) {
+                if (build[node].prefix_item < 0) {
+                    build[node].prefix_item = (int)i;
+                }
+            }
+            else if (build[node].exact_item < 0) {
+                build[node].exact_item = (int)i;
+            }
+        }
+
+        /* Copy the nodes in breadth first order, so children are contiguous,
+         * merging the chains of nodes that have a single child and end no route.
+         * The order array holds the last build node of each merged chain. */
+        memset(&router->nodes[0], 0, sizeof(h3zero_router_node_t));
+        router->nodes[0].exact_item = build[0].exact_item;
+        router->nodes[0].prefix_item = build[0].prefix_item;
+        order[0] = 0;
+
+        for (size_t q = 0; q < next_node; q++) {
+            int child = build[order[q]].first_child;
+
+            router->nodes[q].first_child = (uint32_t)next_node;
+            router->nodes[q].nb_children = 0;
+            while (child >= 0) {
+                h3zero_router_node_t* node = &router->nodes[next_node];
+                int last = child;
+                uint32_t segment_length = 1;
+
+                while (build[last].exact_item < 0 && build[last].prefix_item < 0 &&
+                    build[last].first_child >= 0 && build[build[last].first_child].next_sibling < 0) {
+                    last = build[last].first_child;
+                    segment_length++;
+                }
+                node->segment = (const uint8_t*)router->path_table[build[last].item].path +
+                    build[last].depth + 1 - segment_length;
+                node->segment_length = segment_length;
+                node->label = build[child].label;
+                node->exact_item = build[last].exact_item;
+                node->prefix_item = build[last].prefix_item;
+                order[next_node] = last;
+                router->nodes[q].nb_children++;
+                next_node++;
+                child = build[child].next_sibling;
+            }
+        }
+        router->nb_nodes = next_node;
+        if (next_node < max_nodes) {
+            /* Release the space saved by merging the chains */
+            h3zero_router_node_t* nodes = (h3zero_router_node_t*)realloc(router->nodes, next_node * sizeof(h3zero_router_node_t));
+            if (nodes != NULL) {
+                router->nodes = nodes;
+            }
+        }
+    }
+
+    if (build != NULL) {
+        free(build);
+    }
+    if (order != NULL) {
+        free(order);
+    }
+
+    return ret;
+}
+
+h3zero_router_t* h3zero_router_create(const picohttp_server_path_item_t* path_table, size_t path_table_nb)
+{
+    h3zero_router_t* router = (h3zero_router_t*)malloc(sizeof(h3zero_router_t));
+
+    if (router != NULL) {
+        memset(router, 0, sizeof(h3zero_router_t));
+        router->path_table = path_table;
+        router->path_table_nb = path_table_nb;
+        if (h3zero_router_compile(router) != 0) {
+            h3zero_router_delete(router);
+            router = NULL;
+        }
+    }
+
+    return router;
+}
+
+void h3zero_router_delete(h3zero_router_t* router)
+{
+    if (router->nodes != NULL) {
+        free(router->nodes);
+    }
+    free(router);
+}
+
+static const h3zero_router_node_t* h3zero_router_child(const h3zero_router_t* router, const h3zero_router_node_t* node, uint8_t label)
+{
+    const h3zero_router_node_t* child = NULL;
+    size_t low = node->first_child;
+    size_t high = low + node->nb_children;
+
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        uint8_t middle_label = router->nodes[middle].label;
+
+        if (middle_label == label) {
+            child = &router->nodes[middle];
+            break;
+        }
+        else if (middle_label < label) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    return child;
+}
+
+int h3zero_router_find(const h3zero_router_t* router, const uint8_t* path, size_t path_length, h3zero_route_match_t* match)
+{
+    const h3zero_router_node_t* node = &router->nodes[0];
+    size_t path_end = h3zero_pathabempty_length(path, path_length);
+    size_t prefix_length = 0;
+    size_t i = 0;
+    int exact_item = -1;
+    int prefix_item = -1;
+
+    while (node != NULL) {
+        if (node->prefix_item >= 0 && i <= path_end) {
+            prefix_item = node->prefix_item;
+            prefix_length = i;
+        }
+        if (node->exact_item >= 0 && (i == path_length || path[i] == (uint8_t)'?')) {
+            exact_item = node->exact_item;
+        }
+        if (i >= path_length) {
+            break;
+        }
+        node = h3zero_router_child(router, node, path[i]);
+        if (node != NULL) {
+            if (node->segment_length > path_length - i ||
+                memcmp(node->segment + 1, path + i + 1, node->segment_length - 1) != 0) {
+                break;
+            }
+            i += node->segment_length;
+        }
+    }
+
+    if (exact_item >= 0) {
+        match->path_item = exact_item;
+        match->suffix = path + path_end;
+        match->suffix_length = 0;
+    }
+    else {
+        match->path_item = prefix_item;
+        match->suffix = path + prefix_length;
+        match->suffix_length = (prefix_item >= 0) ? path_end - prefix_length : 0;
+    }
+    if (path_end < path_length) {
+        match->query = path + path_end + 1;
+        match->query_length = path_length - path_end - 1;
+    }
+    else {
+        match->query = NULL;
+        match->query_length = 0;
+    }
+
+    return match->path_item;
+}
@@ -215,17 +215,3 @@ int h3zero_server_prepare_to_send(void* context, size_t space, h3zero_stream_ctx
  *         for POST: finalize the response
  *         for CONNECT: close the context.
  */
-
-int picohttp_find_path_item(const uint8_t * path, size_t path_length, const picohttp_server_path_item_t * path_table, size_t path_table_nb)
-{
-    size_t i = 0;
-
-    while (i < path_table_nb) {
-        if (path_length >= path_table[i].path_length && memcmp(path, path_table[i].path, path_table[i].path_length) == 0){
-            return (int)i;
-        }
-        i++;
-    }
-    return -1;
-}
-
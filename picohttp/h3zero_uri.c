@@ -119,14 +119,9 @@
 
 size_t h3zero_pathabempty_length(const uint8_t* path, size_t path_length)
 {
-    size_t l = 0;
-    while (l < path_length) {
-        if (path[l] == (uint8_t)'?') {
-            break;
-        }
-        l++;
-    }
-    return l;
+    const uint8_t* query_mark = (path_length == 0) ? NULL : (const uint8_t*)memchr(path, '?', path_length);
+
+    return (query_mark == NULL) ? path_length : (size_t)(query_mark - path);
 }
 
 
@@ -174,13 +169,9 @@ size_t h3zero_query_parameter_position(const uint8_t* queries, size_t queries_le
 
 size_t h3zero_query_parameter_length(const uint8_t* parameter_value, size_t max_length)
 {
-    size_t next_char_index = 0;
+    const uint8_t* delimiter = (max_length == 0) ? NULL : (const uint8_t*)memchr(parameter_value, '&', max_length);
 
-    while (next_char_index < max_length && parameter_value[next_char_index] != (uint8_t)'&') {
-        next_char_index++;
-    }
-
-    return(next_char_index);
+    return (delimiter == NULL) ? max_length : (size_t)(delimiter - parameter_value);
 }
 
 size_t h3zero_query_parameter_pchar(const uint8_t* bytes, size_t length, size_t next_char_index, uint8_t* p, int * err)
@@ -314,3 +305,35 @@ int h3zero_query_parameter_number(const uint8_t* queries, size_t queries_length,
 
     return ret;
 }
+
+size_t h3zero_query_split(const uint8_t* queries, size_t queries_length, h3zero_query_parameter_t* parameters, size_t parameters_max)
+{
+    size_t nb_parameters = 0;
+    size_t begin_index = 0;
+
+    while (begin_index < queries_length && nb_parameters < parameters_max) {
+        size_t parameter_length = h3zero_query_parameter_length(queries + begin_index, queries_length - begin_index);
+
+        if (parameter_length > 0) {
+            const uint8_t* equal_sign = (const uint8_t*)memchr(queries + begin_index, '=', parameter_length);
+            h3zero_query_parameter_t* parameter = &parameters[nb_parameters];
+
+            parameter->name = queries + begin_index;
+            if (equal_sign == NULL) {
+                parameter->name_length = parameter_length;
+                parameter->value = NULL;
+                parameter->value_length = 0;
+            }
+            else {
+                parameter->name_length = equal_sign - parameter->name;
+                parameter->value = equal_sign + 1;
+                parameter->value_length = parameter_length - parameter->name_length - 1;
+            }
+            nb_parameters++;
+        }
+        /* Skip the parameter and the & delimiter */
+        begin_index += parameter_length + 1;
+    }
+
+    return nb_parameters;
+}
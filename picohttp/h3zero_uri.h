@@ -48,6 +48,18 @@ int h3zero_query_parameter_string(const uint8_t* queries, size_t queries_length,
 
 int h3zero_query_parameter_number(const uint8_t* queries, size_t queries_length, const char* parameter_id, size_t parameter_id_length, uint64_t* number, uint64_t default_number);
 
+/* Parameters of a query, pointing inside the query. The values are not decoded,
+ * h3zero_query_bytes_to_string or h3zero_query_bytes_to_uint64 can be used for that. */
+typedef struct st_h3zero_query_parameter_t {
+    const uint8_t* name;
+    size_t name_length;
+    const uint8_t* value; /* NULL if the parameter has no '=' */
+    size_t value_length;
+} h3zero_query_parameter_t;
+
+/* Split the query in at most parameters_max parameters. Returns the number of parameters found. */
+size_t h3zero_query_split(const uint8_t* queries, size_t queries_length, h3zero_query_parameter_t* parameters, size_t parameters_max);
+
 #ifdef __cplusplus
 }
 #endif
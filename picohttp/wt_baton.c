@@ -550,14 +550,11 @@ int wt_baton_provide_data(picoquic_cnx_t* cnx,
     return ret;
 }
 
-int wt_baton_ctx_path_params(wt_baton_ctx_t* baton_ctx, const uint8_t* path, size_t path_length)
+static int wt_baton_ctx_query_params(wt_baton_ctx_t* baton_ctx, const uint8_t* queries, size_t queries_length)
 {
     int ret = 0;
-    size_t query_offset = h3zero_query_offset(path, path_length);
-    if (query_offset < path_length) {
-        const uint8_t* queries = path + query_offset;
-        size_t queries_length = path_length - query_offset;
 
+    if (queries != NULL && queries_length > 0) {
         if (h3zero_query_parameter_number(queries, queries_length, "version", 5, &baton_ctx->version, 0) != 0 ||
             h3zero_query_parameter_number(queries, queries_length, "baton", 5, &baton_ctx->initial_baton, 0) != 0 ||
             h3zero_query_parameter_number(queries, queries_length, "count", 5, &baton_ctx->nb_lanes, 1) != 0 ||
@@ -580,6 +577,13 @@ int wt_baton_ctx_path_params(wt_baton_ctx_t* baton_ctx, const uint8_t* path, siz
     return ret;
 }
 
+int wt_baton_ctx_path_params(wt_baton_ctx_t* baton_ctx, const uint8_t* path, size_t path_length)
+{
+    size_t query_offset = h3zero_query_offset(path, path_length);
+
+    return wt_baton_ctx_query_params(baton_ctx, path + query_offset, path_length - query_offset);
+}
+
 /* Accept an incoming connection */
 int wt_baton_accept(picoquic_cnx_t* cnx,
     uint8_t* path, size_t path_length,
@@ -597,8 +601,11 @@ int wt_baton_accept(picoquic_cnx_t* cnx,
         /* register the incoming stream ID */
         ret = wt_baton_ctx_init(baton_ctx, h3_ctx, app_ctx, stream_ctx);
 
-        /* init the global parameters */
-        if (path != NULL && path_length > 0) {
+        /* init the global parameters, using the query found by the server router if there is one */
+        if (stream_ctx->route.suffix != NULL) {
+            ret = wt_baton_ctx_query_params(baton_ctx, stream_ctx->route.query, stream_ctx->route.query_length);
+        }
+        else if (path != NULL && path_length > 0) {
             ret = wt_baton_ctx_path_params(baton_ctx, path, path_length);
         }
 
@@ -732,6 +739,9 @@ int wt_baton_provide_datagram(picoquic_cnx_t* cnx,
         if (space > 1536) {
             space = 1536;
         }
+        if (baton_ctx->datagram_size > 0 && space > baton_ctx->datagram_size) {
+            space = baton_ctx->datagram_size;
+        }
         if (space < 3) {
             /* Not enough space to send anything */
         }
@@ -771,7 +781,10 @@ int wt_baton_callback(picoquic_cnx_t* cnx,
     void* path_app_ctx)
 {
     int ret = 0;
-    DBG_PRINTF("wt_baton_callback: %d, %" PRIi64 "\n", (int)wt_event, (stream_ctx == NULL)?(int64_t)-1:(int64_t)stream_ctx->stream_id);
+    if (wt_event != picohttp_callback_post_datagram && wt_event != picohttp_callback_provide_datagram) {
+        /* Datagram events are not traced, to keep the datagram path cheap */
+        DBG_PRINTF("wt_baton_callback: %d, %" PRIi64 "\n", (int)wt_event, (stream_ctx == NULL)?(int64_t)-1:(int64_t)stream_ctx->stream_id);
+    }
     switch (wt_event) {
     case picohttp_callback_connecting:
         ret = wt_baton_connecting(cnx, stream_ctx, path_app_ctx);
@@ -117,6 +117,7 @@ extern "C" {
         int nb_datagrams_sent;
         size_t nb_datagram_bytes_sent;
         int is_datagram_ready;
+        size_t datagram_size; /* Size of datagrams sent, 0 to fill the available space */
         uint8_t baton_datagram_send_next;
         uint64_t nb_baton_bytes_received;
         uint64_t nb_baton_bytes_sent;
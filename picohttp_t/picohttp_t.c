@@ -50,6 +50,7 @@ static const picoquic_test_def_t test_table[] = {
     { "h3zero_incoming_unidir", h3zero_incoming_unidir_test },
     { "qpack_huffman", qpack_huffman_test },
     { "qpack_huffman_base", qpack_huffman_base_test},
+    { "qpack_huffman_encode", qpack_huffman_encode_test },
     { "h3zero_parse_qpack", h3zero_parse_qpack_test },
     { "h3zero_prepare_qpack", h3zero_prepare_qpack_test },
     { "h3zero_user_agent", h3zero_user_agent_test },
@@ -68,6 +69,18 @@ static const picoquic_test_def_t test_table[] = {
     { "demo_file_sanitize", demo_file_sanitize_test },
     { "demo_file_access", demo_file_access_test },
     { "demo_server_file", demo_server_file_test },
+    { "h3zero_file_cache", h3zero_file_cache_test },
+    { "h3zero_file_cache_bench", h3zero_file_cache_bench_test },
+    { "h3zero_response_cache", h3zero_response_cache_test },
+    { "h3zero_response_cache_bench", h3zero_response_cache_bench_test },
+    { "h3zero_priority", h3zero_priority_test },
+    { "h3zero_priority_page_load", h3zero_priority_page_load_test },
+    { "h3zero_frame_pool", h3zero_frame_pool_test },
+    { "h3zero_stream_index", h3zero_stream_index_test },
+    { "h3zero_loadgen_histogram", h3zero_loadgen_histogram_test },
+    { "h3zero_loadgen", h3zero_loadgen_test },
+    { "h3zero_router", h3zero_router_test },
+    { "h3zero_router_bench", h3zero_router_bench_test },
     { "h3zero_satellite", h3zero_satellite_test },
     { "h09_satellite", h09_satellite_test },
     { "h09_lone_fin", h09_lone_fin_test },
@@ -81,6 +94,9 @@ static const picoquic_test_def_t test_table[] = {
     { "h09_multi_file_loss", h09_multi_file_loss_test },
     { "h09_multi_file_preemptive", h09_multi_file_preemptive_test },
     { "h3zero_settings", h3zero_settings_test },
+    { "h3zero_qpack_dynamic", h3zero_qpack_dynamic_test },
+    { "h3zero_qpack_bench", h3zero_qpack_bench_test },
+    { "h3zero_qpack_huffman_bench", h3zero_qpack_huffman_bench_test },
     { "http_stress", http_stress_test },
     { "http_corrupt", http_corrupt_test},
     { "http_corrupt_rdpn", http_corrupt_rdpn_test},
@@ -91,7 +107,8 @@ static const picoquic_test_def_t test_table[] = {
     { "picowt_baton_multi", picowt_baton_multi_test },
     { "picowt_baton_random", picowt_baton_random_test },
     { "picowt_baton_uri", picowt_baton_uri_test },
-    { "picowt_baton_wrong", picowt_baton_wrong_test }
+    { "picowt_baton_wrong", picowt_baton_wrong_test },
+    { "picowt_baton_datagram", picowt_baton_datagram_test }
 };
 
 static size_t const nb_tests = sizeof(test_table) / sizeof(picoquic_test_def_t);
@@ -31,6 +31,7 @@
 #include "qlog.h"
 #include "cidset.h"
 #include "logreader.h"
+#include "logbatch.h"
 #ifdef _WINDOWS
 #include "../picoquicfirst/getopt.h"
 #endif
@@ -54,6 +55,7 @@ int convert_csv(const picoquic_connection_id_t * cid, void * ptr);
 int convert_svg(const picoquic_connection_id_t * cid, void * ptr);
 int convert_qlog(const picoquic_connection_id_t * cid, void * ptr);
 int filedump_binlog(FILE* bin_log, FILE* bin_dump);
+int batch_convert(const app_conversion_context_t* appctx, char const** binlog_names, size_t nb_binlogs, int nb_threads);
 
 int usage();
 void usage_formats();
@@ -82,8 +84,11 @@ int main(int argc, char ** argv)
     app_conversion_context_t appctx = { 0 };
     appctx.out_format = "csv";
 
+    int is_batch = 0;
+    int nb_threads = 4;
+
     int opt;
-    while ((opt = getopt(argc, argv, "o:f:t:c:h")) != -1) {
+    while ((opt = getopt(argc, argv, "o:f:t:c:bj:h")) != -1) {
         switch (opt) {
         case 'o':
             appctx.out_dir = optarg;
@@ -97,6 +102,15 @@ int main(int argc, char ** argv)
         case 'c':
             cid_name = optarg;
             break;
+        case 'b':
+            is_batch = 1;
+            break;
+        case 'j':
+            if ((nb_threads = atoi(optarg)) <= 0) {
+                fprintf(stderr, "Invalid number of threads: %s\n", optarg);
+                return usage();
+            }
+            break;
         case 'h':
         default:
             return usage();
@@ -104,11 +118,17 @@ int main(int argc, char ** argv)
         }
     }
 
-    if (optind < argc) {
-        appctx.binlog_name = argv[optind++];
-    } else {
+    if (optind >= argc) {
         return usage();
     }
+    else if (is_batch) {
+        (void)cidset_delete(cids);
+        debug_printf_push_stream(stderr);
+        return batch_convert(&appctx, (char const**)(argv + optind), (size_t)(argc - optind), nb_threads);
+    }
+    else {
+        appctx.binlog_name = argv[optind++];
+    }
 
     if (cids == NULL) {
         fprintf(stderr, "Fatal: failed to create resources.\n");
@@ -216,6 +236,7 @@ int usage()
 {
     fprintf(stderr, "PicoQUIC log file converter\n");
     fprintf(stderr, "Usage: picolog <options> input \n");
+    fprintf(stderr, "       picolog -b <options> input [input ...]\n");
     fprintf(stderr, "\n");
     fprintf(stderr, "Options:\n");
     fprintf(stderr, "  -o directory          output directory name\n");
@@ -224,6 +245,9 @@ int usage()
     usage_formats();
     fprintf(stderr, "  -t template-file      template file for svg format conversion\n");
     fprintf(stderr, "  -c connection-id      only convert logs of specified connection id\n");
+    fprintf(stderr, "  -b                    batch mode: convert all connections of all the input\n");
+    fprintf(stderr, "                        files in parallel, qlog or csv format only\n");
+    fprintf(stderr, "  -j threads            number of conversion threads in batch mode, default 4\n");
     fprintf(stderr, "\n");
     fprintf(stderr, "picolog converts binary log files into the format specified. Output files are\n");
     fprintf(stderr, "placed in the specified directory with their connection-id as file name.\n");
@@ -242,6 +266,37 @@ void usage_formats()
     fprintf(stderr, "                        -f qlog : generate IETF QLOG file\n");
 }
 
+int batch_convert(const app_conversion_context_t* appctx, char const** binlog_names, size_t nb_binlogs, int nb_threads)
+{
+    int ret = 0;
+    binlog_batch_format_enum format = binlog_batch_format_qlog;
+    binlog_batch_stats_t stats;
+
+    if (strcmp(appctx->out_format, "csv") == 0) {
+        format = binlog_batch_format_csv;
+    }
+    else if (strcmp(appctx->out_format, "qlog") != 0) {
+        fprintf(stderr, "Batch mode only supports the qlog and csv formats.\n");
+        ret = 1;
+    }
+
+    if (ret == 0) {
+        double duration = 0;
+
+        ret = binlog_batch_convert(binlog_names, nb_binlogs, appctx->out_dir, format, nb_threads, &stats);
+        duration = ((double)stats.duration_us) / 1000000.0;
+        if (duration <= 0) {
+            duration = 0.000001;
+        }
+        fprintf(stderr, "Converted %" PRIst " connection(s) from %" PRIst " file(s) in %.3f s with %d thread(s), %" PRIst " error(s).\n",
+            stats.nb_connections, stats.nb_files, duration, nb_threads, stats.nb_errors);
+        fprintf(stderr, "%.1f files/s, %.1f connections/s.\n",
+            ((double)stats.nb_files) / duration, ((double)stats.nb_connections) / duration);
+    }
+
+    return ret;
+}
+
 int convert_csv(const picoquic_connection_id_t * cid, void * ptr)
 {
     const app_conversion_context_t* appctx = (const app_conversion_context_t*)ptr;
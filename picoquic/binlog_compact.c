@@ -0,0 +1,163 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Compact binary log records.
+ *
+ * The log writer composes each event as a classic record: 32 bit length,
+ * then CID, absolute time, path ID, event type, and event data. In the
+ * compact format, the record is rewritten as:
+ *
+ *     vint (connection number << 1) | cid_present
+ *     cid, only if cid_present
+ *     vint time delta from the previous event of the connection, zigzag coded
+ *     vint path ID
+ *     vint event type
+ *     event data
+ *
+ * The CID is sent once, in the first record of the connection in the file,
+ * and then designated by its connection number. For PDU events, the peer
+ * and local addresses are replaced by references to a per connection
+ * dictionary:
+ *
+ *     vint (index << 1) | address_present
+ *     address, only if address_present
+ *
+ * A new address is added to the dictionary at the next free index. When the
+ * dictionary is full, addresses are sent with index set to the dictionary
+ * size, and the readers do not store them.
+ *
+ * The state of the encoder is kept per connection, so the records of a
+ * connection can be decoded without reading the records of the other
+ * connections, as needed when reading a log segment through its index.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "picoquic_internal.h"
+#include "picoquic_utils.h"
+#include "picoquic_binlog.h"
+#include "bytestream.h"
+
+void binlog_compact_init(picoquic_binlog_compact_t* state, uint64_t connection_number)
+{
+    memset(state, 0, sizeof(picoquic_binlog_compact_t));
+    state->connection_number = connection_number;
+}
+
+static int binlog_compact_encode_addr(picoquic_binlog_compact_t* state, bytestream* s, bytestream* out)
+{
+    const uint8_t* addr = bytestream_ptr(s);
+    size_t addr_length;
+    size_t index = 0;
+    int ret = byteskip_addr(s);
+
+    if (ret == 0) {
+        addr_length = bytestream_ptr(s) - addr;
+
+        while (index < state->nb_addr &&
+            (state->addr_length[index] != addr_length || memcmp(state->addr[index], addr, addr_length) != 0)) {
+            index++;
+        }
+
+        if (index < state->nb_addr) {
+            ret = bytewrite_vint(out, index << 1);
+        }
+        else {
+            if (state->nb_addr < PICOQUIC_BINLOG_COMPACT_ADDR_MAX && addr_length <= PICOQUIC_BINLOG_COMPACT_ADDR_SIZE) {
+                memcpy(state->addr[index], addr, addr_length);
+                state->addr_length[index] = addr_length;
+                state->nb_addr++;
+            }
+            else {
+                index = PICOQUIC_BINLOG_COMPACT_ADDR_MAX;
+            }
+            ret = bytewrite_vint(out, (index << 1) | 1);
+            ret |= bytewrite_buffer(out, addr, addr_length);
+        }
+    }
+
+    return ret;
+}
+
+int binlog_compact_encode(picoquic_binlog_compact_t* state, const uint8_t* record, size_t length,
+    uint8_t* compact, size_t compact_max, size_t* compact_length)
+{
+    bytestream stream;
+    bytestream* s = bytestream_ref_init(&stream, record, length);
+    bytestream out_stream;
+    bytestream* out = bytestream_ref_init(&out_stream, compact, compact_max);
+    picoquic_connection_id_t cid;
+    uint64_t current_time = 0;
+    uint64_t path_id = 0;
+    uint64_t event_type = 0;
+    size_t nb_addr = state->nb_addr;
+    int ret = 0;
+
+    if ((ret = bytestream_skip(s, 4)) == 0 &&
+        (ret = byteread_cid(s, &cid)) == 0 &&
+        (ret = byteread_vint(s, &current_time)) == 0 &&
+        (ret = byteread_vint(s, &path_id)) == 0 &&
+        (ret = byteread_vint(s, &event_type)) == 0) {
+        int64_t delta = (int64_t)(current_time - state->last_time);
+        uint64_t zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+
+        ret |= bytewrite_int32(out, 0);
+        if (state->is_cid_sent) {
+            ret |= bytewrite_vint(out, state->connection_number << 1);
+        }
+        else {
+            ret |= bytewrite_vint(out, (state->connection_number << 1) | 1);
+            ret |= bytewrite_cid(out, &cid);
+        }
+        ret |= bytewrite_vint(out, zigzag);
+        ret |= bytewrite_vint(out, path_id);
+        ret |= bytewrite_vint(out, event_type);
+
+        if (ret == 0 && (event_type == picoquic_log_event_pdu_sent || event_type == picoquic_log_event_pdu_recv)) {
+            /* Peer address, packet length, local address */
+            uint64_t packet_length = 0;
+
+            if ((ret = binlog_compact_encode_addr(state, s, out)) == 0 &&
+                (ret = byteread_vint(s, &packet_length)) == 0 &&
+                (ret = bytewrite_vint(out, packet_length)) == 0) {
+                ret = binlog_compact_encode_addr(state, s, out);
+            }
+        }
+
+        if (ret == 0) {
+            ret = bytewrite_buffer(out, bytestream_ptr(s), bytestream_remain(s));
+        }
+
+        if (ret == 0) {
+            /* The state is only updated if the record is written */
+            state->is_cid_sent = 1;
+            state->last_time = current_time;
+            picoformat_32(compact, (uint32_t)(bytestream_length(out) - 4));
+            *compact_length = bytestream_length(out);
+        }
+        else {
+            state->nb_addr = nb_addr;
+        }
+    }
+
+    return ret;
+}
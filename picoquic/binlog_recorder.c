@@ -0,0 +1,204 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Binary log policies and flight recorder.
+ *
+ * When the logging policy sets a flight recorder depth or a threshold,
+ * the log records of a connection are not written to a file, but kept
+ * in a circular list of the last K records. Each slot keeps its buffer
+ * when it is reused, so once the list is full, recording an event only
+ * costs a copy. The records are kept in the classic format, and are
+ * written through the regular log writer if the connection crosses one
+ * of the thresholds or closes with an error. Otherwise, they are
+ * discarded when the connection closes.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "picoquic_internal.h"
+#include "picoquic_utils.h"
+#include "picoquic_binlog.h"
+
+typedef struct st_binlog_recorder_slot_t {
+    uint8_t* data;
+    size_t length;
+    size_t allocated;
+} binlog_recorder_slot_t;
+
+typedef struct st_binlog_recorder_t {
+    size_t nb_slots;
+    size_t first;
+    size_t count;
+    binlog_recorder_slot_t slot[1];
+} binlog_recorder_t;
+
+void* binlog_recorder_create(size_t nb_events)
+{
+    binlog_recorder_t* recorder = NULL;
+
+    if (nb_events > 0) {
+        size_t alloc_size = sizeof(binlog_recorder_t) + (nb_events - 1) * sizeof(binlog_recorder_slot_t);
+        recorder = (binlog_recorder_t*)malloc(alloc_size);
+        if (recorder != NULL) {
+            memset(recorder, 0, alloc_size);
+            recorder->nb_slots = nb_events;
+        }
+    }
+
+    return recorder;
+}
+
+void binlog_recorder_delete(void* v_recorder)
+{
+    binlog_recorder_t* recorder = (binlog_recorder_t*)v_recorder;
+
+    if (recorder != NULL) {
+        for (size_t i = 0; i < recorder->nb_slots; i++) {
+            if (recorder->slot[i].data != NULL) {
+                free(recorder->slot[i].data);
+            }
+        }
+        free(recorder);
+    }
+}
+
+int binlog_recorder_add(void* v_recorder, const uint8_t* record, size_t length)
+{
+    binlog_recorder_t* recorder = (binlog_recorder_t*)v_recorder;
+    binlog_recorder_slot_t* slot;
+    int ret = 0;
+
+    if (recorder->count < recorder->nb_slots) {
+        slot = &recorder->slot[(recorder->first + recorder->count) % recorder->nb_slots];
+    }
+    else {
+        /* Overwrite the oldest record */
+        slot = &recorder->slot[recorder->first];
+    }
+
+    if (slot->allocated < length) {
+        uint8_t* data = (uint8_t*)malloc(length);
+        if (data == NULL) {
+            ret = PICOQUIC_ERROR_MEMORY;
+        }
+        else {
+            if (slot->data != NULL) {
+                free(slot->data);
+            }
+            slot->data = data;
+            slot->allocated = length;
+        }
+    }
+
+    if (ret == 0) {
+        memcpy(slot->data, record, length);
+        slot->length = length;
+        if (recorder->count < recorder->nb_slots) {
+            recorder->count++;
+        }
+        else {
+            recorder->first = (recorder->first + 1) % recorder->nb_slots;
+        }
+    }
+
+    return ret;
+}
+
+size_t binlog_recorder_count(void* v_recorder)
+{
+    return ((binlog_recorder_t*)v_recorder)->count;
+}
+
+/* Get the record number i, starting with the oldest */
+const uint8_t* binlog_recorder_get(void* v_recorder, size_t i, size_t* length)
+{
+    binlog_recorder_t* recorder = (binlog_recorder_t*)v_recorder;
+    const uint8_t* record = NULL;
+
+    if (i < recorder->count) {
+        binlog_recorder_slot_t* slot = &recorder->slot[(recorder->first + i) % recorder->nb_slots];
+        record = slot->data;
+        *length = slot->length;
+    }
+
+    return record;
+}
+
+/* Policy checks */
+
+int binlog_policy_is_sampled(picoquic_quic_t* quic)
+{
+    int is_sampled = 1;
+
+    if (quic->binlog_policy.sample_one_in_n > 1) {
+        is_sampled = (quic->binlog_sample_count % quic->binlog_policy.sample_one_in_n) == 0;
+        quic->binlog_sample_count++;
+    }
+
+    return is_sampled;
+}
+
+int binlog_policy_uses_recorder(picoquic_quic_t* quic)
+{
+    return (quic->binlog_policy.recorder_depth > 0 || quic->binlog_policy.retransmit_per_mille > 0 ||
+        quic->binlog_policy.rtt_threshold > 0 || quic->binlog_policy.handshake_threshold > 0);
+}
+
+int binlog_policy_is_exceeded(picoquic_cnx_t* cnx, uint64_t current_time)
+{
+    picoquic_binlog_policy_t* policy = &cnx->quic->binlog_policy;
+    int is_exceeded = 0;
+
+    if (policy->retransmit_per_mille > 0 && cnx->nb_packets_sent >= PICOQUIC_BINLOG_POLICY_MIN_PACKETS &&
+        cnx->nb_retransmission_total * 1000 > cnx->nb_packets_sent * policy->retransmit_per_mille) {
+        is_exceeded = 1;
+    }
+    else if (policy->rtt_threshold > 0 && cnx->path[0]->smoothed_rtt > policy->rtt_threshold) {
+        is_exceeded = 1;
+    }
+    else if (policy->handshake_threshold > 0 && cnx->cnx_state < picoquic_state_client_ready_start &&
+        current_time > cnx->start_time + policy->handshake_threshold) {
+        is_exceeded = 1;
+    }
+
+    return is_exceeded;
+}
+
+int binlog_policy_is_error(picoquic_cnx_t* cnx)
+{
+    return (cnx->local_error != 0 || cnx->remote_error != 0 ||
+        cnx->application_error != 0 || cnx->remote_application_error != 0);
+}
+
+void picoquic_set_binlog_policy(picoquic_quic_t* quic, const picoquic_binlog_policy_t* policy)
+{
+    if (policy == NULL) {
+        memset(&quic->binlog_policy, 0, sizeof(picoquic_binlog_policy_t));
+    }
+    else {
+        quic->binlog_policy = *policy;
+        if (quic->binlog_policy.recorder_depth == 0 && binlog_policy_uses_recorder(quic)) {
+            quic->binlog_policy.recorder_depth = PICOQUIC_BINLOG_RECORDER_DEFAULT_DEPTH;
+        }
+    }
+    quic->binlog_sample_count = 0;
+}
@@ -0,0 +1,415 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Binary log ring.
+ *
+ * When the ring is enabled, the binary log events of all connections in a
+ * QUIC context are serialized into a single producer, single consumer ring
+ * buffer. The QUIC context is only ever used by one thread, so the ring is
+ * in effect per thread and the producer side needs no lock. A writer
+ * thread drains the ring, opens the per connection log files, and
+ * performs the file I/O.
+ *
+ * The producer owns the head index, the writer owns the tail index. Each
+ * side publishes its index with release semantics and reads the other
+ * side's with acquire semantics. Data records are dropped when the ring is
+ * full, so that logging never blocks the packet loop. Open and close
+ * records are never dropped; if the ring is full, the producer waits for
+ * the writer to make room.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "picoquic_internal.h"
+#include "picoquic_utils.h"
+#include "picoquic_binlog.h"
+
+#define BINLOG_RING_SIZE_MIN 0x10000
+#define BINLOG_RING_RECORD_MAX 0x4000
+#define BINLOG_RING_WAIT_MICROS 10000
+#define BINLOG_RING_CACHE_LINE 64
+
+#ifdef _WINDOWS
+static size_t binlog_ring_load_acquire(volatile size_t* p)
+{
+    size_t v = *p;
+    MemoryBarrier();
+    return v;
+}
+
+static void binlog_ring_store_release(volatile size_t* p, size_t v)
+{
+    MemoryBarrier();
+    *p = v;
+}
+#else
+static size_t binlog_ring_load_acquire(volatile size_t* p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void binlog_ring_store_release(volatile size_t* p, size_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+#endif
+
+typedef enum {
+    binlog_ring_record_open = 1,
+    binlog_ring_record_data,
+    binlog_ring_record_close
+} binlog_ring_record_enum;
+
+typedef struct st_binlog_ring_file_t {
+    FILE* f;
+    char* file_name;
+    void* qlog_job;
+    picoquic_autoqlog_run_fn qlog_run_fn;
+} binlog_ring_file_t;
+
+typedef struct st_binlog_ring_record_t {
+    uint32_t length;
+    uint32_t record_type;
+    binlog_ring_file_t* file;
+} binlog_ring_record_t;
+
+typedef struct st_picoquic_binlog_ring_t {
+    uint8_t* buffer;
+    size_t size;
+    size_t mask;
+    /* Producer side, only written by the packet loop thread */
+    volatile size_t head;
+    uint64_t nb_records;
+    uint64_t nb_dropped;
+    uint8_t head_pad[BINLOG_RING_CACHE_LINE];
+    /* Consumer side, only written by the writer thread */
+    volatile size_t tail;
+    uint8_t tail_pad[BINLOG_RING_CACHE_LINE];
+    volatile size_t should_stop;
+    picoquic_event_t data_event;
+    picoquic_event_t space_event;
+    picoquic_thread_t thread;
+    uint8_t* record_buffer;
+} picoquic_binlog_ring_t;
+
+static void binlog_ring_copy_in(picoquic_binlog_ring_t* ring, size_t index, const uint8_t* data, size_t length)
+{
+    size_t offset = index & ring->mask;
+    size_t first = ring->size - offset;
+
+    if (first >= length) {
+        memcpy(ring->buffer + offset, data, length);
+    }
+    else {
+        memcpy(ring->buffer + offset, data, first);
+        memcpy(ring->buffer, data + first, length - first);
+    }
+}
+
+static void binlog_ring_copy_out(picoquic_binlog_ring_t* ring, size_t index, uint8_t* data, size_t length)
+{
+    size_t offset = index & ring->mask;
+    size_t first = ring->size - offset;
+
+    if (first >= length) {
+        memcpy(data, ring->buffer + offset, length);
+    }
+    else {
+        memcpy(data, ring->buffer + offset, first);
+        memcpy(data + first, ring->buffer, length - first);
+    }
+}
+
+static size_t binlog_ring_record_size(size_t length)
+{
+    return (sizeof(binlog_ring_record_t) + length + 7) & ~((size_t)7);
+}
+
+static void binlog_ring_file_free(binlog_ring_file_t* file)
+{
+    if (file->f != NULL) {
+        (void)fflush(file->f);
+        file->f = picoquic_file_close(file->f);
+    }
+    file->file_name = picoquic_string_free(file->file_name);
+    free(file);
+}
+
+/* Writer thread: process one record from the ring. */
+static void binlog_ring_process(binlog_ring_record_t* record, const uint8_t* data)
+{
+    binlog_ring_file_t* file = record->file;
+
+    switch (record->record_type) {
+    case binlog_ring_record_open:
+        file->f = picoquic_file_open(file->file_name, "wb");
+        if (file->f == NULL) {
+            DBG_PRINTF("Cannot open file %s for write.\n", file->file_name);
+        }
+        else if (fwrite(data, record->length, 1, file->f) != 1) {
+            DBG_PRINTF("Cannot write header for file %s.\n", file->file_name);
+            file->f = picoquic_file_close(file->f);
+        }
+        break;
+    case binlog_ring_record_data:
+        if (file->f != NULL) {
+            (void)fwrite(data, record->length, 1, file->f);
+        }
+        break;
+    case binlog_ring_record_close:
+        if (file->f != NULL) {
+            (void)fflush(file->f);
+            file->f = picoquic_file_close(file->f);
+        }
+        if (file->qlog_job != NULL && file->qlog_run_fn != NULL) {
+            file->qlog_run_fn(file->qlog_job);
+        }
+        binlog_ring_file_free(file);
+        break;
+    default:
+        break;
+    }
+}
+
+static picoquic_thread_return_t binlog_ring_writer(void* v_ring)
+{
+    picoquic_binlog_ring_t* ring = (picoquic_binlog_ring_t*)v_ring;
+    size_t tail = ring->tail;
+
+    while (1) {
+        size_t head = binlog_ring_load_acquire(&ring->head);
+
+        if (head != tail) {
+            binlog_ring_record_t record;
+
+            binlog_ring_copy_out(ring, tail, (uint8_t*)&record, sizeof(record));
+            binlog_ring_copy_out(ring, tail + sizeof(record), ring->record_buffer, record.length);
+            binlog_ring_process(&record, ring->record_buffer);
+            tail += binlog_ring_record_size(record.length);
+            binlog_ring_store_release(&ring->tail, tail);
+        }
+        else if (binlog_ring_load_acquire(&ring->should_stop)) {
+            break;
+        }
+        else {
+            /* The ring is empty: let a waiting producer proceed, then sleep until
+             * signalled or until the next polling interval. */
+            (void)picoquic_signal_event(&ring->space_event);
+            (void)picoquic_wait_for_event(&ring->data_event, BINLOG_RING_WAIT_MICROS);
+        }
+    }
+
+    picoquic_thread_do_return;
+}
+
+/* Producer side: queue a record. Returns 0 if queued, -1 if dropped. */
+static int binlog_ring_push(picoquic_binlog_ring_t* ring, binlog_ring_record_enum record_type,
+    binlog_ring_file_t* file, const uint8_t* data, size_t length)
+{
+    int ret = 0;
+    size_t record_size = binlog_ring_record_size(length);
+    size_t head = ring->head;
+    size_t tail = binlog_ring_load_acquire(&ring->tail);
+    int must_deliver = (record_type != binlog_ring_record_data);
+
+    if (length > BINLOG_RING_RECORD_MAX || record_size > ring->size) {
+        ret = -1;
+    }
+    else {
+        while (ring->size - (head - tail) < record_size) {
+            (void)picoquic_signal_event(&ring->data_event);
+            if (!must_deliver) {
+                ret = -1;
+                break;
+            }
+            (void)picoquic_wait_for_event(&ring->space_event, 1000);
+            tail = binlog_ring_load_acquire(&ring->tail);
+        }
+    }
+
+    if (ret == 0) {
+        binlog_ring_record_t record;
+
+        memset(&record, 0, sizeof(record));
+        record.length = (uint32_t)length;
+        record.record_type = (uint32_t)record_type;
+        record.file = file;
+        binlog_ring_copy_in(ring, head, (const uint8_t*)&record, sizeof(record));
+        if (length > 0) {
+            binlog_ring_copy_in(ring, head + sizeof(record), data, length);
+        }
+        binlog_ring_store_release(&ring->head, head + record_size);
+        ring->nb_records++;
+
+        /* Only wake the writer when the ring is filling up or when a file is
+         * closed, so that the common case involves no system call. */
+        if (must_deliver || 2 * (head + record_size - tail) > ring->size) {
+            (void)picoquic_signal_event(&ring->data_event);
+        }
+    }
+    else {
+        ring->nb_dropped++;
+    }
+
+    return ret;
+}
+
+void* binlog_ring_open(picoquic_quic_t* quic, char const* file_name, const uint8_t* header, size_t header_length)
+{
+    picoquic_binlog_ring_t* ring = (picoquic_binlog_ring_t*)quic->v_binlog_ring;
+    binlog_ring_file_t* file = NULL;
+
+    if (ring != NULL && (file = (binlog_ring_file_t*)malloc(sizeof(binlog_ring_file_t))) != NULL) {
+        memset(file, 0, sizeof(binlog_ring_file_t));
+        if ((file->file_name = picoquic_string_duplicate(file_name)) == NULL) {
+            free(file);
+            file = NULL;
+        }
+        else if (binlog_ring_push(ring, binlog_ring_record_open, file, header, header_length) != 0) {
+            binlog_ring_file_free(file);
+            file = NULL;
+        }
+    }
+
+    return file;
+}
+
+int binlog_ring_write(picoquic_quic_t* quic, void* v_file, const uint8_t* data, size_t length)
+{
+    int ret = -1;
+
+    if (quic->v_binlog_ring != NULL) {
+        ret = binlog_ring_push((picoquic_binlog_ring_t*)quic->v_binlog_ring, binlog_ring_record_data,
+            (binlog_ring_file_t*)v_file, data, length);
+    }
+
+    return ret;
+}
+
+void binlog_ring_close(picoquic_quic_t* quic, void* v_file, void* qlog_job, picoquic_autoqlog_run_fn qlog_run_fn)
+{
+    binlog_ring_file_t* file = (binlog_ring_file_t*)v_file;
+    binlog_ring_record_t record;
+
+    file->qlog_job = qlog_job;
+    file->qlog_run_fn = qlog_run_fn;
+    if (quic->v_binlog_ring != NULL) {
+        (void)binlog_ring_push((picoquic_binlog_ring_t*)quic->v_binlog_ring, binlog_ring_record_close, file, NULL, 0);
+    }
+    else {
+        /* The ring was stopped while the connection was open. */
+        memset(&record, 0, sizeof(record));
+        record.record_type = binlog_ring_record_close;
+        record.file = file;
+        binlog_ring_process(&record, NULL);
+    }
+}
+
+static void binlog_ring_free(picoquic_binlog_ring_t* ring)
+{
+    if (ring->record_buffer != NULL) {
+        free(ring->record_buffer);
+    }
+    if (ring->buffer != NULL) {
+        free(ring->buffer);
+    }
+    free(ring);
+}
+
+/* Stop the writer thread after it has processed all queued records. */
+void picoquic_binlog_ring_delete(picoquic_quic_t* quic)
+{
+    picoquic_binlog_ring_t* ring = (picoquic_binlog_ring_t*)quic->v_binlog_ring;
+
+    if (ring != NULL) {
+        binlog_ring_store_release(&ring->should_stop, 1);
+        (void)picoquic_signal_event(&ring->data_event);
+        (void)picoquic_wait_thread(ring->thread);
+#ifdef _WINDOWS
+        CloseHandle(ring->thread);
+#endif
+        picoquic_delete_event(&ring->data_event);
+        picoquic_delete_event(&ring->space_event);
+        binlog_ring_free(ring);
+        quic->v_binlog_ring = NULL;
+    }
+}
+
+int picoquic_set_binlog_ring(picoquic_quic_t* quic, size_t ring_size)
+{
+    int ret = 0;
+    picoquic_binlog_ring_t* ring = NULL;
+
+    picoquic_binlog_ring_delete(quic);
+
+    if (ring_size > 0) {
+        size_t size = BINLOG_RING_SIZE_MIN;
+
+        while (size < ring_size && size < (SIZE_MAX >> 2)) {
+            size <<= 1;
+        }
+
+        if ((ring = (picoquic_binlog_ring_t*)malloc(sizeof(picoquic_binlog_ring_t))) == NULL) {
+            ret = PICOQUIC_ERROR_MEMORY;
+        }
+        else {
+            memset(ring, 0, sizeof(picoquic_binlog_ring_t));
+            ring->size = size;
+            ring->mask = size - 1;
+            if ((ring->buffer = (uint8_t*)malloc(size)) == NULL ||
+                (ring->record_buffer = (uint8_t*)malloc(BINLOG_RING_RECORD_MAX)) == NULL) {
+                ret = PICOQUIC_ERROR_MEMORY;
+            }
+            else if (picoquic_create_event(&ring->data_event) != 0) {
+                ret = PICOQUIC_ERROR_MEMORY;
+            }
+            else if (picoquic_create_event(&ring->space_event) != 0) {
+                picoquic_delete_event(&ring->data_event);
+                ret = PICOQUIC_ERROR_MEMORY;
+            }
+            else if (picoquic_create_thread(&ring->thread, binlog_ring_writer, ring) != 0) {
+                picoquic_delete_event(&ring->data_event);
+                picoquic_delete_event(&ring->space_event);
+                ret = PICOQUIC_ERROR_MEMORY;
+            }
+
+            if (ret == 0) {
+                quic->v_binlog_ring = ring;
+                /* Make sure that the ring is drained and closed with the context */
+                picoquic_enable_binlog(quic);
+            }
+            else {
+                binlog_ring_free(ring);
+            }
+        }
+    }
+
+    return ret;
+}
+
+void picoquic_get_binlog_ring_stats(picoquic_quic_t* quic, uint64_t* nb_records, uint64_t* nb_dropped)
+{
+    picoquic_binlog_ring_t* ring = (picoquic_binlog_ring_t*)quic->v_binlog_ring;
+
+    *nb_records = (ring == NULL) ? 0 : ring->nb_records;
+    *nb_dropped = (ring == NULL) ? 0 : ring->nb_dropped;
+}
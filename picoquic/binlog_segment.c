@@ -0,0 +1,424 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Segmented binary log.
+ *
+ * In segment mode, the events of all the connections of a QUIC context are
+ * written to a single binary log file, instead of one file per connection.
+ * When the file grows past the maximum segment size, it is closed and a new
+ * segment is started, so the number of open files is always one.
+ *
+ * The segment uses the same header and the same event records as the
+ * per connection log, with version set to PICOQUIC_BINLOG_VERSION_SEGMENT,
+ * or PICOQUIC_BINLOG_VERSION_COMPACT_SEGMENT if the records are compact.
+ * Compact records are numbered per connection in the order in which the
+ * connections appear in the segment.
+ * When the segment is closed, the writer appends an index and a fixed size
+ * trailer:
+ *
+ *     index:   vint nb_cid, then for each connection:
+ *              cid, vint nb_records, vint offsets of the records, each
+ *              coded as the difference with the previous offset.
+ *     trailer: int64 index offset, int32 index length, int32 'cidx'.
+ *
+ * The readers use the index to go directly to the records of a connection.
+ * A segment that was not closed, e.g., after a crash, has no trailer, and
+ * the readers fall back to reading all records in sequence.
+ *
+ * Connections that are still open when a segment is closed have their
+ * "new connection" record copied at the beginning of the next segment,
+ * so that each segment can be converted on its own.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "picoquic_internal.h"
+#include "picoquic_utils.h"
+#include "picoquic_binlog.h"
+#include "bytestream.h"
+#include "tls_api.h"
+
+#define BINLOG_SEGMENT_SIZE_MIN 0x10000
+#define BINLOG_SEGMENT_OFFSETS_MIN 64
+
+typedef struct st_binlog_segment_entry_t {
+    struct st_binlog_segment_entry_t* next;
+    struct st_binlog_segment_entry_t* previous;
+    picoquic_cnx_t* cnx;
+    picoquic_connection_id_t cid;
+    uint8_t* start_record;
+    size_t start_record_length;
+    uint64_t* offsets;
+    size_t nb_offsets;
+    size_t nb_offsets_max;
+    int is_closed;
+    picoquic_binlog_compact_t compact;
+} binlog_segment_entry_t;
+
+typedef struct st_picoquic_binlog_segment_t {
+    FILE* f;
+    uint64_t max_segment_size;
+    uint64_t segment_length;
+    uint64_t replay_length;
+    uint64_t nb_connections;
+    uint32_t segment_number;
+    uint16_t log_unique;
+    uint16_t flags;
+    int is_compact;
+    binlog_segment_entry_t* first;
+    binlog_segment_entry_t* last;
+    uint8_t compact_buffer[PICOQUIC_BINLOG_RECORD_MAX + 16];
+} picoquic_binlog_segment_t;
+
+static void binlog_segment_entry_free(picoquic_binlog_segment_t* seg, binlog_segment_entry_t* entry)
+{
+    if (entry->previous == NULL) {
+        seg->first = entry->next;
+    }
+    else {
+        entry->previous->next = entry->next;
+    }
+    if (entry->next == NULL) {
+        seg->last = entry->previous;
+    }
+    else {
+        entry->next->previous = entry->previous;
+    }
+    if (!entry->is_closed && entry->cnx != NULL) {
+        entry->cnx->binlog_segment_entry = NULL;
+    }
+    if (entry->start_record != NULL) {
+        free(entry->start_record);
+    }
+    if (entry->offsets != NULL) {
+        free(entry->offsets);
+    }
+    free(entry);
+}
+
+static int binlog_segment_put(picoquic_binlog_segment_t* seg, binlog_segment_entry_t* entry,
+    const uint8_t* data, size_t length)
+{
+    int ret = 0;
+
+    if (entry->nb_offsets >= entry->nb_offsets_max) {
+        size_t new_max = (entry->nb_offsets_max == 0) ? BINLOG_SEGMENT_OFFSETS_MIN : 2 * entry->nb_offsets_max;
+        uint64_t* new_offsets = (uint64_t*)realloc(entry->offsets, new_max * sizeof(uint64_t));
+
+        if (new_offsets == NULL) {
+            ret = PICOQUIC_ERROR_MEMORY;
+        }
+        else {
+            entry->offsets = new_offsets;
+            entry->nb_offsets_max = new_max;
+        }
+    }
+
+    if (ret == 0 && seg->is_compact) {
+        ret = binlog_compact_encode(&entry->compact, data, length, seg->compact_buffer, sizeof(seg->compact_buffer), &length);
+        data = seg->compact_buffer;
+    }
+
+    if (ret == 0) {
+        if (fwrite(data, length, 1, seg->f) != 1) {
+            ret = -1;
+        }
+        else {
+            entry->offsets[entry->nb_offsets] = seg->segment_length;
+            entry->nb_offsets++;
+            seg->segment_length += length;
+        }
+    }
+
+    return ret;
+}
+
+/* Start the next segment. The numbers of segments that already exist,
+ * e.g., written by a previous run, are skipped so they are not overwritten. */
+static int binlog_segment_start(picoquic_quic_t* quic, picoquic_binlog_segment_t* seg)
+{
+    int ret = 0;
+    char const* bin_dir = (quic->binlog_dir == NULL) ? quic->qlog_dir : quic->binlog_dir;
+    char segment_name[512];
+
+    if (bin_dir == NULL) {
+        ret = -1;
+    }
+
+    while (ret == 0) {
+        FILE* F;
+
+        if (quic->use_unique_log_names) {
+            ret = picoquic_sprintf(segment_name, sizeof(segment_name), NULL, "%s%sbinlog.%x.%u.log",
+                bin_dir, PICOQUIC_FILE_SEPARATOR, seg->log_unique, seg->segment_number);
+        }
+        else {
+            ret = picoquic_sprintf(segment_name, sizeof(segment_name), NULL, "%s%sbinlog.%u.log",
+                bin_dir, PICOQUIC_FILE_SEPARATOR, seg->segment_number);
+        }
+        if (ret == 0 && (F = picoquic_file_open(segment_name, "rb")) != NULL) {
+            (void)picoquic_file_close(F);
+            seg->segment_number++;
+            continue;
+        }
+        break;
+    }
+
+    if (ret == 0) {
+        if ((seg->f = picoquic_file_open(segment_name, "wb")) == NULL) {
+            DBG_PRINTF("Cannot open file %s for write.\n", segment_name);
+            ret = -1;
+        }
+        else {
+            bytestream_buf stream;
+            bytestream* ps = bytestream_buf_init(&stream, 16);
+
+            bytewrite_int32(ps, FOURCC('q', 'l', 'o', 'g'));
+            bytewrite_int16(ps, seg->flags);
+            seg->is_compact = quic->use_compact_binlog;
+            bytewrite_int16(ps, (seg->is_compact) ? PICOQUIC_BINLOG_VERSION_COMPACT_SEGMENT : PICOQUIC_BINLOG_VERSION_SEGMENT);
+            bytewrite_int64(ps, picoquic_get_quic_time(quic));
+
+            if (fwrite(bytestream_data(ps), bytestream_length(ps), 1, seg->f) != 1) {
+                DBG_PRINTF("Cannot write header for file %s.\n", segment_name);
+                seg->f = picoquic_file_close(seg->f);
+                ret = -1;
+            }
+            else {
+                binlog_segment_entry_t* entry = seg->first;
+
+                seg->segment_number++;
+                seg->segment_length = bytestream_length(ps);
+                seg->nb_connections = 0;
+
+                /* Copy the start of the connections that continue from the previous segment */
+                while (ret == 0 && entry != NULL) {
+                    binlog_compact_init(&entry->compact, seg->nb_connections++);
+                    ret = binlog_segment_put(seg, entry, entry->start_record, entry->start_record_length);
+                    entry = entry->next;
+                }
+                seg->replay_length = seg->segment_length;
+            }
+        }
+    }
+
+    return ret;
+}
+
+/* Write the index and the trailer, close the file, and forget the
+ * connections that were closed during the segment. */
+static int binlog_segment_finish(picoquic_binlog_segment_t* seg)
+{
+    int ret = 0;
+    size_t index_size = 8;
+    size_t nb_cid = 0;
+    binlog_segment_entry_t* entry = seg->first;
+    uint8_t* index_buffer = NULL;
+
+    while (entry != NULL) {
+        if (entry->nb_offsets > 0) {
+            index_size += 1 + PICOQUIC_CONNECTION_ID_MAX_SIZE + 8 + 8 * entry->nb_offsets;
+            nb_cid++;
+        }
+        entry = entry->next;
+    }
+
+    if ((index_buffer = (uint8_t*)malloc(index_size + PICOQUIC_BINLOG_TRAILER_SIZE)) == NULL) {
+        ret = PICOQUIC_ERROR_MEMORY;
+    }
+    else {
+        bytestream stream;
+        bytestream* ps = bytestream_ref_init(&stream, index_buffer, index_size + PICOQUIC_BINLOG_TRAILER_SIZE);
+        size_t index_length;
+
+        bytewrite_vint(ps, nb_cid);
+        entry = seg->first;
+        while (entry != NULL) {
+            if (entry->nb_offsets > 0) {
+                uint64_t previous = 0;
+
+                bytewrite_cid(ps, &entry->cid);
+                bytewrite_vint(ps, entry->nb_offsets);
+                for (size_t i = 0; i < entry->nb_offsets; i++) {
+                    bytewrite_vint(ps, entry->offsets[i] - previous);
+                    previous = entry->offsets[i];
+                }
+            }
+            entry = entry->next;
+        }
+        index_length = bytestream_length(ps);
+        bytewrite_int64(ps, seg->segment_length);
+        bytewrite_int32(ps, (uint32_t)index_length);
+        bytewrite_int32(ps, FOURCC('c', 'i', 'd', 'x'));
+
+        if (fwrite(bytestream_data(ps), bytestream_length(ps), 1, seg->f) != 1) {
+            DBG_PRINTF("%s", "Cannot write the index of the binary log segment.\n");
+            ret = -1;
+        }
+        free(index_buffer);
+    }
+
+    seg->f = picoquic_file_close(seg->f);
+    seg->segment_length = 0;
+    seg->replay_length = 0;
+
+    entry = seg->first;
+    while (entry != NULL) {
+        binlog_segment_entry_t* next = entry->next;
+
+        if (entry->is_closed) {
+            binlog_segment_entry_free(seg, entry);
+        }
+        else {
+            entry->nb_offsets = 0;
+        }
+        entry = next;
+    }
+
+    return ret;
+}
+
+/* Make sure that there is an open segment with room for the next record.
+ * A segment holding no record beyond the copied connection starts is never
+ * rotated, so very large records cannot cause a loop. */
+static int binlog_segment_prepare(picoquic_quic_t* quic, picoquic_binlog_segment_t* seg, size_t length)
+{
+    int ret = 0;
+
+    if (seg->f != NULL && seg->segment_length + length > seg->max_segment_size &&
+        seg->segment_length > seg->replay_length) {
+        ret = binlog_segment_finish(seg);
+    }
+
+    if (ret == 0 && seg->f == NULL) {
+        ret = binlog_segment_start(quic, seg);
+    }
+
+    return ret;
+}
+
+void* binlog_segment_open(picoquic_cnx_t* cnx, const uint8_t* start_record, size_t length)
+{
+    picoquic_binlog_segment_t* seg = (picoquic_binlog_segment_t*)cnx->quic->v_binlog_segment;
+    binlog_segment_entry_t* entry = NULL;
+
+    if (seg != NULL && binlog_segment_prepare(cnx->quic, seg, length) == 0 &&
+        (entry = (binlog_segment_entry_t*)malloc(sizeof(binlog_segment_entry_t))) != NULL) {
+        memset(entry, 0, sizeof(binlog_segment_entry_t));
+        binlog_compact_init(&entry->compact, seg->nb_connections++);
+        entry->cnx = cnx;
+        entry->cid = cnx->initial_cnxid;
+        if ((entry->start_record = (uint8_t*)malloc(length)) == NULL) {
+            free(entry);
+            entry = NULL;
+        }
+        else {
+            memcpy(entry->start_record, start_record, length);
+            entry->start_record_length = length;
+            entry->previous = seg->last;
+            if (seg->last == NULL) {
+                seg->first = entry;
+            }
+            else {
+                seg->last->next = entry;
+            }
+            seg->last = entry;
+
+            if (binlog_segment_put(seg, entry, start_record, length) != 0) {
+                entry->is_closed = 1;
+                entry->cnx = NULL;
+                entry = NULL;
+            }
+        }
+    }
+
+    return entry;
+}
+
+int binlog_segment_write(picoquic_quic_t* quic, void* v_entry, const uint8_t* data, size_t length)
+{
+    int ret = 0;
+    picoquic_binlog_segment_t* seg = (picoquic_binlog_segment_t*)quic->v_binlog_segment;
+
+    if (seg == NULL) {
+        ret = -1;
+    }
+    else if ((ret = binlog_segment_prepare(quic, seg, length)) == 0) {
+        ret = binlog_segment_put(seg, (binlog_segment_entry_t*)v_entry, data, length);
+    }
+
+    return ret;
+}
+
+void binlog_segment_close(picoquic_quic_t* quic, void* v_entry)
+{
+    binlog_segment_entry_t* entry = (binlog_segment_entry_t*)v_entry;
+
+    if (quic->v_binlog_segment != NULL && entry != NULL) {
+        /* The entry is kept until the end of the segment, for the index */
+        entry->is_closed = 1;
+        entry->cnx = NULL;
+    }
+}
+
+void picoquic_binlog_segment_delete(picoquic_quic_t* quic)
+{
+    picoquic_binlog_segment_t* seg = (picoquic_binlog_segment_t*)quic->v_binlog_segment;
+
+    if (seg != NULL) {
+        if (seg->f != NULL) {
+            (void)binlog_segment_finish(seg);
+        }
+        while (seg->first != NULL) {
+            binlog_segment_entry_free(seg, seg->first);
+        }
+        free(seg);
+        quic->v_binlog_segment = NULL;
+    }
+}
+
+int picoquic_set_binlog_segments(picoquic_quic_t* quic, uint64_t max_segment_size)
+{
+    int ret = 0;
+
+    picoquic_binlog_segment_delete(quic);
+
+    if (max_segment_size > 0) {
+        picoquic_binlog_segment_t* seg = (picoquic_binlog_segment_t*)malloc(sizeof(picoquic_binlog_segment_t));
+
+        if (seg == NULL) {
+            ret = PICOQUIC_ERROR_MEMORY;
+        }
+        else {
+            memset(seg, 0, sizeof(picoquic_binlog_segment_t));
+            seg->max_segment_size = (max_segment_size < BINLOG_SEGMENT_SIZE_MIN) ? BINLOG_SEGMENT_SIZE_MIN : max_segment_size;
+            seg->flags = (quic->default_tp.enable_multipath || quic->default_tp.enable_simple_multipath ||
+                quic->default_tp.is_unique_path_id_enabled) ? 0x01 : 0;
+            picoquic_crypto_random(quic, &seg->log_unique, sizeof(seg->log_unique));
+            quic->v_binlog_segment = seg;
+            /* Make sure that the last segment is indexed when the context is freed */
+            picoquic_enable_binlog(quic);
+        }
+    }
+
+    return ret;
+}
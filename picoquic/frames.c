@@ -1379,6 +1379,7 @@ uint8_t * picoquic_format_data_blocked_frame(picoquic_cnx_t * cnx, uint8_t* byte
         (bytes = picoquic_frames_varint_encode(bytes, bytes_max, cnx->maxdata_remote)) != NULL) {
         *is_pure_ack = 0;
         cnx->sent_blocked_frame = 1;
+        PICOQUIC_PROBE2(data_blocked, cnx, cnx->maxdata_remote);
     }
     else {
         *more_data = 1;
@@ -1399,6 +1400,7 @@ uint8_t * picoquic_format_stream_data_blocked_frame(uint8_t* bytes,
     {
         *is_pure_ack = 0;
         stream->stream_data_blocked_sent = 1;
+        PICOQUIC_PROBE2(stream_data_blocked, stream->stream_id, stream->maxdata_remote);
     }
     else {
         *more_data = 1;
@@ -1430,6 +1432,7 @@ uint8_t * picoquic_format_stream_blocked_frame(picoquic_cnx_t* cnx, uint8_t* byt
         if ((bytes = picoquic_frames_uint8_encode(bytes, bytes_max, f_type)) != NULL &&
             (bytes = picoquic_frames_varint_encode(bytes, bytes_max, stream_limit)) != NULL) {
             *is_pure_ack = 0;
+            PICOQUIC_PROBE3(streams_blocked, cnx, f_type, stream_limit);
             if (IS_BIDIR_STREAM_ID(stream->stream_id)) {
                 cnx->stream_blocked_bidir_sent = 1;
             }
@@ -2502,12 +2505,17 @@ picoquic_packet_t* picoquic_check_spurious_retransmission(picoquic_cnx_t* cnx,
                 if (cnx->congestion_alg != NULL) {
                     picoquic_per_ack_state_t ack_state = { 0 };
                     ack_state.lost_packet_number = p->sequence_number;
+                    PICOQUIC_PHASE_START(cc_start);
                     cnx->congestion_alg->alg_notify(cnx, old_path, picoquic_congestion_notification_spurious_repeat,
                        &ack_state, current_time);
+                    PICOQUIC_PHASE_END(cnx->quic, picoquic_phase_cc_update, cc_start);
+                    PICOQUIC_PROBE5(cc_notify, cnx, old_path, picoquic_congestion_notification_spurious_repeat,
+                        old_path->cwin, old_path->bytes_in_transit);
                 }
             }
 
             cnx->nb_spurious++;
+            PICOQUIC_METRICS_ADD(cnx->quic, picoquic_metrics_spurious, 1);
             should_delete = p;
         }
 
@@ -2897,9 +2905,13 @@ void process_decoded_packet_data(picoquic_cnx_t* cnx, picoquic_path_t * path_x,
             ack_state.inflight_prior = packet_data->path_ack[i].inflight_prior;
             ack_state.is_app_limited = packet_data->path_ack[i].rs_is_path_limited;
             ack_state.is_cwnd_limited = packet_data->path_ack[i].rs_is_cwnd_limited;
+            PICOQUIC_PHASE_START(cc_start);
             cnx->congestion_alg->alg_notify(cnx, packet_data->path_ack[i].acked_path,
                 picoquic_congestion_notification_acknowledgement,
                 &ack_state, current_time);
+            PICOQUIC_PHASE_END(cnx->quic, picoquic_phase_cc_update, cc_start);
+            PICOQUIC_PROBE5(cc_notify, cnx, packet_data->path_ack[i].acked_path, picoquic_congestion_notification_acknowledgement,
+                packet_data->path_ack[i].acked_path->cwin, packet_data->path_ack[i].acked_path->bytes_in_transit);
         }
     }
 
@@ -3594,6 +3606,7 @@ const uint8_t* picoquic_decode_ack_frame(picoquic_cnx_t* cnx, const uint8_t* byt
     picoquic_packet_context_t* pkt_ctx = &cnx->pkt_ctx[pc];
     uint64_t largest_in_path = 0;
     picoquic_path_t * ack_path = cnx->path[0];
+    PICOQUIC_PHASE_START(ack_start);
 
     if (picoquic_parse_ack_header(bytes, bytes_max-bytes, &num_block,
         (has_path_id)?&path_id:NULL,
@@ -3732,11 +3745,15 @@ const uint8_t* picoquic_decode_ack_frame(picoquic_cnx_t* cnx, const uint8_t* byt
             picoquic_per_ack_state_t ack_state = { 0 };
             ack_state.lost_packet_number = largest_in_path;
             pkt_ctx->ecn_ce_total_remote = ecnx3[2];
+            PICOQUIC_PHASE_START(cc_start);
             cnx->congestion_alg->alg_notify(cnx, ack_path,
                 picoquic_congestion_notification_ecn_ec,
                 &ack_state, current_time);
+            PICOQUIC_PHASE_END(cnx->quic, picoquic_phase_cc_update, cc_start);
+            PICOQUIC_PROBE5(cc_notify, cnx, ack_path, picoquic_congestion_notification_ecn_ec, ack_path->cwin, ack_path->bytes_in_transit);
         }
     }
+    PICOQUIC_PHASE_END(cnx->quic, picoquic_phase_ack_processing, ack_start);
 
     return bytes;
 }
@@ -5725,17 +5742,17 @@ uint8_t* picoquic_format_bdp_frame(picoquic_cnx_t* cnx, uint8_t* bytes, uint8_t*
     uint64_t recon_min_rtt = 0;
     uint8_t* ip_addr = NULL;
     uint8_t ip_addr_length = 0;
+    picoquic_issued_ticket_t server_ticket;
 
     /* Server sends bdp reflecting current path caracteristics */
     if (!cnx->client_mode) {
         if (path_x->is_ticket_seeded && !path_x->is_bdp_sent) {
-            picoquic_issued_ticket_t* server_ticket;
-            server_ticket = picoquic_retrieve_issued_ticket(cnx->quic, cnx->issued_ticket_id);
-            if (server_ticket != NULL && server_ticket->cwin > 0) {
-                recon_bytes_in_flight =  server_ticket->cwin;
-                recon_min_rtt = server_ticket->rtt;
-                ip_addr = server_ticket->ip_addr;
-                ip_addr_length = server_ticket->ip_addr_length;
+            if (picoquic_retrieve_issued_ticket(cnx->quic, cnx->issued_ticket_id, &server_ticket) == 0 &&
+                server_ticket.cwin > 0) {
+                recon_bytes_in_flight =  server_ticket.cwin;
+                recon_min_rtt = server_ticket.rtt;
+                ip_addr = server_ticket.ip_addr;
+                ip_addr_length = server_ticket.ip_addr_length;
             }
         }
     }
@@ -5789,6 +5806,7 @@ int picoquic_decode_frames(picoquic_cnx_t* cnx, picoquic_path_t * path_x, const
     int is_path_probing_packet = 1; /* Will be set to zero if non probing frame received */
     picoquic_packet_context_enum pc = picoquic_context_from_epoch(epoch);
     picoquic_packet_data_t packet_data;
+    PICOQUIC_PHASE_START(decode_start);
 
     memset(&packet_data, 0, sizeof(packet_data));
 
@@ -6048,6 +6066,7 @@ int picoquic_decode_frames(picoquic_cnx_t* cnx, picoquic_path_t * path_x, const
             path_x->last_non_path_probing_pn = pn64;
         }
     }
+    PICOQUIC_PHASE_END(cnx->quic, picoquic_phase_frame_decode, decode_start);
 
     return bytes != NULL ? 0 : PICOQUIC_ERROR_DETECTED;
 }
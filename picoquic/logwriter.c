@@ -24,6 +24,7 @@
 */
 
 #include <stdarg.h>
+#include <stdlib.h>
 #include "picoquic_binlog.h"
 #include "bytestream.h"
 #include "tls_api.h"
@@ -58,18 +59,20 @@ static const uint8_t* picoquic_log_length(const uint8_t* bytes, const uint8_t* b
     return (len == 0 || *nsz != n64) ? NULL : bytes + len;
 }
 
-static void picoquic_binlog_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static void picoquic_binlog_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     if (bytes != NULL && bytes_max != NULL) {
         size_t len = bytes_max - bytes;
         uint8_t varlen[8];
         size_t l_varlen = picoquic_varint_encode(varlen, 8, len);
-        fwrite(varlen, 1, l_varlen, f);
-        fwrite(bytes, 1, len, f);
+        if (l_varlen > 0 && bytestream_remain(s) >= l_varlen + len) {
+            (void)bytewrite_buffer(s, varlen, l_varlen);
+            (void)bytewrite_buffer(s, bytes, len);
+        }
     }
 }
 
-static const uint8_t* picoquic_log_stream_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_stream_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
     uint8_t ftype = bytes[0];
@@ -101,7 +104,7 @@ static const uint8_t* picoquic_log_stream_frame(FILE* f, const uint8_t* bytes, c
             extra_bytes = length;
         }
         if (has_length) {
-            picoquic_binlog_frame(f, bytes_begin, bytes + extra_bytes);
+            picoquic_binlog_frame(s, bytes_begin, bytes + extra_bytes);
         }
         else {
             uint8_t* log_next = log_buffer;
@@ -112,10 +115,10 @@ static const uint8_t* picoquic_log_stream_frame(FILE* f, const uint8_t* bytes, c
             if ((log_next = picoquic_frames_varint_encode(log_next, log_buffer + 256, length)) != NULL) {
                 memcpy(log_next, bytes, extra_bytes);
                 log_next += extra_bytes;
-                picoquic_binlog_frame(f, log_buffer, log_next);
+                picoquic_binlog_frame(s, log_buffer, log_next);
             }
             else {
-                picoquic_binlog_frame(f, log_buffer, log_buffer + l_head);
+                picoquic_binlog_frame(s, log_buffer, log_buffer + l_head);
             }
         }
 
@@ -127,12 +130,12 @@ static const uint8_t* picoquic_log_stream_frame(FILE* f, const uint8_t* bytes, c
         if (length > 26) {
             length = 26;
         }
-        picoquic_binlog_frame(f, bytes_begin, bytes_begin + length);
+        picoquic_binlog_frame(s, bytes_begin, bytes_begin + length);
     }
     return bytes;
 }
 
-static const uint8_t* picoquic_log_ack_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_ack_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
     uint64_t ftype = 0;
@@ -163,11 +166,11 @@ static const uint8_t* picoquic_log_ack_frame(FILE* f, const uint8_t* bytes, cons
         bytes = picoquic_log_varint_skip(bytes, bytes_max);
     }
 
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
     return bytes;
 }
 
-static const uint8_t* picoquic_log_reset_stream_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_reset_stream_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t * bytes_begin = bytes;
 
@@ -176,11 +179,11 @@ static const uint8_t* picoquic_log_reset_stream_frame(FILE* f, const uint8_t* by
     bytes = picoquic_log_varint_skip(bytes, bytes_max);
     bytes = picoquic_log_varint_skip(bytes, bytes_max);
 
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
     return bytes;
 }
 
-static const uint8_t* picoquic_log_stop_sending_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_stop_sending_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
 
@@ -188,11 +191,11 @@ static const uint8_t* picoquic_log_stop_sending_frame(FILE* f, const uint8_t* by
     bytes = picoquic_log_varint_skip(bytes, bytes_max);
     bytes = picoquic_log_varint_skip(bytes, bytes_max);
 
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
     return bytes;
 }
 
-static const uint8_t* picoquic_log_close_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_close_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
     size_t length = 0;
@@ -203,11 +206,11 @@ static const uint8_t* picoquic_log_close_frame(FILE* f, const uint8_t* bytes, co
     bytes = picoquic_log_length(bytes, bytes_max, &length);
     bytes = picoquic_log_fixed_skip(bytes, bytes_max, length);
 
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
     return bytes;
 }
 
-static const uint8_t* picoquic_log_app_close_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_app_close_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
     size_t length = 0;
@@ -217,22 +220,22 @@ static const uint8_t* picoquic_log_app_close_frame(FILE* f, const uint8_t* bytes
     bytes = picoquic_log_length(bytes, bytes_max, &length);
     bytes = picoquic_log_fixed_skip(bytes, bytes_max, length);
 
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
     return bytes;
 }
 
-static const uint8_t* picoquic_log_max_data_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_max_data_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
 
     bytes = picoquic_log_fixed_skip(bytes, bytes_max, 1);
     bytes = picoquic_log_varint_skip(bytes, bytes_max);
 
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
     return bytes;
 }
 
-static const uint8_t* picoquic_log_max_stream_data_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_max_stream_data_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
 
@@ -240,33 +243,33 @@ static const uint8_t* picoquic_log_max_stream_data_frame(FILE* f, const uint8_t*
     bytes = picoquic_log_varint_skip(bytes, bytes_max);
     bytes = picoquic_log_varint_skip(bytes, bytes_max);
 
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
     return bytes;
 }
 
-static const uint8_t* picoquic_log_max_stream_id_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_max_stream_id_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
 
     bytes = picoquic_log_fixed_skip(bytes, bytes_max, 1);
     bytes = picoquic_log_varint_skip(bytes, bytes_max);
 
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
     return bytes;
 }
 
-static const uint8_t* picoquic_log_blocked_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_blocked_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
 
     bytes = picoquic_log_fixed_skip(bytes, bytes_max, 1);
     bytes = picoquic_log_varint_skip(bytes, bytes_max);
 
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
     return bytes;
 }
 
-static const uint8_t* picoquic_log_stream_blocked_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_stream_blocked_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
 
@@ -274,22 +277,22 @@ static const uint8_t* picoquic_log_stream_blocked_frame(FILE* f, const uint8_t*
     bytes = picoquic_log_varint_skip(bytes, bytes_max);
     bytes = picoquic_log_varint_skip(bytes, bytes_max);
 
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
     return bytes;
 }
 
-static const uint8_t* picoquic_log_streams_blocked_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_streams_blocked_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
 
     bytes = picoquic_log_fixed_skip(bytes, bytes_max, 1);
     bytes = picoquic_log_varint_skip(bytes, bytes_max);
 
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
     return bytes;
 }
 
-static const uint8_t* picoquic_log_new_connection_id_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_new_connection_id_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
 
@@ -302,11 +305,11 @@ static const uint8_t* picoquic_log_new_connection_id_frame(FILE* f, const uint8_
 
     bytes = picoquic_log_fixed_skip(bytes, bytes_max, PICOQUIC_RESET_SECRET_SIZE);
 
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
     return bytes;
 }
 
-static const uint8_t* picoquic_log_mp_new_connection_id_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_mp_new_connection_id_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
 
@@ -320,22 +323,22 @@ static const uint8_t* picoquic_log_mp_new_connection_id_frame(FILE* f, const uin
 
     bytes = picoquic_log_fixed_skip(bytes, bytes_max, PICOQUIC_RESET_SECRET_SIZE);
 
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
     return bytes;
 }
 
-static const uint8_t* picoquic_log_retire_connection_id_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_retire_connection_id_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
 
     bytes = picoquic_log_fixed_skip(bytes, bytes_max, 1);
     bytes = picoquic_log_varint_skip(bytes, bytes_max);
 
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
     return bytes;
 }
 
-static const uint8_t* picoquic_log_mp_retire_connection_id_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_mp_retire_connection_id_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
 
@@ -343,11 +346,11 @@ static const uint8_t* picoquic_log_mp_retire_connection_id_frame(FILE* f, const
     bytes = picoquic_log_varint_skip(bytes, bytes_max);
     bytes = picoquic_log_varint_skip(bytes, bytes_max);
 
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
     return bytes;
 }
 
-static const uint8_t* picoquic_log_new_token_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_new_token_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
     size_t length = 0;
@@ -357,21 +360,21 @@ static const uint8_t* picoquic_log_new_token_frame(FILE* f, const uint8_t* bytes
 
     bytes = picoquic_log_fixed_skip(bytes, bytes_max, length);
 
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
     return bytes;
 }
 
-static const uint8_t* picoquic_log_path_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_path_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
 
     bytes = picoquic_log_fixed_skip(bytes, bytes_max, 1 + 8);
 
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
     return bytes;
 }
 
-static const uint8_t* picoquic_log_crypto_hs_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_crypto_hs_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
     size_t length = 0;
@@ -380,24 +383,24 @@ static const uint8_t* picoquic_log_crypto_hs_frame(FILE* f, const uint8_t* bytes
     bytes = picoquic_log_varint_skip(bytes, bytes_max);
     bytes = picoquic_log_length(bytes, bytes_max, &length);
 
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
 
     bytes = picoquic_log_fixed_skip(bytes, bytes_max, length);
     return bytes;
 }
 
 
-static const uint8_t* picoquic_log_handshake_done_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_handshake_done_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
 
     bytes = picoquic_log_fixed_skip(bytes, bytes_max, 1);
 
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
     return bytes;
 }
 
-static const uint8_t* picoquic_log_datagram_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_datagram_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
     uint8_t ftype = bytes[0];
@@ -411,46 +414,46 @@ static const uint8_t* picoquic_log_datagram_frame(FILE* f, const uint8_t* bytes,
         length = bytes_max - bytes;
     }
 
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
 
     bytes = picoquic_log_fixed_skip(bytes, bytes_max, length);
     return bytes;
 }
 
-static const uint8_t* picoquic_log_time_stamp_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_time_stamp_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
 
     bytes = picoquic_log_varint_skip(bytes, bytes_max); /* frame type as varint */
     bytes = picoquic_log_varint_skip(bytes, bytes_max); /* time stamp as varint */
 
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
 
     return bytes;
 }
 
-static const uint8_t* picoquic_log_path_abandon_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_path_abandon_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
     bytes = picoquic_log_varint_skip(bytes, bytes_max); /* frame type as varint */
     bytes = picoquic_skip_path_abandon_frame(bytes, bytes_max); /* skip abandon frame */
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
 
     return bytes;
 }
 
-static const uint8_t* picoquic_log_path_available_or_standby_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_path_available_or_standby_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
     bytes = picoquic_log_varint_skip(bytes, bytes_max); /* frame type as varint */
     bytes = picoquic_skip_path_available_or_standby_frame(bytes, bytes_max); /* skip available or standby frame */
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
 
     return bytes;
 }
 
 
-static const uint8_t* picoquic_log_ack_frequency_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_ack_frequency_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
 
@@ -460,34 +463,34 @@ static const uint8_t* picoquic_log_ack_frequency_frame(FILE* f, const uint8_t* b
     bytes = picoquic_log_varint_skip(bytes, bytes_max); /* Max ACK delay */
     bytes = picoquic_log_varint_skip(bytes, bytes_max); /* Reordering threshold */
 
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
 
     return bytes;
 }
 
-static const uint8_t* picoquic_log_immediate_ack_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_immediate_ack_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
 
     bytes = picoquic_log_varint_skip(bytes, bytes_max); /* frame type as varint */
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
 
     return bytes;
 }
 
-static const uint8_t* picoquic_log_erroring_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_erroring_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     size_t frame_size = bytes_max - bytes;
     size_t copied = (frame_size > 8) ? 8 : frame_size;
 
-    picoquic_binlog_frame(f, bytes, bytes + copied);
+    picoquic_binlog_frame(s, bytes, bytes + copied);
 
     return NULL;
 }
 
-static const uint8_t* picoquic_log_padding(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_padding(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
-    picoquic_binlog_frame(f, bytes, bytes + 1);
+    picoquic_binlog_frame(s, bytes, bytes + 1);
 
     uint8_t ftype = bytes[0];
     while (bytes < bytes_max && bytes[0] == ftype) {
@@ -497,7 +500,7 @@ static const uint8_t* picoquic_log_padding(FILE* f, const uint8_t* bytes, const
     return bytes;
 }
 
-static const uint8_t* picoquic_log_bdp_frame(FILE* f, const uint8_t* bytes, const uint8_t* bytes_max)
+static const uint8_t* picoquic_log_bdp_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
 {
     const uint8_t* bytes_begin = bytes;
     size_t ip_len = 0;
@@ -509,131 +512,164 @@ static const uint8_t* picoquic_log_bdp_frame(FILE* f, const uint8_t* bytes, cons
     bytes = picoquic_log_length(bytes, bytes_max, &ip_len); /*  IP Address length */
     bytes = picoquic_log_fixed_skip(bytes, bytes_max, ip_len); /* IP address value */
 
-    picoquic_binlog_frame(f, bytes_begin, bytes);
+    picoquic_binlog_frame(s, bytes_begin, bytes);
 
     return bytes;
 }
 
-void picoquic_binlog_frames(FILE * f, const uint8_t* bytes, size_t length)
+static const uint8_t* binlog_compose_frame(bytestream* s, uint64_t ftype, const uint8_t* bytes, const uint8_t* bytes_max)
 {
-    const uint8_t* bytes_max = bytes + length;
-
-    while (bytes != NULL && bytes < bytes_max) {
-        uint64_t ftype= 0;
-        size_t ftype_ll = picoquic_varint_decode(bytes, length, &ftype);
-
-        if (ftype_ll == 0) {
-            /* Error, incorrect frame type encoding */
-            bytes = NULL;
-            break;
-        }
-        else if (ftype < 64 && ftype_ll != 1) {
-            /* Error, incorrect frame type encoding */
-            bytes = NULL;
-            break;
-        }
-
-        if (PICOQUIC_IN_RANGE(ftype, picoquic_frame_type_stream_range_min, picoquic_frame_type_stream_range_max)) {
-            bytes = picoquic_log_stream_frame(f, bytes, bytes_max);
-            continue;
-        }
-
+    if (PICOQUIC_IN_RANGE(ftype, picoquic_frame_type_stream_range_min, picoquic_frame_type_stream_range_max)) {
+        bytes = picoquic_log_stream_frame(s, bytes, bytes_max);
+    }
+    else {
         switch (ftype) {
         case picoquic_frame_type_ack:
         case picoquic_frame_type_ack_ecn:
         case picoquic_frame_type_ack_mp:
         case picoquic_frame_type_ack_mp_ecn:
-            bytes = picoquic_log_ack_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_ack_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_retire_connection_id:
-            bytes = picoquic_log_retire_connection_id_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_retire_connection_id_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_mp_retire_connection_id:
-            bytes = picoquic_log_mp_retire_connection_id_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_mp_retire_connection_id_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_padding:
         case picoquic_frame_type_ping:
-            bytes = picoquic_log_padding(f, bytes, bytes_max);
+            bytes = picoquic_log_padding(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_reset_stream:
-            bytes = picoquic_log_reset_stream_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_reset_stream_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_connection_close:
-            bytes = picoquic_log_close_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_close_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_application_close:
-            bytes = picoquic_log_app_close_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_app_close_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_max_data:
-            bytes = picoquic_log_max_data_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_max_data_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_max_stream_data:
-            bytes = picoquic_log_max_stream_data_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_max_stream_data_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_max_streams_bidir:
         case picoquic_frame_type_max_streams_unidir:
-            bytes = picoquic_log_max_stream_id_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_max_stream_id_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_data_blocked:
-            bytes = picoquic_log_blocked_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_blocked_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_stream_data_blocked:
-            bytes = picoquic_log_stream_blocked_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_stream_blocked_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_streams_blocked_bidir:
         case picoquic_frame_type_streams_blocked_unidir:
-            bytes = picoquic_log_streams_blocked_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_streams_blocked_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_new_connection_id:
-            bytes = picoquic_log_new_connection_id_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_new_connection_id_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_mp_new_connection_id:
-            bytes = picoquic_log_mp_new_connection_id_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_mp_new_connection_id_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_stop_sending:
-            bytes = picoquic_log_stop_sending_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_stop_sending_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_path_challenge:
         case picoquic_frame_type_path_response:
-            bytes = picoquic_log_path_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_path_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_crypto_hs:
-            bytes = picoquic_log_crypto_hs_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_crypto_hs_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_new_token:
-            bytes = picoquic_log_new_token_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_new_token_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_handshake_done:
-            bytes = picoquic_log_handshake_done_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_handshake_done_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_datagram:
         case picoquic_frame_type_datagram_l:
-            bytes = picoquic_log_datagram_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_datagram_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_ack_frequency:
-            bytes = picoquic_log_ack_frequency_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_ack_frequency_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_immediate_ack:
-            bytes = picoquic_log_immediate_ack_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_immediate_ack_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_time_stamp:
-            bytes = picoquic_log_time_stamp_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_time_stamp_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_path_abandon:
-            bytes = picoquic_log_path_abandon_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_path_abandon_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_path_standby:
         case picoquic_frame_type_path_available:
-            bytes = picoquic_log_path_available_or_standby_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_path_available_or_standby_frame(s, bytes, bytes_max);
             break;
         case picoquic_frame_type_bdp:
-            bytes = picoquic_log_bdp_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_bdp_frame(s, bytes, bytes_max);
             break;
         default:
-            bytes = picoquic_log_erroring_frame(f, bytes, bytes_max);
+            bytes = picoquic_log_erroring_frame(s, bytes, bytes_max);
+            break;
+        }
+    }
+
+    return bytes;
+}
+
+/* Frames that do not fit in the record are replaced by their first bytes,
+ * as many as fit, as is done for frames that cannot be parsed. The reader
+ * sees them as incomplete frames. For connections, the truncated frames
+ * are counted in nb_binlog_frames_truncated. */
+static void picoquic_binlog_truncated_frame(bytestream* s, const uint8_t* bytes, const uint8_t* bytes_max)
+{
+    size_t remain = bytestream_remain(s);
+
+    if (bytes != NULL && bytes_max != NULL && remain > 1) {
+        size_t len = bytes_max - bytes;
+        size_t max_len = (remain > 64) ? remain - 2 : remain - 1;
+
+        picoquic_binlog_frame(s, bytes, bytes + ((len > max_len) ? max_len : len));
+    }
+}
+
+static size_t binlog_compose_frames(bytestream* s, const uint8_t* bytes, size_t length)
+{
+    const uint8_t* bytes_max = bytes + length;
+    size_t nb_truncated = 0;
+
+    while (bytes != NULL && bytes < bytes_max) {
+        uint64_t ftype= 0;
+        size_t ftype_ll = picoquic_varint_decode(bytes, length, &ftype);
+        const uint8_t* frame_begin = bytes;
+        size_t logged = bytestream_length(s);
+
+        if (ftype_ll == 0) {
+            /* Error, incorrect frame type encoding */
+            bytes = NULL;
+            break;
+        }
+        else if (ftype < 64 && ftype_ll != 1) {
+            /* Error, incorrect frame type encoding */
+            bytes = NULL;
             break;
         }
+
+        bytes = binlog_compose_frame(s, ftype, bytes, bytes_max);
+        if (bytes != NULL && bytestream_length(s) == logged) {
+            /* The frame was parsed but did not fit */
+            picoquic_binlog_truncated_frame(s, frame_begin, bytes);
+            nb_truncated++;
+        }
     }
+
+    return nb_truncated;
 }
 
 static void binlog_compose_event_header(bytestream* msg, const picoquic_connection_id_t* cid, uint64_t current_time,
@@ -665,12 +701,68 @@ static uint64_t binlog_get_path_id(picoquic_cnx_t* cnx, picoquic_path_t* path_x)
     return path_id;
 }
 
-void binlog_pdu(FILE* f, const picoquic_connection_id_t* cid, int receiving, uint64_t current_time,
-    const struct sockaddr* addr_peer, const struct sockaddr* addr_local, size_t packet_length)
+/* Each binary log event is composed in memory as a complete record,
+ * 32 bit length followed by the event, and then written in one operation,
+ * either directly to the log file or through the log ring.
+ * Packet records can be larger than the default byte stream buffer, because
+ * each logged frame is prefixed by its length, so they are composed in
+ * buffers of PICOQUIC_BINLOG_RECORD_MAX bytes.
+ */
+
+static void binlog_record_finish(bytestream* msg)
 {
-    bytestream_buf stream_msg;
-    bytestream* msg = bytestream_buf_init(&stream_msg, BYTESTREAM_MAX_BUFFER_SIZE);
+    picoformat_32(msg->data, (uint32_t)(msg->ptr - 4));
+}
+
+static void binlog_write_record_bytes(picoquic_cnx_t* cnx, const uint8_t* record, size_t length)
+{
+    uint8_t compact[PICOQUIC_BINLOG_RECORD_MAX + 16];
+
+    if (cnx->binlog_recorder != NULL) {
+        /* Kept in memory until the logging policy decides */
+        (void)binlog_recorder_add(cnx->binlog_recorder, record, length);
+    }
+    else if (cnx->binlog_segment_entry != NULL) {
+        /* The segment writer keeps its own compact encoding state */
+        (void)binlog_segment_write(cnx->quic, cnx->binlog_segment_entry, record, length);
+    }
+    else if (cnx->binlog_compact != NULL &&
+        binlog_compact_encode((picoquic_binlog_compact_t*)cnx->binlog_compact, record, length,
+            compact, sizeof(compact), &length) != 0) {
+        /* Skip the records that cannot be encoded */
+    }
+    else {
+        if (cnx->binlog_compact != NULL) {
+            record = compact;
+        }
+        if (cnx->binlog_ring_handle != NULL) {
+            (void)binlog_ring_write(cnx->quic, cnx->binlog_ring_handle, record, length);
+        }
+        else if (cnx->f_binlog != NULL) {
+            (void)fwrite(record, length, 1, cnx->f_binlog);
+        }
+    }
+}
 
+static void binlog_write_record(picoquic_cnx_t* cnx, bytestream* msg)
+{
+    binlog_write_record_bytes(cnx, bytestream_data(msg), bytestream_length(msg));
+}
+
+void picoquic_binlog_frames(FILE* f, const uint8_t* bytes, size_t length)
+{
+    bytestream stream;
+    uint8_t buffer[PICOQUIC_BINLOG_RECORD_MAX];
+    bytestream* s = bytestream_ref_init(&stream, buffer, sizeof(buffer));
+
+    (void)binlog_compose_frames(s, bytes, length);
+    (void)fwrite(bytestream_data(s), bytestream_length(s), 1, f);
+}
+
+static void binlog_compose_pdu(bytestream* msg, const picoquic_connection_id_t* cid, int receiving, uint64_t current_time,
+    const struct sockaddr* addr_peer, const struct sockaddr* addr_local, size_t packet_length)
+{
+    bytewrite_int32(msg, 0);
     /* Common chunk header */
     binlog_compose_event_header(msg, cid, current_time, 0, picoquic_log_event_pdu_sent + receiving);
 
@@ -679,31 +771,37 @@ void binlog_pdu(FILE* f, const picoquic_connection_id_t* cid, int receiving, uin
     bytewrite_vint(msg, packet_length);
     bytewrite_addr(msg, addr_local);
 
-    uint8_t head[4] = { 0 };
-    picoformat_32(head, (uint32_t)bytestream_length(msg));
+    binlog_record_finish(msg);
+}
+
+void binlog_pdu(FILE* f, const picoquic_connection_id_t* cid, int receiving, uint64_t current_time,
+    const struct sockaddr* addr_peer, const struct sockaddr* addr_local, size_t packet_length)
+{
+    bytestream_buf stream_msg;
+    bytestream* msg = bytestream_buf_init(&stream_msg, BYTESTREAM_MAX_BUFFER_SIZE);
 
-    (void)fwrite(head, sizeof(head), 1, f);
+    binlog_compose_pdu(msg, cid, receiving, current_time, addr_peer, addr_local, packet_length);
     (void)fwrite(bytestream_data(msg), bytestream_length(msg), 1, f);
 }
 
 static void binlog_pdu_ex(picoquic_cnx_t* cnx, int receiving, uint64_t current_time,
     const struct sockaddr* addr_peer, const struct sockaddr* addr_local, size_t packet_length)
 {
-    if (cnx != NULL && cnx->f_binlog != NULL && picoquic_cnx_is_still_logging(cnx)) {
-        binlog_pdu(cnx->f_binlog, &cnx->initial_cnxid, receiving, current_time, addr_peer, addr_local, packet_length);
+    if (cnx != NULL && PICOQUIC_CNX_HAS_BINLOG(cnx) && picoquic_cnx_is_still_logging(cnx)) {
+        bytestream_buf stream_msg;
+        bytestream* msg = bytestream_buf_init(&stream_msg, BYTESTREAM_MAX_BUFFER_SIZE);
+
+        binlog_compose_pdu(msg, &cnx->initial_cnxid, receiving, current_time, addr_peer, addr_local, packet_length);
+        binlog_write_record(cnx, msg);
     }
 }
 
-void binlog_packet(FILE* f, const picoquic_connection_id_t* cid, uint64_t path_id, int receiving, uint64_t current_time,
+static size_t binlog_compose_packet(bytestream* msg, const picoquic_connection_id_t* cid, uint64_t path_id, int receiving, uint64_t current_time,
     const picoquic_packet_header* ph, const uint8_t* bytes, size_t bytes_max)
 {
-    long fpos0 = ftell(f);
-
-    uint8_t head[4] = { 0 };
-    (void)fwrite(head, 4, 1, f);
+    size_t nb_truncated = 0;
 
-    bytestream_buf stream_msg;
-    bytestream* msg = bytestream_buf_init(&stream_msg, BYTESTREAM_MAX_BUFFER_SIZE);
+    bytewrite_int32(msg, 0);
 
     /* Common chunk header */
     binlog_compose_event_header(msg, cid, current_time, path_id, picoquic_log_event_packet_sent + receiving);
@@ -730,31 +828,53 @@ void binlog_packet(FILE* f, const picoquic_connection_id_t* cid, uint64_t path_i
         bytewrite_buffer(msg, ph->token_bytes, ph->token_length);
     }
 
-    (void)fwrite(bytestream_data(msg), bytestream_length(msg), 1, f);
-
     /* frame information */
     if (ph->ptype == picoquic_packet_version_negotiation || ph->ptype == picoquic_packet_retry) {
-        picoquic_binlog_frame(f, bytes + ph->offset, bytes + bytes_max);
+        size_t logged = bytestream_length(msg);
+
+        picoquic_binlog_frame(msg, bytes + ph->offset, bytes + bytes_max);
+        if (bytestream_length(msg) == logged) {
+            picoquic_binlog_truncated_frame(msg, bytes + ph->offset, bytes + bytes_max);
+            nb_truncated++;
+        }
     }
     else if (ph->ptype != picoquic_packet_error) {
-        picoquic_binlog_frames(f, bytes + ph->offset, ph->payload_length);
+        nb_truncated = binlog_compose_frames(msg, bytes + ph->offset, ph->payload_length);
     }
 
-    /* re-write chunk size field */
-    long fpos1 = ftell(f);
+    /* write the chunk size at the reserved spot */
+    binlog_record_finish(msg);
+
+    return nb_truncated;
+}
+
+void binlog_packet(FILE* f, const picoquic_connection_id_t* cid, uint64_t path_id, int receiving, uint64_t current_time,
+    const picoquic_packet_header* ph, const uint8_t* bytes, size_t bytes_max)
+{
+    bytestream stream_msg;
+    uint8_t record[PICOQUIC_BINLOG_RECORD_MAX];
+    bytestream* msg = bytestream_ref_init(&stream_msg, record, sizeof(record));
+
+    (void)binlog_compose_packet(msg, cid, path_id, receiving, current_time, ph, bytes, bytes_max);
+    (void)fwrite(bytestream_data(msg), bytestream_length(msg), 1, f);
+}
 
-    picoformat_32(head, (uint32_t)(fpos1 - fpos0 - 4));
+static void binlog_packet_cnx(picoquic_cnx_t* cnx, const picoquic_connection_id_t* cid, uint64_t path_id, int receiving,
+    uint64_t current_time, const picoquic_packet_header* ph, const uint8_t* bytes, size_t bytes_max)
+{
+    bytestream stream_msg;
+    uint8_t record[PICOQUIC_BINLOG_RECORD_MAX];
+    bytestream* msg = bytestream_ref_init(&stream_msg, record, sizeof(record));
 
-    (void)fseek(f, fpos0, SEEK_SET);
-    (void)fwrite(head, 4, 1, f);
-    (void)fseek(f, 0, SEEK_END);
+    cnx->nb_binlog_frames_truncated += binlog_compose_packet(msg, cid, path_id, receiving, current_time, ph, bytes, bytes_max);
+    binlog_write_record(cnx, msg);
 }
 
 static void binlog_packet_ex(picoquic_cnx_t* cnx, picoquic_path_t * path_x, int receiving, uint64_t current_time,
     picoquic_packet_header* ph, const uint8_t* bytes, size_t bytes_max)
 {
-    if (cnx != NULL && cnx->f_binlog != NULL && picoquic_cnx_is_still_logging(cnx)) {
-        binlog_packet(cnx->f_binlog, &cnx->initial_cnxid, binlog_get_path_id(cnx, path_x),
+    if (cnx != NULL && PICOQUIC_CNX_HAS_BINLOG(cnx) && picoquic_cnx_is_still_logging(cnx)) {
+        binlog_packet_cnx(cnx, &cnx->initial_cnxid, binlog_get_path_id(cnx, path_x),
             receiving, current_time, ph, bytes, bytes_max);
     }
 }
@@ -763,7 +883,6 @@ void binlog_dropped_packet(picoquic_cnx_t* cnx, picoquic_path_t* path_x,
     picoquic_packet_header* ph,  size_t packet_size, int err,
     uint8_t * raw_data, uint64_t current_time)
 {
-    FILE* f = cnx->f_binlog;
     size_t raw_size = packet_size;
     bytestream_buf stream_msg;
     bytestream* msg = bytestream_buf_init(&stream_msg, BYTESTREAM_MAX_BUFFER_SIZE);
@@ -787,14 +906,13 @@ void binlog_dropped_packet(picoquic_cnx_t* cnx, picoquic_path_t* path_x,
     (void)bytewrite_buffer(msg, raw_data, raw_size);
 
     /* write the frame length at the reserved spot, and save to log file*/
-    picoformat_32(msg->data, (uint32_t)(msg->ptr - 4));
-    (void)fwrite(bytestream_data(msg), bytestream_length(msg), 1, f);
+    binlog_record_finish(msg);
+    binlog_write_record(cnx, msg);
 }
 
 void binlog_buffered_packet(picoquic_cnx_t* cnx, picoquic_path_t* path_x, 
     picoquic_packet_type_enum ptype, uint64_t current_time)
 {
-    FILE* f = cnx->f_binlog;
     bytestream_buf stream_msg;
     bytestream* msg = bytestream_buf_init(&stream_msg, BYTESTREAM_MAX_BUFFER_SIZE);
 
@@ -807,8 +925,8 @@ void binlog_buffered_packet(picoquic_cnx_t* cnx, picoquic_path_t* path_x,
     (void)bytewrite_cstr(msg, "keys_unavailable");
 
     /* write the frame length at the reserved spot, and save to log file*/
-    picoformat_32(msg->data, (uint32_t)(msg->ptr - 4));
-    (void)fwrite(bytestream_data(msg), bytestream_length(msg), 1, f);
+    binlog_record_finish(msg);
+    binlog_write_record(cnx, msg);
 }
 
 
@@ -816,8 +934,6 @@ void binlog_outgoing_packet(picoquic_cnx_t* cnx, picoquic_path_t * path_x,
     uint8_t * bytes, uint64_t sequence_number, size_t pn_length, size_t length,
     uint8_t* send_buffer, size_t send_length, uint64_t current_time)
 {
-    FILE* f = cnx->f_binlog;
-
     picoquic_cnx_t* pcnx = cnx;
     picoquic_packet_header ph;
     size_t checksum_length = 16;
@@ -858,7 +974,7 @@ void binlog_outgoing_packet(picoquic_cnx_t* cnx, picoquic_path_t * path_x,
         }
     }
 
-    binlog_packet(f, cnxid, binlog_get_path_id(cnx, path_x),  0, current_time, &ph, bytes, length);
+    binlog_packet_cnx(cnx, cnxid, binlog_get_path_id(cnx, path_x),  0, current_time, &ph, bytes, length);
 }
 
 void binlog_packet_lost(picoquic_cnx_t* cnx, picoquic_path_t* path_x,
@@ -866,8 +982,6 @@ void binlog_packet_lost(picoquic_cnx_t* cnx, picoquic_path_t* path_x,
     picoquic_connection_id_t * dcid, size_t packet_size,
     uint64_t current_time)
 {
-    FILE* f = cnx->f_binlog;
-
     bytestream_buf stream_msg;
     bytestream* msg = bytestream_buf_init(&stream_msg, BYTESTREAM_MAX_BUFFER_SIZE);
 
@@ -887,8 +1001,8 @@ void binlog_packet_lost(picoquic_cnx_t* cnx, picoquic_path_t* path_x,
     bytewrite_vint(msg, packet_size);
 
     /* write the frame length at the reserved spot, and save to log file*/
-    picoformat_32(msg->data, (uint32_t)(msg->ptr - 4));
-    (void)fwrite(bytestream_data(msg), bytestream_length(msg), 1, f);
+    binlog_record_finish(msg);
+    binlog_write_record(cnx, msg);
 }
 
 
@@ -896,10 +1010,10 @@ void binlog_negotiated_alpn(picoquic_cnx_t* cnx, int is_local,
     uint8_t const * sni, size_t sni_len, uint8_t const* alpn, size_t alpn_len,
     const ptls_iovec_t* alpn_list, size_t alpn_count)
 {
-    FILE* f = cnx->f_binlog;
-
     bytestream_buf stream_msg;
     bytestream* msg = bytestream_buf_init(&stream_msg, BYTESTREAM_MAX_BUFFER_SIZE);
+
+    bytewrite_int32(msg, 0);
     /* Common chunk header */
     binlog_compose_event_header(msg, &cnx->initial_cnxid, picoquic_get_quic_time(cnx->quic), 0, picoquic_log_event_alpn_update);
     /* Event header */
@@ -922,21 +1036,17 @@ void binlog_negotiated_alpn(picoquic_cnx_t* cnx, int is_local,
         bytewrite_buffer(msg, alpn, alpn_len);
     }
 
-    bytestream_buf stream_head;
-    bytestream* head = bytestream_buf_init(&stream_head, 4);
-    bytewrite_int32(head, (uint32_t)bytestream_length(msg));
-
-    (void)fwrite(bytestream_data(head), bytestream_length(head), 1, f);
-    (void)fwrite(bytestream_data(msg), bytestream_length(msg), 1, f);
+    binlog_record_finish(msg);
+    binlog_write_record(cnx, msg);
 }
 
 void binlog_transport_extension(picoquic_cnx_t* cnx, int is_local,
     size_t param_length, uint8_t* params)
 {
-    FILE* f = cnx->f_binlog;
-
     bytestream_buf stream_msg;
     bytestream* msg = bytestream_buf_init(&stream_msg, BYTESTREAM_MAX_BUFFER_SIZE);
+
+    bytewrite_int32(msg, 0);
     /* Common chunk header */
     binlog_compose_event_header(msg, &cnx->initial_cnxid, picoquic_get_quic_time(cnx->quic), 0, picoquic_log_event_param_update);
     /* Event header */
@@ -947,42 +1057,67 @@ void binlog_transport_extension(picoquic_cnx_t* cnx, int is_local,
         bytewrite_buffer(msg, params, param_length);
     }
 
-    bytestream_buf stream_head;
-    bytestream* head = bytestream_buf_init(&stream_head, 4);
-    bytewrite_int32(head, (uint32_t)bytestream_length(msg));
-
-    (void)fwrite(bytestream_data(head), bytestream_length(head), 1, f);
-    (void)fwrite(bytestream_data(msg), bytestream_length(msg), 1, f);
+    binlog_record_finish(msg);
+    binlog_write_record(cnx, msg);
 }
 
-void binlog_picotls_ticket(FILE* f, picoquic_connection_id_t cnx_id,
+static void binlog_compose_picotls_ticket(bytestream* msg, picoquic_connection_id_t cnx_id,
     uint8_t* ticket, uint16_t ticket_length)
 {
-    bytestream_buf stream_msg;
-    bytestream * msg = bytestream_buf_init(&stream_msg, BYTESTREAM_MAX_BUFFER_SIZE);
+    bytewrite_int32(msg, 0);
     /* Common chunk header */
     binlog_compose_event_header(msg, &cnx_id, 0, 0, picoquic_log_event_tls_key_update);
 
     bytewrite_vint(msg, ticket_length);
     bytewrite_buffer(msg, ticket, ticket_length);
 
-    bytestream_buf stream_head;
-    bytestream * head = bytestream_buf_init(&stream_head, 8);
-    bytewrite_int32(head, (uint32_t)bytestream_length(msg));
+    binlog_record_finish(msg);
+}
+
+void binlog_picotls_ticket(FILE* f, picoquic_connection_id_t cnx_id,
+    uint8_t* ticket, uint16_t ticket_length)
+{
+    bytestream_buf stream_msg;
+    bytestream * msg = bytestream_buf_init(&stream_msg, BYTESTREAM_MAX_BUFFER_SIZE);
 
-    (void)fwrite(bytestream_data(head), bytestream_length(head), 1, f);
+    binlog_compose_picotls_ticket(msg, cnx_id, ticket, ticket_length);
     (void)fwrite(bytestream_data(msg), bytestream_length(msg), 1, f);
 }
 
 static void binlog_picotls_ticket_ex(picoquic_cnx_t* cnx,
     uint8_t* ticket, uint16_t ticket_length)
 {
-    if (cnx != NULL && cnx->f_binlog != NULL && picoquic_cnx_is_still_logging(cnx)) {
-        binlog_picotls_ticket(cnx->f_binlog, cnx->initial_cnxid, ticket, ticket_length);
+    if (cnx != NULL && PICOQUIC_CNX_HAS_BINLOG(cnx) && picoquic_cnx_is_still_logging(cnx)) {
+        bytestream_buf stream_msg;
+        bytestream* msg = bytestream_buf_init(&stream_msg, BYTESTREAM_MAX_BUFFER_SIZE);
+
+        binlog_compose_picotls_ticket(msg, cnx->initial_cnxid, ticket, ticket_length);
+        binlog_write_record(cnx, msg);
     }
 }
 
 FILE* create_binlog(char const* binlog_file, uint64_t creation_time, unsigned int multipath_enabled);
+static FILE* binlog_create_file(char const* binlog_file, uint64_t creation_time, unsigned int is_multipath_supported, uint16_t version);
+static void binlog_compose_file_header(bytestream* ps, uint64_t creation_time, unsigned int is_multipath_supported, uint16_t version);
+
+static void binlog_compose_new_connection(bytestream* msg, picoquic_cnx_t* cnx)
+{
+    bytewrite_int32(msg, 0);
+    /* Common chunk header */
+    binlog_compose_event_header(msg, &cnx->initial_cnxid, cnx->start_time, 0, picoquic_log_event_new_connection);
+
+    bytewrite_int8(msg, cnx->client_mode != 0);
+    bytewrite_int32(msg, cnx->proposed_version);
+    bytewrite_cid(msg, &cnx->path[0]->p_remote_cnxid->cnx_id);
+
+    /* Algorithms used */
+    bytewrite_cstr(msg, cnx->congestion_alg->congestion_algorithm_id);
+    bytewrite_vint(msg, cnx->spin_policy);
+
+    binlog_record_finish(msg);
+}
+
+static void binlog_open_connection(picoquic_cnx_t* cnx, char const* bin_dir);
 
 void binlog_new_connection(picoquic_cnx_t * cnx)
 {
@@ -992,6 +1127,65 @@ void binlog_new_connection(picoquic_cnx_t * cnx)
         return;
     }
 
+    if (cnx->binlog_recorder != NULL) {
+        /* The connection is restarted, e.g., after version negotiation */
+        binlog_recorder_delete(cnx->binlog_recorder);
+        cnx->binlog_recorder = NULL;
+    }
+    else if (!PICOQUIC_CNX_HAS_BINLOG(cnx) && !binlog_policy_is_sampled(cnx->quic)) {
+        return;
+    }
+
+    if (!PICOQUIC_CNX_HAS_BINLOG(cnx) && binlog_policy_uses_recorder(cnx->quic)) {
+        /* The log file is only opened if the connection fails or crosses a threshold */
+        cnx->binlog_recorder = binlog_recorder_create(cnx->quic->binlog_policy.recorder_depth);
+    }
+    else {
+        binlog_open_connection(cnx, bin_dir);
+    }
+}
+
+/* Persist the events kept in the flight recorder, then log the next
+ * events directly. The new connection event is not recorded, because it
+ * is written when the log is opened. */
+static void binlog_recorder_flush(picoquic_cnx_t* cnx)
+{
+    void* recorder = cnx->binlog_recorder;
+    char const* bin_dir = (cnx->quic->binlog_dir == NULL) ? cnx->quic->qlog_dir : cnx->quic->binlog_dir;
+
+    cnx->binlog_recorder = NULL;
+    if (bin_dir != NULL) {
+        binlog_open_connection(cnx, bin_dir);
+    }
+    if (PICOQUIC_CNX_HAS_BINLOG(cnx)) {
+        size_t nb_records = binlog_recorder_count(recorder);
+
+        for (size_t i = 0; i < nb_records; i++) {
+            size_t length = 0;
+            const uint8_t* record = binlog_recorder_get(recorder, i, &length);
+
+            binlog_write_record_bytes(cnx, record, length);
+        }
+    }
+    binlog_recorder_delete(recorder);
+}
+
+static void binlog_open_connection(picoquic_cnx_t* cnx, char const* bin_dir)
+{
+    if (cnx->quic->v_binlog_segment != NULL) {
+        /* All connections share the segment file, which is not counted
+         * against max_simultaneous_logs. */
+        bytestream_buf stream_msg;
+        bytestream* msg = bytestream_buf_init(&stream_msg, BYTESTREAM_MAX_BUFFER_SIZE);
+
+        if (cnx->binlog_segment_entry != NULL) {
+            binlog_segment_close(cnx->quic, cnx->binlog_segment_entry);
+        }
+        binlog_compose_new_connection(msg, cnx);
+        cnx->binlog_segment_entry = binlog_segment_open(cnx, bytestream_data(msg), bytestream_length(msg));
+        return;
+    }
+
     if (cnx->quic->current_number_of_open_logs >= cnx->quic->max_simultaneous_logs) {
         return;
     }
@@ -999,6 +1193,15 @@ void binlog_new_connection(picoquic_cnx_t * cnx)
     int ret = 0;
 
     cnx->f_binlog = picoquic_file_close(cnx->f_binlog);
+    if (cnx->binlog_ring_handle != NULL) {
+        binlog_ring_close(cnx->quic, cnx->binlog_ring_handle, NULL, NULL);
+        cnx->binlog_ring_handle = NULL;
+    }
+    if (cnx->binlog_compact != NULL) {
+        free(cnx->binlog_compact);
+        cnx->binlog_compact = NULL;
+    }
+    uint16_t version = (cnx->quic->use_compact_binlog) ? PICOQUIC_BINLOG_VERSION_COMPACT : PICOQUIC_BINLOG_VERSION;
     
     char cid_name[2 * PICOQUIC_CONNECTION_ID_MAX_SIZE + 1];
     if (picoquic_print_connection_id_hexa(cid_name, sizeof(cid_name), &cnx->initial_cnxid) != 0) {
@@ -1027,9 +1230,27 @@ void binlog_new_connection(picoquic_cnx_t * cnx)
         }
     }
 
-    if (ret == 0) {
-        cnx->f_binlog = create_binlog(log_filename, picoquic_get_quic_time(cnx->quic),
-            cnx->local_parameters.enable_multipath | cnx->local_parameters.enable_simple_multipath | cnx->local_parameters.is_unique_path_id_enabled);
+    if (ret == 0 && cnx->quic->v_binlog_ring != NULL) {
+        /* The file is opened by the ring writer */
+        bytestream_buf stream;
+        bytestream* ps = bytestream_buf_init(&stream, 16);
+
+        binlog_compose_file_header(ps, picoquic_get_quic_time(cnx->quic),
+            cnx->local_parameters.enable_multipath | cnx->local_parameters.enable_simple_multipath | cnx->local_parameters.is_unique_path_id_enabled,
+            version);
+        cnx->binlog_ring_handle = binlog_ring_open(cnx->quic, log_filename, bytestream_data(ps), bytestream_length(ps));
+        if (cnx->binlog_ring_handle == NULL) {
+            cnx->binlog_file_name = picoquic_string_free(cnx->binlog_file_name);
+            ret = -1;
+        }
+        else {
+            cnx->quic->current_number_of_open_logs++;
+        }
+    }
+    else if (ret == 0) {
+        cnx->f_binlog = binlog_create_file(log_filename, picoquic_get_quic_time(cnx->quic),
+            cnx->local_parameters.enable_multipath | cnx->local_parameters.enable_simple_multipath | cnx->local_parameters.is_unique_path_id_enabled,
+            version);
         if (cnx->f_binlog == NULL) {
             cnx->binlog_file_name = picoquic_string_free(cnx->binlog_file_name);
             ret = -1;
@@ -1039,75 +1260,113 @@ void binlog_new_connection(picoquic_cnx_t * cnx)
         }
     }
 
+    if (ret == 0 && version == PICOQUIC_BINLOG_VERSION_COMPACT) {
+        if ((cnx->binlog_compact = malloc(sizeof(picoquic_binlog_compact_t))) == NULL) {
+            ret = -1;
+        }
+        else {
+            binlog_compact_init((picoquic_binlog_compact_t*)cnx->binlog_compact, 0);
+        }
+    }
+
     if (ret == 0) {
         bytestream_buf stream_msg;
         bytestream * msg = bytestream_buf_init(&stream_msg, BYTESTREAM_MAX_BUFFER_SIZE);
-        /* Common chunk header */
-        binlog_compose_event_header(msg, &cnx->initial_cnxid, cnx->start_time, 0, picoquic_log_event_new_connection);
 
-        bytewrite_int8(msg, cnx->client_mode != 0);
-        bytewrite_int32(msg, cnx->proposed_version);
-        bytewrite_cid(msg, &cnx->path[0]->p_remote_cnxid->cnx_id);
-
-        /* Algorithms used */
-        bytewrite_cstr(msg, cnx->congestion_alg->congestion_algorithm_id);
-        bytewrite_vint(msg, cnx->spin_policy);
-
-        bytestream_buf stream_head;
-        bytestream * head = bytestream_buf_init(&stream_head, 8);
-        bytewrite_int32(head, (uint32_t)bytestream_length(msg));
-
-        (void)fwrite(bytestream_data(head), bytestream_length(head), 1, cnx->f_binlog);
-        (void)fwrite(bytestream_data(msg), bytestream_length(msg), 1, cnx->f_binlog);
+        binlog_compose_new_connection(msg, cnx);
+        binlog_write_record(cnx, msg);
     }
 }
 
 void binlog_close_connection(picoquic_cnx_t * cnx)
 {
-    FILE * f = cnx->f_binlog;
-    if (f == NULL) {
+    if (!PICOQUIC_CNX_HAS_BINLOG(cnx)) {
         return;
     }
 
+    if (cnx->binlog_recorder != NULL) {
+        if (binlog_policy_is_error(cnx) || binlog_policy_is_exceeded(cnx, picoquic_get_quic_time(cnx->quic))) {
+            binlog_recorder_flush(cnx);
+        }
+        else {
+            binlog_recorder_delete(cnx->binlog_recorder);
+            cnx->binlog_recorder = NULL;
+        }
+        if (!PICOQUIC_CNX_HAS_BINLOG(cnx)) {
+            return;
+        }
+    }
+
     bytestream_buf stream_msg;
     bytestream * msg = bytestream_buf_init(&stream_msg, BYTESTREAM_MAX_BUFFER_SIZE);
+
+    bytewrite_int32(msg, 0);
     /* Common chunk header */
     binlog_compose_event_header(msg, &cnx->initial_cnxid, picoquic_get_quic_time(cnx->quic), 0, picoquic_log_event_connection_close);
+    binlog_record_finish(msg);
+    binlog_write_record(cnx, msg);
 
-    bytestream_buf stream_head;
-    bytestream * head = bytestream_buf_init(&stream_head, 8);
-    bytewrite_int32(head, (uint32_t)bytestream_length(msg));
+    if (cnx->binlog_segment_entry != NULL) {
+        /* The segment stays open for the other connections */
+        binlog_segment_close(cnx->quic, cnx->binlog_segment_entry);
+        cnx->binlog_segment_entry = NULL;
+        return;
+    }
 
-    (void)fwrite(bytestream_data(head), bytestream_length(head), 1, f);
-    (void)fwrite(bytestream_data(msg), bytestream_length(msg), 1, f);
+    if (cnx->binlog_ring_handle != NULL) {
+        /* The qlog conversion can only start after the ring writer has closed the file */
+        void* qlog_job = NULL;
 
-    fflush(f);
+        if (cnx->quic->qlog_dir != NULL && cnx->quic->autoqlog_defer_fn != NULL) {
+            qlog_job = cnx->quic->autoqlog_defer_fn(cnx);
+        }
+        binlog_ring_close(cnx->quic, cnx->binlog_ring_handle, qlog_job, cnx->quic->autoqlog_run_fn);
+        cnx->binlog_ring_handle = NULL;
+    }
+    else {
+        fflush(cnx->f_binlog);
 
-    cnx->f_binlog = picoquic_file_close(cnx->f_binlog);
+        cnx->f_binlog = picoquic_file_close(cnx->f_binlog);
 
-    if (cnx->quic->qlog_dir != NULL && cnx->quic->autoqlog_fn != NULL) {
-        (void)cnx->quic->autoqlog_fn(cnx);
+        if (cnx->quic->qlog_dir != NULL && cnx->quic->autoqlog_fn != NULL) {
+            (void)cnx->quic->autoqlog_fn(cnx);
+        }
     }
     cnx->binlog_file_name = picoquic_string_free(cnx->binlog_file_name);
+    if (cnx->binlog_compact != NULL) {
+        free(cnx->binlog_compact);
+        cnx->binlog_compact = NULL;
+    }
     if (cnx->quic->current_number_of_open_logs > 0) {
         cnx->quic->current_number_of_open_logs--;
     }
 }
 
+/* Write a header text with version identifier and current date  */
+static void binlog_compose_file_header(bytestream* ps, uint64_t creation_time, unsigned int is_multipath_supported, uint16_t version)
+{
+    bytewrite_int32(ps, FOURCC('q', 'l', 'o', 'g'));
+    bytewrite_int16(ps, (is_multipath_supported) ? 0x01 : 0); /* flags */
+    bytewrite_int16(ps, version);
+    bytewrite_int64(ps, creation_time);
+}
+
 FILE* create_binlog(char const* binlog_file, uint64_t creation_time, unsigned int is_multipath_supported)
+{
+    return binlog_create_file(binlog_file, creation_time, is_multipath_supported, PICOQUIC_BINLOG_VERSION);
+}
+
+static FILE* binlog_create_file(char const* binlog_file, uint64_t creation_time, unsigned int is_multipath_supported, uint16_t version)
 {
     FILE* f_binlog = picoquic_file_open(binlog_file, "wb");
     if (f_binlog == NULL) {
         DBG_PRINTF("Cannot open file %s for write.\n", binlog_file);
     }
     else {
-        /* Write a header text with version identifier and current date  */
         bytestream_buf stream;
         bytestream* ps = bytestream_buf_init(&stream, 16);
-        bytewrite_int32(ps, FOURCC('q', 'l', 'o', 'g'));
-        bytewrite_int16(ps, (is_multipath_supported) ? 0x01 : 0); /* flags */
-        bytewrite_int16(ps, 0x01); /* version */
-        bytewrite_int64(ps, creation_time);
+
+        binlog_compose_file_header(ps, creation_time, is_multipath_supported, version);
 
         if (fwrite(bytestream_data(ps), bytestream_length(ps), 1, f_binlog) <= 0) {
             DBG_PRINTF("Cannot write header for file %s.\n", binlog_file);
@@ -1126,12 +1385,20 @@ FILE* create_binlog(char const* binlog_file, uint64_t creation_time, unsigned in
 
 void binlog_cc_dump(picoquic_cnx_t* cnx, uint64_t current_time)
 {
-    if (cnx->f_binlog == NULL) {
+    if (!PICOQUIC_CNX_HAS_BINLOG(cnx)) {
         return;
     }
 
+    if (cnx->binlog_recorder != NULL && binlog_policy_is_exceeded(cnx, current_time)) {
+        binlog_recorder_flush(cnx);
+        if (!PICOQUIC_CNX_HAS_BINLOG(cnx)) {
+            return;
+        }
+    }
+
     bytestream_buf stream_msg;
     bytestream* ps_msg = bytestream_buf_init(&stream_msg, BYTESTREAM_MAX_BUFFER_SIZE);
+    bytewrite_int32(ps_msg, 0);
     int path_max = (cnx->is_multipath_enabled || cnx->is_simple_multipath_enabled || cnx->is_unique_path_id_enabled) ? cnx->nb_paths : 1;
 
     for (int path_id = 0; path_id < path_max; path_id++)
@@ -1210,13 +1477,8 @@ void binlog_cc_dump(picoquic_cnx_t* cnx, uint64_t current_time)
         bytewrite_vint(ps_msg, path->bytes_in_transit);
         bytewrite_vint(ps_msg, path->last_bw_estimate_path_limited);
 
-        bytestream_buf stream_head;
-        bytestream* ps_head = bytestream_buf_init(&stream_head, BYTESTREAM_MAX_BUFFER_SIZE);
-
-        bytewrite_int32(ps_head, (uint32_t)bytestream_length(ps_msg));
-
-        (void)fwrite(bytestream_data(ps_head), bytestream_length(ps_head), 1, cnx->f_binlog);
-        (void)fwrite(bytestream_data(ps_msg), bytestream_length(ps_msg), 1, cnx->f_binlog);
+        binlog_record_finish(ps_msg);
+        binlog_write_record(cnx, ps_msg);
     }
 }
 
@@ -1226,7 +1488,7 @@ void binlog_cc_dump(picoquic_cnx_t* cnx, uint64_t current_time)
 
 void picoquic_binlog_message_v(picoquic_cnx_t* cnx, const char* fmt, va_list vargs)
 {
-    if (cnx->f_binlog == NULL) {
+    if (!PICOQUIC_CNX_HAS_BINLOG(cnx)) {
         return;
     }
     bytestream_buf stream_msg;
@@ -1234,6 +1496,8 @@ void picoquic_binlog_message_v(picoquic_cnx_t* cnx, const char* fmt, va_list var
     size_t message_len;
     char* message_text;
     int written = -1;
+
+    bytewrite_int32(ps_msg, 0);
     /* Common chunk header */
     binlog_compose_event_header(ps_msg, &cnx->initial_cnxid, picoquic_get_quic_time(cnx->quic), 0, picoquic_log_event_info_message);
 
@@ -1252,13 +1516,8 @@ void picoquic_binlog_message_v(picoquic_cnx_t* cnx, const char* fmt, va_list var
 #endif
     ps_msg->ptr += message_len;
 
-    bytestream_buf stream_head;
-    bytestream* ps_head = bytestream_buf_init(&stream_head, BYTESTREAM_MAX_BUFFER_SIZE);
-
-    bytewrite_int32(ps_head, (uint32_t)bytestream_length(ps_msg));
-
-    (void)fwrite(bytestream_data(ps_head), bytestream_length(ps_head), 1, cnx->f_binlog);
-    (void)fwrite(bytestream_data(ps_msg), bytestream_length(ps_msg), 1, cnx->f_binlog);
+    binlog_record_finish(ps_msg);
+    binlog_write_record(cnx, ps_msg);
 }
 
 /* Log an event that cannot be attached to a specific connection */
@@ -1288,17 +1547,17 @@ void binlog_ignore_quic_pdu(picoquic_quic_t* quic, int receiving, uint64_t curre
 /* Log an event relating to a specific connection */
 static void binlog_app_message(picoquic_cnx_t* cnx, const char* fmt, va_list vargs)
 {
-    if (cnx->f_binlog != NULL) {
+    if (PICOQUIC_CNX_HAS_BINLOG(cnx)) {
         picoquic_binlog_message_v(cnx, fmt, vargs);
     }
 }
 
-/* Return from close with nothing, as this is per connection only */
+/* Logs are per connection, so there is nothing to close at the context
+ * level except the log ring writer, if it was enabled. */
 void binlog_close(picoquic_quic_t* quic)
 {
-#ifdef _WINDOWS
-    UNREFERENCED_PARAMETER(quic);
-#endif
+    picoquic_binlog_segment_delete(quic);
+    picoquic_binlog_ring_delete(quic);
 }
 
 struct st_picoquic_unified_logging_t binlog_functions = {
@@ -1334,3 +1593,8 @@ void picoquic_enable_binlog(picoquic_quic_t* quic)
 {
     quic->bin_log_fns = &binlog_functions;
 }
+
+void picoquic_set_binlog_compact(picoquic_quic_t* quic, int use_compact_binlog)
+{
+    quic->use_compact_binlog = (use_compact_binlog) ? 1 : 0;
+}
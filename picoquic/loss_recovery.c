@@ -851,6 +851,8 @@ static picoquic_packet_t* picoquic_process_lost_packet(picoquic_cnx_t* cnx, pico
     int ret = 0;
     int force_queue = 0;
 
+    PICOQUIC_PROBE7(packet_lost, cnx, old_p->send_path, old_p->sequence_number, old_p->length,
+        is_timer_expired, old_p->send_time, current_time);
     /* Manage the path MTU issues */
     picoquic_check_path_mtu_on_losses(cnx, old_p, is_timer_expired);
     /* Report loss to application, update counts */
@@ -957,6 +959,7 @@ static void picoquic_count_and_notify_loss(
 
         if (!old_p->is_preemptive_repeat) {
             cnx->nb_retransmission_total++;
+            PICOQUIC_METRICS_ADD(cnx->quic, picoquic_metrics_retransmissions, 1);
         }
     }
 
@@ -974,9 +977,14 @@ static void picoquic_count_and_notify_loss(
             picoquic_per_ack_state_t ack_state = { 0 };
             ack_state.lost_packet_number = old_p->path_packet_number;
             ack_state.nb_bytes_newly_lost = old_p->length;
+            PICOQUIC_PHASE_START(cc_start);
             cnx->congestion_alg->alg_notify(cnx, old_p->send_path,
                 (timer_based_retransmit == 0) ? picoquic_congestion_notification_repeat : picoquic_congestion_notification_timeout,
                 &ack_state, current_time);
+            PICOQUIC_PHASE_END(cnx->quic, picoquic_phase_cc_update, cc_start);
+            PICOQUIC_PROBE5(cc_notify, cnx, old_p->send_path,
+                (timer_based_retransmit == 0) ? picoquic_congestion_notification_repeat : picoquic_congestion_notification_timeout,
+                old_p->send_path->cwin, old_p->send_path->bytes_in_transit);
         }
     }
 }
@@ -0,0 +1,413 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Context level metrics registry.
+ *
+ * The registry is a flat set of 64 bit values. There is a single
+ * writer, the thread running the QUIC context, so updates are done with
+ * relaxed loads and stores instead of locked instructions. Readers in
+ * other threads copy the values one by one with relaxed loads.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include "picoquic_internal.h"
+#include "picoquic_utils.h"
+#include "picoquic_metrics.h"
+#ifdef _WINDOWS
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+typedef struct st_picoquic_metrics_t {
+    picoquic_metrics_snapshot_t values;
+} picoquic_metrics_t;
+
+#ifdef _WINDOWS
+static uint64_t metrics_load(volatile uint64_t* p)
+{
+    return *p;
+}
+
+static void metrics_store(volatile uint64_t* p, uint64_t v)
+{
+    *p = v;
+}
+#else
+static uint64_t metrics_load(volatile uint64_t* p)
+{
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+static void metrics_store(volatile uint64_t* p, uint64_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELAXED);
+}
+#endif
+
+int picoquic_metrics_enable(picoquic_quic_t* quic)
+{
+    int ret = 0;
+
+    if (quic->metrics == NULL) {
+        quic->metrics = (picoquic_metrics_t*)malloc(sizeof(picoquic_metrics_t));
+        if (quic->metrics == NULL) {
+            ret = PICOQUIC_ERROR_MEMORY;
+        }
+        else {
+            memset(quic->metrics, 0, sizeof(picoquic_metrics_t));
+        }
+    }
+
+    return ret;
+}
+
+void picoquic_metrics_disable(picoquic_quic_t* quic)
+{
+    if (quic->metrics != NULL) {
+        free(quic->metrics);
+        quic->metrics = NULL;
+    }
+}
+
+/* Update functions */
+
+void picoquic_metrics_add(picoquic_quic_t* quic, picoquic_metrics_counter_enum counter, uint64_t value)
+{
+    if (quic->metrics != NULL) {
+        uint64_t* p = &quic->metrics->values.counter[counter];
+        metrics_store(p, *p + value);
+    }
+}
+
+size_t picoquic_metrics_bucket_index(uint64_t value)
+{
+    size_t index = (size_t)value;
+
+    if (value >= PICOQUIC_METRICS_SUB_BUCKETS) {
+        /* Find the rank of the highest bit */
+        int e = 0;
+        uint64_t v = value;
+
+        if (v >> 32) { e += 32; v >>= 32; }
+        if (v >> 16) { e += 16; v >>= 16; }
+        if (v >> 8) { e += 8; v >>= 8; }
+        if (v >> 4) { e += 4; v >>= 4; }
+        if (v >> 2) { e += 2; v >>= 2; }
+        if (v >> 1) { e += 1; }
+        index = ((size_t)e - PICOQUIC_METRICS_SUB_BUCKET_BITS + 1) * PICOQUIC_METRICS_SUB_BUCKETS +
+            (size_t)((value >> (e - PICOQUIC_METRICS_SUB_BUCKET_BITS)) & (PICOQUIC_METRICS_SUB_BUCKETS - 1));
+    }
+
+    return index;
+}
+
+/* Largest value that falls in the bucket */
+uint64_t picoquic_metrics_bucket_upper(size_t index)
+{
+    uint64_t upper = (uint64_t)index;
+
+    if (index >= PICOQUIC_METRICS_SUB_BUCKETS) {
+        int shift = (int)(index / PICOQUIC_METRICS_SUB_BUCKETS) - 1;
+        uint64_t sub = (uint64_t)(index % PICOQUIC_METRICS_SUB_BUCKETS);
+        uint64_t lower = (PICOQUIC_METRICS_SUB_BUCKETS + sub) << shift;
+
+        upper = lower + ((((uint64_t)1) << shift) - 1);
+    }
+
+    return upper;
+}
+
+void picoquic_metrics_record(picoquic_quic_t* quic, picoquic_metrics_histogram_enum histogram, uint64_t value)
+{
+    if (quic->metrics != NULL) {
+        picoquic_metrics_histogram_t* h = &quic->metrics->values.histogram[histogram];
+        size_t index = picoquic_metrics_bucket_index(value);
+
+        metrics_store(&h->bucket[index], h->bucket[index] + 1);
+        metrics_store(&h->sum, h->sum + value);
+        if (h->count == 0 || value < h->min) {
+            metrics_store(&h->min, value);
+        }
+        if (value > h->max) {
+            metrics_store(&h->max, value);
+        }
+        metrics_store(&h->count, h->count + 1);
+    }
+}
+
+void picoquic_metrics_sample_pools(picoquic_quic_t* quic)
+{
+    if (quic->metrics != NULL) {
+        uint64_t* gauge = quic->metrics->values.gauge;
+
+        metrics_store(&gauge[picoquic_metrics_connections], quic->current_number_connections);
+        metrics_store(&gauge[picoquic_metrics_packets_allocated], (uint64_t)quic->nb_packets_allocated);
+        metrics_store(&gauge[picoquic_metrics_packets_in_pool], (uint64_t)quic->nb_packets_in_pool);
+        metrics_store(&gauge[picoquic_metrics_data_nodes_allocated], (uint64_t)quic->nb_data_nodes_allocated);
+        metrics_store(&gauge[picoquic_metrics_data_nodes_in_pool], (uint64_t)quic->nb_data_nodes_in_pool);
+        picoquic_metrics_record(quic, picoquic_metrics_packet_pool,
+            (uint64_t)(quic->nb_packets_allocated - quic->nb_packets_in_pool));
+        picoquic_metrics_record(quic, picoquic_metrics_data_node_pool,
+            (uint64_t)(quic->nb_data_nodes_allocated - quic->nb_data_nodes_in_pool));
+    }
+}
+
+/* Snapshot and quantiles */
+
+int picoquic_metrics_get_snapshot(picoquic_quic_t* quic, picoquic_metrics_snapshot_t* snapshot)
+{
+    int ret = -1;
+    picoquic_metrics_t* metrics = quic->metrics;
+
+    if (metrics != NULL) {
+        /* The snapshot only contains 64 bit values */
+        uint64_t* src = (uint64_t*)&metrics->values;
+        uint64_t* dst = (uint64_t*)snapshot;
+        size_t nb_values = sizeof(picoquic_metrics_snapshot_t) / sizeof(uint64_t);
+
+        for (size_t i = 0; i < nb_values; i++) {
+            dst[i] = metrics_load(&src[i]);
+        }
+        ret = 0;
+    }
+
+    return ret;
+}
+
+uint64_t picoquic_metrics_quantile(const picoquic_metrics_histogram_t* histogram, double quantile)
+{
+    uint64_t value = 0;
+
+    if (histogram->count > 0) {
+        double target = quantile * (double)histogram->count;
+        uint64_t rank = (uint64_t)target;
+        uint64_t cumul = 0;
+
+        if ((double)rank < target) {
+            rank++;
+        }
+
+        if (rank < 1) {
+            rank = 1;
+        }
+        if (rank > histogram->count) {
+            rank = histogram->count;
+        }
+
+        value = histogram->max;
+        for (size_t i = 0; i < PICOQUIC_METRICS_NB_BUCKETS; i++) {
+            cumul += histogram->bucket[i];
+            if (cumul >= rank) {
+                uint64_t upper = picoquic_metrics_bucket_upper(i);
+                if (upper < value) {
+                    value = upper;
+                }
+                break;
+            }
+        }
+    }
+
+    return value;
+}
+
+/* Names, used as the suffix of the Prometheus names */
+
+const char* picoquic_metrics_counter_name(picoquic_metrics_counter_enum counter)
+{
+    switch (counter) {
+    case picoquic_metrics_cnx_created: return "connections_created";
+    case picoquic_metrics_cnx_deleted: return "connections_deleted";
+    case picoquic_metrics_packets_sent: return "packets_sent";
+    case picoquic_metrics_packets_received: return "packets_received";
+    case picoquic_metrics_retransmissions: return "retransmissions";
+    case picoquic_metrics_spurious: return "spurious_retransmissions";
+    case picoquic_metrics_trains_sent: return "trains_sent";
+    case picoquic_metrics_trains_short: return "trains_short";
+    case picoquic_metrics_trains_blocked_cwin: return "trains_blocked_cwin";
+    case picoquic_metrics_trains_blocked_pacing: return "trains_blocked_pacing";
+    case picoquic_metrics_trains_blocked_others: return "trains_blocked_others";
+    default: return "unknown";
+    }
+}
+
+const char* picoquic_metrics_gauge_name(picoquic_metrics_gauge_enum gauge)
+{
+    switch (gauge) {
+    case picoquic_metrics_connections: return "connections";
+    case picoquic_metrics_packets_allocated: return "packets_allocated";
+    case picoquic_metrics_packets_in_pool: return "packets_in_pool";
+    case picoquic_metrics_data_nodes_allocated: return "data_nodes_allocated";
+    case picoquic_metrics_data_nodes_in_pool: return "data_nodes_in_pool";
+    default: return "unknown";
+    }
+}
+
+const char* picoquic_metrics_histogram_name(picoquic_metrics_histogram_enum histogram)
+{
+    switch (histogram) {
+    case picoquic_metrics_handshake_time: return "handshake_time_us";
+    case picoquic_metrics_rtt: return "rtt_us";
+    case picoquic_metrics_cwin: return "cwin_bytes";
+    case picoquic_metrics_train_packets: return "train_packets";
+    case picoquic_metrics_loop_time: return "loop_time_us";
+    case picoquic_metrics_packet_time: return "packet_time_us";
+    case picoquic_metrics_packet_pool: return "packets_in_use";
+    case picoquic_metrics_data_node_pool: return "data_nodes_in_use";
+    default: return "unknown";
+    }
+}
+
+/* Prometheus text format */
+
+static int picoquic_metrics_append(char* text, size_t text_max, size_t* text_length, const char* fmt, ...)
+{
+    int ret = -1;
+    size_t length = *text_length;
+
+    if (length < text_max) {
+        va_list args;
+        int res;
+
+        va_start(args, fmt);
+#ifdef _WINDOWS
+        res = vsnprintf_s(text + length, text_max - length, _TRUNCATE, fmt, args);
+#else
+        res = vsnprintf(text + length, text_max - length, fmt, args);
+#endif
+        va_end(args);
+        if (res >= 0 && (size_t)res < text_max - length) {
+            *text_length = length + (size_t)res;
+            ret = 0;
+        }
+    }
+
+    return ret;
+}
+
+int picoquic_metrics_format_prometheus(const picoquic_metrics_snapshot_t* snapshot,
+    char* text, size_t text_max, size_t* text_length)
+{
+    static const char* quantile_text[4] = { "0.5", "0.9", "0.99", "0.999" };
+    static const double quantile_value[4] = { 0.5, 0.9, 0.99, 0.999 };
+    int ret = 0;
+
+    *text_length = 0;
+
+    for (int i = 0; ret == 0 && i < picoquic_metrics_counter_max; i++) {
+        const char* name = picoquic_metrics_counter_name((picoquic_metrics_counter_enum)i);
+        ret = picoquic_metrics_append(text, text_max, text_length,
+            "# TYPE picoquic_%s_total counter\npicoquic_%s_total %" PRIu64 "\n",
+            name, name, snapshot->counter[i]);
+    }
+
+    for (int i = 0; ret == 0 && i < picoquic_metrics_gauge_max; i++) {
+        const char* name = picoquic_metrics_gauge_name((picoquic_metrics_gauge_enum)i);
+        ret = picoquic_metrics_append(text, text_max, text_length,
+            "# TYPE picoquic_%s gauge\npicoquic_%s %" PRIu64 "\n",
+            name, name, snapshot->gauge[i]);
+    }
+
+    for (int i = 0; ret == 0 && i < picoquic_metrics_histogram_max; i++) {
+        const picoquic_metrics_histogram_t* h = &snapshot->histogram[i];
+        const char* name = picoquic_metrics_histogram_name((picoquic_metrics_histogram_enum)i);
+
+        ret = picoquic_metrics_append(text, text_max, text_length, "# TYPE picoquic_%s summary\n", name);
+        for (int q = 0; ret == 0 && q < 4; q++) {
+            ret = picoquic_metrics_append(text, text_max, text_length, "picoquic_%s{quantile=\"%s\"} %" PRIu64 "\n",
+                name, quantile_text[q], picoquic_metrics_quantile(h, quantile_value[q]));
+        }
+        if (ret == 0) {
+            ret = picoquic_metrics_append(text, text_max, text_length,
+                "picoquic_%s_sum %" PRIu64 "\npicoquic_%s_count %" PRIu64 "\n# TYPE picoquic_%s_max gauge\npicoquic_%s_max %" PRIu64 "\n",
+                name, h->sum, name, h->count, name, name, h->max);
+        }
+    }
+
+    return ret;
+}
+
+static char* picoquic_metrics_render(picoquic_quic_t* quic, size_t* text_length)
+{
+    char* text = NULL;
+    picoquic_metrics_snapshot_t* snapshot = (picoquic_metrics_snapshot_t*)malloc(sizeof(picoquic_metrics_snapshot_t));
+
+    if (snapshot != NULL) {
+        if (picoquic_metrics_get_snapshot(quic, snapshot) == 0 &&
+            (text = (char*)malloc(PICOQUIC_METRICS_TEXT_MAX)) != NULL &&
+            picoquic_metrics_format_prometheus(snapshot, text, PICOQUIC_METRICS_TEXT_MAX, text_length) != 0) {
+            free(text);
+            text = NULL;
+        }
+        free(snapshot);
+    }
+
+    return text;
+}
+
+int picoquic_metrics_write_prometheus(picoquic_quic_t* quic, FILE* F)
+{
+    int ret = -1;
+    size_t text_length = 0;
+    char* text = picoquic_metrics_render(quic, &text_length);
+
+    if (text != NULL) {
+        if (fwrite(text, 1, text_length, F) == text_length) {
+            ret = 0;
+        }
+        free(text);
+    }
+
+    return ret;
+}
+
+int picoquic_metrics_write_prometheus_fd(picoquic_quic_t* quic, int fd)
+{
+    int ret = -1;
+    size_t text_length = 0;
+    char* text = picoquic_metrics_render(quic, &text_length);
+
+    if (text != NULL) {
+        size_t written = 0;
+
+        ret = 0;
+        while (ret == 0 && written < text_length) {
+#ifdef _WINDOWS
+            int res = _write(fd, text + written, (unsigned int)(text_length - written));
+#else
+            ssize_t res = write(fd, text + written, text_length - written);
+#endif
+            if (res <= 0) {
+                ret = -1;
+            }
+            else {
+                written += (size_t)res;
+            }
+        }
+        free(text);
+    }
+
+    return ret;
+}
@@ -411,7 +411,7 @@ uint64_t picoquic_get_packet_number64(uint64_t highest, uint64_t mask, uint32_t
 
 void picoquic_log_pn_dec_trial(picoquic_cnx_t* cnx)
 {
-    if (cnx->quic->log_pn_dec && (cnx->quic->F_log != NULL || cnx->f_binlog != NULL)){
+    if (cnx->quic->log_pn_dec && (cnx->quic->F_log != NULL || PICOQUIC_CNX_HAS_BINLOG(cnx))){
         void* pn_dec = cnx->crypto_context[picoquic_epoch_1rtt].pn_dec;
         void* pn_enc = cnx->crypto_context[picoquic_epoch_1rtt].pn_enc;
         uint8_t test_iv[32] = {
@@ -692,6 +692,14 @@ size_t picoquic_remove_packet_protection(picoquic_cnx_t* cnx,
     return decoded;
 }
 
+/* Check whether an Initial packet for an unknown connection can be answered by a
+ * Retry built from the clear text header, see picoquic_queue_fast_stateless_retry */
+static int picoquic_is_fast_retry_candidate(picoquic_quic_t* quic, picoquic_packet_header* ph)
+{
+    return (quic->check_token && !quic->server_busy && !quic->enforce_client_only &&
+        quic->local_cnxid_length > 0 && ph->token_length == 0 && ph->version_index >= 0);
+}
+
 int picoquic_parse_header_and_decrypt(
     picoquic_quic_t* quic,
     const uint8_t* bytes,
@@ -708,7 +716,11 @@ int picoquic_parse_header_and_decrypt(
     /* Parse the clear text header. Ret == 0 means an incorrect packet that could not be parsed */
     int already_received = 0;
     size_t decoded_length = 0;
-    int ret = picoquic_parse_packet_header(quic, bytes, length, addr_from, ph, pcnx, 1);
+    int ret;
+    PICOQUIC_PHASE_START(parse_start);
+
+    ret = picoquic_parse_packet_header(quic, bytes, length, addr_from, ph, pcnx, 1);
+    PICOQUIC_PHASE_END(quic, picoquic_phase_header_parse, parse_start);
 
     *new_ctx_created = 0;
 
@@ -738,6 +750,10 @@ int picoquic_parse_header_and_decrypt(
                         /* Initial CID too short -- ignore the packet */
                         ret = PICOQUIC_ERROR_INITIAL_CID_TOO_SHORT;
                     }
+                    else if (picoquic_is_fast_retry_candidate(quic, ph)) {
+                        /* Retry is mandatory, the caller will send it without creating a context */
+                        ret = PICOQUIC_ERROR_RETRY;
+                    }
                     else if (!quic->enforce_client_only) {
                         /* if listening is OK, listen */
 
@@ -775,15 +791,17 @@ int picoquic_parse_header_and_decrypt(
                     }
 
                     if (ret == 0) {
+                        PICOQUIC_PHASE_START(decrypt_start);
                         /* Remove header protection at this point -- values of bytes will change */
                         ret = picoquic_remove_header_protection(*pcnx, (uint8_t*)bytes, decrypted_data->data, ph);
+                        if (ret == 0) {
+                            decoded_length = picoquic_remove_packet_protection(*pcnx, (uint8_t*)bytes,
+                                decrypted_data->data, ph, current_time, &already_received);
+                        }
+                        PICOQUIC_PHASE_END(quic, picoquic_phase_decrypt, decrypt_start);
                     }
 
-                    if (ret == 0) {
-                        decoded_length = picoquic_remove_packet_protection(*pcnx, (uint8_t*)bytes,
-                            decrypted_data->data, ph, current_time, &already_received);
-                    }
-                    else {
+                    if (ret != 0) {
                         decoded_length = ph->payload_length + 1;
                     }
 
@@ -1133,6 +1151,76 @@ void picoquic_queue_stateless_retry(picoquic_cnx_t* cnx,
     }
 }
 
+/*
+ * Queue a stateless retry without creating a connection context.
+ * When the server requires address validation, a token-less Initial will always be
+ * answered by a Retry. All the data needed for that Retry is available in the clear
+ * text header, so there is no need to create a connection context, derive the
+ * Initial keys and decrypt the packet. This matters when the server is flooded with
+ * spoofed Initial packets.
+ * The packet number of the client Initial is protected, so it cannot be read here.
+ * The token documents a packet number of 0, which is a valid lower bound since
+ * clients shall not reset the packet number after receiving a Retry.
+ */
+static void picoquic_queue_fast_stateless_retry(picoquic_quic_t* quic,
+    picoquic_packet_header* ph, struct sockaddr* addr_from,
+    struct sockaddr* addr_to,
+    unsigned long if_index_to,
+    uint64_t current_time)
+{
+    picoquic_stateless_packet_t* sp = NULL;
+    picoquic_connection_id_t retry_cid;
+    uint8_t token_buffer[256];
+    size_t token_size = 0;
+
+    if (quic->nb_pending_stateless >= PICOQUIC_MAX_PENDING_STATELESS) {
+        /* The sender is not keeping up, dropping is the only option */
+        quic->nb_fast_retry_dropped++;
+    }
+    else if (picoquic_create_retry_cnxid(quic, &ph->dest_cnx_id, &retry_cid) == 0 &&
+        picoquic_prepare_retry_token(quic, addr_from,
+            current_time + PICOQUIC_TOKEN_DELAY_SHORT, &ph->dest_cnx_id,
+            &retry_cid, 0, token_buffer, sizeof(token_buffer), &token_size) == 0 &&
+        (sp = picoquic_create_stateless_packet(quic)) != NULL) {
+        void* integrity_aead = picoquic_find_retry_protection_context_ex(quic, ph->version_index, 1);
+        size_t checksum_length = (integrity_aead == NULL) ? 0 : picoquic_aead_get_checksum_length(integrity_aead);
+        uint8_t* bytes = sp->bytes;
+        size_t byte_index = 0;
+
+        bytes[byte_index++] = picoquic_create_long_packet_type(picoquic_packet_retry, ph->version_index);
+        picoformat_32(&bytes[byte_index], picoquic_supported_versions[ph->version_index].version);
+        byte_index += 4;
+        bytes[byte_index++] = ph->srce_cnx_id.id_len;
+        byte_index += picoquic_format_connection_id(bytes + byte_index,
+            PICOQUIC_MAX_PACKET_SIZE - byte_index, ph->srce_cnx_id);
+        bytes[byte_index++] = retry_cid.id_len;
+        byte_index += picoquic_format_connection_id(bytes + byte_index,
+            PICOQUIC_MAX_PACKET_SIZE - byte_index, retry_cid);
+
+        if (integrity_aead == NULL) {
+            bytes[byte_index++] = ph->dest_cnx_id.id_len;
+            byte_index += picoquic_format_connection_id(bytes + byte_index,
+                PICOQUIC_MAX_PACKET_SIZE - byte_index - checksum_length, ph->dest_cnx_id);
+        }
+
+        memcpy(&bytes[byte_index], token_buffer, token_size);
+        byte_index += token_size;
+
+        byte_index = picoquic_encode_retry_protection(integrity_aead, bytes, PICOQUIC_MAX_PACKET_SIZE, byte_index, &ph->dest_cnx_id);
+
+        sp->length = byte_index;
+        sp->ptype = picoquic_packet_retry;
+        picoquic_store_addr(&sp->addr_to, addr_from);
+        picoquic_store_addr(&sp->addr_local, addr_to);
+        sp->if_index_local = if_index_to;
+        sp->initial_cid = ph->dest_cnx_id;
+        sp->cnxid_log64 = picoquic_val64_connection_id(sp->initial_cid);
+
+        picoquic_queue_stateless_packet(quic, sp);
+        quic->nb_fast_retry_sent++;
+    }
+}
+
 /* Queue a close message for an incoming connection attemt that was rejected.
  * The connection context can then be immediately frees.
  */
@@ -1147,7 +1235,7 @@ void picoquic_queue_immediate_close(picoquic_cnx_t* cnx, uint64_t current_time)
             picoquic_queue_stateless_packet(cnx->quic, sp);
         }
         else {
-            picoquic_delete_stateless_packet(sp);
+            picoquic_delete_stateless_packet(cnx->quic, sp);
         }
     }
 }
@@ -2242,6 +2330,7 @@ int picoquic_incoming_segment(
     if (decrypted_data == NULL) {
         return -1;
     }
+    PICOQUIC_PROBE3(segment_start, quic, length, current_time);
     /* Parse the header and decrypt the segment */
     ret = picoquic_parse_header_and_decrypt(quic, raw_bytes, length, packet_length, addr_from,
         current_time, decrypted_data, &ph, &cnx, consumed, &new_context_created);
@@ -2428,6 +2517,8 @@ int picoquic_incoming_segment(
                 break;
             }
         }
+    } else if (ret == PICOQUIC_ERROR_RETRY && cnx == NULL) {
+        picoquic_queue_fast_stateless_retry(quic, &ph, addr_from, addr_to, if_index_to, current_time);
     } else if (ret == PICOQUIC_ERROR_STATELESS_RESET) {
         ret = picoquic_incoming_stateless_reset(cnx);
     }
@@ -2449,6 +2540,7 @@ int picoquic_incoming_segment(
         if (cnx != NULL && cnx->cnx_state != picoquic_state_disconnected &&
             ph.ptype != picoquic_packet_version_negotiation) {
             cnx->nb_packets_received++;
+            PICOQUIC_METRICS_ADD(quic, picoquic_metrics_packets_received, 1);
             cnx->latest_receive_time = current_time;
             /* Mark the sequence number as received */
             ret = picoquic_record_pn_received(cnx, ph.pc, ph.l_cid, ph.pn64, receive_time);
@@ -2501,6 +2593,8 @@ int picoquic_incoming_segment(
         picoquic_stream_data_node_recycle(decrypted_data);
     }
 
+    PICOQUIC_PROBE6(segment_done, quic, cnx, ph.ptype, ph.pn64, length, ret);
+
     return ret;
 }
 
@@ -2518,6 +2612,7 @@ int picoquic_incoming_packet_ex(
     size_t consumed_index = 0;
     int ret = 0;
     picoquic_connection_id_t previous_destid = picoquic_null_connection_id;
+    uint64_t process_start = (quic->metrics == NULL) ? 0 : picoquic_current_time();
 
     while (consumed_index < packet_length) {
         size_t consumed = 0;
@@ -2543,6 +2638,10 @@ int picoquic_incoming_packet_ex(
         (*first_cnx)->max_mtu_received = packet_length;
     }
 
+    if (quic->metrics != NULL) {
+        picoquic_metrics_record(quic, picoquic_metrics_packet_time, picoquic_current_time() - process_start);
+    }
+
     return ret;
 }
 
@@ -2622,7 +2721,7 @@ void picoquic_process_sooner_packets(picoquic_cnx_t* cnx, uint64_t current_time)
             else {
                 previous->next_packet = packet->next_packet;
             }
-            picoquic_delete_stateless_packet(packet);
+            picoquic_delete_stateless_packet(cnx->quic, packet);
         }
         else {
             previous = packet;
@@ -32,10 +32,25 @@
  *   "performance log" context, i.e., in memory.
  * - when there are no more active connections on the server, the collected
  *   data is appended to the log.
+ *
+ * On long running servers, keeping the measurements in memory until all
+ * connections are closed is not practical. In streaming mode, the rows are
+ * formatted when each connection ends and appended to a buffer, which a
+ * writer thread drains to the log file. The writer periodically syncs the
+ * file to disk, and rotates it when it grows past a maximum size. Rows are
+ * dropped if the buffer is full, so that logging never blocks the packet
+ * loop. Streaming logs can also include periodic snapshots of long lived
+ * connections, marked by a last column set to 1.
  */
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
+#ifdef _WINDOWS
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 #include "picoquic.h"
 #include "picoquic_utils.h"
 #include "picoquic_internal.h"
@@ -60,10 +75,36 @@ typedef struct st_picoquic_performance_log_item_t {
     uint64_t v[PICOQUIC_PERF_LOG_MAX_ITEMS];
 } picoquic_performance_log_item_t;
 
+typedef struct st_picoquic_perflog_stream_t {
+    picoquic_mutex_t mutex;
+    picoquic_event_t event;
+    picoquic_thread_t thread;
+    size_t buffer_size;
+    uint64_t fsync_interval;
+    uint64_t max_file_size;
+    /* Shared with the packet loop, protected by the mutex */
+    char* fill_buffer;
+    size_t fill_length;
+    int should_stop;
+    uint64_t nb_rows;
+    uint64_t nb_dropped;
+    /* Only used by the writer thread */
+    char* write_buffer;
+    char const* file_name;
+    FILE* F;
+    uint64_t file_size;
+    uint64_t header_size;
+    uint64_t last_sync_time;
+    int is_sync_needed;
+    int rotation_index;
+} picoquic_perflog_stream_t;
+
 typedef struct st_picoquic_performance_log_ctx_t {
     struct st_picoquic_performance_log_item_t* first;
     struct st_picoquic_performance_log_item_t* last;
     char const* perflog_file_name;
+    picoquic_perflog_stream_t* stream;
+    uint64_t snapshot_interval;
 } picoquic_performance_log_ctx_t;
 
 void picoquic_perflog_item_free(picoquic_performance_log_item_t* perflog_item)
@@ -74,6 +115,62 @@ void picoquic_perflog_item_free(picoquic_performance_log_item_t* perflog_item)
     free(perflog_item);
 }
 
+/* Format the CSV row of a log item. Streaming rows end with a column
+ * set to 1 for snapshots, 0 for the final measurement. */
+static size_t picoquic_perflog_format_row(char* row, size_t row_max, picoquic_performance_log_item_t* perflog_item,
+    int is_streaming, int is_snapshot)
+{
+    char cnxid_str[513];
+    size_t length = 0;
+    size_t nb_chars = 0;
+    int ret = 0;
+
+    /* Print version identifiers */
+    ret = picoquic_sprintf(row, row_max, &nb_chars, "%d, %s, ", PICOQUIC_PER_LOG_VERSION, PICOQUIC_VERSION);
+    length += nb_chars;
+    /* Print the key performance data */
+    if (ret == 0) {
+        ret = picoquic_sprintf(row + length, row_max - length, &nb_chars, "%f, %" PRIu64 ", %" PRIu64 ", %f, %f",
+            perflog_item->duration_sec,
+            perflog_item->data_sent,
+            perflog_item->data_received,
+            perflog_item->send_mbps,
+            perflog_item->recv_mbps);
+        length += nb_chars;
+    }
+    /* TODO: nb streams.
+    printf("Nb_transactions: %" PRIu64"\n", quicperf_ctx->nb_streams);
+    printf("TPS: %f\n", ((double)quicperf_ctx->nb_streams) / duration_sec);
+    */
+    /* Print identification data */
+    if (ret == 0) {
+        if (picoquic_print_connection_id_hexa(cnxid_str, sizeof(cnxid_str), &perflog_item->cnxid) != 0) {
+            cnxid_str[0] = 0;
+        }
+        ret = picoquic_sprintf(row + length, row_max - length, &nb_chars, ", 0x%x, %s, 0x%s, %" PRIu64,
+            perflog_item->quic_version,
+            (perflog_item->alpn == NULL) ? "" : perflog_item->alpn,
+            cnxid_str, perflog_item->cnx_time_64);
+        length += nb_chars;
+    }
+
+    /* Print the additional values */
+    for (size_t i = 0; ret == 0 && i < perflog_item->nb_values; i++) {
+        ret = picoquic_sprintf(row + length, row_max - length, &nb_chars, ", %"PRIu64, perflog_item->v[i]);
+        length += nb_chars;
+    }
+    if (ret == 0 && is_streaming) {
+        ret = picoquic_sprintf(row + length, row_max - length, &nb_chars, ", %d", is_snapshot);
+        length += nb_chars;
+    }
+    if (ret == 0) {
+        ret = picoquic_sprintf(row + length, row_max - length, &nb_chars, "\n");
+        length += nb_chars;
+    }
+
+    return (ret == 0) ? length : 0;
+}
+
 int picoquic_perflog_save(picoquic_performance_log_ctx_t* perflog_ctx)
 {
     int ret = 0;
@@ -84,39 +181,17 @@ int picoquic_perflog_save(picoquic_performance_log_ctx_t* perflog_ctx)
     }
     else {
         while (perflog_ctx->first != NULL) {
-            char cnxid_str[513];
+            char row[PICOQUIC_PERFLOG_ROW_MAX];
+            size_t row_length;
             picoquic_performance_log_item_t* perflog_item = perflog_ctx->first;
             perflog_ctx->first = perflog_item->next;
             if (perflog_ctx->first == NULL) {
                 perflog_ctx->last = NULL;
             }
-            /* Print version identifiers */
-            fprintf(F, "%d, %s, ", PICOQUIC_PER_LOG_VERSION, PICOQUIC_VERSION);
-            /* Print the key performance data */
-            fprintf(F, "%f, %" PRIu64 ", %" PRIu64 ", %f, %f",
-                perflog_item->duration_sec,
-                perflog_item->data_sent,
-                perflog_item->data_received,
-                perflog_item->send_mbps,
-                perflog_item->recv_mbps);
-            /* TODO: nb streams.
-            printf("Nb_transactions: %" PRIu64"\n", quicperf_ctx->nb_streams);
-            printf("TPS: %f\n", ((double)quicperf_ctx->nb_streams) / duration_sec);
-            */
-            /* Print identification data */
-            if (picoquic_print_connection_id_hexa(cnxid_str, sizeof(cnxid_str), &perflog_item->cnxid) != 0) {
-                cnxid_str[0] = 0;
-            }
-            fprintf(F, ", 0x%x, %s, 0x%s, %" PRIu64,
-                perflog_item->quic_version,
-                (perflog_item->alpn == NULL) ? "" : perflog_item->alpn,
-                cnxid_str, perflog_item->cnx_time_64);
-
-            /* Print the additional values */
-            for (size_t i = 0; i < perflog_item->nb_values; i++) {
-                fprintf(F, ", %"PRIu64, perflog_item->v[i]);
+            row_length = picoquic_perflog_format_row(row, sizeof(row), perflog_item, 0, 0);
+            if (row_length > 0) {
+                (void)fwrite(row, 1, row_length, F);
             }
-            fprintf(F, "\n");
             picoquic_perflog_item_free(perflog_item);
         }
         (void)picoquic_file_close(F);
@@ -124,72 +199,133 @@ int picoquic_perflog_save(picoquic_performance_log_ctx_t* perflog_ctx)
     return ret;
 }
 
+/* Fill the measurements of a log item, except for the ALPN, which is
+ * either copied or referenced by the caller. */
+static void picoquic_perflog_fill_item(picoquic_cnx_t* cnx, picoquic_performance_log_item_t* perflog_item, uint64_t current_time)
+{
+    uint64_t start_time = picoquic_get_cnx_start_time(cnx);
+    uint64_t duration_usec = current_time - start_time;
+
+    memset(perflog_item, 0, sizeof(picoquic_performance_log_item_t));
+    /* Compute the key performance metrics */
+    perflog_item->duration_sec = ((double)duration_usec) / 1000000.0;
+    if (perflog_item->duration_sec > 0) {
+        perflog_item->data_sent = picoquic_get_data_sent(cnx);
+        perflog_item->data_received = picoquic_get_data_received(cnx);
+        perflog_item->send_mbps = ((double)perflog_item->data_sent) * 8.0 / ((double)duration_usec);
+        perflog_item->recv_mbps = ((double)perflog_item->data_received) * 8.0 / ((double)duration_usec);
+        /* TODO: nb streams.
+        printf("Nb_transactions: %" PRIu64"\n", quicperf_ctx->nb_streams);
+        printf("TPS: %f\n", ((double)quicperf_ctx->nb_streams) / duration_sec);
+        */
+    }
+    /* Store identification data */
+    perflog_item->quic_version = (cnx->version_index >= 0) ?
+        picoquic_supported_versions[cnx->version_index].version : 0;
+    perflog_item->cnxid = picoquic_get_logging_cnxid(cnx);
+    perflog_item->cnx_time_64 = start_time;
+    /* Store additional parameters */
+    perflog_item->nb_values = PICOQUIC_PERF_LOG_MAX_ITEMS;
+    perflog_item->v[picoquic_perflog_is_client] = cnx->client_mode;
+    perflog_item->v[picoquic_perflog_nb_packets_received] = cnx->nb_packets_received;
+    perflog_item->v[picoquic_perflog_nb_trains_sent] = cnx->nb_trains_sent;
+    perflog_item->v[picoquic_perflog_nb_trains_short] = cnx->nb_trains_short;
+    perflog_item->v[picoquic_perflog_nb_trains_blocked_cwin] = cnx->nb_trains_blocked_cwin;
+    perflog_item->v[picoquic_perflog_nb_trains_blocked_pacing] = cnx->nb_trains_blocked_pacing;
+    perflog_item->v[picoquic_perflog_nb_trains_blocked_others] = cnx->nb_trains_blocked_others;
+    perflog_item->v[picoquic_perflog_nb_packets_sent] = cnx->nb_packets_sent;
+    perflog_item->v[picoquic_perflog_nb_retransmission_total] = cnx->nb_retransmission_total;
+    perflog_item->v[picoquic_perflog_nb_spurious] = cnx->nb_spurious;
+    perflog_item->v[picoquic_perflog_delayed_ack_option] = cnx->is_ack_frequency_negotiated;
+    perflog_item->v[picoquic_perflog_min_ack_delay_remote] = cnx->min_ack_delay_remote;
+    perflog_item->v[picoquic_perflog_max_ack_delay_remote] = cnx->max_ack_delay_remote;
+    perflog_item->v[picoquic_perflog_max_ack_gap_remote] = cnx->max_ack_gap_remote;
+    perflog_item->v[picoquic_perflog_min_ack_delay_local] = cnx->min_ack_delay_local;
+    perflog_item->v[picoquic_perflog_max_ack_delay_local] = cnx->max_ack_delay_local;
+    perflog_item->v[picoquic_perflog_max_ack_gap_local] = cnx->max_ack_gap_local;
+    perflog_item->v[picoquic_perflog_max_mtu_sent] = cnx->max_mtu_sent;
+    perflog_item->v[picoquic_perflog_max_mtu_received] = cnx->max_mtu_received;
+    perflog_item->v[picoquic_perflog_zero_rtt] = (cnx->nb_zero_rtt_received > 0) || (cnx->nb_zero_rtt_acked > 0);
+    if (cnx->path != NULL && cnx->path[0] != NULL) {
+        perflog_item->v[picoquic_perflog_srtt] = cnx->path[0]->smoothed_rtt;
+        perflog_item->v[picoquic_perflog_minrtt] = cnx->path[0]->rtt_min;
+        perflog_item->v[picoquic_perflog_cwin] = cnx->path[0]->cwin;
+        perflog_item->v[picoquic_perflog_bwe_max] = cnx->path[0]->bandwidth_estimate_max;
+        perflog_item->v[picoquic_perflog_pacing_quantum_max] = cnx->path[0]->pacing_quantum_max;
+        perflog_item->v[picoquic_perflog_pacing_rate] = cnx->path[0]->pacing_rate_max;
+    }
+    if (cnx->congestion_alg != NULL) {
+        perflog_item->v[picoquic_perflog_ccalgo] = cnx->congestion_alg->congestion_algorithm_number;
+    }
+}
+
+/* Streaming mode: append the row to the fill buffer of the writer. */
+static int picoquic_perflog_stream_push(picoquic_perflog_stream_t* stream, const char* row, size_t row_length)
+{
+    int ret = 0;
+    int should_signal = 0;
+
+    (void)picoquic_lock_mutex(&stream->mutex);
+    if (stream->fill_length + row_length > stream->buffer_size) {
+        stream->nb_dropped++;
+        should_signal = 1;
+        ret = -1;
+    }
+    else {
+        memcpy(stream->fill_buffer + stream->fill_length, row, row_length);
+        stream->fill_length += row_length;
+        stream->nb_rows++;
+        should_signal = (2 * stream->fill_length > stream->buffer_size);
+    }
+    (void)picoquic_unlock_mutex(&stream->mutex);
+
+    if (should_signal) {
+        (void)picoquic_signal_event(&stream->event);
+    }
+
+    return ret;
+}
+
+static int picoquic_perflog_stream_record(picoquic_cnx_t* cnx, picoquic_perflog_stream_t* stream,
+    uint64_t current_time, int is_snapshot)
+{
+    int ret = 0;
+    char row[PICOQUIC_PERFLOG_ROW_MAX];
+    size_t row_length;
+    picoquic_performance_log_item_t perflog_item;
+
+    picoquic_perflog_fill_item(cnx, &perflog_item, current_time);
+    /* The row is formatted before returning, so the ALPN does not need to be copied */
+    perflog_item.alpn = (char*)cnx->alpn;
+    row_length = picoquic_perflog_format_row(row, sizeof(row), &perflog_item, 1, is_snapshot);
+    if (row_length == 0) {
+        ret = -1;
+    }
+    else {
+        ret = picoquic_perflog_stream_push(stream, row, row_length);
+    }
+
+    return ret;
+}
+
 int picoquic_perflog_record(picoquic_cnx_t* cnx, picoquic_performance_log_ctx_t* perflog_ctx)
 {
     int ret = 0;
-    picoquic_performance_log_item_t* perflog_item = (picoquic_performance_log_item_t*)
-        malloc(sizeof(picoquic_performance_log_item_t));
+    picoquic_performance_log_item_t* perflog_item;
+
+    if (perflog_ctx->stream != NULL) {
+        return picoquic_perflog_stream_record(cnx, perflog_ctx->stream, picoquic_get_quic_time(cnx->quic), 0);
+    }
+
+    perflog_item = (picoquic_performance_log_item_t*)malloc(sizeof(picoquic_performance_log_item_t));
 
     if (perflog_item == NULL) {
         ret = -1;
     }
     else {
-        uint64_t start_time = picoquic_get_cnx_start_time(cnx);
-        uint64_t close_time = picoquic_get_quic_time(cnx->quic);
-        uint64_t duration_usec = close_time - start_time;
-        memset(perflog_item, 0, sizeof(picoquic_performance_log_item_t));
-        /* Compute the key performance metrics */
-        perflog_item->duration_sec = ((double)duration_usec) / 1000000.0;
-        if (perflog_item->duration_sec > 0) {
-            perflog_item->data_sent = picoquic_get_data_sent(cnx);
-            perflog_item->data_received = picoquic_get_data_received(cnx);
-            perflog_item->send_mbps = ((double)perflog_item->data_sent) * 8.0 / ((double)duration_usec);
-            perflog_item->recv_mbps = ((double)perflog_item->data_received) * 8.0 / ((double)duration_usec);
-            /* TODO: nb streams.
-            printf("Nb_transactions: %" PRIu64"\n", quicperf_ctx->nb_streams);
-            printf("TPS: %f\n", ((double)quicperf_ctx->nb_streams) / duration_sec);
-            */
-        }
-        /* Store identification data */
+        picoquic_perflog_fill_item(cnx, perflog_item, picoquic_get_quic_time(cnx->quic));
         perflog_item->alpn = picoquic_string_duplicate(cnx->alpn);
-        perflog_item->quic_version = (cnx->version_index >= 0) ?
-            picoquic_supported_versions[cnx->version_index].version : 0;
-        perflog_item->cnxid = picoquic_get_logging_cnxid(cnx);
-        perflog_item->cnx_time_64 = start_time;
-        /* Store additional parameters */
-        perflog_item->nb_values = PICOQUIC_PERF_LOG_MAX_ITEMS;
-        perflog_item->v[picoquic_perflog_is_client] = cnx->client_mode;
-        perflog_item->v[picoquic_perflog_nb_packets_received] = cnx->nb_packets_received;
-        perflog_item->v[picoquic_perflog_nb_trains_sent] = cnx->nb_trains_sent;
-        perflog_item->v[picoquic_perflog_nb_trains_short] = cnx->nb_trains_short;
-        perflog_item->v[picoquic_perflog_nb_trains_blocked_cwin] = cnx->nb_trains_blocked_cwin;
-        perflog_item->v[picoquic_perflog_nb_trains_blocked_pacing] = cnx->nb_trains_blocked_pacing;
-        perflog_item->v[picoquic_perflog_nb_trains_blocked_others] = cnx->nb_trains_blocked_others;
-        perflog_item->v[picoquic_perflog_nb_packets_sent] = cnx->nb_packets_sent;
-        perflog_item->v[picoquic_perflog_nb_retransmission_total] = cnx->nb_retransmission_total;
-        perflog_item->v[picoquic_perflog_nb_spurious] = cnx->nb_spurious;
-        perflog_item->v[picoquic_perflog_delayed_ack_option] = cnx->is_ack_frequency_negotiated;
-        perflog_item->v[picoquic_perflog_min_ack_delay_remote] = cnx->min_ack_delay_remote;
-        perflog_item->v[picoquic_perflog_max_ack_delay_remote] = cnx->max_ack_delay_remote;
-        perflog_item->v[picoquic_perflog_max_ack_gap_remote] = cnx->max_ack_gap_remote;
-        perflog_item->v[picoquic_perflog_min_ack_delay_local] = cnx->min_ack_delay_local;
-        perflog_item->v[picoquic_perflog_max_ack_delay_local] = cnx->max_ack_delay_local;
-        perflog_item->v[picoquic_perflog_max_ack_gap_local] = cnx->max_ack_gap_local;
-        perflog_item->v[picoquic_perflog_max_mtu_sent] = cnx->max_mtu_sent;
-        perflog_item->v[picoquic_perflog_max_mtu_received] = cnx->max_mtu_received;
-        perflog_item->v[picoquic_perflog_zero_rtt] = (cnx->nb_zero_rtt_received > 0) || (cnx->nb_zero_rtt_acked > 0);
-        if (cnx->path != NULL && cnx->path[0] != NULL) {
-            perflog_item->v[picoquic_perflog_srtt] = cnx->path[0]->smoothed_rtt;
-            perflog_item->v[picoquic_perflog_minrtt] = cnx->path[0]->rtt_min;
-            perflog_item->v[picoquic_perflog_cwin] = cnx->path[0]->cwin;
-            perflog_item->v[picoquic_perflog_bwe_max] = cnx->path[0]->bandwidth_estimate_max;
-            perflog_item->v[picoquic_perflog_pacing_quantum_max] = cnx->path[0]->pacing_quantum_max;
-            perflog_item->v[picoquic_perflog_pacing_rate] = cnx->path[0]->pacing_rate_max;
-        }
-        if (cnx->congestion_alg != NULL) {
-            perflog_item->v[picoquic_perflog_ccalgo] = cnx->congestion_alg->congestion_algorithm_number;
-        }
-        
+
         if (perflog_ctx->first == NULL) {
             perflog_ctx->first = perflog_item;
         }
@@ -199,6 +335,7 @@ int picoquic_perflog_record(picoquic_cnx_t* cnx, picoquic_performance_log_ctx_t*
         }
         else {
             perflog_ctx->last->next = perflog_item;
+            perflog_ctx->last = perflog_item;
         }
 
         if (cnx->quic->cnx_list == cnx && cnx->quic->cnx_last == cnx) {
@@ -209,8 +346,289 @@ int picoquic_perflog_record(picoquic_cnx_t* cnx, picoquic_performance_log_ctx_t*
     return ret;
 }
 
+/* Mid-connection snapshot, called from the packet loop. The first call
+ * only programs the time of the first snapshot. */
+static void picoquic_perflog_snapshot(picoquic_cnx_t* cnx, uint64_t current_time)
+{
+    picoquic_performance_log_ctx_t* perflog_ctx = (picoquic_performance_log_ctx_t*)cnx->quic->v_perflog_ctx;
+
+    if (perflog_ctx != NULL && perflog_ctx->stream != NULL && perflog_ctx->snapshot_interval > 0) {
+        if (cnx->next_perflog_snapshot_time != 0 &&
+            cnx->cnx_state >= picoquic_state_client_ready_start && cnx->cnx_state < picoquic_state_disconnecting) {
+            (void)picoquic_perflog_stream_record(cnx, perflog_ctx->stream, current_time, 1);
+        }
+        cnx->next_perflog_snapshot_time = current_time + perflog_ctx->snapshot_interval;
+    }
+    else {
+        cnx->next_perflog_snapshot_time = UINT64_MAX;
+    }
+}
+
+/* Write the CSV header. Returns the number of bytes written. */
+static size_t picoquic_perflog_write_header(FILE* F, int is_streaming)
+{
+    int nb_written = 0;
+    int ret;
+
+    ret = fprintf(F, "Log_v, PQ_v, Duration, Sent, Received, Mpbs_S, Mbps_R");
+    nb_written += (ret > 0) ? ret : 0;
+    ret = fprintf(F, ", QUIC_v, ALPN, CNX_ID, T64");
+    nb_written += (ret > 0) ? ret : 0;
+    /* Print the additional values */
+    for (size_t i = 0; i < PICOQUIC_PERF_LOG_MAX_ITEMS; i++) {
+        char buf[16];
+        char const* s = picoquic_perflog_param_name((picoquic_perflog_column_enum)i);
+        if (s == NULL) {
+            (void)picoquic_sprintf(buf, sizeof(buf), NULL, "v%zu", i);
+            s = buf;
+        }
+        ret = fprintf(F, ", %s", s);
+        nb_written += (ret > 0) ? ret : 0;
+    }
+    if (is_streaming) {
+        ret = fprintf(F, ", snapshot");
+        nb_written += (ret > 0) ? ret : 0;
+    }
+    ret = fprintf(F, "\n");
+    nb_written += (ret > 0) ? ret : 0;
+
+    return (size_t)nb_written;
+}
+
+/* Streaming writer. The file is opened in append mode, and the header is
+ * added if the file is empty. */
+static int picoquic_perflog_stream_open(picoquic_perflog_stream_t* stream)
+{
+    int ret = 0;
+
+    if ((stream->F = picoquic_file_open(stream->file_name, "a")) == NULL) {
+        ret = -1;
+    }
+    else {
+        long sz;
+
+        fseek(stream->F, 0, SEEK_END);
+        sz = ftell(stream->F);
+        stream->file_size = (sz > 0) ? (uint64_t)sz : 0;
+        stream->header_size = 0;
+        if (stream->file_size == 0) {
+            stream->header_size = picoquic_perflog_write_header(stream->F, 1);
+            stream->file_size = stream->header_size;
+            stream->is_sync_needed = 1;
+        }
+    }
+
+    return ret;
+}
+
+static void picoquic_perflog_stream_sync(picoquic_perflog_stream_t* stream)
+{
+    if (stream->F != NULL && stream->is_sync_needed) {
+        (void)fflush(stream->F);
+#ifdef _WINDOWS
+        (void)_commit(_fileno(stream->F));
+#else
+        (void)fsync(fileno(stream->F));
+#endif
+        stream->is_sync_needed = 0;
+    }
+    stream->last_sync_time = picoquic_current_time();
+}
+
+/* Close the current file, rename it to the first free name in the series
+ * <name>.1, <name>.2, etc., and start a new file. */
+static int picoquic_perflog_stream_rotate(picoquic_perflog_stream_t* stream)
+{
+    int ret = 0;
+    char rotated_name[512];
+
+    picoquic_perflog_stream_sync(stream);
+    stream->F = picoquic_file_close(stream->F);
+
+    do {
+        FILE* F;
+
+        stream->rotation_index++;
+        if (picoquic_sprintf(rotated_name, sizeof(rotated_name), NULL, "%s.%d", stream->file_name, stream->rotation_index) != 0) {
+            ret = -1;
+        }
+        else if ((F = picoquic_file_open(rotated_name, "r")) != NULL) {
+            /* Do not overwrite the files of a previous run */
+            (void)picoquic_file_close(F);
+            continue;
+        }
+        break;
+    } while (ret == 0);
+
+    if (ret == 0 && rename(stream->file_name, rotated_name) != 0) {
+        DBG_PRINTF("Cannot rename %s to %s\n", stream->file_name, rotated_name);
+        ret = -1;
+    }
+
+    if (picoquic_perflog_stream_open(stream) != 0) {
+        ret = -1;
+    }
+
+    return ret;
+}
+
+/* Write the buffered rows. The file is rotated between rows, so that each
+ * file starts with a header and stays below the maximum size, unless a
+ * single row is larger. */
+static void picoquic_perflog_stream_write(picoquic_perflog_stream_t* stream, const char* data, size_t length)
+{
+    if (stream->F == NULL) {
+        (void)picoquic_perflog_stream_open(stream);
+    }
+
+    while (stream->F != NULL && length > 0) {
+        size_t chunk = length;
+
+        if (stream->max_file_size > 0 && stream->file_size + length > stream->max_file_size) {
+            size_t available = (stream->max_file_size > stream->file_size) ? (size_t)(stream->max_file_size - stream->file_size) : 0;
+
+            chunk = 0;
+            for (size_t i = 0; i < length && i < available; i++) {
+                if (data[i] == '\n') {
+                    chunk = i + 1;
+                }
+            }
+            if (chunk == 0) {
+                if (stream->file_size > stream->header_size) {
+                    (void)picoquic_perflog_stream_rotate(stream);
+                    continue;
+                }
+                /* The row does not fit in an empty file */
+                while (chunk < length && data[chunk] != '\n') {
+                    chunk++;
+                }
+                if (chunk < length) {
+                    chunk++;
+                }
+            }
+        }
+
+        if (fwrite(data, 1, chunk, stream->F) == chunk) {
+            stream->file_size += chunk;
+        }
+        stream->is_sync_needed = 1;
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+static picoquic_thread_return_t picoquic_perflog_stream_writer(void* v_stream)
+{
+    picoquic_perflog_stream_t* stream = (picoquic_perflog_stream_t*)v_stream;
+    size_t length = 0;
+    int is_stopping = 0;
+
+    do {
+        (void)picoquic_lock_mutex(&stream->mutex);
+        length = stream->fill_length;
+        if (length > 0) {
+            char* x = stream->write_buffer;
+            stream->write_buffer = stream->fill_buffer;
+            stream->fill_buffer = x;
+            stream->fill_length = 0;
+        }
+        is_stopping = stream->should_stop;
+        (void)picoquic_unlock_mutex(&stream->mutex);
+
+        if (length > 0) {
+            picoquic_perflog_stream_write(stream, stream->write_buffer, length);
+        }
+        else if (!is_stopping) {
+            (void)picoquic_wait_for_event(&stream->event, PICOQUIC_PERFLOG_FLUSH_INTERVAL);
+        }
+
+        if (stream->fsync_interval > 0 && picoquic_current_time() >= stream->last_sync_time + stream->fsync_interval) {
+            picoquic_perflog_stream_sync(stream);
+        }
+    } while (length > 0 || !is_stopping);
+
+    if (stream->F != NULL) {
+        picoquic_perflog_stream_sync(stream);
+        stream->F = picoquic_file_close(stream->F);
+    }
+
+    picoquic_thread_do_return;
+}
+
+static void picoquic_perflog_stream_free(picoquic_perflog_stream_t* stream)
+{
+    if (stream->fill_buffer != NULL) {
+        free(stream->fill_buffer);
+    }
+    if (stream->write_buffer != NULL) {
+        free(stream->write_buffer);
+    }
+    if (stream->file_name != NULL) {
+        free((char*)stream->file_name);
+    }
+    free(stream);
+}
+
+/* Stop the writer after all buffered rows are written. */
+static void picoquic_perflog_stream_delete(picoquic_perflog_stream_t* stream)
+{
+    (void)picoquic_lock_mutex(&stream->mutex);
+    stream->should_stop = 1;
+    (void)picoquic_unlock_mutex(&stream->mutex);
+    (void)picoquic_signal_event(&stream->event);
+    (void)picoquic_wait_thread(stream->thread);
+#ifdef _WINDOWS
+    CloseHandle(stream->thread);
+#endif
+    picoquic_delete_event(&stream->event);
+    (void)picoquic_delete_mutex(&stream->mutex);
+    picoquic_perflog_stream_free(stream);
+}
+
+static picoquic_perflog_stream_t* picoquic_perflog_stream_create(char const* perflog_file_name,
+    const picoquic_perflog_stream_options_t* options)
+{
+    picoquic_perflog_stream_t* stream = (picoquic_perflog_stream_t*)malloc(sizeof(picoquic_perflog_stream_t));
+
+    if (stream != NULL) {
+        memset(stream, 0, sizeof(picoquic_perflog_stream_t));
+        stream->buffer_size = (options->buffer_size < PICOQUIC_PERFLOG_ROW_MAX) ?
+            PICOQUIC_PERFLOG_STREAM_BUFFER_SIZE : options->buffer_size;
+        stream->fsync_interval = options->fsync_interval;
+        stream->max_file_size = options->max_file_size;
+        stream->last_sync_time = picoquic_current_time();
+        if ((stream->file_name = picoquic_string_duplicate(perflog_file_name)) == NULL ||
+            (stream->fill_buffer = (char*)malloc(stream->buffer_size)) == NULL ||
+            (stream->write_buffer = (char*)malloc(stream->buffer_size)) == NULL) {
+            picoquic_perflog_stream_free(stream);
+            stream = NULL;
+        }
+        else if (picoquic_create_mutex(&stream->mutex) != 0) {
+            picoquic_perflog_stream_free(stream);
+            stream = NULL;
+        }
+        else if (picoquic_create_event(&stream->event) != 0) {
+            (void)picoquic_delete_mutex(&stream->mutex);
+            picoquic_perflog_stream_free(stream);
+            stream = NULL;
+        }
+        else if (picoquic_create_thread(&stream->thread, picoquic_perflog_stream_writer, stream) != 0) {
+            picoquic_delete_event(&stream->event);
+            (void)picoquic_delete_mutex(&stream->mutex);
+            picoquic_perflog_stream_free(stream);
+            stream = NULL;
+        }
+    }
+
+    return stream;
+}
+
 void picoquic_perflog_free(picoquic_performance_log_ctx_t* perflog_ctx)
 {
+    if (perflog_ctx->stream != NULL) {
+        picoquic_perflog_stream_delete(perflog_ctx->stream);
+        perflog_ctx->stream = NULL;
+    }
     if (perflog_ctx->perflog_file_name != NULL) {
         free((char *)perflog_ctx->perflog_file_name);
     }
@@ -235,6 +653,7 @@ int picoquic_perflog(picoquic_quic_t* quic, picoquic_cnx_t* cnx, int should_dele
         picoquic_perflog_free(perflog_ctx);
         quic->v_perflog_ctx = NULL;
         quic->perflog_fn = NULL;
+        quic->perflog_snapshot_fn = NULL;
     }
 
     return ret;
@@ -300,19 +719,7 @@ void picoquic_perflog_file_set_header(char const* perflog_file_name)
     FILE* F = picoquic_file_open(perflog_file_name, "w");
 
     if (F != NULL) {
-        fprintf(F, "Log_v, PQ_v, Duration, Sent, Received, Mpbs_S, Mbps_R");
-        fprintf(F, ", QUIC_v, ALPN, CNX_ID, T64");
-        /* Print the additional values */
-        for (size_t i = 0; i < PICOQUIC_PERF_LOG_MAX_ITEMS; i++) {
-            char buf[16];
-            char const* s = picoquic_perflog_param_name((picoquic_perflog_column_enum)i);
-            if (s == NULL) {
-                (void)picoquic_sprintf(buf, sizeof(buf), NULL, "v%zu", i);
-                s = buf;
-            }
-            fprintf(F, ", %s", s);
-        }
-        fprintf(F, "\n");
+        (void)picoquic_perflog_write_header(F, 0);
         fclose(F);
     }
 }
@@ -342,4 +749,54 @@ int picoquic_perflog_setup(picoquic_quic_t* quic, char const * perflog_file_name
         }
     }
     return ret;
-}
\ No newline at end of file
+}
+
+int picoquic_perflog_setup_streaming(picoquic_quic_t* quic, char const* perflog_file_name,
+    const picoquic_perflog_stream_options_t* options)
+{
+    int ret = 0;
+    picoquic_perflog_stream_options_t default_options;
+    picoquic_performance_log_ctx_t* perflog_ctx = (picoquic_performance_log_ctx_t*)
+        malloc(sizeof(picoquic_performance_log_ctx_t));
+
+    if (options == NULL) {
+        memset(&default_options, 0, sizeof(default_options));
+        options = &default_options;
+    }
+
+    if (perflog_ctx == NULL) {
+        ret = -1;
+    }
+    else {
+        memset(perflog_ctx, 0, sizeof(picoquic_performance_log_ctx_t));
+        perflog_ctx->snapshot_interval = options->snapshot_interval;
+        if ((perflog_ctx->stream = picoquic_perflog_stream_create(perflog_file_name, options)) == NULL) {
+            free(perflog_ctx);
+            ret = -1;
+        }
+        else {
+            /* Replace the previous performance log, if any */
+            if (quic->perflog_fn != NULL) {
+                (void)(quic->perflog_fn)(quic, NULL, 1);
+            }
+            quic->perflog_fn = picoquic_perflog;
+            quic->perflog_snapshot_fn = (perflog_ctx->snapshot_interval > 0) ? picoquic_perflog_snapshot : NULL;
+            quic->v_perflog_ctx = (void*)perflog_ctx;
+        }
+    }
+    return ret;
+}
+
+void picoquic_perflog_get_stream_stats(picoquic_quic_t* quic, uint64_t* nb_rows, uint64_t* nb_dropped)
+{
+    picoquic_performance_log_ctx_t* perflog_ctx = (picoquic_performance_log_ctx_t*)quic->v_perflog_ctx;
+
+    *nb_rows = 0;
+    *nb_dropped = 0;
+    if (perflog_ctx != NULL && perflog_ctx->stream != NULL) {
+        (void)picoquic_lock_mutex(&perflog_ctx->stream->mutex);
+        *nb_rows = perflog_ctx->stream->nb_rows;
+        *nb_dropped = perflog_ctx->stream->nb_dropped;
+        (void)picoquic_unlock_mutex(&perflog_ctx->stream->mutex);
+    }
+}
@@ -62,6 +62,36 @@ const char* picoquic_perflog_param_name(picoquic_perflog_column_enum rank);
 
 int picoquic_perflog_setup(picoquic_quic_t* quic, char const* perflog_file_name);
 
+/* Streaming performance log. Instead of being kept in memory until all
+ * connections are closed, the rows are appended to a buffer when each
+ * connection ends, and written to the file by a writer thread. Rows are
+ * dropped if the buffer is full.
+ * - buffer_size: size of the row buffer, default PICOQUIC_PERFLOG_STREAM_BUFFER_SIZE.
+ * - fsync_interval: interval between syncs of the file to disk, in
+ *   microseconds, or 0 to only sync when the log is closed.
+ * - max_file_size: when the file would grow past that size, it is renamed to
+ *   <name>.1, <name>.2, etc., and a new file is started. 0 disables rotation.
+ * - snapshot_interval: if not 0, a row is also written for each active
+ *   connection at that interval, in microseconds of the QUIC context time,
+ *   when the connection next prepares packets.
+ * Streaming rows have an additional "snapshot" column, set to 1 for the
+ * mid-connection snapshots and 0 for the final rows.
+ */
+#define PICOQUIC_PERFLOG_STREAM_BUFFER_SIZE 0x10000
+#define PICOQUIC_PERFLOG_ROW_MAX 2048
+#define PICOQUIC_PERFLOG_FLUSH_INTERVAL 100000
+
+typedef struct st_picoquic_perflog_stream_options_t {
+    size_t buffer_size;
+    uint64_t fsync_interval;
+    uint64_t max_file_size;
+    uint64_t snapshot_interval;
+} picoquic_perflog_stream_options_t;
+
+int picoquic_perflog_setup_streaming(picoquic_quic_t* quic, char const* perflog_file_name,
+    const picoquic_perflog_stream_options_t* options);
+void picoquic_perflog_get_stream_stats(picoquic_quic_t* quic, uint64_t* nb_rows, uint64_t* nb_dropped);
+
 #ifdef __cplusplus
 }
 #endif
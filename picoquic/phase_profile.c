@@ -0,0 +1,105 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string.h>
+#include <inttypes.h>
+#include "picoquic_internal.h"
+#include "picoquic_profile.h"
+#ifdef _WINDOWS
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+int picoquic_phase_profile_is_enabled(void)
+{
+#ifdef PICOQUIC_WITH_PHASE_PROFILE
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+const char* picoquic_phase_profile_unit(void)
+{
+#ifdef PICOQUIC_PHASE_TICKS_ARE_NS
+    return "ns";
+#else
+    return "cycles";
+#endif
+}
+
+const char* picoquic_phase_name(picoquic_phase_enum phase)
+{
+    switch (phase) {
+    case picoquic_phase_header_parse: return "header_parse";
+    case picoquic_phase_decrypt: return "decrypt";
+    case picoquic_phase_frame_decode: return "frame_decode";
+    case picoquic_phase_ack_processing: return "ack_processing";
+    case picoquic_phase_cc_update: return "cc_update";
+    case picoquic_phase_packet_format: return "packet_format";
+    case picoquic_phase_encrypt: return "encrypt";
+    case picoquic_phase_socket_recv: return "socket_recv";
+    case picoquic_phase_socket_send: return "socket_send";
+    default: return "unknown";
+    }
+}
+
+void picoquic_get_phase_stats(picoquic_quic_t* quic, picoquic_phase_stats_t* stats)
+{
+    *stats = quic->phase_stats;
+}
+
+void picoquic_reset_phase_stats(picoquic_quic_t* quic)
+{
+    memset(&quic->phase_stats, 0, sizeof(picoquic_phase_stats_t));
+}
+
+void picoquic_phase_stats_print(FILE* F, const picoquic_phase_stats_t* stats)
+{
+    const char* unit = picoquic_phase_profile_unit();
+
+    fprintf(F, "%-16s %12s %16s %12s\n", "phase", "calls", unit, "per call");
+    for (int i = 0; i < picoquic_phase_max; i++) {
+        fprintf(F, "%-16s %12" PRIu64 " %16" PRIu64 " %12" PRIu64 "\n",
+            picoquic_phase_name((picoquic_phase_enum)i), stats->calls[i], stats->ticks[i],
+            (stats->calls[i] == 0) ? 0 : stats->ticks[i] / stats->calls[i]);
+    }
+}
+
+uint64_t picoquic_phase_clock_ns(void)
+{
+#ifdef _WINDOWS
+    static LARGE_INTEGER frequency = { 0 };
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0) {
+        (void)QueryPerformanceFrequency(&frequency);
+    }
+    (void)QueryPerformanceCounter(&counter);
+    return (uint64_t)((double)counter.QuadPart * 1000000000.0 / (double)frequency.QuadPart);
+#else
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec) * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
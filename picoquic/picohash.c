@@ -169,6 +169,37 @@ void picohash_delete(picohash_table* hash_table, int delete_key_too)
     free(hash_table);
 }
 
+/* Move all the items to a new array of nb_bin bins. If the allocation
+ * fails, the table is left unchanged and an error is returned.
+ */
+int picohash_resize(picohash_table* hash_table, size_t nb_bin)
+{
+    int ret = 0;
+    picohash_item** hash_bin = NULL;
+
+    if (nb_bin == 0 || (hash_bin = (picohash_item**)malloc(sizeof(picohash_item*) * nb_bin)) == NULL) {
+        ret = -1;
+    } else {
+        (void)memset(hash_bin, 0, sizeof(picohash_item*) * nb_bin);
+        for (size_t i = 0; i < hash_table->nb_bin; i++) {
+            picohash_item* item = hash_table->hash_bin[i];
+            while (item != NULL) {
+                picohash_item* next = item->next_in_bin;
+                uint32_t bin = (uint32_t)(item->hash % nb_bin);
+
+                item->next_in_bin = hash_bin[bin];
+                hash_bin[bin] = item;
+                item = next;
+            }
+        }
+        free(hash_table->hash_bin);
+        hash_table->hash_bin = hash_bin;
+        hash_table->nb_bin = nb_bin;
+    }
+
+    return ret;
+}
+
 uint64_t picohash_hash_mix(uint64_t hash, uint64_t h2)
 {
     h2 ^= (hash << 17) ^ (hash >> 37);
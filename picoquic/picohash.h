@@ -68,6 +68,8 @@ void picohash_delete_key(picohash_table* hash_table, void* key, int delete_key_t
 
 void picohash_delete(picohash_table* hash_table, int delete_key_too);
 
+int picohash_resize(picohash_table* hash_table, size_t nb_bin);
+
 uint64_t picohash_hash_mix(uint64_t hash, uint64_t h2);
 
 uint64_t picohash_bytes(const uint8_t* key, uint32_t length);
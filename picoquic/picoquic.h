@@ -519,6 +519,33 @@ picoquic_quic_t* picoquic_create(uint32_t max_nb_connections,
 
 void picoquic_free(picoquic_quic_t* quic);
 
+/* Shared TLS master context.
+ * Loading certificates and keys and building the certificate verifier is
+ * done once, in picoquic_tls_master_create(). Additional QUIC contexts,
+ * e.g., one per core, are then created with picoquic_create_with_tls_master(),
+ * which reuses the certificate chain, the signer and the verifier without
+ * copying them. Each context derives its own ticket AEAD contexts from the
+ * shared ticket key, so tickets and tokens issued by one context are accepted
+ * by the others while each context can run in its own thread.
+ * The master context is immutable and reference counted. The creator holds
+ * one reference, and each QUIC context holds another, released in picoquic_free().
+ */
+typedef struct st_picoquic_tls_master_t picoquic_tls_master_t;
+picoquic_tls_master_t* picoquic_tls_master_create(char const* cert_file_name, char const* key_file_name,
+    char const* cert_root_file_name, const uint8_t* ticket_encryption_key, size_t ticket_encryption_key_length);
+void picoquic_tls_master_release(picoquic_tls_master_t* master);
+picoquic_quic_t* picoquic_create_with_tls_master(picoquic_tls_master_t* master,
+    uint32_t max_nb_connections,
+    char const* default_alpn,
+    picoquic_stream_data_cb_fn default_callback_fn,
+    void* default_callback_ctx,
+    picoquic_connection_id_cb_fn cnx_id_callback,
+    void* cnx_id_callback_data,
+    uint8_t reset_seed[PICOQUIC_RESET_SECRET_SIZE],
+    uint64_t current_time,
+    uint64_t* p_simulated_time,
+    char const* ticket_file_name);
+
 /* Preference for low memory options.
  * setting this flag instructs picoquic to chose implementations of algorithms 
  * that use less memory while maintaining reasonable performance. For example,
@@ -691,6 +718,40 @@ int picoquic_load_retry_tokens(picoquic_quic_t* quic, char const* token_store_fi
 int picoquic_save_session_tickets(picoquic_quic_t* quic, char const* ticket_store_filename);
 int picoquic_save_retry_tokens(picoquic_quic_t* quic, char const* token_store_filename);
 
+/* Set the maximum number of retry tokens kept in the token store.
+ * When the store is full, the tokens closest to expiry are evicted first.
+ * Default is PICOQUIC_DEFAULT_MAX_STORED_TOKENS (1024). Setting 0 removes the limit.
+ */
+void picoquic_set_max_stored_tokens(picoquic_quic_t* quic, size_t max_stored_tokens);
+size_t picoquic_get_nb_stored_tokens(picoquic_quic_t* quic);
+
+/* Shared registry of issued session tickets, token reuse detection and
+ * ticket/retry token secret, for servers running several QUIC contexts,
+ * e.g., one per core. The registry is thread safe: each context attached
+ * to it can run in its own thread. Session tickets and tokens issued by
+ * one context are accepted by the others, and the 0-RTT anti-replay
+ * check is performed across all of them.
+ *
+ * - max_tickets, max_tokens: bounds on the number of issued tickets and
+ *   registered tokens kept in memory. When the bound is reached, the
+ *   oldest tickets are evicted first. Registered tokens are only removed
+ *   when they expire: while the token registry is full, new tokens are
+ *   rejected, and the clients are asked to validate their address again.
+ * - ticket_lifetime: issued tickets older than this (microseconds) are evicted.
+ *   Zero means no time-based eviction, tickets are only evicted by max_tickets.
+ * - secret: key material for the ticket and token AEAD contexts. If NULL,
+ *   a random secret is created when the first context is attached.
+ *
+ * The registry is reference counted. The creator holds one reference, and
+ * each attached context holds another, released in picoquic_free().
+ * The registry must be attached before any connection is created.
+ */
+typedef struct st_picoquic_shared_registry_t picoquic_shared_registry_t;
+picoquic_shared_registry_t* picoquic_shared_registry_create(size_t max_tickets, size_t max_tokens,
+    uint64_t ticket_lifetime, const uint8_t* secret, size_t secret_length);
+void picoquic_shared_registry_release(picoquic_shared_registry_t* registry);
+int picoquic_attach_shared_registry(picoquic_quic_t* quic, picoquic_shared_registry_t* registry);
+
 /* Manage bdps */
 void picoquic_set_default_bdp_frame_option(picoquic_quic_t* quic, int enable_bdp_frame);
 
@@ -33,6 +33,30 @@
 extern "C" {
 #endif
 
+/* Version numbers in the binary log file header. Log segments hold the
+ * events of several connections, followed by an index and a trailer of
+ * PICOQUIC_BINLOG_TRAILER_SIZE bytes. */
+#define PICOQUIC_BINLOG_VERSION 0x01
+#define PICOQUIC_BINLOG_VERSION_SEGMENT 0x02
+#define PICOQUIC_BINLOG_VERSION_COMPACT 0x03
+#define PICOQUIC_BINLOG_VERSION_COMPACT_SEGMENT 0x04
+#define PICOQUIC_BINLOG_TRAILER_SIZE 16
+#define PICOQUIC_BINLOG_RECORD_MAX (2*PICOQUIC_MAX_PACKET_SIZE + 512)
+#define PICOQUIC_BINLOG_IS_COMPACT(version) ((version) == PICOQUIC_BINLOG_VERSION_COMPACT || (version) == PICOQUIC_BINLOG_VERSION_COMPACT_SEGMENT)
+
+/* State of the compact record encoder, kept per connection and per file */
+#define PICOQUIC_BINLOG_COMPACT_ADDR_MAX 8
+#define PICOQUIC_BINLOG_COMPACT_ADDR_SIZE 24
+
+typedef struct st_picoquic_binlog_compact_t {
+    uint64_t connection_number;
+    uint64_t last_time;
+    int is_cid_sent;
+    size_t nb_addr;
+    size_t addr_length[PICOQUIC_BINLOG_COMPACT_ADDR_MAX];
+    uint8_t addr[PICOQUIC_BINLOG_COMPACT_ADDR_MAX][PICOQUIC_BINLOG_COMPACT_ADDR_SIZE];
+} picoquic_binlog_compact_t;
+
 typedef enum {
     picoquic_log_event_pdu_sent = 0x0002,
     picoquic_log_event_pdu_recv = 0x0003,
@@ -112,6 +136,84 @@ int picoquic_set_binlog(picoquic_quic_t* quic, char const* binlog_dir);
 /* Enable binary logs, e.g. if autoqlog is requests */
 void picoquic_enable_binlog(picoquic_quic_t* quic);
 
+/* Write binary logs through a ring buffer drained by a writer thread.
+ * The packet loop thread serializes each log event into the ring, without
+ * locks or system calls, and the writer thread opens the per connection
+ * log files and writes them. Events are dropped if the ring is full.
+ * The ring size is rounded up to a power of 2, with a minimum of 64KB.
+ * This must be set before connections are created. Setting a size of 0
+ * stops the writer after all queued events are written.
+ */
+int picoquic_set_binlog_ring(picoquic_quic_t* quic, size_t ring_size);
+void picoquic_get_binlog_ring_stats(picoquic_quic_t* quic, uint64_t* nb_records, uint64_t* nb_dropped);
+
+/* Write the binary logs of all connections in a single file, instead of
+ * one file per connection, so that logging all connections only requires
+ * one file descriptor. The file is closed and a new segment is started
+ * when it grows past max_segment_size, e.g., binlog.0.log, binlog.1.log,
+ * etc. in the binary log folder. Each segment ends with an index of the
+ * records of each connection, which the log readers use to find the
+ * events of a connection without reading the whole file.
+ * This must be set before connections are created, and takes precedence
+ * over the log ring. The automatic qlog conversion is not performed for
+ * connections logged in segments. Setting a size of 0 closes the current
+ * segment and returns to per connection logs.
+ */
+int picoquic_set_binlog_segments(picoquic_quic_t* quic, uint64_t max_segment_size);
+
+/* Write the binary logs in the compact format, in which the CID is only
+ * written in the first event of a connection, the event times are coded as
+ * differences with the previous event, and the addresses of the PDU events
+ * refer to a per connection dictionary. The compact logs are read by the
+ * same tools as the regular logs. This must be set before connections are
+ * created, and also applies to the log ring and the log segments.
+ */
+void picoquic_set_binlog_compact(picoquic_quic_t* quic, int use_compact_binlog);
+
+/* Select which connections are logged. With sample_one_in_n set to N,
+ * only one connection in N is logged. With a flight recorder depth K or
+ * any threshold set, the last K events of each connection are kept in
+ * memory, and only written to the log if the connection closes with an
+ * error, or if it crosses a threshold, in which case the following events
+ * are logged directly. The depth defaults to
+ * PICOQUIC_BINLOG_RECORDER_DEFAULT_DEPTH if only thresholds are set. The
+ * retransmission threshold is only checked after
+ * PICOQUIC_BINLOG_POLICY_MIN_PACKETS packets are sent. This must be set
+ * before connections are created. Setting a NULL policy logs all
+ * connections.
+ */
+#define PICOQUIC_BINLOG_RECORDER_DEFAULT_DEPTH 256
+#define PICOQUIC_BINLOG_POLICY_MIN_PACKETS 32
+void picoquic_set_binlog_policy(picoquic_quic_t* quic, const picoquic_binlog_policy_t* policy);
+
+/* Rewrite a binary log record in the compact format */
+void binlog_compact_init(picoquic_binlog_compact_t* state, uint64_t connection_number);
+int binlog_compact_encode(picoquic_binlog_compact_t* state, const uint8_t* record, size_t length,
+    uint8_t* compact, size_t compact_max, size_t* compact_length);
+
+/* Internal API between the binary log writer and the flight recorder */
+void* binlog_recorder_create(size_t nb_events);
+void binlog_recorder_delete(void* v_recorder);
+int binlog_recorder_add(void* v_recorder, const uint8_t* record, size_t length);
+size_t binlog_recorder_count(void* v_recorder);
+const uint8_t* binlog_recorder_get(void* v_recorder, size_t i, size_t* length);
+int binlog_policy_is_sampled(picoquic_quic_t* quic);
+int binlog_policy_uses_recorder(picoquic_quic_t* quic);
+int binlog_policy_is_exceeded(picoquic_cnx_t* cnx, uint64_t current_time);
+int binlog_policy_is_error(picoquic_cnx_t* cnx);
+
+/* Internal API between the binary log writer and the log segments */
+void* binlog_segment_open(picoquic_cnx_t* cnx, const uint8_t* start_record, size_t length);
+int binlog_segment_write(picoquic_quic_t* quic, void* v_entry, const uint8_t* data, size_t length);
+void binlog_segment_close(picoquic_quic_t* quic, void* v_entry);
+void picoquic_binlog_segment_delete(picoquic_quic_t* quic);
+
+/* Internal API between the binary log writer and the log ring */
+void* binlog_ring_open(picoquic_quic_t* quic, char const* file_name, const uint8_t* header, size_t header_length);
+int binlog_ring_write(picoquic_quic_t* quic, void* v_file, const uint8_t* data, size_t length);
+void binlog_ring_close(picoquic_quic_t* quic, void* v_file, void* qlog_job, picoquic_autoqlog_run_fn qlog_run_fn);
+void picoquic_binlog_ring_delete(picoquic_quic_t* quic);
+
 #ifdef __cplusplus
 }
 #endif
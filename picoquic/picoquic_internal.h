@@ -30,6 +30,9 @@
 #include "picosplay.h"
 #include "picoquic.h"
 #include "picoquic_utils.h"
+#include "picoquic_metrics.h"
+#include "picoquic_probes.h"
+#include "picoquic_profile.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -48,6 +51,7 @@ extern "C" {
 #define PICOQUIC_NB_PATH_TARGET 8
 #define PICOQUIC_NB_PATH_DEFAULT 2
 #define PICOQUIC_MAX_PACKETS_IN_POOL 0x2000
+#define PICOQUIC_MAX_PENDING_STATELESS 4096
 #define PICOQUIC_STORED_IP_MAX 16
 
 #define PICOQUIC_INITIAL_RTT 250000ull /* 250 ms */
@@ -89,6 +93,8 @@ extern "C" {
 
 #define PICOQUIC_DEFAULT_SIMULTANEOUS_LOGS 32
 #define PICOQUIC_DEFAULT_HALF_OPEN_RETRY_THRESHOLD 64
+#define PICOQUIC_DEFAULT_MAX_STORED_TOKENS 1024
+#define PICOQUIC_TOKEN_STORE_HASH_BINS 256
 
 #define PICOQUIC_PN_RANDOM_MIN 0xffff
 #define PICOQUIC_PN_RANDOM_RANGE 0x10000
@@ -346,11 +352,16 @@ typedef struct st_picoquic_stateless_packet_t {
     uint8_t bytes[PICOQUIC_MAX_PACKET_SIZE];
 } picoquic_stateless_packet_t;
 
-/* Handling of stateless packets */
+/* Handling of stateless packets.
+ * All the packets are taken from a single block of PICOQUIC_MAX_PENDING_STATELESS
+ * packets, allocated when the first one is needed, so that a flood of Initial
+ * packets answered with Retry does not cost a malloc per packet. If the block is
+ * exhausted, picoquic_create_stateless_packet returns NULL.
+ */
 picoquic_stateless_packet_t* picoquic_create_stateless_packet(picoquic_quic_t* quic);
 void picoquic_queue_stateless_packet(picoquic_quic_t* quic, picoquic_stateless_packet_t* sp);
 picoquic_stateless_packet_t* picoquic_dequeue_stateless_packet(picoquic_quic_t* quic);
-void picoquic_delete_stateless_packet(picoquic_stateless_packet_t* sp);
+void picoquic_delete_stateless_packet(picoquic_quic_t* quic, picoquic_stateless_packet_t* sp);
 
 /* Data structure used to hold chunk of stream data before in sequence delivery */
 typedef struct st_picoquic_stream_data_node_t {
@@ -502,8 +513,13 @@ void picoquic_free_tickets(picoquic_stored_ticket_t** pp_first_ticket);
 void picoquic_seed_ticket(picoquic_cnx_t* cnx, picoquic_path_t* path_x);
 
 
+/* Stored tokens are indexed by a hash of the SNI, so that all tokens for
+ * the same server are found in the same bin, and by expiry time, so that
+ * expired tokens can be removed in O(log n) without scanning the store.
+ */
 typedef struct st_picoquic_stored_token_t {
-    struct st_picoquic_stored_token_t* next_token;
+    picohash_item hash_item;
+    picosplay_node_t expiry_node;
     char const* sni;
     uint8_t const* token;
     uint8_t const* ip_addr;
@@ -526,7 +542,11 @@ int picoquic_get_token(picoquic_quic_t * quic,
 int picoquic_save_tokens(picoquic_quic_t* quic,
     char const* token_file_name);
 int picoquic_load_tokens(picoquic_quic_t* quic, char const* token_file_name);
-void picoquic_free_tokens(picoquic_stored_token_t** pp_first_token);
+int picoquic_create_token_store(picoquic_quic_t* quic);
+void picoquic_expire_tokens(picoquic_quic_t* quic, uint64_t current_time);
+picoquic_stored_token_t* picoquic_first_stored_token(picoquic_quic_t* quic);
+picoquic_stored_token_t* picoquic_next_stored_token(picoquic_stored_token_t* stored);
+void picoquic_free_tokens(picoquic_quic_t* quic);
 
 /* Remember the tickets issued by a server, and the last
  * congestion control parameters for the corresponding connection
@@ -551,8 +571,52 @@ int picoquic_remember_issued_ticket(picoquic_quic_t* quic,
     const uint8_t* ip_addr,
     uint8_t ip_addr_length);
 
-picoquic_issued_ticket_t* picoquic_retrieve_issued_ticket(picoquic_quic_t* quic,
-    uint64_t ticket_id);
+int picoquic_retrieve_issued_ticket(picoquic_quic_t* quic,
+    uint64_t ticket_id, picoquic_issued_ticket_t* ticket);
+
+picohash_table* picoquic_create_issued_ticket_table(size_t nb_bin);
+void picoquic_init_registered_token_tree(picosplay_tree_t* tree);
+void* picoquic_registered_token_value(picosplay_node_t* node);
+
+/* Registry of issued tickets and registered tokens shared between several
+ * QUIC contexts, for example one context per core. The registry is split in
+ * stripes, each protected by its own mutex, so that contexts running in
+ * different threads rarely contend for the same lock. Tickets are assigned to
+ * a stripe by ticket ID, tokens by token hash. The registry also holds the
+ * secret from which the contexts derive the AEAD keys used to protect session
+ * tickets and retry tokens, so that a token issued by one context can be
+ * verified by another.
+ */
+#define PICOQUIC_SHARED_REGISTRY_STRIPES 16
+
+typedef struct st_picoquic_registry_stripe_t {
+    picoquic_mutex_t mutex;
+    picohash_table* table_issued_tickets;
+    picoquic_issued_ticket_t* table_issued_tickets_first;
+    picoquic_issued_ticket_t* table_issued_tickets_last;
+    size_t table_issued_tickets_nb;
+    picosplay_tree_t token_reuse_tree;
+} picoquic_registry_stripe_t;
+
+typedef struct st_picoquic_shared_registry_t {
+    picoquic_mutex_t mutex; /* protects reference count and secret initialization */
+    int nb_references;
+    int is_secret_set;
+    size_t max_tickets_per_stripe;
+    size_t max_tokens_per_stripe;
+    uint64_t ticket_lifetime;
+    uint8_t ticket_secret[PICOQUIC_RETRY_SECRET_SIZE];
+    picoquic_registry_stripe_t stripe[PICOQUIC_SHARED_REGISTRY_STRIPES];
+} picoquic_shared_registry_t;
+
+int picoquic_shared_registry_remember_ticket(picoquic_shared_registry_t* registry,
+    uint64_t ticket_id, uint64_t rtt, uint64_t cwin, const uint8_t* ip_addr, uint8_t ip_addr_length,
+    uint64_t current_time);
+int picoquic_shared_registry_retrieve_ticket(picoquic_shared_registry_t* registry,
+    uint64_t ticket_id, picoquic_issued_ticket_t* ticket, uint64_t current_time);
+int picoquic_shared_registry_check_reuse(picoquic_shared_registry_t* registry,
+    const uint8_t* token, size_t token_length, uint64_t expiry_time, uint64_t current_time);
+void picoquic_shared_registry_clear_tokens(picoquic_shared_registry_t* registry, uint64_t expiry_time_max);
 
 /*
  * Transport parameters, as defined by the QUIC transport specification.
@@ -597,16 +661,38 @@ typedef uint64_t picoquic_tp_enum;
  * API.
  */
 typedef int (*picoquic_autoqlog_fn)(picoquic_cnx_t * cnx);
+typedef void (*picoquic_autoqlog_close_fn)(picoquic_quic_t* quic);
+/* When binary logs are written by the log ring, the qlog conversion is prepared
+ * when the connection closes, and runs after the ring writer has closed the file.
+ */
+typedef void* (*picoquic_autoqlog_defer_fn)(picoquic_cnx_t* cnx);
+typedef void (*picoquic_autoqlog_run_fn)(void* qlog_job);
+
+/* Policy deciding which connections have their binary log persisted.
+ * A value of 0 disables the corresponding rule.
+ */
+typedef struct st_picoquic_binlog_policy_t {
+    uint32_t sample_one_in_n; /* Only log one connection in N */
+    uint32_t recorder_depth; /* Keep the last K events in memory until the connection fails or crosses a threshold */
+    uint32_t retransmit_per_mille; /* Retransmissions per thousand packets sent */
+    uint64_t rtt_threshold; /* Smoothed RTT of the default path, microseconds */
+    uint64_t handshake_threshold; /* Time to complete the handshake, microseconds */
+} picoquic_binlog_policy_t;
 
 /* Callback used for the performance log
  */
 typedef int (*picoquic_performance_log_fn)(picoquic_quic_t* quic, picoquic_cnx_t* cnx, int should_delete);
+/* Callback used for the mid-connection snapshots of the performance log,
+ * called when preparing packets after next_perflog_snapshot_time.
+ */
+typedef void (*picoquic_performance_snapshot_fn)(picoquic_cnx_t* cnx, uint64_t current_time);
 
 /* QUIC context, defining the tables of connections,
  * open sockets, etc.
  */
 typedef struct st_picoquic_quic_t {
     void* tls_master_ctx;
+    picoquic_tls_master_t* shared_tls_master;
     picoquic_stream_data_cb_fn default_callback_fn;
     void* default_callback_ctx;
     char const* default_alpn;
@@ -617,8 +703,11 @@ typedef struct st_picoquic_quic_t {
     char const* ticket_file_name;
     char const* token_file_name;
     picoquic_stored_ticket_t * p_first_ticket;
-    picoquic_stored_token_t * p_first_token;
+    picohash_table* table_stored_tokens; /* stored tokens, hashed by SNI */
+    picosplay_tree_t token_expiry_tree; /* stored tokens, ordered by expiry time */
+    size_t max_stored_tokens;
     picosplay_tree_t token_reuse_tree; /* detection of token reuse */
+    struct st_picoquic_shared_registry_t* shared_registry; /* if set, replaces issued tickets and token reuse tree */
     uint8_t local_cnxid_length;
     uint8_t default_stream_priority;
     uint8_t default_datagram_priority;
@@ -653,6 +742,7 @@ typedef struct st_picoquic_quic_t {
     unsigned int is_cert_store_not_empty : 1;
     unsigned int is_cert_verifier_custom : 1;
     unsigned int use_long_log : 1;
+    unsigned int use_compact_binlog : 1;
     unsigned int should_close_log : 1;
     unsigned int use_unique_log_names : 1; /* Add 64 bit random number to log names for uniqueness */
     unsigned int dont_coalesce_init : 1; /* test option to turn of packet coalescing on server */
@@ -668,8 +758,16 @@ typedef struct st_picoquic_quic_t {
     unsigned int test_large_server_flight : 1; /* Use TP to ensure server flight is at least 8K */
     unsigned int is_port_blocking_disabled : 1; /* Do not check client port on incoming connections */
     unsigned int are_path_callbacks_enabled : 1; /* Enable path specific callbacks by default */
+    unsigned int is_initial_salt_cache_disabled : 1; /* Initial keys are derived without the cached salt contexts */
 
     picoquic_stateless_packet_t* pending_stateless_packet;
+    picoquic_stateless_packet_t* pending_stateless_last;
+    size_t nb_pending_stateless;
+    picoquic_stateless_packet_t* stateless_packet_block; /* PICOQUIC_MAX_PENDING_STATELESS packets, allocated at first use */
+    picoquic_stateless_packet_t* p_first_stateless_free;
+    size_t nb_stateless_in_pool;
+    uint64_t nb_fast_retry_sent;
+    uint64_t nb_fast_retry_dropped;
 
     picoquic_congestion_algorithm_t const* default_congestion_alg;
     uint64_t wifi_shadow_rtt;
@@ -708,6 +806,7 @@ typedef struct st_picoquic_quic_t {
     void* aead_decrypt_ticket_ctx;
     void ** retry_integrity_sign_ctx;
     void ** retry_integrity_verify_ctx;
+    void ** initial_salt_ctx;
 
     struct st_ptls_verify_certificate_t * verify_certificate_callback;
     picoquic_free_verify_certificate_ctx free_verify_certificate_callback_fn;
@@ -733,13 +832,55 @@ typedef struct st_picoquic_quic_t {
     char* binlog_dir;
     char* qlog_dir;
     picoquic_autoqlog_fn autoqlog_fn;
+    picoquic_autoqlog_close_fn autoqlog_close_fn;
+    void* v_autoqlog_ctx;
+    picoquic_autoqlog_defer_fn autoqlog_defer_fn;
+    picoquic_autoqlog_run_fn autoqlog_run_fn;
+    void* v_binlog_ring;
+    void* v_binlog_segment;
+    picoquic_binlog_policy_t binlog_policy;
+    uint64_t binlog_sample_count;
     struct st_picoquic_unified_logging_t* text_log_fns;
     struct st_picoquic_unified_logging_t* bin_log_fns;
     struct st_picoquic_unified_logging_t* qlog_fns;
     picoquic_performance_log_fn perflog_fn;
+    picoquic_performance_snapshot_fn perflog_snapshot_fn;
     void* v_perflog_ctx;
+    struct st_picoquic_metrics_t* metrics;
+    picoquic_phase_stats_t phase_stats;
 } picoquic_quic_t;
 
+/* Update the metrics registry, if it is enabled */
+#define PICOQUIC_METRICS_ADD(quic, counter, value) (((quic)->metrics == NULL) ? (void)0 : picoquic_metrics_add(quic, counter, value))
+#define PICOQUIC_METRICS_RECORD(quic, histogram, value) (((quic)->metrics == NULL) ? (void)0 : picoquic_metrics_record(quic, histogram, value))
+
+/* Per phase profiling, only compiled with ENABLE_PHASE_PROFILE.
+ * PICOQUIC_PHASE_START declares the variable holding the start time. */
+#if (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))) || \
+    ((defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)))
+#define PICOQUIC_PHASE_USE_RDTSC
+#else
+#define PICOQUIC_PHASE_TICKS_ARE_NS
+#endif
+
+#ifdef PICOQUIC_WITH_PHASE_PROFILE
+#ifdef PICOQUIC_PHASE_USE_RDTSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define PICOQUIC_PHASE_TICKS() ((uint64_t)__rdtsc())
+#else
+#define PICOQUIC_PHASE_TICKS() picoquic_phase_clock_ns()
+#endif
+#define PICOQUIC_PHASE_START(t) uint64_t t = PICOQUIC_PHASE_TICKS()
+#define PICOQUIC_PHASE_END(quic, phase, t) ((quic)->phase_stats.ticks[phase] += PICOQUIC_PHASE_TICKS() - (t), (quic)->phase_stats.calls[phase]++)
+#else
+#define PICOQUIC_PHASE_START(t)
+#define PICOQUIC_PHASE_END(quic, phase, t)
+#endif
+
 picoquic_packet_context_enum picoquic_context_from_epoch(int epoch);
 
 int picoquic_registered_token_check_reuse(picoquic_quic_t* quic, const uint8_t* token, size_t token_length, uint64_t expiry_time);
@@ -1501,10 +1642,22 @@ typedef struct st_picoquic_cnx_t {
     /* Log handling */
     uint16_t log_unique;
     FILE* f_binlog;
+    void* binlog_ring_handle;
+    void* binlog_segment_entry;
+    void* binlog_compact;
+    void* binlog_recorder;
     char* binlog_file_name;
+    uint64_t nb_binlog_frames_truncated; /* Frames that did not fit in their binary log record */
+    uint64_t next_perflog_snapshot_time;
 
 } picoquic_cnx_t;
 
+/* The binary log of a connection is written either directly to a file,
+ * through the log ring of the QUIC context, or to the shared log segment,
+ * or kept in the flight recorder until the logging policy decides. */
+#define PICOQUIC_CNX_HAS_BINLOG(cnx) ((cnx)->f_binlog != NULL || (cnx)->binlog_ring_handle != NULL || \
+    (cnx)->binlog_segment_entry != NULL || (cnx)->binlog_recorder != NULL)
+
 typedef struct st_picoquic_packet_data_t {
     uint64_t last_time_stamp_received;
     uint64_t last_ack_delay; /* ACK Delay in ACK frame */
@@ -1606,6 +1759,7 @@ picoquic_cnx_t* picoquic_cnx_by_id(picoquic_quic_t* quic, picoquic_connection_id
 picoquic_cnx_t* picoquic_cnx_by_net(picoquic_quic_t* quic, const struct sockaddr* addr);
 picoquic_cnx_t* picoquic_cnx_by_icid(picoquic_quic_t* quic, picoquic_connection_id_t* icid,
     const struct sockaddr* addr);
+int picoquic_create_retry_cnxid(picoquic_quic_t* quic, const picoquic_connection_id_t* icid, picoquic_connection_id_t* retry_cid);
 picoquic_cnx_t* picoquic_cnx_by_secret(picoquic_quic_t* quic, const uint8_t* reset_secret, const struct sockaddr* addr);
 
 /* Reset the pacing data after CWIN is updated */
@@ -1647,6 +1801,7 @@ size_t picoquic_decode_varint_length(uint8_t byte);
 /* Packet parsing */
 
 picoquic_packet_type_enum picoquic_parse_long_packet_type(uint8_t flags, int version_index);
+uint8_t picoquic_create_long_packet_type(picoquic_packet_type_enum pt, int version_index);
 
 int picoquic_parse_packet_header(
     picoquic_quic_t* quic,
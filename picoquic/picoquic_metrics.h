@@ -0,0 +1,139 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef PICOQUIC_METRICS_H
+#define PICOQUIC_METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "picoquic.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Context level metrics registry.
+ *
+ * Once enabled, the registry aggregates the statistics of all the
+ * connections of the QUIC context as counters, gauges and histograms.
+ * The registry is only updated by the thread that runs the QUIC
+ * context, using relaxed atomic stores, so updates never take a lock.
+ * Snapshots can be taken from any thread; each value in the snapshot is
+ * consistent, but the snapshot as a whole is not.
+ *
+ * Histograms use HDR style buckets: values below 8 have their own
+ * bucket, and each power of 2 above that is split in 8 linear buckets,
+ * so the value of a bucket is known within 12.5%.
+ */
+#define PICOQUIC_METRICS_SUB_BUCKET_BITS 3
+#define PICOQUIC_METRICS_SUB_BUCKETS (1 << PICOQUIC_METRICS_SUB_BUCKET_BITS)
+#define PICOQUIC_METRICS_NB_BUCKETS ((64 - PICOQUIC_METRICS_SUB_BUCKET_BITS + 1) * PICOQUIC_METRICS_SUB_BUCKETS)
+#define PICOQUIC_METRICS_TEXT_MAX 0x8000
+
+typedef enum {
+    picoquic_metrics_cnx_created = 0,
+    picoquic_metrics_cnx_deleted,
+    picoquic_metrics_packets_sent,
+    picoquic_metrics_packets_received,
+    picoquic_metrics_retransmissions,
+    picoquic_metrics_spurious,
+    picoquic_metrics_trains_sent,
+    picoquic_metrics_trains_short,
+    picoquic_metrics_trains_blocked_cwin,
+    picoquic_metrics_trains_blocked_pacing,
+    picoquic_metrics_trains_blocked_others,
+    picoquic_metrics_counter_max
+} picoquic_metrics_counter_enum;
+
+typedef enum {
+    picoquic_metrics_connections = 0,
+    picoquic_metrics_packets_allocated,
+    picoquic_metrics_packets_in_pool,
+    picoquic_metrics_data_nodes_allocated,
+    picoquic_metrics_data_nodes_in_pool,
+    picoquic_metrics_gauge_max
+} picoquic_metrics_gauge_enum;
+
+typedef enum {
+    picoquic_metrics_handshake_time = 0,
+    picoquic_metrics_rtt,
+    picoquic_metrics_cwin,
+    picoquic_metrics_train_packets,
+    picoquic_metrics_loop_time,
+    picoquic_metrics_packet_time,
+    picoquic_metrics_packet_pool,
+    picoquic_metrics_data_node_pool,
+    picoquic_metrics_histogram_max
+} picoquic_metrics_histogram_enum;
+
+typedef struct st_picoquic_metrics_histogram_t {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t bucket[PICOQUIC_METRICS_NB_BUCKETS];
+} picoquic_metrics_histogram_t;
+
+typedef struct st_picoquic_metrics_snapshot_t {
+    uint64_t counter[picoquic_metrics_counter_max];
+    uint64_t gauge[picoquic_metrics_gauge_max];
+    picoquic_metrics_histogram_t histogram[picoquic_metrics_histogram_max];
+} picoquic_metrics_snapshot_t;
+
+/* Enable or disable the registry. Disabling frees it; it is also freed
+ * when the QUIC context is deleted. */
+int picoquic_metrics_enable(picoquic_quic_t* quic);
+void picoquic_metrics_disable(picoquic_quic_t* quic);
+
+/* Copy the current values. Returns -1 if the registry is not enabled. */
+int picoquic_metrics_get_snapshot(picoquic_quic_t* quic, picoquic_metrics_snapshot_t* snapshot);
+
+/* Sample the packet and data node pools. This is done after each
+ * iteration of the packet loop; custom loops may call it directly. */
+void picoquic_metrics_sample_pools(picoquic_quic_t* quic);
+
+/* Histogram helpers */
+size_t picoquic_metrics_bucket_index(uint64_t value);
+uint64_t picoquic_metrics_bucket_upper(size_t index);
+uint64_t picoquic_metrics_quantile(const picoquic_metrics_histogram_t* histogram, double quantile);
+
+const char* picoquic_metrics_counter_name(picoquic_metrics_counter_enum counter);
+const char* picoquic_metrics_gauge_name(picoquic_metrics_gauge_enum gauge);
+const char* picoquic_metrics_histogram_name(picoquic_metrics_histogram_enum histogram);
+
+/* Prometheus text exposition format. Counters are exported as counters,
+ * gauges as gauges, and histograms as summaries with the 0.5, 0.9, 0.99
+ * and 0.999 quantiles. The format function returns -1 if the text does
+ * not fit in the buffer. The fd variant is meant to be called from the
+ * packet loop callback, for example to answer a connection on a
+ * monitoring socket. */
+int picoquic_metrics_format_prometheus(const picoquic_metrics_snapshot_t* snapshot,
+    char* text, size_t text_max, size_t* text_length);
+int picoquic_metrics_write_prometheus(picoquic_quic_t* quic, FILE* F);
+int picoquic_metrics_write_prometheus_fd(picoquic_quic_t* quic, int fd);
+
+/* Update functions, called from the stack */
+void picoquic_metrics_add(picoquic_quic_t* quic, picoquic_metrics_counter_enum counter, uint64_t value);
+void picoquic_metrics_record(picoquic_quic_t* quic, picoquic_metrics_histogram_enum histogram, uint64_t value);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* PICOQUIC_METRICS_H */
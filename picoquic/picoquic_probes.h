@@ -0,0 +1,62 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef PICOQUIC_PROBES_H
+#define PICOQUIC_PROBES_H
+
+/* USDT static probes.
+ *
+ * When the library is built with the CMake option ENABLE_USDT, the
+ * probes are compiled as "nop" instructions described in the ELF notes,
+ * which tracing tools such as bpftrace or perf can attach to. Otherwise,
+ * the macros expand to nothing. All probes are in the "picoquic" provider:
+ *
+ * segment_start(quic, length, current_time)
+ * segment_done(quic, cnx, ptype, pn64, length, ret)
+ * packet_sent(cnx, path_x, ptype, sequence_number, length, current_time)
+ * packet_lost(cnx, path_x, sequence_number, length, is_timer_expired, send_time, current_time)
+ * cc_notify(cnx, path_x, notification, cwin, bytes_in_transit)
+ * data_blocked(cnx, maxdata_remote)
+ * stream_data_blocked(stream_id, maxdata_remote)
+ * streams_blocked(cnx, frame_type, stream_limit)
+ * wake_reinsert(cnx, previous_wake_time, next_wake_time, wake_file, wake_line)
+ *
+ * Times are in microseconds of the QUIC context clock. The bpftrace
+ * scripts in scripts/usdt use these probes.
+ */
+#ifdef PICOQUIC_WITH_USDT
+#include <sys/sdt.h>
+
+#define PICOQUIC_PROBE2(name, a1, a2) DTRACE_PROBE2(picoquic, name, a1, a2)
+#define PICOQUIC_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(picoquic, name, a1, a2, a3)
+#define PICOQUIC_PROBE4(name, a1, a2, a3, a4) DTRACE_PROBE4(picoquic, name, a1, a2, a3, a4)
+#define PICOQUIC_PROBE5(name, a1, a2, a3, a4, a5) DTRACE_PROBE5(picoquic, name, a1, a2, a3, a4, a5)
+#define PICOQUIC_PROBE6(name, a1, a2, a3, a4, a5, a6) DTRACE_PROBE6(picoquic, name, a1, a2, a3, a4, a5, a6)
+#define PICOQUIC_PROBE7(name, a1, a2, a3, a4, a5, a6, a7) DTRACE_PROBE7(picoquic, name, a1, a2, a3, a4, a5, a6, a7)
+#else
+#define PICOQUIC_PROBE2(name, a1, a2)
+#define PICOQUIC_PROBE3(name, a1, a2, a3)
+#define PICOQUIC_PROBE4(name, a1, a2, a3, a4)
+#define PICOQUIC_PROBE5(name, a1, a2, a3, a4, a5)
+#define PICOQUIC_PROBE6(name, a1, a2, a3, a4, a5, a6)
+#define PICOQUIC_PROBE7(name, a1, a2, a3, a4, a5, a6, a7)
+#endif
+
+#endif /* PICOQUIC_PROBES_H */
@@ -0,0 +1,79 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef PICOQUIC_PROFILE_H
+#define PICOQUIC_PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "picoquic.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Per phase profiling counters.
+ *
+ * When the library is built with the CMake option ENABLE_PHASE_PROFILE,
+ * the time spent in each phase of packet processing is accumulated in the
+ * QUIC context, together with the number of calls. Time is measured in
+ * CPU cycles with rdtsc on x86 and x64, and in nanoseconds of the
+ * monotonic clock on other platforms. Phases may be nested: the frame
+ * decoding time includes the ACK processing time, and both include some
+ * of the congestion control updates. Packet formatting includes the
+ * encryption time.
+ *
+ * The counters are updated without locks by the thread running the
+ * context, and should be read or reset from that thread, for example in
+ * the packet loop callback. Without the CMake option, the counters
+ * remain zero.
+ */
+typedef enum {
+    picoquic_phase_header_parse = 0,
+    picoquic_phase_decrypt,
+    picoquic_phase_frame_decode,
+    picoquic_phase_ack_processing,
+    picoquic_phase_cc_update,
+    picoquic_phase_packet_format,
+    picoquic_phase_encrypt,
+    picoquic_phase_socket_recv,
+    picoquic_phase_socket_send,
+    picoquic_phase_max
+} picoquic_phase_enum;
+
+typedef struct st_picoquic_phase_stats_t {
+    uint64_t ticks[picoquic_phase_max];
+    uint64_t calls[picoquic_phase_max];
+} picoquic_phase_stats_t;
+
+int picoquic_phase_profile_is_enabled(void);
+const char* picoquic_phase_profile_unit(void);
+const char* picoquic_phase_name(picoquic_phase_enum phase);
+void picoquic_get_phase_stats(picoquic_quic_t* quic, picoquic_phase_stats_t* stats);
+void picoquic_reset_phase_stats(picoquic_quic_t* quic);
+void picoquic_phase_stats_print(FILE* F, const picoquic_phase_stats_t* stats);
+
+/* Monotonic clock in nanoseconds, used when rdtsc is not available */
+uint64_t picoquic_phase_clock_ns(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* PICOQUIC_PROFILE_H */
@@ -407,7 +407,13 @@ picohash_item* picoquic_issued_ticket_key_to_item(const void* key)
     return &ticket_key->hash_item;
 }
 
-picoquic_issued_ticket_t* picoquic_retrieve_issued_ticket(picoquic_quic_t* quic,
+picohash_table* picoquic_create_issued_ticket_table(size_t nb_bin)
+{
+    return picohash_create_ex(nb_bin, picoquic_issued_ticket_hash, picoquic_issued_ticket_compare,
+        picoquic_issued_ticket_key_to_item);
+}
+
+static picoquic_issued_ticket_t* picoquic_find_issued_ticket(picoquic_quic_t* quic,
     uint64_t ticket_id)
 {
     picoquic_issued_ticket_t* ret = NULL;
@@ -425,6 +431,31 @@ picoquic_issued_ticket_t* picoquic_retrieve_issued_ticket(picoquic_quic_t* quic,
     return ret;
 }
 
+/* Copy the properties of the issued ticket, if found. The ticket is copied
+ * rather than returned by reference, because the shared registry may
+ * evict it as soon as the lock is released.
+ */
+int picoquic_retrieve_issued_ticket(picoquic_quic_t* quic,
+    uint64_t ticket_id, picoquic_issued_ticket_t* ticket)
+{
+    int ret = -1;
+
+    if (quic->shared_registry != NULL) {
+        ret = picoquic_shared_registry_retrieve_ticket(quic->shared_registry, ticket_id, ticket,
+            picoquic_get_quic_time(quic));
+    }
+    else {
+        picoquic_issued_ticket_t* found = picoquic_find_issued_ticket(quic, ticket_id);
+
+        if (found != NULL) {
+            memcpy(ticket, found, sizeof(picoquic_issued_ticket_t));
+            ret = 0;
+        }
+    }
+
+    return ret;
+}
+
 static void picoquic_update_issued_ticket(
     picoquic_issued_ticket_t* ticket,
     uint64_t rtt,
@@ -474,9 +505,14 @@ int picoquic_remember_issued_ticket(picoquic_quic_t* quic,
     uint8_t ip_addr_length)
 {
     int ret = 0;
+    picoquic_issued_ticket_t* ticket;
+
+    if (quic->shared_registry != NULL) {
+        return picoquic_shared_registry_remember_ticket(quic->shared_registry, ticket_id,
+            rtt, cwin, ip_addr, ip_addr_length, picoquic_get_quic_time(quic));
+    }
 
-    picoquic_issued_ticket_t* ticket = picoquic_retrieve_issued_ticket(quic,
-        ticket_id);
+    ticket = picoquic_find_issued_ticket(quic, ticket_id);
     if (ticket != NULL) {
         picoquic_update_issued_ticket(ticket, rtt, cwin, ip_addr, ip_addr_length);
     }
@@ -538,7 +574,7 @@ static picosplay_node_t* picoquic_registered_token_create(void* value)
 }
 
 
-static void* picoquic_registered_token_value(picosplay_node_t* node)
+void* picoquic_registered_token_value(picosplay_node_t* node)
 {
     return (void*)((node == NULL)?NULL:((char*)node - offsetof(struct st_picoquic_registered_token_t, registered_token_node)));
 }
@@ -549,11 +585,21 @@ static void picoquic_registered_token_delete(void* tree, picosplay_node_t* node)
     free(rt);
 }
 
+void picoquic_init_registered_token_tree(picosplay_tree_t* tree)
+{
+    picosplay_init_tree(tree, picoquic_registered_token_compare,
+        picoquic_registered_token_create, picoquic_registered_token_delete, picoquic_registered_token_value);
+}
+
 int picoquic_registered_token_check_reuse(picoquic_quic_t * quic,
     const uint8_t * token, size_t token_length, uint64_t expiry_time)
 {
     int ret = -1;
-    if (token_length >= 8) {
+    if (quic->shared_registry != NULL) {
+        ret = picoquic_shared_registry_check_reuse(quic->shared_registry, token, token_length, expiry_time,
+            picoquic_get_quic_time(quic));
+    }
+    else if (token_length >= 8) {
         picoquic_registered_token_t* rt = (picoquic_registered_token_t*)malloc(sizeof(picoquic_registered_token_t));
         if (rt != NULL) {
             picosplay_node_t* rt_n = NULL;
@@ -581,6 +627,12 @@ int picoquic_registered_token_check_reuse(picoquic_quic_t * quic,
 void picoquic_registered_token_clear(picoquic_quic_t* quic, uint64_t expiry_time_max)
 {
     int end_reached = 0;
+
+    if (quic->shared_registry != NULL) {
+        picoquic_shared_registry_clear_tokens(quic->shared_registry, expiry_time_max);
+        return;
+    }
+
     do {
         picoquic_registered_token_t* rt_first = (picoquic_registered_token_t*)
             picoquic_registered_token_value(picosplay_first(&quic->token_reuse_tree));
@@ -612,7 +664,7 @@ uint32_t picoquic_current_number_connections(picoquic_quic_t * quic)
 static void picoquic_wake_list_init(picoquic_quic_t* quic);
 
 /* QUIC context create and dispose */
-picoquic_quic_t* picoquic_create(uint32_t max_nb_connections,
+static picoquic_quic_t* picoquic_create_ex(uint32_t max_nb_connections,
     char const* cert_file_name,
     char const* key_file_name, 
     char const * cert_root_file_name,
@@ -626,7 +678,8 @@ picoquic_quic_t* picoquic_create(uint32_t max_nb_connections,
     uint64_t* p_simulated_time,
     char const* ticket_file_name,
     const uint8_t* ticket_encryption_key,
-    size_t ticket_encryption_key_length)
+    size_t ticket_encryption_key_length,
+    picoquic_tls_master_t* shared_tls_master)
 {
     picoquic_quic_t* quic = (picoquic_quic_t*)malloc(sizeof(picoquic_quic_t));
     int ret = 0;
@@ -690,25 +743,26 @@ picoquic_quic_t* picoquic_create(uint32_t max_nb_connections,
             quic->table_cnx_by_secret = picohash_create_ex((size_t)max_nb_connections * 4,
                 picoquic_net_secret_hash, picoquic_net_secret_compare, picoquic_net_secret_to_item);
 
-            quic->table_issued_tickets = picohash_create_ex((size_t)max_nb_connections,
-                picoquic_issued_ticket_hash, picoquic_issued_ticket_compare, picoquic_issued_ticket_key_to_item);
+            quic->table_issued_tickets = picoquic_create_issued_ticket_table((size_t)max_nb_connections);
 
-            picosplay_init_tree(&quic->token_reuse_tree, picoquic_registered_token_compare,
-                picoquic_registered_token_create, picoquic_registered_token_delete, picoquic_registered_token_value);
+            picoquic_init_registered_token_tree(&quic->token_reuse_tree);
 
             if (quic->table_cnx_by_id == NULL || quic->table_cnx_by_net == NULL ||
                 quic->table_cnx_by_icid == NULL || quic->table_cnx_by_secret == NULL ||
-                quic->table_issued_tickets == NULL) {
+                quic->table_issued_tickets == NULL || picoquic_create_token_store(quic) != 0) {
                 ret = -1;
                 DBG_PRINTF("%s", "Cannot initialize hash tables\n");
             }
-            else if (picoquic_master_tlscontext(quic, cert_file_name, key_file_name, cert_root_file_name, ticket_encryption_key, ticket_encryption_key_length) != 0) {
+            else if ((shared_tls_master == NULL) ?
+                picoquic_master_tlscontext(quic, cert_file_name, key_file_name, cert_root_file_name, ticket_encryption_key, ticket_encryption_key_length) != 0 :
+                picoquic_master_tlscontext_from_shared(quic, shared_tls_master) != 0) {
                 ret = -1;
                 DBG_PRINTF("%s", "Cannot create TLS context \n");
             }
             else {
                 /* In the absence of certificate or key, we assume that this is a client only context */
-                quic->enforce_client_only = (cert_file_name == NULL || key_file_name == NULL);
+                quic->enforce_client_only = (shared_tls_master == NULL) ?
+                    (cert_file_name == NULL || key_file_name == NULL) : !picoquic_tls_master_has_certificate(shared_tls_master);
                 /* the random generator was initialized as part of the TLS context.
                  * Use it to create the seed for generating the per context stateless
                  * resets and the retry tokens */
@@ -746,6 +800,45 @@ picoquic_quic_t* picoquic_create(uint32_t max_nb_connections,
     return quic;
 }
 
+picoquic_quic_t* picoquic_create(uint32_t max_nb_connections,
+    char const* cert_file_name,
+    char const* key_file_name,
+    char const * cert_root_file_name,
+    char const* default_alpn,
+    picoquic_stream_data_cb_fn default_callback_fn,
+    void* default_callback_ctx,
+    picoquic_connection_id_cb_fn cnx_id_callback,
+    void* cnx_id_callback_ctx,
+    uint8_t reset_seed[PICOQUIC_RESET_SECRET_SIZE],
+    uint64_t current_time,
+    uint64_t* p_simulated_time,
+    char const* ticket_file_name,
+    const uint8_t* ticket_encryption_key,
+    size_t ticket_encryption_key_length)
+{
+    return picoquic_create_ex(max_nb_connections, cert_file_name, key_file_name, cert_root_file_name,
+        default_alpn, default_callback_fn, default_callback_ctx, cnx_id_callback, cnx_id_callback_ctx,
+        reset_seed, current_time, p_simulated_time, ticket_file_name,
+        ticket_encryption_key, ticket_encryption_key_length, NULL);
+}
+
+picoquic_quic_t* picoquic_create_with_tls_master(picoquic_tls_master_t* master,
+    uint32_t max_nb_connections,
+    char const* default_alpn,
+    picoquic_stream_data_cb_fn default_callback_fn,
+    void* default_callback_ctx,
+    picoquic_connection_id_cb_fn cnx_id_callback,
+    void* cnx_id_callback_ctx,
+    uint8_t reset_seed[PICOQUIC_RESET_SECRET_SIZE],
+    uint64_t current_time,
+    uint64_t* p_simulated_time,
+    char const* ticket_file_name)
+{
+    return picoquic_create_ex(max_nb_connections, NULL, NULL, NULL,
+        default_alpn, default_callback_fn, default_callback_ctx, cnx_id_callback, cnx_id_callback_ctx,
+        reset_seed, current_time, p_simulated_time, ticket_file_name, NULL, 0, master);
+}
+
 int picoquic_load_token_file(picoquic_quic_t* quic, char const * token_file_name)
 {
     int ret = picoquic_load_tokens(quic, token_file_name);
@@ -913,6 +1006,7 @@ void picoquic_free(picoquic_quic_t* quic)
 
         /* Delete TLS and AEAD cntexts */
         picoquic_delete_retry_protection_contexts(quic);
+        picoquic_delete_initial_salt_contexts(quic);
 
         if (quic->aead_encrypt_ticket_ctx != NULL) {
             picoquic_aead_free(quic->aead_encrypt_ticket_ctx);
@@ -933,11 +1027,17 @@ void picoquic_free(picoquic_quic_t* quic)
         picoquic_free_tickets(&quic->p_first_ticket);
 
         /* Delete the stored tokens */
-        picoquic_free_tokens(&quic->p_first_token);
+        picoquic_free_tokens(quic);
 
         /* Deelete the reused tokens tree */
         picosplay_empty_tree(&quic->token_reuse_tree);
 
+        /* Release the shared registry, if any */
+        if (quic->shared_registry != NULL) {
+            picoquic_shared_registry_release(quic->shared_registry);
+            quic->shared_registry = NULL;
+        }
+
         /* delete packets in pool */
         while (quic->p_first_packet != NULL) {
             picoquic_packet_t * p = quic->p_first_packet->packet_previous;
@@ -956,11 +1056,15 @@ void picoquic_free(picoquic_quic_t* quic)
             quic->nb_data_nodes_in_pool--;
         }
 
-        /* delete all pending stateless packets */
-        while (quic->pending_stateless_packet != NULL) {
-            picoquic_stateless_packet_t* to_delete = quic->pending_stateless_packet;
-            quic->pending_stateless_packet = to_delete->next_packet;
-            free(to_delete);
+        /* delete all stateless packets, pending or in pool */
+        quic->pending_stateless_packet = NULL;
+        quic->pending_stateless_last = NULL;
+        quic->nb_pending_stateless = 0;
+        quic->p_first_stateless_free = NULL;
+        quic->nb_stateless_in_pool = 0;
+        if (quic->stateless_packet_block != NULL) {
+            free(quic->stateless_packet_block);
+            quic->stateless_packet_block = NULL;
         }
 
         if (quic->table_cnx_by_id != NULL) {
@@ -998,6 +1102,11 @@ void picoquic_free(picoquic_quic_t* quic)
         /* Close the logs */
         picoquic_log_close_logs(quic);
 
+        /* Complete the pending qlog conversions */
+        if (quic->autoqlog_close_fn != NULL) {
+            quic->autoqlog_close_fn(quic);
+        }
+
         quic->binlog_dir = picoquic_string_free(quic->binlog_dir);
         quic->qlog_dir = picoquic_string_free(quic->qlog_dir);
 
@@ -1005,6 +1114,8 @@ void picoquic_free(picoquic_quic_t* quic)
             (void)(quic->perflog_fn)(quic, NULL, 1);
         }
 
+        picoquic_metrics_disable(quic);
+
         free(quic);
     }
 }
@@ -1049,27 +1160,49 @@ uint32_t picoquic_get_max_half_open_retry_threshold(picoquic_quic_t* quic)
 
 picoquic_stateless_packet_t* picoquic_create_stateless_packet(picoquic_quic_t* quic)
 {
-#ifdef _WINDOWS
-    UNREFERENCED_PARAMETER(quic);
-#endif
-    return (picoquic_stateless_packet_t*)malloc(sizeof(picoquic_stateless_packet_t));
+    picoquic_stateless_packet_t* sp;
+
+    if (quic->stateless_packet_block == NULL) {
+        quic->stateless_packet_block = (picoquic_stateless_packet_t*)malloc(
+            sizeof(picoquic_stateless_packet_t) * PICOQUIC_MAX_PENDING_STATELESS);
+        if (quic->stateless_packet_block != NULL) {
+            for (size_t i = PICOQUIC_MAX_PENDING_STATELESS; i > 0; i--) {
+                quic->stateless_packet_block[i - 1].next_packet = quic->p_first_stateless_free;
+                quic->p_first_stateless_free = &quic->stateless_packet_block[i - 1];
+            }
+            quic->nb_stateless_in_pool = PICOQUIC_MAX_PENDING_STATELESS;
+        }
+    }
+
+    if ((sp = quic->p_first_stateless_free) != NULL) {
+        quic->p_first_stateless_free = sp->next_packet;
+        quic->nb_stateless_in_pool--;
+        sp->next_packet = NULL;
+        sp->initial_cid = picoquic_null_connection_id;
+    }
+
+    return sp;
 }
 
-void picoquic_delete_stateless_packet(picoquic_stateless_packet_t* sp)
+void picoquic_delete_stateless_packet(picoquic_quic_t* quic, picoquic_stateless_packet_t* sp)
 {
-    free(sp);
+    sp->next_packet = quic->p_first_stateless_free;
+    quic->p_first_stateless_free = sp;
+    quic->nb_stateless_in_pool++;
 }
 
 void picoquic_queue_stateless_packet(picoquic_quic_t* quic, picoquic_stateless_packet_t* sp)
 {
-    picoquic_stateless_packet_t** pnext = &quic->pending_stateless_packet;
+    sp->next_packet = NULL;
 
-    while ((*pnext) != NULL) {
-        pnext = &(*pnext)->next_packet;
+    if (quic->pending_stateless_last == NULL) {
+        quic->pending_stateless_packet = sp;
     }
-
-    *pnext = sp;
-    sp->next_packet = NULL;
+    else {
+        quic->pending_stateless_last->next_packet = sp;
+    }
+    quic->pending_stateless_last = sp;
+    quic->nb_pending_stateless++;
 }
 
 picoquic_stateless_packet_t* picoquic_dequeue_stateless_packet(picoquic_quic_t* quic)
@@ -1078,6 +1211,10 @@ picoquic_stateless_packet_t* picoquic_dequeue_stateless_packet(picoquic_quic_t*
 
     if (sp != NULL) {
         quic->pending_stateless_packet = sp->next_packet;
+        if (quic->pending_stateless_packet == NULL) {
+            quic->pending_stateless_last = NULL;
+        }
+        quic->nb_pending_stateless--;
         sp->next_packet = NULL;
         picoquic_log_quic_pdu(quic, 0, picoquic_get_quic_time(quic), sp->cnxid_log64,
             (struct sockaddr*) & sp->addr_to, (struct sockaddr*) & sp->addr_local, sp->length);
@@ -1276,6 +1413,7 @@ static void picoquic_insert_cnx_in_list(picoquic_quic_t* quic, picoquic_cnx_t* c
     quic->cnx_list = cnx;
     cnx->previous_in_table = NULL;
     quic->current_number_connections++;
+    PICOQUIC_METRICS_ADD(quic, picoquic_metrics_cnx_created, 1);
 }
 
 static void picoquic_remove_cnx_from_list(picoquic_cnx_t* cnx)
@@ -1297,6 +1435,7 @@ static void picoquic_remove_cnx_from_list(picoquic_cnx_t* cnx)
     picoquic_unregister_net_secret(cnx);
 
     cnx->quic->current_number_connections--;
+    PICOQUIC_METRICS_ADD(cnx->quic, picoquic_metrics_cnx_deleted, 1);
 }
 
 /* Management of the list of connections, sorted by wake time */
@@ -1345,6 +1484,7 @@ static void picoquic_insert_cnx_by_wake_time(picoquic_quic_t* quic, picoquic_cnx
 
 void picoquic_reinsert_by_wake_time(picoquic_quic_t* quic, picoquic_cnx_t* cnx, uint64_t next_time)
 {
+    PICOQUIC_PROBE5(wake_reinsert, cnx, cnx->next_wake_time, next_time, quic->wake_file, quic->wake_line);
     picoquic_remove_cnx_from_wake_list(cnx);
     cnx->next_wake_time = next_time;
     picoquic_insert_cnx_by_wake_time(quic, cnx);
@@ -1467,6 +1607,32 @@ static void picoquic_create_random_cnx_id(picoquic_quic_t* quic, picoquic_connec
     cnx_id->id_len = id_length;
 }
 
+/* Pick the connection ID announced in a Retry sent without creating a connection
+ * context. This follows the same logic as the creation of the first local CID,
+ * so that load balancing callbacks see the same inputs. */
+int picoquic_create_retry_cnxid(picoquic_quic_t* quic, const picoquic_connection_id_t* icid, picoquic_connection_id_t* retry_cid)
+{
+    int ret = -1;
+
+    if (quic->local_cnxid_length > 0) {
+        for (int i = 0; i < 32; i++) {
+            picoquic_create_random_cnx_id(quic, retry_cid, quic->local_cnxid_length);
+
+            if (quic->cnx_id_callback_fn) {
+                quic->cnx_id_callback_fn(quic, *retry_cid, *icid,
+                    quic->cnx_id_callback_ctx, retry_cid);
+            }
+
+            if (picoquic_cnx_by_id(quic, *retry_cid, NULL) == NULL) {
+                ret = 0;
+                break;
+            }
+        }
+    }
+
+    return ret;
+}
+
 /* Path management -- returns the index of the path that was created. */
 
 int picoquic_create_path(picoquic_cnx_t* cnx, uint64_t start_time, const struct sockaddr* local_addr, const struct sockaddr* peer_addr)
@@ -1859,7 +2025,7 @@ void picoquic_promote_path_to_default(picoquic_cnx_t* cnx, int path_index, uint6
             }
         }
 
-        if (cnx->quic->F_log != NULL || cnx->f_binlog != NULL) {
+        if (cnx->quic->F_log != NULL || PICOQUIC_CNX_HAS_BINLOG(cnx)) {
             char src_ip[128];
             char dst_ip[128];
 
@@ -4509,7 +4675,7 @@ void picoquic_delete_sooner_packets(picoquic_cnx_t* cnx)
 
     while (packet != NULL) {
         picoquic_stateless_packet_t* next_packet = packet->next_packet;
-        picoquic_delete_stateless_packet(packet);
+        picoquic_delete_stateless_packet(cnx->quic, packet);
         packet = next_packet;
     }
     cnx->first_sooner = NULL;
@@ -835,6 +835,7 @@ static size_t picoquic_protect_packet(picoquic_cnx_t* cnx,
     }
 
     /* Encrypt the packet */
+    PICOQUIC_PHASE_START(encrypt_start);
     if (cnx->is_multipath_enabled && ptype == picoquic_packet_1rtt_protected) {
         send_length = picoquic_aead_encrypt_mp(send_buffer + /* header_length */ h_length,
             bytes + header_length, length - header_length, path_x->p_remote_cnxid->sequence,
@@ -853,6 +854,7 @@ static size_t picoquic_protect_packet(picoquic_cnx_t* cnx,
     }
 
     send_length += /* header_length */ h_length;
+    PICOQUIC_PHASE_END(cnx->quic, picoquic_phase_encrypt, encrypt_start);
 
     /* if needed, log the segment before header protection is applied */
     picoquic_log_outgoing_packet(cnx, path_x,
@@ -1366,6 +1368,7 @@ void picoquic_finalize_and_protect_packet(picoquic_cnx_t *cnx,
         *send_length = length;
 
         if (length > 0) {
+            PICOQUIC_PROBE6(packet_sent, cnx, path_x, packet->ptype, packet->sequence_number, length, current_time);
             packet->checksum_overhead = checksum_overhead;
             picoquic_queue_for_retransmit(cnx, path_x, packet, length, current_time);
             path_x->last_sent_time = current_time;
@@ -1965,9 +1968,12 @@ void picoquic_implicit_handshake_ack(picoquic_cnx_t* cnx, picoquic_packet_contex
             ack_state.nb_bytes_delivered_since_packet_sent = old_path->delivered - p->delivered_prior;
             ack_state.is_app_limited = 1;
 
+            PICOQUIC_PHASE_START(cc_start);
             cnx->congestion_alg->alg_notify(cnx, old_path,
                 picoquic_congestion_notification_acknowledgement,
                 &ack_state, current_time);
+            PICOQUIC_PHASE_END(cnx->quic, picoquic_phase_cc_update, cc_start);
+            PICOQUIC_PROBE5(cc_notify, cnx, old_path, picoquic_congestion_notification_acknowledgement, old_path->cwin, old_path->bytes_in_transit);
         }
         /* Update the number of bytes in transit and remove old packet from queue */
         /* The packet will not be placed in the "retransmitted" queue */
@@ -2875,6 +2881,7 @@ void picoquic_ready_state_transition(picoquic_cnx_t* cnx, uint64_t current_time)
      * The handshake is complete, all the handshake packets are implicitly acknowledged */
     cnx->cnx_state = picoquic_state_ready;
     cnx->is_handshake_finished = 1;
+    PICOQUIC_METRICS_RECORD(cnx->quic, picoquic_metrics_handshake_time, current_time - cnx->start_time);
     picoquic_implicit_handshake_ack(cnx, picoquic_packet_context_initial, current_time);
     picoquic_implicit_handshake_ack(cnx, picoquic_packet_context_handshake, current_time);
 
@@ -3375,9 +3382,12 @@ int picoquic_prepare_packet_almost_ready(picoquic_cnx_t* cnx, picoquic_path_t* p
                     cnx->cwin_blocked = 1;
                     path_x->last_cwin_blocked_time = current_time;
                     if (cnx->congestion_alg != NULL) {
+                        PICOQUIC_PHASE_START(cc_start);
                         cnx->congestion_alg->alg_notify(cnx, path_x,
                             picoquic_congestion_notification_cwin_blocked,
                             &ack_state, current_time);
+                        PICOQUIC_PHASE_END(cnx->quic, picoquic_phase_cc_update, cc_start);
+                        PICOQUIC_PROBE5(cc_notify, cnx, path_x, picoquic_congestion_notification_cwin_blocked, path_x->cwin, path_x->bytes_in_transit);
                     }
                 }
                 else {
@@ -3726,9 +3736,12 @@ int picoquic_prepare_packet_ready(picoquic_cnx_t* cnx, picoquic_path_t* path_x,
                     if (cnx->congestion_alg != NULL) {
                         picoquic_per_ack_state_t ack_state = { 0 };
 
+                        PICOQUIC_PHASE_START(cc_start);
                         cnx->congestion_alg->alg_notify(cnx, path_x,
                             picoquic_congestion_notification_cwin_blocked,
                             &ack_state, current_time);
+                        PICOQUIC_PHASE_END(cnx->quic, picoquic_phase_cc_update, cc_start);
+                        PICOQUIC_PROBE5(cc_notify, cnx, path_x, picoquic_congestion_notification_cwin_blocked, path_x->cwin, path_x->bytes_in_transit);
                     }
                 }
                 else {
@@ -4444,6 +4457,10 @@ int picoquic_prepare_packet_ex(picoquic_cnx_t* cnx,
 
     ret = picoquic_check_idle_timer(cnx, &next_wake_time, current_time);
 
+    if (cnx->quic->perflog_snapshot_fn != NULL && current_time >= cnx->next_perflog_snapshot_time) {
+        cnx->quic->perflog_snapshot_fn(cnx, current_time);
+    }
+
     if (send_buffer_max < PICOQUIC_ENFORCED_INITIAL_MTU) {
         DBG_PRINTF("Invalid buffer size: %zu", send_buffer_max);
         ret = -1;
@@ -4511,8 +4528,10 @@ int picoquic_prepare_packet_ex(picoquic_cnx_t* cnx,
                     break;
                 }
                 else {
+                    PICOQUIC_PHASE_START(format_start);
                     ret = picoquic_prepare_segment(cnx, cnx->path[path_id], packet, current_time,
                         packet_buffer + packet_size, available, &segment_length, &next_wake_time, &is_initial_sent);
+                    PICOQUIC_PHASE_END(cnx->quic, picoquic_phase_packet_format, format_start);
 
                     if (ret == 0) {
                         packet_size += segment_length;
@@ -4557,6 +4576,7 @@ int picoquic_prepare_packet_ex(picoquic_cnx_t* cnx,
                     cnx->max_mtu_sent = packet_size;
                 }
                 cnx->nb_packets_sent++;
+                PICOQUIC_METRICS_ADD(cnx->quic, picoquic_metrics_packets_sent, 1);
                 /* if needed, log that the packet is sent */
                 if (p_addr_to != NULL && p_addr_from != NULL) {
                     picoquic_log_pdu(cnx, 0, current_time,
@@ -4586,16 +4606,20 @@ int picoquic_prepare_packet_ex(picoquic_cnx_t* cnx,
                     if (packet_size == 0 && *send_length < 8*(*send_msg_size)) {
                         if (cnx->path[path_id]->cwin <= cnx->path[path_id]->bytes_in_transit) {
                             cnx->nb_trains_blocked_cwin++;
+                            PICOQUIC_METRICS_ADD(cnx->quic, picoquic_metrics_trains_blocked_cwin, 1);
                         }
                         else if (cnx->path[path_id]->pacing_bucket_nanosec < cnx->path[path_id]->pacing_packet_time_nanosec){
                             cnx->nb_trains_blocked_pacing++;
+                            PICOQUIC_METRICS_ADD(cnx->quic, picoquic_metrics_trains_blocked_pacing, 1);
                         }
                         else {
                             cnx->nb_trains_blocked_others++;
+                            PICOQUIC_METRICS_ADD(cnx->quic, picoquic_metrics_trains_blocked_others, 1);
                         }
                     }
                     else {
                         cnx->nb_trains_short++;
+                        PICOQUIC_METRICS_ADD(cnx->quic, picoquic_metrics_trains_short, 1);
                     }
                 }
                 break;
@@ -4606,6 +4630,11 @@ int picoquic_prepare_packet_ex(picoquic_cnx_t* cnx,
         }
         if (*send_length > 0) {
             cnx->nb_trains_sent++;
+            if (cnx->quic->metrics != NULL) {
+                size_t msg_size = (send_msg_size == NULL || *send_msg_size == 0) ? *send_length : *send_msg_size;
+                picoquic_metrics_add(cnx->quic, picoquic_metrics_trains_sent, 1);
+                picoquic_metrics_record(cnx->quic, picoquic_metrics_train_packets, (*send_length + msg_size - 1) / msg_size);
+            }
         }
     }
 
@@ -4689,7 +4718,7 @@ int picoquic_prepare_next_packet_ex(picoquic_quic_t* quic,
                 *log_cid = sp->initial_cid;
             }
         }
-        picoquic_delete_stateless_packet(sp);
+        picoquic_delete_stateless_packet(quic, sp);
     }
     else {
         picoquic_cnx_t* cnx = picoquic_get_earliest_cnx_to_wake(quic, current_time);
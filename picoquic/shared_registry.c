@@ -0,0 +1,338 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Shared registry of issued tickets and registered tokens.
+ *
+ * Each stripe holds a hash table of issued tickets organized as an LRU
+ * list, and a splay tree of registered tokens ordered by expiry time,
+ * the same structures used in a single QUIC context. The stripe is
+ * selected by the ticket ID or the token hash, both of which are random,
+ * so the load spreads evenly across stripes.
+ */
+
+#include "tls_api.h"
+#include "picoquic_internal.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+picoquic_shared_registry_t* picoquic_shared_registry_create(size_t max_tickets, size_t max_tokens,
+    uint64_t ticket_lifetime, const uint8_t* secret, size_t secret_length)
+{
+    int ret = 0;
+    picoquic_shared_registry_t* registry = (picoquic_shared_registry_t*)malloc(sizeof(picoquic_shared_registry_t));
+
+    if (registry != NULL) {
+        int nb_stripes_init = 0;
+        memset(registry, 0, sizeof(picoquic_shared_registry_t));
+        registry->nb_references = 1;
+        registry->max_tickets_per_stripe = (max_tickets + PICOQUIC_SHARED_REGISTRY_STRIPES - 1) / PICOQUIC_SHARED_REGISTRY_STRIPES;
+        registry->max_tokens_per_stripe = (max_tokens + PICOQUIC_SHARED_REGISTRY_STRIPES - 1) / PICOQUIC_SHARED_REGISTRY_STRIPES;
+        registry->ticket_lifetime = ticket_lifetime;
+        if (registry->max_tickets_per_stripe == 0) {
+            registry->max_tickets_per_stripe = 1;
+        }
+        if (registry->max_tokens_per_stripe == 0) {
+            registry->max_tokens_per_stripe = 1;
+        }
+        if (secret != NULL && secret_length > 0) {
+            if (secret_length > sizeof(registry->ticket_secret)) {
+                secret_length = sizeof(registry->ticket_secret);
+            }
+            memcpy(registry->ticket_secret, secret, secret_length);
+            registry->is_secret_set = 1;
+        }
+
+        ret = picoquic_create_mutex(&registry->mutex);
+
+        for (int i = 0; ret == 0 && i < PICOQUIC_SHARED_REGISTRY_STRIPES; i++) {
+            picoquic_registry_stripe_t* stripe = &registry->stripe[i];
+
+            picoquic_init_registered_token_tree(&stripe->token_reuse_tree);
+            if ((stripe->table_issued_tickets = picoquic_create_issued_ticket_table(registry->max_tickets_per_stripe)) == NULL) {
+                ret = PICOQUIC_ERROR_MEMORY;
+            }
+            else if ((ret = picoquic_create_mutex(&stripe->mutex)) != 0) {
+                picohash_delete(stripe->table_issued_tickets, 1);
+                stripe->table_issued_tickets = NULL;
+            }
+            else {
+                nb_stripes_init++;
+            }
+        }
+
+        if (ret != 0) {
+            for (int i = 0; i < nb_stripes_init; i++) {
+                picohash_delete(registry->stripe[i].table_issued_tickets, 1);
+                (void)picoquic_delete_mutex(&registry->stripe[i].mutex);
+            }
+            free(registry);
+            registry = NULL;
+        }
+    }
+
+    return registry;
+}
+
+static void picoquic_shared_registry_delete(picoquic_shared_registry_t* registry)
+{
+    for (int i = 0; i < PICOQUIC_SHARED_REGISTRY_STRIPES; i++) {
+        picoquic_registry_stripe_t* stripe = &registry->stripe[i];
+
+        picosplay_empty_tree(&stripe->token_reuse_tree);
+        picohash_delete(stripe->table_issued_tickets, 1);
+        (void)picoquic_delete_mutex(&stripe->mutex);
+    }
+    (void)picoquic_delete_mutex(&registry->mutex);
+    memset(registry->ticket_secret, 0, sizeof(registry->ticket_secret));
+    free(registry);
+}
+
+void picoquic_shared_registry_release(picoquic_shared_registry_t* registry)
+{
+    int nb_references;
+
+    (void)picoquic_lock_mutex(&registry->mutex);
+    nb_references = --registry->nb_references;
+    (void)picoquic_unlock_mutex(&registry->mutex);
+
+    if (nb_references <= 0) {
+        picoquic_shared_registry_delete(registry);
+    }
+}
+
+int picoquic_attach_shared_registry(picoquic_quic_t* quic, picoquic_shared_registry_t* registry)
+{
+    int ret = 0;
+
+    if (quic->shared_registry != NULL || quic->cnx_list != NULL) {
+        ret = -1;
+    }
+    else {
+        (void)picoquic_lock_mutex(&registry->mutex);
+        if (!registry->is_secret_set) {
+            picoquic_crypto_random(quic, registry->ticket_secret, sizeof(registry->ticket_secret));
+            registry->is_secret_set = 1;
+        }
+        ret = picoquic_set_ticket_secret(quic, registry->ticket_secret, sizeof(registry->ticket_secret));
+        if (ret == 0) {
+            registry->nb_references++;
+            quic->shared_registry = registry;
+        }
+        (void)picoquic_unlock_mutex(&registry->mutex);
+    }
+
+    return ret;
+}
+
+/* Issued tickets. Must be called with the stripe locked. */
+
+static void picoquic_stripe_delete_ticket(picoquic_registry_stripe_t* stripe, picoquic_issued_ticket_t* ticket)
+{
+    if (ticket->next_ticket == NULL) {
+        stripe->table_issued_tickets_last = ticket->previous_ticket;
+    }
+    else {
+        ticket->next_ticket->previous_ticket = ticket->previous_ticket;
+    }
+
+    if (ticket->previous_ticket == NULL) {
+        stripe->table_issued_tickets_first = ticket->next_ticket;
+    }
+    else {
+        ticket->previous_ticket->next_ticket = ticket->next_ticket;
+    }
+
+    picohash_delete_item(stripe->table_issued_tickets, &ticket->hash_item, 1);
+
+    if (stripe->table_issued_tickets_nb > 0) {
+        stripe->table_issued_tickets_nb--;
+    }
+}
+
+/* A lifetime of 0 disables time-based eviction. The age is computed by
+ * subtraction, so that very large lifetimes do not overflow. */
+static void picoquic_stripe_expire_tickets(picoquic_shared_registry_t* registry,
+    picoquic_registry_stripe_t* stripe, uint64_t current_time)
+{
+    while (registry->ticket_lifetime > 0 && stripe->table_issued_tickets_last != NULL &&
+        current_time > stripe->table_issued_tickets_last->creation_time &&
+        current_time - stripe->table_issued_tickets_last->creation_time > registry->ticket_lifetime) {
+        picoquic_stripe_delete_ticket(stripe, stripe->table_issued_tickets_last);
+    }
+}
+
+static picoquic_issued_ticket_t* picoquic_stripe_find_ticket(picoquic_registry_stripe_t* stripe, uint64_t ticket_id)
+{
+    picoquic_issued_ticket_t key;
+    picohash_item* item;
+
+    memset(&key, 0, sizeof(key));
+    key.ticket_id = ticket_id;
+    item = picohash_retrieve(stripe->table_issued_tickets, &key);
+
+    return (item == NULL) ? NULL : (picoquic_issued_ticket_t*)item->key;
+}
+
+int picoquic_shared_registry_remember_ticket(picoquic_shared_registry_t* registry,
+    uint64_t ticket_id, uint64_t rtt, uint64_t cwin, const uint8_t* ip_addr, uint8_t ip_addr_length,
+    uint64_t current_time)
+{
+    int ret = 0;
+    picoquic_registry_stripe_t* stripe = &registry->stripe[ticket_id % PICOQUIC_SHARED_REGISTRY_STRIPES];
+    picoquic_issued_ticket_t* ticket;
+
+    if (ip_addr_length > PICOQUIC_STORED_IP_MAX) {
+        ip_addr_length = PICOQUIC_STORED_IP_MAX;
+    }
+
+    (void)picoquic_lock_mutex(&stripe->mutex);
+
+    picoquic_stripe_expire_tickets(registry, stripe, current_time);
+
+    if ((ticket = picoquic_stripe_find_ticket(stripe, ticket_id)) == NULL) {
+        while (stripe->table_issued_tickets_nb >= registry->max_tickets_per_stripe) {
+            picoquic_stripe_delete_ticket(stripe, stripe->table_issued_tickets_last);
+        }
+        ticket = (picoquic_issued_ticket_t*)malloc(sizeof(picoquic_issued_ticket_t));
+        if (ticket != NULL) {
+            memset(ticket, 0, sizeof(picoquic_issued_ticket_t));
+            ticket->ticket_id = ticket_id;
+            ticket->creation_time = current_time;
+            ticket->next_ticket = stripe->table_issued_tickets_first;
+            stripe->table_issued_tickets_first = ticket;
+            if (ticket->next_ticket == NULL) {
+                stripe->table_issued_tickets_last = ticket;
+            }
+            else {
+                ticket->next_ticket->previous_ticket = ticket;
+            }
+            picohash_insert(stripe->table_issued_tickets, ticket);
+            stripe->table_issued_tickets_nb++;
+        }
+        else {
+            ret = PICOQUIC_ERROR_MEMORY;
+        }
+    }
+
+    if (ticket != NULL) {
+        ticket->ip_addr_length = ip_addr_length;
+        memcpy(ticket->ip_addr, ip_addr, ip_addr_length);
+        ticket->rtt = rtt;
+        ticket->cwin = cwin;
+    }
+
+    (void)picoquic_unlock_mutex(&stripe->mutex);
+
+    return ret;
+}
+
+int picoquic_shared_registry_retrieve_ticket(picoquic_shared_registry_t* registry,
+    uint64_t ticket_id, picoquic_issued_ticket_t* ticket, uint64_t current_time)
+{
+    int ret = -1;
+    picoquic_registry_stripe_t* stripe = &registry->stripe[ticket_id % PICOQUIC_SHARED_REGISTRY_STRIPES];
+    picoquic_issued_ticket_t* found;
+
+    (void)picoquic_lock_mutex(&stripe->mutex);
+
+    picoquic_stripe_expire_tickets(registry, stripe, current_time);
+
+    if ((found = picoquic_stripe_find_ticket(stripe, ticket_id)) != NULL) {
+        memcpy(ticket, found, sizeof(picoquic_issued_ticket_t));
+        ticket->next_ticket = NULL;
+        ticket->previous_ticket = NULL;
+        ret = 0;
+    }
+
+    (void)picoquic_unlock_mutex(&stripe->mutex);
+
+    return ret;
+}
+
+/* Token reuse detection. Must be called with the stripe locked. */
+
+static void picoquic_stripe_clear_tokens(picoquic_registry_stripe_t* stripe, uint64_t expiry_time_max)
+{
+    picoquic_registered_token_t* rt_first;
+
+    while ((rt_first = (picoquic_registered_token_t*)picoquic_registered_token_value(
+        picosplay_first(&stripe->token_reuse_tree))) != NULL && rt_first->token_time < expiry_time_max) {
+        picosplay_delete_hint(&stripe->token_reuse_tree, &rt_first->registered_token_node);
+    }
+}
+
+int picoquic_shared_registry_check_reuse(picoquic_shared_registry_t* registry,
+    const uint8_t* token, size_t token_length, uint64_t expiry_time, uint64_t current_time)
+{
+    int ret = -1;
+
+    if (token_length >= 8) {
+        uint64_t token_hash = PICOPARSE_64(token + token_length - 8);
+        picoquic_registry_stripe_t* stripe = &registry->stripe[token_hash % PICOQUIC_SHARED_REGISTRY_STRIPES];
+        picoquic_registered_token_t* rt = (picoquic_registered_token_t*)malloc(sizeof(picoquic_registered_token_t));
+
+        if (rt != NULL) {
+            picosplay_node_t* rt_n = NULL;
+            memset(rt, 0, sizeof(picoquic_registered_token_t));
+            rt->token_time = expiry_time;
+            rt->token_hash = token_hash;
+            rt->count = 1;
+
+            (void)picoquic_lock_mutex(&stripe->mutex);
+
+            picoquic_stripe_clear_tokens(stripe, current_time);
+            rt_n = picosplay_find(&stripe->token_reuse_tree, rt);
+            if (rt_n != NULL) {
+                free(rt);
+                rt = (picoquic_registered_token_t*)picoquic_registered_token_value(rt_n);
+                rt->count++;
+                DBG_PRINTF("Token reuse detected, count=%d", rt->count);
+            }
+            else if ((size_t)stripe->token_reuse_tree.size >= registry->max_tokens_per_stripe) {
+                /* Tokens are only forgotten when they expire. Evicting them
+                 * earlier would let a flood of new tokens erase the record of
+                 * a used token, which could then be replayed. If the stripe is
+                 * full, reject the token, so the client is sent a Retry. */
+                free(rt);
+            }
+            else {
+                (void)picosplay_insert(&stripe->token_reuse_tree, rt);
+                ret = 0;
+            }
+
+            (void)picoquic_unlock_mutex(&stripe->mutex);
+        }
+    }
+
+    return ret;
+}
+
+void picoquic_shared_registry_clear_tokens(picoquic_shared_registry_t* registry, uint64_t expiry_time_max)
+{
+    for (int i = 0; i < PICOQUIC_SHARED_REGISTRY_STRIPES; i++) {
+        picoquic_registry_stripe_t* stripe = &registry->stripe[i];
+
+        (void)picoquic_lock_mutex(&stripe->mutex);
+        picoquic_stripe_clear_tokens(stripe, expiry_time_max);
+        (void)picoquic_unlock_mutex(&stripe->mutex);
+    }
+}
@@ -630,10 +630,12 @@ int picoquic_packet_loop_select(picoquic_socket_ctx_t* s_ctx,
         {
             for (int i = 0; i < nb_sockets; i++) {
                 if (FD_ISSET(s_ctx[i].fd, &readfds)) {
+                    PICOQUIC_PHASE_START(recv_start);
                     *socket_rank = i;
                     bytes_recv = picoquic_recvmsg(s_ctx[i].fd, addr_from,
                         addr_dest, dest_if, received_ecn,
                         buffer, buffer_max);
+                    PICOQUIC_PHASE_END(thread_ctx->quic, picoquic_phase_socket_recv, recv_start);
 
                     if (bytes_recv <= 0) {
                         DBG_PRINTF("Could not receive packet on UDP socket[%d]= %d!\n",
@@ -826,6 +828,9 @@ void* picoquic_packet_loop_v3(void* v_ctx)
                 if (ret == 0 && current_time < next_send_time) {
                     /* Try to receive more packets if possible */
                     loop_immediate = 1;
+                    if (quic->metrics != NULL) {
+                        picoquic_metrics_record(quic, picoquic_metrics_loop_time, picoquic_current_time() - loop_time);
+                    }
                     continue;
                 }
                 else {
@@ -899,9 +904,11 @@ void* picoquic_packet_loop_v3(void* v_ctx)
                         param->simulate_eio = 0;
                     }
                     else {
+                        PICOQUIC_PHASE_START(send_start);
                         sock_ret = picoquic_sendmsg(send_socket,
                             (struct sockaddr*)&peer_addr, (struct sockaddr*)&local_addr, if_index,
                             (const char*)send_buffer, (int)send_length, (int)send_msg_size, &sock_err);
+                        PICOQUIC_PHASE_END(quic, picoquic_phase_socket_send, send_start);
                     }
 
                     if (sock_ret <= 0) {
@@ -962,6 +969,11 @@ void* picoquic_packet_loop_v3(void* v_ctx)
                 }
             }
 
+            if (quic->metrics != NULL) {
+                picoquic_metrics_record(quic, picoquic_metrics_loop_time, picoquic_current_time() - loop_time);
+                picoquic_metrics_sample_pools(quic);
+            }
+
             if (ret == 0 && loop_callback != NULL) {
                 ret = loop_callback(quic, picoquic_packet_loop_after_send, loop_callback_ctx, &bytes_sent);
             }
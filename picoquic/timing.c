@@ -103,9 +103,12 @@ static void picoquic_validate_bdp_seed(picoquic_cnx_t* cnx, picoquic_path_t* pat
             picoquic_per_ack_state_t ack_state = { 0 };
             ack_state.nb_bytes_acknowledged = (uint64_t)cnx->seed_cwin;
             cnx->cwin_notified_from_seed = 1;
+            PICOQUIC_PHASE_START(cc_start);
             cnx->congestion_alg->alg_notify(cnx, path_x,
                 picoquic_congestion_notification_seed_cwin,
                 &ack_state, current_time);
+            PICOQUIC_PHASE_END(cnx->quic, picoquic_phase_cc_update, cc_start);
+            PICOQUIC_PROBE5(cc_notify, cnx, path_x, picoquic_congestion_notification_seed_cwin, path_x->cwin, path_x->bytes_in_transit);
         }
     }
 }
@@ -195,6 +198,10 @@ void picoquic_update_path_rtt(picoquic_cnx_t* cnx, picoquic_path_t* old_path, pi
             }
         }
         old_path->rtt_sample = rtt_estimate;
+        if (cnx->quic->metrics != NULL) {
+            picoquic_metrics_record(cnx->quic, picoquic_metrics_rtt, rtt_estimate);
+            picoquic_metrics_record(cnx->quic, picoquic_metrics_cwin, old_path->cwin);
+        }
 #ifdef PICOQUIC_TESTING_CLASSIC_RTT_COMPUTATION
         if (is_first) {
             old_path->smoothed_rtt = rtt_estimate;
@@ -340,9 +347,12 @@ void picoquic_update_path_rtt(picoquic_cnx_t* cnx, picoquic_path_t* old_path, pi
             picoquic_per_ack_state_t ack_state = { 0 };
             ack_state.rtt_measurement = rtt_estimate;
             ack_state.one_way_delay = (cnx->is_time_stamp_enabled) ? old_path->one_way_delay_sample : 0;
+            PICOQUIC_PHASE_START(cc_start);
             cnx->congestion_alg->alg_notify(cnx, old_path,
                 picoquic_congestion_notification_rtt_measurement,
                 &ack_state, current_time);
+            PICOQUIC_PHASE_END(cnx->quic, picoquic_phase_cc_update, cc_start);
+            PICOQUIC_PROBE5(cc_notify, cnx, old_path, picoquic_congestion_notification_rtt_measurement, old_path->cwin, old_path->bytes_in_transit);
         }
 
         /* On very first sample, apply the saved BDP */
@@ -604,7 +604,10 @@ int picoquic_set_tls_root_certificates(picoquic_quic_t* quic, ptls_iovec_t* cert
 {
     int ret = -1;
 
-    if (picoquic_set_tls_root_certificates_fn != NULL) {
+    if (picoquic_set_tls_root_certificates_fn != NULL &&
+        (quic->shared_tls_master == NULL ||
+            ((ptls_context_t*)quic->tls_master_ctx)->verify_certificate != quic->shared_tls_master->verify_certificate)) {
+        /* The verifier of a shared master context is immutable */
         if ((ret = picoquic_set_tls_root_certificates_fn(quic->tls_master_ctx, certs, count)) == 0){
             quic->is_cert_store_not_empty = 1;
         }
@@ -1082,21 +1085,21 @@ int picoquic_server_encrypt_ticket_call_back(ptls_encrypt_ticket_t* encrypt_tick
                         picoquic_supported_versions[quic->cnx_in_progress->version_index].version, version_number);
                 }
                 else {
-                    picoquic_issued_ticket_t* server_ticket;
+                    picoquic_issued_ticket_t server_ticket;
                     dst->off += decrypted - 4;
                     picoquic_log_app_message(quic->cnx_in_progress, "%s",
                         "Session ticket properly decrypted");
                     /* Remember resumed ticket ID in connection context */
                     quic->cnx_in_progress->resumed_ticket_id = seq_num;
                     /* Remember rtt and cwin from ticket */
-                    server_ticket = picoquic_retrieve_issued_ticket(quic, seq_num);
-                    if (server_ticket != NULL && server_ticket->cwin > 0) {
+                    if (picoquic_retrieve_issued_ticket(quic, seq_num, &server_ticket) == 0 &&
+                        server_ticket.cwin > 0) {
                         picoquic_seed_bandwidth(
                             quic->cnx_in_progress,
-                            server_ticket->rtt,
-                            server_ticket->cwin,
-                            server_ticket->ip_addr,
-                            server_ticket->ip_addr_length);
+                            server_ticket.rtt,
+                            server_ticket.cwin,
+                            server_ticket.ip_addr,
+                            server_ticket.ip_addr_length);
                     }
                 }
             }
@@ -1169,7 +1172,10 @@ void picoquic_dispose_verify_certificate_callback(picoquic_quic_t* quic) {
     ptls_context_t* ctx = (ptls_context_t*)quic->tls_master_ctx;
 
     if (ctx->verify_certificate != NULL){
-        if (quic->is_cert_verifier_custom) {
+        if (quic->shared_tls_master != NULL && ctx->verify_certificate == quic->shared_tls_master->verify_certificate) {
+            /* Owned by the shared master context */
+        }
+        else if (quic->is_cert_verifier_custom) {
             if (quic->free_verify_certificate_callback_fn != NULL) {
                 (quic->free_verify_certificate_callback_fn)(ctx->verify_certificate);
                 quic->free_verify_certificate_callback_fn = NULL;
@@ -1371,6 +1377,161 @@ int picoquic_setup_initial_secrets(
     return ret;
 }
 
+/*
+ * Cache of the salted HMAC state used for the initial master secret.
+ * HKDF-Extract(salt, CID) is HMAC-Hash(salt, CID), i.e.,
+ *     H((salt ^ opad) || H((salt ^ ipad) || CID))
+ * The salt only depends on the version, so the hash states after absorbing
+ * the inner and outer padded keys are computed once per version and cloned
+ * for each derivation, saving two of the four compression function calls.
+ */
+typedef struct st_picoquic_initial_salt_ctx_t {
+    ptls_hash_algorithm_t* algo;
+    ptls_hash_context_t* inner;
+    ptls_hash_context_t* outer;
+} picoquic_initial_salt_ctx_t;
+
+static void picoquic_delete_initial_salt_ctx(picoquic_initial_salt_ctx_t* salt_ctx)
+{
+    if (salt_ctx->inner != NULL) {
+        salt_ctx->inner->final(salt_ctx->inner, NULL, PTLS_HASH_FINAL_MODE_FREE);
+    }
+    if (salt_ctx->outer != NULL) {
+        salt_ctx->outer->final(salt_ctx->outer, NULL, PTLS_HASH_FINAL_MODE_FREE);
+    }
+    free(salt_ctx);
+}
+
+void* picoquic_create_initial_salt_ctx(ptls_cipher_suite_t* cipher, ptls_iovec_t salt)
+{
+    picoquic_initial_salt_ctx_t* salt_ctx = NULL;
+    ptls_hash_algorithm_t* algo = cipher->hash;
+    uint8_t key_block[PTLS_MAX_DIGEST_SIZE * 2]; /* Block size is at most 128 bytes */
+
+    if (algo->block_size <= sizeof(key_block) &&
+        (salt_ctx = (picoquic_initial_salt_ctx_t*)malloc(sizeof(picoquic_initial_salt_ctx_t))) != NULL) {
+        memset(salt_ctx, 0, sizeof(picoquic_initial_salt_ctx_t));
+        salt_ctx->algo = algo;
+        salt_ctx->inner = algo->create();
+        salt_ctx->outer = algo->create();
+
+        if (salt_ctx->inner == NULL || salt_ctx->outer == NULL || salt_ctx->inner->clone_ == NULL) {
+            picoquic_delete_initial_salt_ctx(salt_ctx);
+            salt_ctx = NULL;
+        }
+        else {
+            memset(key_block, 0, algo->block_size);
+            if (salt.len > algo->block_size) {
+                /* Longer keys are replaced by their hash, as specified in RFC 2104 */
+                ptls_calc_hash(algo, key_block, salt.base, salt.len);
+            }
+            else if (salt.len > 0) {
+                memcpy(key_block, salt.base, salt.len);
+            }
+
+            for (size_t i = 0; i < algo->block_size; i++) {
+                key_block[i] ^= 0x36;
+            }
+            salt_ctx->inner->update(salt_ctx->inner, key_block, algo->block_size);
+            for (size_t i = 0; i < algo->block_size; i++) {
+                key_block[i] ^= 0x36 ^ 0x5c;
+            }
+            salt_ctx->outer->update(salt_ctx->outer, key_block, algo->block_size);
+            ptls_clear_memory(key_block, sizeof(key_block));
+        }
+    }
+
+    return salt_ctx;
+}
+
+void picoquic_free_initial_salt_ctx(void* salt_ctx)
+{
+    if (salt_ctx != NULL) {
+        picoquic_delete_initial_salt_ctx((picoquic_initial_salt_ctx_t*)salt_ctx);
+    }
+}
+
+int picoquic_setup_initial_master_secret_cached(void* v_salt_ctx,
+    picoquic_connection_id_t initial_cnxid, uint8_t* master_secret)
+{
+    int ret = 0;
+    picoquic_initial_salt_ctx_t* salt_ctx = (picoquic_initial_salt_ctx_t*)v_salt_ctx;
+    ptls_hash_context_t* inner = salt_ctx->inner->clone_(salt_ctx->inner);
+    ptls_hash_context_t* outer = salt_ctx->outer->clone_(salt_ctx->outer);
+    uint8_t inner_digest[PTLS_MAX_DIGEST_SIZE];
+
+    if (inner == NULL || outer == NULL) {
+        ret = PICOQUIC_ERROR_MEMORY;
+        if (inner != NULL) {
+            inner->final(inner, NULL, PTLS_HASH_FINAL_MODE_FREE);
+        }
+        if (outer != NULL) {
+            outer->final(outer, NULL, PTLS_HASH_FINAL_MODE_FREE);
+        }
+    }
+    else {
+        inner->update(inner, initial_cnxid.id, initial_cnxid.id_len);
+        inner->final(inner, inner_digest, PTLS_HASH_FINAL_MODE_FREE);
+        outer->update(outer, inner_digest, salt_ctx->algo->digest_size);
+        outer->final(outer, master_secret, PTLS_HASH_FINAL_MODE_FREE);
+        ptls_clear_memory(inner_digest, sizeof(inner_digest));
+    }
+
+    return ret;
+}
+
+/* Find or create the salt context for a version, as for retry protection contexts.
+ * If the contexts cannot be created, the cache is disabled, so that the
+ * following connections use the plain derivation without trying again. */
+static void* picoquic_find_initial_salt_ctx(picoquic_quic_t* quic, int version_index, ptls_cipher_suite_t* cipher)
+{
+    picoquic_initial_salt_ctx_t* salt_ctx = NULL;
+
+    if (quic->is_initial_salt_cache_disabled) {
+        return NULL;
+    }
+
+    if (quic->initial_salt_ctx == NULL) {
+        quic->initial_salt_ctx = (void**)malloc(sizeof(void*) * picoquic_nb_supported_versions);
+        if (quic->initial_salt_ctx != NULL) {
+            memset(quic->initial_salt_ctx, 0, sizeof(void*) * picoquic_nb_supported_versions);
+        }
+        else {
+            quic->is_initial_salt_cache_disabled = 1;
+        }
+    }
+
+    if (quic->initial_salt_ctx != NULL) {
+        salt_ctx = (picoquic_initial_salt_ctx_t*)quic->initial_salt_ctx[version_index];
+        if (salt_ctx != NULL && salt_ctx->algo != cipher->hash) {
+            picoquic_delete_initial_salt_ctx(salt_ctx);
+            salt_ctx = NULL;
+        }
+        if (salt_ctx == NULL) {
+            ptls_iovec_t salt;
+            picoquic_setup_cleartext_aead_salt(version_index, &salt);
+            salt_ctx = (picoquic_initial_salt_ctx_t*)picoquic_create_initial_salt_ctx(cipher, salt);
+            if (salt_ctx == NULL) {
+                quic->is_initial_salt_cache_disabled = 1;
+            }
+        }
+        quic->initial_salt_ctx[version_index] = salt_ctx;
+    }
+
+    return salt_ctx;
+}
+
+void picoquic_delete_initial_salt_contexts(picoquic_quic_t* quic)
+{
+    if (quic->initial_salt_ctx != NULL) {
+        for (size_t i = 0; i < picoquic_nb_supported_versions; i++) {
+            picoquic_free_initial_salt_ctx(quic->initial_salt_ctx[i]);
+        }
+        free(quic->initial_salt_ctx);
+        quic->initial_salt_ctx = NULL;
+    }
+}
+
 int picoquic_setup_initial_traffic_keys(picoquic_cnx_t* cnx)
 {
     int ret = 0;
@@ -1386,10 +1547,21 @@ int picoquic_setup_initial_traffic_keys(picoquic_cnx_t* cnx)
         ret = -1;
     }
     else {
-        picoquic_setup_cleartext_aead_salt(cnx->version_index, &salt);
+        void* salt_ctx = picoquic_find_initial_salt_ctx(cnx->quic, cnx->version_index, cipher);
+
+        if (salt_ctx != NULL &&
+            picoquic_setup_initial_master_secret_cached(salt_ctx, cnx->initial_cnxid, master_secret) != 0) {
+            /* The hash contexts could not be cloned, stop using the cache */
+            cnx->quic->is_initial_salt_cache_disabled = 1;
+            picoquic_delete_initial_salt_contexts(cnx->quic);
+            salt_ctx = NULL;
+        }
+        if (salt_ctx == NULL) {
+            picoquic_setup_cleartext_aead_salt(cnx->version_index, &salt);
 
-        /* Extract the master key -- key length will be 32 per SHA256 */
-        ret = picoquic_setup_initial_master_secret(cipher, salt, cnx->initial_cnxid, master_secret);
+            /* Extract the master key -- key length will be 32 per SHA256 */
+            ret = picoquic_setup_initial_master_secret(cipher, salt, cnx->initial_cnxid, master_secret);
+        }
     }
 
     /* set up client and server secrets */
@@ -1576,14 +1748,141 @@ void picoquic_crypto_context_free(picoquic_crypto_context_t * ctx)
     }
 }
 
+/*
+ * Shared TLS master context: certificate chain, signer, verifier and ticket
+ * key, loaded once and used by several QUIC contexts. The ptls contexts
+ * themselves are not shared, because their callbacks refer to a specific
+ * QUIC context, but they point to the shared objects instead of copies.
+ * The ticket AEAD contexts are not thread safe, so each QUIC context creates
+ * its own from the shared key.
+ */
+struct st_picoquic_tls_master_t {
+    picoquic_mutex_t mutex;
+    int nb_references;
+    ptls_iovec_t* certificates;
+    size_t nb_certificates;
+    ptls_sign_certificate_t* sign_certificate;
+    ptls_verify_certificate_t* verify_certificate;
+    unsigned int is_cert_store_not_empty;
+    uint8_t ticket_key[PTLS_MAX_DIGEST_SIZE];
+};
+
+static void free_certificates_list(ptls_iovec_t* certs, size_t len);
+
+static void picoquic_tls_master_delete(picoquic_tls_master_t* master)
+{
+    free_certificates_list(master->certificates, master->nb_certificates);
+
+    if (master->sign_certificate != NULL) {
+        picoquic_dispose_sign_certificate(master->sign_certificate);
+        free(master->sign_certificate);
+    }
+
+    if (master->verify_certificate != NULL) {
+        picoquic_dispose_certificate_verifier(master->verify_certificate);
+        free(master->verify_certificate);
+    }
+
+    ptls_clear_memory(master->ticket_key, sizeof(master->ticket_key));
+    (void)picoquic_delete_mutex(&master->mutex);
+    free(master);
+}
+
+picoquic_tls_master_t* picoquic_tls_master_create(char const* cert_file_name, char const* key_file_name,
+    char const* cert_root_file_name, const uint8_t* ticket_encryption_key, size_t ticket_encryption_key_length)
+{
+    int ret = 0;
+    picoquic_tls_master_t* master = NULL;
+    ptls_context_t ctx;
+
+    picoquic_tls_api_init();
+
+    memset(&ctx, 0, sizeof(ptls_context_t));
+    picoquic_set_random_provider_in_ctx(&ctx);
+
+    if (cert_file_name != NULL && key_file_name != NULL) {
+        /* Load the certificates and the key in a temporary context */
+        if (ptls_load_certificates(&ctx, (char*)cert_file_name) != 0) {
+            DBG_PRINTF("Cannot load certificate: %s", cert_file_name);
+            ret = -1;
+        }
+        else {
+            ret = set_private_key_from_file(key_file_name, &ctx);
+            if (ret != 0) {
+                DBG_PRINTF("Cannot load key: %s, ret = 0x%x", key_file_name, ret);
+            }
+        }
+    }
+
+    if (ret == 0) {
+        master = (picoquic_tls_master_t*)malloc(sizeof(picoquic_tls_master_t));
+        if (master == NULL) {
+            ret = PICOQUIC_ERROR_MEMORY;
+        }
+        else {
+            memset(master, 0, sizeof(picoquic_tls_master_t));
+            if (picoquic_create_mutex(&master->mutex) != 0) {
+                free(master);
+                master = NULL;
+                ret = PICOQUIC_ERROR_MEMORY;
+            }
+        }
+    }
+
+    if (ret == 0) {
+        master->nb_references = 1;
+        master->certificates = ctx.certificates.list;
+        master->nb_certificates = ctx.certificates.count;
+        master->sign_certificate = ctx.sign_certificate;
+        master->verify_certificate = picoquic_get_certificate_verifier(cert_root_file_name, &master->is_cert_store_not_empty);
+
+        if (ticket_encryption_key != NULL && ticket_encryption_key_length > 0) {
+            memcpy(master->ticket_key, ticket_encryption_key,
+                (ticket_encryption_key_length > sizeof(master->ticket_key)) ? sizeof(master->ticket_key) : ticket_encryption_key_length);
+        }
+        else {
+            ctx.random_bytes(master->ticket_key, sizeof(master->ticket_key));
+        }
+    }
+    else {
+        free_certificates_list(ctx.certificates.list, ctx.certificates.count);
+        if (ctx.sign_certificate != NULL) {
+            picoquic_dispose_sign_certificate(ctx.sign_certificate);
+            free(ctx.sign_certificate);
+        }
+    }
+
+    return master;
+}
+
+void picoquic_tls_master_release(picoquic_tls_master_t* master)
+{
+    int nb_references;
+
+    (void)picoquic_lock_mutex(&master->mutex);
+    nb_references = --master->nb_references;
+    (void)picoquic_unlock_mutex(&master->mutex);
+
+    if (nb_references <= 0) {
+        picoquic_tls_master_delete(master);
+    }
+}
+
+int picoquic_tls_master_has_certificate(picoquic_tls_master_t* master)
+{
+    return (master->nb_certificates > 0 && master->sign_certificate != NULL);
+}
+
 /*
  * Setting the master TLS context.
- * On servers, this implies setting the "on hello" call back
+ * On servers, this implies setting the "on hello" call back.
+ * If a shared master is provided, the certificates, signer, verifier and
+ * ticket key are taken from it instead of being loaded from files.
  */
 
-int picoquic_master_tlscontext(picoquic_quic_t* quic,
+static int picoquic_master_tlscontext_ex(picoquic_quic_t* quic,
     char const* cert_file_name, char const* key_file_name, const char * cert_root_file_name,
-    const uint8_t* ticket_key, size_t ticket_key_length)
+    const uint8_t* ticket_key, size_t ticket_key_length, picoquic_tls_master_t* master)
 {
     /* Create a client context or a server context */
     int ret = 0;
@@ -1633,7 +1932,15 @@ int picoquic_master_tlscontext(picoquic_quic_t* quic,
                 }
             }
 
-            if (cert_file_name != NULL && key_file_name != NULL) {
+            if (master != NULL) {
+                /* Point to the shared objects, do not copy them */
+                ctx->certificates.list = master->certificates;
+                ctx->certificates.count = master->nb_certificates;
+                ctx->sign_certificate = master->sign_certificate;
+                ticket_key = master->ticket_key;
+                ticket_key_length = sizeof(master->ticket_key);
+            }
+            else if (cert_file_name != NULL && key_file_name != NULL) {
                 /* Read the certificate file */
                 if (ptls_load_certificates(ctx, (char*)cert_file_name) != 0) {
                     DBG_PRINTF("Cannot load certificate: %s", cert_file_name);
@@ -1682,7 +1989,13 @@ int picoquic_master_tlscontext(picoquic_quic_t* quic,
             }
         }
 
-        ctx->verify_certificate = picoquic_get_certificate_verifier(cert_root_file_name, &is_cert_store_not_empty);
+        if (master != NULL) {
+            ctx->verify_certificate = master->verify_certificate;
+            is_cert_store_not_empty = master->is_cert_store_not_empty;
+        }
+        else {
+            ctx->verify_certificate = picoquic_get_certificate_verifier(cert_root_file_name, &is_cert_store_not_empty);
+        }
         quic->is_cert_store_not_empty = is_cert_store_not_empty;
 
         if (quic->ticket_file_name != NULL) {
@@ -1704,6 +2017,12 @@ int picoquic_master_tlscontext(picoquic_quic_t* quic,
         if (ret == 0) {
             quic->tls_master_ctx = ctx;
             picoquic_public_random_seed(quic);
+            if (master != NULL) {
+                (void)picoquic_lock_mutex(&master->mutex);
+                master->nb_references++;
+                (void)picoquic_unlock_mutex(&master->mutex);
+                quic->shared_tls_master = master;
+            }
         } else {
             free(ctx);
         }
@@ -1712,6 +2031,19 @@ int picoquic_master_tlscontext(picoquic_quic_t* quic,
     return ret;
 }
 
+int picoquic_master_tlscontext(picoquic_quic_t* quic,
+    char const* cert_file_name, char const* key_file_name, const char * cert_root_file_name,
+    const uint8_t* ticket_key, size_t ticket_key_length)
+{
+    return picoquic_master_tlscontext_ex(quic, cert_file_name, key_file_name, cert_root_file_name,
+        ticket_key, ticket_key_length, NULL);
+}
+
+int picoquic_master_tlscontext_from_shared(picoquic_quic_t* quic, picoquic_tls_master_t* master)
+{
+    return picoquic_master_tlscontext_ex(quic, NULL, NULL, NULL, NULL, 0, master);
+}
+
 static void free_certificates_list(ptls_iovec_t* certs, size_t len) {
     if (certs == NULL) {
         return;
@@ -1733,13 +2065,18 @@ void picoquic_master_tlscontext_free(picoquic_quic_t* quic)
             ctx->get_time = NULL;
         }
 
-        free_certificates_list(ctx->certificates.list, ctx->certificates.count);
+        if (quic->shared_tls_master == NULL || ctx->certificates.list != quic->shared_tls_master->certificates) {
+            free_certificates_list(ctx->certificates.list, ctx->certificates.count);
+        }
+        ctx->certificates.list = NULL;
+        ctx->certificates.count = 0;
 
-        if (ctx->sign_certificate != NULL) {
+        if (ctx->sign_certificate != NULL &&
+            (quic->shared_tls_master == NULL || ctx->sign_certificate != quic->shared_tls_master->sign_certificate)) {
             picoquic_dispose_sign_certificate(ctx->sign_certificate);
             free(ctx->sign_certificate);
-            ctx->sign_certificate = NULL;
         }
+        ctx->sign_certificate = NULL;
 
         picoquic_dispose_verify_certificate_callback(quic);
 
@@ -1765,6 +2102,11 @@ void picoquic_master_tlscontext_free(picoquic_quic_t* quic)
         }
 
         picoquic_free_log_event(quic);
+
+        if (quic->shared_tls_master != NULL) {
+            picoquic_tls_master_release(quic->shared_tls_master);
+            quic->shared_tls_master = NULL;
+        }
     }
 }
 
@@ -2325,6 +2667,13 @@ int picoquic_server_setup_ticket_aead_contexts(picoquic_quic_t* quic,
     return ret;
 }
 
+/* Reset the ticket AEAD contexts from a new secret, e.g., shared by several QUIC contexts */
+int picoquic_set_ticket_secret(picoquic_quic_t* quic, const uint8_t* secret, size_t secret_length)
+{
+    return picoquic_server_setup_ticket_aead_contexts(quic, (ptls_context_t*)quic->tls_master_ctx,
+        secret, secret_length);
+}
+
 /* Access integrity limit for AEAD */
 uint64_t picoquic_aead_integrity_limit(void* aead_ctx)
 {
@@ -2686,7 +3035,9 @@ void picoquic_set_tls_certificate_chain(picoquic_quic_t* quic, ptls_iovec_t* cer
 {
     ptls_context_t* ctx = (ptls_context_t*)quic->tls_master_ctx;
 
-    free_certificates_list(ctx->certificates.list, ctx->certificates.count);
+    if (quic->shared_tls_master == NULL || ctx->certificates.list != quic->shared_tls_master->certificates) {
+        free_certificates_list(ctx->certificates.list, ctx->certificates.count);
+    }
 
     ctx->certificates.list = certs;
     ctx->certificates.count = count;
@@ -2977,20 +3328,20 @@ void * picoquic_create_retry_protection_context(int is_enc, uint8_t * key, const
     return (void *)picoquic_setup_test_aead_context(is_enc, key, prefix_label);
 }
 
-void * picoquic_find_retry_protection_context(picoquic_cnx_t * cnx, int sending)
+void * picoquic_find_retry_protection_context_ex(picoquic_quic_t * quic, int version_index, int sending)
 {
     void * aead_ctx = NULL;
-    void ** aead_vector = (sending) ? cnx->quic->retry_integrity_sign_ctx : cnx->quic->retry_integrity_verify_ctx;
+    void ** aead_vector = (sending) ? quic->retry_integrity_sign_ctx : quic->retry_integrity_verify_ctx;
 
-    if (picoquic_supported_versions[cnx->version_index].version_retry_key != NULL) {
+    if (version_index >= 0 && picoquic_supported_versions[version_index].version_retry_key != NULL) {
         if (aead_vector == NULL) {
             if (sending) {
-                cnx->quic->retry_integrity_sign_ctx = (void**)malloc(sizeof(void*)*picoquic_nb_supported_versions);
-                aead_vector = cnx->quic->retry_integrity_sign_ctx;
+                quic->retry_integrity_sign_ctx = (void**)malloc(sizeof(void*)*picoquic_nb_supported_versions);
+                aead_vector = quic->retry_integrity_sign_ctx;
             }
             else {
-                cnx->quic->retry_integrity_verify_ctx = (void**)malloc(sizeof(void*)*picoquic_nb_supported_versions);
-                aead_vector = cnx->quic->retry_integrity_verify_ctx;
+                quic->retry_integrity_verify_ctx = (void**)malloc(sizeof(void*)*picoquic_nb_supported_versions);
+                aead_vector = quic->retry_integrity_verify_ctx;
             }
             if (aead_vector != NULL) {
                 memset(aead_vector, 0, sizeof(void*)*picoquic_nb_supported_versions);
@@ -2998,11 +3349,11 @@ void * picoquic_find_retry_protection_context(picoquic_cnx_t * cnx, int sending)
         }
 
         if (aead_vector != NULL) {
-            aead_ctx = aead_vector[cnx->version_index];
+            aead_ctx = aead_vector[version_index];
             if (aead_ctx == NULL) {
-                aead_ctx = picoquic_create_retry_protection_context(sending, picoquic_supported_versions[cnx->version_index].version_retry_key,
-                                                                    picoquic_supported_versions[cnx->version_index].tls_prefix_label);
-                aead_vector[cnx->version_index] = aead_ctx;
+                aead_ctx = picoquic_create_retry_protection_context(sending, picoquic_supported_versions[version_index].version_retry_key,
+                                                                    picoquic_supported_versions[version_index].tls_prefix_label);
+                aead_vector[version_index] = aead_ctx;
             }
         }
     }
@@ -3010,6 +3361,11 @@ void * picoquic_find_retry_protection_context(picoquic_cnx_t * cnx, int sending)
     return aead_ctx;
 }
 
+void * picoquic_find_retry_protection_context(picoquic_cnx_t * cnx, int sending)
+{
+    return picoquic_find_retry_protection_context_ex(cnx->quic, cnx->version_index, sending);
+}
+
 static void ** picoquic_delete_one_retry_protection_context(void ** ctx)
 {
     if (ctx != NULL) {
@@ -47,6 +47,9 @@ extern "C" {
 int picoquic_master_tlscontext(picoquic_quic_t* quic, char const* cert_file_name, char const* key_file_name,
     char const * cert_root_file_name, const uint8_t* ticket_key, size_t ticket_key_length);
 
+int picoquic_master_tlscontext_from_shared(picoquic_quic_t* quic, picoquic_tls_master_t* master);
+int picoquic_tls_master_has_certificate(picoquic_tls_master_t* master);
+
 void picoquic_master_tlscontext_free(picoquic_quic_t* quic);
 
 int picoquic_tlscontext_create(picoquic_quic_t* quic, picoquic_cnx_t* cnx, uint64_t current_time);
@@ -64,6 +67,8 @@ int picoquic_initialize_tls_stream(picoquic_cnx_t* cnx, uint64_t current_time);
 
 uint64_t picoquic_get_tls_time(picoquic_quic_t* quic);
 
+int picoquic_set_ticket_secret(picoquic_quic_t* quic, const uint8_t* secret, size_t secret_length);
+
 void picoquic_crypto_random(picoquic_quic_t* quic, void* buf, size_t len);
 uint64_t picoquic_crypto_uniform_random(picoquic_quic_t* quic, uint64_t rnd_max);
 
@@ -173,8 +178,14 @@ ptls_iovec_t* picoquic_get_certs_from_file(char const* file_name, size_t * count
 
 /* Special AEAD context definition functions used for stateless retry integrity protection */
 void * picoquic_create_retry_protection_context(int is_enc, uint8_t * key, const char *prefix_label);
+void * picoquic_find_retry_protection_context_ex(picoquic_quic_t * quic, int version_index, int sending);
 void * picoquic_find_retry_protection_context(picoquic_cnx_t * cnx, int sending);
 void picoquic_delete_retry_protection_contexts(picoquic_quic_t * quic);
+void* picoquic_create_initial_salt_ctx(ptls_cipher_suite_t* cipher, ptls_iovec_t salt);
+void picoquic_free_initial_salt_ctx(void* salt_ctx);
+int picoquic_setup_initial_master_secret_cached(void* salt_ctx,
+    picoquic_connection_id_t initial_cnxid, uint8_t* master_secret);
+void picoquic_delete_initial_salt_contexts(picoquic_quic_t* quic);
 size_t picoquic_encode_retry_protection(void * integrity_aead, uint8_t * bytes, size_t bytes_max, size_t byte_index, const picoquic_connection_id_t * odcid);
 int picoquic_verify_retry_protection(void * integrity_aead, uint8_t * bytes, size_t * length, size_t byte_index, const picoquic_connection_id_t * odcid);
 
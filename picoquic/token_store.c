@@ -154,13 +154,164 @@ int picoquic_deserialize_token(picoquic_stored_token_t ** token, uint8_t * bytes
     return ret;
 }
 
+/* Management of the token store.
+ * Tokens are kept in a hash table keyed by SNI and IP address. The hash only
+ * covers the SNI, so the tokens for the same server are all found in the
+ * same bin, which is used when the token is requested without an address.
+ * The same tokens are also kept in a splay tree ordered by expiry time,
+ * so expired tokens can be removed without scanning the whole store, and
+ * the tokens closest to expiry can be evicted when the store is full.
+ */
+
+static uint64_t picoquic_stored_token_hash(const void* key)
+{
+    const picoquic_stored_token_t* stored = (const picoquic_stored_token_t*)key;
+
+    return picohash_bytes((const uint8_t*)stored->sni, stored->sni_length);
+}
+
+static int picoquic_stored_token_compare(const void* key1, const void* key2)
+{
+    const picoquic_stored_token_t* stored1 = (const picoquic_stored_token_t*)key1;
+    const picoquic_stored_token_t* stored2 = (const picoquic_stored_token_t*)key2;
+    int ret = -1;
+
+    if (stored1->sni_length == stored2->sni_length && stored1->ip_addr_length == stored2->ip_addr_length &&
+        memcmp(stored1->sni, stored2->sni, stored1->sni_length) == 0 &&
+        memcmp(stored1->ip_addr, stored2->ip_addr, stored1->ip_addr_length) == 0) {
+        ret = 0;
+    }
+
+    return ret;
+}
+
+static picohash_item* picoquic_stored_token_to_item(const void* key)
+{
+    picoquic_stored_token_t* stored = (picoquic_stored_token_t*)key;
+
+    return &stored->hash_item;
+}
+
+static int64_t picoquic_stored_token_expiry_compare(void* l, void* r)
+{
+    picoquic_stored_token_t* stored_l = (picoquic_stored_token_t*)l;
+    picoquic_stored_token_t* stored_r = (picoquic_stored_token_t*)r;
+    int64_t ret = 0;
+
+    if (stored_l->time_valid_until > stored_r->time_valid_until) {
+        ret = 1;
+    }
+    else if (stored_l->time_valid_until < stored_r->time_valid_until) {
+        ret = -1;
+    }
+    else if ((uintptr_t)stored_l > (uintptr_t)stored_r) {
+        ret = 1;
+    }
+    else if ((uintptr_t)stored_l < (uintptr_t)stored_r) {
+        ret = -1;
+    }
+
+    return ret;
+}
+
+static picosplay_node_t* picoquic_stored_token_expiry_create(void* value)
+{
+    return &((picoquic_stored_token_t*)value)->expiry_node;
+}
+
+static void* picoquic_stored_token_expiry_value(picosplay_node_t* node)
+{
+    return (void*)((node == NULL) ? NULL : ((char*)node - offsetof(struct st_picoquic_stored_token_t, expiry_node)));
+}
+
+static void picoquic_stored_token_expiry_delete(void* tree, picosplay_node_t* node)
+{
+#ifdef _WINDOWS
+    UNREFERENCED_PARAMETER(tree);
+#endif
+    memset(node, 0, sizeof(picosplay_node_t));
+}
+
+int picoquic_create_token_store(picoquic_quic_t* quic)
+{
+    int ret = 0;
+
+    quic->max_stored_tokens = PICOQUIC_DEFAULT_MAX_STORED_TOKENS;
+    quic->table_stored_tokens = picohash_create_ex(PICOQUIC_TOKEN_STORE_HASH_BINS,
+        picoquic_stored_token_hash, picoquic_stored_token_compare, picoquic_stored_token_to_item);
+    picosplay_init_tree(&quic->token_expiry_tree, picoquic_stored_token_expiry_compare,
+        picoquic_stored_token_expiry_create, picoquic_stored_token_expiry_delete, picoquic_stored_token_expiry_value);
+
+    if (quic->table_stored_tokens == NULL) {
+        ret = PICOQUIC_ERROR_MEMORY;
+    }
+
+    return ret;
+}
+
+static void picoquic_delete_stored_token(picoquic_quic_t* quic, picoquic_stored_token_t* stored)
+{
+    picosplay_delete_hint(&quic->token_expiry_tree, &stored->expiry_node);
+    picohash_delete_item(quic->table_stored_tokens, &stored->hash_item, 1);
+}
+
+picoquic_stored_token_t* picoquic_first_stored_token(picoquic_quic_t* quic)
+{
+    return (picoquic_stored_token_t*)picoquic_stored_token_expiry_value(picosplay_first(&quic->token_expiry_tree));
+}
+
+picoquic_stored_token_t* picoquic_next_stored_token(picoquic_stored_token_t* stored)
+{
+    return (picoquic_stored_token_t*)picoquic_stored_token_expiry_value(picosplay_next(&stored->expiry_node));
+}
+
+void picoquic_expire_tokens(picoquic_quic_t* quic, uint64_t current_time)
+{
+    picoquic_stored_token_t* first;
+
+    while ((first = picoquic_first_stored_token(quic)) != NULL && first->time_valid_until <= current_time) {
+        picoquic_delete_stored_token(quic, first);
+    }
+}
+
+/* Insert a token in the store. Replaces any token for the same SNI and address,
+ * and evicts the tokens closest to expiry if the store is full.
+ */
+static void picoquic_insert_stored_token(picoquic_quic_t* quic, picoquic_stored_token_t* stored)
+{
+    picohash_item* item = picohash_retrieve(quic->table_stored_tokens, stored);
+
+    if (item != NULL) {
+        picoquic_stored_token_t* previous = (picoquic_stored_token_t*)item->key;
+        if (previous->time_valid_until > stored->time_valid_until) {
+            /* The stored token is more recent than the new one */
+            free(stored);
+            stored = NULL;
+        }
+        else {
+            picoquic_delete_stored_token(quic, previous);
+        }
+    }
+
+    if (stored != NULL) {
+        while (quic->max_stored_tokens > 0 && quic->table_stored_tokens->count >= quic->max_stored_tokens) {
+            picoquic_delete_stored_token(quic, picoquic_first_stored_token(quic));
+        }
+        if (picohash_insert(quic->table_stored_tokens, stored) == 0) {
+            (void)picosplay_insert(&quic->token_expiry_tree, stored);
+        }
+        else {
+            free(stored);
+        }
+    }
+}
+
 int picoquic_store_token(picoquic_quic_t * quic,
     char const* sni, uint16_t sni_length,
     uint8_t const* ip_addr, uint8_t ip_addr_length,
     uint8_t const* token, uint16_t token_length)
 {
     int ret = 0;
-    picoquic_stored_token_t** pp_first_token = &quic->p_first_token;
     uint64_t current_time = picoquic_get_tls_time(quic);
 
     if (token_length < 1 || sni == NULL || sni_length == 0) {
@@ -175,26 +326,8 @@ int picoquic_store_token(picoquic_quic_t * quic,
             ret = PICOQUIC_ERROR_MEMORY;
         }
         else {
-            picoquic_stored_token_t* next;
-            picoquic_stored_token_t** pprevious;
-
-            stored->next_token = next = *pp_first_token;
-            *pp_first_token = stored;
-            pprevious = &stored->next_token;
-
-            /* Now remove the old tokens for that SNI & ip_addr */
-            while (next != NULL) {
-                if (next->time_valid_until <= stored->time_valid_until && next->sni_length == sni_length && next->ip_addr_length == ip_addr_length && memcmp(next->sni, sni, sni_length) == 0 && memcmp(next->ip_addr, ip_addr, ip_addr_length) == 0) {
-                    picoquic_stored_token_t* deleted = next;
-                    next = next->next_token;
-                    *pprevious = next;
-                    free(deleted);
-                }
-                else {
-                    pprevious = &next->next_token;
-                    next = next->next_token;
-                }
-            }
+            picoquic_expire_tokens(quic, current_time);
+            picoquic_insert_stored_token(quic, stored);
         }
     } 
 
@@ -207,27 +340,39 @@ int picoquic_get_token(picoquic_quic_t * quic,
     uint8_t** token, uint16_t* token_length, int mark_used)
 {
     int ret = 0;
-
     uint64_t current_time = picoquic_get_tls_time(quic);
-    picoquic_stored_token_t* p_first_token = quic->p_first_token;
-    picoquic_stored_token_t* next = p_first_token;
     picoquic_stored_token_t* best_match = NULL;
+    picoquic_stored_token_t key;
 
-    while (next != NULL) {
-        if (next->time_valid_until > current_time && next->sni_length == sni_length && memcmp(next->sni, sni, sni_length) == 0 && next->was_used == 0){
-            if (ip_addr_length > 0) {
-                if (next->ip_addr_length == ip_addr_length && memcmp(next->ip_addr, ip_addr, ip_addr_length) == 0) {
-                    best_match = next;
-                    break;
-                }
-            }
-            else {
-                if (best_match == NULL || next->time_valid_until > best_match->time_valid_until) {
-                    best_match = next;
-                }
+    picoquic_expire_tokens(quic, current_time);
+
+    memset(&key, 0, sizeof(key));
+    key.sni = sni;
+    key.sni_length = sni_length;
+    key.ip_addr = ip_addr;
+    key.ip_addr_length = ip_addr_length;
+
+    if (ip_addr_length > 0) {
+        picohash_item* item = picohash_retrieve(quic->table_stored_tokens, &key);
+        if (item != NULL && ((picoquic_stored_token_t*)item->key)->was_used == 0) {
+            best_match = (picoquic_stored_token_t*)item->key;
+        }
+    }
+    else {
+        /* Without an address, pick the most recent token for the SNI.
+         * All these tokens are in the same hash bin. */
+        uint64_t hash = picoquic_stored_token_hash(&key);
+        picohash_item* item = quic->table_stored_tokens->hash_bin[hash % quic->table_stored_tokens->nb_bin];
+
+        while (item != NULL) {
+            picoquic_stored_token_t* next = (picoquic_stored_token_t*)item->key;
+            if (item->hash == hash && next->was_used == 0 &&
+                next->sni_length == sni_length && memcmp(next->sni, sni, sni_length) == 0 &&
+                (best_match == NULL || next->time_valid_until > best_match->time_valid_until)) {
+                best_match = next;
             }
-        } 
-        next = next->next_token;
+            item = item->next_in_bin;
+        }
     }
 
     if (best_match == NULL || best_match->token_length == 0 || (*token = (uint8_t *)malloc(best_match->token_length)) == NULL) {
@@ -243,13 +388,16 @@ int picoquic_get_token(picoquic_quic_t * quic,
     return ret;
 }
 
+/* The token file uses the same format as the session ticket file: a sequence of
+ * records, each composed of a 4 bytes length followed by the serialized token.
+ * Tokens are saved in order of expiry time.
+ */
 int picoquic_save_tokens(picoquic_quic_t * quic,
     char const* token_file_name)
 {
     int ret = 0;
     FILE* F = NULL;
-    const picoquic_stored_token_t* first_token = quic->p_first_token;
-    const picoquic_stored_token_t* next = first_token;
+    const picoquic_stored_token_t* next = picoquic_first_stored_token(quic);
     uint64_t current_time = picoquic_get_tls_time(quic);
 
     if ((F = picoquic_file_open(token_file_name, "wb")) == NULL) {
@@ -271,7 +419,7 @@ int picoquic_save_tokens(picoquic_quic_t * quic,
                     }
                 }
             }
-            next = next->next_token;
+            next = picoquic_next_stored_token((picoquic_stored_token_t*)next);
         }
         (void)picoquic_file_close(F);
     }
@@ -284,12 +432,10 @@ int picoquic_load_tokens(picoquic_quic_t* quic, char const* token_file_name)
     int ret = 0;
     int file_ret = 0;
     FILE* F = NULL;
-    picoquic_stored_token_t* previous = NULL;
     picoquic_stored_token_t* next = NULL;
     uint32_t record_size;
     uint32_t storage_size;
     uint64_t current_time = picoquic_get_tls_time(quic);
-    picoquic_stored_token_t** pp_first_token = &quic->p_first_token;
 
     if ((F = picoquic_file_open_ex(token_file_name, "rb", &file_ret)) == NULL) {
         ret = (file_ret == ENOENT) ? PICOQUIC_ERROR_NO_SUCH_FILE : -1;
@@ -321,39 +467,47 @@ int picoquic_load_tokens(picoquic_quic_t* quic, char const* token_file_name)
                 if (ret == 0 && next != NULL) {
                     if (next->time_valid_until < current_time) {
                         free(next);
-                        next = NULL;
                     }
                     else {
-                        next->sni = ((char*)next) + sizeof(picoquic_stored_token_t);
-                        next->ip_addr = ((uint8_t*)next->sni) + next->sni_length + 1;
-                        next->token = (uint8_t*)(next->ip_addr + next->ip_addr_length + 1);
-                        next->next_token = NULL;
-                        if (previous == NULL) {
-                            *pp_first_token = next;
-                        }
-                        else {
-                            previous->next_token = next;
-                        }
-
-                        previous = next;
+                        picoquic_insert_stored_token(quic, next);
                     }
+                    next = NULL;
                 }
             }
         }
     }
 
+    if (next != NULL) {
+        free(next);
+    }
+
     (void)picoquic_file_close(F);
 
     return ret;
 }
 
-void picoquic_free_tokens(picoquic_stored_token_t** pp_first_token)
+void picoquic_free_tokens(picoquic_quic_t* quic)
 {
-    picoquic_stored_token_t* next;
+    picosplay_empty_tree(&quic->token_expiry_tree);
 
-    while ((next = *pp_first_token) != NULL) {
-        *pp_first_token = next->next_token;
+    if (quic->table_stored_tokens != NULL) {
+        picohash_delete(quic->table_stored_tokens, 1);
+        quic->table_stored_tokens = NULL;
+    }
+}
 
-        free(next);
+void picoquic_set_max_stored_tokens(picoquic_quic_t* quic, size_t max_stored_tokens)
+{
+    quic->max_stored_tokens = max_stored_tokens;
+
+    if (max_stored_tokens > 0) {
+        while (quic->table_stored_tokens->count > max_stored_tokens) {
+            picoquic_delete_stored_token(quic, picoquic_first_stored_token(quic));
+        }
     }
 }
+
+size_t picoquic_get_nb_stored_tokens(picoquic_quic_t* quic)
+{
+    return quic->table_stored_tokens->count;
+}
@@ -58,7 +58,7 @@ void picoquic_log_app_message_v(picoquic_cnx_t* cnx, const char* fmt, va_list va
         cnx->quic->text_log_fns->log_app_message(cnx, fmt, vargs);
     }
 
-    if (cnx->f_binlog != NULL) {
+    if (PICOQUIC_CNX_HAS_BINLOG(cnx)) {
         cnx->quic->bin_log_fns->log_app_message(cnx, fmt, vargs);
     }
 }
@@ -72,7 +72,7 @@ void picoquic_log_app_message(picoquic_cnx_t* cnx, const char* fmt, ...)
         va_end(args);
     }
 
-    if (cnx->f_binlog != NULL) {
+    if (PICOQUIC_CNX_HAS_BINLOG(cnx)) {
         va_list args;
         va_start(args, fmt);
         cnx->quic->bin_log_fns->log_app_message(cnx, fmt, args);
@@ -99,7 +99,7 @@ void picoquic_log_pdu(picoquic_cnx_t* cnx, int receiving, uint64_t current_time,
             cnx->quic->text_log_fns->log_pdu(cnx, receiving, current_time, addr_peer, addr_local, packet_length);
         }
 
-        if (cnx->f_binlog != NULL) {
+        if (PICOQUIC_CNX_HAS_BINLOG(cnx)) {
             cnx->quic->bin_log_fns->log_pdu(cnx, receiving, current_time, addr_peer, addr_local, packet_length);
         }
     }
@@ -114,7 +114,7 @@ void picoquic_log_packet(picoquic_cnx_t* cnx, picoquic_path_t* path_x, int recei
             cnx->quic->text_log_fns->log_packet(cnx, path_x, receiving, current_time, ph, bytes, bytes_max);
         }
 
-        if (cnx->f_binlog != NULL) {
+        if (PICOQUIC_CNX_HAS_BINLOG(cnx)) {
             cnx->quic->bin_log_fns->log_packet(cnx, path_x, receiving, current_time, ph, bytes, bytes_max);
         }
     }
@@ -129,7 +129,7 @@ void picoquic_log_dropped_packet(picoquic_cnx_t* cnx, picoquic_path_t* path_x, s
             cnx->quic->text_log_fns->log_dropped_packet(cnx, path_x, ph, packet_size, err, raw_data, current_time);
         }
 
-        if (cnx->f_binlog != NULL) {
+        if (PICOQUIC_CNX_HAS_BINLOG(cnx)) {
             cnx->quic->bin_log_fns->log_dropped_packet(cnx, path_x, ph, packet_size, err, raw_data, current_time);
         }
     }
@@ -143,7 +143,7 @@ void picoquic_log_buffered_packet(picoquic_cnx_t* cnx, picoquic_path_t* path_x,
             cnx->quic->text_log_fns->log_buffered_packet(cnx, path_x, ptype, current_time);
         }
 
-        if (cnx->f_binlog != NULL) {
+        if (PICOQUIC_CNX_HAS_BINLOG(cnx)) {
             cnx->quic->bin_log_fns->log_buffered_packet(cnx, path_x, ptype, current_time);
         }
     }
@@ -160,7 +160,7 @@ void picoquic_log_outgoing_packet(picoquic_cnx_t* cnx, picoquic_path_t* path_x,
                 send_buffer, send_length, current_time);
         }
 
-        if (cnx->f_binlog != NULL) {
+        if (PICOQUIC_CNX_HAS_BINLOG(cnx)) {
             cnx->quic->bin_log_fns->log_outgoing_packet(cnx, path_x, bytes, sequence_number, pn_length, length,
                 send_buffer, send_length, current_time);
         }
@@ -178,7 +178,7 @@ void picoquic_log_packet_lost(picoquic_cnx_t* cnx, picoquic_path_t* path_x,
             cnx->quic->text_log_fns->log_packet_lost(cnx, path_x, ptype, sequence_number, trigger, dcid, packet_size, current_time);
         }
 
-        if (cnx->f_binlog != NULL) {
+        if (PICOQUIC_CNX_HAS_BINLOG(cnx)) {
             cnx->quic->bin_log_fns->log_packet_lost(cnx, path_x, ptype, sequence_number, trigger, dcid, packet_size, current_time);
         }
     }
@@ -193,7 +193,7 @@ void picoquic_log_negotiated_alpn(picoquic_cnx_t* cnx, int is_local,
         cnx->quic->text_log_fns->log_negotiated_alpn(cnx, is_local, sni, sni_len, alpn, alpn_len, alpn_list, alpn_count);
     }
 
-    if (cnx->f_binlog != NULL) {
+    if (PICOQUIC_CNX_HAS_BINLOG(cnx)) {
         cnx->quic->bin_log_fns->log_negotiated_alpn(cnx, is_local, sni, sni_len, alpn, alpn_len, alpn_list, alpn_count);
     }
 }
@@ -206,7 +206,7 @@ void picoquic_log_transport_extension(picoquic_cnx_t* cnx, int is_local,
         cnx->quic->text_log_fns->log_transport_extension(cnx, is_local, param_length, params);
     }
 
-    if (cnx->f_binlog != NULL) {
+    if (PICOQUIC_CNX_HAS_BINLOG(cnx)) {
         cnx->quic->bin_log_fns->log_transport_extension(cnx, is_local, param_length, params);
     }
 }
@@ -218,7 +218,7 @@ void picoquic_log_tls_ticket(picoquic_cnx_t* cnx, uint8_t* ticket, uint16_t tick
         cnx->quic->text_log_fns->log_picotls_ticket(cnx, ticket, ticket_length);
     }
 
-    if (cnx->f_binlog != NULL) {
+    if (PICOQUIC_CNX_HAS_BINLOG(cnx)) {
         cnx->quic->bin_log_fns->log_picotls_ticket(cnx, ticket, ticket_length);
     }
 }
@@ -241,7 +241,7 @@ void picoquic_log_close_connection(picoquic_cnx_t* cnx)
         cnx->quic->text_log_fns->log_close_connection(cnx);
     }
 
-    if (cnx->f_binlog != NULL) {
+    if (PICOQUIC_CNX_HAS_BINLOG(cnx)) {
         cnx->quic->bin_log_fns->log_close_connection(cnx);
     }
 }
@@ -253,7 +253,7 @@ void picoquic_log_cc_dump(picoquic_cnx_t* cnx, uint64_t current_time)
         if (cnx->quic->F_log != NULL) {
             cnx->quic->text_log_fns->log_cc_dump(cnx, current_time);
         }
-        if (cnx->f_binlog != NULL) {
+        if (PICOQUIC_CNX_HAS_BINLOG(cnx)) {
             cnx->quic->bin_log_fns->log_cc_dump(cnx, current_time);
         }
     }
@@ -97,6 +97,7 @@ static const picoquic_test_def_t test_table[] = {
     { "retry_protection_vector", retry_protection_vector_test },
     { "retry_protection_v2", retry_protection_v2_test },
     { "draft17_vector", draft17_vector_test },
+    { "initial_key_bench", initial_key_bench_test },
     { "dtn_basic", dtn_basic_test },
     { "dtn_data", dtn_data_test },
     { "dtn_silence", dtn_silence_test },
@@ -165,6 +166,7 @@ static const picoquic_test_def_t test_table[] = {
     { "many_short_loss", many_short_loss_test },
     { "retry", tls_api_retry_test },
     { "retry_large", tls_api_retry_large_test},
+    { "retry_flood", tls_api_retry_flood_test },
     { "retry_token", tls_retry_token_test },
     { "retry_token_valid", tls_retry_token_valid_test },
     { "two_connections", tls_api_two_connections_test },
@@ -181,7 +183,9 @@ static const picoquic_test_def_t test_table[] = {
     { "ticket_seed", ticket_seed_test },
     { "ticket_seed_from_bdp_frame", ticket_seed_from_bdp_frame_test },
     { "token_store", token_store_test },
+    { "token_store_expiry", token_store_expiry_test },
     { "token_reuse_api", token_reuse_api_test },
+    { "shared_registry", shared_registry_test },
     { "session_resume", session_resume_test },
     { "zero_rtt", zero_rtt_test },
     { "zero_rtt_loss", zero_rtt_loss_test },
@@ -224,6 +228,7 @@ static const picoquic_test_def_t test_table[] = {
     { "set_certificate_and_key", set_certificate_and_key_test },
     { "request_client_authentication", request_client_authentication_test },
     { "bad_client_certificate", bad_client_certificate_test },
+    { "tls_master_shared", tls_master_shared_test },
     { "nat_rebinding", nat_rebinding_test },
     { "nat_rebinding_loss", nat_rebinding_loss_test },
     { "nat_rebinding_zero", nat_rebinding_zero_test },
@@ -280,8 +285,22 @@ static const picoquic_test_def_t test_table[] = {
     { "qlog_trace_auto", qlog_trace_auto_test },
     { "qlog_trace_only", qlog_trace_only_test },
     { "qlog_trace_ecn", qlog_trace_ecn_test },
+    { "qlog_trace_background", qlog_trace_background_test },
+    { "qlog_trace_ring", qlog_trace_ring_test },
+    { "binlog_ring_bench", binlog_ring_bench_test },
+    { "qlog_trace_segment", qlog_trace_segment_test },
+    { "binlog_segment", binlog_segment_test },
+    { "binlog_sampling", binlog_sampling_test },
+    { "binlog_flight_recorder", binlog_flight_recorder_test },
+    { "qlog_trace_compact", qlog_trace_compact_test },
+    { "qlog_trace_compact_segment", qlog_trace_compact_segment_test },
+    { "qlog_trace_threshold", qlog_trace_threshold_test },
+    { "qlog_trace_batch", qlog_trace_batch_test },
     { "path_packet_queue", path_packet_queue_test },
     { "perflog", perflog_test },
+    { "perflog_stream", perflog_stream_test },
+    { "metrics", metrics_test },
+    { "phase_profile", phase_profile_test },
     { "nat_rebinding_stress", rebinding_stress_test },
     { "random_padding", random_padding_test },
     { "ec00_zero", ec00_zero_test },
@@ -81,6 +81,7 @@ static const char* token_store_filename = "demo_token_store.bin";
 #include "performance_log.h"
 #include "picoquic_config.h"
 #include "picoquic_lb.h"
+#include "picoquic_profile.h"
 
 /*
  * SIDUCK datagram demo call back.
@@ -107,11 +108,32 @@ void print_address(FILE* F_log, struct sockaddr* address, char* label, picoquic_
     }
 }
 
+/* Periodic dump of the per phase counters, if requested with -Y.
+ * The counters are reset after each dump, so each report covers
+ * the last interval. */
+static void demo_phase_profile_dump(picoquic_quic_t* quic, uint64_t dump_interval, uint64_t* next_dump_time)
+{
+    uint64_t current_time = picoquic_get_quic_time(quic);
+
+    if (dump_interval > 0 && current_time >= *next_dump_time) {
+        if (*next_dump_time != 0) {
+            picoquic_phase_stats_t stats;
+
+            picoquic_get_phase_stats(quic, &stats);
+            picoquic_phase_stats_print(stdout, &stats);
+            picoquic_reset_phase_stats(quic);
+        }
+        *next_dump_time = current_time + dump_interval;
+    }
+}
+
 /* server loop call back management */
 typedef struct st_server_loop_cb_t {
     int just_once;
     int first_connection_seen;
     int connection_done;
+    uint64_t phase_dump_interval;
+    uint64_t next_phase_dump;
 } server_loop_cb_t;
 
 static int server_loop_cb(picoquic_quic_t* quic, picoquic_packet_loop_cb_enum cb_mode,
@@ -131,6 +153,7 @@ static int server_loop_cb(picoquic_quic_t* quic, picoquic_packet_loop_cb_enum cb
         case picoquic_packet_loop_after_receive:
             break;
         case picoquic_packet_loop_after_send:
+            demo_phase_profile_dump(quic, cb_ctx->phase_dump_interval, &cb_ctx->next_phase_dump);
             break;
         case picoquic_packet_loop_port_update:
             break;
@@ -277,7 +300,7 @@ picohttp_server_path_item_t path_item_list[2] =
     }
 };
 
-int quic_server(const char* server_name, picoquic_quic_config_t * config, int just_once)
+int quic_server(const char* server_name, picoquic_quic_config_t * config, int just_once, uint64_t phase_dump_interval)
 {
     /* Start: start the QUIC process with cert and key files */
     int ret = 0;
@@ -290,9 +313,21 @@ int quic_server(const char* server_name, picoquic_quic_config_t * config, int ju
     picoquic_file_param.web_folder = config->www_dir;
     picoquic_file_param.path_table = path_item_list;
     picoquic_file_param.path_table_nb = 2;
+    /* Compile the path table once for all connections */
+    picoquic_file_param.router = h3zero_router_create(path_item_list, 2);
+    if (config->www_dir != NULL) {
+        /* Share open files and mappings between the streams serving the same file */
+        picoquic_file_param.file_cache = h3zero_file_cache_create(256, 64);
+        if (picoquic_file_param.file_cache != NULL) {
+            /* Up to 1024 responses and 256MB, check the files every 10 seconds */
+            picoquic_file_param.response_cache = h3zero_response_cache_create(picoquic_file_param.file_cache,
+                1024, 256 * 1024 * 1024, 10000000);
+        }
+    }
 
     memset(&loop_cb_ctx, 0, sizeof(server_loop_cb_t));
     loop_cb_ctx.just_once = just_once;
+    loop_cb_ctx.phase_dump_interval = phase_dump_interval;
 
     /* Setup the server context */
     if (ret == 0) {
@@ -320,6 +355,8 @@ int quic_server(const char* server_name, picoquic_quic_config_t * config, int ju
                 if (config->qlog_dir != NULL)
                 {
                     picoquic_set_qlog(qserver, config->qlog_dir);
+                    /* Convert qlogs off the packet loop, so closing connections do not stall the server */
+                    (void)picoquic_set_qlog_background(qserver, 256, picoquic_qlog_queue_full_drop);
                 }
                 if (config->performance_log != NULL)
                 {
@@ -366,6 +403,15 @@ int quic_server(const char* server_name, picoquic_quic_config_t * config, int ju
     if (qserver != NULL) {
         picoquic_free(qserver);
     }
+    if (picoquic_file_param.response_cache != NULL) {
+        h3zero_response_cache_delete(picoquic_file_param.response_cache);
+    }
+    if (picoquic_file_param.file_cache != NULL) {
+        h3zero_file_cache_delete(picoquic_file_param.file_cache);
+    }
+    if (picoquic_file_param.router != NULL) {
+        h3zero_router_delete(picoquic_file_param.router);
+    }
 
     return ret;
 }
@@ -412,6 +458,8 @@ typedef struct st_client_loop_cb_t {
     uint16_t local_port;
     picoquic_connection_id_t server_cid_before_migration;
     picoquic_connection_id_t client_cid_before_migration;
+    uint64_t phase_dump_interval;
+    uint64_t next_phase_dump;
 } client_loop_cb_t;
 
 
@@ -695,6 +743,7 @@ int client_loop_cb(picoquic_quic_t* quic, picoquic_packet_loop_cb_enum cb_mode,
             }
             break;
         case picoquic_packet_loop_after_send:
+            demo_phase_profile_dump(quic, cb_ctx->phase_dump_interval, &cb_ctx->next_phase_dump);
             if (picoquic_get_cnx_state(cb_ctx->cnx_client) == picoquic_state_disconnected) {
                 ret = PICOQUIC_NO_ERROR_TERMINATE_PACKET_LOOP;
             }
@@ -731,7 +780,8 @@ int client_loop_cb(picoquic_quic_t* quic, picoquic_packet_loop_cb_enum cb_mode,
 /* Quic Client */
 int quic_client(const char* ip_address_text, int server_port, 
     picoquic_quic_config_t * config, int force_migration,
-    int nb_packets_before_key_update, char const * client_scenario_text)
+    int nb_packets_before_key_update, char const * client_scenario_text,
+    uint64_t phase_dump_interval)
 {
     /* Start: start the QUIC process with cert and key files */
     int ret = 0;
@@ -751,6 +801,7 @@ int quic_client(const char* ip_address_text, int server_port,
     const char* sni = config->sni;
 
     memset(&loop_cb, 0, sizeof(client_loop_cb_t));
+    loop_cb.phase_dump_interval = phase_dump_interval;
 
     if (ret == 0) {
         ret = picoquic_get_server_address(ip_address_text, server_port, &loop_cb.server_address, &is_name);
@@ -1206,6 +1257,8 @@ void usage()
     fprintf(stderr, "                        -f 3  test migration to new address.\n");
     fprintf(stderr, "  -u nb                 trigger key update after receiving <nb> packets on client\n");
     fprintf(stderr, "  -1                    Once: close the server after processing 1 connection.\n");
+    fprintf(stderr, "  -Y seconds            Print the per phase counters every <seconds>, requires\n");
+    fprintf(stderr, "                        a library built with ENABLE_PHASE_PROFILE.\n");
 
     fprintf(stderr, "\nThe scenario argument specifies the set of files that should be retrieved,\n");
     fprintf(stderr, "and their order. The syntax is:\n");
@@ -1238,6 +1291,7 @@ int main(int argc, char** argv)
     int force_migration = 0;
     int just_once = 0;
     int is_client = 0;
+    int phase_dump_seconds = 0;
     int ret;
 
 #ifdef _WINDOWS
@@ -1245,8 +1299,8 @@ int main(int argc, char** argv)
     (void)WSA_START(MAKEWORD(2, 2), &wsaData);
 #endif
     picoquic_config_init(&config);
-    memcpy(option_string, "A:u:f:1", 7);
-    ret = picoquic_config_option_letters(option_string + 7, sizeof(option_string) - 7, NULL);
+    memcpy(option_string, "A:u:f:Y:1", 9);
+    ret = picoquic_config_option_letters(option_string + 9, sizeof(option_string) - 9, NULL);
 
     if (ret == 0) {
         /* Get the parameters */
@@ -1268,6 +1322,15 @@ int main(int argc, char** argv)
             case '1':
                 just_once = 1;
                 break;
+            case 'Y':
+                if ((phase_dump_seconds = atoi(optarg)) <= 0) {
+                    fprintf(stderr, "Invalid dump interval: %s\n", optarg);
+                    usage();
+                }
+                if (!picoquic_phase_profile_is_enabled()) {
+                    fprintf(stderr, "Warning: phase counters not compiled in, rebuild with ENABLE_PHASE_PROFILE.\n");
+                }
+                break;
             case 'A':
                 config.multipath_alt_config = malloc(sizeof(char) * (strlen(optarg) + 1));
                 memcpy(config.multipath_alt_config, optarg, sizeof(char) * (strlen(optarg) + 1));
@@ -1323,14 +1386,15 @@ int main(int argc, char** argv)
         /* Run as server */
         printf("Starting Picoquic server (v%s) on port %d, server name = %s, just_once = %d, do_retry = %d\n",
             PICOQUIC_VERSION, config.server_port, server_name, just_once, config.do_retry);
-        ret = quic_server(server_name, &config, just_once);
+        ret = quic_server(server_name, &config, just_once, ((uint64_t)phase_dump_seconds) * 1000000);
         printf("Server exit with code = %d\n", ret);
     }
     else {
         /* Run as client */
         printf("Starting Picoquic (v%s) connection to server = %s, port = %d\n", PICOQUIC_VERSION, server_name, server_port);
         ret = quic_client(server_name, server_port, &config,
-            force_migration, nb_packets_before_update, client_scenario);
+            force_migration, nb_packets_before_update, client_scenario,
+            ((uint64_t)phase_dump_seconds) * 1000000);
 
         printf("Client exit with code = %d\n", ret);
     }
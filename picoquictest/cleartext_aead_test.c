@@ -1360,4 +1360,135 @@ int retry_protection_v2_test()
     }
 
     return ret;
-}
\ No newline at end of file
+}
+
+/* Initial key derivation cache. Verify that the cached salt contexts
+ * produce the same master secret as the plain HKDF extract, for all
+ * supported versions and a range of CID lengths. Then compare the rate
+ * at which client connections, including their initial keys, can be
+ * created with and without the cached salt contexts. Timing is reported
+ * but never fails the test.
+ */
+#define INITIAL_KEY_BENCH_NB_CID 64
+#define INITIAL_KEY_BENCH_NB_CNX 2000
+
+static int initial_key_bench_cnx_rate(picoquic_quic_t* quic, struct sockaddr* addr, uint64_t* duration)
+{
+    int ret = 0;
+    uint64_t start_time = picoquic_current_time();
+
+    for (int i = 0; ret == 0 && i < INITIAL_KEY_BENCH_NB_CNX; i++) {
+        picoquic_cnx_t* cnx = picoquic_create_cnx(quic, picoquic_null_connection_id, picoquic_null_connection_id,
+            addr, 0, 0, NULL, NULL, 1);
+
+        if (cnx == NULL) {
+            DBG_PRINTF("Cannot create connection #%d", i);
+            ret = -1;
+        }
+        else {
+            if (cnx->crypto_context[0].aead_encrypt == NULL || cnx->crypto_context[0].aead_decrypt == NULL) {
+                DBG_PRINTF("Initial keys not set for connection #%d", i);
+                ret = -1;
+            }
+            picoquic_delete_cnx(cnx);
+        }
+    }
+    *duration = picoquic_current_time() - start_time;
+
+    return ret;
+}
+
+int initial_key_bench_test()
+{
+    int ret = 0;
+    ptls_cipher_suite_t* cipher = (ptls_cipher_suite_t*)picoquic_get_aes128gcm_sha256_v(0);
+    uint64_t random_ctx = 0xcafebabedeadbeefull;
+    picoquic_connection_id_t cid = picoquic_null_connection_id;
+    uint8_t master_plain[PTLS_MAX_DIGEST_SIZE];
+    uint8_t master_cached[PTLS_MAX_DIGEST_SIZE];
+
+    if (cipher == NULL) {
+        DBG_PRINTF("%s", "Cannot obtain the AES128GCM-SHA256 cipher suite.");
+        ret = -1;
+    }
+
+    for (size_t v = 0; ret == 0 && v < picoquic_nb_supported_versions; v++) {
+        ptls_iovec_t salt;
+        void* salt_ctx;
+
+        if (picoquic_supported_versions[v].version_aead_key == NULL) {
+            continue;
+        }
+        salt.base = (uint8_t*)picoquic_supported_versions[v].version_aead_key;
+        salt.len = picoquic_supported_versions[v].version_aead_key_length;
+
+        if ((salt_ctx = picoquic_create_initial_salt_ctx(cipher, salt)) == NULL) {
+            DBG_PRINTF("Cannot create salt context for version 0x%08x", picoquic_supported_versions[v].version);
+            ret = -1;
+            break;
+        }
+
+        for (int i = 0; ret == 0 && i < INITIAL_KEY_BENCH_NB_CID; i++) {
+            cid.id_len = (uint8_t)(i % (PICOQUIC_CONNECTION_ID_MAX_SIZE + 1));
+            picoquic_test_random_bytes(&random_ctx, cid.id, cid.id_len);
+
+            if ((ret = picoquic_setup_initial_master_secret(cipher, salt, cid, master_plain)) != 0 ||
+                (ret = picoquic_setup_initial_master_secret_cached(salt_ctx, cid, master_cached)) != 0) {
+                DBG_PRINTF("Master secret derivation fails for version 0x%08x, ret = 0x%x",
+                    picoquic_supported_versions[v].version, ret);
+            }
+            else if (memcmp(master_plain, master_cached, cipher->hash->digest_size) != 0) {
+                DBG_PRINTF("Cached master secret differs for version 0x%08x, CID length %d",
+                    picoquic_supported_versions[v].version, cid.id_len);
+                ret = -1;
+            }
+        }
+
+        picoquic_free_initial_salt_ctx(salt_ctx);
+    }
+
+    if (ret == 0) {
+        picoquic_quic_t* qclient = picoquic_create(8, NULL, NULL, NULL, NULL, NULL, NULL,
+            NULL, NULL, NULL, 0, NULL, NULL, NULL, 0);
+        struct sockaddr_in test_addr;
+        uint64_t cached_time = 0;
+        uint64_t plain_time = 0;
+
+        memset(&test_addr, 0, sizeof(struct sockaddr_in));
+        test_addr.sin_family = AF_INET;
+        memcpy(&test_addr.sin_addr, addr1, 4);
+        test_addr.sin_port = 12345;
+
+        if (qclient == NULL) {
+            DBG_PRINTF("%s", "Could not create Quic context.");
+            ret = -1;
+        }
+        else {
+            /* With the salt contexts cached in the Quic context */
+            ret = initial_key_bench_cnx_rate(qclient, (struct sockaddr*)&test_addr, &cached_time);
+            if (ret == 0 && (qclient->initial_salt_ctx == NULL || qclient->is_initial_salt_cache_disabled)) {
+                DBG_PRINTF("%s", "Initial salt contexts were not cached.");
+                ret = -1;
+            }
+            /* Without the cache, as when the contexts cannot be created */
+            if (ret == 0) {
+                picoquic_delete_initial_salt_contexts(qclient);
+                qclient->is_initial_salt_cache_disabled = 1;
+                ret = initial_key_bench_cnx_rate(qclient, (struct sockaddr*)&test_addr, &plain_time);
+                if (ret == 0 && qclient->initial_salt_ctx != NULL) {
+                    DBG_PRINTF("%s", "Initial salt contexts created while the cache is disabled.");
+                    ret = -1;
+                }
+            }
+            if (ret == 0) {
+                DBG_PRINTF("Client connections, %d created: cached salt %" PRIu64 "us (%" PRIu64 " cnx/s), plain %" PRIu64 "us (%" PRIu64 " cnx/s)",
+                    INITIAL_KEY_BENCH_NB_CNX,
+                    cached_time, (cached_time > 0) ? (INITIAL_KEY_BENCH_NB_CNX * 1000000ull) / cached_time : 0,
+                    plain_time, (plain_time > 0) ? (INITIAL_KEY_BENCH_NB_CNX * 1000000ull) / plain_time : 0);
+            }
+            picoquic_free(qclient);
+        }
+    }
+
+    return ret;
+}
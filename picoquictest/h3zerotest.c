@@ -28,6 +28,8 @@
 #include "tls_api.h"
 #include "h3zero.h"
 #include "h3zero_common.h"
+#include "h3zero_loadgen.h"
+#include "h3zero_uri.h"
 #include "democlient.h"
 #include "demoserver.h"
 #ifdef _WINDOWS
@@ -510,32 +512,102 @@ int qpack_huffman_base_test()
         }
     }
 
-    /* Second, test a set of valid terminators */
+    /* Second, verify that padding of 8 bits or more is rejected, as
+     * required by RFC 7541 section 5.2 */
     for (size_t i = 1; ret == 0 && i < 4; i++) {
         input_length = 0;
         for (size_t l = 0; l < i; l++) {
             input[input_length++] = 0xFF;
         }
 
-        ret = hzero_qpack_huffman_decode(
+        if (hzero_qpack_huffman_decode(
             input,
             input + input_length,
-            data, sizeof(data), &nb_data);
-        if (ret == 0) {
-            if (nb_data != 0) {
-                DBG_PRINTF("Huffman eof test %d bad length (%d vs %d)\n", (int)i,
-                    (int)nb_data, 0);
-                ret = -1;
-            }
-        }
-        else {
-            DBG_PRINTF("Huffman cannot decode eof test %d\n", (int)i);
+            data, sizeof(data), &nb_data) == 0) {
+            DBG_PRINTF("Huffman eof test %d, long padding not detected", (int)i);
+            ret = -1;
         }
     }
     return ret;
 }
 
 
+/* Test of QPACK Huffman encoding. The RFC examples must be encoded to the
+ * expected bytes, all octet values must survive a round trip, and the
+ * decoder must reject the EOS code, invalid padding and output overflow.
+ */
+int qpack_huffman_encode_test()
+{
+    int ret = 0;
+    uint8_t encoded[1024];
+    uint8_t data[256];
+    uint8_t all_octets[256];
+    size_t nb_data;
+
+    for (size_t i = 0; ret == 0 && i < nb_qpack_huffman_test_case; i++) {
+        size_t length = h3zero_qpack_huffman_length(qpack_huffman_test_case[i].result, qpack_huffman_test_case[i].result_size);
+        uint8_t* last = h3zero_qpack_huffman_encode(encoded, encoded + sizeof(encoded),
+            qpack_huffman_test_case[i].result, qpack_huffman_test_case[i].result_size);
+
+        if (last == NULL || (size_t)(last - encoded) != length || length != qpack_huffman_test_case[i].test_size ||
+            memcmp(encoded, qpack_huffman_test_case[i].test, length) != 0) {
+            DBG_PRINTF("Huffman encode test %d does not match", (int)i);
+            ret = -1;
+        }
+        else if (h3zero_qpack_huffman_encode(encoded, encoded + length - 1,
+            qpack_huffman_test_case[i].result, qpack_huffman_test_case[i].result_size) != NULL) {
+            DBG_PRINTF("Huffman encode test %d does not detect overflow", (int)i);
+            ret = -1;
+        }
+    }
+
+    for (int reverse = 0; ret == 0 && reverse < 2; reverse++) {
+        uint8_t* last;
+
+        for (int i = 0; i < 256; i++) {
+            all_octets[i] = (uint8_t)((reverse) ? 255 - i : i);
+        }
+        last = h3zero_qpack_huffman_encode(encoded, encoded + sizeof(encoded), all_octets, sizeof(all_octets));
+        if (last == NULL) {
+            DBG_PRINTF("Cannot encode all octets, reverse = %d", reverse);
+            ret = -1;
+        }
+        else if (hzero_qpack_huffman_decode(encoded, last, data, sizeof(data), &nb_data) != 0 ||
+            nb_data != sizeof(all_octets) || memcmp(data, all_octets, nb_data) != 0) {
+            DBG_PRINTF("Cannot decode all octets, reverse = %d", reverse);
+            ret = -1;
+        }
+        else if (hzero_qpack_huffman_decode(encoded, last, data, sizeof(data) - 1, &nb_data) == 0) {
+            DBG_PRINTF("Output overflow not detected, reverse = %d", reverse);
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        /* 32 bits set include the 30 bits EOS code */
+        uint8_t eos[4] = { 0xff, 0xff, 0xff, 0xff };
+        /* Code for '0' followed by 3 bits of zero padding */
+        uint8_t bad_padding[1] = { 0x00 };
+        /* Code for '0' followed by 11 bits of padding, all ones */
+        uint8_t long_padding[2] = { 0x07, 0xff };
+
+        if (hzero_qpack_huffman_decode(eos, eos + sizeof(eos), data, sizeof(data), &nb_data) == 0) {
+            DBG_PRINTF("%s", "EOS code not detected");
+            ret = -1;
+        }
+        else if (hzero_qpack_huffman_decode(bad_padding, bad_padding + sizeof(bad_padding), data, sizeof(data), &nb_data) == 0) {
+            DBG_PRINTF("%s", "Bad padding not detected");
+            ret = -1;
+        }
+        else if (hzero_qpack_huffman_decode(long_padding, long_padding + sizeof(long_padding), data, sizeof(data), &nb_data) == 0) {
+            DBG_PRINTF("%s", "Padding longer than 7 bits not detected");
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
 #define QPACK_HUFFMAN_TXT "qpack_huffman.txt"
 
 /* Test decoding of basic QPACK messages */
@@ -550,10 +622,14 @@ int qpack_huffman_base_test()
 #define QPACK_TEST_HEADER_STATUS_LEN 7
 #define QPACK_TEST_HEADER_QPACK_PATH 0xFD, 0xFD, 0xFD 
 #define QPACK_TEST_HEADER_DEQPACK_PATH 'Z', 'Z', 'Z'
-#define QPACK_TEST_HEADER_HOST 0x50, 0x0b, 'e', 'x', 'a', 'm', 'p', 'l', 'e', '.', 'c', 'o', 'm'
+/* Host "example.com", Huffman encoded */
+#define QPACK_TEST_HEADER_HOST 0x50, 0x80 | 8, 0x2f, 0x91, 0xd3, 0x5d, 0x05, 0x5c, 0x87, 0xa7
 #define QPACK_TEST_HEADER_ALLOW_GET_POST 
 #define QPACK_TEST_ALLOWED_METHODS 'G', 'E', 'T', ',', ' ', 'P', 'O', 'S', 'T', ',', ' ', 'C', 'O', 'N', 'N', 'E', 'C', 'T'
 #define QPACK_TEST_ALLOWED_METHODS_LEN 18
+/* "GET, POST, CONNECT", Huffman encoded */
+#define QPACK_TEST_ALLOWED_METHODS_HUFFMAN 0xc5, 0x83, 0x7f, 0xd2, 0x9a, 0xf5, 0x6e, 0xdf, 0xf4, 0xa5, 0xed, 0x5a, 0x74, 0xe0, 0xbd, 0xbf
+#define QPACK_TEST_ALLOWED_METHODS_HUFFMAN_LEN 16
 
 static uint8_t qpack_test_get_slash[] = {
     QPACK_TEST_HEADER_BLOCK_PREFIX, 0xC0|17, 0xC0 | 1 };
@@ -589,7 +665,7 @@ static uint8_t qpack_test_status_405_code[] = {
 static uint8_t qpack_test_status_405_null[] = {
     QPACK_TEST_HEADER_BLOCK_PREFIX, 0x50 | 0x0F,  H3ZERO_QPACK_CODE_404 - 0x0F, 3, '4', '0', '5',
     0x50 | 0x0F, H3ZERO_QPACK_ALLOW_GET - 0x0F,
-    QPACK_TEST_ALLOWED_METHODS_LEN, QPACK_TEST_ALLOWED_METHODS };
+    0x80 | QPACK_TEST_ALLOWED_METHODS_HUFFMAN_LEN, QPACK_TEST_ALLOWED_METHODS_HUFFMAN };
 
 static uint8_t qpack_test_get_zzz[] = {
     QPACK_TEST_HEADER_BLOCK_PREFIX, 0xC0 | 17, 0x50 | 1,
@@ -940,6 +1016,11 @@ int h3zero_prepare_qpack_test()
 #define QPACK_TEST_UA_STRING_LEN 10
 #define QPACK_TEST_UA_STRING_TEST 'T', 'e', 's', 't', '/', '1', '.', '0'
 #define QPACK_TEST_UA_STRING_TEST_LEN 8
+/* The encoder uses Huffman when it is shorter, as for these strings */
+#define QPACK_TEST_UA_STRING_HUFFMAN 0xc6, 0xcf, 0xe9, 0x6c, 0x3b, 0x01, 0x5c, 0x1f
+#define QPACK_TEST_UA_STRING_HUFFMAN_LEN 8
+#define QPACK_TEST_UA_STRING_TEST_HUFFMAN 0xde, 0x54, 0x25, 0x80, 0xae, 0x0f
+#define QPACK_TEST_UA_STRING_TEST_HUFFMAN_LEN 6
 char const h3zero_test_ua_string[] = { QPACK_TEST_UA_STRING_TEST, 0 };
 char const h3zero_test_ua_post_path[] = { QPACK_TEST_HEADER_DEQPACK_PATH, 0 };
 
@@ -947,44 +1028,44 @@ static uint8_t qpack_test_get_slash_ua[] = {
     QPACK_TEST_HEADER_BLOCK_PREFIX, 0xC0 | 17, 0xC0 | 23,
     0x51, 1, '/',
     QPACK_TEST_HEADER_HOST,
-    0x5f, 95 - 0x0f, QPACK_TEST_UA_STRING_LEN, QPACK_TEST_UA_STRING
+    0x5f, 95 - 0x0f, 0x80 | QPACK_TEST_UA_STRING_HUFFMAN_LEN, QPACK_TEST_UA_STRING_HUFFMAN
 };
 static uint8_t qpack_test_post_zzz_ua[] = {
     QPACK_TEST_HEADER_BLOCK_PREFIX, 0xC0 | 20, 0xC0 | 23,
     0x50 | 1, 3, QPACK_TEST_HEADER_DEQPACK_PATH,
     QPACK_TEST_HEADER_HOST,
-    0x5f, 95 - 0x0f, QPACK_TEST_UA_STRING_LEN, QPACK_TEST_UA_STRING, 0xF5
+    0x5f, 95 - 0x0f, 0x80 | QPACK_TEST_UA_STRING_HUFFMAN_LEN, QPACK_TEST_UA_STRING_HUFFMAN, 0xF5
 };
 static uint8_t qpack_test_status_404_srv[] = {
     QPACK_TEST_HEADER_BLOCK_PREFIX, 0xC0 | 27,
-    0x5f, 92 - 0x0f, QPACK_TEST_UA_STRING_LEN, QPACK_TEST_UA_STRING
+    0x5f, 92 - 0x0f, 0x80 | QPACK_TEST_UA_STRING_HUFFMAN_LEN, QPACK_TEST_UA_STRING_HUFFMAN
 };
 static uint8_t qpack_test_status_405_srv[] = {
     QPACK_TEST_HEADER_BLOCK_PREFIX, 0x50 | 0x0F,  H3ZERO_QPACK_CODE_404 - 0x0F, 3, '4', '0', '5',
-    0x5f, 92 - 0x0f, QPACK_TEST_UA_STRING_LEN, QPACK_TEST_UA_STRING,
+    0x5f, 92 - 0x0f, 0x80 | QPACK_TEST_UA_STRING_HUFFMAN_LEN, QPACK_TEST_UA_STRING_HUFFMAN,
     0x50 | 0x0F, H3ZERO_QPACK_ALLOW_GET - 0x0F,
-    QPACK_TEST_ALLOWED_METHODS_LEN, QPACK_TEST_ALLOWED_METHODS };
+    0x80 | QPACK_TEST_ALLOWED_METHODS_HUFFMAN_LEN, QPACK_TEST_ALLOWED_METHODS_HUFFMAN };
 static uint8_t qpack_test_get_slash_ua2[] = {
     QPACK_TEST_HEADER_BLOCK_PREFIX, 0xC0 | 17, 0xC0 | 23,
     0x51, 1, '/',
     QPACK_TEST_HEADER_HOST,
-    0x5f, 95 - 0x0f, QPACK_TEST_UA_STRING_TEST_LEN, QPACK_TEST_UA_STRING_TEST
+    0x5f, 95 - 0x0f, 0x80 | QPACK_TEST_UA_STRING_TEST_HUFFMAN_LEN, QPACK_TEST_UA_STRING_TEST_HUFFMAN
 };
 static uint8_t qpack_test_post_zzz_ua2[] = {
     QPACK_TEST_HEADER_BLOCK_PREFIX, 0xC0 | 20, 0xC0 | 23,
     0x50 | 1, 3, QPACK_TEST_HEADER_DEQPACK_PATH,
     QPACK_TEST_HEADER_HOST,
-    0x5f, 95 - 0x0f, QPACK_TEST_UA_STRING_TEST_LEN, QPACK_TEST_UA_STRING_TEST, 0xF5
+    0x5f, 95 - 0x0f, 0x80 | QPACK_TEST_UA_STRING_TEST_HUFFMAN_LEN, QPACK_TEST_UA_STRING_TEST_HUFFMAN, 0xF5
 };
 static uint8_t qpack_test_status_404_srv2[] = {
     QPACK_TEST_HEADER_BLOCK_PREFIX, 0xC0 | 27,
-    0x5f, 92 - 0x0f, QPACK_TEST_UA_STRING_TEST_LEN, QPACK_TEST_UA_STRING_TEST
+    0x5f, 92 - 0x0f, 0x80 | QPACK_TEST_UA_STRING_TEST_HUFFMAN_LEN, QPACK_TEST_UA_STRING_TEST_HUFFMAN
 };
 static uint8_t qpack_test_status_405_srv2[] = {
     QPACK_TEST_HEADER_BLOCK_PREFIX, 0x50 | 0x0F, H3ZERO_QPACK_CODE_404 - 0x0F, 3, '4', '0', '5',
-    0x5f, 92 - 0x0f, QPACK_TEST_UA_STRING_TEST_LEN, QPACK_TEST_UA_STRING_TEST,
+    0x5f, 92 - 0x0f, 0x80 | QPACK_TEST_UA_STRING_TEST_HUFFMAN_LEN, QPACK_TEST_UA_STRING_TEST_HUFFMAN,
     0x50 | 0x0F, H3ZERO_QPACK_ALLOW_GET - 0x0F,
-    QPACK_TEST_ALLOWED_METHODS_LEN, QPACK_TEST_ALLOWED_METHODS };
+    0x80 | QPACK_TEST_ALLOWED_METHODS_HUFFMAN_LEN, QPACK_TEST_ALLOWED_METHODS_HUFFMAN };
 
 typedef struct st_h3zero_user_agent_case_t {
     uint8_t* data;
@@ -1328,6 +1409,242 @@ int h3zero_stream_test()
 }
 
 
+/*
+ * Check that header frames received in a single delivery are parsed in
+ * place, and that frames split across deliveries use the buffer pool.
+ */
+
+static int h3zero_frame_pool_test_one(h3zero_frame_pool_t* pool, uint8_t* bytes, size_t nb_bytes,
+    size_t split, uint64_t nb_allocated_expected)
+{
+    int ret = 0;
+    h3zero_data_stream_state_t stream_state;
+    uint8_t packet_buffer[256];
+    size_t nb_data = 0;
+    size_t consumed = 0;
+
+    memset(&stream_state, 0, sizeof(h3zero_data_stream_state_t));
+    stream_state.frame_pool = pool;
+
+    while (ret == 0 && consumed < nb_bytes) {
+        size_t delivered = (consumed < split) ? split - consumed : nb_bytes - consumed;
+        uint8_t* p = packet_buffer;
+        uint8_t* p_max = packet_buffer + delivered;
+        size_t available_data;
+        uint64_t error_found;
+
+        memcpy(packet_buffer, bytes + consumed, delivered);
+        while (p != NULL && p < p_max) {
+            p = h3zero_parse_data_stream(p, p_max, &stream_state, &available_data, &error_found);
+            if (p != NULL) {
+                p += available_data;
+                nb_data += available_data;
+            }
+        }
+        if (p == NULL) {
+            DBG_PRINTF("Parse error 0x%" PRIx64 ", split %zu", error_found, split);
+            ret = -1;
+        }
+        consumed += delivered;
+    }
+
+    if (ret == 0 && (!stream_state.header_found || nb_data != sizeof(h3zero_stream_test2_data))) {
+        DBG_PRINTF("Header found: %d, data: %zu, split %zu", stream_state.header_found, nb_data, split);
+        ret = -1;
+    }
+    if (ret == 0 && stream_state.current_frame != NULL) {
+        DBG_PRINTF("Frame buffer still attached, split %zu", split);
+        ret = -1;
+    }
+    if (ret == 0 && pool->nb_allocated != nb_allocated_expected) {
+        DBG_PRINTF("Allocated %" PRIu64 " frame buffers instead of %" PRIu64 ", split %zu",
+            pool->nb_allocated, nb_allocated_expected, split);
+        ret = -1;
+    }
+
+    h3zero_delete_data_stream_state(&stream_state);
+
+    return ret;
+}
+
+/* Requests received on successive streams of a connection. Once the pool
+ * holds a buffer for the stream context and one for the path, the
+ * following requests do not allocate any more memory.
+ */
+static int h3zero_frame_pool_request_test()
+{
+    int ret = 0;
+    h3zero_callback_ctx_t* ctx = h3zero_callback_create_context(NULL);
+    uint8_t request[256];
+    uint8_t* request_max = NULL;
+    char const* path = "/index.html";
+    uint64_t nb_allocated_primed = 0;
+
+    if (ctx == NULL) {
+        DBG_PRINTF("%s", "Cannot create the callback context");
+        ret = -1;
+    }
+    else if ((request_max = h3zero_create_request_header_frame(request + 2, request + sizeof(request),
+        (uint8_t const*)path, strlen(path), "example.com")) == NULL ||
+        request_max - request - 2 >= 64) {
+        DBG_PRINTF("%s", "Cannot create the request header");
+        ret = -1;
+    }
+    else {
+        request[0] = h3zero_frame_header;
+        request[1] = (uint8_t)(request_max - request - 2);
+    }
+
+    for (uint64_t i = 0; ret == 0 && i < 8; i++) {
+        h3zero_stream_ctx_t* stream_ctx = h3zero_find_or_create_stream(NULL, 4 * i, ctx, 1, 1);
+        uint8_t* p = request;
+        size_t available_data = 0;
+        uint64_t error_found = 0;
+
+        if (stream_ctx == NULL) {
+            DBG_PRINTF("Cannot create stream %" PRIu64, 4 * i);
+            ret = -1;
+            break;
+        }
+        while (p != NULL && p < request_max) {
+            p = h3zero_parse_data_stream(p, request_max, &stream_ctx->ps.stream_state, &available_data, &error_found);
+        }
+        if (p == NULL || !stream_ctx->ps.stream_state.header_found ||
+            stream_ctx->ps.stream_state.header.path_length != strlen(path) ||
+            memcmp(stream_ctx->ps.stream_state.header.path, path, strlen(path)) != 0) {
+            DBG_PRINTF("Request not parsed on stream %" PRIu64, 4 * i);
+            ret = -1;
+        }
+        else if (!stream_ctx->is_ctx_pooled || !stream_ctx->ps.stream_state.header.path_is_pooled) {
+            DBG_PRINTF("Stream context or path not pooled on stream %" PRIu64, 4 * i);
+            ret = -1;
+        }
+        else if (i == 0) {
+            nb_allocated_primed = ctx->frame_pool.nb_allocated;
+        }
+        else if (ctx->frame_pool.nb_allocated != nb_allocated_primed) {
+            DBG_PRINTF("Allocated %" PRIu64 " pool buffers instead of %" PRIu64 " on stream %" PRIu64,
+                ctx->frame_pool.nb_allocated, nb_allocated_primed, 4 * i);
+            ret = -1;
+        }
+        h3zero_delete_stream(NULL, ctx, stream_ctx);
+    }
+
+    if (ctx != NULL) {
+        h3zero_callback_delete_context(NULL, ctx);
+    }
+
+    return ret;
+}
+
+int h3zero_frame_pool_test()
+{
+    int ret = 0;
+    h3zero_frame_pool_t pool;
+    uint8_t* bytes = h3zero_stream_test2;
+    size_t nb_bytes = sizeof(h3zero_stream_test2);
+
+    memset(&pool, 0, sizeof(h3zero_frame_pool_t));
+
+    /* Contiguous header frame, parsed in place. */
+    ret = h3zero_frame_pool_test_one(&pool, bytes, nb_bytes, nb_bytes, 0);
+    /* Header frame split after the first content byte, then at every content byte.
+     * The first split allocates one buffer, the next ones reuse it. */
+    for (size_t split = 3; ret == 0 && split < 6; split++) {
+        ret = h3zero_frame_pool_test_one(&pool, bytes, nb_bytes, split, 1);
+    }
+    if (ret == 0 && pool.nb_buffers != 1) {
+        DBG_PRINTF("Expected 1 pooled buffer, got %zu", pool.nb_buffers);
+        ret = -1;
+    }
+    if (ret == 0) {
+        DBG_PRINTF("Stream context size: %zu bytes", sizeof(h3zero_stream_ctx_t));
+    }
+
+    h3zero_frame_pool_release(&pool);
+
+    if (ret == 0) {
+        ret = h3zero_frame_pool_request_test();
+    }
+
+    return ret;
+}
+
+
+/*
+ * Check the stream lookup index with a large number of streams, including
+ * growth of the index and deletion of streams through the stream tree.
+ */
+#define H3ZERO_STREAM_INDEX_TEST_NB 4000
+
+int h3zero_stream_index_test()
+{
+    int ret = 0;
+    h3zero_callback_ctx_t* ctx = h3zero_callback_create_context(NULL);
+
+    if (ctx == NULL) {
+        ret = -1;
+    }
+
+    for (uint64_t i = 0; ret == 0 && i < H3ZERO_STREAM_INDEX_TEST_NB; i++) {
+        h3zero_stream_ctx_t* stream_ctx = h3zero_find_or_create_stream(NULL, 4 * i, ctx, 1, 1);
+        if (stream_ctx == NULL || stream_ctx->stream_id != 4 * i) {
+            DBG_PRINTF("Cannot create stream %" PRIu64, 4 * i);
+            ret = -1;
+        }
+    }
+
+    if (ret == 0 && (ctx->h3_stream_index == NULL || ctx->h3_stream_index->count != H3ZERO_STREAM_INDEX_TEST_NB ||
+        2 * ctx->h3_stream_index->nb_bin < H3ZERO_STREAM_INDEX_TEST_NB / 2)) {
+        DBG_PRINTF("%s", "Stream index did not grow as expected");
+        ret = -1;
+    }
+
+    /* Delete the odd streams */
+    for (uint64_t i = 1; ret == 0 && i < H3ZERO_STREAM_INDEX_TEST_NB; i += 2) {
+        h3zero_stream_ctx_t* stream_ctx = h3zero_find_stream(ctx, 4 * i);
+        if (stream_ctx == NULL) {
+            DBG_PRINTF("Cannot find stream %" PRIu64, 4 * i);
+            ret = -1;
+        }
+        else {
+            h3zero_delete_stream(NULL, ctx, stream_ctx);
+        }
+    }
+
+    if (ret == 0) {
+        uint64_t t0 = picoquic_current_time();
+        uint64_t lookup_us;
+        int nb_rounds = 100;
+
+        for (int r = 0; ret == 0 && r < nb_rounds; r++) {
+            for (uint64_t i = 0; ret == 0 && i < H3ZERO_STREAM_INDEX_TEST_NB; i++) {
+                h3zero_stream_ctx_t* stream_ctx = h3zero_find_stream(ctx, 4 * i);
+                if ((i & 1) == 0 && (stream_ctx == NULL || stream_ctx->stream_id != 4 * i)) {
+                    DBG_PRINTF("Stream %" PRIu64 " not found", 4 * i);
+                    ret = -1;
+                }
+                else if ((i & 1) != 0 && stream_ctx != NULL) {
+                    DBG_PRINTF("Deleted stream %" PRIu64 " still found", 4 * i);
+                    ret = -1;
+                }
+            }
+        }
+        lookup_us = picoquic_current_time() - t0;
+        if (ret == 0) {
+            DBG_PRINTF("%d lookups in %" PRIu64 " us, %zu streams in %zu bins", nb_rounds * H3ZERO_STREAM_INDEX_TEST_NB,
+                lookup_us, ctx->h3_stream_index->count, ctx->h3_stream_index->nb_bin);
+        }
+    }
+
+    if (ctx != NULL) {
+        h3zero_callback_delete_context(NULL, ctx);
+    }
+
+    return ret;
+}
+
+
 /*
  * Test the scenario parsing function
  */
@@ -1785,8 +2102,8 @@ int h09_header_split_test(const uint8_t* bytes, size_t length, size_t split, h09
     }
 
     if (stream_ctx != NULL) {
-        if (stream_ctx->ps.hq.path != NULL) {
-            free(stream_ctx->ps.hq.path);
+        if (stream_ctx->frame != NULL) {
+            free(stream_ctx->frame);
         }
         free(stream_ctx);
     }
@@ -2213,6 +2530,28 @@ int demo_server_file_test()
         ret = file_test_compare(&file_param, &file_test_scenario[0]);
     }
 
+    if (ret == 0) {
+        /* Same test, serving the file from the file cache */
+        if ((file_param.file_cache = h3zero_file_cache_create(16, 4)) == NULL) {
+            ret = -1;
+        }
+        else {
+            if ((ret = demo_server_test(PICOHTTP_ALPN_H3_LATEST, h3zero_callback, (void*)&file_param,
+                file_test_scenario, nb_file_test_scenario, demo_file_test_stream_length, 0, 0, 0, 0, NULL, NULL, NULL, 0)) != 0) {
+                DBG_PRINTF("H3 server (%s) file cache test fails, ret = %d\n", PICOHTTP_ALPN_H3_LATEST, ret);
+            }
+            else if (file_param.file_cache->nb_opens != 1 || file_param.file_cache->nb_idle != 1) {
+                DBG_PRINTF("File cache: %" PRIu64 " opens, %zu idle", file_param.file_cache->nb_opens, file_param.file_cache->nb_idle);
+                ret = -1;
+            }
+            else {
+                ret = file_test_compare(&file_param, &file_test_scenario[0]);
+            }
+            h3zero_file_cache_delete(file_param.file_cache);
+            file_param.file_cache = NULL;
+        }
+    }
+
     if (ret == 0 && (ret = demo_server_test(PICOHTTP_ALPN_HQ_LATEST, picoquic_h09_server_callback, (void*)&file_param,
         file_test_scenario, nb_file_test_scenario, demo_file_test_stream_length, 0, 0, 0, 0, NULL, NULL, NULL, 0)) != 0) {
         DBG_PRINTF("H09 server (%s) file test fails, ret = %d\n", PICOHTTP_ALPN_HQ_LATEST, ret);
@@ -2240,733 +2579,1673 @@ int demo_server_file_test()
     return ret;
 }
 
-static const picoquic_demo_stream_desc_t satellite_test_scenario[] = {
-    { 0, 0, PICOQUIC_DEMO_STREAM_ID_INITIAL, "/10000000", "bin10M.txt", 0 }
-};
-
-static const size_t nb_satellite_test_scenario = sizeof(satellite_test_scenario) / sizeof(picoquic_demo_stream_desc_t);
-
-int h3zero_satellite_test()
-{
-    return demo_server_test(PICOHTTP_ALPN_H3_LATEST, h3zero_callback, NULL, satellite_test_scenario, nb_satellite_test_scenario,
-        demo_test_stream_length, 1, 0, 10750000, 0, NULL, NULL, NULL, 0);
-}
-
-int h09_satellite_test()
-{
-    return demo_server_test(PICOHTTP_ALPN_HQ_LATEST, picoquic_h09_server_callback, NULL, satellite_test_scenario, nb_satellite_test_scenario, 
-        demo_test_stream_length, 1, 0, 10750000, 0, NULL, NULL, NULL, 0);
-}
-
-int h09_lone_fin_test()
+/* Test of the file cache: files are opened once and shared by the
+ * streams that serve them, idle files are closed in LRU order, and the
+ * content read at any offset matches the file.
+ */
+static int h3zero_file_cache_create_test_file(char const* file_name, size_t nb_blocks, size_t block_size)
 {
     int ret = 0;
-    char file_name_buffer[1024];
-    picohttp_server_parameters_t file_param;
+    uint8_t buf[1024];
+    FILE* F = picoquic_file_open(file_name, "wb");
 
-    ret = serve_file_test_set_param(&file_param, file_name_buffer, sizeof(file_name_buffer));
-
-    if (ret == 0 && (ret = demo_server_test(PICOHTTP_ALPN_HQ_LATEST, picoquic_h09_server_callback, (void*)&file_param, 
-        file_test_scenario, nb_file_test_scenario, demo_file_test_stream_length, 0, 0, 0, 1, NULL, NULL, NULL, 0)) != 0) {
-        DBG_PRINTF("H09 server (%s) file test fails, ret = %d\n", PICOHTTP_ALPN_HQ_LATEST, ret);
+    if (F == NULL || block_size > sizeof(buf)) {
+        DBG_PRINTF("Cannot create file: %s", file_name);
+        ret = -1;
     }
-    else if (ret == 0) {
-        ret = file_test_compare(&file_param, &file_test_scenario[0]);
+    else {
+        for (size_t i = 0; ret == 0 && i < nb_blocks; i++) {
+            memset(buf, (int)(i & 0xFF), block_size);
+            if (fwrite(buf, 1, block_size, F) != block_size) {
+                ret = -1;
+            }
+        }
+    }
+    if (F != NULL) {
+        (void)picoquic_file_close(F);
     }
 
     return ret;
 }
 
-#ifndef _WINDOWS
-const char doc_name_long[] = { '/', FILE_NAME_LONG, 0};
-const char file_name_long[] = { '.', '/', FILE_NAME_LONG, 0 };
-
-static const picoquic_demo_stream_desc_t long_file_name_scenario[] = {
-    { 0, 0, PICOQUIC_DEMO_STREAM_ID_INITIAL, doc_name_long, file_name_long, 0 }
-};
-
-static const size_t nb_long_file_name_scenario = sizeof(long_file_name_scenario) / sizeof(picoquic_demo_stream_desc_t);
-#endif
-
-static size_t const long_file_name_stream_length[] = {
-    32
-};
-
-int h3_long_file_name_test()
+int h3zero_file_cache_test()
 {
     int ret = 0;
-#ifdef _WINDOWS
-    /* In contrast to Unix, the path size in Windows is limited to 260 bytes.
-     * This means that the maximum path size depends on the size of the path
-     * to the working directory. It has to be kept small enough! */
-    DWORD current_directory_length = GetCurrentDirectory(0, NULL);
-    picoquic_demo_stream_desc_t scenario_line;
-    char file_name_var[MAX_PATH];
-    char doc_name_var[MAX_PATH];
-    size_t name_length = 0;
-    size_t file_name_length = 0;
-    size_t doc_name_length = 0;
+    char const* file_names[2] = { "x1234x5679.zzz", "x1234x5680.zzz" };
+    h3zero_file_cache_t* cache = NULL;
+    h3zero_file_entry_t* entries[3] = { NULL, NULL, NULL };
+    uint8_t buf[300];
 
-    if (current_directory_length + 7 >= MAX_PATH) {
-        DBG_PRINTF("Current Directory too long for test: %d chars", current_directory_length);
+    for (int i = 0; ret == 0 && i < 2; i++) {
+        ret = h3zero_file_cache_create_test_file(file_names[i], 16, 128);
+    }
+
+    if (ret == 0 && (cache = h3zero_file_cache_create(16, 1)) == NULL) {
         ret = -1;
     }
-    else {
-        name_length = MAX_PATH - current_directory_length - 7;
-        if (name_length > 253) {
-            name_length = 253;
+
+    if (ret == 0) {
+        /* Two streams serving the same file share the entry */
+        entries[0] = h3zero_file_cache_open(cache, file_names[0]);
+        entries[1] = h3zero_file_cache_open(cache, file_names[0]);
+        if (entries[0] == NULL || entries[0] != entries[1] || cache->nb_opens != 1 || cache->nb_hits != 1 ||
+            entries[0]->file_size != 16 * 128) {
+            DBG_PRINTF("%s", "Entries are not shared");
+            ret = -1;
         }
-        file_name_var[file_name_length++] = '.';
-        file_name_var[file_name_length++] = '\\';
-        doc_name_var[doc_name_length++] = '/';
-        for (size_t i = 0; i < name_length; i++) {
-            file_name_var[file_name_length++] = '0';
-            doc_name_var[doc_name_length++] = '0';
-        }
-        file_name_var[file_name_length++] = '3';
-        doc_name_var[doc_name_length++] = '3';
-        file_name_var[file_name_length++] = '2';
-        doc_name_var[doc_name_length++] = '2';
-        file_name_var[file_name_length++] = 0;
-        doc_name_var[doc_name_length++] = 0;
-        scenario_line.repeat_count = 0;
-        scenario_line.stream_id = 0;
-        scenario_line.previous_stream_id = PICOQUIC_DEMO_STREAM_ID_INITIAL;
-        scenario_line.doc_name = doc_name_var;
-        scenario_line.f_name = file_name_var;
-        scenario_line.post_size = 0;
+    }
 
-        ret = demo_server_test(PICOHTTP_ALPN_H3_LATEST, h3zero_callback, NULL, &scenario_line, 1,
-            long_file_name_stream_length, 0, 0, 400000, 0, NULL, NULL, NULL, 0);
+    if (ret == 0) {
+        /* Read across block boundaries, and at the end of the file */
+        uint64_t offsets[3] = { 0, 100, 16 * 128 - sizeof(buf) };
+
+        for (int i = 0; ret == 0 && i < 3; i++) {
+            if (h3zero_file_entry_read(entries[i & 1], offsets[i], buf, sizeof(buf)) != 0) {
+                DBG_PRINTF("Cannot read at offset %" PRIu64, offsets[i]);
+                ret = -1;
+            }
+            for (size_t j = 0; ret == 0 && j < sizeof(buf); j++) {
+                if (buf[j] != (uint8_t)((offsets[i] + j) / 128)) {
+                    DBG_PRINTF("Bad content at offset %" PRIu64, offsets[i] + j);
+                    ret = -1;
+                }
+            }
+        }
+        if (ret == 0 && h3zero_file_entry_read(entries[0], 16 * 128 - 1, buf, 2) == 0) {
+            DBG_PRINTF("%s", "Read past the end of file not detected");
+            ret = -1;
+        }
     }
-#else
-    ret = demo_server_test(PICOHTTP_ALPN_H3_LATEST, h3zero_callback, NULL, 
-        long_file_name_scenario, nb_long_file_name_scenario, 
-        long_file_name_stream_length, 0, 0, 400000, 0, NULL, NULL, NULL, 0);
-#endif
-    return ret;
-}
 
-/* Multi-file test.
- * Create a list of file and their content in the folder "www" in current directory.
- * Create in memory a scenario with the list of files to download in parallel by the client.
- * Execute the scenario, downloading the file in the client scenario.
- * Verify that all the files have been properly received. */
-static void demo_test_create_directory(char const* dir_path)
-{
-#ifdef _WINDOWS
-    (void)_mkdir(dir_path);
-#else
-    (void)mkdir(dir_path, 0777);
-#endif
-}
+    if (ret == 0) {
+        /* Released entries stay open, within the idle limit */
+        h3zero_file_cache_release(entries[0]);
+        h3zero_file_cache_release(entries[1]);
+        entries[0] = NULL;
+        entries[1] = NULL;
+        if (cache->nb_idle != 1 || (entries[0] = h3zero_file_cache_open(cache, file_names[0])) == NULL ||
+            cache->nb_opens != 1 || cache->nb_idle != 0) {
+            DBG_PRINTF("%s", "Idle entry not reused");
+            ret = -1;
+        }
+        else {
+            h3zero_file_cache_release(entries[0]);
+            entries[0] = NULL;
+        }
+    }
 
-static int demo_test_create_file(char const* dir_path, char const* file_name, size_t length, uint64_t* random_ctx)
-{
-    int ret = 0;
-    char name[1024];
-    FILE* F;
-    size_t nb_sprintf;
+    if (ret == 0) {
+        /* Opening another file evicts the least recently used idle entry */
+        if ((entries[2] = h3zero_file_cache_open(cache, file_names[1])) == NULL) {
+            ret = -1;
+        }
+        else {
+            h3zero_file_cache_release(entries[2]);
+            entries[2] = NULL;
+            if (cache->nb_idle != 1 || cache->table->count != 1 || cache->first_idle == NULL ||
+                strcmp(cache->first_idle->file_path, file_names[1]) != 0) {
+                DBG_PRINTF("%s", "LRU entry not evicted");
+                ret = -1;
+            }
+        }
+    }
 
-    (void)picoquic_sprintf(name, sizeof(name), &nb_sprintf, "%s%s%s", dir_path, PICOQUIC_FILE_SEPARATOR, file_name);
+    if (ret == 0) {
+        /* A file truncated while open is detected when it is opened again.
+         * The new entry has the new size, and the stream still using the
+         * old entry does not read past the new end */
+        if ((entries[2] = h3zero_file_cache_open(cache, file_names[1])) == NULL ||
+            h3zero_file_cache_create_test_file(file_names[1], 4, 128) != 0) {
+            ret = -1;
+        }
+        else if ((entries[0] = h3zero_file_cache_open(cache, file_names[1])) == NULL ||
+            entries[0] == entries[2] || entries[0]->file_size != 4 * 128 || cache->nb_invalidations != 1) {
+            DBG_PRINTF("%s", "Truncated file not detected when opened again");
+            ret = -1;
+        }
+        else if (h3zero_file_entry_read(entries[2], 16 * 128 - sizeof(buf), buf, sizeof(buf)) == 0) {
+            DBG_PRINTF("%s", "Read past the end of a truncated file not detected");
+            ret = -1;
+        }
+        else if (h3zero_file_entry_read(entries[2], 0, buf, 100) != 0 || buf[0] != 0 || buf[99] != 0 ||
+            h3zero_file_entry_read(entries[0], 4 * 128 - 100, buf, 100) != 0 || buf[0] != 3 || buf[99] != 3) {
+            DBG_PRINTF("%s", "Cannot read the beginning of a truncated file");
+            ret = -1;
+        }
+    }
 
-    if ((F = picoquic_file_open(name, "wb")) == NULL) {
+    if (ret == 0 && h3zero_file_cache_open(cache, "x1234x5681.zzz") != NULL) {
+        DBG_PRINTF("%s", "Opened a missing file");
         ret = -1;
     }
-    else {
-        uint8_t data[128];
-        size_t written = 0;
 
-        while (written < length) {
-            size_t nb = length - written;
-            if (nb > sizeof(data)) {
-                nb = sizeof(data);
-            }
-            picoquic_test_random_bytes(random_ctx, data, nb);
-            if (fwrite(data, 1, nb, F) <= 0) {
-                ret = -1;
-                break;
+    if (cache != NULL) {
+        for (int i = 0; i < 3; i++) {
+            if (entries[i] != NULL) {
+                h3zero_file_cache_release(entries[i]);
             }
-            written += length;
         }
+        h3zero_file_cache_delete(cache);
+    }
 
-        (void)picoquic_file_close(F);
+    for (int i = 0; i < 2; i++) {
+        (void)remove(file_names[i]);
     }
 
     return ret;
 }
 
-static void demo_test_delete_file(char const* dir_path, char const* file_name)
+/* Benchmark of file serving, comparing the stdio path, which opens the
+ * file for each request and reads it with fread, with the file cache.
+ * Each request reads a 1MB file in packet size chunks. The result is
+ * reported in requests per second and in Gbps.
+ */
+#define H3ZERO_FILE_CACHE_BENCH_NB_REQUESTS 200
+#define H3ZERO_FILE_CACHE_BENCH_CHUNK 1440
+
+int h3zero_file_cache_bench_test()
 {
-    char name[1024];
-    size_t nb_sprintf;
+    int ret = 0;
+    char const* file_name = "x1234x5682.zzz";
+    size_t file_size = 1024 * 1024;
+    h3zero_file_cache_t* cache = NULL;
+    uint8_t buf[H3ZERO_FILE_CACHE_BENCH_CHUNK];
+    uint64_t duration_us[2] = { 0, 0 };
 
-    (void)picoquic_sprintf(name, sizeof(name), &nb_sprintf, "%s%s%s", dir_path, PICOQUIC_FILE_SEPARATOR, file_name);
+    ret = h3zero_file_cache_create_test_file(file_name, file_size / 1024, 1024);
 
-#ifdef _WINDOWS
-    (void)DeleteFileA(name);
-#else
-    (void)remove(name);
-#endif
-}
+    if (ret == 0 && (cache = h3zero_file_cache_create(16, 4)) == NULL) {
+        ret = -1;
+    }
 
-static char * demo_test_create_random_file_name(size_t name_length, uint64_t * random_ctx)
-{
-    size_t alloc_size = name_length + 1;
-    char* file_name = NULL;
-    if (name_length < alloc_size) {
-        file_name = (char*)malloc(alloc_size);
-        if (file_name != NULL) {
-            for (size_t i = 0; i < name_length; i++) {
-                file_name[i] = 'a' + (int)picoquic_test_uniform_random(random_ctx, 'z' - 'a' + 1);
+    for (int use_cache = 0; ret == 0 && use_cache < 2; use_cache++) {
+        uint64_t t0 = picoquic_current_time();
+
+        for (int r = 0; ret == 0 && r < H3ZERO_FILE_CACHE_BENCH_NB_REQUESTS; r++) {
+            FILE* F = NULL;
+            h3zero_file_entry_t* entry = NULL;
+
+            if (use_cache) {
+                entry = h3zero_file_cache_open(cache, file_name);
             }
-            file_name[name_length] = 0;
+            else {
+                F = picoquic_file_open(file_name, "rb");
+            }
+            if (F == NULL && entry == NULL) {
+                ret = -1;
+                break;
+            }
+            for (size_t sent = 0; ret == 0 && sent < file_size; sent += H3ZERO_FILE_CACHE_BENCH_CHUNK) {
+                size_t length = (file_size - sent > H3ZERO_FILE_CACHE_BENCH_CHUNK) ? H3ZERO_FILE_CACHE_BENCH_CHUNK : file_size - sent;
+
+                if (use_cache) {
+                    ret = h3zero_file_entry_read(entry, sent, buf, length);
+                }
+                else if (fread(buf, 1, length, F) != length) {
+                    ret = -1;
+                }
+                if (ret == 0 && buf[0] != (uint8_t)((sent / 1024) & 0xFF)) {
+                    ret = -1;
+                }
+            }
+            if (use_cache) {
+                h3zero_file_cache_release(entry);
+            }
+            else {
+                (void)picoquic_file_close(F);
+            }
+        }
+        duration_us[use_cache] = picoquic_current_time() - t0;
+        if (ret != 0) {
+            DBG_PRINTF("File read fails, use_cache = %d", use_cache);
+        }
+        else {
+            double seconds = (duration_us[use_cache] == 0) ? 0.000001 : (double)duration_us[use_cache] / 1000000.0;
+            DBG_PRINTF("%s: %.0f requests/s, %.2f Gbps", (use_cache) ? "File cache" : "Stdio",
+                H3ZERO_FILE_CACHE_BENCH_NB_REQUESTS / seconds,
+                ((double)H3ZERO_FILE_CACHE_BENCH_NB_REQUESTS * (double)file_size * 8.0) / (seconds * 1000000000.0));
         }
     }
-    return file_name;
-}
-
-static int demo_test_check_file(char const* www_path, char const* download_path, char const* file_name)
-{
-    int ret;
-    char name1[1024];
-    char name2[1024];
-    size_t nb_written;
-
-    (void)picoquic_sprintf(name1, sizeof(name1), &nb_written, "%s%s%s", www_path, PICOQUIC_FILE_SEPARATOR, file_name);
-    (void)picoquic_sprintf(name2, sizeof(name2), &nb_written, "%s%s%s", download_path, PICOQUIC_FILE_SEPARATOR, file_name);
 
-    if ((ret = picoquic_test_compare_binary_files(name1, name2)) != 0) {
-        DBG_PRINTF("Files %s != %s", name1, name2);
+    if (cache != NULL) {
+        h3zero_file_cache_delete(cache);
     }
+    (void)remove(file_name);
+
     return ret;
 }
 
-static int demo_test_multi_scenario_create(picoquic_demo_stream_desc_t** scenario, size_t** stream_length, uint64_t seed, size_t nb_files, size_t name_length, size_t length,
-    char const* dir_www, char const* dir_download)
+/* Test of the response cache: cached responses start with the same bytes
+ * as those built by the header functions, entries are evicted in LRU
+ * order when the count or size limits are exceeded, and file entries are
+ * invalidated when the file changes.
+ */
+int h3zero_response_cache_test()
 {
-    uint64_t random_ctx = seed;
     int ret = 0;
-    *scenario = NULL;
-    *stream_length = NULL;
-    demo_test_create_directory(dir_www);
-    demo_test_create_directory(dir_download);
+    char const* file_name = "x1234x5683.zzz";
+    char const* body = "<html>Hello</html>";
+    h3zero_file_cache_t* file_cache = NULL;
+    h3zero_response_cache_t* cache = NULL;
+    h3zero_response_entry_t* entry = NULL;
+    uint64_t current_time = 1000000;
+    uint8_t expected[256];
+    uint8_t* last;
+
+    ret = h3zero_file_cache_create_test_file(file_name, 4, 128);
+
+    if (ret == 0 && ((file_cache = h3zero_file_cache_create(16, 4)) == NULL ||
+        (cache = h3zero_response_cache_create(file_cache, 2, 4096, 1000000)) == NULL)) {
+        ret = -1;
+    }
 
     if (ret == 0) {
-        *scenario = (picoquic_demo_stream_desc_t*)malloc(sizeof(picoquic_demo_stream_desc_t) * nb_files);
-        if (*scenario == NULL) {
+        /* Inline body */
+        entry = h3zero_response_cache_add(cache, (const uint8_t*)"/", 1, NULL, 0, (const uint8_t*)body, strlen(body),
+            h3zero_content_type_text_html, H3ZERO_USER_AGENT_STRING, current_time);
+        expected[0] = h3zero_frame_header;
+        last = h3zero_create_response_header_frame_ex(expected + 3, expected + sizeof(expected), h3zero_content_type_text_html,
+            H3ZERO_USER_AGENT_STRING);
+        if (entry == NULL || last == NULL) {
+            DBG_PRINTF("%s", "Cannot add inline entry");
             ret = -1;
         }
         else {
-            memset(*scenario, 0, sizeof(picoquic_demo_stream_desc_t) * nb_files);
-            *stream_length = (size_t*)malloc(sizeof(size_t) * nb_files);
-            if (*stream_length == NULL) {
+            size_t header_length = last - expected - 3;
+            expected[1] = (uint8_t)((header_length >> 8) | 0x40);
+            expected[2] = (uint8_t)(header_length & 0xFF);
+            *last++ = h3zero_frame_data;
+            *last++ = (uint8_t)strlen(body);
+            memcpy(last, body, strlen(body));
+            last += strlen(body);
+            if (entry->response_length != (size_t)(last - expected) ||
+                memcmp(entry->response, expected, entry->response_length) != 0 || entry->echo_length != 0) {
+                DBG_PRINTF("%s", "Inline entry does not match");
                 ret = -1;
             }
-            else {
-                for (size_t i = 0; ret == 0 && i < nb_files; i++) {
-                    char* file_name = demo_test_create_random_file_name(name_length, &random_ctx);
-                    if (file_name == NULL) {
-                        ret = -1;
-                    } else {
-                        ret = demo_test_create_file(dir_www, file_name, length, &random_ctx);
-                    }
-                    if (ret == 0) {
-                        size_t f_name_size = strlen(dir_download) + strlen(PICOQUIC_FILE_SEPARATOR) + strlen(file_name) + 1;
-                        char* fn_alloc = (char*)malloc(f_name_size);
-
-                        demo_test_delete_file(dir_download, file_name);
-                        (*scenario)[i].doc_name = file_name;
-                        (*scenario)[i].previous_stream_id = UINT64_MAX;
-                        (*scenario)[i].stream_id = ((uint64_t)4)*i;
-                        (*scenario)[i].repeat_count = 0;
-                        (*stream_length)[i] = length;
-                        (*scenario)[i].f_name = fn_alloc;
-                        if (fn_alloc == NULL) {
-                            ret = -1;
-                        }
-                        else {
-                            size_t nb_chars = 0;
-                            (void)picoquic_sprintf(fn_alloc, f_name_size, &nb_chars, "%s%s%s",
-                                dir_download, PICOQUIC_FILE_SEPARATOR, file_name);
-                        }
-                    }
-                }
-            }
         }
     }
 
-    return ret;
-}
-
-static int demo_test_multi_scenario_check(picoquic_demo_stream_desc_t* scenario, size_t nb_files, char const* dir_www, char const* dir_download)
-{
-    int ret = 0;
-
-    for (size_t i = 0; ret == 0 && i < nb_files; i++) {
-        ret = demo_test_check_file(dir_www, dir_download, scenario[i].doc_name);
-        if (ret != 0) {
-            DBG_PRINTF("File #%d differs", i);
+    if (ret == 0) {
+        /* File body, and generated body */
+        if ((entry = h3zero_response_cache_add(cache, (const uint8_t*)"/file", 5, file_name, 512, NULL, 0,
+            h3zero_content_type_text_plain, H3ZERO_USER_AGENT_STRING, current_time)) == NULL ||
+            entry->file_entry == NULL || entry->echo_length != 512) {
+            DBG_PRINTF("%s", "Cannot add file entry");
+            ret = -1;
+        }
+        else if (h3zero_response_cache_get(cache, (const uint8_t*)"/", 1, current_time) == NULL ||
+            h3zero_response_cache_get(cache, (const uint8_t*)"/file", 5, current_time) != entry ||
+            h3zero_response_cache_get(cache, (const uint8_t*)"/none", 5, current_time) != NULL ||
+            cache->nb_hits != 2 || cache->nb_misses != 1) {
+            DBG_PRINTF("%s", "Cache lookup fails");
+            ret = -1;
+        }
+        else if (h3zero_response_cache_add(cache, (const uint8_t*)"/1000", 5, NULL, 1000, NULL, 0,
+            h3zero_content_type_text_plain, H3ZERO_USER_AGENT_STRING, current_time) == NULL ||
+            cache->nb_entries != 2 || h3zero_response_cache_get(cache, (const uint8_t*)"/", 1, current_time) != NULL) {
+            /* "/" is the least recently used, it must have been evicted */
+            DBG_PRINTF("%s", "LRU entry not evicted");
+            ret = -1;
+        }
+        else if (h3zero_response_cache_add(cache, (const uint8_t*)"/big", 4, NULL, 0, (const uint8_t*)expected, 4096,
+            h3zero_content_type_text_plain, H3ZERO_USER_AGENT_STRING, current_time) != NULL) {
+            DBG_PRINTF("%s", "Entry larger than the cache was added");
+            ret = -1;
         }
     }
 
-    return ret;
-}
-
-static void demo_test_multi_scenario_free(picoquic_demo_stream_desc_t** scenario, size_t** stream_length, size_t nb_files)
-{
-    if (*scenario != NULL) {
-        for (size_t i = 0; i < nb_files; i++) {
-            if ((*scenario)[i].doc_name != NULL) {
-                free((char*)((*scenario)[i].doc_name));
-                (*scenario)[i].doc_name = NULL;
+    if (ret == 0) {
+        /* Modify the file: the entry shall be invalidated after the check interval */
+        FILE* F = picoquic_file_open(file_name, "ab");
+        if (F == NULL) {
+            ret = -1;
+        }
+        else {
+            fwrite(body, 1, strlen(body), F);
+            (void)picoquic_file_close(F);
+            if (h3zero_response_cache_get(cache, (const uint8_t*)"/file", 5, current_time + 10) == NULL) {
+                DBG_PRINTF("%s", "Entry checked before the interval");
+                ret = -1;
             }
-            if ((*scenario)[i].f_name != NULL) {
-                free((char*)((*scenario)[i].f_name));
-                (*scenario)[i].f_name = NULL;
+            else if (h3zero_response_cache_get(cache, (const uint8_t*)"/file", 5, current_time + 2000000) != NULL ||
+                cache->nb_invalidations != 1 || file_cache->table->count != 0) {
+                DBG_PRINTF("%s", "Modified file not invalidated");
+                ret = -1;
             }
         }
-        free(*scenario);
-        *scenario = NULL;
     }
 
-    if (*stream_length != NULL) {
-        free(*stream_length);
-        *stream_length = NULL;
+    if (cache != NULL) {
+        h3zero_response_cache_delete(cache);
     }
+    if (file_cache != NULL) {
+        h3zero_file_cache_delete(file_cache);
+    }
+    (void)remove(file_name);
+
+    return ret;
 }
 
-size_t picohttp_test_multifile_number = 1000;
-#define MULTI_FILE_CLIENT_BIN "multi_file_client_trace.bin"
-#define MULTI_FILE_SERVER_BIN "multi_file_server_trace.bin"
+/* Benchmark of the response cache. Requests for a set of files follow a
+ * skewed distribution, and the cache can hold half of the files.
+ * Without the cache, each request resolves the path, checks the file,
+ * encodes the response header and opens the file, as the server does. Report the hit rate and the number of
+ * requests processed per second, with and without the cache.
+ */
+#define H3ZERO_RESPONSE_CACHE_BENCH_NB_FILES 64
+#define H3ZERO_RESPONSE_CACHE_BENCH_NB_REQUESTS 20000
 
-int http_multi_file_test_one(char const * alpn, picoquic_stream_data_cb_fn server_callback_fn,
-    uint64_t do_loss, int do_preemptive_repeat)
+int h3zero_response_cache_bench_test()
 {
-    picoquic_demo_stream_desc_t* scenario = NULL;
-    size_t* stream_length = NULL;
-    char const* dir_www = "h3-m-www";
-    char const* dir_download = "h3-m-download";
-    size_t nb_files = picohttp_test_multifile_number;
-    size_t const name_length = 10;
-    size_t const file_length = 32;
-    uint64_t const random_seed = 0xab8acadab8aull;
-    picohttp_server_parameters_t file_param;
-
-    memset(&file_param, 0, sizeof(picohttp_server_parameters_t));
-    file_param.web_folder = dir_www;
-
-    int ret = demo_test_multi_scenario_create(&scenario, &stream_length, random_seed, nb_files, name_length, file_length, dir_www, dir_download);
+    int ret = 0;
+#ifdef _WINDOWS
+    char const* folder = ".\\";
+#else
+    char const* folder = "./";
+#endif
+    char paths[H3ZERO_RESPONSE_CACHE_BENCH_NB_FILES][32];
+    h3zero_file_cache_t* file_cache = NULL;
+    h3zero_response_cache_t* cache = NULL;
+    uint64_t random_ctx = 0x0123456789abcdefull;
+    uint64_t duration_us[2] = { 0, 0 };
 
-    if (ret == 0) {
-        ret = demo_server_test(alpn, server_callback_fn, (void*)&file_param, scenario, nb_files,
-            stream_length, 0, do_loss, 5000000, 0, NULL, MULTI_FILE_CLIENT_BIN, MULTI_FILE_SERVER_BIN, do_preemptive_repeat);
+    for (int i = 0; ret == 0 && i < H3ZERO_RESPONSE_CACHE_BENCH_NB_FILES; i++) {
+        size_t length = 0;
+        (void)picoquic_sprintf(paths[i], sizeof(paths[i]), &length, "/rcbench-%d.txt", i);
+        ret = h3zero_file_cache_create_test_file(paths[i] + 1, 4, 1000);
     }
 
-    if (ret == 0) {
-        ret = demo_test_multi_scenario_check(scenario, nb_files, dir_www, dir_download);
+    if (ret == 0 && ((file_cache = h3zero_file_cache_create(64, 16)) == NULL ||
+        (cache = h3zero_response_cache_create(file_cache, H3ZERO_RESPONSE_CACHE_BENCH_NB_FILES / 2, 16 * 1024 * 1024, 0)) == NULL)) {
+        ret = -1;
     }
 
-    demo_test_multi_scenario_free(&scenario, &stream_length, nb_files);
+    for (int use_cache = 0; ret == 0 && use_cache < 2; use_cache++) {
+        uint64_t t0 = picoquic_current_time();
 
-    return ret;
-}
+        for (int r = 0; ret == 0 && r < H3ZERO_RESPONSE_CACHE_BENCH_NB_REQUESTS; r++) {
+            /* Skewed distribution: half of the requests go to 1/8th of the files */
+            uint64_t x = picoquic_test_uniform_random(&random_ctx, H3ZERO_RESPONSE_CACHE_BENCH_NB_FILES);
+            int file_index = (int)((x * x * x) / (H3ZERO_RESPONSE_CACHE_BENCH_NB_FILES * H3ZERO_RESPONSE_CACHE_BENCH_NB_FILES));
+            const uint8_t* path = (const uint8_t*)paths[file_index];
+            size_t path_length = strlen(paths[file_index]);
+            h3zero_response_entry_t* entry = NULL;
 
-int h3_multi_file_test()
-{
-    return http_multi_file_test_one(PICOHTTP_ALPN_H3_LATEST, h3zero_callback, 0, 0);
-}
+            if (use_cache) {
+                entry = h3zero_response_cache_get(cache, path, path_length, r);
+            }
+            if (entry == NULL) {
+                uint64_t echo_length = 0;
+                char* file_path = NULL;
+                int file_error = 0;
+                uint8_t buffer[256];
 
-#define H3ZERO_MULTI_LOSS_PATTERN 0xa242EDB710000ull
+                if (h3zero_server_parse_path(path, path_length, &echo_length, &file_path, folder, &file_error) != 0) {
+                    ret = -1;
+                }
+                else if (use_cache) {
+                    if (h3zero_response_cache_add(cache, path, path_length, file_path, echo_length, NULL, 0,
+                        h3zero_content_type_text_plain, H3ZERO_USER_AGENT_STRING, r) == NULL) {
+                        ret = -1;
+                    }
+                }
+                else if (h3zero_create_response_header_frame_ex(buffer, buffer + sizeof(buffer), h3zero_content_type_text_plain,
+                    H3ZERO_USER_AGENT_STRING) == NULL) {
+                    ret = -1;
+                }
+                else {
+                    FILE* F = picoquic_file_open(file_path, "rb");
+                    if (F == NULL) {
+                        ret = -1;
+                    }
+                    else {
+                        (void)picoquic_file_close(F);
+                    }
+                }
+                if (file_path != NULL) {
+                    free(file_path);
+                }
+            }
+        }
+        duration_us[use_cache] = picoquic_current_time() - t0;
+        if (ret != 0) {
+            DBG_PRINTF("Response bench fails, use_cache = %d", use_cache);
+        }
+        else {
+            double seconds = (duration_us[use_cache] == 0) ? 0.000001 : (double)duration_us[use_cache] / 1000000.0;
+            if (use_cache) {
+                DBG_PRINTF("Response cache: hit rate %.1f%%, %.0f requests/s",
+                    (100.0 * (double)cache->nb_hits) / (double)(cache->nb_hits + cache->nb_misses),
+                    H3ZERO_RESPONSE_CACHE_BENCH_NB_REQUESTS / seconds);
+            }
+            else {
+                DBG_PRINTF("No response cache: %.0f requests/s", H3ZERO_RESPONSE_CACHE_BENCH_NB_REQUESTS / seconds);
+            }
+        }
+    }
 
-int h3_multi_file_loss_test()
-{
-    uint64_t loss_pattern = H3ZERO_MULTI_LOSS_PATTERN;
-    return http_multi_file_test_one(PICOHTTP_ALPN_H3_LATEST, h3zero_callback, loss_pattern, 0);
-}
+    if (cache != NULL) {
+        h3zero_response_cache_delete(cache);
+    }
+    if (file_cache != NULL) {
+        h3zero_file_cache_delete(file_cache);
+    }
+    for (int i = 0; i < H3ZERO_RESPONSE_CACHE_BENCH_NB_FILES; i++) {
+        (void)remove(paths[i] + 1);
+    }
 
-int h3_multi_file_preemptive_test()
-{
-    uint64_t loss_pattern = H3ZERO_MULTI_LOSS_PATTERN;
-    return http_multi_file_test_one(PICOHTTP_ALPN_H3_LATEST, h3zero_callback, loss_pattern, 1);
+    return ret;
 }
 
-int h09_multi_file_test()
-{
-    return http_multi_file_test_one(PICOHTTP_ALPN_HQ_LATEST, picoquic_h09_server_callback, 0, 0);
-}
+/* Test of the priority field parser and encoders, RFC 9218 */
+typedef struct st_h3zero_priority_test_case_t {
+    char const* field;
+    int ret;
+    uint8_t urgency;
+    int incremental;
+} h3zero_priority_test_case_t;
+
+static const h3zero_priority_test_case_t h3zero_priority_test_cases[] = {
+    { "", 0, 3, 0 },
+    { "u=0", 0, 0, 0 },
+    { "u=7, i", 0, 7, 1 },
+    { "i, u=1", 0, 1, 1 },
+    { "i=?0,u=2", 0, 2, 0 },
+    { "i=?1", 0, 3, 1 },
+    { "u=5;foo=bar, i;x=\"y,z\"", 0, 5, 1 },
+    { "u=8", 0, 3, 0 },
+    { "u=-1", 0, 3, 0 },
+    { "u=1.5", 0, 3, 0 },
+    { "u=\"1\", i=1", 0, 3, 0 },
+    { "foo=bar, u=4", 0, 4, 0 },
+    { "u=2, u=6", 0, 6, 0 },
+    { "u=1,", -1, 3, 0 },
+    { "U=1", -1, 3, 0 },
+    { "u=", -1, 3, 0 },
+    { "u=1 i", -1, 3, 0 },
+    { "i=?2", -1, 3, 0 }
+};
 
-int h09_multi_file_loss_test()
-{
-    uint64_t loss_pattern = H3ZERO_MULTI_LOSS_PATTERN;
-    return http_multi_file_test_one(PICOHTTP_ALPN_HQ_LATEST, picoquic_h09_server_callback, 
-        loss_pattern, 0);
-}
+static const size_t nb_h3zero_priority_test_cases = sizeof(h3zero_priority_test_cases) / sizeof(h3zero_priority_test_case_t);
 
-int h09_multi_file_preemptive_test()
+int h3zero_priority_test()
 {
-    uint64_t loss_pattern = H3ZERO_MULTI_LOSS_PATTERN;
-    return http_multi_file_test_one(PICOHTTP_ALPN_HQ_LATEST, picoquic_h09_server_callback,
-        loss_pattern, 1);
-}
+    int ret = 0;
 
-/* HTTP Server stress.
- * Execute in parallel a series of connection requests to the HTTP server.
- * Verify that all requests are served.
- *
- * Requirement:
- *  - network connection to each client.
- *  - set of scenarios (pick prime number)
- *     - in scenario parsing, add a client number to each download file name.
- *  - choice of h09 or h3 for each scenario (alternate)
- *  - number of clients
- */
+    for (size_t i = 0; ret == 0 && i < nb_h3zero_priority_test_cases; i++) {
+        const h3zero_priority_test_case_t* test = &h3zero_priority_test_cases[i];
+        uint8_t urgency = 0xff;
+        int incremental = -1;
+        int parse_ret = h3zero_parse_priority_field((const uint8_t*)test->field, strlen(test->field), &urgency, &incremental);
 
+        if ((parse_ret == 0) != (test->ret == 0) || urgency != test->urgency || incremental != test->incremental) {
+            DBG_PRINTF("Priority field <%s>: ret %d, u=%d, i=%d", test->field, parse_ret, urgency, incremental);
+            ret = -1;
+        }
+    }
 
-static const picoquic_demo_stream_desc_t http_stress_scenario_1[] = {
-    { 0, 0, PICOQUIC_DEMO_STREAM_ID_INITIAL, "/", "_", 0},
-    { 0, 4, 0, "test.html", "test.html", 0 },
-    { 0, 8, 0, "main.jpg", "main.jpg", 0 },
-    { 0, 12, 0, "/bla/bla/", "_bla_bla_", 0 }
-};
+    /* Map all urgencies: order is preserved, FIFO if not incremental, and
+     * the default is the default stream priority. */
+    for (uint8_t u = 0; ret == 0 && u <= H3ZERO_PRIORITY_URGENCY_MAX; u++) {
+        uint8_t p_fifo = h3zero_priority_to_stream_priority(u, 0);
+        uint8_t p_rr = h3zero_priority_to_stream_priority(u, 1);
 
-static const picoquic_demo_stream_desc_t http_stress_scenario_2[] = {
-    { 0, 0, PICOQUIC_DEMO_STREAM_ID_INITIAL, "/", "_", 0 },
-    { 0, 4, 0, "main.jpg", "main.jpg", 0 },
-    { 0, 8, 4, "test.html", "test.html", 0 }
-};
+        if ((p_fifo & 1) != 1 || (p_rr & 1) != 0 || p_rr <= 1 ||
+            (u > 0 && p_rr <= h3zero_priority_to_stream_priority(u - 1, 0))) {
+            DBG_PRINTF("Bad mapping for urgency %d: %d, %d", u, p_fifo, p_rr);
+            ret = -1;
+        }
+    }
+    if (ret == 0 && h3zero_priority_to_stream_priority(H3ZERO_PRIORITY_URGENCY_DEFAULT, 0) != PICOQUIC_DEFAULT_STREAM_PRIORITY) {
+        DBG_PRINTF("%s", "Default urgency does not map to the default priority");
+        ret = -1;
+    }
 
-static const picoquic_demo_stream_desc_t http_stress_scenario_3[] = {
-    { 1000, 0, PICOQUIC_DEMO_STREAM_ID_INITIAL, "/", "_", 0 }
-};
+    for (int incremental = 0; ret == 0 && incremental < 2; incremental++) {
+        /* Priority header field in a request */
+        uint8_t buffer[256];
+        uint8_t* bytes = h3zero_create_request_header_frame(buffer, buffer + sizeof(buffer), (const uint8_t*)"/style.css", 10,
+            "example.com");
+        h3zero_header_parts_t parts;
 
-static const picoquic_demo_stream_desc_t http_stress_scenario_4[] = {
-    { 0, 0, PICOQUIC_DEMO_STREAM_ID_INITIAL, "/cgi-sink", "_cgi-sink", 1000000 },
-    { 0, 4, 0, "/", "_", 0 }
-};
+        bytes = h3zero_create_priority_header_field(bytes, buffer + sizeof(buffer), 1, incremental);
+        if (bytes == NULL || h3zero_parse_qpack_header_frame(buffer, bytes, &parts) != bytes) {
+            DBG_PRINTF("%s", "Cannot parse request with priority");
+            ret = -1;
+        }
+        else {
+            if (!parts.priority_found || parts.urgency != 1 || parts.incremental != incremental ||
+                parts.path_length != 10) {
+                DBG_PRINTF("Priority header not found, i=%d", incremental);
+                ret = -1;
+            }
+            h3zero_release_header_parts(&parts);
+        }
 
-typedef struct st_http_stress_scenario_list_t {
-    const picoquic_demo_stream_desc_t * sc;
-    const size_t sc_nb;
-} http_stress_scenario_list_t;
+        /* Priority update frame */
+        if (ret == 0) {
+            uint64_t frame_type = 0;
+            uint64_t frame_length = 0;
+            uint64_t stream_id = 0;
+            uint8_t urgency = 0;
+            int inc = -1;
+            const uint8_t* frame;
+
+            bytes = h3zero_priority_update_encode(buffer, buffer + sizeof(buffer), 12345, 6, incremental);
+            if (bytes == NULL ||
+                (frame = picoquic_frames_varint_decode(buffer, bytes, &frame_type)) == NULL ||
+                (frame = picoquic_frames_varint_decode(frame, bytes, &frame_length)) == NULL ||
+                frame_type != h3zero_frame_priority_update_request || frame + frame_length != bytes ||
+                h3zero_priority_update_components_decode(frame, bytes, &stream_id, &urgency, &inc) != bytes ||
+                stream_id != 12345 || urgency != 6 || inc != incremental) {
+                DBG_PRINTF("Priority update fails, i=%d", incremental);
+                ret = -1;
+            }
+        }
+    }
 
-#define HTTP_TEST_SCENARIO(scenario) { scenario, sizeof(scenario)/sizeof(picoquic_demo_stream_desc_t) }
+    return ret;
+}
 
-static const http_stress_scenario_list_t http_stress_scenario_list[] = {
-    HTTP_TEST_SCENARIO(http_stress_scenario_1),
-    HTTP_TEST_SCENARIO(http_stress_scenario_2),
-    HTTP_TEST_SCENARIO(http_stress_scenario_3),
-    HTTP_TEST_SCENARIO(http_stress_scenario_4)
+/* Page load simulation. The page requests three large images, then a
+ * small style sheet that is needed to render the page. Without priorities,
+ * the server sends the responses in FIFO order, and the style sheet
+ * arrives last. With priorities, the client sends PRIORITY_UPDATE frames
+ * making the style sheet urgent and the images incremental, and the first
+ * byte of the style sheet should arrive much earlier.
+ */
+static const picoquic_demo_stream_desc_t priority_page_load_scenario[] = {
+    { 0, 0, PICOQUIC_DEMO_STREAM_ID_INITIAL, "/1000000", "prio-image-1.bin", 0 },
+    { 0, 4, PICOQUIC_DEMO_STREAM_ID_INITIAL, "/1000000", "prio-image-2.bin", 0 },
+    { 0, 8, PICOQUIC_DEMO_STREAM_ID_INITIAL, "/1000000", "prio-image-3.bin", 0 },
+    { 0, 12, PICOQUIC_DEMO_STREAM_ID_INITIAL, "/20000", "prio-style.css", 0 }
 };
 
-static size_t nb_http_stress_scenario = sizeof(http_stress_scenario_list) / sizeof(http_stress_scenario_list_t);
+static const size_t nb_priority_page_load_scenario = sizeof(priority_page_load_scenario) / sizeof(picoquic_demo_stream_desc_t);
 
-typedef struct st_http_stress_client_context_t {
-    picoquic_quic_t * qclient;
-    picoquic_cnx_t * cnx_client;
-    picoquic_demo_callback_ctx_t callback_ctx;
-    struct sockaddr_storage client_address;
-    uint64_t client_time;
-    int is_dropped;
-    int is_not_sending;
-} http_stress_client_context_t;
+#define PRIORITY_PAGE_LOAD_CRITICAL_STREAM 12
+#define PRIORITY_PAGE_LOAD_CRITICAL_LENGTH 20000
 
-http_stress_client_context_t* http_stress_client_delete(http_stress_client_context_t* ctx)
+static int h3zero_priority_page_load_one(int use_priorities, uint64_t* first_byte_time, uint64_t* completion_time)
 {
-    picoquic_demo_client_delete_context(&ctx->callback_ctx);
-    if (ctx->cnx_client != NULL) {
-        ctx->cnx_client = NULL;
+    uint64_t simulated_time = 0;
+    uint64_t loss_mask = 0;
+    uint64_t time_out;
+    uint64_t start_time = 0;
+    int nb_trials = 0;
+    int was_active = 0;
+    picoquic_test_tls_api_ctx_t* test_ctx = NULL;
+    picoquic_demo_callback_ctx_t callback_ctx;
+    picoquic_connection_id_t initial_cid = { {0xd1, 0x09, 3, 4, 5, 6, 7, 8}, 8 };
+    int ret = picoquic_demo_client_initialize_context(&callback_ctx, priority_page_load_scenario,
+        nb_priority_page_load_scenario, PICOHTTP_ALPN_H3_LATEST, 1, 0);
+
+    *first_byte_time = UINT64_MAX;
+    *completion_time = UINT64_MAX;
+    callback_ctx.no_print = 1;
+
+    if (ret == 0) {
+        ret = tls_api_init_ctx_ex(&test_ctx, PICOQUIC_INTERNAL_TEST_VERSION_1,
+            PICOQUIC_TEST_SNI, PICOHTTP_ALPN_H3_LATEST, &simulated_time, NULL, NULL, 0, 1, 0, &initial_cid);
     }
-    if (ctx->qclient != NULL) {
-        picoquic_free(ctx->qclient);
-        ctx->qclient = NULL;
+
+    if (ret == 0) {
+        picoquic_set_alpn_select_fn(test_ctx->qserver, picoquic_demo_server_callback_select_alpn);
+        picoquic_set_default_callback(test_ctx->qserver, h3zero_callback, NULL);
+        picoquic_set_callback(test_ctx->cnx_client, picoquic_demo_client_callback, &callback_ctx);
+        ret = picoquic_start_client_cnx(test_ctx->cnx_client);
     }
-    free(ctx);
-    return(NULL);
-}
 
-http_stress_client_context_t* http_stress_client_create(size_t client_id, uint64_t * simulated_time, 
-    struct sockaddr* server_address, int initial_random)
-{
-    int ret = 0;
-    http_stress_client_context_t* ctx = (http_stress_client_context_t*)malloc(sizeof(http_stress_client_context_t));
+    if (ret == 0) {
+        ret = tls_api_connection_loop(test_ctx, &loss_mask, 0, &simulated_time);
+    }
 
-    if (ctx != NULL) {
-        char const* alpn = NULL;
+    if (ret == 0) {
+        start_time = simulated_time;
+        ret = picoquic_demo_client_start_streams(test_ctx->cnx_client, &callback_ctx, PICOQUIC_DEMO_STREAM_ID_INITIAL);
+    }
 
-        memset(ctx, 0, sizeof(http_stress_client_context_t));
+    if (ret == 0 && use_priorities) {
+        /* Queue the updates on the client control stream, after the settings.
+         * The control stream is the first client unidirectional stream. */
+        uint8_t buffer[128];
+        uint8_t* bytes = buffer;
 
-        /* alternate ALPN between H3, HQ and "server chooses" */
-        switch (client_id % 3) {
-        case 0:
-            alpn = PICOHTTP_ALPN_H3_LATEST;
-            break;
-        case 1:
-            alpn = PICOHTTP_ALPN_HQ_LATEST;
-            break;
-        default:
-            break;
+        for (size_t i = 0; bytes != NULL && i < nb_priority_page_load_scenario; i++) {
+            if (priority_page_load_scenario[i].stream_id == PRIORITY_PAGE_LOAD_CRITICAL_STREAM) {
+                bytes = h3zero_priority_update_encode(bytes, buffer + sizeof(buffer), priority_page_load_scenario[i].stream_id, 0, 0);
+            }
+            else {
+                bytes = h3zero_priority_update_encode(bytes, buffer + sizeof(buffer), priority_page_load_scenario[i].stream_id, 5, 1);
+            }
         }
-
-        ctx->qclient = picoquic_create(8, NULL, NULL, NULL, alpn, NULL, NULL, NULL, NULL, NULL, *simulated_time, simulated_time, NULL, NULL, 0);
-
-        if (ctx->qclient == NULL) {
+        if (bytes == NULL) {
             ret = -1;
         }
         else {
-            /* Use predictable value for ICID */
-            picoquic_connection_id_t i_cid = picoquic_null_connection_id;
-            uint64_t id64 = 0xdeadbeefbabac001ull;
-
-            picoquic_set_default_congestion_algorithm(ctx->qclient, picoquic_bbr_algorithm);
-            picoquic_set_null_verifier(ctx->qclient);
-            if (initial_random) {
-                picoquic_set_random_initial(ctx->qclient, 1);
-            }
-
-            id64 ^= (uint64_t)client_id;
-            for (int i = 0; i < 8; i++) {
-                i_cid.id[i] = (uint8_t)id64;
-                id64 >>= 8;
-            }
+            ret = picoquic_add_to_stream(test_ctx->cnx_client, 2, buffer, bytes - buffer, 0);
+        }
+    }
 
-            /* Use various values for local CID length*/
-            ctx->qclient->local_cnxid_length = client_id % 9;
+    time_out = simulated_time + 60000000;
+    while (ret == 0 && picoquic_get_cnx_state(test_ctx->cnx_client) != picoquic_state_disconnected) {
+        picoquic_demo_client_stream_ctx_t* stream = callback_ctx.first_stream;
 
-            /* Create a client connection */
-            ctx->cnx_client = picoquic_create_cnx(ctx->qclient, i_cid, picoquic_null_connection_id, server_address, *simulated_time, 0, PICOQUIC_TEST_FILE_SERVER_CERT, alpn, 1);
+        ret = tls_api_one_sim_round(test_ctx, &simulated_time, time_out, &was_active);
+        if (ret != 0) {
+            break;
+        }
 
-            if (ctx->cnx_client == NULL) {
-                ret = -1;
+        while (stream != NULL && stream->stream_id != PRIORITY_PAGE_LOAD_CRITICAL_STREAM) {
+            stream = stream->next_stream;
+        }
+        if (stream != NULL) {
+            if (stream->received_length > 0 && *first_byte_time == UINT64_MAX) {
+                *first_byte_time = simulated_time - start_time;
             }
-            else {
-                size_t scenario_id = client_id % nb_http_stress_scenario;
-
-                ret = picoquic_demo_client_initialize_context(&ctx->callback_ctx, http_stress_scenario_list[scenario_id].sc, http_stress_scenario_list[scenario_id].sc_nb, alpn, 1 /* No disk!*/, 0);
-                if (ret == 0) {
-                    picoquic_set_callback(ctx->cnx_client, picoquic_demo_client_callback, &ctx->callback_ctx);
-                    ctx->callback_ctx.no_print = 1;
-                }
+            if (stream->received_length >= PRIORITY_PAGE_LOAD_CRITICAL_LENGTH && *completion_time == UINT64_MAX) {
+                *completion_time = simulated_time - start_time;
             }
         }
 
-        if (ret == 0) {
-            char test_addr[256];
-            size_t nb_written = 0;
-
-            if ((ret = picoquic_sprintf(test_addr, sizeof(test_addr), &nb_written, "2::%x:%x", (uint16_t)(client_id >> 16), (uint16_t)client_id & 0xFFFF)) == 0) {
-                ret = picoquic_store_text_addr(&ctx->client_address, test_addr, 4443);
-            }
+        if (picoquic_is_cnx_backlog_empty(test_ctx->cnx_client) && callback_ctx.nb_open_streams == 0) {
+            ret = picoquic_close(test_ctx->cnx_client, 0);
         }
-        
-        if (ret == 0)
-        {
-            /* Requires TP grease, for interop tests */
-            ctx->cnx_client->grease_transport_parameters = 1;
-            ctx->cnx_client->local_parameters.enable_time_stamp = 3;
-            ctx->client_time = *simulated_time;
-
-            if (ret == 0) {
-                ret = picoquic_start_client_cnx(ctx->cnx_client);
-            }
+        if (++nb_trials > 200000) {
+            ret = -1;
         }
+    }
 
-        if (ret == 0) {
-            ret = picoquic_demo_client_start_streams(ctx->cnx_client, &ctx->callback_ctx, PICOQUIC_DEMO_STREAM_ID_INITIAL);
-        }
+    if (ret == 0 && *completion_time == UINT64_MAX) {
+        DBG_PRINTF("%s", "Critical resource was not received");
+        ret = -1;
     }
 
-    if (ret != 0 && ctx != NULL) {
-        /* TODO: delete context */
-        ctx = http_stress_client_delete(ctx);
+    picoquic_demo_client_delete_context(&callback_ctx);
+
+    if (test_ctx != NULL) {
+        tls_api_delete_ctx(test_ctx);
     }
 
-    return ctx;
+    return ret;
 }
 
-size_t picohttp_nb_stress_clients = 128;
-uint64_t picohttp_random_stress_context = 0x12345678;
-
-int http_stress_test_one(int do_corrupt, int do_drop, int initial_random)
+int h3zero_priority_page_load_test()
 {
-    /* initialize the server, address 1::1 */
-    /* Create QUIC context */
+    uint64_t first_byte_time[2] = { 0, 0 };
+    uint64_t completion_time[2] = { 0, 0 };
     int ret = 0;
-    uint64_t simulated_time = 0;
-    uint8_t reset_seed[PICOQUIC_RESET_SECRET_SIZE] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 , 13, 14, 15, 16 };
-    char test_server_cert_file[512];
-    char test_server_key_file[512];
-    char file_name_buffer[1024];
-    picohttp_server_parameters_t file_param;
-    picoquic_quic_t* qserver = NULL;
-    http_stress_client_context_t** ctx_client = NULL;
-    picoquictest_sim_link_t* lan = NULL;
-    struct sockaddr_storage server_address;
-    uint64_t server_time = 0;
-    uint64_t random_context = picohttp_random_stress_context;
-    size_t nb_stress_clients = picohttp_nb_stress_clients;
-    int nb_loops = 0;
 
-    ret = picoquic_store_text_addr(&server_address, "1::1", 443);
+    for (int use_priorities = 0; ret == 0 && use_priorities < 2; use_priorities++) {
+        ret = h3zero_priority_page_load_one(use_priorities, &first_byte_time[use_priorities], &completion_time[use_priorities]);
+        if (ret == 0) {
+            DBG_PRINTF("Priorities %s: first critical byte after %" PRIu64 " us, complete after %" PRIu64 " us",
+                (use_priorities) ? "on" : "off", first_byte_time[use_priorities], completion_time[use_priorities]);
+        }
+    }
 
-    if (ret == 0) {
-        ret = serve_file_test_set_param(&file_param, file_name_buffer, sizeof(file_name_buffer));
+    if (ret == 0 && (first_byte_time[1] >= first_byte_time[0] / 2 || completion_time[1] >= completion_time[0])) {
+        DBG_PRINTF("%s", "Priorities do not accelerate the critical resource");
+        ret = -1;
     }
 
-    if (ret == 0) {
-        ret = picoquic_get_input_path(test_server_cert_file, sizeof(test_server_cert_file), picoquic_solution_dir, PICOQUIC_TEST_FILE_SERVER_CERT);
+    return ret;
+}
+
+/* Check the latency histograms and the path formatting of the load generator
+ */
+static int h3zero_loadgen_check_percentile(h3zero_loadgen_histogram_t* histo, double percentile, uint64_t expected)
+{
+    int ret = 0;
+    uint64_t value = h3zero_loadgen_histogram_percentile(histo, percentile);
+
+    /* Buckets have 32 sub-buckets per power of 2, i.e., less than 3.2% error */
+    if (value < expected || value > expected + (expected / 32) + 1) {
+        DBG_PRINTF("Percentile %f, expected %" PRIu64 ", got %" PRIu64, percentile, expected, value);
+        ret = -1;
     }
 
-    if (ret == 0) {
-        ret = picoquic_get_input_path(test_server_key_file, sizeof(test_server_key_file), picoquic_solution_dir, PICOQUIC_TEST_FILE_SERVER_KEY);
+    return ret;
+}
+
+int h3zero_loadgen_histogram_test()
+{
+    int ret = 0;
+    h3zero_loadgen_histogram_t* histo = (h3zero_loadgen_histogram_t*)malloc(sizeof(h3zero_loadgen_histogram_t));
+    h3zero_loadgen_histogram_t* other = (h3zero_loadgen_histogram_t*)malloc(sizeof(h3zero_loadgen_histogram_t));
+
+    if (histo == NULL || other == NULL) {
+        ret = -1;
     }
-    if (ret == 0) {
-        /* Make sure that the server is configured to handle all required clients.
-        */
-        qserver = picoquic_create((uint32_t)nb_stress_clients, test_server_cert_file, test_server_key_file, NULL, NULL,
-            picoquic_demo_server_callback, &file_param,
-            NULL, NULL, reset_seed, simulated_time, &simulated_time, NULL, NULL, 0);
-        if (qserver == NULL) {
-            DBG_PRINTF("%s", "Cannot create http_stress server");
+    else {
+        h3zero_loadgen_histogram_init(histo);
+        h3zero_loadgen_histogram_init(other);
+        if (h3zero_loadgen_histogram_percentile(histo, 50.0) != 0) {
+            DBG_PRINTF("%s", "Empty histogram should return 0");
             ret = -1;
         }
-        else {
-            picoquic_set_alpn_select_fn(qserver, picoquic_demo_server_callback_select_alpn);
-            if (initial_random) {
-                picoquic_set_random_initial(qserver, 1);
-            }
-            if (random_context == 0) {
-                picoquic_crypto_random(qserver, &random_context, sizeof(random_context));
-            }
+        /* Small values are exact */
+        for (uint64_t v = 0; v < 64; v++) {
+            h3zero_loadgen_histogram_add(histo, v);
+        }
+        if (ret == 0 && (h3zero_loadgen_histogram_percentile(histo, 50.0) != 31 ||
+            h3zero_loadgen_histogram_percentile(histo, 100.0) != 63 ||
+            h3zero_loadgen_histogram_percentile(histo, 0.0) != 0)) {
+            DBG_PRINTF("%s", "Small values are not exact");
+            ret = -1;
+        }
+        /* Large values within the bucket precision, also after merging */
+        h3zero_loadgen_histogram_init(histo);
+        for (uint64_t v = 1; v <= 10000; v++) {
+            h3zero_loadgen_histogram_add((v % 2 == 0) ? histo : other, v * 1000);
+        }
+        h3zero_loadgen_histogram_merge(histo, other);
+        if (ret == 0 && (histo->nb_values != 10000 || histo->min_value != 1000 || histo->max_value != 10000000 ||
+            histo->sum != 50005000ull * 1000)) {
+            DBG_PRINTF("%s", "Merged histogram totals are wrong");
+            ret = -1;
+        }
+        if (ret == 0) {
+            ret = h3zero_loadgen_check_percentile(histo, 50.0, 5000000);
+        }
+        if (ret == 0) {
+            ret = h3zero_loadgen_check_percentile(histo, 99.0, 9900000);
+        }
+        if (ret == 0) {
+            ret = h3zero_loadgen_check_percentile(histo, 99.9, 9990000);
+        }
+        if (ret == 0 && h3zero_loadgen_histogram_percentile(histo, 100.0) != 10000000) {
+            DBG_PRINTF("%s", "Maximum is not capped at the max value");
+            ret = -1;
+        }
+        /* Values beyond the last bucket are kept in it */
+        h3zero_loadgen_histogram_add(histo, UINT64_MAX);
+        if (ret == 0 && h3zero_loadgen_histogram_percentile(histo, 100.0) != UINT64_MAX) {
+            DBG_PRINTF("%s", "Huge value not retrieved");
+            ret = -1;
         }
     }
 
     if (ret == 0) {
-        ctx_client = (http_stress_client_context_t**)malloc(sizeof(http_stress_client_context_t*) * nb_stress_clients);
-        if (ctx_client == NULL) {
+        h3zero_loadgen_config_t config;
+        char const* paths[2] = { "/index.html", "/style.css" };
+        char path[H3ZERO_LOADGEN_PATH_MAX];
+        size_t path_length = 0;
+
+        memset(&config, 0, sizeof(config));
+        if (h3zero_loadgen_format_path(&config, 7, path, sizeof(path), &path_length) != 0 ||
+            strcmp(path, "/") != 0 || path_length != 1) {
+            DBG_PRINTF("%s", "Default path is not /");
             ret = -1;
         }
-        else {
-            /* initialize each client, address 2::nnnn */
-            memset(ctx_client, 0, sizeof(http_stress_client_context_t*) * nb_stress_clients);
-            for (size_t i = 0; ret == 0 && i < nb_stress_clients; i++) {
-                ctx_client[i] = http_stress_client_create(i, &simulated_time, (struct sockaddr*) & server_address, initial_random);
-                if (ctx_client[i] == NULL) {
-                    ret = -1;
-                }
-            }
+        config.paths = paths;
+        config.nb_paths = 2;
+        if (ret == 0 && (h3zero_loadgen_format_path(&config, 7, path, sizeof(path), &path_length) != 0 ||
+            strcmp(path, "/style.css") != 0)) {
+            DBG_PRINTF("Path list, got %s", path);
+            ret = -1;
+        }
+        config.path_template = "/img/{n}.png";
+        config.template_range = 100;
+        if (ret == 0 && (h3zero_loadgen_format_path(&config, 1234, path, sizeof(path), &path_length) != 0 ||
+            strcmp(path, "/img/34.png") != 0 || path_length != strlen("/img/34.png"))) {
+            DBG_PRINTF("Template, got %s", path);
+            ret = -1;
+        }
+        if (ret == 0 && h3zero_loadgen_format_path(&config, 1234, path, 8, &path_length) == 0) {
+            DBG_PRINTF("%s", "Template overflow not detected");
+            ret = -1;
         }
     }
 
-    if (ret == 0)
-    {
-        /* simulate a local network linking every client and the server */
-        lan = picoquictest_sim_link_create(1.0, 1000, NULL, 10000, simulated_time);
-        if (lan == NULL) {
+    if (histo != NULL) {
+        free(histo);
+    }
+    if (other != NULL) {
+        free(other);
+    }
+
+    return ret;
+}
+
+/* Run the load generator over the simulated connection against the h3zero server.
+ * The simulation only handles the test client connection, so the test uses a
+ * single connection with several streams.
+ */
+#define H3ZERO_LOADGEN_TEST_REQUESTS 40
+
+static int h3zero_loadgen_test_one(uint64_t request_rate)
+{
+    uint64_t simulated_time = 0;
+    uint64_t time_out;
+    int nb_trials = 0;
+    int was_active = 0;
+    picoquic_test_tls_api_ctx_t* test_ctx = NULL;
+    picoquic_connection_id_t initial_cid = { {0x10, 0xad, 0x6e, 4, 5, 6, 7, 8}, 8 };
+    h3zero_loadgen_config_t config;
+    h3zero_loadgen_ctx_t* lg_ctx = NULL;
+    uint64_t expected_bytes = 0;
+    int ret = tls_api_init_ctx_ex(&test_ctx, PICOQUIC_INTERNAL_TEST_VERSION_1,
+        PICOQUIC_TEST_SNI, PICOHTTP_ALPN_H3_LATEST, &simulated_time, NULL, NULL, 0, 1, 0, &initial_cid);
+
+    memset(&config, 0, sizeof(config));
+    config.sni = PICOQUIC_TEST_SNI;
+    config.nb_connections = 1;
+    config.nb_streams = 4;
+    config.nb_requests = H3ZERO_LOADGEN_TEST_REQUESTS;
+    config.request_rate = request_rate;
+    config.path_template = "/1{n}";
+    config.template_range = 10;
+    for (uint64_t n = 0; n < H3ZERO_LOADGEN_TEST_REQUESTS; n++) {
+        expected_bytes += 10 + (n % 10);
+    }
+
+    if (ret == 0) {
+        picoquic_set_alpn_select_fn(test_ctx->qserver, picoquic_demo_server_callback_select_alpn);
+        picoquic_set_default_callback(test_ctx->qserver, h3zero_callback, NULL);
+        if ((lg_ctx = h3zero_loadgen_create(&config, test_ctx->qclient)) == NULL) {
             ret = -1;
         }
+        else {
+            ret = h3zero_loadgen_start_cnx(lg_ctx, 0, test_ctx->cnx_client, simulated_time);
+        }
     }
 
-    /* run the simulation until all clients are served */
+    time_out = simulated_time + 60000000;
     while (ret == 0) {
-        uint64_t next_time = UINT64_MAX;
-        int is_lan_ready = lan->first_packet != NULL;
-        size_t client_id = nb_stress_clients;
-        picoquic_quic_t* qready = NULL;
-        struct sockaddr* ready_from = NULL;
+        uint64_t next_time;
 
-        nb_loops++;
-        if (nb_loops > 10000000) {
-            DBG_PRINTF("Loop detected after %d iterations", nb_loops);
-            ret = -1;
+        if ((ret = h3zero_loadgen_update(lg_ctx, simulated_time)) != 0) {
+            if (ret == PICOQUIC_NO_ERROR_TERMINATE_PACKET_LOOP) {
+                ret = 0;
+            }
             break;
         }
-
-        if (is_lan_ready) {
-            next_time = picoquictest_sim_link_next_arrival(lan, next_time);
+        /* Do not let the simulation skip past the next scheduled request */
+        next_time = h3zero_loadgen_next_time(lg_ctx);
+        if (next_time > time_out) {
+            next_time = time_out;
+        }
+        ret = tls_api_one_sim_round(test_ctx, &simulated_time, next_time, &was_active);
+        if (simulated_time >= time_out || ++nb_trials > 100000) {
+            DBG_PRINTF("Load test not complete after %d rounds", nb_trials);
+            ret = -1;
         }
+    }
 
-        if (lan->queue_time < simulated_time + lan->queue_delay_max) {
-            /* Simulate contention on access to LAN, to avoid creating peak loads and huge queues */
-            if (server_time < next_time) {
-                qready = qserver;
-                ready_from = (struct sockaddr*) & server_address;
-                next_time = server_time;
-            }
+    if (ret == 0) {
+        h3zero_loadgen_stats_t* stats = &lg_ctx->stats;
 
-            for (size_t i = 0; ret == 0 && i < nb_stress_clients; i++) {
-                if (ctx_client[i] != NULL && ctx_client[i]->client_time < next_time && !ctx_client[i]->is_not_sending) {
-                    qready = ctx_client[i]->qclient;
-                    ready_from = (struct sockaddr*) & ctx_client[i]->client_address;
-                    next_time = ctx_client[i]->client_time;
-                    client_id = i;
-                }
-            }
+        if (stats->nb_started != H3ZERO_LOADGEN_TEST_REQUESTS || stats->nb_completed != H3ZERO_LOADGEN_TEST_REQUESTS ||
+            stats->nb_failed != 0 || stats->nb_bytes != expected_bytes || stats->nb_connections != 1) {
+            DBG_PRINTF("Started %" PRIu64 ", completed %" PRIu64 ", failed %" PRIu64 ", %" PRIu64 " bytes instead of %" PRIu64,
+                stats->nb_started, stats->nb_completed, stats->nb_failed, stats->nb_bytes, expected_bytes);
+            ret = -1;
         }
-
-        if (next_time > simulated_time) {
-            if (next_time == UINT64_MAX) {
-                DBG_PRINTF("%s", "end of simulation");
-                break;
-            }
-            else {
-                simulated_time = next_time;
-            }
+        else if (stats->ttfb.nb_values != H3ZERO_LOADGEN_TEST_REQUESTS ||
+            stats->completion.nb_values != H3ZERO_LOADGEN_TEST_REQUESTS ||
+            h3zero_loadgen_histogram_percentile(&stats->ttfb, 50.0) == 0 ||
+            h3zero_loadgen_histogram_percentile(&stats->completion, 50.0) < h3zero_loadgen_histogram_percentile(&stats->ttfb, 50.0)) {
+            DBG_PRINTF("%s", "Latencies not recorded");
+            ret = -1;
         }
-        if (qready != NULL) {
-            picoquictest_sim_packet_t* prepared = picoquictest_sim_link_create_packet();
+        else if (request_rate > 0 &&
+            stats->end_time - stats->start_time < ((H3ZERO_LOADGEN_TEST_REQUESTS - 1) * 1000000) / request_rate) {
+            DBG_PRINTF("Rate %" PRIu64 " not respected, test took %" PRIu64 " us", request_rate, stats->end_time - stats->start_time);
+            ret = -1;
+        }
+    }
 
-            if (prepared == NULL) {
-                ret = -1;
-            }
-            else {
-                /* ask server to prepare next packet */
-                int if_index = -1;
+    if (lg_ctx != NULL) {
+        h3zero_loadgen_delete(lg_ctx);
+    }
 
-                ret = picoquic_prepare_next_packet(qready, simulated_time, prepared->bytes, sizeof(prepared->bytes),
-                    &prepared->length, &prepared->addr_to, &prepared->addr_from, &if_index, NULL, NULL);
+    if (test_ctx != NULL) {
+        tls_api_delete_ctx(test_ctx);
+    }
 
-                if (prepared->length == 0) {
-                    free(prepared);
-                }
-                else {
-                    if (prepared->addr_from.ss_family == 0) {
-                        picoquic_store_addr(&prepared->addr_from, ready_from);
-                    }
-                    picoquictest_sim_link_submit(lan, prepared, simulated_time);
-                }
-            }
+    return ret;
+}
 
-            if (client_id < nb_stress_clients && ctx_client[client_id] != NULL) {
-                if (ctx_client[client_id]->is_dropped) {
-                    uint64_t should_not_send = picoquic_test_uniform_random(&random_context, 5);
-                    ctx_client[client_id]->is_not_sending = should_not_send == 3;
-                }
-                if (!ctx_client[client_id]->is_not_sending) {
-                    ctx_client[client_id]->client_time = picoquic_get_next_wake_time(ctx_client[client_id]->qclient, simulated_time);
-                    if (ctx_client[client_id]->client_time == UINT64_MAX) {
-                        DBG_PRINTF("End of client %d", (int)client_id);
-                    }
-                }
-            }
-            else {
-                server_time = picoquic_get_next_wake_time(qserver, simulated_time);
-                if (server_time == UINT64_MAX) {
-                    DBG_PRINTF("End of server at %llu", (unsigned long long)simulated_time);
-                }
-            }
-        }
-        else if (is_lan_ready) {
-            picoquictest_sim_packet_t* arrival = picoquictest_sim_link_dequeue(lan, simulated_time);
+int h3zero_loadgen_test()
+{
+    int ret = h3zero_loadgen_test_one(0);
 
-            if (arrival != NULL) {
-                if (do_corrupt) {
-                    /* simulate packet corruption in flight. But, in the case of server initial packets,
-                     * corrupting the initial connection ID will result in the creation of extra initial
-                     * contexts, which can cause the server to end up with too many connections. We 
-                     * prevent that by doing a minimal parsing of the long-header packets, to avoid
-                     * messing with CID values there.
-                     */
+    if (ret == 0) {
+        ret = h3zero_loadgen_test_one(100);
+    }
+
+    return ret;
+}
+
+static const picoquic_demo_stream_desc_t satellite_test_scenario[] = {
+    { 0, 0, PICOQUIC_DEMO_STREAM_ID_INITIAL, "/10000000", "bin10M.txt", 0 }
+};
+
+static const size_t nb_satellite_test_scenario = sizeof(satellite_test_scenario) / sizeof(picoquic_demo_stream_desc_t);
+
+int h3zero_satellite_test()
+{
+    return demo_server_test(PICOHTTP_ALPN_H3_LATEST, h3zero_callback, NULL, satellite_test_scenario, nb_satellite_test_scenario,
+        demo_test_stream_length, 1, 0, 10750000, 0, NULL, NULL, NULL, 0);
+}
+
+int h09_satellite_test()
+{
+    return demo_server_test(PICOHTTP_ALPN_HQ_LATEST, picoquic_h09_server_callback, NULL, satellite_test_scenario, nb_satellite_test_scenario, 
+        demo_test_stream_length, 1, 0, 10750000, 0, NULL, NULL, NULL, 0);
+}
+
+int h09_lone_fin_test()
+{
+    int ret = 0;
+    char file_name_buffer[1024];
+    picohttp_server_parameters_t file_param;
+
+    ret = serve_file_test_set_param(&file_param, file_name_buffer, sizeof(file_name_buffer));
+
+    if (ret == 0 && (ret = demo_server_test(PICOHTTP_ALPN_HQ_LATEST, picoquic_h09_server_callback, (void*)&file_param, 
+        file_test_scenario, nb_file_test_scenario, demo_file_test_stream_length, 0, 0, 0, 1, NULL, NULL, NULL, 0)) != 0) {
+        DBG_PRINTF("H09 server (%s) file test fails, ret = %d\n", PICOHTTP_ALPN_HQ_LATEST, ret);
+    }
+    else if (ret == 0) {
+        ret = file_test_compare(&file_param, &file_test_scenario[0]);
+    }
+
+    return ret;
+}
+
+#ifndef _WINDOWS
+const char doc_name_long[] = { '/', FILE_NAME_LONG, 0};
+const char file_name_long[] = { '.', '/', FILE_NAME_LONG, 0 };
+
+static const picoquic_demo_stream_desc_t long_file_name_scenario[] = {
+    { 0, 0, PICOQUIC_DEMO_STREAM_ID_INITIAL, doc_name_long, file_name_long, 0 }
+};
+
+static const size_t nb_long_file_name_scenario = sizeof(long_file_name_scenario) / sizeof(picoquic_demo_stream_desc_t);
+#endif
+
+static size_t const long_file_name_stream_length[] = {
+    32
+};
+
+int h3_long_file_name_test()
+{
+    int ret = 0;
+#ifdef _WINDOWS
+    /* In contrast to Unix, the path size in Windows is limited to 260 bytes.
+     * This means that the maximum path size depends on the size of the path
+     * to the working directory. It has to be kept small enough! */
+    DWORD current_directory_length = GetCurrentDirectory(0, NULL);
+    picoquic_demo_stream_desc_t scenario_line;
+    char file_name_var[MAX_PATH];
+    char doc_name_var[MAX_PATH];
+    size_t name_length = 0;
+    size_t file_name_length = 0;
+    size_t doc_name_length = 0;
+
+    if (current_directory_length + 7 >= MAX_PATH) {
+        DBG_PRINTF("Current Directory too long for test: %d chars", current_directory_length);
+        ret = -1;
+    }
+    else {
+        name_length = MAX_PATH - current_directory_length - 7;
+        if (name_length > 253) {
+            name_length = 253;
+        }
+        file_name_var[file_name_length++] = '.';
+        file_name_var[file_name_length++] = '\\';
+        doc_name_var[doc_name_length++] = '/';
+        for (size_t i = 0; i < name_length; i++) {
+            file_name_var[file_name_length++] = '0';
+            doc_name_var[doc_name_length++] = '0';
+        }
+        file_name_var[file_name_length++] = '3';
+        doc_name_var[doc_name_length++] = '3';
+        file_name_var[file_name_length++] = '2';
+        doc_name_var[doc_name_length++] = '2';
+        file_name_var[file_name_length++] = 0;
+        doc_name_var[doc_name_length++] = 0;
+        scenario_line.repeat_count = 0;
+        scenario_line.stream_id = 0;
+        scenario_line.previous_stream_id = PICOQUIC_DEMO_STREAM_ID_INITIAL;
+        scenario_line.doc_name = doc_name_var;
+        scenario_line.f_name = file_name_var;
+        scenario_line.post_size = 0;
+
+        ret = demo_server_test(PICOHTTP_ALPN_H3_LATEST, h3zero_callback, NULL, &scenario_line, 1,
+            long_file_name_stream_length, 0, 0, 400000, 0, NULL, NULL, NULL, 0);
+    }
+#else
+    ret = demo_server_test(PICOHTTP_ALPN_H3_LATEST, h3zero_callback, NULL, 
+        long_file_name_scenario, nb_long_file_name_scenario, 
+        long_file_name_stream_length, 0, 0, 400000, 0, NULL, NULL, NULL, 0);
+#endif
+    return ret;
+}
+
+/* Multi-file test.
+ * Create a list of file and their content in the folder "www" in current directory.
+ * Create in memory a scenario with the list of files to download in parallel by the client.
+ * Execute the scenario, downloading the file in the client scenario.
+ * Verify that all the files have been properly received. */
+static void demo_test_create_directory(char const* dir_path)
+{
+#ifdef _WINDOWS
+    (void)_mkdir(dir_path);
+#else
+    (void)mkdir(dir_path, 0777);
+#endif
+}
+
+static int demo_test_create_file(char const* dir_path, char const* file_name, size_t length, uint64_t* random_ctx)
+{
+    int ret = 0;
+    char name[1024];
+    FILE* F;
+    size_t nb_sprintf;
+
+    (void)picoquic_sprintf(name, sizeof(name), &nb_sprintf, "%s%s%s", dir_path, PICOQUIC_FILE_SEPARATOR, file_name);
+
+    if ((F = picoquic_file_open(name, "wb")) == NULL) {
+        ret = -1;
+    }
+    else {
+        uint8_t data[128];
+        size_t written = 0;
+
+        while (written < length) {
+            size_t nb = length - written;
+            if (nb > sizeof(data)) {
+                nb = sizeof(data);
+            }
+            picoquic_test_random_bytes(random_ctx, data, nb);
+            if (fwrite(data, 1, nb, F) <= 0) {
+                ret = -1;
+                break;
+            }
+            written += length;
+        }
+
+        (void)picoquic_file_close(F);
+    }
+
+    return ret;
+}
+
+static void demo_test_delete_file(char const* dir_path, char const* file_name)
+{
+    char name[1024];
+    size_t nb_sprintf;
+
+    (void)picoquic_sprintf(name, sizeof(name), &nb_sprintf, "%s%s%s", dir_path, PICOQUIC_FILE_SEPARATOR, file_name);
+
+#ifdef _WINDOWS
+    (void)DeleteFileA(name);
+#else
+    (void)remove(name);
+#endif
+}
+
+static char * demo_test_create_random_file_name(size_t name_length, uint64_t * random_ctx)
+{
+    size_t alloc_size = name_length + 1;
+    char* file_name = NULL;
+    if (name_length < alloc_size) {
+        file_name = (char*)malloc(alloc_size);
+        if (file_name != NULL) {
+            for (size_t i = 0; i < name_length; i++) {
+                file_name[i] = 'a' + (int)picoquic_test_uniform_random(random_ctx, 'z' - 'a' + 1);
+            }
+            file_name[name_length] = 0;
+        }
+    }
+    return file_name;
+}
+
+static int demo_test_check_file(char const* www_path, char const* download_path, char const* file_name)
+{
+    int ret;
+    char name1[1024];
+    char name2[1024];
+    size_t nb_written;
+
+    (void)picoquic_sprintf(name1, sizeof(name1), &nb_written, "%s%s%s", www_path, PICOQUIC_FILE_SEPARATOR, file_name);
+    (void)picoquic_sprintf(name2, sizeof(name2), &nb_written, "%s%s%s", download_path, PICOQUIC_FILE_SEPARATOR, file_name);
+
+    if ((ret = picoquic_test_compare_binary_files(name1, name2)) != 0) {
+        DBG_PRINTF("Files %s != %s", name1, name2);
+    }
+    return ret;
+}
+
+static int demo_test_multi_scenario_create(picoquic_demo_stream_desc_t** scenario, size_t** stream_length, uint64_t seed, size_t nb_files, size_t name_length, size_t length,
+    char const* dir_www, char const* dir_download)
+{
+    uint64_t random_ctx = seed;
+    int ret = 0;
+    *scenario = NULL;
+    *stream_length = NULL;
+    demo_test_create_directory(dir_www);
+    demo_test_create_directory(dir_download);
+
+    if (ret == 0) {
+        *scenario = (picoquic_demo_stream_desc_t*)malloc(sizeof(picoquic_demo_stream_desc_t) * nb_files);
+        if (*scenario == NULL) {
+            ret = -1;
+        }
+        else {
+            memset(*scenario, 0, sizeof(picoquic_demo_stream_desc_t) * nb_files);
+            *stream_length = (size_t*)malloc(sizeof(size_t) * nb_files);
+            if (*stream_length == NULL) {
+                ret = -1;
+            }
+            else {
+                for (size_t i = 0; ret == 0 && i < nb_files; i++) {
+                    char* file_name = demo_test_create_random_file_name(name_length, &random_ctx);
+                    if (file_name == NULL) {
+                        ret = -1;
+                    } else {
+                        ret = demo_test_create_file(dir_www, file_name, length, &random_ctx);
+                    }
+                    if (ret == 0) {
+                        size_t f_name_size = strlen(dir_download) + strlen(PICOQUIC_FILE_SEPARATOR) + strlen(file_name) + 1;
+                        char* fn_alloc = (char*)malloc(f_name_size);
+
+                        demo_test_delete_file(dir_download, file_name);
+                        (*scenario)[i].doc_name = file_name;
+                        (*scenario)[i].previous_stream_id = UINT64_MAX;
+                        (*scenario)[i].stream_id = ((uint64_t)4)*i;
+                        (*scenario)[i].repeat_count = 0;
+                        (*stream_length)[i] = length;
+                        (*scenario)[i].f_name = fn_alloc;
+                        if (fn_alloc == NULL) {
+                            ret = -1;
+                        }
+                        else {
+                            size_t nb_chars = 0;
+                            (void)picoquic_sprintf(fn_alloc, f_name_size, &nb_chars, "%s%s%s",
+                                dir_download, PICOQUIC_FILE_SEPARATOR, file_name);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return ret;
+}
+
+static int demo_test_multi_scenario_check(picoquic_demo_stream_desc_t* scenario, size_t nb_files, char const* dir_www, char const* dir_download)
+{
+    int ret = 0;
+
+    for (size_t i = 0; ret == 0 && i < nb_files; i++) {
+        ret = demo_test_check_file(dir_www, dir_download, scenario[i].doc_name);
+        if (ret != 0) {
+            DBG_PRINTF("File #%d differs", i);
+        }
+    }
+
+    return ret;
+}
+
+static void demo_test_multi_scenario_free(picoquic_demo_stream_desc_t** scenario, size_t** stream_length, size_t nb_files)
+{
+    if (*scenario != NULL) {
+        for (size_t i = 0; i < nb_files; i++) {
+            if ((*scenario)[i].doc_name != NULL) {
+                free((char*)((*scenario)[i].doc_name));
+                (*scenario)[i].doc_name = NULL;
+            }
+            if ((*scenario)[i].f_name != NULL) {
+                free((char*)((*scenario)[i].f_name));
+                (*scenario)[i].f_name = NULL;
+            }
+        }
+        free(*scenario);
+        *scenario = NULL;
+    }
+
+    if (*stream_length != NULL) {
+        free(*stream_length);
+        *stream_length = NULL;
+    }
+}
+
+size_t picohttp_test_multifile_number = 1000;
+#define MULTI_FILE_CLIENT_BIN "multi_file_client_trace.bin"
+#define MULTI_FILE_SERVER_BIN "multi_file_server_trace.bin"
+
+int http_multi_file_test_one(char const * alpn, picoquic_stream_data_cb_fn server_callback_fn,
+    uint64_t do_loss, int do_preemptive_repeat)
+{
+    picoquic_demo_stream_desc_t* scenario = NULL;
+    size_t* stream_length = NULL;
+    char const* dir_www = "h3-m-www";
+    char const* dir_download = "h3-m-download";
+    size_t nb_files = picohttp_test_multifile_number;
+    size_t const name_length = 10;
+    size_t const file_length = 32;
+    uint64_t const random_seed = 0xab8acadab8aull;
+    picohttp_server_parameters_t file_param;
+
+    memset(&file_param, 0, sizeof(picohttp_server_parameters_t));
+    file_param.web_folder = dir_www;
+
+    int ret = demo_test_multi_scenario_create(&scenario, &stream_length, random_seed, nb_files, name_length, file_length, dir_www, dir_download);
+
+    if (ret == 0) {
+        ret = demo_server_test(alpn, server_callback_fn, (void*)&file_param, scenario, nb_files,
+            stream_length, 0, do_loss, 5000000, 0, NULL, MULTI_FILE_CLIENT_BIN, MULTI_FILE_SERVER_BIN, do_preemptive_repeat);
+    }
+
+    if (ret == 0) {
+        ret = demo_test_multi_scenario_check(scenario, nb_files, dir_www, dir_download);
+    }
+
+    demo_test_multi_scenario_free(&scenario, &stream_length, nb_files);
+
+    return ret;
+}
+
+int h3_multi_file_test()
+{
+    return http_multi_file_test_one(PICOHTTP_ALPN_H3_LATEST, h3zero_callback, 0, 0);
+}
+
+#define H3ZERO_MULTI_LOSS_PATTERN 0xa242EDB710000ull
+
+int h3_multi_file_loss_test()
+{
+    uint64_t loss_pattern = H3ZERO_MULTI_LOSS_PATTERN;
+    return http_multi_file_test_one(PICOHTTP_ALPN_H3_LATEST, h3zero_callback, loss_pattern, 0);
+}
+
+int h3_multi_file_preemptive_test()
+{
+    uint64_t loss_pattern = H3ZERO_MULTI_LOSS_PATTERN;
+    return http_multi_file_test_one(PICOHTTP_ALPN_H3_LATEST, h3zero_callback, loss_pattern, 1);
+}
+
+int h09_multi_file_test()
+{
+    return http_multi_file_test_one(PICOHTTP_ALPN_HQ_LATEST, picoquic_h09_server_callback, 0, 0);
+}
+
+int h09_multi_file_loss_test()
+{
+    uint64_t loss_pattern = H3ZERO_MULTI_LOSS_PATTERN;
+    return http_multi_file_test_one(PICOHTTP_ALPN_HQ_LATEST, picoquic_h09_server_callback, 
+        loss_pattern, 0);
+}
+
+int h09_multi_file_preemptive_test()
+{
+    uint64_t loss_pattern = H3ZERO_MULTI_LOSS_PATTERN;
+    return http_multi_file_test_one(PICOHTTP_ALPN_HQ_LATEST, picoquic_h09_server_callback,
+        loss_pattern, 1);
+}
+
+/* HTTP Server stress.
+ * Execute in parallel a series of connection requests to the HTTP server.
+ * Verify that all requests are served.
+ *
+ * Requirement:
+ *  - network connection to each client.
+ *  - set of scenarios (pick prime number)
+ *     - in scenario parsing, add a client number to each download file name.
+ *  - choice of h09 or h3 for each scenario (alternate)
+ *  - number of clients
+ */
+
+
+static const picoquic_demo_stream_desc_t http_stress_scenario_1[] = {
+    { 0, 0, PICOQUIC_DEMO_STREAM_ID_INITIAL, "/", "_", 0},
+    { 0, 4, 0, "test.html", "test.html", 0 },
+    { 0, 8, 0, "main.jpg", "main.jpg", 0 },
+    { 0, 12, 0, "/bla/bla/", "_bla_bla_", 0 }
+};
+
+static const picoquic_demo_stream_desc_t http_stress_scenario_2[] = {
+    { 0, 0, PICOQUIC_DEMO_STREAM_ID_INITIAL, "/", "_", 0 },
+    { 0, 4, 0, "main.jpg", "main.jpg", 0 },
+    { 0, 8, 4, "test.html", "test.html", 0 }
+};
+
+static const picoquic_demo_stream_desc_t http_stress_scenario_3[] = {
+    { 1000, 0, PICOQUIC_DEMO_STREAM_ID_INITIAL, "/", "_", 0 }
+};
+
+static const picoquic_demo_stream_desc_t http_stress_scenario_4[] = {
+    { 0, 0, PICOQUIC_DEMO_STREAM_ID_INITIAL, "/cgi-sink", "_cgi-sink", 1000000 },
+    { 0, 4, 0, "/", "_", 0 }
+};
+
+typedef struct st_http_stress_scenario_list_t {
+    const picoquic_demo_stream_desc_t * sc;
+    const size_t sc_nb;
+} http_stress_scenario_list_t;
+
+#define HTTP_TEST_SCENARIO(scenario) { scenario, sizeof(scenario)/sizeof(picoquic_demo_stream_desc_t) }
+
+static const http_stress_scenario_list_t http_stress_scenario_list[] = {
+    HTTP_TEST_SCENARIO(http_stress_scenario_1),
+    HTTP_TEST_SCENARIO(http_stress_scenario_2),
+    HTTP_TEST_SCENARIO(http_stress_scenario_3),
+    HTTP_TEST_SCENARIO(http_stress_scenario_4)
+};
+
+static size_t nb_http_stress_scenario = sizeof(http_stress_scenario_list) / sizeof(http_stress_scenario_list_t);
+
+typedef struct st_http_stress_client_context_t {
+    picoquic_quic_t * qclient;
+    picoquic_cnx_t * cnx_client;
+    picoquic_demo_callback_ctx_t callback_ctx;
+    struct sockaddr_storage client_address;
+    uint64_t client_time;
+    int is_dropped;
+    int is_not_sending;
+} http_stress_client_context_t;
+
+http_stress_client_context_t* http_stress_client_delete(http_stress_client_context_t* ctx)
+{
+    picoquic_demo_client_delete_context(&ctx->callback_ctx);
+    if (ctx->cnx_client != NULL) {
+        ctx->cnx_client = NULL;
+    }
+    if (ctx->qclient != NULL) {
+        picoquic_free(ctx->qclient);
+        ctx->qclient = NULL;
+    }
+    free(ctx);
+    return(NULL);
+}
+
+http_stress_client_context_t* http_stress_client_create(size_t client_id, uint64_t * simulated_time, 
+    struct sockaddr* server_address, int initial_random)
+{
+    int ret = 0;
+    http_stress_client_context_t* ctx = (http_stress_client_context_t*)malloc(sizeof(http_stress_client_context_t));
+
+    if (ctx != NULL) {
+        char const* alpn = NULL;
+
+        memset(ctx, 0, sizeof(http_stress_client_context_t));
+
+        /* alternate ALPN between H3, HQ and "server chooses" */
+        switch (client_id % 3) {
+        case 0:
+            alpn = PICOHTTP_ALPN_H3_LATEST;
+            break;
+        case 1:
+            alpn = PICOHTTP_ALPN_HQ_LATEST;
+            break;
+        default:
+            break;
+        }
+
+        ctx->qclient = picoquic_create(8, NULL, NULL, NULL, alpn, NULL, NULL, NULL, NULL, NULL, *simulated_time, simulated_time, NULL, NULL, 0);
+
+        if (ctx->qclient == NULL) {
+            ret = -1;
+        }
+        else {
+            /* Use predictable value for ICID */
+            picoquic_connection_id_t i_cid = picoquic_null_connection_id;
+            uint64_t id64 = 0xdeadbeefbabac001ull;
+
+            picoquic_set_default_congestion_algorithm(ctx->qclient, picoquic_bbr_algorithm);
+            picoquic_set_null_verifier(ctx->qclient);
+            if (initial_random) {
+                picoquic_set_random_initial(ctx->qclient, 1);
+            }
+
+            id64 ^= (uint64_t)client_id;
+            for (int i = 0; i < 8; i++) {
+                i_cid.id[i] = (uint8_t)id64;
+                id64 >>= 8;
+            }
+
+            /* Use various values for local CID length*/
+            ctx->qclient->local_cnxid_length = client_id % 9;
+
+            /* Create a client connection */
+            ctx->cnx_client = picoquic_create_cnx(ctx->qclient, i_cid, picoquic_null_connection_id, server_address, *simulated_time, 0, PICOQUIC_TEST_FILE_SERVER_CERT, alpn, 1);
+
+            if (ctx->cnx_client == NULL) {
+                ret = -1;
+            }
+            else {
+                size_t scenario_id = client_id % nb_http_stress_scenario;
+
+                ret = picoquic_demo_client_initialize_context(&ctx->callback_ctx, http_stress_scenario_list[scenario_id].sc, http_stress_scenario_list[scenario_id].sc_nb, alpn, 1 /* No disk!*/, 0);
+                if (ret == 0) {
+                    picoquic_set_callback(ctx->cnx_client, picoquic_demo_client_callback, &ctx->callback_ctx);
+                    ctx->callback_ctx.no_print = 1;
+                }
+            }
+        }
+
+        if (ret == 0) {
+            char test_addr[256];
+            size_t nb_written = 0;
+
+            if ((ret = picoquic_sprintf(test_addr, sizeof(test_addr), &nb_written, "2::%x:%x", (uint16_t)(client_id >> 16), (uint16_t)client_id & 0xFFFF)) == 0) {
+                ret = picoquic_store_text_addr(&ctx->client_address, test_addr, 4443);
+            }
+        }
+        
+        if (ret == 0)
+        {
+            /* Requires TP grease, for interop tests */
+            ctx->cnx_client->grease_transport_parameters = 1;
+            ctx->cnx_client->local_parameters.enable_time_stamp = 3;
+            ctx->client_time = *simulated_time;
+
+            if (ret == 0) {
+                ret = picoquic_start_client_cnx(ctx->cnx_client);
+            }
+        }
+
+        if (ret == 0) {
+            ret = picoquic_demo_client_start_streams(ctx->cnx_client, &ctx->callback_ctx, PICOQUIC_DEMO_STREAM_ID_INITIAL);
+        }
+    }
+
+    if (ret != 0 && ctx != NULL) {
+        /* TODO: delete context */
+        ctx = http_stress_client_delete(ctx);
+    }
+
+    return ctx;
+}
+
+size_t picohttp_nb_stress_clients = 128;
+uint64_t picohttp_random_stress_context = 0x12345678;
+
+int http_stress_test_one(int do_corrupt, int do_drop, int initial_random)
+{
+    /* initialize the server, address 1::1 */
+    /* Create QUIC context */
+    int ret = 0;
+    uint64_t simulated_time = 0;
+    uint8_t reset_seed[PICOQUIC_RESET_SECRET_SIZE] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 , 13, 14, 15, 16 };
+    char test_server_cert_file[512];
+    char test_server_key_file[512];
+    char file_name_buffer[1024];
+    picohttp_server_parameters_t file_param;
+    picoquic_quic_t* qserver = NULL;
+    http_stress_client_context_t** ctx_client = NULL;
+    picoquictest_sim_link_t* lan = NULL;
+    struct sockaddr_storage server_address;
+    uint64_t server_time = 0;
+    uint64_t random_context = picohttp_random_stress_context;
+    size_t nb_stress_clients = picohttp_nb_stress_clients;
+    int nb_loops = 0;
+
+    ret = picoquic_store_text_addr(&server_address, "1::1", 443);
+
+    if (ret == 0) {
+        ret = serve_file_test_set_param(&file_param, file_name_buffer, sizeof(file_name_buffer));
+    }
+
+    if (ret == 0) {
+        ret = picoquic_get_input_path(test_server_cert_file, sizeof(test_server_cert_file), picoquic_solution_dir, PICOQUIC_TEST_FILE_SERVER_CERT);
+    }
+
+    if (ret == 0) {
+        ret = picoquic_get_input_path(test_server_key_file, sizeof(test_server_key_file), picoquic_solution_dir, PICOQUIC_TEST_FILE_SERVER_KEY);
+    }
+    if (ret == 0) {
+        /* Make sure that the server is configured to handle all required clients.
+        */
+        qserver = picoquic_create((uint32_t)nb_stress_clients, test_server_cert_file, test_server_key_file, NULL, NULL,
+            picoquic_demo_server_callback, &file_param,
+            NULL, NULL, reset_seed, simulated_time, &simulated_time, NULL, NULL, 0);
+        if (qserver == NULL) {
+            DBG_PRINTF("%s", "Cannot create http_stress server");
+            ret = -1;
+        }
+        else {
+            picoquic_set_alpn_select_fn(qserver, picoquic_demo_server_callback_select_alpn);
+            if (initial_random) {
+                picoquic_set_random_initial(qserver, 1);
+            }
+            if (random_context == 0) {
+                picoquic_crypto_random(qserver, &random_context, sizeof(random_context));
+            }
+        }
+    }
+
+    if (ret == 0) {
+        ctx_client = (http_stress_client_context_t**)malloc(sizeof(http_stress_client_context_t*) * nb_stress_clients);
+        if (ctx_client == NULL) {
+            ret = -1;
+        }
+        else {
+            /* initialize each client, address 2::nnnn */
+            memset(ctx_client, 0, sizeof(http_stress_client_context_t*) * nb_stress_clients);
+            for (size_t i = 0; ret == 0 && i < nb_stress_clients; i++) {
+                ctx_client[i] = http_stress_client_create(i, &simulated_time, (struct sockaddr*) & server_address, initial_random);
+                if (ctx_client[i] == NULL) {
+                    ret = -1;
+                }
+            }
+        }
+    }
+
+    if (ret == 0)
+    {
+        /* simulate a local network linking every client and the server */
+        lan = picoquictest_sim_link_create(1.0, 1000, NULL, 10000, simulated_time);
+        if (lan == NULL) {
+            ret = -1;
+        }
+    }
+
+    /* run the simulation until all clients are served */
+    while (ret == 0) {
+        uint64_t next_time = UINT64_MAX;
+        int is_lan_ready = lan->first_packet != NULL;
+        size_t client_id = nb_stress_clients;
+        picoquic_quic_t* qready = NULL;
+        struct sockaddr* ready_from = NULL;
+
+        nb_loops++;
+        if (nb_loops > 10000000) {
+            DBG_PRINTF("Loop detected after %d iterations", nb_loops);
+            ret = -1;
+            break;
+        }
+
+        if (is_lan_ready) {
+            next_time = picoquictest_sim_link_next_arrival(lan, next_time);
+        }
+
+        if (lan->queue_time < simulated_time + lan->queue_delay_max) {
+            /* Simulate contention on access to LAN, to avoid creating peak loads and huge queues */
+            if (server_time < next_time) {
+                qready = qserver;
+                ready_from = (struct sockaddr*) & server_address;
+                next_time = server_time;
+            }
+
+            for (size_t i = 0; ret == 0 && i < nb_stress_clients; i++) {
+                if (ctx_client[i] != NULL && ctx_client[i]->client_time < next_time && !ctx_client[i]->is_not_sending) {
+                    qready = ctx_client[i]->qclient;
+                    ready_from = (struct sockaddr*) & ctx_client[i]->client_address;
+                    next_time = ctx_client[i]->client_time;
+                    client_id = i;
+                }
+            }
+        }
+
+        if (next_time > simulated_time) {
+            if (next_time == UINT64_MAX) {
+                DBG_PRINTF("%s", "end of simulation");
+                break;
+            }
+            else {
+                simulated_time = next_time;
+            }
+        }
+        if (qready != NULL) {
+            picoquictest_sim_packet_t* prepared = picoquictest_sim_link_create_packet();
+
+            if (prepared == NULL) {
+                ret = -1;
+            }
+            else {
+                /* ask server to prepare next packet */
+                int if_index = -1;
+
+                ret = picoquic_prepare_next_packet(qready, simulated_time, prepared->bytes, sizeof(prepared->bytes),
+                    &prepared->length, &prepared->addr_to, &prepared->addr_from, &if_index, NULL, NULL);
+
+                if (prepared->length == 0) {
+                    free(prepared);
+                }
+                else {
+                    if (prepared->addr_from.ss_family == 0) {
+                        picoquic_store_addr(&prepared->addr_from, ready_from);
+                    }
+                    picoquictest_sim_link_submit(lan, prepared, simulated_time);
+                }
+            }
+
+            if (client_id < nb_stress_clients && ctx_client[client_id] != NULL) {
+                if (ctx_client[client_id]->is_dropped) {
+                    uint64_t should_not_send = picoquic_test_uniform_random(&random_context, 5);
+                    ctx_client[client_id]->is_not_sending = should_not_send == 3;
+                }
+                if (!ctx_client[client_id]->is_not_sending) {
+                    ctx_client[client_id]->client_time = picoquic_get_next_wake_time(ctx_client[client_id]->qclient, simulated_time);
+                    if (ctx_client[client_id]->client_time == UINT64_MAX) {
+                        DBG_PRINTF("End of client %d", (int)client_id);
+                    }
+                }
+            }
+            else {
+                server_time = picoquic_get_next_wake_time(qserver, simulated_time);
+                if (server_time == UINT64_MAX) {
+                    DBG_PRINTF("End of server at %llu", (unsigned long long)simulated_time);
+                }
+            }
+        }
+        else if (is_lan_ready) {
+            picoquictest_sim_packet_t* arrival = picoquictest_sim_link_dequeue(lan, simulated_time);
+
+            if (arrival != NULL) {
+                if (do_corrupt) {
+                    /* simulate packet corruption in flight. But, in the case of server initial packets,
+                     * corrupting the initial connection ID will result in the creation of extra initial
+                     * contexts, which can cause the server to end up with too many connections. We 
+                     * prevent that by doing a minimal parsing of the long-header packets, to avoid
+                     * messing with CID values there.
+                     */
                     uint64_t lost_byte = picoquic_test_uniform_random(&random_context,((uint64_t)4)* arrival->length);
                     uint64_t min_length = 0;
 
@@ -3015,218 +4294,718 @@ int http_stress_test_one(int do_corrupt, int do_drop, int initial_random)
                     }
                 }
 
-                free(arrival);
-            }
+                free(arrival);
+            }
+        }
+        else {
+            /* end of simulation. */
+            break;
+        }
+    }
+
+    if (!do_corrupt && !do_drop) {
+        /* verify that each client scenario is properly completed */
+        for (size_t i = 0; ret == 0 && i < nb_stress_clients; i++) {
+            if (ctx_client[i] != NULL) {
+                if (!ctx_client[i]->callback_ctx.connection_ready) {
+                    DBG_PRINTF("Connection #%d failed", (int)i);
+                    ret = -1;
+                }
+                else if (!ctx_client[i]->callback_ctx.connection_closed) {
+                    DBG_PRINTF("Connection #%d not closed", (int)i);
+                    ret = -1;
+                }
+            }
+        }
+    }
+
+    if (!do_corrupt) {
+        /* verify that the global execution time makes sense,
+        * but only if we are not fuzzing, since fuzzing likely
+        * will cause instances of idle timers on clients or
+        * servers. */
+        if (ret == 0 && simulated_time > 240000000ull + 1000000ull * nb_stress_clients) {
+            DBG_PRINTF("Taking %llu microseconds for %d clients!", (unsigned long long)simulated_time, (int)nb_stress_clients);
+            ret = -1;
+        }
+    }
+
+    /* clean up */
+    if (lan != NULL) {
+        picoquictest_sim_link_delete(lan);
+        lan = NULL;
+    }
+
+    if (ctx_client != NULL) {
+        for (size_t i = 0; i < nb_stress_clients; i++) {
+            if (ctx_client[i] != NULL) {
+                (void)http_stress_client_delete(ctx_client[i]);
+            }
+        }
+        free(ctx_client);
+    }
+
+    if (qserver != NULL) {
+        picoquic_free(qserver);
+    }
+
+    return ret;
+}
+
+int http_stress_test()
+{
+    return http_stress_test_one(0, 0, 0);
+}
+
+int http_corrupt_test()
+{
+    return http_stress_test_one(1, 0, 0);
+}
+
+int http_drop_test()
+{
+    return http_stress_test_one(0, 1, 0);
+}
+
+int http_corrupt_rdpn_test()
+{
+    return http_stress_test_one(1, 0, 1);
+}
+
+/* Test the selection of ALPN
+ */
+char const* alpn_good_list[] = {
+    "h3-34", "hq-34", "h3-29", "hq-29", "h3", "hq-interop", "siduck", "siduck-00", "perf", NULL };
+picoquic_alpn_enum alpn_proto_list[] = {
+    picoquic_alpn_http_3, picoquic_alpn_http_0_9, picoquic_alpn_http_3, picoquic_alpn_http_0_9,
+    picoquic_alpn_http_3, picoquic_alpn_http_0_9,
+    picoquic_alpn_siduck, picoquic_alpn_siduck,
+    picoquic_alpn_quicperf };
+char const* alpn_bad_list[] = {
+    "h3-00", "hq", "hq-interop-00", "siduck-99", "", "unknown", NULL };
+
+int demo_alpn_test()
+{
+    int ret = 0;
+    /* Try the list of correct and incorrect values */
+    for (int i = 0; ret == 0 && alpn_good_list[i] != NULL; i++) {
+        picoquic_alpn_enum x = picoquic_parse_alpn_nz(alpn_good_list[i], strlen(alpn_good_list[i]));
+        if (x != alpn_proto_list[i]) {
+            DBG_PRINTF("For ALPN = \"%s\", got proto %d instead of %d", alpn_good_list[i], x, alpn_proto_list[i]);
+            ret = -1;
+            break;
         }
-        else {
-            /* end of simulation. */
+    }
+
+    for (int i = 0; ret == 0 && alpn_bad_list[i] != NULL; i++) {
+        picoquic_alpn_enum x = picoquic_parse_alpn_nz(alpn_bad_list[i], strlen(alpn_bad_list[i]));
+        if (x != picoquic_alpn_undef) {
+            DBG_PRINTF("For ALPN = \"%s\", got proto %d instead of %d", alpn_bad_list[i], x, picoquic_alpn_undef);
+            ret = -1;
             break;
         }
     }
 
-    if (!do_corrupt && !do_drop) {
-        /* verify that each client scenario is properly completed */
-        for (size_t i = 0; ret == 0 && i < nb_stress_clients; i++) {
-            if (ctx_client[i] != NULL) {
-                if (!ctx_client[i]->callback_ctx.connection_ready) {
-                    DBG_PRINTF("Connection #%d failed", (int)i);
-                    ret = -1;
-                }
-                else if (!ctx_client[i]->callback_ctx.connection_closed) {
-                    DBG_PRINTF("Connection #%d not closed", (int)i);
-                    ret = -1;
-                }
-            }
+    /* Try the list of correct values with extra zero */
+    for (int i = 0; ret == 0 && alpn_good_list[i] != NULL; i++) {
+        char buf[256];
+        picoquic_alpn_enum x;
+        size_t len = strlen(alpn_good_list[i]);
+
+        memset(buf, 0, sizeof(buf));
+        memcpy(buf, alpn_good_list[i], len);
+        x = picoquic_parse_alpn_nz(buf, len+1);
+        if (x != picoquic_alpn_undef) {
+            DBG_PRINTF("For ALPN = \"%s\\0...\", got proto %d instead of %d",
+                alpn_good_list[i], x, picoquic_alpn_undef);
+            ret = -1;
+            break;
         }
     }
 
-    if (!do_corrupt) {
-        /* verify that the global execution time makes sense,
-        * but only if we are not fuzzing, since fuzzing likely
-        * will cause instances of idle timers on clients or
-        * servers. */
-        if (ret == 0 && simulated_time > 240000000ull + 1000000ull * nb_stress_clients) {
-            DBG_PRINTF("Taking %llu microseconds for %d clients!", (unsigned long long)simulated_time, (int)nb_stress_clients);
+    /* Same test, but with large buffer */
+    for (int i = 0; ret == 0 && alpn_good_list[i] != NULL; i++) {
+        char buf[256];
+        picoquic_alpn_enum x;
+
+        memset(buf, 'a', sizeof(buf));
+        memcpy(buf, alpn_good_list[i], strlen(alpn_good_list[i]));
+        x = picoquic_parse_alpn_nz(buf, sizeof(buf));
+        if (x != picoquic_alpn_undef) {
+            DBG_PRINTF("For ALPN = \"%saaaaaaaaaaaaaa...\", got proto %d instead of %d", 
+                alpn_good_list[i], x, picoquic_alpn_undef);
             ret = -1;
+            break;
         }
     }
 
-    /* clean up */
-    if (lan != NULL) {
-        picoquictest_sim_link_delete(lan);
-        lan = NULL;
+    return ret;
+}
+
+/* Test encode and decode of settings frame
+ */
+
+int h3zero_settings_encode_test(const uint8_t* ref, size_t ref_length, h3zero_settings_t* test)
+{
+    int ret = -1;
+    uint8_t buffer[1024];
+    uint8_t* bytes = buffer;
+    uint8_t* bytes_max = buffer + sizeof(buffer);
+
+    if ((bytes = h3zero_settings_encode(bytes, bytes_max, test)) != NULL &&
+        (bytes - buffer) == ref_length &&
+        memcmp(buffer, ref, ref_length) == 0) {
+        ret = 0;
     }
+    return ret;
+}
 
-    if (ctx_client != NULL) {
-        for (size_t i = 0; i < nb_stress_clients; i++) {
-            if (ctx_client[i] != NULL) {
-                (void)http_stress_client_delete(ctx_client[i]);
+int h3zero_settings_decode_test(const uint8_t* bytes, size_t length, h3zero_settings_t* ref, int check_length)
+{
+    int ret = 0;
+    h3zero_settings_t decoded;
+    const uint8_t * bytes_max = bytes + length;
+
+    bytes = h3zero_settings_decode(bytes, bytes_max, &decoded);
+    if (bytes == NULL) {
+        ret = -1;
+    }
+    else if (check_length && bytes != bytes_max) {
+        ret = -1;
+    }
+    else if (decoded.table_size != ref->table_size) {
+        ret = -1;
+    }
+    else if (decoded.blocked_streams != ref->blocked_streams) {
+        ret = -1;
+    }
+    else if (decoded.enable_connect_protocol != ref->enable_connect_protocol){
+        ret = -1;
+    }
+    else if (decoded.h3_datagram != ref->h3_datagram){
+        ret = -1;
+    }
+#if 0
+    else if (decoded.is_web_transport_enabled != ref->is_web_transport_enabled){
+        ret = -1;
+    }
+#endif
+    else if (decoded.webtransport_max_sessions != ref->webtransport_max_sessions) {
+        ret = -1;
+    }
+    return ret;
+}
+
+h3zero_settings_t default_setting_expected = {
+    1, 0, 0, 0, 1, 1, 0
+};
+
+int h3zero_settings_test()
+{
+    int ret = h3zero_settings_decode_test(h3zero_default_setting_frame + 1, h3zero_default_setting_frame_size - 1, &default_setting_expected, 1);
+
+    if (ret == 0) {
+        ret = h3zero_settings_encode_test(h3zero_default_setting_frame + 1, h3zero_default_setting_frame_size - 1, &default_setting_expected);
+    }
+
+    return ret;
+}
+
+/* Test of the QPACK dynamic table.
+ * With the dynamic table disabled, the encoder must produce the same bytes
+ * as the static header frame functions. With the table enabled, the encoder
+ * instructions must be understood by the decoder, the decoder instructions
+ * by the encoder, and the header sections must decode to the same values.
+ */
+
+static int h3zero_qpack_dynamic_static_test()
+{
+    int ret = 0;
+    h3zero_qpack_encoder_t encoder;
+    uint8_t expected[256];
+    uint8_t encoded[256];
+    char const* error_codes[3] = { "404", "405", "501" };
+
+    (void)h3zero_qpack_encoder_init(&encoder, 0);
+    if (h3zero_qpack_encoder_set_peer_settings(&encoder, 4096, 16) != 0) {
+        ret = -1;
+    }
+
+    for (int i = 0; ret == 0 && i < 3; i++) {
+        h3zero_content_type_enum doc_type = (i == 0) ? h3zero_content_type_text_html :
+            ((i == 1) ? h3zero_content_type_text_plain : h3zero_content_type_none);
+        uint8_t* e_last = h3zero_create_response_header_frame_ex(expected, expected + sizeof(expected), doc_type, H3ZERO_USER_AGENT_STRING);
+        uint8_t* last = h3zero_create_response_header_frame_qpack(encoded, encoded + sizeof(encoded), doc_type, H3ZERO_USER_AGENT_STRING,
+            &encoder, 0);
+
+        if (e_last == NULL || last == NULL || last - encoded != e_last - expected ||
+            memcmp(encoded, expected, last - encoded) != 0) {
+            DBG_PRINTF("Static response header %d does not match", i);
+            ret = -1;
+        }
+        else {
+            e_last = h3zero_create_error_frame(expected, expected + sizeof(expected), error_codes[i], H3ZERO_USER_AGENT_STRING);
+            last = h3zero_create_error_frame_qpack(encoded, encoded + sizeof(encoded), error_codes[i], H3ZERO_USER_AGENT_STRING,
+                &encoder, 0);
+            if (e_last == NULL || last == NULL || last - encoded != e_last - expected ||
+                memcmp(encoded, expected, last - encoded) != 0) {
+                DBG_PRINTF("Static error header %s does not match", error_codes[i]);
+                ret = -1;
             }
         }
-        free(ctx_client);
     }
 
-    if (qserver != NULL) {
-        picoquic_free(qserver);
+    if (ret == 0 && (encoder.instructions.length != 0 || encoder.nb_sections != 0)) {
+        DBG_PRINTF("%s", "Static encoding should not create instructions");
+        ret = -1;
+    }
+
+    h3zero_qpack_encoder_release(&encoder);
+
+    return ret;
+}
+
+static int h3zero_qpack_dynamic_parse(h3zero_qpack_decoder_t* decoder, uint8_t* bytes, uint8_t* bytes_max,
+    uint64_t stream_id, h3zero_content_type_enum expected_type)
+{
+    int ret = 0;
+    h3zero_header_parts_t parts;
+    uint8_t* parsed = h3zero_parse_qpack_header_frame_ex(bytes, bytes_max, &parts, decoder, stream_id);
+
+    if (parsed != bytes_max) {
+        DBG_PRINTF("Cannot parse header section of stream %" PRIu64, stream_id);
+        ret = -1;
+    }
+    else if (parts.status != 200 || parts.content_type != expected_type) {
+        DBG_PRINTF("Wrong header parts, status %d, content type %d", parts.status, parts.content_type);
+        ret = -1;
+    }
+    h3zero_release_header_parts(&parts);
+
+    return ret;
+}
+
+/* Exchange the pending instructions between encoder and decoder. The
+ * encoder instructions are passed one byte at a time, to verify the
+ * handling of partial instructions. */
+static int h3zero_qpack_dynamic_exchange(h3zero_qpack_encoder_t* encoder, h3zero_qpack_decoder_t* decoder)
+{
+    int ret = 0;
+
+    for (size_t i = 0; ret == 0 && i < encoder->instructions.length; i++) {
+        ret = h3zero_qpack_decoder_receive(decoder, encoder->instructions.bytes + i, 1);
+    }
+    encoder->instructions.length = 0;
+    if (ret == 0 && decoder->instructions.length > 0) {
+        ret = h3zero_qpack_encoder_receive(encoder, decoder->instructions.bytes, decoder->instructions.length);
+        decoder->instructions.length = 0;
+    }
+    return ret;
+}
+
+static int h3zero_qpack_dynamic_blocked_test(uint64_t blocked_streams)
+{
+    int ret = 0;
+    h3zero_qpack_encoder_t encoder;
+    h3zero_qpack_decoder_t decoder;
+    uint8_t first[256];
+    uint8_t second[256];
+    uint8_t* first_last;
+    uint8_t* second_last = NULL;
+
+    (void)h3zero_qpack_encoder_init(&encoder, 4096);
+    if (h3zero_qpack_encoder_set_peer_settings(&encoder, 4096, blocked_streams) != 0 ||
+        h3zero_qpack_decoder_init(&decoder, 4096, blocked_streams) != 0) {
+        ret = -1;
+    }
+    /* The first response inserts the server string */
+    else if ((first_last = h3zero_create_response_header_frame_qpack(first, first + sizeof(first),
+        h3zero_content_type_text_html, H3ZERO_USER_AGENT_STRING, &encoder, 0)) == NULL) {
+        DBG_PRINTF("%s", "Cannot encode first response");
+        ret = -1;
+    }
+    else if (encoder.table.insert_count != 1 || encoder.instructions.length == 0) {
+        DBG_PRINTF("Expected 1 insertion, got %" PRIu64, encoder.table.insert_count);
+        ret = -1;
+    }
+    else if (h3zero_qpack_section_is_blocked(&decoder, first, first_last) != ((blocked_streams > 0) ? 1 : 0)) {
+        DBG_PRINTF("Unexpected blocked state, blocked streams: %" PRIu64, blocked_streams);
+        ret = -1;
+    }
+    else if ((ret = h3zero_qpack_dynamic_exchange(&encoder, &decoder)) != 0) {
+        DBG_PRINTF("Instruction exchange fails, ret = 0x%x", ret);
+    }
+    else if (h3zero_qpack_section_is_blocked(&decoder, first, first_last) != 0 ||
+        decoder.table.insert_count != 1 || encoder.known_received_count != 1) {
+        DBG_PRINTF("%s", "Instructions were not processed");
+        ret = -1;
+    }
+    else if ((ret = h3zero_qpack_dynamic_parse(&decoder, first, first_last, 0, h3zero_content_type_text_html)) == 0 &&
+        (ret = h3zero_qpack_dynamic_exchange(&encoder, &decoder)) == 0) {
+        /* The second response references the acknowledged entry */
+        second_last = h3zero_create_response_header_frame_qpack(second, second + sizeof(second),
+            h3zero_content_type_text_plain, H3ZERO_USER_AGENT_STRING, &encoder, 4);
+        /* prefix, status, server reference and content type take one byte each */
+        if (second_last == NULL || encoder.instructions.length != 0 || second_last - second != 5) {
+            DBG_PRINTF("%s", "Second response does not use the dynamic table");
+            ret = -1;
+        }
+        else if ((ret = h3zero_qpack_dynamic_parse(&decoder, second, second_last, 4, h3zero_content_type_text_plain)) == 0 &&
+            (ret = h3zero_qpack_dynamic_exchange(&encoder, &decoder)) == 0 &&
+            encoder.nb_sections != 0) {
+            DBG_PRINTF("%" PRIu64 " sections not acknowledged", (uint64_t)encoder.nb_sections);
+            ret = -1;
+        }
+    }
+
+    h3zero_qpack_encoder_release(&encoder);
+    h3zero_qpack_decoder_release(&decoder);
+
+    return ret;
+}
+
+static int h3zero_qpack_dynamic_evict_test()
+{
+    int ret = 0;
+    h3zero_qpack_table_t table;
+    uint8_t name[8] = { 'x', '-', 't', 'e', 's', 't', '-', '0' };
+    uint8_t large_value[32] = { 0 };
+
+    /* Each entry takes 8 + 8 + 32 bytes, only two fit in the table */
+    if (h3zero_qpack_table_init(&table, 100) != 0 ||
+        h3zero_qpack_table_set_capacity(&table, 100) != 0) {
+        ret = -1;
+    }
+    for (int i = 0; ret == 0 && i < 5; i++) {
+        name[7] = (uint8_t)('0' + i);
+        ret = h3zero_qpack_table_insert(&table, http_header_unknown, name, 8, name, 8);
+    }
+    if (ret == 0 && (table.insert_count != 5 || table.drop_count != 3 || table.size != 96 ||
+        h3zero_qpack_table_get(&table, 2) != NULL || h3zero_qpack_table_get(&table, 3) == NULL ||
+        h3zero_qpack_table_get(&table, 4)->name[7] != '4' || h3zero_qpack_table_get(&table, 5) != NULL)) {
+        DBG_PRINTF("Unexpected table state after eviction, insert %" PRIu64 ", drop %" PRIu64,
+            table.insert_count, table.drop_count);
+        ret = -1;
+    }
+    /* Reducing the capacity evicts, exceeding the maximum is an error */
+    if (ret == 0 && (h3zero_qpack_table_set_capacity(&table, 50) != 0 || table.drop_count != 4 ||
+        h3zero_qpack_table_set_capacity(&table, 200) == 0)) {
+        DBG_PRINTF("%s", "Unexpected capacity handling");
+        ret = -1;
+    }
+    /* An entry larger than the capacity cannot be inserted */
+    if (ret == 0 && h3zero_qpack_table_insert(&table, http_header_unknown, name, 8, large_value, sizeof(large_value)) == 0) {
+        DBG_PRINTF("%s", "Oversized entry was inserted");
+        ret = -1;
+    }
+    h3zero_qpack_table_release(&table);
+
+    return ret;
+}
+
+static int h3zero_qpack_dynamic_error_test()
+{
+    int ret = 0;
+    h3zero_qpack_encoder_t encoder;
+    h3zero_qpack_decoder_t decoder;
+    uint8_t duplicate_unknown[] = { 0x05 };
+    uint8_t capacity_too_large[] = { 0x3f, 0xe2, 0x1f };
+    uint8_t static_out_of_range[] = { 0xff, 0x3f, 0x01, 'a' };
+    uint8_t ack_unknown[] = { 0x84 };
+    uint8_t increment_too_large[] = { 0x01 };
+    uint8_t blocked_section[] = { 0x02, 0x00, 0x80 };
+
+    (void)h3zero_qpack_encoder_init(&encoder, 4096);
+    if (h3zero_qpack_encoder_set_peer_settings(&encoder, 4096, 1) != 0 ||
+        h3zero_qpack_decoder_init(&decoder, 4096, 1) != 0) {
+        ret = -1;
+    }
+    else if (h3zero_qpack_decoder_receive(&decoder, duplicate_unknown, sizeof(duplicate_unknown)) != H3ZERO_QPACK_ENCODER_STREAM_ERROR) {
+        DBG_PRINTF("%s", "Duplicate of unknown entry not detected");
+        ret = -1;
+    }
+    else {
+        h3zero_qpack_decoder_release(&decoder);
+        (void)h3zero_qpack_decoder_init(&decoder, 4096, 1);
+        if (h3zero_qpack_decoder_receive(&decoder, capacity_too_large, sizeof(capacity_too_large)) != H3ZERO_QPACK_ENCODER_STREAM_ERROR) {
+            DBG_PRINTF("%s", "Excessive capacity not detected");
+            ret = -1;
+        }
+    }
+    if (ret == 0) {
+        h3zero_qpack_decoder_release(&decoder);
+        (void)h3zero_qpack_decoder_init(&decoder, 4096, 1);
+        if (h3zero_qpack_decoder_receive(&decoder, static_out_of_range, sizeof(static_out_of_range)) != H3ZERO_QPACK_ENCODER_STREAM_ERROR) {
+            DBG_PRINTF("%s", "Static index out of range not detected");
+            ret = -1;
+        }
+    }
+    if (ret == 0) {
+        h3zero_header_parts_t parts;
+        /* A section that references entries not yet received is blocked, and cannot be parsed */
+        h3zero_qpack_decoder_release(&decoder);
+        (void)h3zero_qpack_decoder_init(&decoder, 4096, 1);
+        if (h3zero_qpack_section_is_blocked(&decoder, blocked_section, blocked_section + sizeof(blocked_section)) != 1 ||
+            h3zero_parse_qpack_header_frame_ex(blocked_section, blocked_section + sizeof(blocked_section), &parts, &decoder, 0) != NULL ||
+            h3zero_parse_qpack_header_frame(blocked_section, blocked_section + sizeof(blocked_section), &parts) != NULL) {
+            DBG_PRINTF("%s", "Blocked section not detected");
+            ret = -1;
+        }
+        h3zero_release_header_parts(&parts);
+    }
+    if (ret == 0 && h3zero_qpack_encoder_receive(&encoder, ack_unknown, sizeof(ack_unknown)) != H3ZERO_QPACK_DECODER_STREAM_ERROR) {
+        DBG_PRINTF("%s", "Ack of unknown section not detected");
+        ret = -1;
+    }
+    if (ret == 0) {
+        h3zero_qpack_encoder_release(&encoder);
+        (void)h3zero_qpack_encoder_init(&encoder, 4096);
+        (void)h3zero_qpack_encoder_set_peer_settings(&encoder, 4096, 1);
+        if (h3zero_qpack_encoder_receive(&encoder, increment_too_large, sizeof(increment_too_large)) != H3ZERO_QPACK_DECODER_STREAM_ERROR) {
+            DBG_PRINTF("%s", "Excessive insert count increment not detected");
+            ret = -1;
+        }
     }
 
+    h3zero_qpack_encoder_release(&encoder);
+    h3zero_qpack_decoder_release(&decoder);
+
     return ret;
 }
 
-int http_stress_test()
-{
-    return http_stress_test_one(0, 0, 0);
-}
-
-int http_corrupt_test()
+int h3zero_qpack_dynamic_test()
 {
-    return http_stress_test_one(1, 0, 0);
-}
+    int ret = h3zero_qpack_dynamic_static_test();
 
-int http_drop_test()
-{
-    return http_stress_test_one(0, 1, 0);
-}
+    if (ret == 0) {
+        ret = h3zero_qpack_dynamic_blocked_test(0);
+    }
+    if (ret == 0) {
+        ret = h3zero_qpack_dynamic_blocked_test(16);
+    }
+    if (ret == 0) {
+        ret = h3zero_qpack_dynamic_evict_test();
+    }
+    if (ret == 0) {
+        ret = h3zero_qpack_dynamic_error_test();
+    }
 
-int http_corrupt_rdpn_test()
-{
-    return http_stress_test_one(1, 0, 1);
+    return ret;
 }
 
-/* Test the selection of ALPN
+/* Benchmark of QPACK encoding, with and without dynamic table.
+ * Encode and decode a series of request headers, and report the
+ * number of header bytes per request, including the encoder and decoder
+ * instructions, and the encoding and decoding time per header block.
  */
-char const* alpn_good_list[] = {
-    "h3-34", "hq-34", "h3-29", "hq-29", "h3", "hq-interop", "siduck", "siduck-00", "perf", NULL };
-picoquic_alpn_enum alpn_proto_list[] = {
-    picoquic_alpn_http_3, picoquic_alpn_http_0_9, picoquic_alpn_http_3, picoquic_alpn_http_0_9,
-    picoquic_alpn_http_3, picoquic_alpn_http_0_9,
-    picoquic_alpn_siduck, picoquic_alpn_siduck,
-    picoquic_alpn_quicperf };
-char const* alpn_bad_list[] = {
-    "h3-00", "hq", "hq-interop-00", "siduck-99", "", "unknown", NULL };
+#define H3ZERO_QPACK_BENCH_NB_REQUESTS 10000
 
-int demo_alpn_test()
+static int h3zero_qpack_bench_one(uint64_t capacity, uint64_t* header_bytes, uint64_t* encode_us, uint64_t* decode_us)
 {
     int ret = 0;
-    /* Try the list of correct and incorrect values */
-    for (int i = 0; ret == 0 && alpn_good_list[i] != NULL; i++) {
-        picoquic_alpn_enum x = picoquic_parse_alpn_nz(alpn_good_list[i], strlen(alpn_good_list[i]));
-        if (x != alpn_proto_list[i]) {
-            DBG_PRINTF("For ALPN = \"%s\", got proto %d instead of %d", alpn_good_list[i], x, alpn_proto_list[i]);
-            ret = -1;
-            break;
-        }
+    h3zero_qpack_encoder_t encoder;
+    h3zero_qpack_decoder_t decoder;
+    char const* authority = "www.example.com";
+    char const* user_agent = H3ZERO_USER_AGENT_STRING;
+    char path[32];
+    h3zero_qpack_field_t fields[5];
+    uint8_t buffer[256];
+
+    *header_bytes = 0;
+    *encode_us = 0;
+    *decode_us = 0;
+    memset(fields, 0, sizeof(fields));
+    fields[0].static_index = H3ZERO_QPACK_CODE_GET;
+    fields[0].is_static_match = 1;
+    fields[1].static_index = H3ZERO_QPACK_SCHEME_HTTPS;
+    fields[1].is_static_match = 1;
+    fields[2].static_index = H3ZERO_QPACK_AUTHORITY;
+    fields[2].value = (uint8_t const*)authority;
+    fields[2].value_length = strlen(authority);
+    fields[2].is_indexable = 1;
+    fields[3].static_index = H3ZERO_QPACK_USER_AGENT;
+    fields[3].value = (uint8_t const*)user_agent;
+    fields[3].value_length = strlen(user_agent);
+    fields[3].is_indexable = 1;
+    fields[4].static_index = H3ZERO_QPACK_CODE_PATH;
+    fields[4].value = (uint8_t const*)path;
+    fields[4].is_indexable = 1;
+
+    (void)h3zero_qpack_encoder_init(&encoder, capacity);
+    if (h3zero_qpack_encoder_set_peer_settings(&encoder, capacity, 0) != 0 ||
+        h3zero_qpack_decoder_init(&decoder, capacity, 0) != 0) {
+        ret = -1;
     }
 
-    for (int i = 0; ret == 0 && alpn_bad_list[i] != NULL; i++) {
-        picoquic_alpn_enum x = picoquic_parse_alpn_nz(alpn_bad_list[i], strlen(alpn_bad_list[i]));
-        if (x != picoquic_alpn_undef) {
-            DBG_PRINTF("For ALPN = \"%s\", got proto %d instead of %d", alpn_bad_list[i], x, picoquic_alpn_undef);
+    for (int i = 0; ret == 0 && i < H3ZERO_QPACK_BENCH_NB_REQUESTS; i++) {
+        uint64_t stream_id = 4 * (uint64_t)i;
+        uint64_t t0;
+        uint64_t t1;
+        uint8_t* last;
+        h3zero_header_parts_t parts;
+        size_t path_length = 0;
+
+        /* Cycle through 16 documents, so the table holds all the paths */
+        (void)picoquic_sprintf(path, sizeof(path), &path_length, "/img/picture-%d.png", i % 16);
+        fields[4].value_length = path_length;
+
+        t0 = picoquic_current_time();
+        last = h3zero_qpack_encode_header_section(buffer, buffer + sizeof(buffer), &encoder, stream_id, fields, 5);
+        t1 = picoquic_current_time();
+        *encode_us += t1 - t0;
+        if (last == NULL) {
+            DBG_PRINTF("Cannot encode request %d", i);
             ret = -1;
             break;
         }
+        *header_bytes += (last - buffer) + encoder.instructions.length;
+        if (encoder.instructions.length > 0) {
+            ret = h3zero_qpack_decoder_receive(&decoder, encoder.instructions.bytes, encoder.instructions.length);
+            encoder.instructions.length = 0;
+        }
+        if (ret == 0) {
+            t0 = picoquic_current_time();
+            if (h3zero_parse_qpack_header_frame_ex(buffer, last, &parts, &decoder, stream_id) != last) {
+                DBG_PRINTF("Cannot decode request %d", i);
+                ret = -1;
+            }
+            t1 = picoquic_current_time();
+            *decode_us += t1 - t0;
+            if (ret == 0 && (parts.method != h3zero_method_get || parts.path_length != path_length ||
+                memcmp(parts.path, path, path_length) != 0)) {
+                DBG_PRINTF("Wrong decoding of request %d", i);
+                ret = -1;
+            }
+            h3zero_release_header_parts(&parts);
+        }
+        if (ret == 0 && decoder.instructions.length > 0) {
+            *header_bytes += decoder.instructions.length;
+            ret = h3zero_qpack_encoder_receive(&encoder, decoder.instructions.bytes, decoder.instructions.length);
+            decoder.instructions.length = 0;
+        }
     }
 
-    /* Try the list of correct values with extra zero */
-    for (int i = 0; ret == 0 && alpn_good_list[i] != NULL; i++) {
-        char buf[256];
-        picoquic_alpn_enum x;
-        size_t len = strlen(alpn_good_list[i]);
+    h3zero_qpack_encoder_release(&encoder);
+    h3zero_qpack_decoder_release(&decoder);
 
-        memset(buf, 0, sizeof(buf));
-        memcpy(buf, alpn_good_list[i], len);
-        x = picoquic_parse_alpn_nz(buf, len+1);
-        if (x != picoquic_alpn_undef) {
-            DBG_PRINTF("For ALPN = \"%s\\0...\", got proto %d instead of %d",
-                alpn_good_list[i], x, picoquic_alpn_undef);
-            ret = -1;
-            break;
-        }
-    }
+    return ret;
+}
 
-    /* Same test, but with large buffer */
-    for (int i = 0; ret == 0 && alpn_good_list[i] != NULL; i++) {
-        char buf[256];
-        picoquic_alpn_enum x;
+int h3zero_qpack_bench_test()
+{
+    int ret = 0;
+    uint64_t capacities[3] = { 0, 1024, 4096 };
 
-        memset(buf, 'a', sizeof(buf));
-        memcpy(buf, alpn_good_list[i], strlen(alpn_good_list[i]));
-        x = picoquic_parse_alpn_nz(buf, sizeof(buf));
-        if (x != picoquic_alpn_undef) {
-            DBG_PRINTF("For ALPN = \"%saaaaaaaaaaaaaa...\", got proto %d instead of %d", 
-                alpn_good_list[i], x, picoquic_alpn_undef);
-            ret = -1;
-            break;
+    for (int i = 0; ret == 0 && i < 3; i++) {
+        uint64_t header_bytes;
+        uint64_t encode_us;
+        uint64_t decode_us;
+
+        if ((ret = h3zero_qpack_bench_one(capacities[i], &header_bytes, &encode_us, &decode_us)) != 0) {
+            DBG_PRINTF("QPACK bench fails for capacity %" PRIu64, capacities[i]);
+        }
+        else {
+            DBG_PRINTF("QPACK capacity %" PRIu64 ": %" PRIu64 " header bytes per request, %" PRIu64 " ns per encode, %" PRIu64 " ns per decode",
+                capacities[i], header_bytes / H3ZERO_QPACK_BENCH_NB_REQUESTS,
+                (encode_us * 1000) / H3ZERO_QPACK_BENCH_NB_REQUESTS, (decode_us * 1000) / H3ZERO_QPACK_BENCH_NB_REQUESTS);
         }
     }
 
     return ret;
 }
 
-/* Test encode and decode of settings frame
+/* Benchmark of QPACK Huffman coding.
+ * Report the reduction in size of typical header strings and of the
+ * request header blocks that carry them, and the decoding time per
+ * decoded byte.
  */
+#define H3ZERO_QPACK_HUFFMAN_BENCH_NB_ROUNDS 20000
 
-int h3zero_settings_encode_test(const uint8_t* ref, size_t ref_length, h3zero_settings_t* test)
+int h3zero_qpack_huffman_bench_test()
 {
-    int ret = -1;
-    uint8_t buffer[1024];
-    uint8_t* bytes = buffer;
-    uint8_t* bytes_max = buffer + sizeof(buffer);
-
-    if ((bytes = h3zero_settings_encode(bytes, bytes_max, test)) != NULL &&
-        (bytes - buffer) == ref_length &&
-        memcmp(buffer, ref, ref_length) == 0) {
-        ret = 0;
+    int ret = 0;
+    char const* strings[] = {
+        "www.example.com", H3ZERO_USER_AGENT_STRING, "/index.html", "/img/picture-12.png",
+        "/api/v1/users/12345/profile?fields=name,email", "text/html; charset=utf-8",
+        "application/json", "gzip, deflate, br", "Mon, 19 Oct 2026 10:21:33 GMT",
+        "max-age=3600, public", "\"33a64df551425fcc55e4d42a148795d9f25f89d4\""
+    };
+    size_t nb_strings = sizeof(strings) / sizeof(char const*);
+    uint8_t encoded[16][128];
+    size_t encoded_length[16];
+    uint8_t decoded[128];
+    uint64_t raw_bytes = 0;
+    uint64_t huffman_bytes = 0;
+    uint64_t block_bytes = 0;
+    uint64_t block_raw_bytes = 0;
+    uint64_t decoded_bytes = 0;
+    uint64_t t0;
+    uint64_t decode_us;
+
+    for (size_t i = 0; ret == 0 && i < nb_strings; i++) {
+        size_t length = strlen(strings[i]);
+        uint8_t* last = h3zero_qpack_huffman_encode(encoded[i], encoded[i] + sizeof(encoded[i]), (uint8_t const*)strings[i], length);
+
+        if (last == NULL) {
+            DBG_PRINTF("Cannot encode string %d", (int)i);
+            ret = -1;
+        }
+        else {
+            encoded_length[i] = last - encoded[i];
+            raw_bytes += length;
+            huffman_bytes += (encoded_length[i] < length) ? encoded_length[i] : length;
+        }
     }
-    return ret;
-}
 
-int h3zero_settings_decode_test(const uint8_t* bytes, size_t length, h3zero_settings_t* ref, int check_length)
-{
-    int ret = 0;
-    h3zero_settings_t decoded;
-    const uint8_t * bytes_max = bytes + length;
+    /* Request header blocks, compared to the same blocks with raw literals.
+     * All the strings are shorter than 127 bytes, so the length prefixes
+     * have the same size in both cases. */
+    for (size_t i = 2; ret == 0 && i < 5; i++) {
+        uint8_t block[256];
+        uint8_t* last = h3zero_create_request_header_frame_ex(block, block + sizeof(block),
+            (uint8_t const*)strings[i], strlen(strings[i]), strings[0], strings[1]);
 
-    bytes = h3zero_settings_decode(bytes, bytes_max, &decoded);
-    if (bytes == NULL) {
-        ret = -1;
-    }
-    else if (check_length && bytes != bytes_max) {
-        ret = -1;
-    }
-    else if (decoded.table_size != ref->table_size) {
-        ret = -1;
-    }
-    else if (decoded.blocked_streams != ref->blocked_streams) {
-        ret = -1;
-    }
-    else if (decoded.enable_connect_protocol != ref->enable_connect_protocol){
-        ret = -1;
-    }
-    else if (decoded.h3_datagram != ref->h3_datagram){
-        ret = -1;
-    }
-#if 0
-    else if (decoded.is_web_transport_enabled != ref->is_web_transport_enabled){
-        ret = -1;
-    }
-#endif
-    else if (decoded.webtransport_max_sessions != ref->webtransport_max_sessions) {
-        ret = -1;
+        if (last == NULL) {
+            DBG_PRINTF("Cannot encode request block %d", (int)i);
+            ret = -1;
+        }
+        else {
+            size_t string_index[3] = { 0, 1, i };
+
+            block_bytes += last - block;
+            block_raw_bytes += last - block;
+            for (int j = 0; j < 3; j++) {
+                size_t length = strlen(strings[string_index[j]]);
+                if (encoded_length[string_index[j]] < length) {
+                    block_raw_bytes += length - encoded_length[string_index[j]];
+                }
+            }
+        }
     }
-    return ret;
-}
 
-h3zero_settings_t default_setting_expected = {
-    1, 0, 0, 0, 1, 1, 0
-};
+    t0 = picoquic_current_time();
+    for (int r = 0; ret == 0 && r < H3ZERO_QPACK_HUFFMAN_BENCH_NB_ROUNDS; r++) {
+        for (size_t i = 0; i < nb_strings; i++) {
+            size_t nb_decoded = 0;
 
-int h3zero_settings_test()
-{
-    int ret = h3zero_settings_decode_test(h3zero_default_setting_frame + 1, h3zero_default_setting_frame_size - 1, &default_setting_expected, 1);
+            if (hzero_qpack_huffman_decode(encoded[i], encoded[i] + encoded_length[i], decoded, sizeof(decoded), &nb_decoded) != 0 ||
+                nb_decoded != strlen(strings[i])) {
+                DBG_PRINTF("Cannot decode string %d", (int)i);
+                ret = -1;
+                break;
+            }
+            decoded_bytes += nb_decoded;
+        }
+    }
+    decode_us = picoquic_current_time() - t0;
 
     if (ret == 0) {
-        ret = h3zero_settings_encode_test(h3zero_default_setting_frame + 1, h3zero_default_setting_frame_size - 1, &default_setting_expected);
+        DBG_PRINTF("Huffman strings: %" PRIu64 " bytes instead of %" PRIu64 " (%" PRIu64 "%% smaller)",
+            huffman_bytes, raw_bytes, ((raw_bytes - huffman_bytes) * 100) / raw_bytes);
+        DBG_PRINTF("Request header blocks: %" PRIu64 " bytes instead of %" PRIu64 " (%" PRIu64 "%% smaller)",
+            block_bytes, block_raw_bytes, ((block_raw_bytes - block_bytes) * 100) / block_raw_bytes);
+        DBG_PRINTF("Huffman decoding: %" PRIu64 " bytes in %" PRIu64 " us, %.2f ns per byte",
+            decoded_bytes, decode_us, (decoded_bytes == 0) ? 0.0 : ((double)decode_us * 1000.0) / (double)decoded_bytes);
     }
 
     return ret;
@@ -3404,4 +5183,240 @@ int h3_grease_server_test()
     int ret = h3_grease_test_one(1);
 
     return ret;
-}
\ No newline at end of file
+}
+
+/* Test of the compiled path router */
+static picohttp_server_path_item_t h3zero_router_test_table[] = {
+    { "/post", 5, NULL, NULL, 0 },
+    { "/baton", 6, NULL, NULL, 0 },
+    { "/files/", 7, NULL, NULL, 1 },
+    { "/files/img/", 11, NULL, NULL, 1 },
+    { "/files/img/logo.png", 19, NULL, NULL, 0 },
+    { "/post", 5, NULL, NULL, 0 },
+    { "/", 1, NULL, NULL, 1 }
+};
+
+typedef struct st_h3zero_router_test_case_t {
+    char const* path;
+    size_t nb_items; /* Number of items of the table compiled in the router */
+    int path_item;
+    char const* suffix;
+    char const* query; /* NULL if no query */
+} h3zero_router_test_case_t;
+
+static const h3zero_router_test_case_t h3zero_router_test_cases[] = {
+    { "/post", 7, 0, "", NULL },
+    { "/post?x=1", 7, 0, "", "x=1" },
+    { "/poster", 7, 6, "poster", NULL },
+    { "/poster", 6, -1, "", NULL },
+    { "/files/a.txt", 7, 2, "a.txt", NULL },
+    { "/files/img/b.png?w=3", 7, 3, "b.png", "w=3" },
+    { "/files/img/logo.png", 7, 4, "", NULL },
+    { "/files/img/logo.png?v", 7, 4, "", "v" },
+    { "/files/img/logo.png2", 7, 3, "logo.png2", NULL },
+    { "/files", 7, 6, "files", NULL },
+    { "/baton?count=4&inject", 7, 1, "", "count=4&inject" },
+    { "/?", 7, 6, "", "" },
+    { "/", 7, 6, "", NULL },
+    { "", 7, -1, "", NULL },
+    { "/zzz", 6, -1, "", NULL }
+};
+
+static int h3zero_router_test_match(const h3zero_router_test_case_t* test, const h3zero_route_match_t* match)
+{
+    int ret = 0;
+    size_t suffix_length = strlen(test->suffix);
+
+    if (match->path_item != test->path_item) {
+        ret = -1;
+    }
+    else if (match->suffix_length != suffix_length || (suffix_length > 0 && memcmp(match->suffix, test->suffix, suffix_length) != 0)) {
+        ret = -1;
+    }
+    else if (test->query == NULL) {
+        if (match->query != NULL) {
+            ret = -1;
+        }
+    }
+    else if (match->query == NULL || match->query_length != strlen(test->query) ||
+        memcmp(match->query, test->query, match->query_length) != 0) {
+        ret = -1;
+    }
+
+    return ret;
+}
+
+int h3zero_router_test()
+{
+    int ret = 0;
+    size_t nb_cases = sizeof(h3zero_router_test_cases) / sizeof(h3zero_router_test_case_t);
+    h3zero_callback_ctx_t h3_ctx;
+
+    for (size_t i = 0; ret == 0 && i < nb_cases; i++) {
+        const h3zero_router_test_case_t* test = &h3zero_router_test_cases[i];
+        h3zero_router_t* router = h3zero_router_create(h3zero_router_test_table, test->nb_items);
+
+        if (router == NULL) {
+            ret = -1;
+        }
+        else {
+            h3zero_route_match_t match;
+            int path_item = h3zero_router_find(router, (const uint8_t*)test->path, strlen(test->path), &match);
+
+            if (path_item != match.path_item || h3zero_router_test_match(test, &match) != 0) {
+                DBG_PRINTF("Router test %zu fails for <%s>, item %d instead of %d", i, test->path, path_item, test->path_item);
+                ret = -1;
+            }
+            else {
+                /* The HTTP 3 and HTTP 0.9 servers route through the context, with
+                 * or without a router. Both must produce the same match. */
+                memset(&h3_ctx, 0, sizeof(h3zero_callback_ctx_t));
+                h3_ctx.path_table = h3zero_router_test_table;
+                h3_ctx.path_table_nb = test->nb_items;
+                for (int with_router = 0; ret == 0 && with_router < 2; with_router++) {
+                    h3_ctx.router = (with_router) ? router : NULL;
+                    memset(&match, 0, sizeof(h3zero_route_match_t));
+                    path_item = h3zero_route_path(&h3_ctx, (const uint8_t*)test->path, strlen(test->path), &match);
+                    if (path_item != match.path_item || h3zero_router_test_match(test, &match) != 0) {
+                        DBG_PRINTF("Route path test %zu fails for <%s>, router %d, item %d instead of %d",
+                            i, test->path, with_router, path_item, test->path_item);
+                        ret = -1;
+                    }
+                }
+            }
+            h3zero_router_delete(router);
+        }
+    }
+
+    if (ret == 0) {
+        /* Split of the query found by the router */
+        const uint8_t* queries = (const uint8_t*)"a=1&b&&c=x%20y&=z";
+        size_t queries_length = strlen((const char*)queries);
+        h3zero_query_parameter_t parameters[8];
+        size_t nb_parameters = h3zero_query_split(queries, queries_length, parameters, 8);
+        uint8_t text[16];
+        size_t text_length = 0;
+        uint64_t number = 0;
+
+        if (nb_parameters != 4 ||
+            parameters[0].name_length != 1 || parameters[0].name[0] != 'a' ||
+            h3zero_query_bytes_to_uint64(parameters[0].value, parameters[0].value_length, &number) != 0 || number != 1 ||
+            parameters[1].name_length != 1 || parameters[1].name[0] != 'b' || parameters[1].value != NULL ||
+            parameters[2].name_length != 1 || parameters[2].name[0] != 'c' ||
+            h3zero_query_bytes_to_string(parameters[2].value, parameters[2].value_length, text, sizeof(text), &text_length) != 0 ||
+            text_length != 3 || memcmp(text, "x y", 3) != 0 ||
+            parameters[3].name_length != 0 || parameters[3].value_length != 1 || parameters[3].value[0] != 'z' ||
+            h3zero_query_split(queries, queries_length, parameters, 2) != 2 ||
+            h3zero_query_split(queries, 0, parameters, 8) != 0) {
+            DBG_PRINTF("%s", "Query split test fails");
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+/* Compare the router with the linear search of the path table, for tables
+ * of 10 and 1000 routes. Most requests match a route and carry a query,
+ * one out of 8 does not match any route.
+ */
+#define H3ZERO_ROUTER_BENCH_NB_LOOKUPS 200000
+
+static int h3zero_router_bench_one(size_t nb_routes)
+{
+    int ret = 0;
+    picohttp_server_path_item_t* table = (picohttp_server_path_item_t*)malloc(nb_routes * sizeof(picohttp_server_path_item_t));
+    char(*paths)[48] = (char(*)[48])malloc(nb_routes * 48);
+    h3zero_router_t* router = NULL;
+    uint64_t random_ctx = 0xdeadbeef0badcafeull;
+    uint64_t duration_us[2] = { 0, 0 };
+    int nb_found[2] = { 0, 0 };
+
+    if (table == NULL || paths == NULL) {
+        ret = -1;
+    }
+    else {
+        memset(table, 0, nb_routes * sizeof(picohttp_server_path_item_t));
+        for (size_t i = 0; i < nb_routes; i++) {
+            size_t length = 0;
+            (void)picoquic_sprintf(paths[i], sizeof(paths[i]), &length, "/api/v1/service%zu/resource%zu", i % 37, i);
+            table[i].path = paths[i];
+            table[i].path_length = length;
+        }
+        if ((router = h3zero_router_create(table, nb_routes)) == NULL) {
+            ret = -1;
+        }
+    }
+
+    for (int use_router = 0; ret == 0 && use_router < 2; use_router++) {
+        uint64_t t0 = picoquic_current_time();
+
+        random_ctx = 0xdeadbeef0badcafeull;
+        for (int r = 0; ret == 0 && r < H3ZERO_ROUTER_BENCH_NB_LOOKUPS; r++) {
+            size_t route = (size_t)picoquic_test_uniform_random(&random_ctx, nb_routes);
+            uint8_t path[64];
+            size_t path_length = table[route].path_length;
+            int expected = (int)route;
+            int path_item;
+
+            memcpy(path, table[route].path, path_length);
+            if ((r & 7) == 7) {
+                /* Unknown path */
+                path[path_length++] = 'x';
+                expected = -1;
+            }
+            memcpy(path + path_length, "?id=17&page=3", 13);
+            path_length += 13;
+
+            if (use_router) {
+                h3zero_route_match_t match;
+                path_item = h3zero_router_find(router, path, path_length, &match);
+            }
+            else {
+                path_item = h3zero_find_path_item(path, path_length, table, nb_routes);
+            }
+            if (path_item != expected) {
+                DBG_PRINTF("Route %zu found as %d, use_router = %d", route, path_item, use_router);
+                ret = -1;
+            }
+            else if (path_item >= 0) {
+                nb_found[use_router]++;
+            }
+        }
+        duration_us[use_router] = picoquic_current_time() - t0;
+    }
+
+    if (ret == 0) {
+        if (nb_found[0] != nb_found[1]) {
+            ret = -1;
+        }
+        else {
+            DBG_PRINTF("%zu routes, %zu nodes: linear %.1f ns/lookup, router %.1f ns/lookup", nb_routes, router->nb_nodes,
+                (1000.0 * (double)duration_us[0]) / H3ZERO_ROUTER_BENCH_NB_LOOKUPS,
+                (1000.0 * (double)duration_us[1]) / H3ZERO_ROUTER_BENCH_NB_LOOKUPS);
+        }
+    }
+
+    if (router != NULL) {
+        h3zero_router_delete(router);
+    }
+    if (paths != NULL) {
+        free(paths);
+    }
+    if (table != NULL) {
+        free(table);
+    }
+
+    return ret;
+}
+
+int h3zero_router_bench_test()
+{
+    int ret = h3zero_router_bench_one(10);
+
+    if (ret == 0) {
+        ret = h3zero_router_bench_one(1000);
+    }
+
+    return ret;
+}
@@ -143,6 +143,39 @@ int picohash_test_one(int embedded_item)
             }
         }
 
+        /* Grow the table, check that all the values are still there */
+        if (ret == 0 && picohash_resize(t, 67) != 0) {
+            DBG_PRINTF("%s", "picohash_resize(67) failed");
+            ret = -1;
+        }
+
+        if (ret == 0 && (t->nb_bin != 67 || t->count != 11)) {
+            DBG_PRINTF("picohash resized table nb_bin != 67 or count != 11 (nb_bin=%"PRIst", count=%"PRIst")", t->nb_bin, t->count);
+            ret = -1;
+        }
+
+        for (uint64_t i = 1; ret == 0 && i < 10; i += 2) {
+            hk.x = i;
+            picohash_item* pi = picohash_retrieve(t, &hk);
+
+            if (pi == NULL) {
+                DBG_PRINTF("picohash_retrieve(%"PRId64") failed after resize", i);
+                ret = -1;
+            }
+        }
+
+        for (uint64_t k = 1; ret == 0 && k < 6; k += 4) {
+            for (uint64_t j = 1; ret == 0 && j <= k; j++) {
+                hk.x = k + 32 * j;
+                picohash_item* pi = picohash_retrieve(t, &hk);
+
+                if (pi == NULL) {
+                    DBG_PRINTF("picohash_retrieve(%"PRId64" + 32 * %"PRId64") failed after resize", k, j);
+                    ret = -1;
+                }
+            }
+        }
+
         /* Test whether different values cannot be retrieved */
         for (uint64_t i = 0; ret == 0 && i <= 10; i += 2) {
             hk.x = i;
@@ -90,6 +90,7 @@ int tls_api_very_long_with_err_test();
 int tls_api_very_long_congestion_test();
 int tls_api_retry_test();
 int tls_api_retry_large_test();
+int tls_api_retry_flood_test();
 int ackrange_test();
 int ack_of_ack_test();
 int ack_disorder_test();
@@ -112,6 +113,7 @@ int ticket_store_test();
 int ticket_seed_test();
 int ticket_seed_from_bdp_frame_test();
 int token_store_test();
+int token_store_expiry_test();
 int session_resume_test();
 int zero_rtt_test();
 int zero_rtt_loss_test();
@@ -146,6 +148,7 @@ int vn_tp_test();
 int vn_compat_test();
 int request_client_authentication_test();
 int bad_client_certificate_test();
+int tls_master_shared_test();
 int nat_rebinding_test();
 int nat_rebinding_loss_test();
 int nat_rebinding_zero_test();
@@ -179,6 +182,7 @@ int sockloop_thread_name_test();
 int splay_test();
 int TlsStreamFrameTest();
 int draft17_vector_test();
+int initial_key_bench_test();
 int dtn_basic_test();
 int dtn_data_test();
 int dtn_silence_test();
@@ -221,8 +225,22 @@ int qlog_trace_test();
 int qlog_trace_auto_test();
 int qlog_trace_only_test();
 int qlog_trace_ecn_test();
+int qlog_trace_background_test();
+int qlog_trace_ring_test();
+int binlog_ring_bench_test();
+int qlog_trace_segment_test();
+int binlog_segment_test();
+int binlog_sampling_test();
+int binlog_flight_recorder_test();
+int qlog_trace_compact_test();
+int qlog_trace_compact_segment_test();
+int qlog_trace_threshold_test();
+int qlog_trace_batch_test();
 int path_packet_queue_test();
 int perflog_test();
+int perflog_stream_test();
+int metrics_test();
+int phase_profile_test();
 int rebinding_stress_test();
 int many_short_loss_test();
 int random_padding_test();
@@ -284,6 +302,7 @@ int h3zero_varint_stream_test();
 int h3zero_incoming_unidir_test();
 int qpack_huffman_test();
 int qpack_huffman_base_test();
+int qpack_huffman_encode_test();
 int h3zero_parse_qpack_test();
 int h3zero_prepare_qpack_test();
 int h3zero_user_agent_test();
@@ -466,6 +485,7 @@ int simple_multipath_perf_test();
 int simple_multipath_qlog_test();
 int simple_multipath_quality_test();
 int token_reuse_api_test();
+int shared_registry_test();
 int grease_quic_bit_test();
 int grease_quic_bit_one_way_test();
 int pn_random_test();
@@ -499,6 +519,18 @@ int demo_alpn_test();
 int demo_file_sanitize_test();
 int demo_file_access_test();
 int demo_server_file_test();
+int h3zero_file_cache_test();
+int h3zero_file_cache_bench_test();
+int h3zero_response_cache_test();
+int h3zero_response_cache_bench_test();
+int h3zero_priority_test();
+int h3zero_priority_page_load_test();
+int h3zero_frame_pool_test();
+int h3zero_stream_index_test();
+int h3zero_loadgen_histogram_test();
+int h3zero_loadgen_test();
+int h3zero_router_test();
+int h3zero_router_bench_test();
 int h3zero_satellite_test();
 int h09_satellite_test();
 int h09_lone_fin_test();
@@ -516,6 +548,9 @@ int h09_multi_file_test();
 int h09_multi_file_loss_test();
 int h09_multi_file_preemptive_test();
 int h3zero_settings_test();
+int h3zero_qpack_dynamic_test();
+int h3zero_qpack_bench_test();
+int h3zero_qpack_huffman_bench_test();
 int picowt_baton_basic_test();
 int picowt_baton_error_test();
 int picowt_baton_long_test();
@@ -523,6 +558,7 @@ int picowt_baton_multi_test();
 int picowt_baton_random_test();
 int picowt_baton_wrong_test();
 int picowt_baton_uri_test();
+int picowt_baton_datagram_test();
 
 int cplusplustest();
 
@@ -639,7 +639,7 @@ int picoqinq_test_sim_step(struct st_picoqinq_test_ctx_t* test_ctx)
                     memcpy(packet->bytes, sp->bytes, sp->length);
                     packet->length = sp->length;
                 }
-                picoquic_delete_stateless_packet(sp);
+                picoquic_delete_stateless_packet(test_ctx->qctx[selected_ctx], sp);
             }
         }
         else if (test_ctx->qctx[selected_ctx]->cnx_wake_first == NULL) {
@@ -523,7 +523,7 @@ static int stress_submit_sp_packets(picoquic_stress_ctx_t * ctx, picoquic_quic_t
                 }
             }
         }
-        picoquic_delete_stateless_packet(sp);
+        picoquic_delete_stateless_packet(q, sp);
     }
 
     return ret;
@@ -303,11 +303,11 @@ static int create_test_token(uint64_t current_time, uint32_t ttl, uint8_t* buf,
     return ret;
 }
 
-static int token_store_compare(picoquic_stored_token_t* s1, picoquic_stored_token_t* s2)
+static int token_store_compare(picoquic_quic_t* quic1, picoquic_quic_t* quic2)
 {
     int ret = 0;
-    picoquic_stored_token_t* c1 = s1;
-    picoquic_stored_token_t* c2 = s2;
+    picoquic_stored_token_t* c1 = picoquic_first_stored_token(quic1);
+    picoquic_stored_token_t* c2 = picoquic_first_stored_token(quic2);
 
     while (ret == 0 && c1 != 0) {
         if (c2 == 0) {
@@ -322,8 +322,8 @@ static int token_store_compare(picoquic_stored_token_t* s1, picoquic_stored_toke
                 ret = -1;
             }
             else {
-                c1 = c1->next_token;
-                c2 = c2->next_token;
+                c1 = picoquic_next_stored_token(c1);
+                c2 = picoquic_next_stored_token(c2);
             }
         }
     }
@@ -338,10 +338,6 @@ static int token_store_compare(picoquic_stored_token_t* s1, picoquic_stored_toke
 int token_store_test()
 {
     int ret = 0;
-    picoquic_stored_token_t* p_first_token = NULL;
-    picoquic_stored_token_t* p_first_token_bis = NULL;
-    picoquic_stored_token_t* p_first_token_ter = NULL;
-
     uint64_t token_time = 40000000000ull;
     uint64_t current_time = 50000000000ull;
     uint64_t retrieve_time = 60000000000ull;
@@ -351,9 +347,19 @@ int token_store_test()
     uint64_t simulated_time = current_time;
     picoquic_quic_t * quic = picoquic_create(8, NULL, NULL, NULL, NULL, NULL, NULL,
         NULL, NULL, NULL, 0, &simulated_time, NULL, NULL, 0);
+    picoquic_quic_t* quic_bis = picoquic_create(8, NULL, NULL, NULL, NULL, NULL, NULL,
+        NULL, NULL, NULL, 0, &simulated_time, NULL, NULL, 0);
+    picoquic_quic_t* quic_ter = picoquic_create(8, NULL, NULL, NULL, NULL, NULL, NULL,
+        NULL, NULL, NULL, 0, &simulated_time, NULL, NULL, 0);
+
+    if (quic == NULL || quic_bis == NULL || quic_ter == NULL) {
+        ret = -1;
+    }
 
     /* Writing an empty file */
-    ret = picoquic_save_tokens(quic, test_token_file_name);
+    if (ret == 0) {
+        ret = picoquic_save_tokens(quic, test_token_file_name);
+    }
 
     /* Load the empty file again */
     if (ret == 0) {
@@ -361,11 +367,8 @@ int token_store_test()
         ret = picoquic_load_tokens(quic, test_token_file_name);
 
         /* Verify that the content is empty */
-        if (quic->p_first_token != NULL) {
-            if (ret == 0) {
-                ret = -1;
-            }
-            picoquic_free_tokens(&quic->p_first_token);
+        if (ret == 0 && picoquic_get_nb_stored_tokens(quic) != 0) {
+            ret = -1;
         }
     }
 
@@ -419,41 +422,107 @@ int token_store_test()
     /* Store them on a file */
     if (ret == 0) {
         ret = picoquic_save_tokens(quic, test_token_file_name);
-        p_first_token = quic->p_first_token;
-        quic->p_first_token = NULL;
     }
     /* Load the file again */
     if (ret == 0) {
         simulated_time = retrieve_time;
-        ret = picoquic_load_tokens(quic, test_token_file_name);
-        p_first_token_bis = quic->p_first_token;
-        quic->p_first_token = NULL;
+        ret = picoquic_load_tokens(quic_bis, test_token_file_name);
     }
 
     /* Verify that the two contents match */
     if (ret == 0) {
-        ret = token_store_compare(p_first_token, p_first_token_bis);
+        ret = token_store_compare(quic, quic_bis);
     }
 
     /* Reload after a long time */
     if (ret == 0) {
         simulated_time = too_late_time;
-        ret = picoquic_load_tokens(quic, test_token_file_name);
+        ret = picoquic_load_tokens(quic_ter, test_token_file_name);
 
-        p_first_token_ter = quic->p_first_token;
-        quic->p_first_token = NULL;
-        if (ret == 0 && p_first_token_ter != NULL) {
+        if (ret == 0 && picoquic_get_nb_stored_tokens(quic_ter) != 0) {
             ret = -1;
         }
     }
     /* Free what needs be */
-    picoquic_free_tokens(&p_first_token);
-    picoquic_free_tokens(&p_first_token_bis);
-    picoquic_free_tokens(&p_first_token_ter);
+    if (quic != NULL) {
+        picoquic_free(quic);
+    }
+    if (quic_bis != NULL) {
+        picoquic_free(quic_bis);
+    }
+    if (quic_ter != NULL) {
+        picoquic_free(quic_ter);
+    }
+    return ret;
+}
+
+/* Verify that the token store enforces its size limit, evicting the
+ * tokens closest to expiry first, and that expired tokens are removed.
+ */
+int token_store_expiry_test()
+{
+    int ret = 0;
+    uint64_t simulated_time = 50000000000ull;
+    uint8_t token[64];
+    char sni[64];
+    picoquic_quic_t* quic = picoquic_create(8, NULL, NULL, NULL, NULL, NULL, NULL,
+        NULL, NULL, NULL, 0, &simulated_time, NULL, NULL, 0);
+
+    if (quic == NULL) {
+        ret = -1;
+    }
+    else {
+        picoquic_set_max_stored_tokens(quic, 16);
+    }
+
+    /* Store 32 tokens for different servers, one second apart */
+    for (int i = 0; ret == 0 && i < 32; i++) {
+        size_t sni_length = 0;
+        memset(token, i + 1, sizeof(token));
+        if ((ret = picoquic_sprintf(sni, sizeof(sni), &sni_length, "server%d.example.com", i)) == 0) {
+            ret = picoquic_store_token(quic, sni, (uint16_t)sni_length,
+                test_ip_addr[0].ip_addr, test_ip_addr[0].ip_addr_length, token, sizeof(token));
+        }
+        simulated_time += 1000000;
+    }
+
+    if (ret == 0 && picoquic_get_nb_stored_tokens(quic) != 16) {
+        ret = -1;
+    }
+
+    /* The oldest tokens were evicted, the newest are still present */
+    for (int i = 0; ret == 0 && i < 32; i++) {
+        uint8_t* stored = NULL;
+        uint16_t stored_length = 0;
+        size_t sni_length = 0;
+        int get_ret;
+
+        if ((ret = picoquic_sprintf(sni, sizeof(sni), &sni_length, "server%d.example.com", i)) != 0) {
+            break;
+        }
+        get_ret = picoquic_get_token(quic, sni, (uint16_t)sni_length, NULL, 0, &stored, &stored_length, 0);
+
+        if ((i < 16 && get_ret == 0) || (i >= 16 && (get_ret != 0 || stored_length != sizeof(token) || stored[0] != i + 1))) {
+            ret = -1;
+        }
+        if (stored != NULL) {
+            free(stored);
+        }
+    }
+
+    /* After 24 hours, all tokens have expired */
+    if (ret == 0) {
+        simulated_time += PICOQUIC_TOKEN_DELAY_LONG;
+        picoquic_expire_tokens(quic, picoquic_get_quic_time(quic));
+        if (picoquic_get_nb_stored_tokens(quic) != 0) {
+            ret = -1;
+        }
+    }
 
     if (quic != NULL) {
         picoquic_free(quic);
     }
+
     return ret;
 }
 
@@ -542,6 +611,201 @@ int token_reuse_api_test()
     return ret;
 }
 
+/* Check the shared registry of tickets and tokens. Two contexts are
+ * attached to the same registry: tickets remembered by one are found
+ * by the other, and tokens registered by one are detected as reused by the other.
+ * The same tokens are then checked concurrently from several threads,
+ * each with its own context, and each token shall be accepted exactly once.
+ */
+#define SHARED_REGISTRY_TEST_THREADS 4
+#define SHARED_REGISTRY_TEST_TOKENS 256
+
+typedef struct st_shared_registry_test_thread_t {
+    picoquic_quic_t* quic;
+    uint64_t token_time;
+    int nb_accepted;
+} shared_registry_test_thread_t;
+
+static void shared_registry_test_token(uint8_t* token, size_t token_length, int rank)
+{
+    memset(token, 0, token_length);
+    picoformat_32(token + token_length - 4, (uint32_t)(rank * 0x9E3779B1u));
+    picoformat_32(token + token_length - 8, (uint32_t)rank);
+}
+
+static picoquic_thread_return_t shared_registry_test_thread(void* vctx)
+{
+    shared_registry_test_thread_t* ctx = (shared_registry_test_thread_t*)vctx;
+    uint8_t token[16];
+
+    for (int i = 0; i < SHARED_REGISTRY_TEST_TOKENS; i++) {
+        shared_registry_test_token(token, sizeof(token), 1000 + i);
+        if (picoquic_registered_token_check_reuse(ctx->quic, token, sizeof(token), ctx->token_time) == 0) {
+            ctx->nb_accepted++;
+        }
+    }
+
+    picoquic_thread_do_return;
+}
+
+int shared_registry_test()
+{
+    int ret = 0;
+    uint64_t simulated_time = 1000000;
+    uint64_t ticket_lifetime = 100000000;
+    uint8_t secret[32];
+    uint8_t token[16];
+    uint8_t ip_addr[4] = { 10, 0, 0, 1 };
+    picoquic_issued_ticket_t ticket;
+    picoquic_shared_registry_t* registry;
+    picoquic_quic_t* quic[SHARED_REGISTRY_TEST_THREADS];
+    shared_registry_test_thread_t thread_ctx[SHARED_REGISTRY_TEST_THREADS];
+    picoquic_thread_t thread[SHARED_REGISTRY_TEST_THREADS];
+    int nb_threads = 0;
+
+    memset(quic, 0, sizeof(quic));
+    memset(thread_ctx, 0, sizeof(thread_ctx));
+    memset(secret, 0x5a, sizeof(secret));
+
+    if ((registry = picoquic_shared_registry_create(64, 1024, ticket_lifetime, secret, sizeof(secret))) == NULL) {
+        DBG_PRINTF("%s", "Cannot create shared registry");
+        ret = -1;
+    }
+
+    for (int i = 0; ret == 0 && i < SHARED_REGISTRY_TEST_THREADS; i++) {
+        if ((quic[i] = picoquic_create(4, NULL, NULL, NULL, "test", NULL, NULL, NULL, NULL,
+            NULL, 0, &simulated_time, NULL, NULL, 0)) == NULL ||
+            picoquic_attach_shared_registry(quic[i], registry) != 0) {
+            DBG_PRINTF("Cannot attach context %d to shared registry", i);
+            ret = -1;
+        }
+    }
+
+    if (registry != NULL) {
+        /* The contexts now hold their own references */
+        picoquic_shared_registry_release(registry);
+    }
+
+    /* Tickets remembered in one context are visible in the other */
+    if (ret == 0 && (picoquic_remember_issued_ticket(quic[0], 12345, 20000, 150000, ip_addr, 4) != 0 ||
+        picoquic_retrieve_issued_ticket(quic[1], 12345, &ticket) != 0 ||
+        ticket.rtt != 20000 || ticket.cwin != 150000 || ticket.ip_addr_length != 4 ||
+        memcmp(ticket.ip_addr, ip_addr, 4) != 0)) {
+        DBG_PRINTF("%s", "Shared ticket not found");
+        ret = -1;
+    }
+
+    /* Tokens registered in one context are reused if presented to another */
+    if (ret == 0) {
+        shared_registry_test_token(token, sizeof(token), 1);
+        if (picoquic_registered_token_check_reuse(quic[0], token, sizeof(token), simulated_time + 1000000) != 0 ||
+            picoquic_registered_token_check_reuse(quic[1], token, sizeof(token), simulated_time + 1000000) == 0) {
+            DBG_PRINTF("%s", "Shared token reuse not detected");
+            ret = -1;
+        }
+    }
+
+    /* The number of tickets is bounded */
+    for (uint64_t i = 0; ret == 0 && i < 1024; i++) {
+        ret = picoquic_remember_issued_ticket(quic[i % SHARED_REGISTRY_TEST_THREADS], 100000 + i, 20000, 150000, ip_addr, 4);
+    }
+    for (int i = 0; ret == 0 && i < PICOQUIC_SHARED_REGISTRY_STRIPES; i++) {
+        if (quic[0]->shared_registry->stripe[i].table_issued_tickets_nb > quic[0]->shared_registry->max_tickets_per_stripe) {
+            DBG_PRINTF("Too many tickets in stripe %d", i);
+            ret = -1;
+        }
+    }
+
+    /* Tickets are evicted after their lifetime */
+    if (ret == 0) {
+        simulated_time += ticket_lifetime + 1;
+        if (picoquic_retrieve_issued_ticket(quic[1], 100000 + 1023, &ticket) == 0) {
+            DBG_PRINTF("%s", "Ticket not evicted after lifetime");
+            ret = -1;
+        }
+    }
+
+    /* A lifetime of zero or UINT64_MAX never evicts tickets */
+    for (int i = 0; ret == 0 && i < 2; i++) {
+        picoquic_shared_registry_t* forever = picoquic_shared_registry_create(64, 1024,
+            (i == 0) ? 0 : UINT64_MAX, secret, sizeof(secret));
+
+        if (forever == NULL) {
+            ret = -1;
+        }
+        else {
+            if (picoquic_shared_registry_remember_ticket(forever, 54321, 20000, 150000, ip_addr, 4, 1000000) != 0 ||
+                picoquic_shared_registry_retrieve_ticket(forever, 54321, &ticket, UINT64_MAX / 2) != 0) {
+                DBG_PRINTF("Ticket evicted with lifetime %s", (i == 0) ? "0" : "UINT64_MAX");
+                ret = -1;
+            }
+            picoquic_shared_registry_release(forever);
+        }
+    }
+
+    /* With one token per stripe, a full stripe rejects new tokens instead
+     * of forgetting a registered one, until that one expires */
+    if (ret == 0) {
+        picoquic_shared_registry_t* small = picoquic_shared_registry_create(64, PICOQUIC_SHARED_REGISTRY_STRIPES,
+            ticket_lifetime, secret, sizeof(secret));
+
+        if (small == NULL) {
+            ret = -1;
+        }
+        else {
+            uint8_t token_b[16];
+
+            memset(token, 0, sizeof(token));
+            memset(token_b, 0, sizeof(token_b));
+            picoformat_64(token + sizeof(token) - 8, 3);
+            picoformat_64(token_b + sizeof(token_b) - 8, 3 + PICOQUIC_SHARED_REGISTRY_STRIPES);
+            if (picoquic_shared_registry_check_reuse(small, token, sizeof(token), 2000000, 1000000) != 0 ||
+                picoquic_shared_registry_check_reuse(small, token_b, sizeof(token_b), 3000000, 1000000) == 0 ||
+                picoquic_shared_registry_check_reuse(small, token, sizeof(token), 2000000, 1000000) == 0 ||
+                picoquic_shared_registry_check_reuse(small, token_b, sizeof(token_b), 3000000, 2000001) != 0) {
+                DBG_PRINTF("%s", "Full token stripe not handled as expected");
+                ret = -1;
+            }
+            picoquic_shared_registry_release(small);
+        }
+    }
+
+    /* Concurrent token checks, each token accepted exactly once */
+    for (int i = 0; ret == 0 && i < SHARED_REGISTRY_TEST_THREADS; i++) {
+        thread_ctx[i].quic = quic[i];
+        thread_ctx[i].token_time = simulated_time + 1000000;
+        if ((ret = picoquic_create_thread(&thread[i], shared_registry_test_thread, &thread_ctx[i])) != 0) {
+            DBG_PRINTF("Create thread returns %d (0x%x)", ret, ret);
+        }
+        else {
+            nb_threads++;
+        }
+    }
+
+    for (int i = 0; i < nb_threads; i++) {
+        picoquic_delete_thread(&thread[i]);
+    }
+
+    if (ret == 0) {
+        int nb_accepted = 0;
+        for (int i = 0; i < SHARED_REGISTRY_TEST_THREADS; i++) {
+            nb_accepted += thread_ctx[i].nb_accepted;
+        }
+        if (nb_accepted != SHARED_REGISTRY_TEST_TOKENS) {
+            DBG_PRINTF("Only %d tokens accepted out of %d", nb_accepted, SHARED_REGISTRY_TEST_TOKENS);
+            ret = -1;
+        }
+    }
+
+    for (int i = 0; i < SHARED_REGISTRY_TEST_THREADS; i++) {
+        if (quic[i] != NULL) {
+            picoquic_free(quic[i]);
+        }
+    }
+
+    return ret;
+}
+
 /* Ticket seed. Do a connection, and verify that server and client have properly
  * documented the congestion parameters in the outgoing or incoming tickets
  */
@@ -617,13 +881,17 @@ int ticket_seed_test_one(int bdp_option)
     if (ret == 0) {
         /* Check the issued tickets list at the server. */
         picoquic_issued_ticket_t* server_ticket;
+        picoquic_issued_ticket_t server_ticket_copy;
 
         if (test_ctx->cnx_server == NULL) {
             server_ticket = test_ctx->qserver->table_issued_tickets_first;
         }
+        else if (picoquic_retrieve_issued_ticket(test_ctx->qserver,
+            test_ctx->cnx_server->issued_ticket_id, &server_ticket_copy) == 0) {
+            server_ticket = &server_ticket_copy;
+        }
         else {
-            server_ticket = picoquic_retrieve_issued_ticket(test_ctx->qserver,
-                test_ctx->cnx_server->issued_ticket_id);
+            server_ticket = NULL;
         }
         if (server_ticket == NULL) {
             DBG_PRINTF("%s", "No ticket found for server.");
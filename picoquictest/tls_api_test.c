@@ -32,9 +32,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include "picoquic_binlog.h"
+#include "logreader.h"
+#include "cidset.h"
 #include "csv.h"
 #include "qlog.h"
 #include "autoqlog.h"
+#include "logbatch.h"
 #include "picoquic_logger.h"
 #include "performance_log.h"
 #include "picoquictest.h"
@@ -1406,7 +1409,7 @@ static void tls_api_static_departure(picoquic_test_tls_api_ctx_t* test_ctx,
                 (struct sockaddr*)&test_ctx->client_addr_2,
                 test_ctx->s_to_c_link, test_ctx->s_to_c_link_2);
         }
-        picoquic_delete_stateless_packet(sp);
+        picoquic_delete_stateless_packet(test_ctx->qserver, sp);
     }
 }
 
@@ -3829,6 +3832,209 @@ int tls_api_retry_large_test()
 {
     return tls_api_retry_test_one(1);
 }
+
+/*
+ * Verify the stateless retry fast path used when the server requires address
+ * validation: a flood of token-less Initial packets shall be answered with valid
+ * Retry packets without creating any connection context, the stateless packets
+ * shall be recycled, and the queue of pending packets shall remain bounded.
+ */
+
+static size_t tls_api_retry_flood_initial(uint8_t* bytes, picoquic_connection_id_t* dcid,
+    picoquic_connection_id_t* scid, uint32_t rank)
+{
+    size_t byte_index = 0;
+    size_t length_index;
+
+    for (int i = 0; i < 8; i++) {
+        dcid->id[i] = (uint8_t)(rank >> (8 * (i % 4))) ^ (uint8_t)(0x11 * i);
+        scid->id[i] = (uint8_t)(rank >> (8 * (i % 4))) ^ (uint8_t)(0x5A + i);
+    }
+    dcid->id_len = 8;
+    scid->id_len = 8;
+
+    bytes[byte_index++] = picoquic_create_long_packet_type(picoquic_packet_initial, 0);
+    picoformat_32(&bytes[byte_index], PICOQUIC_V1_VERSION);
+    byte_index += 4;
+    bytes[byte_index++] = dcid->id_len;
+    byte_index += picoquic_format_connection_id(&bytes[byte_index], PICOQUIC_MAX_PACKET_SIZE - byte_index, *dcid);
+    bytes[byte_index++] = scid->id_len;
+    byte_index += picoquic_format_connection_id(&bytes[byte_index], PICOQUIC_MAX_PACKET_SIZE - byte_index, *scid);
+    /* No token */
+    bytes[byte_index++] = 0;
+    /* Payload length on 2 bytes, then 4 bytes of packet number and padding */
+    length_index = byte_index;
+    byte_index += 2;
+    memset(&bytes[byte_index], 0, PICOQUIC_ENFORCED_INITIAL_MTU - byte_index);
+    bytes[length_index] = (uint8_t)(0x40 | ((PICOQUIC_ENFORCED_INITIAL_MTU - byte_index) >> 8));
+    bytes[length_index + 1] = (uint8_t)((PICOQUIC_ENFORCED_INITIAL_MTU - byte_index) & 0xFF);
+
+    return PICOQUIC_ENFORCED_INITIAL_MTU;
+}
+
+static int tls_api_retry_flood_check(picoquic_quic_t* qserver, picoquic_stateless_packet_t* sp,
+    picoquic_connection_id_t* dcid, picoquic_connection_id_t* scid, uint64_t current_time)
+{
+    int ret = 0;
+    size_t byte_index = 0;
+    size_t length = sp->length;
+    picoquic_connection_id_t retry_dcid;
+    picoquic_connection_id_t retry_scid;
+    picoquic_connection_id_t odcid;
+    void* integrity_aead = picoquic_find_retry_protection_context_ex(qserver, 0, 0);
+    int is_new_token = 0;
+
+    if (length < 7 + 16 || sp->bytes[0] != picoquic_create_long_packet_type(picoquic_packet_retry, 0) ||
+        PICOPARSE_32(&sp->bytes[1]) != PICOQUIC_V1_VERSION) {
+        ret = -1;
+    }
+    else {
+        byte_index = 5;
+        byte_index += 1 + picoquic_parse_connection_id(&sp->bytes[byte_index + 1], sp->bytes[byte_index], &retry_dcid);
+        byte_index += 1 + picoquic_parse_connection_id(&sp->bytes[byte_index + 1], sp->bytes[byte_index], &retry_scid);
+
+        if (picoquic_compare_connection_id(&retry_dcid, scid) != 0 ||
+            retry_scid.id_len != qserver->local_cnxid_length) {
+            ret = -1;
+        }
+        else if (integrity_aead == NULL ||
+            picoquic_verify_retry_protection(integrity_aead, sp->bytes, &length, byte_index, dcid) != 0) {
+            ret = -1;
+        }
+        else if (picoquic_verify_retry_token(qserver, (struct sockaddr*)&sp->addr_to, current_time, &is_new_token,
+            &odcid, &retry_scid, 1, sp->bytes + byte_index, length - byte_index, 0) != 0 ||
+            picoquic_compare_connection_id(&odcid, dcid) != 0) {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+int tls_api_retry_flood_test()
+{
+    uint64_t simulated_time = 0;
+    uint64_t loss_mask = 0;
+    const uint32_t nb_initials = PICOQUIC_MAX_PENDING_STATELESS + 64;
+    picoquic_test_tls_api_ctx_t* test_ctx = NULL;
+    int ret = tls_api_init_ctx(&test_ctx, 0, PICOQUIC_TEST_SNI, PICOQUIC_TEST_ALPN, &simulated_time, NULL, NULL, 0, 1, 0);
+
+    if (ret == 0) {
+        picoquic_set_cookie_mode(test_ctx->qserver, 1);
+    }
+
+    /* Send a flood of initial packets, draining the queue as a server would */
+    for (uint32_t i = 0; ret == 0 && i < 256; i++) {
+        uint8_t bytes[PICOQUIC_MAX_PACKET_SIZE];
+        struct sockaddr_in addr_from = { 0 };
+        picoquic_connection_id_t dcid;
+        picoquic_connection_id_t scid;
+        size_t length = tls_api_retry_flood_initial(bytes, &dcid, &scid, i);
+        picoquic_stateless_packet_t* sp;
+
+        addr_from.sin_family = AF_INET;
+#ifdef _WINDOWS
+        addr_from.sin_addr.S_un.S_addr = htonl(0x0A010000 + i);
+#else
+        addr_from.sin_addr.s_addr = htonl(0x0A010000 + i);
+#endif
+        addr_from.sin_port = htons(5000 + (uint16_t)i);
+
+        (void)picoquic_incoming_packet(test_ctx->qserver, bytes, length, (struct sockaddr*)&addr_from,
+            (struct sockaddr*)&test_ctx->server_addr, 0, 0, simulated_time);
+
+        if (test_ctx->qserver->cnx_list != NULL || test_ctx->qserver->nb_fast_retry_sent != (uint64_t)i + 1) {
+            DBG_PRINTF("Initial %u: connection created or no fast retry", i);
+            ret = -1;
+        }
+        else if ((sp = picoquic_dequeue_stateless_packet(test_ctx->qserver)) == NULL) {
+            DBG_PRINTF("Initial %u: no retry queued", i);
+            ret = -1;
+        }
+        else {
+            if (tls_api_retry_flood_check(test_ctx->qserver, sp, &dcid, &scid, simulated_time) != 0) {
+                DBG_PRINTF("Initial %u: invalid retry", i);
+                ret = -1;
+            }
+            picoquic_delete_stateless_packet(test_ctx->qserver, sp);
+        }
+        simulated_time += 10;
+    }
+
+    /* The stateless packets are recycled in the preallocated block */
+    if (ret == 0 && (test_ctx->qserver->stateless_packet_block == NULL ||
+        test_ctx->qserver->nb_stateless_in_pool != PICOQUIC_MAX_PENDING_STATELESS)) {
+        DBG_PRINTF("Expected %d packets in pool, got %zu", PICOQUIC_MAX_PENDING_STATELESS,
+            test_ctx->qserver->nb_stateless_in_pool);
+        ret = -1;
+    }
+
+    /* Without draining, the queue of pending packets remains bounded */
+    for (uint32_t i = 0; ret == 0 && i < nb_initials; i++) {
+        uint8_t bytes[PICOQUIC_MAX_PACKET_SIZE];
+        struct sockaddr_in addr_from = { 0 };
+        picoquic_connection_id_t dcid;
+        picoquic_connection_id_t scid;
+        size_t length = tls_api_retry_flood_initial(bytes, &dcid, &scid, 0x10000 + i);
+
+        addr_from.sin_family = AF_INET;
+#ifdef _WINDOWS
+        addr_from.sin_addr.S_un.S_addr = htonl(0x0A020000 + i);
+#else
+        addr_from.sin_addr.s_addr = htonl(0x0A020000 + i);
+#endif
+        addr_from.sin_port = htons(5000);
+
+        (void)picoquic_incoming_packet(test_ctx->qserver, bytes, length, (struct sockaddr*)&addr_from,
+            (struct sockaddr*)&test_ctx->server_addr, 0, 0, simulated_time);
+    }
+
+    if (ret == 0 && (test_ctx->qserver->cnx_list != NULL ||
+        test_ctx->qserver->nb_pending_stateless != PICOQUIC_MAX_PENDING_STATELESS ||
+        test_ctx->qserver->nb_fast_retry_dropped != nb_initials - PICOQUIC_MAX_PENDING_STATELESS)) {
+        DBG_PRINTF("Expected %d pending packets, got %zu, %" PRIu64 " dropped", PICOQUIC_MAX_PENDING_STATELESS,
+            test_ctx->qserver->nb_pending_stateless, test_ctx->qserver->nb_fast_retry_dropped);
+        ret = -1;
+    }
+
+    /* Drain the queue, then verify that a legitimate client still gets through */
+    while (ret == 0) {
+        picoquic_stateless_packet_t* sp = picoquic_dequeue_stateless_packet(test_ctx->qserver);
+        if (sp == NULL) {
+            break;
+        }
+        picoquic_delete_stateless_packet(test_ctx->qserver, sp);
+    }
+
+    if (ret == 0 && (test_ctx->qserver->nb_pending_stateless != 0 ||
+        test_ctx->qserver->nb_stateless_in_pool != PICOQUIC_MAX_PENDING_STATELESS)) {
+        ret = -1;
+    }
+
+    if (ret == 0) {
+        ret = picoquic_start_client_cnx(test_ctx->cnx_client);
+    }
+
+    if (ret == 0) {
+        ret = tls_api_connection_loop(test_ctx, &loss_mask, 0, &simulated_time);
+    }
+
+    if (ret == 0 && test_ctx->cnx_client->original_cnxid.id_len == 0) {
+        DBG_PRINTF("%s", "Client connection did not go through retry");
+        ret = -1;
+    }
+
+    if (ret == 0) {
+        ret = tls_api_attempt_to_close(test_ctx, &simulated_time);
+    }
+
+    if (test_ctx != NULL) {
+        tls_api_delete_ctx(test_ctx);
+        test_ctx = NULL;
+    }
+
+    return ret;
+}
 /*
 * verify that a connection is correctly established
 * if the client does not initially provide a key share
@@ -5539,6 +5745,131 @@ int bad_client_certificate_test()
     return ret;
 }
 
+/*
+ * Verify that several QUIC contexts can share a TLS master context: the
+ * certificate chain and signer are not copied, tickets and tokens issued by
+ * one context are accepted by the other, and connections succeed.
+ */
+int tls_master_shared_test()
+{
+    uint64_t simulated_time = 0;
+    uint64_t loss_mask = 0;
+    picoquic_test_tls_api_ctx_t* test_ctx = NULL;
+    picoquic_tls_master_t* master = NULL;
+    picoquic_quic_t* qother = NULL;
+    char test_server_cert_file[512];
+    char test_server_key_file[512];
+    char test_server_cert_store_file[512];
+    int ret = picoquic_get_input_path(test_server_cert_file, sizeof(test_server_cert_file), picoquic_solution_dir, PICOQUIC_TEST_FILE_SERVER_CERT);
+
+    if (ret == 0) {
+        ret = picoquic_get_input_path(test_server_key_file, sizeof(test_server_key_file), picoquic_solution_dir, PICOQUIC_TEST_FILE_SERVER_KEY);
+    }
+
+    if (ret == 0) {
+        ret = picoquic_get_input_path(test_server_cert_store_file, sizeof(test_server_cert_store_file), picoquic_solution_dir, PICOQUIC_TEST_FILE_CERT_STORE);
+    }
+
+    if (ret != 0) {
+        DBG_PRINTF("%s", "Cannot set the cert, key or store file names.\n");
+    }
+    else if ((master = picoquic_tls_master_create(test_server_cert_file, test_server_key_file, test_server_cert_store_file,
+        test_ticket_encrypt_key, sizeof(test_ticket_encrypt_key))) == NULL) {
+        DBG_PRINTF("%s", "Cannot create the shared TLS master context.\n");
+        ret = -1;
+    }
+    else {
+        ret = tls_api_init_ctx(&test_ctx, 0, PICOQUIC_TEST_SNI, PICOQUIC_TEST_ALPN, &simulated_time, NULL, NULL, 0, 0, 0);
+    }
+
+    if (ret == 0 && test_ctx == NULL) {
+        ret = -1;
+    }
+
+    /* Replace the server context by two contexts sharing the master */
+    if (ret == 0) {
+        picoquic_free(test_ctx->qserver);
+        test_ctx->qserver = picoquic_create_with_tls_master(master, 8, PICOQUIC_TEST_ALPN,
+            test_api_callback, (void*)&test_ctx->server_callback, NULL, NULL, NULL,
+            simulated_time, &simulated_time, NULL);
+        qother = picoquic_create_with_tls_master(master, 8, PICOQUIC_TEST_ALPN,
+            test_api_callback, NULL, NULL, NULL, NULL,
+            simulated_time, &simulated_time, NULL);
+
+        if (test_ctx->qserver == NULL || qother == NULL) {
+            ret = -1;
+        }
+        else {
+            picoquic_set_random_initial(test_ctx->qserver, 0);
+            picoquic_set_optimistic_ack_policy(test_ctx->qserver, 0);
+        }
+    }
+
+    /* The contexts hold their own references, the creator can release its one */
+    if (master != NULL) {
+        picoquic_tls_master_release(master);
+        master = NULL;
+    }
+
+    /* Certificates and signer are shared, not copied */
+    if (ret == 0) {
+        ptls_context_t* ctx1 = (ptls_context_t*)test_ctx->qserver->tls_master_ctx;
+        ptls_context_t* ctx2 = (ptls_context_t*)qother->tls_master_ctx;
+
+        if (test_ctx->qserver->enforce_client_only || ctx1->certificates.count == 0 ||
+            ctx1->certificates.list != ctx2->certificates.list ||
+            ctx1->sign_certificate != ctx2->sign_certificate ||
+            ctx1->verify_certificate != ctx2->verify_certificate ||
+            ctx1 == ctx2) {
+            DBG_PRINTF("%s", "TLS master objects are not shared as expected.\n");
+            ret = -1;
+        }
+    }
+
+    /* A token issued by one context is accepted by the other */
+    if (ret == 0) {
+        uint8_t token[256];
+        size_t token_length = 0;
+        int is_new_token = 0;
+        picoquic_connection_id_t odcid = { { 1, 2, 3, 4, 5, 6, 7, 8 }, 8 };
+        picoquic_connection_id_t rcid = { { 8, 7, 6, 5, 4, 3, 2, 1 }, 8 };
+        picoquic_connection_id_t decoded_odcid;
+
+        if (picoquic_prepare_retry_token(qother, (struct sockaddr*)&test_ctx->client_addr,
+            simulated_time + PICOQUIC_TOKEN_DELAY_SHORT, &odcid, &rcid, 0, token, sizeof(token), &token_length) != 0 ||
+            picoquic_verify_retry_token(test_ctx->qserver, (struct sockaddr*)&test_ctx->client_addr,
+                simulated_time, &is_new_token, &decoded_odcid, &rcid, 1, token, token_length, 0) != 0 ||
+            picoquic_compare_connection_id(&odcid, &decoded_odcid) != 0) {
+            DBG_PRINTF("%s", "Token not accepted across shared contexts.\n");
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        ret = picoquic_start_client_cnx(test_ctx->cnx_client);
+    }
+
+    if (ret == 0) {
+        ret = tls_api_connection_loop(test_ctx, &loss_mask, 0, &simulated_time);
+    }
+
+    if (ret == 0) {
+        ret = tls_api_attempt_to_close(test_ctx, &simulated_time);
+    }
+
+    /* Deleting the contexts in any order releases the master exactly once */
+    if (qother != NULL) {
+        picoquic_free(qother);
+    }
+
+    if (test_ctx != NULL) {
+        tls_api_delete_ctx(test_ctx);
+        test_ctx = NULL;
+    }
+
+    return ret;
+}
+
 /*
 * NAT Rebinding test. The client is unaware of the migration.
 * Start with one basic transmission, then switch the client
@@ -8549,6 +8880,8 @@ int packet_trace_test()
 #define QLOG_TRACE_QLOG "qlog_trace.qlog"
 #define QLOG_TRACE_ECN_QLOG "qlog_trace_ecn.qlog"
 #define QLOG_TRACE_AUTO_QLOG "0102030405060708.server.qlog"
+#define QLOG_TRACE_BATCH_QLOG "0102030405060708.qlog"
+#define QLOG_TRACE_BATCH_DUP_QLOG "0102030405060708.1.qlog"
 
 void qlog_trace_cid_fn(picoquic_quic_t* quic, picoquic_connection_id_t cnx_id_local,
     picoquic_connection_id_t cnx_id_remote, void* cnx_id_cb_data, picoquic_connection_id_t* cnx_id_returned)
@@ -8567,7 +8900,15 @@ void qlog_trace_cid_fn(picoquic_quic_t* quic, picoquic_connection_id_t cnx_id_lo
     }
 }
 
-int qlog_trace_test_one(int auto_qlog, int keep_binlog, uint8_t recv_ecn)
+#define QLOG_TRACE_OPTION_BACKGROUND 1
+#define QLOG_TRACE_OPTION_RING 2
+#define QLOG_TRACE_OPTION_SEGMENT 4
+#define QLOG_TRACE_OPTION_COMPACT 8
+#define QLOG_TRACE_OPTION_THRESHOLD 16
+#define QLOG_TRACE_OPTION_BATCH 32
+#define QLOG_TRACE_SEGMENT_BIN "binlog.0.log"
+
+int qlog_trace_test_one(int auto_qlog, int keep_binlog, uint8_t recv_ecn, int log_options)
 {
     uint64_t simulated_time = 0;
     picoquic_test_tls_api_ctx_t* test_ctx = NULL;
@@ -8578,6 +8919,17 @@ int qlog_trace_test_one(int auto_qlog, int keep_binlog, uint8_t recv_ecn)
     uint8_t reset_seed_client[PICOQUIC_RESET_SECRET_SIZE] = { 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25 };
     uint8_t reset_seed_server[PICOQUIC_RESET_SECRET_SIZE] = { 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35 };
     char const* qlog_target = (auto_qlog) ? QLOG_TRACE_AUTO_QLOG : ((recv_ecn != 0) ? QLOG_TRACE_ECN_QLOG : QLOG_TRACE_QLOG);
+    char const* binlog_name = ((log_options & QLOG_TRACE_OPTION_SEGMENT) != 0) ? QLOG_TRACE_SEGMENT_BIN : QLOG_TRACE_BIN;
+
+    if ((log_options & QLOG_TRACE_OPTION_BATCH) != 0) {
+        qlog_target = QLOG_TRACE_BATCH_QLOG;
+        (void)picoquic_file_delete(QLOG_TRACE_BATCH_DUP_QLOG, NULL);
+    }
+
+    if ((log_options & QLOG_TRACE_OPTION_SEGMENT) != 0) {
+        /* Segments of previous runs are not overwritten */
+        (void)picoquic_file_delete(QLOG_TRACE_SEGMENT_BIN, NULL);
+    }
 
     if (ret == 0 && test_ctx == NULL) {
         ret = -1;
@@ -8587,7 +8939,7 @@ int qlog_trace_test_one(int auto_qlog, int keep_binlog, uint8_t recv_ecn)
         ret = -1;
     }
 
-    (void)picoquic_file_delete(QLOG_TRACE_BIN, NULL);
+    (void)picoquic_file_delete(binlog_name, NULL);
     (void)picoquic_file_delete(qlog_target, NULL);
 
     /* Set the logging policy on the server side, to store data in the
@@ -8597,10 +8949,34 @@ int qlog_trace_test_one(int auto_qlog, int keep_binlog, uint8_t recv_ecn)
         test_ctx->recv_ecn_server = recv_ecn;
         if (auto_qlog) {
             picoquic_set_qlog(test_ctx->qserver, ".");
+            if ((log_options & QLOG_TRACE_OPTION_BACKGROUND) != 0 &&
+                picoquic_set_qlog_background(test_ctx->qserver, 4, picoquic_qlog_queue_full_inline) != 0) {
+                DBG_PRINTF("%s", "Cannot start the qlog background worker.\n");
+                ret = -1;
+            }
         }
         if (keep_binlog) {
             picoquic_set_binlog(test_ctx->qserver, ".");
         }
+        if ((log_options & QLOG_TRACE_OPTION_RING) != 0 &&
+            picoquic_set_binlog_ring(test_ctx->qserver, 1 << 20) != 0) {
+            DBG_PRINTF("%s", "Cannot start the binlog ring writer.\n");
+            ret = -1;
+        }
+        if ((log_options & QLOG_TRACE_OPTION_SEGMENT) != 0 &&
+            picoquic_set_binlog_segments(test_ctx->qserver, 1 << 24) != 0) {
+            DBG_PRINTF("%s", "Cannot start the binlog segments.\n");
+            ret = -1;
+        }
+        picoquic_set_binlog_compact(test_ctx->qserver, (log_options & QLOG_TRACE_OPTION_COMPACT) != 0);
+        if ((log_options & QLOG_TRACE_OPTION_THRESHOLD) != 0) {
+            picoquic_binlog_policy_t policy;
+
+            memset(&policy, 0, sizeof(policy));
+            policy.recorder_depth = 1 << 16;
+            policy.rtt_threshold = 1;
+            picoquic_set_binlog_policy(test_ctx->qserver, &policy);
+        }
         picoquic_set_default_spinbit_policy(test_ctx->qserver, picoquic_spinbit_on);
         picoquic_set_default_spinbit_policy(test_ctx->qclient, picoquic_spinbit_on);
         picoquic_set_default_lossbit_policy(test_ctx->qserver, picoquic_lossbit_send_receive);
@@ -8650,16 +9026,30 @@ int qlog_trace_test_one(int auto_qlog, int keep_binlog, uint8_t recv_ecn)
         test_ctx = NULL;
     }
 
-    /* Create a QLOG file from the .bin log file */
-    if (ret == 0 && !auto_qlog) {
+    /* Create a QLOG file from the .bin log file. In batch mode, the file
+     * is listed twice, and the second conversion gets a distinct name. */
+    if (ret == 0 && (log_options & QLOG_TRACE_OPTION_BATCH) != 0) {
+        char const* batch_names[2] = { binlog_name, binlog_name };
+        binlog_batch_stats_t stats;
+
+        ret = binlog_batch_convert(batch_names, 2, ".", binlog_batch_format_qlog, 2, &stats);
+        if (ret == 0 && (stats.nb_files != 2 || stats.nb_connections != 2 || stats.nb_errors != 0)) {
+            DBG_PRINTF("Batch converted %" PRIst " connections from %" PRIst " files\n", stats.nb_connections, stats.nb_files);
+            ret = -1;
+        }
+        if (ret == 0) {
+            ret = picoquic_test_compare_text_files(QLOG_TRACE_BATCH_DUP_QLOG, qlog_target);
+        }
+    }
+    else if (ret == 0 && !auto_qlog) {
         uint64_t log_time = 0;
         uint16_t flags;
-        FILE* f_binlog = picoquic_open_cc_log_file_for_read(QLOG_TRACE_BIN, &flags, &log_time);
+        FILE* f_binlog = picoquic_open_cc_log_file_for_read(binlog_name, &flags, &log_time);
         if (f_binlog == NULL) {
             ret = -1;
         }
         else {
-            ret = qlog_convert(&initial_cid, f_binlog, QLOG_TRACE_BIN, qlog_target, NULL, flags);
+            ret = qlog_convert(&initial_cid, f_binlog, binlog_name, qlog_target, NULL, flags);
             picoquic_file_close(f_binlog);
         }
     }
@@ -8685,225 +9075,1303 @@ int qlog_trace_test_one(int auto_qlog, int keep_binlog, uint8_t recv_ecn)
 
 int qlog_trace_test()
 {
-    return qlog_trace_test_one(0, 1, 0);
+    return qlog_trace_test_one(0, 1, 0, 0);
 }
 
 int qlog_trace_only_test()
 {
-    return qlog_trace_test_one(1, 0, 0);
+    return qlog_trace_test_one(1, 0, 0, 0);
 }
 
 int qlog_trace_auto_test()
 {
-    return qlog_trace_test_one(1, 1, 0);
+    return qlog_trace_test_one(1, 1, 0, 0);
 }
 
 int qlog_trace_ecn_test()
 {
-    return qlog_trace_test_one(0, 1, 0x02);
+    return qlog_trace_test_one(0, 1, 0x02, 0);
 }
 
-/*
- * Test of the performance log production
+/* Same as qlog_trace_only, but the conversion runs in the background
+ * worker. The queued conversion completes when the server context is
+ * freed, so the qlog file can be compared as in the synchronous case.
  */
+int qlog_trace_background_test()
+{
+    return qlog_trace_test_one(1, 0, 0, QLOG_TRACE_OPTION_BACKGROUND);
+}
 
-#ifdef _WINDOWS
-#define PERF_TRACE_CLIENT_TEST_REF "picoquictest\\perf_trace_client_ref.txt"
-#define PERF_TRACE_SERVER_TEST_REF "picoquictest\\perf_trace_server_ref.txt"
-#else
-#define PERF_TRACE_CLIENT_TEST_REF "picoquictest/perf_trace_client_ref.txt"
-#define PERF_TRACE_SERVER_TEST_REF "picoquictest/perf_trace_server_ref.txt"
-#endif
-#define PERF_TRACE_CLIENT "perf_trace_client.csv"
-#define PERF_TRACE_SERVER "perf_trace_server.csv"
+/* Same as qlog_trace_auto, but the binary log is written through the
+ * ring buffer and the writer thread. The qlog conversion is deferred
+ * until the writer has closed the file, so the result must not differ
+ * from the synchronous case.
+ */
+int qlog_trace_ring_test()
+{
+    return qlog_trace_test_one(1, 1, 0, QLOG_TRACE_OPTION_RING);
+}
 
-static int perflog_set_version(char const * buffer2, char * buffer3, size_t buffer3_len)
+/* Same as qlog_trace, but the binary log is written to a log segment,
+ * and the qlog is converted from the segment through its index.
+ */
+int qlog_trace_segment_test()
 {
-    size_t i2 = 0;
-    size_t i3 = 0;
-    int ret = 0;
+    return qlog_trace_test_one(0, 1, 0, QLOG_TRACE_OPTION_SEGMENT);
+}
 
-    while (ret == 0 && buffer2[i2] != 0) {
-        if (buffer2[i2] == '$' && buffer2[i2 + 1] == 'V') {
-            char const* v = PICOQUIC_VERSION;
-            size_t v_len = strlen(v);
-            i2 += 2;
-            if (i3 + v_len < buffer3_len) {
-                memcpy(buffer3 + i3, v, v_len);
-                i3 += v_len;
-            }
-            else {
-                ret = -1;
-            }
-        }
-        else {
-            if (i3 < buffer3_len) {
-                buffer3[i3] = buffer2[i2];
-                i3++;
-                i2++;
-            }
-            else {
-                ret = -1;
-            }
-        }
-    }
-    if (ret == 0) {
-        if (i3 < buffer3_len) {
-            buffer3[i3] = 0;
-        }
-        else {
-            buffer3[buffer3_len - 1] = 0;
-            ret = -1;
-        }
-    }
-    return(ret);
+/* Same as qlog_trace, but with the compact binary log format, written to
+ * a per connection file or to a log segment.
+ */
+int qlog_trace_compact_test()
+{
+    return qlog_trace_test_one(0, 1, 0, QLOG_TRACE_OPTION_COMPACT);
 }
 
-static int perflog_compare(const char* fname1, const char* fname2)
+int qlog_trace_compact_segment_test()
 {
-    int ret = 0;
-    int nb_line = 0;
-    FILE* F1 = picoquic_file_open(fname1, "r");
+    return qlog_trace_test_one(0, 1, 0, QLOG_TRACE_OPTION_COMPACT | QLOG_TRACE_OPTION_SEGMENT);
+}
+
+/* Same as qlog_trace, but the events are kept in the flight recorder until
+ * the RTT threshold is crossed. The recorded events are then written to
+ * the log, which must not differ from the log written directly.
+ */
+int qlog_trace_threshold_test()
+{
+    return qlog_trace_test_one(0, 1, 0, QLOG_TRACE_OPTION_THRESHOLD);
+}
+
+/* Same as qlog_trace, but the qlog is produced by the parallel batch
+ * converter, as in "picolog -b".
+ */
+int qlog_trace_batch_test()
+{
+    return qlog_trace_test_one(0, 1, 0, QLOG_TRACE_OPTION_BATCH);
+}
+
+/* Compare the cost of logging every packet of a sustained transfer with
+ * no binary log, with the synchronous binary log, and with the binary log
+ * written through the ring buffer. The times and the number of records
+ * dropped by the ring are only reported, the test fails if a transfer
+ * fails or if nothing went through the ring.
+ */
+#define BINLOG_RING_BENCH_NONE 0
+#define BINLOG_RING_BENCH_SYNC 1
+#define BINLOG_RING_BENCH_RING 2
+
+static int binlog_ring_bench_one(int mode, uint64_t* elapsed, uint64_t* nb_packets)
+{
+    uint64_t simulated_time = 0;
+    uint64_t start_time = 0;
+    picoquic_test_tls_api_ctx_t* test_ctx = NULL;
+    char log_name[2 * PICOQUIC_CONNECTION_ID_MAX_SIZE + 16];
+    int ret = tls_api_init_ctx(&test_ctx, 0, PICOQUIC_TEST_SNI, PICOQUIC_TEST_ALPN, &simulated_time, NULL, NULL, 0, 1, 0);
+
+    log_name[0] = 0;
+    *elapsed = 0;
+    *nb_packets = 0;
+
+    if (ret == 0 && test_ctx == NULL) {
+        ret = -1;
+    }
+
+    if (ret == 0) {
+        if (mode != BINLOG_RING_BENCH_NONE) {
+            picoquic_set_binlog(test_ctx->qserver, ".");
+            picoquic_set_log_level(test_ctx->qserver, 1);
+        }
+        if (mode == BINLOG_RING_BENCH_RING) {
+            ret = picoquic_set_binlog_ring(test_ctx->qserver, 1 << 22);
+        }
+    }
+
+    if (ret == 0) {
+        start_time = picoquic_current_time();
+        ret = tls_api_one_scenario_body(test_ctx, &simulated_time,
+            test_scenario_sustained, sizeof(test_scenario_sustained), 0, 0, 0, 0, 5000000);
+    }
+
+    if (ret == 0 && test_ctx->cnx_server != NULL) {
+        char cid_name[2 * PICOQUIC_CONNECTION_ID_MAX_SIZE + 1];
+
+        *nb_packets = test_ctx->cnx_server->nb_packets_sent + test_ctx->cnx_server->nb_packets_received;
+        if (picoquic_print_connection_id_hexa(cid_name, sizeof(cid_name), &test_ctx->cnx_server->initial_cnxid) == 0) {
+            (void)picoquic_sprintf(log_name, sizeof(log_name), NULL, "%s.server.log", cid_name);
+        }
+    }
+
+    if (test_ctx != NULL) {
+        if (ret == 0 && mode == BINLOG_RING_BENCH_RING) {
+            uint64_t nb_records = 0;
+            uint64_t nb_dropped = 0;
+
+            picoquic_get_binlog_ring_stats(test_ctx->qserver, &nb_records, &nb_dropped);
+            DBG_PRINTF("Binlog ring, %" PRIu64 " records, %" PRIu64 " dropped\n", nb_records, nb_dropped);
+            if (nb_records == 0) {
+                ret = -1;
+            }
+        }
+        /* Deleting the context flushes the log, which is part of the cost */
+        tls_api_delete_ctx(test_ctx);
+        *elapsed = picoquic_current_time() - start_time;
+    }
+
+    if (log_name[0] != 0) {
+        (void)picoquic_file_delete(log_name, NULL);
+    }
+
+    return ret;
+}
+
+int binlog_ring_bench_test()
+{
+    int ret = 0;
+    char const* mode_name[3] = { "no log", "sync binlog", "ring binlog" };
+
+    for (int mode = BINLOG_RING_BENCH_NONE; ret == 0 && mode <= BINLOG_RING_BENCH_RING; mode++) {
+        uint64_t elapsed = 0;
+        uint64_t nb_packets = 0;
+
+        if ((ret = binlog_ring_bench_one(mode, &elapsed, &nb_packets)) != 0) {
+            DBG_PRINTF("Binlog bench fails for %s, ret = 0x%x\n", mode_name[mode], ret);
+        }
+        else if (nb_packets == 0) {
+            DBG_PRINTF("No packets counted for %s\n", mode_name[mode]);
+            ret = -1;
+        }
+        else {
+            DBG_PRINTF("%s: %" PRIu64 " packets in %" PRIu64 " us, %" PRIu64 " ns per packet\n",
+                mode_name[mode], nb_packets, elapsed, (elapsed * 1000) / nb_packets);
+        }
+    }
+
+    return ret;
+}
+
+/* Log all connections of the server in segments of 64KB. Each segment must
+ * start the connection, and reading the segment through its index must
+ * find the same events as reading all the records in sequence.
+ */
+#define BINLOG_SEGMENT_TEST_SIZE 0x10000
+
+typedef struct st_binlog_segment_test_count_t {
+    picoquic_connection_id_t cid;
+    int nb_sequential;
+    int nb_indexed;
+    int nb_start;
+    int first_is_start;
+} binlog_segment_test_count_t;
+
+static int binlog_segment_test_sequential_cb(bytestream* s, void* cbptr)
+{
+    binlog_segment_test_count_t* count = (binlog_segment_test_count_t*)cbptr;
+    picoquic_connection_id_t cid;
+    uint64_t time = 0;
+    uint64_t path_id = 0;
+    uint64_t id = 0;
+    int ret = byteread_cid(s, &cid);
+
+    if (ret == 0 && picoquic_compare_connection_id(&cid, &count->cid) == 0 &&
+        (ret = byteread_vint(s, &time)) == 0 &&
+        (ret = byteread_vint(s, &path_id)) == 0 &&
+        (ret = byteread_vint(s, &id)) == 0) {
+        if (count->nb_sequential == 0) {
+            count->first_is_start = (id == picoquic_log_event_new_connection);
+        }
+        /* Ticket records are not reported by binlog_convert */
+        if (id != picoquic_log_event_tls_key_update) {
+            count->nb_sequential++;
+        }
+    }
+    return ret;
+}
+
+static int binlog_segment_test_start(uint64_t time, const picoquic_connection_id_t* cid, int client_mode,
+    uint32_t proposed_version, const picoquic_connection_id_t* remote_cnxid, void* cbptr)
+{
+    binlog_segment_test_count_t* count = (binlog_segment_test_count_t*)cbptr;
+    count->nb_start++;
+    count->nb_indexed++;
+    return 0;
+}
+
+static int binlog_segment_test_event(uint64_t time, bytestream* s, void* cbptr)
+{
+    ((binlog_segment_test_count_t*)cbptr)->nb_indexed++;
+    return 0;
+}
+
+static int binlog_segment_test_path_event(uint64_t time, uint64_t path_id, bytestream* s, void* cbptr)
+{
+    ((binlog_segment_test_count_t*)cbptr)->nb_indexed++;
+    return 0;
+}
+
+static int binlog_segment_test_pdu(uint64_t time, int rxtx, bytestream* s, void* cbptr)
+{
+    ((binlog_segment_test_count_t*)cbptr)->nb_indexed++;
+    return 0;
+}
+
+static int binlog_segment_test_packet_start(uint64_t time, uint64_t path_id, uint64_t size,
+    const picoquic_packet_header* ph, int rxtx, void* cbptr)
+{
+    ((binlog_segment_test_count_t*)cbptr)->nb_indexed++;
+    return 0;
+}
+
+static int binlog_segment_test_packet_frame(bytestream* s, void* cbptr)
+{
+    return 0;
+}
+
+static int binlog_segment_test_packet_end(void* cbptr)
+{
+    return 0;
+}
+
+static int binlog_segment_test_end(uint64_t time, void* cbptr)
+{
+    ((binlog_segment_test_count_t*)cbptr)->nb_indexed++;
+    return 0;
+}
+
+static int binlog_segment_test_one_file(char const* segment_name, binlog_segment_test_count_t* count)
+{
+    int ret = 0;
+    uint64_t log_time = 0;
+    uint16_t flags = 0;
+    FILE* f_binlog = picoquic_open_cc_log_file_for_read(segment_name, &flags, &log_time);
+    picohash_table* cids = cidset_create();
+
+    if (f_binlog == NULL || cids == NULL) {
+        ret = -1;
+    }
+    else if (binlog_list_cids(f_binlog, cids) != 0 || !cidset_has_cid(cids, &count->cid)) {
+        DBG_PRINTF("Connection not found in the index of %s\n", segment_name);
+        ret = -1;
+    }
+    else if (fileread_binlog(f_binlog, binlog_segment_test_sequential_cb, count) != 0) {
+        DBG_PRINTF("Cannot read the records of %s\n", segment_name);
+        ret = -1;
+    }
+    else {
+        binlog_convert_cb_t callbacks;
+
+        callbacks.connection_start = binlog_segment_test_start;
+        callbacks.alpn_update = binlog_segment_test_event;
+        callbacks.param_update = binlog_segment_test_event;
+        callbacks.pdu = binlog_segment_test_pdu;
+        callbacks.packet_start = binlog_segment_test_packet_start;
+        callbacks.packet_frame = binlog_segment_test_packet_frame;
+        callbacks.packet_end = binlog_segment_test_packet_end;
+        callbacks.packet_lost = binlog_segment_test_path_event;
+        callbacks.packet_dropped = binlog_segment_test_path_event;
+        callbacks.packet_buffered = binlog_segment_test_path_event;
+        callbacks.cc_update = binlog_segment_test_path_event;
+        callbacks.info_message = binlog_segment_test_event;
+        callbacks.connection_end = binlog_segment_test_end;
+        callbacks.ptr = count;
+
+        if (binlog_convert(f_binlog, &count->cid, &callbacks) != 0) {
+            DBG_PRINTF("Cannot convert %s through the index\n", segment_name);
+            ret = -1;
+        }
+    }
+
+    if (cids != NULL) {
+        (void)cidset_delete(cids);
+    }
+    if (f_binlog != NULL) {
+        picoquic_file_close(f_binlog);
+    }
+
+    return ret;
+}
+
+int binlog_segment_test()
+{
+    uint64_t simulated_time = 0;
+    picoquic_test_tls_api_ctx_t* test_ctx = NULL;
+    binlog_segment_test_count_t count;
+    int nb_segments = 0;
+    char const* previous_run = "previous run";
+    char segment_name[64];
+    FILE* F;
+    int ret = tls_api_init_ctx(&test_ctx, 0, PICOQUIC_TEST_SNI, PICOQUIC_TEST_ALPN, &simulated_time, NULL, NULL, 0, 1, 0);
+
+    memset(&count, 0, sizeof(count));
+
+    if (ret == 0 && test_ctx == NULL) {
+        ret = -1;
+    }
+
+    /* Remove the segments of previous tests, then leave a segment 0 as if
+     * written by a previous run. It shall not be overwritten. */
+    for (int i = 0; i < 256; i++) {
+        (void)picoquic_sprintf(segment_name, sizeof(segment_name), NULL, "binlog.%d.log", i);
+        (void)picoquic_file_delete(segment_name, NULL);
+    }
+    if (ret == 0) {
+        if ((F = picoquic_file_open("binlog.0.log", "wb")) == NULL) {
+            ret = -1;
+        }
+        else {
+            if (fwrite(previous_run, strlen(previous_run), 1, F) != 1) {
+                ret = -1;
+            }
+            picoquic_file_close(F);
+        }
+    }
+
+    if (ret == 0) {
+        picoquic_set_binlog(test_ctx->qserver, ".");
+        picoquic_set_log_level(test_ctx->qserver, 1);
+        ret = picoquic_set_binlog_segments(test_ctx->qserver, BINLOG_SEGMENT_TEST_SIZE);
+    }
+
+    if (ret == 0) {
+        ret = tls_api_one_scenario_body(test_ctx, &simulated_time,
+            test_scenario_sustained, sizeof(test_scenario_sustained), 0, 0, 0, 0, 5000000);
+    }
+
+    if (ret == 0) {
+        if (test_ctx->cnx_server == NULL) {
+            ret = -1;
+        }
+        else {
+            count.cid = test_ctx->cnx_server->initial_cnxid;
+        }
+    }
+
+    if (test_ctx != NULL) {
+        /* Closes and indexes the last segment */
+        tls_api_delete_ctx(test_ctx);
+        test_ctx = NULL;
+    }
+
+    if (ret == 0) {
+        char buffer[64];
+        size_t nb_read = 0;
+
+        if ((F = picoquic_file_open("binlog.0.log", "rb")) == NULL) {
+            ret = -1;
+        }
+        else {
+            nb_read = fread(buffer, 1, sizeof(buffer), F);
+            picoquic_file_close(F);
+            if (nb_read != strlen(previous_run) || memcmp(buffer, previous_run, nb_read) != 0) {
+                DBG_PRINTF("%s", "The segment of the previous run was overwritten");
+                ret = -1;
+            }
+        }
+        (void)picoquic_file_delete("binlog.0.log", NULL);
+    }
+
+    while (ret == 0) {
+        (void)picoquic_sprintf(segment_name, sizeof(segment_name), NULL, "binlog.%d.log", nb_segments + 1);
+        if ((F = picoquic_file_open(segment_name, "rb")) == NULL) {
+            break;
+        }
+        picoquic_file_close(F);
+
+        count.nb_sequential = 0;
+        count.nb_indexed = 0;
+        count.nb_start = 0;
+        count.first_is_start = 0;
+
+        if ((ret = binlog_segment_test_one_file(segment_name, &count)) == 0) {
+            if (count.nb_sequential == 0 || count.nb_sequential != count.nb_indexed) {
+                DBG_PRINTF("Segment %s, %d records in sequence, %d through the index\n",
+                    segment_name, count.nb_sequential, count.nb_indexed);
+                ret = -1;
+            }
+            else if (count.nb_start != 1 || !count.first_is_start) {
+                DBG_PRINTF("Segment %s does not start the connection\n", segment_name);
+                ret = -1;
+            }
+        }
+        (void)picoquic_file_delete(segment_name, NULL);
+        nb_segments++;
+    }
+
+    if (ret == 0 && nb_segments < 2) {
+        DBG_PRINTF("Expected several segments, got %d\n", nb_segments);
+        ret = -1;
+    }
+
+    return ret;
+}
+
+/*
+ * Test of the binary log policies. With sampling, only one connection
+ * in N is logged.
+ */
+#define BINLOG_SAMPLING_TEST_NB_CNX 6
+#define BINLOG_SAMPLING_TEST_ONE_IN_N 3
+
+int binlog_sampling_test()
+{
+    uint64_t simulated_time = 0;
+    picoquic_test_tls_api_ctx_t* test_ctx = NULL;
+    picoquic_cnx_t* cnx[BINLOG_SAMPLING_TEST_NB_CNX];
+    char log_name[BINLOG_SAMPLING_TEST_NB_CNX][256];
+    int ret = tls_api_init_ctx(&test_ctx, 0, PICOQUIC_TEST_SNI, PICOQUIC_TEST_ALPN, &simulated_time, NULL, NULL, 0, 1, 0);
+
+    memset(cnx, 0, sizeof(cnx));
+    memset(log_name, 0, sizeof(log_name));
+
+    if (ret == 0 && test_ctx == NULL) {
+        ret = -1;
+    }
+
+    if (ret == 0) {
+        picoquic_binlog_policy_t policy;
+
+        memset(&policy, 0, sizeof(policy));
+        policy.sample_one_in_n = BINLOG_SAMPLING_TEST_ONE_IN_N;
+        picoquic_set_binlog(test_ctx->qclient, ".");
+        picoquic_set_binlog_policy(test_ctx->qclient, &policy);
+    }
+
+    for (int i = 0; ret == 0 && i < BINLOG_SAMPLING_TEST_NB_CNX; i++) {
+        cnx[i] = picoquic_create_client_cnx(test_ctx->qclient, (struct sockaddr*)&test_ctx->server_addr, simulated_time,
+            0, PICOQUIC_TEST_SNI, PICOQUIC_TEST_ALPN, NULL, NULL);
+        if (cnx[i] == NULL) {
+            ret = -1;
+        }
+        else if (PICOQUIC_CNX_HAS_BINLOG(cnx[i]) != ((i % BINLOG_SAMPLING_TEST_ONE_IN_N) == 0)) {
+            DBG_PRINTF("Connection %d, log expected: %d, found: %d\n", i,
+                (i % BINLOG_SAMPLING_TEST_ONE_IN_N) == 0, PICOQUIC_CNX_HAS_BINLOG(cnx[i]));
+            ret = -1;
+        }
+        else if (cnx[i]->binlog_file_name != NULL) {
+            (void)picoquic_sprintf(log_name[i], sizeof(log_name[i]), NULL, "%s", cnx[i]->binlog_file_name);
+        }
+    }
+
+    for (int i = 0; i < BINLOG_SAMPLING_TEST_NB_CNX; i++) {
+        if (cnx[i] != NULL) {
+            picoquic_delete_cnx(cnx[i]);
+        }
+        if (log_name[i][0] != 0) {
+            (void)picoquic_file_delete(log_name[i], NULL);
+        }
+    }
+
+    if (test_ctx != NULL) {
+        tls_api_delete_ctx(test_ctx);
+        test_ctx = NULL;
+    }
+
+    return ret;
+}
+
+/*
+ * In flight recorder mode, the last K events of the connection are only
+ * written if the connection closes with an error.
+ */
+#define BINLOG_FLIGHT_RECORDER_TEST_DEPTH 64
+
+static int binlog_flight_recorder_test_ring()
+{
+    int ret = 0;
+    void* recorder = binlog_recorder_create(4);
+
+    if (recorder == NULL) {
+        ret = -1;
+    }
+
+    for (uint8_t i = 0; ret == 0 && i < 10; i++) {
+        uint8_t record[16];
+
+        memset(record, i, sizeof(record));
+        ret = binlog_recorder_add(recorder, record, (size_t)i + 1);
+    }
+
+    if (ret == 0 && binlog_recorder_count(recorder) != 4) {
+        ret = -1;
+    }
+
+    for (size_t i = 0; ret == 0 && i < 4; i++) {
+        size_t length = 0;
+        const uint8_t* record = binlog_recorder_get(recorder, i, &length);
+
+        if (record == NULL || length != i + 7 || record[0] != (uint8_t)(i + 6) || record[length - 1] != (uint8_t)(i + 6)) {
+            DBG_PRINTF("Unexpected flight recorder record %zu\n", i);
+            ret = -1;
+        }
+    }
+
+    if (ret == 0 && binlog_recorder_get(recorder, 4, NULL) != NULL) {
+        ret = -1;
+    }
+
+    binlog_recorder_delete(recorder);
+
+    return ret;
+}
+
+static int binlog_flight_recorder_test_one(uint64_t server_error)
+{
+    uint64_t simulated_time = 0;
+    uint64_t loss_mask = 0;
+    picoquic_test_tls_api_ctx_t* test_ctx = NULL;
+    binlog_segment_test_count_t count;
+    char log_name[256];
+    int ret = tls_api_init_ctx(&test_ctx, 0, PICOQUIC_TEST_SNI, PICOQUIC_TEST_ALPN, &simulated_time, NULL, NULL, 0, 1, 0);
+
+    memset(&count, 0, sizeof(count));
+    log_name[0] = 0;
+
+    if (ret == 0 && test_ctx == NULL) {
+        ret = -1;
+    }
+
+    if (ret == 0) {
+        picoquic_binlog_policy_t policy;
+
+        memset(&policy, 0, sizeof(policy));
+        policy.recorder_depth = BINLOG_FLIGHT_RECORDER_TEST_DEPTH;
+        picoquic_set_binlog(test_ctx->qserver, ".");
+        picoquic_set_binlog_policy(test_ctx->qserver, &policy);
+        ret = tls_api_connection_loop(test_ctx, &loss_mask, 0, &simulated_time);
+    }
+
+    if (ret == 0) {
+        char cid_name[2 * PICOQUIC_CONNECTION_ID_MAX_SIZE + 1];
+
+        if (test_ctx->cnx_server == NULL || test_ctx->cnx_server->binlog_recorder == NULL ||
+            picoquic_print_connection_id_hexa(cid_name, sizeof(cid_name), &test_ctx->cnx_server->initial_cnxid) != 0) {
+            ret = -1;
+        }
+        else {
+            count.cid = test_ctx->cnx_server->initial_cnxid;
+            (void)picoquic_sprintf(log_name, sizeof(log_name), NULL, "%s.server.log", cid_name);
+            (void)picoquic_file_delete(log_name, NULL);
+        }
+    }
+
+    if (ret == 0 && server_error != 0) {
+        ret = picoquic_close(test_ctx->cnx_server, server_error);
+    }
+
+    if (ret == 0) {
+        ret = tls_api_close_with_losses(test_ctx, &simulated_time, 0);
+    }
+
+    if (test_ctx != NULL) {
+        tls_api_delete_ctx(test_ctx);
+        test_ctx = NULL;
+    }
+
+    if (ret == 0) {
+        FILE* F = picoquic_file_open(log_name, "rb");
+
+        if (F == NULL) {
+            if (server_error != 0) {
+                DBG_PRINTF("No log for the connection closed with error 0x%" PRIx64 "\n", server_error);
+                ret = -1;
+            }
+        }
+        else {
+            picoquic_file_close(F);
+            if (server_error == 0) {
+                DBG_PRINTF("%s", "Unexpected log for the connection closed without error\n");
+                ret = -1;
+            }
+            else if ((ret = binlog_segment_test_one_file(log_name, &count)) == 0) {
+                /* New connection, the recorded events, and the connection close */
+                if (count.nb_start != 1 || !count.first_is_start ||
+                    count.nb_sequential > BINLOG_FLIGHT_RECORDER_TEST_DEPTH + 2 ||
+                    count.nb_sequential != count.nb_indexed) {
+                    DBG_PRINTF("Unexpected flight recorder log, %d records, %d indexed\n",
+                        count.nb_sequential, count.nb_indexed);
+                    ret = -1;
+                }
+            }
+            (void)picoquic_file_delete(log_name, NULL);
+        }
+    }
+
+    return ret;
+}
+
+int binlog_flight_recorder_test()
+{
+    int ret = binlog_flight_recorder_test_ring();
+
+    if (ret == 0) {
+        ret = binlog_flight_recorder_test_one(0);
+    }
+
+    if (ret == 0) {
+        ret = binlog_flight_recorder_test_one(0x1234);
+    }
+
+    return ret;
+}
+
+/*
+ * Test of the performance log production
+ */
+
+#ifdef _WINDOWS
+#define PERF_TRACE_CLIENT_TEST_REF "picoquictest\\perf_trace_client_ref.txt"
+#define PERF_TRACE_SERVER_TEST_REF "picoquictest\\perf_trace_server_ref.txt"
+#else
+#define PERF_TRACE_CLIENT_TEST_REF "picoquictest/perf_trace_client_ref.txt"
+#define PERF_TRACE_SERVER_TEST_REF "picoquictest/perf_trace_server_ref.txt"
+#endif
+#define PERF_TRACE_CLIENT "perf_trace_client.csv"
+#define PERF_TRACE_SERVER "perf_trace_server.csv"
+
+static int perflog_set_version(char const * buffer2, char * buffer3, size_t buffer3_len)
+{
+    size_t i2 = 0;
+    size_t i3 = 0;
+    int ret = 0;
+
+    while (ret == 0 && buffer2[i2] != 0) {
+        if (buffer2[i2] == '$' && buffer2[i2 + 1] == 'V') {
+            char const* v = PICOQUIC_VERSION;
+            size_t v_len = strlen(v);
+            i2 += 2;
+            if (i3 + v_len < buffer3_len) {
+                memcpy(buffer3 + i3, v, v_len);
+                i3 += v_len;
+            }
+            else {
+                ret = -1;
+            }
+        }
+        else {
+            if (i3 < buffer3_len) {
+                buffer3[i3] = buffer2[i2];
+                i3++;
+                i2++;
+            }
+            else {
+                ret = -1;
+            }
+        }
+    }
+    if (ret == 0) {
+        if (i3 < buffer3_len) {
+            buffer3[i3] = 0;
+        }
+        else {
+            buffer3[buffer3_len - 1] = 0;
+            ret = -1;
+        }
+    }
+    return(ret);
+}
+
+static int perflog_compare(const char* fname1, const char* fname2)
+{
+    int ret = 0;
+    int nb_line = 0;
+    FILE* F1 = picoquic_file_open(fname1, "r");
     FILE* F2 = picoquic_file_open(fname2, "r");
 
-    if (F1 == NULL || F2 == NULL) {
+    if (F1 == NULL || F2 == NULL) {
+        ret = -1;
+    }
+    else {
+        char buffer1[512];
+        char buffer2[512];
+        char buffer3[512];
+
+        while (ret == 0 && fgets(buffer1, sizeof(buffer1), F1) != NULL) {
+            nb_line++;
+            if (fgets(buffer2, sizeof(buffer2), F2) == NULL) {
+                /* F2 is too short */
+                DBG_PRINTF("File %s is shorter than %s\n", fname2, fname1);
+                DBG_PRINTF("    Missing line %d: %s", nb_line, buffer1);
+                ret = -1;
+            }
+            else {
+                /* Replace $V in buffer2 by actual version */
+                ret = perflog_set_version(buffer2, buffer3, sizeof(buffer3));
+
+                if (ret == 0) {
+                    ret = picoquic_compare_lines(buffer1, buffer3);
+                }
+                if (ret != 0)
+                {
+                    DBG_PRINTF("File %s differs %s at line %d\n", fname2, fname1, nb_line);
+                    DBG_PRINTF("    Got: %s", buffer1);
+                    DBG_PRINTF("    Vs:  %s", buffer3);
+                }
+            }
+        }
+
+        if (ret == 0 && fgets(buffer2, sizeof(buffer2), F2) != NULL) {
+            /* F2 is too long */
+            DBG_PRINTF("File %s is longer than %s\n", fname2, fname1);
+            DBG_PRINTF("    Extra line %d: %s", nb_line + 1, buffer2);
+            ret = -1;
+        }
+    }
+
+    if (F1 != NULL) {
+        (void)picoquic_file_close(F1);
+    }
+
+    if (F2 != NULL) {
+        (void)picoquic_file_close(F2);
+    }
+
+    return ret;
+}
+
+#if defined(_WINDOWS) && !defined(_WINDOWS64)
+int perflog_test()
+{
+    /* we do not run this test on Win32 builds */
+    return 0;
+}
+#else
+int perflog_test()
+{
+    uint64_t simulated_time = 0;
+    uint64_t loss_mask = 0;
+    uint64_t target_time = 4000000;
+    picoquic_test_tls_api_ctx_t* test_ctx = NULL;
+    picoquic_connection_id_t initial_cid = { {0x9e, 0x8f, 0x08, 0x8a, 0x8c, 0xe0, 0, 0}, 8 };
+    size_t send_buffer_size = 0xFFFF;
+    const uint64_t latency_target = 35000;
+    const uint64_t picosec_per_byte = (1000000ull * 8) / 100;
+    int ret;
+
+    (void)picoquic_file_delete(PERF_TRACE_CLIENT, NULL);
+    (void)picoquic_file_delete(PERF_TRACE_SERVER, NULL);
+
+    ret = tls_api_init_ctx_ex2(&test_ctx, PICOQUIC_INTERNAL_TEST_VERSION_1,
+        PICOQUIC_TEST_SNI, PICOQUIC_TEST_ALPN, &simulated_time, NULL, NULL, 0, 0, 0, &initial_cid, 8, 0, send_buffer_size, 0);
+
+    if (ret == 0 && test_ctx == NULL) {
+        ret = -1;
+    }
+
+    /* Require a performance trace of thee server side */
+    if (ret == 0) {
+        picoquic_perflog_setup(test_ctx->qclient, PERF_TRACE_CLIENT);
+        picoquic_perflog_setup(test_ctx->qserver, PERF_TRACE_SERVER);
+        /* Set parameters to simulate random early drop */
+        test_ctx->c_to_s_link->microsec_latency = latency_target;
+        test_ctx->c_to_s_link->picosec_per_byte = picosec_per_byte;
+        test_ctx->s_to_c_link->microsec_latency = latency_target;
+        test_ctx->s_to_c_link->picosec_per_byte = picosec_per_byte;
+        /* Set the CC algorithm to selected value */
+        picoquic_set_default_congestion_algorithm(test_ctx->qserver, picoquic_bbr_algorithm);
+    }
+
+    if (ret == 0) {
+        ret = tls_api_connection_loop(test_ctx, &loss_mask, latency_target, &simulated_time);
+    }
+
+    /* Prepare to send data */
+    if (ret == 0) {
+        ret = test_api_init_send_recv_scenario(test_ctx, test_scenario_sustained2, sizeof(test_scenario_sustained2));
+    }
+
+    /* Try to complete the data sending loop */
+    if (ret == 0) {
+        ret = tls_api_data_sending_loop(test_ctx, &loss_mask, &simulated_time, 0);
+    }
+
+    /* verify that the transmission was complete */
+    if (ret == 0) {
+        ret = tls_api_one_scenario_body_verify(test_ctx, &simulated_time, target_time);
+    }
+
+    /* Free the resource, which will force writing the performance log files. */
+
+    if (test_ctx != NULL) {
+        tls_api_delete_ctx(test_ctx);
+        test_ctx = NULL;
+    }
+
+    /* Verify that the performance logs are as expected. */
+    for (int i = 0; ret == 0 && i < 2; i++) {
+        char perf_trace_test_ref[512];
+
+        ret = picoquic_get_input_path(perf_trace_test_ref, sizeof(perf_trace_test_ref), picoquic_solution_dir,
+            (i)?PERF_TRACE_CLIENT_TEST_REF: PERF_TRACE_SERVER_TEST_REF);
+
+        if (ret != 0) {
+            DBG_PRINTF("Cannot set the perf trace test ref file name for the %s.\n",
+                (i)?"client":"server");
+        }
+        else {
+            ret = perflog_compare((i)?PERF_TRACE_CLIENT: PERF_TRACE_SERVER, perf_trace_test_ref);
+        }
+    }
+
+    return ret;
+}
+#endif
+
+/*
+ * Test of the streaming performance log. The server rows are written
+ * by the writer thread, with snapshots of the connection every 500ms and
+ * a small maximum file size, so the log is rotated several times. Each
+ * file must start with the header, and the files must contain the
+ * snapshots and exactly one final row.
+ */
+#define PERF_STREAM_SERVER "perf_stream_server.csv"
+#define PERF_STREAM_MAX_FILES 64
+
+static int perflog_stream_check_file(char const* file_name, int* nb_snapshots, int* nb_final)
+{
+    int ret = 0;
+    int nb_lines = 0;
+    char line[PICOQUIC_PERFLOG_ROW_MAX];
+    FILE* F = picoquic_file_open(file_name, "r");
+
+    if (F == NULL) {
+        ret = -1;
+    }
+    else {
+        while (ret == 0 && fgets(line, sizeof(line), F) != NULL) {
+            size_t len = strlen(line);
+
+            nb_lines++;
+            if (nb_lines == 1) {
+                if (strncmp(line, "Log_v,", 6) != 0) {
+                    DBG_PRINTF("File %s does not start with the header\n", file_name);
+                    ret = -1;
+                }
+            }
+            else if (len >= 4 && strcmp(line + len - 4, ", 1\n") == 0) {
+                *nb_snapshots += 1;
+            }
+            else if (len >= 4 && strcmp(line + len - 4, ", 0\n") == 0) {
+                *nb_final += 1;
+            }
+            else {
+                DBG_PRINTF("Unexpected line %d in %s: %s", nb_lines, file_name, line);
+                ret = -1;
+            }
+        }
+        (void)picoquic_file_close(F);
+    }
+
+    return ret;
+}
+
+int perflog_stream_test()
+{
+    uint64_t simulated_time = 0;
+    uint64_t loss_mask = 0;
+    uint64_t target_time = 4000000;
+    uint64_t nb_rows = 0;
+    uint64_t nb_dropped = 0;
+    picoquic_test_tls_api_ctx_t* test_ctx = NULL;
+    const uint64_t latency_target = 35000;
+    const uint64_t picosec_per_byte = (1000000ull * 8) / 100;
+    int nb_files = 0;
+    int nb_snapshots = 0;
+    int nb_final = 0;
+    char file_name[128];
+    int ret;
+
+    (void)picoquic_file_delete(PERF_STREAM_SERVER, NULL);
+    for (int i = 1; i < PERF_STREAM_MAX_FILES; i++) {
+        (void)picoquic_sprintf(file_name, sizeof(file_name), NULL, "%s.%d", PERF_STREAM_SERVER, i);
+        (void)picoquic_file_delete(file_name, NULL);
+    }
+
+    ret = tls_api_init_ctx(&test_ctx, PICOQUIC_INTERNAL_TEST_VERSION_1,
+        PICOQUIC_TEST_SNI, PICOQUIC_TEST_ALPN, &simulated_time, NULL, NULL, 0, 0, 0);
+
+    if (ret == 0 && test_ctx == NULL) {
         ret = -1;
     }
-    else {
-        char buffer1[512];
-        char buffer2[512];
-        char buffer3[512];
 
-        while (ret == 0 && fgets(buffer1, sizeof(buffer1), F1) != NULL) {
-            nb_line++;
-            if (fgets(buffer2, sizeof(buffer2), F2) == NULL) {
-                /* F2 is too short */
-                DBG_PRINTF("File %s is shorter than %s\n", fname2, fname1);
-                DBG_PRINTF("    Missing line %d: %s", nb_line, buffer1);
-                ret = -1;
-            }
-            else {
-                /* Replace $V in buffer2 by actual version */
-                ret = perflog_set_version(buffer2, buffer3, sizeof(buffer3));
+    if (ret == 0) {
+        picoquic_perflog_stream_options_t options;
 
-                if (ret == 0) {
-                    ret = picoquic_compare_lines(buffer1, buffer3);
-                }
-                if (ret != 0)
-                {
-                    DBG_PRINTF("File %s differs %s at line %d\n", fname2, fname1, nb_line);
-                    DBG_PRINTF("    Got: %s", buffer1);
-                    DBG_PRINTF("    Vs:  %s", buffer3);
-                }
-            }
+        memset(&options, 0, sizeof(options));
+        options.fsync_interval = 1000;
+        options.max_file_size = 1024;
+        options.snapshot_interval = 500000;
+        ret = picoquic_perflog_setup_streaming(test_ctx->qserver, PERF_STREAM_SERVER, &options);
+        test_ctx->c_to_s_link->microsec_latency = latency_target;
+        test_ctx->c_to_s_link->picosec_per_byte = picosec_per_byte;
+        test_ctx->s_to_c_link->microsec_latency = latency_target;
+        test_ctx->s_to_c_link->picosec_per_byte = picosec_per_byte;
+    }
+
+    if (ret == 0) {
+        ret = tls_api_connection_loop(test_ctx, &loss_mask, latency_target, &simulated_time);
+    }
+
+    if (ret == 0) {
+        ret = test_api_init_send_recv_scenario(test_ctx, test_scenario_sustained2, sizeof(test_scenario_sustained2));
+    }
+
+    if (ret == 0) {
+        ret = tls_api_data_sending_loop(test_ctx, &loss_mask, &simulated_time, 0);
+    }
+
+    if (ret == 0) {
+        ret = tls_api_one_scenario_body_verify(test_ctx, &simulated_time, target_time);
+    }
+
+    if (test_ctx != NULL) {
+        /* Deleting the server connection adds the final row, deleting the
+         * context writes the remaining rows and closes the file. */
+        if (test_ctx->cnx_server != NULL) {
+            picoquic_delete_cnx(test_ctx->cnx_server);
+            test_ctx->cnx_server = NULL;
         }
+        picoquic_perflog_get_stream_stats(test_ctx->qserver, &nb_rows, &nb_dropped);
+        tls_api_delete_ctx(test_ctx);
+        test_ctx = NULL;
+    }
 
-        if (ret == 0 && fgets(buffer2, sizeof(buffer2), F2) != NULL) {
-            /* F2 is too long */
-            DBG_PRINTF("File %s is longer than %s\n", fname2, fname1);
-            DBG_PRINTF("    Extra line %d: %s", nb_line + 1, buffer2);
-            ret = -1;
+    if (ret == 0 && (nb_rows < 2 || nb_dropped != 0)) {
+        DBG_PRINTF("Perflog stream, %" PRIu64 " rows, %" PRIu64 " dropped\n", nb_rows, nb_dropped);
+        ret = -1;
+    }
+
+    for (int i = 0; ret == 0 && i < PERF_STREAM_MAX_FILES; i++) {
+        FILE* F;
+
+        if (i == 0) {
+            (void)picoquic_sprintf(file_name, sizeof(file_name), NULL, "%s", PERF_STREAM_SERVER);
+        }
+        else {
+            (void)picoquic_sprintf(file_name, sizeof(file_name), NULL, "%s.%d", PERF_STREAM_SERVER, i);
+        }
+        if ((F = picoquic_file_open(file_name, "r")) == NULL) {
+            break;
         }
+        (void)picoquic_file_close(F);
+        nb_files++;
+        ret = perflog_stream_check_file(file_name, &nb_snapshots, &nb_final);
+        (void)picoquic_file_delete(file_name, NULL);
     }
 
-    if (F1 != NULL) {
-        (void)picoquic_file_close(F1);
+    if (ret == 0 && (nb_files < 2 || nb_snapshots < 2 || nb_final != 1 || (uint64_t)(nb_snapshots + nb_final) != nb_rows)) {
+        DBG_PRINTF("Perflog stream, %d files, %d snapshots, %d final rows\n", nb_files, nb_snapshots, nb_final);
+        ret = -1;
     }
 
-    if (F2 != NULL) {
-        (void)picoquic_file_close(F2);
+    return ret;
+}
+
+/*
+ * Test the metrics registry. The bucket functions are checked first, then
+ * the registry is enabled on the server of a simulated connection, and the
+ * counters are compared to the connection statistics.
+ */
+#define METRICS_TEST_FILE "metrics_test.txt"
+
+static int metrics_bucket_test()
+{
+    int ret = 0;
+    uint64_t v = 0;
+    picoquic_metrics_histogram_t* h;
+
+    while (ret == 0) {
+        size_t index = picoquic_metrics_bucket_index(v);
+
+        if (index >= PICOQUIC_METRICS_NB_BUCKETS || picoquic_metrics_bucket_upper(index) < v ||
+            (index > 0 && picoquic_metrics_bucket_upper(index - 1) >= v)) {
+            DBG_PRINTF("Bad bucket %zu for value %" PRIu64 "\n", index, v);
+            ret = -1;
+        }
+        else if (v == UINT64_MAX) {
+            break;
+        }
+        else if (v < 2048) {
+            v++;
+        }
+        else {
+            v = (v + (v >> 3) + 1 < v) ? UINT64_MAX : v + (v >> 3) + 1;
+        }
+    }
+
+    if (ret == 0) {
+        if ((h = (picoquic_metrics_histogram_t*)malloc(sizeof(picoquic_metrics_histogram_t))) == NULL) {
+            ret = -1;
+        }
+        else {
+            uint64_t median;
+
+            memset(h, 0, sizeof(picoquic_metrics_histogram_t));
+            for (v = 1; v <= 1000; v++) {
+                h->bucket[picoquic_metrics_bucket_index(v)]++;
+                h->count++;
+                h->sum += v;
+            }
+            h->min = 1;
+            h->max = 1000;
+            median = picoquic_metrics_quantile(h, 0.5);
+            if (median < 500 || median > 563 || picoquic_metrics_quantile(h, 1.0) != 1000) {
+                DBG_PRINTF("Bad median %" PRIu64 "\n", median);
+                ret = -1;
+            }
+            free(h);
+        }
     }
 
     return ret;
 }
 
-#if defined(_WINDOWS) && !defined(_WINDOWS64)
-int perflog_test()
+static int metrics_check_text(char const* file_name, uint64_t nb_packets_sent)
 {
-    /* we do not run this test on Win32 builds */
-    return 0;
+    int ret = 0;
+    int is_found = 0;
+    int nb_lines = 0;
+    char line[256];
+    char expected[128];
+    FILE* F = picoquic_file_open(file_name, "r");
+
+    (void)picoquic_sprintf(expected, sizeof(expected), NULL, "picoquic_packets_sent_total %" PRIu64 "\n", nb_packets_sent);
+    if (F == NULL) {
+        ret = -1;
+    }
+    else {
+        while (ret == 0 && fgets(line, sizeof(line), F) != NULL) {
+            nb_lines++;
+            if (strcmp(line, expected) == 0) {
+                is_found = 1;
+            }
+            else if (line[0] != '#' && strncmp(line, "picoquic_", 9) != 0) {
+                DBG_PRINTF("Unexpected line: %s", line);
+                ret = -1;
+            }
+        }
+        (void)picoquic_file_close(F);
+    }
+
+    if (ret == 0 && (!is_found || nb_lines < 2 * (picoquic_metrics_counter_max + picoquic_metrics_gauge_max))) {
+        DBG_PRINTF("Metrics text, %d lines, packets sent found: %d\n", nb_lines, is_found);
+        ret = -1;
+    }
+
+    return ret;
 }
-#else
-int perflog_test()
+
+int metrics_test()
 {
     uint64_t simulated_time = 0;
     uint64_t loss_mask = 0;
-    uint64_t target_time = 4000000;
     picoquic_test_tls_api_ctx_t* test_ctx = NULL;
-    picoquic_connection_id_t initial_cid = { {0x9e, 0x8f, 0x08, 0x8a, 0x8c, 0xe0, 0, 0}, 8 };
-    size_t send_buffer_size = 0xFFFF;
-    const uint64_t latency_target = 35000;
-    const uint64_t picosec_per_byte = (1000000ull * 8) / 100;
-    int ret;
+    picoquic_metrics_snapshot_t* snapshot = NULL;
+    const uint64_t latency_target = 10000;
+    uint64_t nb_packets_sent = 0;
+    int ret = metrics_bucket_test();
 
-    (void)picoquic_file_delete(PERF_TRACE_CLIENT, NULL);
-    (void)picoquic_file_delete(PERF_TRACE_SERVER, NULL);
+    if (ret == 0) {
+        snapshot = (picoquic_metrics_snapshot_t*)malloc(sizeof(picoquic_metrics_snapshot_t));
+        if (snapshot == NULL) {
+            ret = -1;
+        }
+    }
 
-    ret = tls_api_init_ctx_ex2(&test_ctx, PICOQUIC_INTERNAL_TEST_VERSION_1,
-        PICOQUIC_TEST_SNI, PICOQUIC_TEST_ALPN, &simulated_time, NULL, NULL, 0, 0, 0, &initial_cid, 8, 0, send_buffer_size, 0);
+    if (ret == 0) {
+        ret = tls_api_init_ctx(&test_ctx, PICOQUIC_INTERNAL_TEST_VERSION_1,
+            PICOQUIC_TEST_SNI, PICOQUIC_TEST_ALPN, &simulated_time, NULL, NULL, 0, 0, 0);
+        if (ret == 0 && test_ctx == NULL) {
+            ret = -1;
+        }
+    }
 
-    if (ret == 0 && test_ctx == NULL) {
+    if (ret == 0 && picoquic_metrics_get_snapshot(test_ctx->qserver, snapshot) == 0) {
+        DBG_PRINTF("%s", "Metrics available before being enabled\n");
         ret = -1;
     }
 
-    /* Require a performance trace of thee server side */
     if (ret == 0) {
-        picoquic_perflog_setup(test_ctx->qclient, PERF_TRACE_CLIENT);
-        picoquic_perflog_setup(test_ctx->qserver, PERF_TRACE_SERVER);
-        /* Set parameters to simulate random early drop */
+        ret = picoquic_metrics_enable(test_ctx->qserver);
         test_ctx->c_to_s_link->microsec_latency = latency_target;
-        test_ctx->c_to_s_link->picosec_per_byte = picosec_per_byte;
         test_ctx->s_to_c_link->microsec_latency = latency_target;
-        test_ctx->s_to_c_link->picosec_per_byte = picosec_per_byte;
-        /* Set the CC algorithm to selected value */
-        picoquic_set_default_congestion_algorithm(test_ctx->qserver, picoquic_bbr_algorithm);
     }
 
     if (ret == 0) {
-        ret = tls_api_connection_loop(test_ctx, &loss_mask, latency_target, &simulated_time);
+        ret = tls_api_connection_loop(test_ctx, &loss_mask, 2 * latency_target, &simulated_time);
     }
 
-    /* Prepare to send data */
     if (ret == 0) {
-        ret = test_api_init_send_recv_scenario(test_ctx, test_scenario_sustained2, sizeof(test_scenario_sustained2));
+        ret = test_api_init_send_recv_scenario(test_ctx, test_scenario_sustained, sizeof(test_scenario_sustained));
     }
 
-    /* Try to complete the data sending loop */
     if (ret == 0) {
         ret = tls_api_data_sending_loop(test_ctx, &loss_mask, &simulated_time, 0);
     }
 
-    /* verify that the transmission was complete */
+    if (ret == 0 && test_ctx->cnx_server == NULL) {
+        ret = -1;
+    }
+
     if (ret == 0) {
-        ret = tls_api_one_scenario_body_verify(test_ctx, &simulated_time, target_time);
+        picoquic_cnx_t* cnx = test_ctx->cnx_server;
+        picoquic_metrics_histogram_t* rtt;
+
+        picoquic_metrics_sample_pools(test_ctx->qserver);
+        ret = picoquic_metrics_get_snapshot(test_ctx->qserver, snapshot);
+        rtt = &snapshot->histogram[picoquic_metrics_rtt];
+        nb_packets_sent = snapshot->counter[picoquic_metrics_packets_sent];
+
+        if (ret == 0 && (nb_packets_sent != cnx->nb_packets_sent ||
+            snapshot->counter[picoquic_metrics_packets_received] != cnx->nb_packets_received ||
+            snapshot->counter[picoquic_metrics_retransmissions] != cnx->nb_retransmission_total ||
+            snapshot->counter[picoquic_metrics_trains_sent] != cnx->nb_trains_sent ||
+            snapshot->histogram[picoquic_metrics_train_packets].count != cnx->nb_trains_sent ||
+            snapshot->histogram[picoquic_metrics_train_packets].sum != cnx->nb_packets_sent)) {
+            DBG_PRINTF("Metrics counters, %" PRIu64 " packets sent vs %" PRIu64 "\n", nb_packets_sent, cnx->nb_packets_sent);
+            ret = -1;
+        }
+
+        if (ret == 0 && (snapshot->counter[picoquic_metrics_cnx_created] != 1 ||
+            snapshot->gauge[picoquic_metrics_connections] != 1 ||
+            snapshot->histogram[picoquic_metrics_handshake_time].count != 1 ||
+            snapshot->histogram[picoquic_metrics_handshake_time].min < 2 * latency_target ||
+            snapshot->histogram[picoquic_metrics_packet_time].count == 0 ||
+            snapshot->histogram[picoquic_metrics_cwin].count != rtt->count ||
+            snapshot->histogram[picoquic_metrics_packet_pool].count != 1)) {
+            DBG_PRINTF("%s", "Metrics connection or pool values do not match\n");
+            ret = -1;
+        }
+
+        if (ret == 0 && (rtt->count == 0 || picoquic_metrics_quantile(rtt, 0.5) < 2 * latency_target ||
+            picoquic_metrics_quantile(rtt, 0.5) > rtt->max)) {
+            DBG_PRINTF("Metrics RTT, %" PRIu64 " samples, median %" PRIu64 "\n", rtt->count,
+                picoquic_metrics_quantile(rtt, 0.5));
+            ret = -1;
+        }
     }
 
-    /* Free the resource, which will force writing the performance log files. */
+    if (ret == 0) {
+        FILE* F = picoquic_file_open(METRICS_TEST_FILE, "w");
+
+        if (F == NULL) {
+            ret = -1;
+        }
+        else {
+            ret = picoquic_metrics_write_prometheus(test_ctx->qserver, F);
+            (void)picoquic_file_close(F);
+        }
+
+        if (ret == 0) {
+            ret = metrics_check_text(METRICS_TEST_FILE, nb_packets_sent);
+        }
+    }
+
+    if (ret == 0) {
+        picoquic_delete_cnx(test_ctx->cnx_server);
+        test_ctx->cnx_server = NULL;
+        if (picoquic_metrics_get_snapshot(test_ctx->qserver, snapshot) != 0 ||
+            snapshot->counter[picoquic_metrics_cnx_deleted] != 1) {
+            DBG_PRINTF("%s", "Deleted connection not counted\n");
+            ret = -1;
+        }
+    }
 
     if (test_ctx != NULL) {
         tls_api_delete_ctx(test_ctx);
-        test_ctx = NULL;
     }
 
-    /* Verify that the performance logs are as expected. */
-    for (int i = 0; ret == 0 && i < 2; i++) {
-        char perf_trace_test_ref[512];
+    if (snapshot != NULL) {
+        free(snapshot);
+    }
 
-        ret = picoquic_get_input_path(perf_trace_test_ref, sizeof(perf_trace_test_ref), picoquic_solution_dir,
-            (i)?PERF_TRACE_CLIENT_TEST_REF: PERF_TRACE_SERVER_TEST_REF);
+    return ret;
+}
 
-        if (ret != 0) {
-            DBG_PRINTF("Cannot set the perf trace test ref file name for the %s.\n",
-                (i)?"client":"server");
+/*
+ * Check the per phase counters. The names and the get/reset API are
+ * always available; the counters are only updated if the library is
+ * compiled with PICOQUIC_WITH_PHASE_PROFILE.
+ */
+int phase_profile_test()
+{
+    uint64_t simulated_time = 0;
+    uint64_t loss_mask = 0;
+    picoquic_test_tls_api_ctx_t* test_ctx = NULL;
+    picoquic_phase_stats_t stats;
+    int ret = 0;
+
+    for (int i = 0; ret == 0 && i < picoquic_phase_max; i++) {
+        if (strcmp(picoquic_phase_name((picoquic_phase_enum)i), "unknown") == 0) {
+            DBG_PRINTF("No name for phase %d\n", i);
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        ret = tls_api_init_ctx(&test_ctx, PICOQUIC_INTERNAL_TEST_VERSION_1,
+            PICOQUIC_TEST_SNI, PICOQUIC_TEST_ALPN, &simulated_time, NULL, NULL, 0, 0, 0);
+        if (ret == 0 && test_ctx == NULL) {
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        ret = tls_api_connection_loop(test_ctx, &loss_mask, 0, &simulated_time);
+    }
+
+    if (ret == 0) {
+        ret = test_api_init_send_recv_scenario(test_ctx, test_scenario_sustained, sizeof(test_scenario_sustained));
+    }
+
+    if (ret == 0) {
+        ret = tls_api_data_sending_loop(test_ctx, &loss_mask, &simulated_time, 0);
+    }
+
+    if (ret == 0) {
+        picoquic_get_phase_stats(test_ctx->qserver, &stats);
+        if (picoquic_phase_profile_is_enabled()) {
+            const picoquic_phase_enum expected[5] = {
+                picoquic_phase_header_parse, picoquic_phase_decrypt, picoquic_phase_frame_decode,
+                picoquic_phase_packet_format, picoquic_phase_encrypt };
+
+            for (int i = 0; ret == 0 && i < 5; i++) {
+                if (stats.calls[expected[i]] == 0) {
+                    DBG_PRINTF("No calls counted for phase %s\n", picoquic_phase_name(expected[i]));
+                    ret = -1;
+                }
+            }
+            if (ret == 0 && (stats.calls[picoquic_phase_ack_processing] == 0 ||
+                stats.calls[picoquic_phase_cc_update] == 0)) {
+                DBG_PRINTF("%s", "ACK or congestion control phases not counted\n");
+                ret = -1;
+            }
         }
         else {
-            ret = perflog_compare((i)?PERF_TRACE_CLIENT: PERF_TRACE_SERVER, perf_trace_test_ref);
+            for (int i = 0; ret == 0 && i < picoquic_phase_max; i++) {
+                if (stats.calls[i] != 0 || stats.ticks[i] != 0) {
+                    DBG_PRINTF("Phase %s counted without profiling\n", picoquic_phase_name((picoquic_phase_enum)i));
+                    ret = -1;
+                }
+            }
+        }
+    }
+
+    if (ret == 0) {
+        picoquic_reset_phase_stats(test_ctx->qserver);
+        picoquic_get_phase_stats(test_ctx->qserver, &stats);
+        for (int i = 0; ret == 0 && i < picoquic_phase_max; i++) {
+            if (stats.calls[i] != 0 || stats.ticks[i] != 0) {
+                DBG_PRINTF("Phase %s not reset\n", picoquic_phase_name((picoquic_phase_enum)i));
+                ret = -1;
+            }
         }
     }
 
+    if (test_ctx != NULL) {
+        tls_api_delete_ctx(test_ctx);
+    }
+
     return ret;
 }
-#endif
 
 /*
  * Testing the flow controlled sending scenario, or "direct sending".
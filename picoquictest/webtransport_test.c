@@ -267,4 +267,156 @@ int picowt_baton_random_test()
     int ret = picowt_baton_test_one(7, "/baton?count=4", 0, 5000000, ".", ".");
 
     return ret;
-}
\ No newline at end of file
+}
+
+/* Benchmark of the web transport datagram path, with many baton sessions
+ * sharing a connection. The test does not run the simulation: datagrams are
+ * passed directly to the h3zero datagram callback, and outgoing datagrams are
+ * formatted by the picoquic datagram frame logic, as when preparing packets.
+ * The test verifies that the datagrams are delivered to the right sessions,
+ * that all sessions get to send in round robin, and that datagrams of several
+ * sessions are batched in the same packet.
+ */
+#define WT_BATON_DATAGRAM_SESSIONS 512
+#define WT_BATON_DATAGRAM_ROUNDS 20
+#define WT_BATON_DATAGRAM_SIZE 64
+
+int picowt_baton_datagram_test()
+{
+    uint64_t simulated_time = 0;
+    picoquic_test_tls_api_ctx_t* test_ctx = NULL;
+    picoquic_connection_id_t initial_cid = { {0x77, 0x74, 0xba, 0xd9, 0, 0, 0, 0}, 8 };
+    h3zero_callback_ctx_t* h3_ctx = NULL;
+    wt_baton_ctx_t* baton_ctx = (wt_baton_ctx_t*)malloc(WT_BATON_DATAGRAM_SESSIONS * sizeof(wt_baton_ctx_t));
+    uint8_t datagram[WT_BATON_DATAGRAM_SESSIONS][16];
+    size_t datagram_length[WT_BATON_DATAGRAM_SESSIONS];
+    uint64_t nb_packets = 0;
+    uint64_t receive_time = 0;
+    uint64_t send_time = 0;
+    int ret = tls_api_init_ctx_ex(&test_ctx, PICOQUIC_INTERNAL_TEST_VERSION_1,
+        PICOQUIC_TEST_SNI, "h3", &simulated_time, NULL, NULL, 0, 1, 0, &initial_cid);
+
+    if (ret == 0 && (baton_ctx == NULL || (h3_ctx = h3zero_callback_create_context(NULL)) == NULL)) {
+        ret = -1;
+    }
+
+    if (ret == 0) {
+        picoquic_set_callback(test_ctx->cnx_client, h3zero_callback, h3_ctx);
+        test_ctx->cnx_client->remote_parameters.max_datagram_frame_size = PICOQUIC_MAX_PACKET_SIZE;
+        for (int i = 0; ret == 0 && i < WT_BATON_DATAGRAM_SESSIONS; i++) {
+            h3zero_stream_ctx_t* stream_ctx = h3zero_find_or_create_stream(test_ctx->cnx_client, 4 * (uint64_t)i, h3_ctx, 1, 1);
+            uint8_t* bytes;
+
+            if (stream_ctx == NULL || wt_baton_ctx_init(&baton_ctx[i], h3_ctx, NULL, stream_ctx) != 0) {
+                DBG_PRINTF("Cannot create session %d", i);
+                ret = -1;
+            }
+            else if ((bytes = picoquic_frames_varint_encode(datagram[i], datagram[i] + 16, (uint64_t)i)) == NULL) {
+                ret = -1;
+            }
+            else {
+                baton_ctx[i].is_client = 1;
+                baton_ctx[i].datagram_size = WT_BATON_DATAGRAM_SIZE;
+                /* Empty padding, coded on 2 bytes, followed by the baton */
+                *bytes++ = 0x40;
+                *bytes++ = 0;
+                *bytes++ = 0;
+                datagram_length[i] = bytes - datagram[i];
+            }
+        }
+    }
+
+    /* Incoming datagrams, sessions visited in a different order at each round */
+    for (int r = 0; ret == 0 && r < WT_BATON_DATAGRAM_ROUNDS; r++) {
+        uint64_t start_time = picoquic_current_time();
+
+        for (int k = 0; k < WT_BATON_DATAGRAM_SESSIONS; k++) {
+            int i = (k * 7 + r) % WT_BATON_DATAGRAM_SESSIONS;
+            datagram[i][datagram_length[i] - 1] = (uint8_t)(r + 1);
+            (void)h3zero_callback_datagram(test_ctx->cnx_client, datagram[i], datagram_length[i], h3_ctx);
+        }
+        receive_time += picoquic_current_time() - start_time;
+    }
+    if (ret == 0) {
+        /* Datagrams for unknown sessions are ignored */
+        uint8_t unknown[16];
+        uint8_t* bytes = picoquic_frames_varint_encode(unknown, unknown + 16, WT_BATON_DATAGRAM_SESSIONS + 1);
+
+        if (bytes == NULL || h3zero_callback_datagram(test_ctx->cnx_client, unknown, bytes - unknown, h3_ctx) != 0) {
+            ret = -1;
+        }
+    }
+    for (int i = 0; ret == 0 && i < WT_BATON_DATAGRAM_SESSIONS; i++) {
+        if (baton_ctx[i].nb_datagrams_received != WT_BATON_DATAGRAM_ROUNDS ||
+            baton_ctx[i].baton_datagram_received != WT_BATON_DATAGRAM_ROUNDS) {
+            DBG_PRINTF("Session %d received %d datagrams, last baton %d", i,
+                baton_ctx[i].nb_datagrams_received, baton_ctx[i].baton_datagram_received);
+            ret = -1;
+        }
+    }
+
+    /* Outgoing datagrams, all sessions ready at each round */
+    for (int r = 0; ret == 0 && r < WT_BATON_DATAGRAM_ROUNDS; r++) {
+        uint64_t start_time;
+
+        for (int i = 0; ret == 0 && i < WT_BATON_DATAGRAM_SESSIONS; i++) {
+            baton_ctx[i].is_datagram_ready = 1;
+            baton_ctx[i].baton_datagram_send_next = (uint8_t)(r + 1);
+            ret = h3zero_set_datagram_ready(test_ctx->cnx_client, baton_ctx[i].control_stream_id);
+        }
+        start_time = picoquic_current_time();
+        while (ret == 0 && test_ctx->cnx_client->is_datagram_ready) {
+            uint8_t packet[PICOQUIC_MAX_PACKET_SIZE];
+            int more_data = 0;
+            int is_pure_ack = 1;
+            uint8_t* bytes = picoquic_format_ready_datagram_frame(test_ctx->cnx_client, test_ctx->cnx_client->path[0],
+                packet, packet + 1440, &more_data, &is_pure_ack, &ret);
+
+            /* Picoquic fills the packet with as many datagrams as possible */
+            while (ret == 0 && bytes != NULL && bytes > packet && test_ctx->cnx_client->is_datagram_ready) {
+                uint8_t* next_bytes = picoquic_format_ready_datagram_frame(test_ctx->cnx_client, test_ctx->cnx_client->path[0],
+                    bytes, packet + 1440, &more_data, &is_pure_ack, &ret);
+                if (next_bytes == bytes) {
+                    break;
+                }
+                bytes = next_bytes;
+            }
+            if (bytes == NULL || bytes == packet) {
+                DBG_PRINTF("No datagram sent at round %d", r);
+                ret = -1;
+            }
+            nb_packets++;
+        }
+        send_time += picoquic_current_time() - start_time;
+        for (int i = 0; ret == 0 && i < WT_BATON_DATAGRAM_SESSIONS; i++) {
+            if (baton_ctx[i].nb_datagrams_sent != r + 1) {
+                DBG_PRINTF("Session %d sent %d datagrams at round %d", i, baton_ctx[i].nb_datagrams_sent, r);
+                ret = -1;
+            }
+        }
+    }
+
+    if (ret == 0) {
+        uint64_t nb_datagrams = (uint64_t)WT_BATON_DATAGRAM_SESSIONS * WT_BATON_DATAGRAM_ROUNDS;
+
+        DBG_PRINTF("%d sessions, %" PRIu64 " datagrams received in %" PRIu64 " us, %" PRIu64 " sent in %" PRIu64 " us, %" PRIu64 " packets",
+            WT_BATON_DATAGRAM_SESSIONS, nb_datagrams, receive_time, nb_datagrams, send_time, nb_packets);
+        if (nb_packets * 8 > nb_datagrams) {
+            DBG_PRINTF("%s", "Datagrams of different sessions are not batched");
+            ret = -1;
+        }
+    }
+
+    if (h3_ctx != NULL) {
+        picoquic_set_callback(test_ctx->cnx_client, NULL, NULL);
+        h3zero_callback_delete_context(test_ctx->cnx_client, h3_ctx);
+    }
+    if (baton_ctx != NULL) {
+        free(baton_ctx);
+    }
+    if (test_ctx != NULL) {
+        tls_api_delete_ctx(test_ctx);
+    }
+
+    return ret;
+}